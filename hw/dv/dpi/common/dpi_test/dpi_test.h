@@ -0,0 +1,131 @@
+// Copyright lowRISC contributors (OpenTitan project).
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef OPENTITAN_HW_DV_DPI_COMMON_DPI_TEST_DPI_TEST_H_
+#define OPENTITAN_HW_DV_DPI_COMMON_DPI_TEST_DPI_TEST_H_
+
+/**
+ * Helpers for tests of the C halves of DPI modules
+ *
+ * A test ticks the module from its main thread and talks to the module's
+ * socket from a client thread, over the loopback interface. Failed checks are
+ * counted rather than aborting the test, and dpi_test_finish() turns the count
+ * into the exit status.
+ *
+ * Everything here is static, so include this header from a single source file
+ * (the test's own).
+ */
+
+#include <arpa/inet.h>
+#include <assert.h>
+#include <netinet/in.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+static int dpi_test_failures = 0;
+
+/**
+ * Report a failure and carry on
+ */
+static void dpi_test_fail(const char *fmt, ...) {
+  va_list args;
+  va_start(args, fmt);
+  vfprintf(stderr, fmt, args);
+  va_end(args);
+  ++dpi_test_failures;
+}
+
+/**
+ * Check a condition, reporting a failure (but carrying on) if it is false
+ */
+#define CHECK(cond)                                                      \
+  do {                                                                   \
+    if (!(cond)) {                                                       \
+      dpi_test_fail("%s:%d: check failed: %s\n", __FILE__, __LINE__,    \
+                    #cond);                                              \
+    }                                                                    \
+  } while (0)
+
+/**
+ * Print a summary of the checks and return the exit status for main()
+ */
+static int dpi_test_finish(void) {
+  if (dpi_test_failures) {
+    fprintf(stderr, "%d check(s) failed.\n", dpi_test_failures);
+    return 1;
+  }
+  printf("All checks passed.\n");
+  return 0;
+}
+
+/**
+ * Find a free port for the server, so that tests can run in parallel
+ */
+static int dpi_test_free_port(void) {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  assert(fd >= 0);
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  socklen_t len = sizeof(addr);
+  int rv = bind(fd, (struct sockaddr *)&addr, sizeof(addr));
+  assert(rv == 0);
+  rv = getsockname(fd, (struct sockaddr *)&addr, &len);
+  assert(rv == 0);
+  (void)rv;
+  close(fd);
+  return ntohs(addr.sin_port);
+}
+
+/**
+ * Connect to the server on port, waiting until it is listening
+ *
+ * @return The socket
+ */
+static int dpi_test_connect(int port) {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  assert(fd >= 0);
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  while (connect(fd, (struct sockaddr *)&addr, sizeof(addr))) {
+    usleep(1000);
+  }
+  return fd;
+}
+
+/**
+ * Send len bytes from buf
+ */
+static void dpi_test_send_all(int fd, const void *buf, size_t len) {
+  const uint8_t *p = (const uint8_t *)buf;
+  while (len) {
+    ssize_t rv = send(fd, p, len, 0);
+    assert(rv > 0);
+    p += rv;
+    len -= rv;
+  }
+}
+
+/**
+ * Receive exactly len bytes into buf
+ */
+static void dpi_test_recv_all(int fd, void *buf, size_t len) {
+  uint8_t *p = (uint8_t *)buf;
+  while (len) {
+    ssize_t rv = recv(fd, p, len, 0);
+    assert(rv > 0);
+    p += rv;
+    len -= rv;
+  }
+}
+
+#endif  // OPENTITAN_HW_DV_DPI_COMMON_DPI_TEST_DPI_TEST_H_
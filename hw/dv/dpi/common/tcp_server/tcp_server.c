@@ -18,83 +18,255 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <sys/socket.h>
-#include <sys/time.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
 /**
- * Simple buffer for passing data between TCP sockets and DPI modules
+ * Ring buffer for passing data between TCP sockets and DPI modules
+ *
+ * Each buffer has a single producer and a single consumer, which run on
+ * different threads: one of them is the server thread and the other is
+ * whichever Verilator thread calls into the DPI module. The producer only
+ * writes wptr and the consumer only writes rptr. Each of them publishes its
+ * pointer with a release store after touching buf and reads the other
+ * pointer with an acquire load, so no locks are needed.
+ *
+ * The pointers run freely and are reduced modulo the size (a power of two)
+ * when indexing buf, so wptr - rptr is the number of bytes in the buffer.
  */
-#define BUFSIZE_BYTE 256
-
 struct tcp_buf {
   unsigned int rptr;
   unsigned int wptr;
-  char buf[BUFSIZE_BYTE];
+  unsigned int size;
+  char *buf;
 };
 
+static unsigned int load_acquire(const unsigned int *ptr) {
+  return __atomic_load_n(ptr, __ATOMIC_ACQUIRE);
+}
+
+static void store_release(unsigned int *ptr, unsigned int val) {
+  __atomic_store_n(ptr, val, __ATOMIC_RELEASE);
+}
+
 /**
- * TCP Server thread context structure
+ * Get the number of bytes in a buffer
+ *
+ * This is exact when called by the consumer or producer for "its own" side
+ * and otherwise an underestimate of the space (for the producer) or data (for
+ * the consumer).
  */
-struct tcp_server_ctx {
-  // Writeable by the host thread
-  char *display_name;
-  uint16_t listen_port;
-  volatile bool socket_run;
-  // Writeable by the server thread
-  struct tcp_buf *buf_in;
-  struct tcp_buf *buf_out;
-  int sfd;  // socket fd
-  int cfd;  // client fd
-  pthread_t sock_thread;
-};
+static unsigned int tcp_buffer_used(struct tcp_buf *buf) {
+  return load_acquire(&buf->wptr) - load_acquire(&buf->rptr);
+}
 
 static bool tcp_buffer_is_full(struct tcp_buf *buf) {
-  if (buf->wptr >= buf->rptr) {
-    return (buf->wptr - buf->rptr) == (BUFSIZE_BYTE - 1);
-  } else {
-    return (buf->rptr - buf->wptr) == 1;
-  }
+  return tcp_buffer_used(buf) == buf->size;
 }
 
 static bool tcp_buffer_is_empty(struct tcp_buf *buf) {
-  return (buf->wptr == buf->rptr);
+  return tcp_buffer_used(buf) == 0;
 }
 
-static void tcp_buffer_put_byte(struct tcp_buf *buf, char dat) {
-  bool done = false;
-  while (!done) {
-    if (!tcp_buffer_is_full(buf)) {
-      buf->buf[buf->wptr++] = dat;
-      buf->wptr %= BUFSIZE_BYTE;
-      done = true;
-    }
-  }
+/**
+ * Get the contiguous data at the start of a buffer (consumer side)
+ *
+ * @return The number of bytes at *data, which might be less than the number
+ *         in the buffer if the data wraps around the end.
+ */
+static size_t tcp_buffer_peek(struct tcp_buf *buf, char **data) {
+  unsigned int rptr = buf->rptr;
+  unsigned int used = load_acquire(&buf->wptr) - rptr;
+  unsigned int idx = rptr & (buf->size - 1);
+  unsigned int to_end = buf->size - idx;
+  *data = &buf->buf[idx];
+  return used < to_end ? used : to_end;
 }
 
-static bool tcp_buffer_get_byte(struct tcp_buf *buf, char *dat) {
-  if (tcp_buffer_is_empty(buf)) {
-    return false;
+/**
+ * Drop bytes from the start of a buffer (consumer side)
+ */
+static void tcp_buffer_consume(struct tcp_buf *buf, size_t len) {
+  assert(len <= tcp_buffer_used(buf));
+  store_release(&buf->rptr, buf->rptr + len);
+}
+
+/**
+ * Get the contiguous free space at the end of a buffer (producer side)
+ *
+ * @return The number of bytes that can be written at *space
+ */
+static size_t tcp_buffer_space(struct tcp_buf *buf, char **space) {
+  unsigned int wptr = buf->wptr;
+  unsigned int space_left = buf->size - (wptr - load_acquire(&buf->rptr));
+  unsigned int idx = wptr & (buf->size - 1);
+  unsigned int to_end = buf->size - idx;
+  *space = &buf->buf[idx];
+  return space_left < to_end ? space_left : to_end;
+}
+
+/**
+ * Publish bytes that have been written at the end of a buffer (producer side)
+ */
+static void tcp_buffer_commit(struct tcp_buf *buf, size_t len) {
+  store_release(&buf->wptr, buf->wptr + len);
+}
+
+/**
+ * Fill iov with the data (or free space) in a buffer, which is in up to two
+ * pieces because it can wrap around the end.
+ *
+ * @return The number of entries of iov that were filled in
+ */
+static int tcp_buffer_iov(struct tcp_buf *buf, bool free_space,
+                          struct iovec iov[2]) {
+  unsigned int rptr, wptr, start, len;
+  if (free_space) {
+    wptr = buf->wptr;
+    rptr = load_acquire(&buf->rptr);
+    start = wptr;
+    len = buf->size - (wptr - rptr);
+  } else {
+    rptr = buf->rptr;
+    wptr = load_acquire(&buf->wptr);
+    start = rptr;
+    len = wptr - rptr;
   }
-  *dat = buf->buf[buf->rptr++];
-  buf->rptr %= BUFSIZE_BYTE;
-  return true;
+
+  unsigned int idx = start & (buf->size - 1);
+  unsigned int to_end = buf->size - idx;
+  if (len == 0) {
+    return 0;
+  }
+  iov[0].iov_base = &buf->buf[idx];
+  if (len <= to_end) {
+    iov[0].iov_len = len;
+    return 1;
+  }
+  iov[0].iov_len = to_end;
+  iov[1].iov_base = &buf->buf[0];
+  iov[1].iov_len = len - to_end;
+  return 2;
 }
 
-static struct tcp_buf *tcp_buffer_new(void) {
+static struct tcp_buf *tcp_buffer_new(size_t size) {
+  // The size must be a power of two so that the free-running pointers can be
+  // reduced with a mask (and so that they wrap around consistently).
+  assert(size && !(size & (size - 1)) && size <= (1u << 30));
+
   struct tcp_buf *buf_new;
   buf_new = (struct tcp_buf *)malloc(sizeof(struct tcp_buf));
+  if (!buf_new) {
+    return NULL;
+  }
+  buf_new->buf = (char *)malloc(size);
+  if (!buf_new->buf) {
+    free(buf_new);
+    return NULL;
+  }
   buf_new->rptr = 0;
   buf_new->wptr = 0;
+  buf_new->size = size;
   return buf_new;
 }
 
 static void tcp_buffer_free(struct tcp_buf **buf) {
+  if (*buf) {
+    free((*buf)->buf);
+  }
   free(*buf);
   *buf = NULL;
 }
 
+/**
+ * TCP Server thread context structure
+ */
+struct tcp_server_ctx {
+  // Writeable by the host thread
+  char *display_name;
+  uint16_t listen_port;
+  bool socket_run;
+  // Writeable by the server thread
+  struct tcp_buf *buf_in;
+  struct tcp_buf *buf_out;
+  int sfd;  // socket fd
+  int epfd;  // epoll fd
+  // Written by the server thread when a client connects and by either thread
+  // when it disconnects, so always accessed atomically.
+  int cfd;  // client fd
+  // Written by the DPI module's thread to wake up the server thread when
+  // there is new data to send, or space for more received data.
+  int wake_fd;
+  // The client events that the server thread waits for (written by the
+  // server thread, and read by the DPI module's thread to decide whether to
+  // wake it up). See wake_server_unless().
+  uint32_t watched_events;
+  pthread_t sock_thread;
+};
+
+static int client_fd(struct tcp_server_ctx *ctx) {
+  return __atomic_load_n(&ctx->cfd, __ATOMIC_ACQUIRE);
+}
+
+/**
+ * Wake up the server thread if it is waiting in epoll_wait()
+ */
+static void wake_server(struct tcp_server_ctx *ctx) {
+  uint64_t one = 1;
+  ssize_t rv = write(ctx->wake_fd, &one, sizeof(one));
+  // This can only fail if the counter is about to overflow, in which case
+  // the server thread has plenty of wakeups waiting already.
+  (void)rv;
+}
+
+/**
+ * Wake up the server thread after changing a buffer, unless it is already
+ * waiting for event (EPOLLIN or EPOLLOUT) from the client
+ *
+ * The server thread publishes the events it is about to wait for and then
+ * checks the buffers again (see server_create()). This side changes a buffer
+ * and then reads the published events. The fences order each store before the
+ * following load, so either the server thread sees the change or we see that
+ * it isn't waiting for the event and wake it up.
+ */
+static void wake_server_unless(struct tcp_server_ctx *ctx, uint32_t event) {
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  uint32_t watched = __atomic_load_n(&ctx->watched_events, __ATOMIC_RELAXED);
+  // With no client, there is nothing to do until one connects, and the server
+  // thread looks at the buffers then anyway.
+  if (client_fd(ctx) && !(watched & event)) {
+    wake_server(ctx);
+  }
+}
+
+/**
+ * Get the client events that the server thread needs to wait for
+ *
+ * Only ask for input if there is space to put it and for output space if
+ * there is something to send. Otherwise level-triggered epoll would wake us
+ * up again straight away.
+ *
+ * @param ctx context object
+ * @param cfd client fd, or 0 if there is no client
+ */
+static uint32_t wanted_events(struct tcp_server_ctx *ctx, int cfd) {
+  if (!cfd) {
+    return 0;
+  }
+  uint32_t events = EPOLLRDHUP;
+  if (!tcp_buffer_is_full(ctx->buf_in)) {
+    events |= EPOLLIN;
+  }
+  if (!tcp_buffer_is_empty(ctx->buf_out)) {
+    events |= EPOLLOUT;
+  }
+  return events;
+}
+
 /**
  * Start a TCP server
  *
@@ -168,6 +340,31 @@ static int start(struct tcp_server_ctx *ctx) {
   ctx->sfd = sfd;
   assert(ctx->sfd > 0);
 
+  // Wait for new connections and wakeups from the DPI module with epoll
+  int epfd = epoll_create1(0);
+  if (epfd == -1) {
+    fprintf(stderr, "%s: Unable to create epoll instance: %s (%d)\n",
+            ctx->display_name, strerror(errno), errno);
+    return -1;
+  }
+  ctx->epfd = epfd;
+
+  struct epoll_event ev;
+  memset(&ev, 0, sizeof(ev));
+  ev.events = EPOLLIN;
+  ev.data.fd = sfd;
+  if (epoll_ctl(epfd, EPOLL_CTL_ADD, sfd, &ev) != 0) {
+    fprintf(stderr, "%s: Unable to watch socket: %s (%d)\n", ctx->display_name,
+            strerror(errno), errno);
+    return -1;
+  }
+  ev.data.fd = ctx->wake_fd;
+  if (epoll_ctl(epfd, EPOLL_CTL_ADD, ctx->wake_fd, &ev) != 0) {
+    fprintf(stderr, "%s: Unable to watch wakeup fd: %s (%d)\n",
+            ctx->display_name, strerror(errno), errno);
+    return -1;
+  }
+
   return 0;
 }
 
@@ -196,7 +393,7 @@ static int client_tryaccept(struct tcp_server_ctx *ctx) {
     return -1;
   }
 
-  if (ctx->cfd > 0) {
+  if (client_fd(ctx) > 0) {
     // Enforce a single concurrent connection. Accept and close any
     // new connection attempt when there's already a client.
     fprintf(stderr, "%s: Rejecting additional connection\n", ctx->display_name);
@@ -211,8 +408,8 @@ static int client_tryaccept(struct tcp_server_ctx *ctx) {
     return -1;
   }
 
-  ctx->cfd = cfd;
-  assert(ctx->cfd > 0);
+  assert(cfd > 0);
+  __atomic_store_n(&ctx->cfd, cfd, __ATOMIC_RELEASE);
 
   printf("%s: Accepted client connection\n", ctx->display_name);
 
@@ -226,6 +423,10 @@ static int client_tryaccept(struct tcp_server_ctx *ctx) {
  */
 static void stop(struct tcp_server_ctx *ctx) {
   assert(ctx);
+  if (ctx->epfd) {
+    close(ctx->epfd);
+    ctx->epfd = 0;
+  }
   if (!ctx->sfd) {
     return;
   }
@@ -234,63 +435,90 @@ static void stop(struct tcp_server_ctx *ctx) {
 }
 
 /**
- * Receive a byte from a connected client
+ * Receive as much data as fits in buf_in from a connected client
  *
  * @param ctx context object
- * @param cmd byte received
- * @return true if a byte was read
+ * @param cfd client fd
  */
-static bool get_byte(struct tcp_server_ctx *ctx, char *cmd) {
+static void fill_from_client(struct tcp_server_ctx *ctx, int cfd) {
   assert(ctx);
 
-  ssize_t num_read = read(ctx->cfd, cmd, 1);
+  while (1) {
+    struct iovec iov[2];
+    int iovcnt = tcp_buffer_iov(ctx->buf_in, true, iov);
+    if (!iovcnt) {
+      return;
+    }
 
-  if (num_read == 0) {
-    return false;
-  }
-  if (num_read == -1) {
+    ssize_t num_read = readv(cfd, iov, iovcnt);
+    if (num_read > 0) {
+      tcp_buffer_commit(ctx->buf_in, num_read);
+      continue;
+    }
+    if (num_read == 0) {
+      printf("%s: Remote disconnected.\n", ctx->display_name);
+      tcp_server_client_close(ctx);
+      return;
+    }
+    if (errno == EINTR) {
+      continue;
+    }
     if (errno == EAGAIN || errno == EWOULDBLOCK) {
-      return false;
-    } else if (errno == EBADF) {
+      return;
+    }
+    if (errno == EBADF) {
       // Possibly client went away? Accept a new connection.
       fprintf(stderr, "%s: Client disappeared.\n", ctx->display_name);
-      tcp_server_client_close(ctx);
-      return false;
     } else {
       fprintf(stderr, "%s: Error while reading from client: %s (%d)\n",
               ctx->display_name, strerror(errno), errno);
-      assert(0 && "Error reading from client");
     }
+    tcp_server_client_close(ctx);
+    return;
   }
-  assert(num_read == 1);
-  return true;
 }
 
 /**
- * Send a byte to a connected client
+ * Send as much of the data in buf_out as the client will take
  *
  * @param ctx context object
- * @param cmd byte to send
+ * @param cfd client fd
  */
-static void put_byte(struct tcp_server_ctx *ctx, char cmd) {
+static void flush_to_client(struct tcp_server_ctx *ctx, int cfd) {
+  assert(ctx);
+
   while (1) {
-    ssize_t num_written = send(ctx->cfd, &cmd, sizeof(cmd), MSG_NOSIGNAL);
-    if (num_written == -1) {
-      if (errno == EAGAIN || errno == EWOULDBLOCK) {
-        continue;
-      } else if (errno == EPIPE) {
-        printf("%s: Remote disconnected.\n", ctx->display_name);
-        tcp_server_client_close(ctx);
-        break;
-      } else {
-        fprintf(stderr, "%s: Error while writing to client: %s (%d)\n",
-                ctx->display_name, strerror(errno), errno);
-        assert(0 && "Error writing to client.");
-      }
+    struct msghdr msg;
+    struct iovec iov[2];
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = tcp_buffer_iov(ctx->buf_out, false, iov);
+    if (!msg.msg_iovlen) {
+      return;
     }
-    if (num_written >= 1) {
-      break;
+
+    // This is writev(), but with MSG_NOSIGNAL to get EPIPE instead of SIGPIPE
+    // if the client has gone away.
+    ssize_t num_written = sendmsg(cfd, &msg, MSG_NOSIGNAL);
+    if (num_written > 0) {
+      tcp_buffer_consume(ctx->buf_out, num_written);
+      continue;
+    }
+    if (num_written == -1 && errno == EINTR) {
+      continue;
+    }
+    if (num_written == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      // We'll be told by EPOLLOUT when there is space again
+      return;
+    }
+    if (num_written == -1 && errno == EPIPE) {
+      printf("%s: Remote disconnected.\n", ctx->display_name);
+    } else {
+      fprintf(stderr, "%s: Error while writing to client: %s (%d)\n",
+              ctx->display_name, strerror(errno), errno);
     }
+    tcp_server_client_close(ctx);
+    return;
   }
 }
 
@@ -303,11 +531,13 @@ static void ctx_free(struct tcp_server_ctx *ctx) {
   // Free the buffers
   tcp_buffer_free(&ctx->buf_in);
   tcp_buffer_free(&ctx->buf_out);
+  if (ctx->wake_fd > 0) {
+    close(ctx->wake_fd);
+  }
   // Free the display name
   free(ctx->display_name);
   // Free the ctx
   free(ctx);
-  ctx = NULL;
 }
 
 /**
@@ -319,7 +549,6 @@ static void ctx_free(struct tcp_server_ctx *ctx) {
 static void *server_create(void *ctx_void) {
   // Cast to a server struct
   struct tcp_server_ctx *ctx = (struct tcp_server_ctx *)ctx_void;
-  struct timeval timeout;
 
   // Start the server
   int rv = start(ctx);
@@ -329,31 +558,60 @@ static void *server_create(void *ctx_void) {
     goto err_cleanup_return;
   }
 
-  // Initialise fd_set
+  // The client fd that is registered with epoll and the events we asked for.
+  // The DPI module's thread can close the client at any time (and the kernel
+  // drops a closed fd from the epoll set), so we compare against client_fd()
+  // on every iteration.
+  int watched_cfd = 0;
+  uint32_t watched_events = 0;
 
   // Start waiting for connection / data
-  char xfer_data;
-  while (ctx->socket_run) {
-    // Initialise structure of fds
-    fd_set read_fds;
-    FD_ZERO(&read_fds);
-    if (ctx->sfd) {
-      FD_SET(ctx->sfd, &read_fds);
+  while (__atomic_load_n(&ctx->socket_run, __ATOMIC_ACQUIRE)) {
+    // The client might be disconnected by the DPI module's thread while we're
+    // working, so work with a snapshot of the client fd.
+    int cfd = client_fd(ctx);
+    if (cfd) {
+      fill_from_client(ctx, cfd);
+      flush_to_client(ctx, cfd);
+      cfd = client_fd(ctx);
     }
-    if (ctx->cfd) {
-      FD_SET(ctx->cfd, &read_fds);
-    }
-    // max fd num
-    int mfd = (ctx->cfd > ctx->sfd) ? ctx->cfd : ctx->sfd;
 
-    // Set timeout - 50us gives good performance; do it every time
-    // since select can trash it.
-    timeout.tv_sec = 0;
-    timeout.tv_usec = 50;
+    uint32_t events = wanted_events(ctx, cfd);
+    if (cfd != watched_cfd || events != watched_events) {
+      struct epoll_event ev;
+      memset(&ev, 0, sizeof(ev));
+      ev.events = events;
+      ev.data.fd = cfd;
+      if (cfd == watched_cfd) {
+        epoll_ctl(ctx->epfd, EPOLL_CTL_MOD, cfd, &ev);
+      } else {
+        if (watched_cfd) {
+          // Fails harmlessly if the fd was closed already
+          epoll_ctl(ctx->epfd, EPOLL_CTL_DEL, watched_cfd, NULL);
+        }
+        if (cfd) {
+          epoll_ctl(ctx->epfd, EPOLL_CTL_ADD, cfd, &ev);
+        }
+      }
+      watched_cfd = cfd;
+      watched_events = events;
+    }
 
-    // Wait for socket activity or timeout
-    rv = select(mfd + 1, &read_fds, NULL, NULL, &timeout);
+    // Tell the DPI module what we are waiting for, then check that the
+    // buffers didn't change under our feet while we worked it out. If they
+    // did, go round again. Otherwise, the DPI module will see the published
+    // events after any later change and wake us up if we need to know (see
+    // wake_server_unless()).
+    __atomic_store_n(&ctx->watched_events, events, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (wanted_events(ctx, client_fd(ctx)) != events) {
+      continue;
+    }
 
+    // Wait for socket activity or a wakeup. tcp_server_close() also wakes us
+    // up to exit.
+    struct epoll_event events_out[4];
+    rv = epoll_wait(ctx->epfd, events_out, 4, -1);
     if (rv < 0) {
       if (errno == EINTR) {
         // On interrupt we want to retry
@@ -363,24 +621,26 @@ static void *server_create(void *ctx_void) {
       printf("%s: Socket read failed, port: %d\n", ctx->display_name,
              ctx->listen_port);
       tcp_server_client_close(ctx);
+      continue;
     }
 
-    // New connection
-    if (FD_ISSET(ctx->sfd, &read_fds)) {
-      client_tryaccept(ctx);
-    }
-
-    // New client data
-    if (FD_ISSET(ctx->cfd, &read_fds)) {
-      while (!tcp_buffer_is_full(ctx->buf_in) && get_byte(ctx, &xfer_data)) {
-        tcp_buffer_put_byte(ctx->buf_in, xfer_data);
-      }
-    }
-
-    if (ctx->cfd != 0) {
-      while (tcp_buffer_get_byte(ctx->buf_out, &xfer_data)) {
-        put_byte(ctx, xfer_data);
+    for (int i = 0; i < rv; ++i) {
+      int fd = events_out[i].data.fd;
+      if (fd == ctx->sfd) {
+        // New connection
+        client_tryaccept(ctx);
+      } else if (fd == ctx->wake_fd) {
+        uint64_t count;
+        ssize_t num_read = read(ctx->wake_fd, &count, sizeof(count));
+        (void)num_read;
+      } else if (fd == cfd && (events_out[i].events & (EPOLLRDHUP | EPOLLHUP |
+                                                      EPOLLERR))) {
+        // Pick up any data that came before the hangup. fill_from_client
+        // closes the client when it sees the end of the stream.
+        fill_from_client(ctx, cfd);
       }
+      // Client data and space to send more are handled at the top of the
+      // loop.
     }
   }
 
@@ -396,13 +656,20 @@ err_cleanup_return:
 // Abstract interface functions
 struct tcp_server_ctx *tcp_server_create(const char *display_name,
                                          int listen_port) {
+  return tcp_server_create_with_bufsize(display_name, listen_port,
+                                        TCP_SERVER_DEFAULT_BUFSIZE);
+}
+
+struct tcp_server_ctx *tcp_server_create_with_bufsize(const char *display_name,
+                                                      int listen_port,
+                                                      size_t bufsize) {
   struct tcp_server_ctx *ctx =
       (struct tcp_server_ctx *)calloc(1, sizeof(struct tcp_server_ctx));
   assert(ctx);
 
   // Create the buffers
-  struct tcp_buf *buf_in = tcp_buffer_new();
-  struct tcp_buf *buf_out = tcp_buffer_new();
+  struct tcp_buf *buf_in = tcp_buffer_new(bufsize);
+  struct tcp_buf *buf_out = tcp_buffer_new(bufsize);
   assert(buf_in);
   assert(buf_out);
 
@@ -416,28 +683,103 @@ struct tcp_server_ctx *tcp_server_create(const char *display_name,
   ctx->display_name = strdup(display_name);
   assert(ctx->display_name);
 
+  ctx->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (ctx->wake_fd == -1) {
+    fprintf(stderr, "%s: Unable to create wakeup fd: %s (%d)\n",
+            ctx->display_name, strerror(errno), errno);
+    ctx->wake_fd = 0;
+    ctx_free(ctx);
+    return NULL;
+  }
+
   if (pthread_create(&ctx->sock_thread, NULL, server_create, (void *)ctx) !=
       0) {
     fprintf(stderr, "%s: Unable to create TCP socket thread\n",
             ctx->display_name);
     ctx_free(ctx);
-    free(ctx);
     return NULL;
   }
   return ctx;
 }
 
 bool tcp_server_read(struct tcp_server_ctx *ctx, char *dat) {
-  return tcp_buffer_get_byte(ctx->buf_in, dat);
+  const char *data;
+  if (!tcp_server_peek(ctx, &data)) {
+    return false;
+  }
+  *dat = data[0];
+  tcp_server_consume(ctx, 1);
+  return true;
+}
+
+size_t tcp_server_read_bulk(struct tcp_server_ctx *ctx, char *buf,
+                            size_t len) {
+  size_t done = 0;
+  while (done < len) {
+    const char *data;
+    size_t avail = tcp_server_peek(ctx, &data);
+    if (!avail) {
+      break;
+    }
+    size_t chunk = avail < len - done ? avail : len - done;
+    memcpy(buf + done, data, chunk);
+    tcp_server_consume(ctx, chunk);
+    done += chunk;
+  }
+  return done;
+}
+
+size_t tcp_server_peek(struct tcp_server_ctx *ctx, const char **data) {
+  char *buf_data;
+  size_t avail = tcp_buffer_peek(ctx->buf_in, &buf_data);
+  *data = buf_data;
+  return avail;
+}
+
+void tcp_server_consume(struct tcp_server_ctx *ctx, size_t len) {
+  if (!len) {
+    return;
+  }
+  tcp_buffer_consume(ctx->buf_in, len);
+  // If the buffer was full, the server thread has stopped reading from the
+  // client, so tell it there is space now.
+  wake_server_unless(ctx, EPOLLIN);
+}
+
+bool tcp_server_write(struct tcp_server_ctx *ctx, char dat) {
+  return tcp_server_write_bulk(ctx, &dat, 1) == 1;
+}
+
+size_t tcp_server_write_bulk(struct tcp_server_ctx *ctx, const char *buf,
+                             size_t len) {
+  size_t done = 0;
+  while (done < len) {
+    char *space;
+    size_t avail = tcp_buffer_space(ctx->buf_out, &space);
+    if (!avail) {
+      break;
+    }
+    size_t chunk = avail < len - done ? avail : len - done;
+    memcpy(space, buf + done, chunk);
+    tcp_buffer_commit(ctx->buf_out, chunk);
+    done += chunk;
+  }
+  // The server thread only waits for the client to be ready to take data
+  // when there is some to send, so wake it up if it isn't waiting already.
+  if (done) {
+    wake_server_unless(ctx, EPOLLOUT);
+  }
+  return done;
 }
 
-void tcp_server_write(struct tcp_server_ctx *ctx, char dat) {
-  tcp_buffer_put_byte(ctx->buf_out, dat);
+size_t tcp_server_write_space(struct tcp_server_ctx *ctx) {
+  return ctx->buf_out->size - tcp_buffer_used(ctx->buf_out);
 }
 
 void tcp_server_close(struct tcp_server_ctx *ctx) {
   // Shut down the socket thread
-  ctx->socket_run = false;
+  __atomic_store_n(&ctx->socket_run, false, __ATOMIC_RELEASE);
+  wake_server(ctx);
   pthread_join(ctx->sock_thread, NULL);
   ctx_free(ctx);
 }
@@ -445,10 +787,12 @@ void tcp_server_close(struct tcp_server_ctx *ctx) {
 void tcp_server_client_close(struct tcp_server_ctx *ctx) {
   assert(ctx);
 
-  if (!ctx->cfd) {
+  // This can be called from the server thread or the DPI module's thread, so
+  // claim the fd atomically to make sure it's only closed once.
+  int cfd = __atomic_exchange_n(&ctx->cfd, 0, __ATOMIC_ACQ_REL);
+  if (!cfd) {
     return;
   }
 
-  close(ctx->cfd);
-  ctx->cfd = 0;
+  close(cfd);
 }
@@ -10,6 +10,11 @@
  *
  * This is intended to be used by simulation add-on DPI modules to provide
  * basic TCP socket communication between a host and simulated peripherals.
+ *
+ * Data goes through a ring buffer in each direction between the server thread
+ * and the DPI module. Each buffer has a single producer and a single consumer,
+ * so all the functions below except tcp_server_create() and
+ * tcp_server_close() must be called from one thread at a time.
  */
 
 #ifdef __cplusplus
@@ -17,8 +22,14 @@ extern "C" {
 #endif
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
+/**
+ * Size of each buffer for tcp_server_create(), in bytes
+ */
+#define TCP_SERVER_DEFAULT_BUFSIZE 65536
+
 struct tcp_server_ctx;
 
 /**
@@ -30,16 +41,78 @@ struct tcp_server_ctx;
  */
 bool tcp_server_read(struct tcp_server_ctx *ctx, char *dat);
 
+/**
+ * Non-blocking read of up to len bytes from a connected client
+ *
+ * @param ctx tcp server context object
+ * @param buf buffer for the bytes received
+ * @param len size of buf
+ * @return the number of bytes read
+ */
+size_t tcp_server_read_bulk(struct tcp_server_ctx *ctx, char *buf, size_t len);
+
+/**
+ * Look at received data without copying it
+ *
+ * This gives the received data that is contiguous in the buffer, which might
+ * not be all of it if it wraps around the end. The data stays valid until it
+ * is dropped with tcp_server_consume().
+ *
+ * @param ctx tcp server context object
+ * @param data set to point at the received data
+ * @return the number of bytes at *data (0 if nothing has been received)
+ */
+size_t tcp_server_peek(struct tcp_server_ctx *ctx, const char **data);
+
+/**
+ * Drop received data that has been handled
+ *
+ * @param ctx tcp server context object
+ * @param len number of bytes to drop, at most the length returned by the last
+ *            tcp_server_peek()
+ */
+void tcp_server_consume(struct tcp_server_ctx *ctx, size_t len);
+
 /**
  * Write a byte to a connected client
  *
- * The write is internally buffered and so does not block if the client is not
- * ready to accept data, but does block if the buffer is full.
+ * The write is internally buffered and never blocks. If the buffer is full
+ * because the client is not taking data, nothing is written and the caller
+ * should try again later. A DPI module can check tcp_server_write_space()
+ * before it handles a command that needs a response and leave the command
+ * in the receive buffer until there is space. That stops the server reading
+ * from the client, so the backpressure reaches the client.
  *
  * @param ctx tcp server context object
  * @param dat byte to send
+ * @return true if the byte was written, false if the buffer was full
  */
-void tcp_server_write(struct tcp_server_ctx *ctx, char dat);
+bool tcp_server_write(struct tcp_server_ctx *ctx, char dat);
+
+/**
+ * Write up to len bytes to a connected client
+ *
+ * Like tcp_server_write(), this is buffered and never blocks: if the buffer
+ * fills up, the rest of the data is not written.
+ *
+ * @param ctx tcp server context object
+ * @param buf bytes to send
+ * @param len number of bytes in buf
+ * @return the number of bytes written
+ */
+size_t tcp_server_write_bulk(struct tcp_server_ctx *ctx, const char *buf,
+                             size_t len);
+
+/**
+ * Get the number of bytes that tcp_server_write_bulk() can take
+ *
+ * This lets a caller that sends messages check that a whole message fits
+ * before it writes any of it.
+ *
+ * @param ctx tcp server context object
+ * @return free space in the buffer to the client, in bytes
+ */
+size_t tcp_server_write_space(struct tcp_server_ctx *ctx);
 
 /**
  * Create a new TCP server instance
@@ -51,6 +124,19 @@ void tcp_server_write(struct tcp_server_ctx *ctx, char dat);
 struct tcp_server_ctx *tcp_server_create(const char *display_name,
                                          int listen_port);
 
+/**
+ * Create a new TCP server instance with a given buffer size
+ *
+ * @param display_name C string description of server
+ * @param listen_port On which port the server should listen
+ * @param bufsize Size of the buffer in each direction, in bytes. This must be
+ *                a power of two.
+ * @return A pointer to the created context struct
+ */
+struct tcp_server_ctx *tcp_server_create_with_bufsize(const char *display_name,
+                                                      int listen_port,
+                                                      size_t bufsize);
+
 /**
  * Shut down the server and free all reserved memory
  *
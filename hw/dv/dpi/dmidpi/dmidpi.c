@@ -306,7 +306,9 @@ static bool process_cmd_byte(struct dmidpi_ctx *ctx, char cmd) {
   } else if (cmd == 'R') {
     // JTAG read, send tdo as response
     char tdo_ascii = ctx->jtag.jtag_tdo + '0';
-    tcp_server_write(ctx->sock, tdo_ascii);
+    bool written = tcp_server_write(ctx->sock, tdo_ascii);
+    assert(written);
+    (void)written;
   } else if (cmd == 'B') {
     // printf("DMI DPI: BLINK ON!\n");
   } else if (cmd == 'b') {
@@ -362,15 +364,31 @@ static void update_dmi_state(struct dmidpi_ctx *ctx) {
     return;
   }
 
-  char done = 0;
+  // Process command bytes until a command completes, working on them in
+  // place in the receive buffer.
+  bool done = false;
   while (!done) {
-    // read a command byte
-    char cmd;
-    if (!tcp_server_read(ctx->sock, &cmd)) {
+    const char *cmds;
+    size_t num_cmds = tcp_server_peek(ctx->sock, &cmds);
+    if (!num_cmds) {
+      return;
+    }
+    size_t pos = 0;
+    bool blocked = false;
+    while (pos < num_cmds && !done) {
+      // A read needs space for its response. If the client isn't taking
+      // responses, leave the read for a later tick, which stops the server
+      // taking more commands from the client until it catches up.
+      if (cmds[pos] == 'R' && !tcp_server_write_space(ctx->sock)) {
+        blocked = true;
+        break;
+      }
+      done = process_cmd_byte(ctx, cmds[pos++]);
+    }
+    tcp_server_consume(ctx->sock, pos);
+    if (blocked) {
       return;
     }
-    // Process command bytes until a command completes
-    done = process_cmd_byte(ctx, cmd);
   }
 }
 
@@ -37,16 +37,47 @@ module dmidpi #(
 
   chandle ctx;
 
-  initial begin
+`ifdef VERILATOR
+  // The ID of the simulator run that created ctx (see sim_ctrl_dpi.h)
+  import "DPI-C" pure function longint simctrl_run_id();
+  longint ctx_run_id;
+`endif
+
+  function automatic void initialize();
     ctx = dmidpi_create(Name, ListenPort);
+`ifdef VERILATOR
+    ctx_run_id = simctrl_run_id();
+`endif
+  endfunction
+
+  // Whether ctx was created by another run of the simulator, and so points nowhere
+  function automatic bit ctx_stale();
+`ifdef VERILATOR
+    return ctx != null && ctx_run_id != simctrl_run_id();
+`else
+    return 1'b0;
+`endif
+  endfunction
+
+  // Create the context again if a restored checkpoint made it stale
+  function automatic void renew_ctx();
+    if (ctx_stale()) begin
+      ctx = null;
+      initialize();
+    end
+  endfunction
+
+  initial begin
+    initialize();
   end
 
   final begin
-    dmidpi_close(ctx);
+    if (!ctx_stale()) dmidpi_close(ctx);
     ctx = null;
   end
 
   always_ff @(posedge clk_i, negedge rst_ni) begin
+    renew_ctx();
     dmidpi_tick(ctx, dmi_req_valid, dmi_req_ready, dmi_req_addr, dmi_req_op,
                 dmi_req_data, dmi_rsp_valid, dmi_rsp_ready, dmi_rsp_data,
                 dmi_rsp_resp, dmi_rst_n);
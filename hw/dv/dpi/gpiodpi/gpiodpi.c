@@ -16,6 +16,7 @@
 #include <fcntl.h>
 #include <limits.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -23,6 +24,12 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include "tcp_server.h"
+#ifdef VERILATOR
+#include "sim_ctrl_dpi.h"
+#include "verilator_sim_ctrl.h"
+#endif
+
 // The number of ticks of host_to_device_tick between making syscalls.
 #define TICKS_PER_SYSCALL 2048
 
@@ -35,14 +42,22 @@
 #define SET_BIT(word, bit_idx) ((word) |= (1 << (bit_idx)))
 #define CLR_BIT(word, bit_idx) ((word) &= ~(1 << (bit_idx)))
 
-struct gpiodpi_ctx {
-  // The number of pins we're driving.
-  int n_bits;
-
+// The state of the pins, which a Verilator simulation keeps in checkpoints.
+struct gpiodpi_pins {
   // The last known value of the pins, in little-endian order.
   uint32_t driven_pin_values;
   // Whether or not the pin is being driven weakly or strongly.
   uint32_t weak_pins;
+  // The last values and output enables reported by the device.
+  uint32_t device_pin_values;
+  uint32_t device_pin_oe;
+};
+
+struct gpiodpi_ctx {
+  // The number of pins we're driving.
+  int n_bits;
+
+  struct gpiodpi_pins pins;
   // A counter of calls into the host_to_device_tick function; used to
   // avoid excessive `read` syscalls to the pipe fd.
   uint32_t counter;
@@ -53,6 +68,16 @@ struct gpiodpi_ctx {
   char dev_to_host_path[PATH_MAX];
   int host_to_dev_fifo;
   char host_to_dev_path[PATH_MAX];
+
+  // The socket for the binary protocol, or NULL if we use the FIFOs.
+  struct tcp_server_ctx *sock;
+  // The next command, as far as it has been received.
+  uint8_t cmd[GPIODPI_CMD_LEN];
+  size_t cmd_len;
+  // Events are only sent once the host has sent a command.
+  bool events_on;
+  // Events have been dropped since the last one that was sent.
+  bool events_lost;
 };
 
 /**
@@ -107,9 +132,9 @@ static void print_usage(char *rfifo, char *wfifo, int n_bits) {
          wfifo);
 }
 
-void *gpiodpi_create(const char *name, int n_bits) {
+void *gpiodpi_create(const char *name, int n_bits, int listen_port) {
   struct gpiodpi_ctx *ctx =
-      (struct gpiodpi_ctx *)malloc(sizeof(struct gpiodpi_ctx));
+      (struct gpiodpi_ctx *)calloc(1, sizeof(struct gpiodpi_ctx));
   assert(ctx);
 
   // n_bits > 32 requires more sophisticated handling of svBitVecVal which we
@@ -117,9 +142,24 @@ void *gpiodpi_create(const char *name, int n_bits) {
   assert(n_bits <= 32 && "n_bits must be <= 32");
   ctx->n_bits = n_bits;
 
-  ctx->driven_pin_values = 0;
-  ctx->weak_pins = 0;
+  ctx->pins.driven_pin_values = 0;
+  ctx->pins.weak_pins = 0;
   ctx->counter = 0;
+#ifdef VERILATOR
+  // After a checkpoint has been restored, this brings back the pin state.
+  simctrl_keep_dpi_state("gpiodpi", name, &ctx->pins, sizeof(ctx->pins));
+#endif
+
+  if (listen_port) {
+    ctx->sock = tcp_server_create(name, listen_port);
+    assert(ctx->sock);
+    printf(
+        "\n"
+        "GPIO: Listening for binary protocol clients on port %d for %d-bit "
+        "wide GPIO.\n",
+        listen_port, ctx->n_bits);
+    return (void *)ctx;
+  }
 
   char cwd_buf[PATH_MAX];
   char *cwd = getcwd(cwd_buf, sizeof(cwd_buf));
@@ -150,11 +190,60 @@ void *gpiodpi_create(const char *name, int n_bits) {
   return (void *)ctx;
 }
 
-void gpiodpi_device_to_host(void *ctx_void, svBitVecVal *gpio_data,
-                            svBitVecVal *gpio_oe) {
+static void put_le(uint8_t *buf, uint64_t val, int len) {
+  for (int i = 0; i < len; ++i) {
+    buf[i] = (val >> (8 * i)) & 0xff;
+  }
+}
+
+static uint64_t get_le(const uint8_t *buf, int len) {
+  uint64_t val = 0;
+  for (int i = len - 1; i >= 0; --i) {
+    val = (val << 8) | buf[i];
+  }
+  return val;
+}
+
+/**
+ * Send an event with the last pin state reported by the device.
+ *
+ * If the host isn't keeping up, the event is dropped and the next event that
+ * is sent has GPIODPI_EVENT_OVERFLOW set.
+ */
+static void send_event(struct gpiodpi_ctx *ctx, uint64_t cycle,
+                       uint32_t flags) {
+  if (!ctx->events_on) {
+    return;
+  }
+  if (tcp_server_write_space(ctx->sock) < GPIODPI_EVENT_LEN) {
+    ctx->events_lost = true;
+    return;
+  }
+  if (ctx->events_lost) {
+    flags |= GPIODPI_EVENT_OVERFLOW;
+    ctx->events_lost = false;
+  }
+
+  uint8_t event[GPIODPI_EVENT_LEN];
+  put_le(&event[0], cycle, 8);
+  put_le(&event[8], ctx->pins.device_pin_values, 4);
+  put_le(&event[12], ctx->pins.device_pin_oe, 4);
+  put_le(&event[16], flags, 4);
+  tcp_server_write_bulk(ctx->sock, (const char *)event, sizeof(event));
+}
+
+void gpiodpi_device_to_host(void *ctx_void, long long cycle,
+                            svBitVecVal *gpio_data, svBitVecVal *gpio_oe) {
   struct gpiodpi_ctx *ctx = (struct gpiodpi_ctx *)ctx_void;
   assert(ctx);
 
+  if (ctx->sock) {
+    ctx->pins.device_pin_values = gpio_data[0] & gpio_oe[0];
+    ctx->pins.device_pin_oe = gpio_oe[0];
+    send_event(ctx, cycle, 0);
+    return;
+  }
+
   // Write 0, 1, or X (when oe is not set) for each GPIO pin, in big endian
   // order (i.e., pin 0 is the last character written). Finish it with a
   // newline.
@@ -211,13 +300,81 @@ static void set_bit_val(uint32_t *word, uint32_t idx, bool val) {
   }
 }
 
-uint32_t gpiodpi_host_to_device_tick(void *ctx_void, svBitVecVal *gpio_oe,
+/**
+ * Stop the simulation controller from skipping idle cycles while a command is
+ * queued, so that skipped cycles don't stretch the time until it is applied.
+ */
+static void veto_idle_skip(void) {
+#ifdef VERILATOR
+  VerilatorSimCtrl::GetInstance().VetoIdleSkip();
+#endif
+}
+
+/**
+ * Apply the binary protocol commands that are due by cycle.
+ */
+static void apply_commands(struct gpiodpi_ctx *ctx, uint64_t cycle,
+                           uint32_t gpio_oe) {
+  while (true) {
+    if (ctx->cmd_len < GPIODPI_CMD_LEN) {
+      ctx->cmd_len +=
+          tcp_server_read_bulk(ctx->sock, (char *)&ctx->cmd[ctx->cmd_len],
+                               GPIODPI_CMD_LEN - ctx->cmd_len);
+      if (ctx->cmd_len < GPIODPI_CMD_LEN) {
+        if (ctx->cmd_len) {
+          veto_idle_skip();
+        }
+        return;
+      }
+      ctx->events_on = true;
+    }
+
+    uint64_t cmd_cycle = get_le(&ctx->cmd[0], 8);
+    if (cmd_cycle > cycle) {
+      veto_idle_skip();
+      return;
+    }
+    ctx->cmd_len = 0;
+    // Don't let the host believe that the command took effect when it asked.
+    uint32_t late = cmd_cycle < cycle ? GPIODPI_EVENT_LATE : 0;
+
+    uint32_t mask = get_le(&ctx->cmd[8], 4);
+    uint32_t value = get_le(&ctx->cmd[12], 4);
+    uint32_t weak = get_le(&ctx->cmd[16], 4);
+    if (!mask) {
+      send_event(ctx, cycle, GPIODPI_EVENT_SYNC | late);
+      continue;
+    }
+
+    uint32_t valid = ctx->n_bits < 32 ? (1u << ctx->n_bits) - 1 : ~0u;
+    if (mask & ~valid) {
+      fprintf(stderr, "GPIO: Host tried to drive invalid pins: 0x%08x\n",
+              mask & ~valid);
+      mask &= valid;
+    }
+    if (mask & gpio_oe) {
+      fprintf(stderr, "GPIO: Host tried to drive output pins: 0x%08x\n",
+              mask & gpio_oe);
+    }
+    ctx->pins.driven_pin_values =
+        (ctx->pins.driven_pin_values & ~mask) | (value & mask);
+    ctx->pins.weak_pins = (ctx->pins.weak_pins & ~mask) | (weak & mask);
+    if (late) {
+      send_event(ctx, cycle, late);
+    }
+  }
+}
+
+uint32_t gpiodpi_host_to_device_tick(void *ctx_void, long long cycle,
+                                     svBitVecVal *gpio_oe,
                                      svBitVecVal *gpio_pull_en,
                                      svBitVecVal *gpio_pull_sel) {
   struct gpiodpi_ctx *ctx = (struct gpiodpi_ctx *)ctx_void;
   assert(ctx);
 
-  if (ctx->counter % TICKS_PER_SYSCALL == 0) {
+  if (ctx->sock) {
+    apply_commands(ctx, cycle, gpio_oe[0]);
+  } else if (ctx->counter % TICKS_PER_SYSCALL == 0) {
     char gpio_str[256];
     ssize_t read_len =
         read(ctx->host_to_dev_fifo, gpio_str, sizeof(gpio_str) - 1);
@@ -245,8 +402,8 @@ uint32_t gpiodpi_host_to_device_tick(void *ctx_void, svBitVecVal *gpio_oe,
                         "GPIO: Host tried to pull output pin low: pin %2d\n",
                         idx);
               }
-              CLR_BIT(ctx->driven_pin_values, idx);
-              set_bit_val(&ctx->weak_pins, idx, weak);
+              CLR_BIT(ctx->pins.driven_pin_values, idx);
+              set_bit_val(&ctx->pins.weak_pins, idx, weak);
             } else {
               fprintf(stderr,
                       "GPIO: Host tried to pull invalid pin low: pin %2d\n",
@@ -265,8 +422,8 @@ uint32_t gpiodpi_host_to_device_tick(void *ctx_void, svBitVecVal *gpio_oe,
                         "GPIO: Host tried to pull output pin high: pin %2d\n",
                         idx);
               }
-              SET_BIT(ctx->driven_pin_values, idx);
-              set_bit_val(&ctx->weak_pins, idx, weak);
+              SET_BIT(ctx->pins.driven_pin_values, idx);
+              set_bit_val(&ctx->pins.weak_pins, idx, weak);
             } else {
               fprintf(stderr,
                       "GPIO: Host tried to pull invalid pin high: pin %2d\n",
@@ -293,9 +450,9 @@ parse_loop_end:
   // which are being weak and the pinmux has the pull up/down resistor enabled.
   // On weak pins, the pinmux pull up/down wins over the driven value of the
   // pin.  On strong pins, the driven value always wins.
-  uint32_t candidates = ctx->weak_pins & gpio_pull_en[0];
+  uint32_t candidates = ctx->pins.weak_pins & gpio_pull_en[0];
   uint32_t pull = candidates & gpio_pull_sel[0];
-  uint32_t result = (ctx->driven_pin_values & ~candidates) | pull;
+  uint32_t result = (ctx->pins.driven_pin_values & ~candidates) | pull;
   return result;
 }
 
@@ -305,6 +462,16 @@ void gpiodpi_close(void *ctx_void) {
     return;
   }
 
+#ifdef VERILATOR
+  simctrl_forget_dpi_state(&ctx->pins);
+#endif
+
+  if (ctx->sock) {
+    tcp_server_close(ctx->sock);
+    free(ctx);
+    return;
+  }
+
   if (close(ctx->dev_to_host_fifo) != 0) {
     printf("GPIO: Failed to close FIFO file at %s: %s\n", ctx->dev_to_host_path,
            strerror(errno));
@@ -11,22 +11,71 @@
 extern "C" {
 #endif
 
+/**
+ * Binary protocol
+ *
+ * If gpiodpi_create() is given a listen port, the host talks to the module
+ * over a TCP socket instead of the text FIFOs. All fields are little-endian
+ * and all times are in cycles of the clock of the module since it was
+ * activated.
+ *
+ * The host sends commands of GPIODPI_CMD_LEN bytes:
+ *
+ *   bytes 0-7    cycle at which to apply the command
+ *   bytes 8-11   mask of the pins to drive
+ *   bytes 12-15  values to drive the pins in the mask to
+ *   bytes 16-19  mask of the pins in the mask to drive weakly
+ *
+ * Commands are applied in order, each at the first clock cycle at or after its
+ * cycle, so commands should be sent in order of cycle. A command with an empty
+ * pin mask is a sync: when its cycle comes, the module answers with an event
+ * that has GPIODPI_EVENT_SYNC set.
+ *
+ * If the simulation has already passed the cycle of a command when the module
+ * gets to it (because the host sent it too late, or out of order), the module
+ * applies it straight away and sends an event with GPIODPI_EVENT_LATE set and
+ * the cycle at which it was applied. For a sync, that is the sync's own event.
+ * Hosts that need exact timing should send commands well ahead, and can check
+ * that no late events come back.
+ *
+ * Once the host has sent a command, the module sends an event of
+ * GPIODPI_EVENT_LEN bytes whenever the pins driven by the device change:
+ *
+ *   bytes 0-7    cycle of the change
+ *   bytes 8-11   values of the pins
+ *   bytes 12-15  output enables of the pins
+ *   bytes 16-19  flags (GPIODPI_EVENT_*)
+ */
+#define GPIODPI_CMD_LEN 20
+#define GPIODPI_EVENT_LEN 20
+
+// The event answers a sync command rather than reporting a change
+#define GPIODPI_EVENT_SYNC 0x1
+// Events were lost before this one because the host didn't read them
+#define GPIODPI_EVENT_OVERFLOW 0x2
+// The event reports a command that was applied after its cycle
+#define GPIODPI_EVENT_LATE 0x4
+
 /**
  * Allocate a new GPIO DPI interface, returned as an opaque pointer.
  *
  * @param name a name to use when creating the inner FIFO.
  * @param n_bits number of bits to write in each direction; this must be at
  *        most 32 bits.
+ * @param listen_port if non-zero, use the binary protocol on a TCP socket on
+ *        this port instead of the text FIFOs.
  */
-void *gpiodpi_create(const char *name, int n_bits);
+void *gpiodpi_create(const char *name, int n_bits, int listen_port);
 
 /**
  * Attempt to post the current GPIO state to the outside world.
  *
  * Intended to be called from SystemVerilog.
+ *
+ * @param cycle the current clock cycle
  */
-void gpiodpi_device_to_host(void *ctx_void, svBitVecVal *gpio_data,
-                            svBitVecVal *gpio_oe);
+void gpiodpi_device_to_host(void *ctx_void, long long cycle,
+                            svBitVecVal *gpio_data, svBitVecVal *gpio_oe);
 
 /**
  * Attempt to read a GPIO command from the outside world.
@@ -37,10 +86,14 @@ void gpiodpi_device_to_host(void *ctx_void, svBitVecVal *gpio_data,
  * does the opposite. All other pins at left in an unspecified state. Invalid
  * commands are ignored.
  *
+ * With the binary protocol, this applies the commands that are due by cycle.
+ *
  * Intended to be called from SystemVerilog.
+ * @param cycle the current clock cycle
  * @return the values to pull the GPIO pins to.
  */
-uint32_t gpiodpi_host_to_device_tick(void *ctx_void, svBitVecVal *gpio_oe,
+uint32_t gpiodpi_host_to_device_tick(void *ctx_void, long long cycle,
+                                     svBitVecVal *gpio_oe,
                                      svBitVecVal *gpio_pull_en,
                                      svBitVecVal *gpio_pull_sel);
 
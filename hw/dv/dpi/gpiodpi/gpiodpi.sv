@@ -5,7 +5,10 @@
 module gpiodpi
 #(
   parameter string NAME = "gpio0",
-  parameter int    N_GPIO = 32
+  parameter int    N_GPIO = 32,
+  // If non-zero, talk to the host with the binary protocol (see gpiodpi.h) on a TCP socket on this
+  // port instead of the text FIFOs. This can be overridden with the `GPIODPI_PORT_<name>` plusarg.
+  parameter int    LISTEN_PORT = 0
 )(
   input  logic              clk_i,
   input  logic              rst_ni,
@@ -18,26 +21,57 @@ module gpiodpi
   input  logic [N_GPIO-1:0] gpio_pull_sel
 );
    import "DPI-C" function
-     chandle gpiodpi_create(input string name, input int n_bits);
+     chandle gpiodpi_create(input string name, input int n_bits, input int listen_port);
 
    import "DPI-C" function
-     void gpiodpi_device_to_host(input chandle ctx, input logic [N_GPIO-1:0] gpio_d2p,
+     void gpiodpi_device_to_host(input chandle ctx, input longint cycle,
+                                 input logic [N_GPIO-1:0] gpio_d2p,
                                  input logic [N_GPIO-1:0] gpio_en_d2p);
 
    import "DPI-C" function
      void gpiodpi_close(input chandle ctx);
 
    import "DPI-C" function
-     int gpiodpi_host_to_device_tick(input chandle ctx,
+     int gpiodpi_host_to_device_tick(input chandle ctx, input longint cycle,
                                      input logic [N_GPIO-1:0] gpio_en_d2p,
                                      input logic [N_GPIO-1:0] gpio_pull_en,
                                      input logic [N_GPIO-1:0] gpio_pull_sel);
 
    chandle ctx;
 
+`ifdef VERILATOR
+   // The ID of the simulator run that created ctx (see sim_ctrl_dpi.h)
+   import "DPI-C" pure function longint simctrl_run_id();
+   longint ctx_run_id;
+`endif
+
    function automatic void initialize();
+     int port;
+
      $display($time, "GPIO: creating gpiodpi");
-     ctx = gpiodpi_create(NAME, N_GPIO);
+     port = LISTEN_PORT;
+     void'($value$plusargs({"GPIODPI_PORT_", NAME, "=%d"}, port));
+     ctx = gpiodpi_create(NAME, N_GPIO, port);
+`ifdef VERILATOR
+     ctx_run_id = simctrl_run_id();
+`endif
+   endfunction
+
+   // Whether ctx was created by another run of the simulator, and so points nowhere
+   function automatic bit ctx_stale();
+`ifdef VERILATOR
+     return ctx != null && ctx_run_id != simctrl_run_id();
+`else
+     return 1'b0;
+`endif
+   endfunction
+
+   // Create the context again if a restored checkpoint made it stale
+   function automatic void renew_ctx();
+     if (ctx_stale()) begin
+       ctx = null;
+       initialize();
+     end
    endfunction
 
    // Allow being activated past initial time.
@@ -50,17 +84,25 @@ module gpiodpi
    end
 
    final begin
-     gpiodpi_close(ctx);
+     if (!ctx_stale()) gpiodpi_close(ctx);
    end
 
    logic eff_clk;
    assign eff_clk = clk_i && active;
 
+   // The number of clock cycles since the module was activated, which timestamps the binary
+   // protocol.
+   longint cycle = 0;
+   always_ff @(posedge eff_clk) begin
+     cycle <= cycle + 1;
+   end
+
    logic [N_GPIO-1:0] gpio_d2p_r;
    always_ff @(posedge eff_clk) begin
      gpio_d2p_r <= gpio_d2p;
+     renew_ctx();
      if (gpio_d2p_r != gpio_d2p) begin
-       gpiodpi_device_to_host(ctx, gpio_d2p, gpio_en_d2p);
+       gpiodpi_device_to_host(ctx, cycle, gpio_d2p, gpio_en_d2p);
      end
    end
 
@@ -68,7 +110,9 @@ module gpiodpi
      if (!rst_ni) begin
        gpio_p2d <= '0; // default value
      end else begin
-       gpio_p2d <= gpiodpi_host_to_device_tick(ctx, gpio_en_d2p, gpio_pull_en, gpio_pull_sel);
+       renew_ctx();
+       gpio_p2d <= gpiodpi_host_to_device_tick(ctx, cycle, gpio_en_d2p, gpio_pull_en,
+                                               gpio_pull_sel);
      end
    end
 
@@ -0,0 +1,151 @@
+// Copyright lowRISC contributors (OpenTitan project).
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+
+// Client test for the binary protocol of the GPIO DPI module. A client thread
+// schedules pin changes and reads back the timestamped event log, while the
+// main thread ticks the module against a device that copies pin 0 to pin 4.
+// Run it with:
+//
+//   bazel test //hw/dv/dpi/gpiodpi:gpiodpi_test
+//
+// or run the binary by hand with an optional port number. The program exits
+// with a nonzero status if any check fails.
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "dpi_test.h"
+#include "gpiodpi.h"
+
+// The device drives pin 4 with the value of pin 0.
+#define IN_PIN 0x01
+#define OUT_PIN 0x10
+
+// The simulation runs up to (and then keeps ticking at) this cycle.
+static volatile long long run_to = 0;
+static volatile bool client_done = false;
+static int port;
+
+static void put_le(uint8_t *buf, uint64_t val, int len) {
+  for (int i = 0; i < len; ++i) {
+    buf[i] = (val >> (8 * i)) & 0xff;
+  }
+}
+
+static uint64_t get_le(const uint8_t *buf, int len) {
+  uint64_t val = 0;
+  for (int i = len - 1; i >= 0; --i) {
+    val = (val << 8) | buf[i];
+  }
+  return val;
+}
+
+static void put_cmd(uint8_t *buf, uint64_t cycle, uint32_t mask,
+                    uint32_t value) {
+  put_le(&buf[0], cycle, 8);
+  put_le(&buf[8], mask, 4);
+  put_le(&buf[12], value, 4);
+  put_le(&buf[16], 0, 4);
+}
+
+/**
+ * Receive the next event and check it against what is expected
+ */
+static void expect_event(int fd, uint64_t cycle, uint32_t values,
+                         uint32_t flags) {
+  uint8_t event[GPIODPI_EVENT_LEN];
+  dpi_test_recv_all(fd, event, sizeof(event));
+  uint64_t ev_cycle = get_le(&event[0], 8);
+  uint32_t ev_values = get_le(&event[8], 4);
+  uint32_t ev_oe = get_le(&event[12], 4);
+  uint32_t ev_flags = get_le(&event[16], 4);
+  if (ev_cycle != cycle || ev_values != values || ev_oe != OUT_PIN ||
+      ev_flags != flags) {
+    dpi_test_fail(
+        "Expected event at cycle %llu (values 0x%x, flags 0x%x), got cycle "
+        "%llu (values 0x%x, oe 0x%x, flags 0x%x)\n",
+        (unsigned long long)cycle, values, flags, (unsigned long long)ev_cycle,
+        ev_values, ev_oe, ev_flags);
+  }
+}
+
+static void *client(void *arg) {
+  (void)arg;
+  int fd = dpi_test_connect(port);
+
+  // The simulation waits at cycle 0 until the first sync has come back. The
+  // commands go in a single send(), so the rest of them have arrived by then.
+  uint8_t cmds[4][GPIODPI_CMD_LEN];
+  put_cmd(cmds[0], 0, 0, 0);
+  put_cmd(cmds[1], 100, IN_PIN, IN_PIN);
+  put_cmd(cmds[2], 150, IN_PIN, 0);
+  put_cmd(cmds[3], 200, 0, 0);
+  dpi_test_send_all(fd, cmds, sizeof(cmds));
+  expect_event(fd, 0, 0, GPIODPI_EVENT_SYNC);
+  run_to = 1000;
+
+  // Each change happens exactly at the cycle that it was scheduled for.
+  expect_event(fd, 100, OUT_PIN, 0);
+  expect_event(fd, 150, 0, 0);
+  expect_event(fd, 200, 0, GPIODPI_EVENT_SYNC);
+
+  // Wait for the simulation to stop at run_to, and then send a command for a
+  // cycle that has already passed. It is applied straight away, and reported.
+  put_cmd(cmds[0], 1000, 0, 0);
+  dpi_test_send_all(fd, cmds[0], GPIODPI_CMD_LEN);
+  expect_event(fd, 1000, 0, GPIODPI_EVENT_SYNC);
+  put_cmd(cmds[0], 500, IN_PIN, IN_PIN);
+  dpi_test_send_all(fd, cmds[0], GPIODPI_CMD_LEN);
+  expect_event(fd, 1000, 0, GPIODPI_EVENT_LATE);
+  expect_event(fd, 1000, OUT_PIN, 0);
+
+  close(fd);
+  client_done = true;
+  return NULL;
+}
+
+int main(int argc, char **argv) {
+  port = argc > 1 ? atoi(argv[1]) : dpi_test_free_port();
+
+  void *ctx = gpiodpi_create("gpiodpi_test", 8, port);
+  assert(ctx);
+
+  pthread_t client_thread;
+  int rv = pthread_create(&client_thread, NULL, client, NULL);
+  assert(rv == 0);
+  (void)rv;
+
+  // Like gpiodpi.sv, report the device pins at the start and whenever they
+  // change. The loop gives up after far longer than the test needs.
+  svBitVecVal oe = OUT_PIN, no_pulls = 0, d2p = 0;
+  long long cycle = 0;
+  gpiodpi_device_to_host(ctx, cycle, &d2p, &oe);
+  for (long iter = 0; !client_done && iter < 10000000; ++iter) {
+    uint32_t p2d = gpiodpi_host_to_device_tick(ctx, cycle, &oe, &no_pulls,
+                                               &no_pulls);
+    svBitVecVal new_d2p = (p2d & IN_PIN) ? OUT_PIN : 0;
+    if (new_d2p != d2p) {
+      d2p = new_d2p;
+      gpiodpi_device_to_host(ctx, cycle, &d2p, &oe);
+    }
+    if (cycle < run_to) {
+      ++cycle;
+    } else {
+      usleep(10);
+    }
+  }
+  CHECK(client_done);
+  if (!client_done) {
+    pthread_cancel(client_thread);
+  }
+  pthread_join(client_thread, NULL);
+  gpiodpi_close(ctx);
+
+  return dpi_test_finish();
+}
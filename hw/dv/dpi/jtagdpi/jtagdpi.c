@@ -11,47 +11,25 @@
 #include <string.h>
 
 #include "tcp_server.h"
+#ifdef VERILATOR
+#include "sim_ctrl_dpi.h"
+#endif
 
-struct jtagdpi_ctx {
-  // Server context
-  struct tcp_server_ctx *sock;
-  // Signals
+// The JTAG signals, which a Verilator simulation keeps in checkpoints.
+struct jtagdpi_signals {
   uint8_t tck;
   uint8_t tms;
   uint8_t tdi;
   uint8_t tdo;
   uint8_t trst_n;
   uint8_t srst_n;
-  // Lookahead buffer - non-zero if valid
-  char cmd;
 };
 
-static bool lookahead(struct jtagdpi_ctx *ctx) {
-  // Look at the next command if available. Return true if it's an
-  // 'R', otherwise buffer it to return via get_cmd().
-  char cmd;
-  if (!tcp_server_read(ctx->sock, &cmd)) {
-    return false;
-  }
-  if (cmd == 'R') {
-    return true;
-  } else {
-    ctx->cmd = cmd;
-    return false;
-  }
-}
-
-static bool get_cmd(struct jtagdpi_ctx *ctx, char *cmd) {
-  // Return a buffered command if available, or try to pull one from
-  // the socket.
-  if (ctx->cmd) {
-    *cmd = ctx->cmd;
-    ctx->cmd = 0;
-    return true;
-  } else {
-    return tcp_server_read(ctx->sock, cmd);
-  }
-}
+struct jtagdpi_ctx {
+  // Server context
+  struct tcp_server_ctx *sock;
+  struct jtagdpi_signals sig;
+};
 
 /**
  * Reset the JTAG signals to a "dongle unplugged" state
@@ -59,15 +37,15 @@ static bool get_cmd(struct jtagdpi_ctx *ctx, char *cmd) {
 static void reset_jtag_signals(struct jtagdpi_ctx *ctx, bool assert_srst) {
   assert(ctx);
 
-  ctx->tck = 0;
-  ctx->tms = 0;
-  ctx->tdi = 0;
+  ctx->sig.tck = 0;
+  ctx->sig.tms = 0;
+  ctx->sig.tdi = 0;
 
   // trst_n is pulled down (reset active) by default
-  ctx->trst_n = 0;
+  ctx->sig.trst_n = 0;
 
   // srst_n default is determined by assert_srst
-  ctx->srst_n = assert_srst ? 0 : 1;
+  ctx->sig.srst_n = assert_srst ? 0 : 1;
 }
 
 /**
@@ -83,62 +61,83 @@ static void update_jtag_signals(struct jtagdpi_ctx *ctx) {
    * https://repo.or.cz/openocd.git/blob/HEAD:/doc/manual/jtag/drivers/remote_bitbang.txt
    */
 
-  // read a command byte
-  char cmd;
-  if (!get_cmd(ctx, &cmd)) {
-    return;
-  }
-
-  bool act_send_resp = false;
-  bool act_quit = false;
-
-  // parse received command byte
-  if (cmd >= '0' && cmd <= '7') {
-    // JTAG write
-    uint8_t tck = ctx->tck;
-    char cmd_bit = cmd - '0';
-    ctx->tdi = (cmd_bit >> 0) & 0x1;
-    ctx->tms = (cmd_bit >> 1) & 0x1;
-    ctx->tck = (cmd_bit >> 2) & 0x1;
-    // On a rising edge of TCK, we can process a following 'R' command
-    // to sense the current TDO without waiting for the next DPI
-    // callback. Since TDO changes on the falling edge of TCK, it is
-    // already stable and valid.
-    if (!tck && ctx->tck && lookahead(ctx)) {
+  // Handle all the received commands that don't change the JTAG signals, up
+  // to and including the first one that does (which the design has to see
+  // before we go on). Commands are handled in place in the receive buffer.
+  const char *cmds;
+  size_t num_cmds = tcp_server_peek(ctx->sock, &cmds);
+  size_t pos = 0;
+  bool signals_changed = false;
+
+  while (pos < num_cmds && !signals_changed) {
+    // A read needs space for its response. If the client isn't taking
+    // responses, leave the read for a later tick. That stops the server
+    // taking more commands from the client until it catches up.
+    if (cmds[pos] == 'R' && !tcp_server_write_space(ctx->sock)) {
+      break;
+    }
+    char cmd = cmds[pos++];
+
+    bool act_send_resp = false;
+    bool act_quit = false;
+
+    // parse received command byte
+    if (cmd >= '0' && cmd <= '7') {
+      // JTAG write
+      uint8_t tck = ctx->sig.tck;
+      char cmd_bit = cmd - '0';
+      ctx->sig.tdi = (cmd_bit >> 0) & 0x1;
+      ctx->sig.tms = (cmd_bit >> 1) & 0x1;
+      ctx->sig.tck = (cmd_bit >> 2) & 0x1;
+      signals_changed = true;
+      // On a rising edge of TCK, we can process a following 'R' command
+      // to sense the current TDO without waiting for the next DPI
+      // callback. Since TDO changes on the falling edge of TCK, it is
+      // already stable and valid.
+      if (!tck && ctx->sig.tck && pos < num_cmds && cmds[pos] == 'R' &&
+          tcp_server_write_space(ctx->sock)) {
+        ++pos;
+        act_send_resp = true;
+      }
+    } else if (cmd >= 'r' && cmd <= 'u') {
+      // JTAG reset (active high from OpenOCD)
+      char cmd_bit = cmd - 'r';
+      ctx->sig.srst_n = !((cmd_bit >> 0) & 0x1);
+      ctx->sig.trst_n = !((cmd_bit >> 1) & 0x1);
+      signals_changed = true;
+    } else if (cmd == 'R') {
+      // JTAG read
       act_send_resp = true;
+    } else if (cmd == 'B') {
+      // printf("BLINK ON!\n");
+    } else if (cmd == 'b') {
+      // printf("BLINK OFF!\n");
+    } else if (cmd == 'Q') {
+      // quit (client disconnect)
+      act_quit = true;
+    } else {
+      fprintf(stderr,
+              "JTAG DPI Protocol violation detected: unsupported command %c\n",
+              cmd);
+      exit(1);
     }
-  } else if (cmd >= 'r' && cmd <= 'u') {
-    // JTAG reset (active high from OpenOCD)
-    char cmd_bit = cmd - 'r';
-    ctx->srst_n = !((cmd_bit >> 0) & 0x1);
-    ctx->trst_n = !((cmd_bit >> 1) & 0x1);
-  } else if (cmd == 'R') {
-    // JTAG read
-    act_send_resp = true;
-  } else if (cmd == 'B') {
-    // printf("BLINK ON!\n");
-  } else if (cmd == 'b') {
-    // printf("BLINK OFF!\n");
-  } else if (cmd == 'Q') {
-    // quit (client disconnect)
-    act_quit = true;
-  } else {
-    fprintf(stderr,
-            "JTAG DPI Protocol violation detected: unsupported command %c\n",
-            cmd);
-    exit(1);
-  }
 
-  // send tdo as response
-  if (act_send_resp) {
-    char tdo_ascii = ctx->tdo + '0';
-    tcp_server_write(ctx->sock, tdo_ascii);
-  }
+    // send tdo as response
+    if (act_send_resp) {
+      char tdo_ascii = ctx->sig.tdo + '0';
+      bool written = tcp_server_write(ctx->sock, tdo_ascii);
+      assert(written);
+      (void)written;
+    }
 
-  if (act_quit) {
-    printf("JTAG DPI: Remote disconnected.\n");
-    tcp_server_client_close(ctx->sock);
+    if (act_quit) {
+      printf("JTAG DPI: Remote disconnected.\n");
+      tcp_server_client_close(ctx->sock);
+      break;
+    }
   }
+
+  tcp_server_consume(ctx->sock, pos);
 }
 
 void *jtagdpi_create(const char *display_name, int listen_port,
@@ -151,6 +150,11 @@ void *jtagdpi_create(const char *display_name, int listen_port,
   ctx->sock = tcp_server_create(display_name, listen_port);
 
   reset_jtag_signals(ctx, assert_srst != 0);
+#ifdef VERILATOR
+  // After a checkpoint has been restored, this brings back the signals as
+  // they were, rather than as a freshly unplugged dongle would drive them.
+  simctrl_keep_dpi_state("jtagdpi", display_name, &ctx->sig, sizeof(ctx->sig));
+#endif
 
   printf(
       "\n"
@@ -169,6 +173,9 @@ void jtagdpi_close(void *ctx_void) {
   if (!ctx) {
     return;
   }
+#ifdef VERILATOR
+  simctrl_forget_dpi_state(&ctx->sig);
+#endif
   tcp_server_close(ctx->sock);
   free(ctx);
 }
@@ -180,11 +187,11 @@ void jtagdpi_tick(void *ctx_void, svBit *tck, svBit *tms, svBit *tdi,
     return;
   }
 
-  ctx->tdo = tdo;
+  ctx->sig.tdo = tdo;
   update_jtag_signals(ctx);
-  *tdi = ctx->tdi;
-  *tms = ctx->tms;
-  *tck = ctx->tck;
-  *srst_n = ctx->srst_n;
-  *trst_n = ctx->trst_n;
+  *tdi = ctx->sig.tdi;
+  *tms = ctx->sig.tms;
+  *tck = ctx->sig.tck;
+  *srst_n = ctx->sig.srst_n;
+  *trst_n = ctx->sig.trst_n;
 }
@@ -32,6 +32,12 @@ module jtagdpi #(
 
   chandle ctx;
 
+`ifdef VERILATOR
+  // The ID of the simulator run that created ctx (see sim_ctrl_dpi.h)
+  import "DPI-C" pure function longint simctrl_run_id();
+  longint ctx_run_id;
+`endif
+
   function automatic void initialize();
     int port, assert_srst;
 
@@ -46,6 +52,26 @@ module jtagdpi #(
     void'($value$plusargs("jtagdpi_assert_srst=%0d", assert_srst));
 
     ctx = jtagdpi_create(Name, port, assert_srst);
+`ifdef VERILATOR
+    ctx_run_id = simctrl_run_id();
+`endif
+  endfunction
+
+  // Whether ctx was created by another run of the simulator, and so points nowhere
+  function automatic bit ctx_stale();
+`ifdef VERILATOR
+    return ctx != null && ctx_run_id != simctrl_run_id();
+`else
+    return 1'b0;
+`endif
+  endfunction
+
+  // Create the context again if a restored checkpoint made it stale
+  function automatic void renew_ctx();
+    if (ctx_stale()) begin
+      ctx = null;
+      initialize();
+    end
   endfunction
 
   initial begin
@@ -57,13 +83,15 @@ module jtagdpi #(
   end
 
   final begin
-    jtagdpi_close(ctx);
+    if (!ctx_stale()) jtagdpi_close(ctx);
     ctx = null;
   end
 
   always_ff @(posedge clk_i, negedge rst_ni) begin
-    if (active) jtagdpi_tick(ctx, jtag_tck, jtag_tms, jtag_tdi, jtag_trst_n,
-                             jtag_srst_n, jtag_tdo);
+    if (active) begin
+      renew_ctx();
+      jtagdpi_tick(ctx, jtag_tck, jtag_tms, jtag_tdi, jtag_trst_n, jtag_srst_n, jtag_tdo);
+    end
   end
 
 endmodule
@@ -13,6 +13,8 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -22,49 +24,286 @@
 #include <unistd.h>
 
 #include "spidpi.h"
+#include "tcp_server.h"
 #ifdef VERILATOR
 #include "verilator_sim_ctrl.h"
 #endif
 
-// This holds the necessary SPI state.
+// Number of bytes in a transaction from the pseudo-terminal
 #define MAX_TRANSACTION 4
+
+// Largest payload that a socket command may have
+#define MAX_PAYLOAD (1 << 24)
+
+// A transaction is a sequence of phases (opcode, address, dummy cycles and
+// payload), each of which moves a number of bits over one, two or four lanes
+// per SCK cycle.
+#define MAX_PHASES 4
+#define PH_OUT 0     // host to device
+#define PH_IN 1      // device to host
+#define PH_DUPLEX 2  // both ways on a single lane
+#define PH_DUMMY 3   // no data
+
+struct spidpi_phase {
+  int dir;
+  int lanes;
+  uint32_t ncycles;
+  // data to send, for PH_OUT and PH_DUPLEX
+  const uint8_t *out;
+};
+
+// This holds the necessary SPI state.
 struct spidpi_ctx {
   int loglevel;
   char ptyname[64];
   int host;
   int device;
+  struct tcp_server_ctx *sock;
   FILE *mon_file;
   char mon_pathname[PATH_MAX];
   void *mon;
   int tick;
   int cpol;
   int cpha;
-  int msbfirst;  // shift direction
-  int nout;
-  int bout;
-  int nin;
-  int bin;
-  int din;
-  int nmax;
-  char driving;
+  // Ticks per half SCK period and until the next SCK edge
+  int half_period;
+  int ticks_to_edge;
+  // Internal SCK, which is 1 between the leading and trailing edge of a cycle
+  int sck;
+  int driving;
   int state;
-  char buf[MAX_TRANSACTION];
+
+  // The current transaction
+  struct spidpi_phase phases[MAX_PHASES];
+  int nphases;
+  int phase;
+  uint32_t cycle;
+  uint8_t *tx;
+  size_t tx_size;
+  // Data received from the device follows a 4-byte length, which is sent
+  // back to socket clients as it is.
+  uint8_t *rx;
+  size_t rx_size;
+  size_t rx_len;
+  int rx_byte;
+  int rx_bits;
+  // The response to the last socket command, which is rx[0, resp_len)
+  size_t resp_len;
+  size_t resp_sent;
+
+  // A socket command as it is received
+  uint8_t hdr[SPIDPI_CMD_HDR_LEN];
+  size_t hdr_len;
+  size_t payload_pos;
+  size_t payload_len;
 };
 
 // SPI Host States
 #define SP_IDLE 0
 #define SP_CSFALL 1
 #define SP_DMOVE 2
-#define SP_LASTBIT 3
-#define SP_CSRISE 4
+#define SP_CSRISE 3
 #define SP_FINISH 99
 
 // Enable this define to stop tracing at cycle 4
 // and resume at the first SPI packet
 // #define CONTROL_TRACE
 
-void *spidpi_create(const char *name, int mode, int loglevel) {
-  int i;
+static bool set_clk_div(struct spidpi_ctx *ctx, int clk_div) {
+  if (clk_div < 2 || (clk_div & 1)) {
+    fprintf(stderr,
+            "SPI: Clock divider must be even and at least 2, not %d.\n",
+            clk_div);
+    return false;
+  }
+  ctx->half_period = clk_div / 2;
+  return true;
+}
+
+// Make sure that buf has room for size bytes
+static void reserve(uint8_t **buf, size_t *buf_size, size_t size) {
+  if (size <= *buf_size) {
+    return;
+  }
+  *buf = (uint8_t *)realloc(*buf, size);
+  assert(*buf);
+  *buf_size = size;
+}
+
+static void add_phase(struct spidpi_ctx *ctx, int dir, int lanes,
+                      uint32_t nbits, const uint8_t *out) {
+  if (nbits == 0) {
+    return;
+  }
+  assert(ctx->nphases < MAX_PHASES);
+  struct spidpi_phase *ph = &ctx->phases[ctx->nphases++];
+  ph->dir = dir;
+  ph->lanes = lanes;
+  ph->ncycles = dir == PH_DUMMY ? nbits : nbits / lanes;
+  ph->out = out;
+}
+
+static void start_transaction(struct spidpi_ctx *ctx, size_t rx_len) {
+  assert(ctx->nphases > 0);
+  reserve(&ctx->rx, &ctx->rx_size, 4 + rx_len);
+  ctx->rx_len = 0;
+  ctx->rx_byte = 0;
+  ctx->rx_bits = 0;
+  ctx->phase = 0;
+  ctx->cycle = 0;
+  ctx->state = SP_CSFALL;
+  ctx->ticks_to_edge = 1;
+#ifdef VERILATOR
+#ifdef CONTROL_TRACE
+  VerilatorSimCtrl::GetInstance().TraceOn();
+#endif
+#endif
+}
+
+/**
+ * Start a transaction for every MAX_TRANSACTION bytes from the pseudo-terminal
+ *
+ * The bytes are sent on a single lane and the bytes received at the same time
+ * are written back to the pseudo-terminal.
+ */
+static void poll_pty(struct spidpi_ctx *ctx) {
+  int n = read(ctx->host, &ctx->tx[ctx->payload_pos],
+               MAX_TRANSACTION - ctx->payload_pos);
+  if (n == -1) {
+    if (errno != EAGAIN) {
+      fprintf(stderr, "Read on SPI FIFO gave %s\n", strerror(errno));
+    }
+    return;
+  }
+  ctx->payload_pos += n;
+  if (ctx->payload_pos < MAX_TRANSACTION) {
+    return;
+  }
+  ctx->payload_pos = 0;
+  ctx->nphases = 0;
+  add_phase(ctx, PH_DUPLEX, 1, 8 * MAX_TRANSACTION, ctx->tx);
+  start_transaction(ctx, MAX_TRANSACTION);
+}
+
+static int get_lanes(uint8_t flags, int shift) {
+  return 1 << ((flags >> shift) & SPIDPI_CMD_LANES_MASK);
+}
+
+static uint32_t get_u32(const uint8_t *buf) {
+  return buf[0] | (buf[1] << 8) | (buf[2] << 16) | ((uint32_t)buf[3] << 24);
+}
+
+static void put_u32(uint8_t *buf, uint32_t val) {
+  for (int i = 0; i < 4; ++i) {
+    buf[i] = (val >> (8 * i)) & 0xff;
+  }
+}
+
+// Send a response with no data, for writes and control commands
+static void queue_empty_response(struct spidpi_ctx *ctx) {
+  reserve(&ctx->rx, &ctx->rx_size, 4);
+  ctx->rx_len = 0;
+  ctx->resp_len = 4;
+  ctx->resp_sent = 0;
+  put_u32(ctx->rx, 0);
+}
+
+// Send the rest of the response to the last command. Returns true once all of
+// it has been sent.
+static bool flush_response(struct spidpi_ctx *ctx) {
+  if (ctx->resp_sent < ctx->resp_len) {
+    ctx->resp_sent += tcp_server_write_bulk(
+        ctx->sock, (const char *)&ctx->rx[ctx->resp_sent],
+        ctx->resp_len - ctx->resp_sent);
+  }
+  return ctx->resp_sent == ctx->resp_len;
+}
+
+static void drop_client(struct spidpi_ctx *ctx, const char *msg) {
+  fprintf(stderr, "SPI: %s Closing the connection.\n", msg);
+  tcp_server_client_close(ctx->sock);
+  ctx->hdr_len = 0;
+}
+
+/**
+ * Receive the next command from the socket
+ *
+ * Once a whole command has been received, this starts its transaction (or
+ * handles it if it is a control command).
+ */
+static void poll_socket(struct spidpi_ctx *ctx) {
+  if (ctx->hdr_len < SPIDPI_CMD_HDR_LEN) {
+    ctx->hdr_len += tcp_server_read_bulk(
+        ctx->sock, (char *)&ctx->hdr[ctx->hdr_len],
+        SPIDPI_CMD_HDR_LEN - ctx->hdr_len);
+    if (ctx->hdr_len < SPIDPI_CMD_HDR_LEN) {
+      return;
+    }
+
+    uint8_t flags = ctx->hdr[0];
+    uint8_t addr_bytes = ctx->hdr[2];
+    uint32_t len = get_u32(&ctx->hdr[8]);
+
+    if (flags & SPIDPI_CMD_CTRL) {
+      ctx->hdr_len = 0;
+      if (ctx->hdr[1] != SPIDPI_CTRL_SET_CLK_DIV ||
+          !set_clk_div(ctx, get_u32(&ctx->hdr[4]))) {
+        drop_client(ctx, "Bad control command.");
+        return;
+      }
+      queue_empty_response(ctx);
+      return;
+    }
+
+    int cmd_lanes = get_lanes(flags, SPIDPI_CMD_CMD_LANES_SHIFT);
+    int addr_lanes = get_lanes(flags, SPIDPI_CMD_ADDR_LANES_SHIFT);
+    int data_lanes = get_lanes(flags, SPIDPI_CMD_DATA_LANES_SHIFT);
+    if (cmd_lanes > 4 || addr_lanes > 4 || data_lanes > 4 || addr_bytes > 4 ||
+        len > MAX_PAYLOAD) {
+      drop_client(ctx, "Bad command.");
+      return;
+    }
+
+    // The opcode and the address go before the payload in tx.
+    size_t prefix_len = 1 + addr_bytes;
+    ctx->payload_len = (flags & SPIDPI_CMD_READ) ? 0 : len;
+    ctx->payload_pos = 0;
+    reserve(&ctx->tx, &ctx->tx_size, prefix_len + ctx->payload_len);
+    ctx->tx[0] = ctx->hdr[1];
+    uint32_t addr = get_u32(&ctx->hdr[4]);
+    for (int i = 0; i < addr_bytes; ++i) {
+      ctx->tx[1 + i] = (addr >> (8 * (addr_bytes - 1 - i))) & 0xff;
+    }
+  }
+
+  uint8_t flags = ctx->hdr[0];
+  size_t prefix_len = 1 + ctx->hdr[2];
+  if (ctx->payload_pos < ctx->payload_len) {
+    ctx->payload_pos += tcp_server_read_bulk(
+        ctx->sock, (char *)&ctx->tx[prefix_len + ctx->payload_pos],
+        ctx->payload_len - ctx->payload_pos);
+    if (ctx->payload_pos < ctx->payload_len) {
+      return;
+    }
+  }
+  ctx->hdr_len = 0;
+
+  uint32_t len = get_u32(&ctx->hdr[8]);
+  int data_lanes = get_lanes(flags, SPIDPI_CMD_DATA_LANES_SHIFT);
+  bool is_read = flags & SPIDPI_CMD_READ;
+  ctx->nphases = 0;
+  add_phase(ctx, PH_OUT, get_lanes(flags, SPIDPI_CMD_CMD_LANES_SHIFT), 8,
+            ctx->tx);
+  add_phase(ctx, PH_OUT, get_lanes(flags, SPIDPI_CMD_ADDR_LANES_SHIFT),
+            8 * ctx->hdr[2], &ctx->tx[1]);
+  add_phase(ctx, PH_DUMMY, data_lanes, ctx->hdr[3], NULL);
+  add_phase(ctx, is_read ? PH_IN : PH_OUT, data_lanes, 8 * len,
+            &ctx->tx[prefix_len]);
+  start_transaction(ctx, is_read ? len : 0);
+}
+
+void *spidpi_create(const char *name, int mode, int loglevel, int clk_div,
+                    int listen_port) {
   struct spidpi_ctx *ctx =
       (struct spidpi_ctx *)calloc(1, sizeof(struct spidpi_ctx));
   assert(ctx);
@@ -72,12 +311,10 @@ void *spidpi_create(const char *name, int mode, int loglevel) {
   ctx->loglevel = loglevel;
   ctx->mon = monitor_spi_init(mode);
   ctx->tick = 0;
-  ctx->msbfirst = 1;
-  ctx->nmax = MAX_TRANSACTION;
-  ctx->nin = 0;
-  ctx->nout = 0;
-  ctx->bout = 0;
   ctx->state = SP_IDLE;
+  if (!set_clk_div(ctx, clk_div)) {
+    set_clk_div(ctx, 8);
+  }
   /* mode is CPOL << 1 | CPHA
    * cpol = 0 --> external clock matches internal
    * cpha = 0 --> drive on internal falling edge, capture on rising
@@ -92,27 +329,43 @@ void *spidpi_create(const char *name, int mode, int loglevel) {
   assert(cwd_rv != NULL);
 
   int rv;
-  struct termios tty;
-  cfmakeraw(&tty);
+  if (listen_port) {
+    ctx->sock = tcp_server_create(name, listen_port);
+    assert(ctx->sock);
+    printf(
+        "\n"
+        "SPI: Listening for commands for %s on port %d, with SCK at 1/%d of "
+        "the clock.\n",
+        name, listen_port, 2 * ctx->half_period);
+  } else {
+    reserve(&ctx->tx, &ctx->tx_size, MAX_TRANSACTION);
 
-  rv = openpty(&ctx->host, &ctx->device, 0, &tty, 0);
-  assert(rv != -1);
+    struct termios tty;
+    cfmakeraw(&tty);
 
-  rv = ttyname_r(ctx->device, ctx->ptyname, 64);
-  assert(rv == 0 && "ttyname_r failed");
+    rv = openpty(&ctx->host, &ctx->device, 0, &tty, 0);
+    assert(rv != -1);
 
-  int cur_flags = fcntl(ctx->host, F_GETFL, 0);
-  assert(cur_flags != -1 && "Unable to read current flags.");
-  int new_flags = fcntl(ctx->host, F_SETFL, cur_flags | O_NONBLOCK);
-  assert(new_flags != -1 && "Unable to set FD flags");
+    rv = ttyname_r(ctx->device, ctx->ptyname, 64);
+    assert(rv == 0 && "ttyname_r failed");
 
-  printf(
-      "\n"
-      "SPI: Created %s for %s. Connect to it with any terminal program, e.g.\n"
-      "$ screen %s\n"
-      "NOTE: a SPI transaction is run for every 4 characters entered.\n",
-      ctx->ptyname, name, ctx->ptyname);
+    int cur_flags = fcntl(ctx->host, F_GETFL, 0);
+    assert(cur_flags != -1 && "Unable to read current flags.");
+    int new_flags = fcntl(ctx->host, F_SETFL, cur_flags | O_NONBLOCK);
+    assert(new_flags != -1 && "Unable to set FD flags");
+
+    printf(
+        "\n"
+        "SPI: Created %s for %s. Connect to it with any terminal program, "
+        "e.g.\n"
+        "$ screen %s\n"
+        "NOTE: a SPI transaction is run for every 4 characters entered.\n",
+        ctx->ptyname, name, ctx->ptyname);
+  }
 
+  if (!loglevel) {
+    return (void *)ctx;
+  }
   rv = snprintf(ctx->mon_pathname, PATH_MAX, "%s/%s.log", cwd, name);
   assert(rv <= PATH_MAX && rv > 0);
   ctx->mon_file = fopen(ctx->mon_pathname, "w");
@@ -131,7 +384,71 @@ void *spidpi_create(const char *name, int mode, int loglevel) {
   return (void *)ctx;
 }
 
-char spidpi_tick(void *ctx_void, const svLogicVecVal *d2p_data) {
+// Drive the outputs for the current cycle
+static void drive_cycle(struct spidpi_ctx *ctx) {
+  const struct spidpi_phase *ph = &ctx->phases[ctx->phase];
+  int sd = 0;
+  int sd_en = 0;
+  if (ph->dir == PH_OUT || ph->dir == PH_DUPLEX) {
+    // Bits go out most significant first. With more than one lane, the most
+    // significant bit of each cycle goes on the highest lane.
+    uint32_t bit = ctx->cycle * ph->lanes;
+    int shift = 8 - ph->lanes - (bit & 7);
+    sd = (ph->out[bit >> 3] >> shift) & ((1 << ph->lanes) - 1);
+    sd_en = (1 << ph->lanes) - 1;
+  } else if (ph->lanes == 1) {
+    // A single-lane host always drives SDI.
+    sd_en = 1;
+  }
+  ctx->driving = (ctx->driving & (P2D_SCK | P2D_CSB)) |
+                 (sd << P2D_SD_SHIFT) | (sd_en << P2D_SD_EN_SHIFT);
+}
+
+// Capture the inputs for the current cycle
+static void sample_cycle(struct spidpi_ctx *ctx, int d2p) {
+  const struct spidpi_phase *ph = &ctx->phases[ctx->phase];
+  if (ph->dir != PH_IN && ph->dir != PH_DUPLEX) {
+    return;
+  }
+  int sd = (d2p >> D2P_SD_SHIFT) & 0xf;
+  // On a single lane, the device sends on SDO (SD1).
+  int bits = ph->lanes == 1 ? ((d2p & D2P_SDO) ? 1 : 0)
+                            : sd & ((1 << ph->lanes) - 1);
+  ctx->rx_byte = (ctx->rx_byte << ph->lanes) | bits;
+  ctx->rx_bits += ph->lanes;
+  if (ctx->rx_bits == 8) {
+    ctx->rx[4 + ctx->rx_len++] = ctx->rx_byte;
+    ctx->rx_byte = 0;
+    ctx->rx_bits = 0;
+  }
+}
+
+// Move on to the next cycle. Returns false at the end of the transaction.
+static bool next_cycle(struct spidpi_ctx *ctx) {
+  if (++ctx->cycle == ctx->phases[ctx->phase].ncycles) {
+    ctx->cycle = 0;
+    ++ctx->phase;
+  }
+  return ctx->phase < ctx->nphases;
+}
+
+static void end_transaction(struct spidpi_ctx *ctx) {
+  if (ctx->sock) {
+    put_u32(ctx->rx, ctx->rx_len);
+    ctx->resp_len = 4 + ctx->rx_len;
+    ctx->resp_sent = 0;
+    flush_response(ctx);
+    return;
+  }
+  size_t sent = 0;
+  while (sent < ctx->rx_len) {
+    int rv = write(ctx->host, &ctx->rx[4 + sent], ctx->rx_len - sent);
+    assert(rv > 0 && "write() failed.");
+    sent += rv;
+  }
+}
+
+int spidpi_tick(void *ctx_void, const svLogicVecVal *d2p_data) {
   struct spidpi_ctx *ctx = (struct spidpi_ctx *)ctx_void;
   assert(ctx);
   int d2p = d2p_data->aval;
@@ -147,104 +464,79 @@ char spidpi_tick(void *ctx_void, const svLogicVecVal *d2p_data) {
 #endif
 #endif
 
-  monitor_spi(ctx->mon, ctx->mon_file, ctx->loglevel, ctx->tick, ctx->driving,
-              d2p);
+  if (ctx->mon_file) {
+    monitor_spi(ctx->mon, ctx->mon_file, ctx->loglevel, ctx->tick,
+                ctx->driving, d2p);
+  }
 
   if (ctx->state == SP_IDLE) {
-    int n = read(ctx->host, &(ctx->buf[ctx->nin]), ctx->nmax - ctx->nin);
-    if (n == -1) {
-      if (errno != EAGAIN) {
-        fprintf(stderr, "Read on SPI FIFO gave %s\n", strerror(errno));
-      }
-    } else {
-      ctx->nin += n;
-      if (ctx->nin == ctx->nmax) {
-        ctx->nout = 0;
-        ctx->nin = 0;
-        ctx->bout = ctx->msbfirst ? 0x80 : 0x01;
-        ctx->bin = ctx->msbfirst ? 0x80 : 0x01;
-        ctx->din = 0;
-        ctx->state = SP_CSFALL;
+    if (!ctx->sock) {
+      poll_pty(ctx);
+    } else if (flush_response(ctx)) {
+      poll_socket(ctx);
+    }
 #ifdef VERILATOR
-#ifdef CONTROL_TRACE
-        VerilatorSimCtrl::GetInstance().TraceOn();
-#endif
-#endif
-      }
+    // Don't let the simulation controller skip idle cycles while a command
+    // is on its way from the socket. Once it starts, CSB marks the SPI device
+    // as busy.
+    if (ctx->hdr_len) {
+      VerilatorSimCtrl::GetInstance().VetoIdleSkip();
     }
+#endif
   }
-  // SPI clock toggles every 4th tick (i.e. freq=primary_frequency/8)
-  if ((ctx->tick & 3) || (ctx->state == SP_IDLE)) {
+  // SPI clock toggles every half_period ticks
+  if ((ctx->state == SP_IDLE) || --ctx->ticks_to_edge) {
     return ctx->driving;
   }
+  ctx->ticks_to_edge = ctx->half_period;
 
-  // Only get here on sck edges when active
-  int internal_sck = (ctx->tick & 4) ? 1 : 0;
-  int set_sck = (internal_sck ? P2D_SCK : 0);
-  if (ctx->cpol) {
-    set_sck ^= P2D_SCK;
-  }
-
-  if (internal_sck == ctx->cpha) {
-    // host driving edge (falling for mode 0)
-    switch (ctx->state) {
-      case SP_DMOVE:
-        // SCLK low, CSB low
-        ctx->driving =
-            set_sck | (ctx->buf[ctx->nout] & ctx->bout) ? P2D_SDI : 0;
-        ctx->bout = (ctx->msbfirst) ? ctx->bout >> 1 : ctx->bout << 1;
-        if ((ctx->bout & 0xff) == 0) {
-          ctx->bout = ctx->msbfirst ? 0x80 : 0x01;
-          ctx->nout++;
-          if (ctx->nout == ctx->nmax) {
-            ctx->state = SP_LASTBIT;
-          }
+  switch (ctx->state) {
+    case SP_CSFALL:
+      // CSB low, SCK idle, and the first bits out unless they go out on the
+      // leading edge.
+      ctx->driving &= ~P2D_CSB;
+      ctx->sck = 0;
+      if (!ctx->cpha) {
+        drive_cycle(ctx);
+      }
+      ctx->state = SP_DMOVE;
+      break;
+    case SP_DMOVE:
+      ctx->sck ^= 1;
+      if (ctx->sck) {
+        // leading edge (rising for mode 0)
+        if (ctx->cpha) {
+          drive_cycle(ctx);
+        } else {
+          sample_cycle(ctx, d2p);
         }
-        break;
-      case SP_LASTBIT:
-        ctx->state = SP_CSRISE;
-        // fallthrough
-      default:
-        ctx->driving = set_sck | (ctx->driving & ~P2D_SCK);
-        break;
-    }
-  } else {
-    // host other edge (rising for mode 0)
-    switch (ctx->state) {
-        // Read input data (opposite edge to sending)
-        // both DMOVE and LASTBIT states are data moving ones!
-      case SP_DMOVE:
-      case SP_LASTBIT:
-        ctx->din = ctx->din | ((d2p & D2P_SDO) ? ctx->bin : 0);
-        ctx->bin = (ctx->msbfirst) ? ctx->bin >> 1 : ctx->bin << 1;
-        if (ctx->bin == 0) {
-          int rv = write(ctx->host, &(ctx->din), 1);
-          assert(rv == 1 && "write() failed.");
-          ctx->bin = (ctx->msbfirst) ? 0x80 : 0x01;
-          ctx->din = 0;
+      } else {
+        // trailing edge (falling for mode 0)
+        if (ctx->cpha) {
+          sample_cycle(ctx, d2p);
+        }
+        if (!next_cycle(ctx)) {
+          ctx->state = SP_CSRISE;
+        } else if (!ctx->cpha) {
+          drive_cycle(ctx);
         }
-        ctx->driving = set_sck | (ctx->driving & ~P2D_SCK);
-        break;
-      case SP_CSFALL:
-        // CSB low, drive SDI to first bit
-        ctx->driving =
-            (set_sck | (ctx->buf[ctx->nout] & ctx->bout) ? P2D_SDI : 0);
-        ctx->state = SP_DMOVE;
-        break;
-      case SP_CSRISE:
-        // CSB high, clock stopped
-        ctx->driving = P2D_CSB;
-        ctx->state = SP_IDLE;
-        break;
-      case SP_FINISH:
+      }
+      ctx->driving = (ctx->driving & ~P2D_SCK) |
+                     ((ctx->sck ^ ctx->cpol) ? P2D_SCK : 0);
+      break;
+    case SP_CSRISE:
+      // CSB high, clock stopped
+      ctx->driving = P2D_CSB | ((ctx->cpol) ? P2D_SCK : 0);
+      ctx->state = SP_IDLE;
+      end_transaction(ctx);
+      break;
+    case SP_FINISH:
 #ifdef VERILATOR
-        VerilatorSimCtrl::GetInstance().RequestStop(true);
+      VerilatorSimCtrl::GetInstance().RequestStop(true);
 #endif
-        break;
-      default:
-        ctx->driving = set_sck | (ctx->driving & ~P2D_SCK);
-        break;
-    }
+      break;
+    default:
+      break;
   }
   return ctx->driving;
 }
@@ -254,6 +546,14 @@ void spidpi_close(void *ctx_void) {
   if (!ctx) {
     return;
   }
-  fclose(ctx->mon_file);
+  if (ctx->sock) {
+    tcp_server_close(ctx->sock);
+  }
+  if (ctx->mon_file) {
+    fclose(ctx->mon_file);
+  }
+  free(ctx->tx);
+  free(ctx->rx);
+  free(ctx->mon);
   free(ctx);
 }
@@ -5,6 +5,7 @@
 #ifndef OPENTITAN_HW_DV_DPI_SPIDPI_SPIDPI_H_
 #define OPENTITAN_HW_DV_DPI_SPIDPI_SPIDPI_H_
 
+#include <stdio.h>
 #include <svdpi.h>
 
 #ifdef __cplusplus
@@ -14,14 +15,61 @@ extern "C" {
 // Bits in data to C
 #define D2P_SDO 0x2
 #define D2P_SDO_EN 0x1
+// SD[3:0] from the device (SD1 is also SDO)
+#define D2P_SD_SHIFT 2
 
 // Bits in char from C
 #define P2D_SCK 0x1
 #define P2D_CSB 0x2
 #define P2D_SDI 0x4
+// SD[3:0] and their output enables to the device (SD0 is also SDI)
+#define P2D_SD_SHIFT 2
+#define P2D_SD_EN_SHIFT 6
 
-void *spidpi_create(const char *name, int mode, int loglevel);
-char spidpi_tick(void *ctx_void, const svLogicVecVal *d2p_data);
+/**
+ * Socket protocol
+ *
+ * If spidpi_create() is given a listen port, the host runs SPI flash style
+ * transactions that a client sends over a TCP socket. Each command is a
+ * 12-byte header, with multi-byte fields in little-endian order:
+ *
+ *   byte 0      flags (see SPIDPI_CMD_*)
+ *   byte 1      opcode
+ *   byte 2      number of address bytes (0 to 4)
+ *   byte 3      number of dummy cycles
+ *   bytes 4-7   address (sent most significant byte first)
+ *   bytes 8-11  payload length in bytes
+ *
+ * For a write, the header is followed by the payload. Each transaction is
+ * framed by CSB and sends the opcode, the address, the dummy cycles and then
+ * the payload, each phase with the number of lanes given in the flags.
+ *
+ * The host answers every command with a 4-byte little-endian length and then
+ * that many bytes: the payload for a read, nothing for a write. Clients can
+ * wait for the answer to know that the transaction has finished.
+ *
+ * If SPIDPI_CMD_CTRL is set, the command configures the host instead of
+ * running a transaction. The opcode is one of SPIDPI_CTRL_* and the address
+ * holds its argument.
+ */
+#define SPIDPI_CMD_HDR_LEN 12
+
+// Lanes for a phase: 0 for single, 1 for dual and 2 for quad
+#define SPIDPI_CMD_CMD_LANES_SHIFT 0
+#define SPIDPI_CMD_ADDR_LANES_SHIFT 2
+#define SPIDPI_CMD_DATA_LANES_SHIFT 4
+#define SPIDPI_CMD_LANES_MASK 0x3
+// The payload is read from the device (otherwise it is written)
+#define SPIDPI_CMD_READ 0x40
+// The command is a control command
+#define SPIDPI_CMD_CTRL 0x80
+
+// Set the SCK period to the given number of clock cycles (even, at least 2)
+#define SPIDPI_CTRL_SET_CLK_DIV 0x00
+
+void *spidpi_create(const char *name, int mode, int loglevel, int clk_div,
+                    int listen_port);
+int spidpi_tick(void *ctx_void, const svLogicVecVal *d2p_data);
 void spidpi_close(void *ctx_void);
 
 // monitor
@@ -7,52 +7,105 @@
 // Bits in LOG_LEVEL sets what is output on info socket
 // 0x01 -- monitor packets
 // 0x08 -- bit level
+// With LOG_LEVEL zero, no monitor log file is written at all.
 
 module spidpi
   #(
   parameter string NAME = "spi0",
   parameter int MODE = 0,
-  parameter int LOG_LEVEL = 9
+  parameter int LOG_LEVEL = 9,
+  // The SCK period in clk_i cycles. This must be even and at least 2.
+  parameter int CLK_DIV = 8,
+  // If non-zero, run SPI flash commands from a TCP socket on this port (see spidpi.h) instead
+  // of the single-lane transactions from a pseudo-terminal.
+  parameter int LISTEN_PORT = 0
   )(
-  input  logic clk_i,
-  input  logic rst_ni,
-  output logic spi_device_sck_o,
-  output logic spi_device_csb_o,
-  output logic spi_device_sdi_o,
-  input  logic spi_device_sdo_i,
-  input  logic spi_device_sdo_en_i
-
+  input  logic       clk_i,
+  input  logic       rst_ni,
+  output logic       spi_device_sck_o,
+  output logic       spi_device_csb_o,
+  // SD0 is SDI and SD1 is SDO in single mode
+  output logic [3:0] spi_device_sd_o,
+  output logic [3:0] spi_device_sd_en_o,
+  input  logic [3:0] spi_device_sd_i,
+  input  logic [3:0] spi_device_sd_en_i
 );
   import "DPI-C" function
-    chandle spidpi_create(input string name, input int mode, input int loglevel);
+    chandle spidpi_create(input string name, input int mode, input int loglevel,
+                          input int clk_div, input int listen_port);
 
   import "DPI-C" function
     void spidpi_close(input chandle ctx);
 
   import "DPI-C" function
-    byte spidpi_tick(input chandle ctx_void, input logic [1:0] d2p_data);
+    int spidpi_tick(input chandle ctx_void, input logic [5:0] d2p_data);
 
   chandle ctx;
 
+`ifdef VERILATOR
+  // The ID of the simulator run that created ctx (see sim_ctrl_dpi.h)
+  import "DPI-C" pure function longint simctrl_run_id();
+  longint ctx_run_id;
+`endif
+
+  // The parameters can be overridden with the `SPIDPI_LOG_LEVEL_<name>`, `SPIDPI_CLK_DIV_<name>`
+  // and `SPIDPI_PORT_<name>` plusargs.
+  function automatic void initialize();
+    int log_level, clk_div, port;
+
+    log_level = LOG_LEVEL;
+    void'($value$plusargs({"SPIDPI_LOG_LEVEL_", NAME, "=%d"}, log_level));
+    clk_div = CLK_DIV;
+    void'($value$plusargs({"SPIDPI_CLK_DIV_", NAME, "=%d"}, clk_div));
+    port = LISTEN_PORT;
+    void'($value$plusargs({"SPIDPI_PORT_", NAME, "=%d"}, port));
+
+    ctx = spidpi_create(NAME, MODE, log_level, clk_div, port);
+`ifdef VERILATOR
+    ctx_run_id = simctrl_run_id();
+`endif
+  endfunction
+
+  // Whether ctx was created by another run of the simulator, and so points nowhere
+  function automatic bit ctx_stale();
+`ifdef VERILATOR
+    return ctx != null && ctx_run_id != simctrl_run_id();
+`else
+    return 1'b0;
+`endif
+  endfunction
+
+  // Create the context again if a restored checkpoint made it stale
+  function automatic void renew_ctx();
+    if (ctx_stale()) begin
+      ctx = null;
+      initialize();
+    end
+  endfunction
+
   initial begin
-    ctx = spidpi_create(NAME, MODE, LOG_LEVEL);
+    initialize();
   end
 
   final begin
-    spidpi_close(ctx);
+    if (!ctx_stale()) spidpi_close(ctx);
   end
 
   logic       unused_rst = rst_ni;
-  logic [1:0] d2p;
+  logic [5:0] d2p;
   logic       unused_dummy;
+  logic [2:0] unused_sd_en = {spi_device_sd_en_i[3:2], spi_device_sd_en_i[0]};
 
-  assign d2p = { spi_device_sdo_i, spi_device_sdo_en_i};
+  assign d2p = {spi_device_sd_i, spi_device_sd_i[1], spi_device_sd_en_i[1]};
   always_ff @(posedge clk_i) begin
-    automatic byte p2d = spidpi_tick(ctx, d2p);
-    spi_device_sck_o <= p2d[0];
-    spi_device_csb_o <= p2d[1];
-    spi_device_sdi_o <= p2d[2];
+    automatic int p2d;
+    renew_ctx();
+    p2d = spidpi_tick(ctx, d2p);
+    spi_device_sck_o   <= p2d[0];
+    spi_device_csb_o   <= p2d[1];
+    spi_device_sd_o    <= p2d[5:2];
+    spi_device_sd_en_o <= p2d[9:6];
     // stop verilator warning
-    unused_dummy <= |p2d[7:3];
+    unused_dummy <= |p2d[31:10];
   end
 endmodule
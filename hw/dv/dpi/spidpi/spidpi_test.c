@@ -0,0 +1,261 @@
+// Copyright lowRISC contributors (OpenTitan project).
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+
+// Loopback test for the socket mode of the SPI DPI host. A client thread
+// programs and reads back a small flash over the socket, the way a bootstrap
+// tool would, while the main thread ticks the host against a model of a SPI
+// flash device. Run it with:
+//
+//   bazel test //hw/dv/dpi/spidpi:spidpi_test
+//
+// or run the binary by hand with an optional port number. The program exits
+// with a nonzero status if any check fails.
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "dpi_test.h"
+#include "spidpi.h"
+
+#define FLASH_SIZE 4096
+
+// Opcodes that the flash model understands
+#define OP_PAGE_PROGRAM 0x02
+#define OP_READ 0x03
+#define OP_QUAD_PAGE_PROGRAM 0x32
+#define OP_DUAL_READ 0x3b
+#define OP_QUAD_READ 0x6b
+
+#define ADDR_BYTES 3
+#define READ_DUMMY_CYCLES 8
+
+/**
+ * A SPI flash in mode 0 with 3-byte addresses
+ *
+ * The opcode and address always come on a single lane. Reads and programs
+ * start at the address and run until CSB goes high.
+ */
+struct flash_model {
+  uint8_t mem[FLASH_SIZE];
+  int prev_p2d;
+  // SCK cycles since CSB went low
+  uint32_t cycle;
+  uint8_t opcode;
+  uint32_t addr;
+  // Lanes and dummy cycles for the data phase of the current opcode
+  int lanes;
+  uint32_t dummy;
+  bool is_read;
+  uint8_t in_byte;
+  int in_bits;
+  uint32_t in_pos;
+};
+
+static void flash_start_data(struct flash_model *flash) {
+  flash->lanes = 1;
+  flash->dummy = 0;
+  flash->is_read = true;
+  switch (flash->opcode) {
+    case OP_PAGE_PROGRAM:
+      flash->is_read = false;
+      break;
+    case OP_QUAD_PAGE_PROGRAM:
+      flash->is_read = false;
+      flash->lanes = 4;
+      break;
+    case OP_READ:
+      break;
+    case OP_DUAL_READ:
+      flash->lanes = 2;
+      flash->dummy = READ_DUMMY_CYCLES;
+      break;
+    case OP_QUAD_READ:
+      flash->lanes = 4;
+      flash->dummy = READ_DUMMY_CYCLES;
+      break;
+    default:
+      dpi_test_fail("Flash model: unexpected opcode 0x%02x\n", flash->opcode);
+  }
+}
+
+// Sample the lanes from the host on a rising edge of SCK
+static void flash_sample(struct flash_model *flash, int p2d) {
+  int sd = (p2d >> P2D_SD_SHIFT) & 0xf;
+  uint32_t cycle = flash->cycle++;
+  uint32_t hdr_cycles = 8 * (1 + ADDR_BYTES);
+  if (cycle < 8) {
+    flash->opcode = (flash->opcode << 1) | (sd & 1);
+    if (cycle == 7) {
+      flash_start_data(flash);
+    }
+    return;
+  }
+  if (cycle < hdr_cycles) {
+    flash->addr = (flash->addr << 1) | (sd & 1);
+    return;
+  }
+  if (flash->is_read) {
+    return;
+  }
+  flash->in_byte = (flash->in_byte << flash->lanes) |
+                   (sd & ((1 << flash->lanes) - 1));
+  flash->in_bits += flash->lanes;
+  if (flash->in_bits == 8) {
+    flash->mem[(flash->addr + flash->in_pos++) % FLASH_SIZE] = flash->in_byte;
+    flash->in_bits = 0;
+  }
+}
+
+// The lanes that the flash drives for the next rising edge of SCK
+static int flash_output(const struct flash_model *flash) {
+  uint32_t start = 8 * (1 + ADDR_BYTES) + flash->dummy;
+  if (!flash->is_read || flash->cycle < start) {
+    return 0;
+  }
+  uint32_t bit = (flash->cycle - start) * flash->lanes;
+  uint8_t byte = flash->mem[(flash->addr + bit / 8) % FLASH_SIZE];
+  int val = (byte >> (8 - flash->lanes - bit % 8)) & ((1 << flash->lanes) - 1);
+  if (flash->lanes == 1) {
+    // A single-lane device sends on SDO (SD1).
+    return val ? (D2P_SDO | (2 << D2P_SD_SHIFT)) : 0;
+  }
+  return val << D2P_SD_SHIFT;
+}
+
+// Update the model for the host outputs from the last tick
+static void flash_update(struct flash_model *flash, int p2d) {
+  if (p2d & P2D_CSB) {
+    flash->cycle = 0;
+    flash->is_read = false;
+    flash->in_bits = 0;
+    flash->in_pos = 0;
+  } else if ((p2d & P2D_SCK) && !(flash->prev_p2d & P2D_SCK)) {
+    flash_sample(flash, p2d);
+  }
+  flash->prev_p2d = p2d;
+}
+
+static volatile bool client_done = false;
+static int port;
+
+static void put_u32(uint8_t *buf, uint32_t val) {
+  for (int i = 0; i < 4; ++i) {
+    buf[i] = (val >> (8 * i)) & 0xff;
+  }
+}
+
+/**
+ * Run a command and return the length of its response
+ *
+ * The response data (if any) is stored at resp.
+ */
+static uint32_t run_cmd(int fd, uint8_t flags, uint8_t opcode,
+                        uint8_t addr_bytes, uint8_t dummy, uint32_t addr,
+                        const uint8_t *payload, uint32_t len, uint8_t *resp) {
+  uint8_t hdr[SPIDPI_CMD_HDR_LEN];
+  hdr[0] = flags;
+  hdr[1] = opcode;
+  hdr[2] = addr_bytes;
+  hdr[3] = dummy;
+  put_u32(&hdr[4], addr);
+  put_u32(&hdr[8], len);
+  dpi_test_send_all(fd, hdr, sizeof(hdr));
+  if (payload) {
+    dpi_test_send_all(fd, payload, len);
+  }
+  uint8_t resp_len_buf[4];
+  dpi_test_recv_all(fd, resp_len_buf, sizeof(resp_len_buf));
+  uint32_t resp_len = resp_len_buf[0] | (resp_len_buf[1] << 8) |
+                      (resp_len_buf[2] << 16) |
+                      ((uint32_t)resp_len_buf[3] << 24);
+  if (resp_len) {
+    assert(resp);
+    dpi_test_recv_all(fd, resp, resp_len);
+  }
+  return resp_len;
+}
+
+static uint8_t lanes_flags(int lanes_log2) {
+  return lanes_log2 << SPIDPI_CMD_DATA_LANES_SHIFT;
+}
+
+static void *client(void *arg) {
+  (void)arg;
+  int fd = dpi_test_connect(port);
+
+  // The same image as a bootstrap tool would send: a page programmed on one
+  // lane and a partial page on four.
+  uint8_t page[256], tail[100], resp[356];
+  for (size_t i = 0; i < sizeof(page); ++i) {
+    page[i] = i * 7 + 3;
+  }
+  for (size_t i = 0; i < sizeof(tail); ++i) {
+    tail[i] = 0xff - i * 5;
+  }
+
+  CHECK(run_cmd(fd, SPIDPI_CMD_CTRL, SPIDPI_CTRL_SET_CLK_DIV, 0, 0, 2, NULL,
+                0, NULL) == 0);
+  CHECK(run_cmd(fd, 0, OP_PAGE_PROGRAM, ADDR_BYTES, 0, 0x100, page,
+                sizeof(page), NULL) == 0);
+  CHECK(run_cmd(fd, lanes_flags(2), OP_QUAD_PAGE_PROGRAM, ADDR_BYTES, 0,
+                0x200, tail, sizeof(tail), NULL) == 0);
+
+  // Read it back with each number of lanes.
+  memset(resp, 0, sizeof(resp));
+  CHECK(run_cmd(fd, SPIDPI_CMD_READ, OP_READ, ADDR_BYTES, 0, 0x100, NULL,
+                sizeof(page), resp) == sizeof(page));
+  CHECK(memcmp(resp, page, sizeof(page)) == 0);
+
+  memset(resp, 0, sizeof(resp));
+  CHECK(run_cmd(fd, SPIDPI_CMD_READ | lanes_flags(1), OP_DUAL_READ,
+                ADDR_BYTES, READ_DUMMY_CYCLES, 0x200, NULL, sizeof(tail),
+                resp) == sizeof(tail));
+  CHECK(memcmp(resp, tail, sizeof(tail)) == 0);
+
+  memset(resp, 0, sizeof(resp));
+  CHECK(run_cmd(fd, SPIDPI_CMD_READ | lanes_flags(2), OP_QUAD_READ,
+                ADDR_BYTES, READ_DUMMY_CYCLES, 0x100, NULL, sizeof(resp),
+                resp) == sizeof(resp));
+  CHECK(memcmp(resp, page, sizeof(page)) == 0);
+  CHECK(memcmp(&resp[sizeof(page)], tail, sizeof(tail)) == 0);
+
+  close(fd);
+  client_done = true;
+  return NULL;
+}
+
+int main(int argc, char **argv) {
+  port = argc > 1 ? atoi(argv[1]) : dpi_test_free_port();
+
+  void *ctx = spidpi_create("spidpi_test", 0, 0, 8, port);
+  assert(ctx);
+  struct flash_model flash;
+  memset(&flash, 0, sizeof(flash));
+  flash.prev_p2d = P2D_CSB;
+
+  pthread_t client_thread;
+  int rv = pthread_create(&client_thread, NULL, client, NULL);
+  assert(rv == 0);
+  (void)rv;
+
+  // Give up after far more ticks than the transactions need.
+  for (long tick = 0; !client_done && tick < 100000000; ++tick) {
+    svLogicVecVal d2p = {(uint32_t)flash_output(&flash), 0};
+    flash_update(&flash, spidpi_tick(ctx, &d2p));
+  }
+  CHECK(client_done);
+  if (!client_done) {
+    pthread_cancel(client_thread);
+  }
+  pthread_join(client_thread, NULL);
+  spidpi_close(ctx);
+
+  return dpi_test_finish();
+}
@@ -26,6 +26,9 @@
 
 #define EXIT_STRING_MAX_LENGTH (64)
 
+// Size of the receive and transmit buffers in buffered mode
+#define UARTDPI_BUF_SIZE (4096)
+
 // This keeps the necessary uart state.
 struct uartdpi_ctx {
   char ptyname[64];
@@ -35,6 +38,19 @@ struct uartdpi_ctx {
   int device;
   char tmp_read;
   FILE *log_file;
+
+  // Buffered mode (see uartdpi_set_poll_interval()). This is enabled if
+  // poll_interval is non-zero.
+  int poll_interval;
+  int ticks_to_poll;
+  // Characters read from the pty that haven't been passed to the design yet
+  // are rx_buf[rx_pos] to rx_buf[rx_len - 1].
+  char rx_buf[UARTDPI_BUF_SIZE];
+  size_t rx_pos;
+  size_t rx_len;
+  // Characters written by the design that haven't been flushed yet
+  char tx_buf[UARTDPI_BUF_SIZE];
+  size_t tx_len;
 };
 
 void *uartdpi_create(const char *name, const char *log_file_path,
@@ -114,15 +130,86 @@ void *uartdpi_create(const char *name, const char *log_file_path,
   // Guarantee that at least one character in the exit string is null.
   ctx->exitstring[EXIT_STRING_MAX_LENGTH - 1] = '\0';
 
+  ctx->poll_interval = 0;
+  ctx->ticks_to_poll = 0;
+  ctx->rx_pos = 0;
+  ctx->rx_len = 0;
+  ctx->tx_len = 0;
+
   return (void *)ctx;
 }
 
+void uartdpi_set_poll_interval(void *ctx_void, int interval) {
+  struct uartdpi_ctx *ctx = (struct uartdpi_ctx *)ctx_void;
+  if (ctx == NULL) {
+    return;
+  }
+  ctx->poll_interval = interval > 0 ? interval : 0;
+  ctx->ticks_to_poll = 0;
+}
+
+/**
+ * Write out the characters in tx_buf (in buffered mode)
+ *
+ * The log file gets everything. If the pty can't take all of it (because
+ * nothing is reading from the other end), the rest is dropped rather than
+ * blocking the simulation.
+ */
+static void flush_tx(struct uartdpi_ctx *ctx) {
+  if (!ctx->tx_len) {
+    return;
+  }
+
+  size_t done = 0;
+  while (done < ctx->tx_len) {
+    ssize_t rv = write(ctx->host, ctx->tx_buf + done, ctx->tx_len - done);
+    if (rv > 0) {
+      done += rv;
+    } else if (rv < 0 && errno == EINTR) {
+      continue;
+    } else {
+      assert((rv == 0 || errno == EAGAIN || errno == EWOULDBLOCK) &&
+             "Write to pseudo-terminal failed.");
+      break;
+    }
+  }
+
+  if (ctx->log_file) {
+    size_t rv = fwrite(ctx->tx_buf, sizeof(char), ctx->tx_len, ctx->log_file);
+    assert(rv == ctx->tx_len && "Write to log file failed.");
+  }
+
+  ctx->tx_len = 0;
+}
+
+/**
+ * Poll the pty and flush output if we're at the end of a poll interval (in
+ * buffered mode)
+ */
+static void poll_tick(struct uartdpi_ctx *ctx) {
+  if (ctx->ticks_to_poll > 0) {
+    --ctx->ticks_to_poll;
+    return;
+  }
+  ctx->ticks_to_poll = ctx->poll_interval - 1;
+
+  flush_tx(ctx);
+
+  if (ctx->rx_pos == ctx->rx_len) {
+    ssize_t rv = read(ctx->host, ctx->rx_buf, UARTDPI_BUF_SIZE);
+    ctx->rx_pos = 0;
+    ctx->rx_len = rv > 0 ? rv : 0;
+  }
+}
+
 void uartdpi_close(void *ctx_void) {
   struct uartdpi_ctx *ctx = (struct uartdpi_ctx *)ctx_void;
   if (!ctx) {
     return;
   }
 
+  flush_tx(ctx);
+
   close(ctx->host);
   close(ctx->device);
 
@@ -143,6 +230,16 @@ int uartdpi_can_read(void *ctx_void) {
   if (ctx == NULL) {
     return 0;
   }
+
+  if (ctx->poll_interval) {
+    poll_tick(ctx);
+    if (ctx->rx_pos == ctx->rx_len) {
+      return 0;
+    }
+    ctx->tmp_read = ctx->rx_buf[ctx->rx_pos++];
+    return 1;
+  }
+
   int rv = read(ctx->host, &ctx->tmp_read, 1);
   return (rv == 1);
 }
@@ -153,20 +250,13 @@ char uartdpi_read(void *ctx_void) {
   return ctx->tmp_read;
 }
 
-int uartdpi_write(void *ctx_void, char c) {
+/**
+ * Compare a character written by the design with the exit string
+ *
+ * @return non-zero if c completes the exit string
+ */
+static int match_exit_string(struct uartdpi_ctx *ctx, char c) {
   int rv;
-  struct uartdpi_ctx *ctx = (struct uartdpi_ctx *)ctx_void;
-  if (ctx == NULL) {
-    return 0;
-  }
-
-  rv = write(ctx->host, &c, 1);
-  assert(rv == 1 && "Write to pseudo-terminal failed.");
-
-  if (ctx->log_file) {
-    rv = fwrite(&c, sizeof(char), 1, ctx->log_file);
-    assert(rv == 1 && "Write to log file failed.");
-  }
 
   if (c == '\0') {
     // If a null character is received the tracker is reset.
@@ -200,3 +290,34 @@ int uartdpi_write(void *ctx_void, char c) {
 
   return 0;
 }
+
+int uartdpi_write(void *ctx_void, char c) {
+  int rv;
+  struct uartdpi_ctx *ctx = (struct uartdpi_ctx *)ctx_void;
+  if (ctx == NULL) {
+    return 0;
+  }
+
+  if (ctx->poll_interval) {
+    if (ctx->tx_len == UARTDPI_BUF_SIZE) {
+      flush_tx(ctx);
+    }
+    ctx->tx_buf[ctx->tx_len++] = c;
+    rv = match_exit_string(ctx, c);
+    // Make sure all the output is visible before the simulation exits.
+    if (rv) {
+      flush_tx(ctx);
+    }
+    return rv;
+  }
+
+  rv = write(ctx->host, &c, 1);
+  assert(rv == 1 && "Write to pseudo-terminal failed.");
+
+  if (ctx->log_file) {
+    rv = fwrite(&c, sizeof(char), 1, ctx->log_file);
+    assert(rv == 1 && "Write to log file failed.");
+  }
+
+  return match_exit_string(ctx, c);
+}
@@ -18,6 +18,12 @@ extern "C" {
 //                character.
 void *uartdpi_create(const char *name, const char *log_file_path,
                      const char *exit_string);
+// Switch to buffered mode: rather than making a system call for each
+// character, poll the pseudo-terminal for input and flush output to it and the
+// log file once every interval calls to uartdpi_can_read. Output is also
+// flushed when the buffer fills up, when the exit string is seen and when the
+// UART is closed. An interval of zero switches back to unbuffered mode.
+void uartdpi_set_poll_interval(void *ctx_void, int interval);
 // Close all the handles held by the UART DPI and frees the context.
 void uartdpi_close(void *ctx_void);
 // Does a read and returns whether a valid character was read.
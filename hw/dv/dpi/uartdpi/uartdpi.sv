@@ -6,7 +6,11 @@ module uartdpi #(
   parameter integer BAUD        = 'x,
   parameter integer FREQ        = 'x,
   parameter string  NAME        = "uart0",
-  parameter string  EXIT_STRING = ""
+  parameter string  EXIT_STRING = "",
+  // If non-zero, only poll the pseudo-terminal and flush output once every POLL_INTERVAL clock
+  // cycles while idle (see uartdpi_set_poll_interval). This can be overridden with the
+  // `UARTDPI_POLL_INTERVAL_<name>` plusarg.
+  parameter integer POLL_INTERVAL = 0
 ) (
   input  logic clk_i,
   input  logic rst_ni,
@@ -24,6 +28,9 @@ module uartdpi #(
   import "DPI-C" function
     chandle uartdpi_create(input string name, input string log_file_path, input string exit_string);
 
+  import "DPI-C" function
+    void uartdpi_set_poll_interval(input chandle ctx, input int interval);
+
   import "DPI-C" function
     void uartdpi_close(input chandle ctx);
 
@@ -39,12 +46,45 @@ module uartdpi #(
   chandle ctx;
   string log_file_path = DEFAULT_LOG_FILE;
 
+`ifdef VERILATOR
+  // The ID of the simulator run that created ctx (see sim_ctrl_dpi.h)
+  import "DPI-C" pure function longint simctrl_run_id();
+  longint ctx_run_id;
+`endif
+
   function automatic void initialize();
     string plusarg_name = {"UARTDPI_LOG_", NAME};
+    int poll_interval;
     if (!$value$plusargs({plusarg_name, "=%s"}, log_file_path)) begin
       $display($sformatf("No %s plusarg found.", plusarg_name));
     end
     ctx = uartdpi_create(NAME, log_file_path, EXIT_STRING);
+`ifdef VERILATOR
+    ctx_run_id = simctrl_run_id();
+`endif
+
+    poll_interval = POLL_INTERVAL;
+    void'($value$plusargs({"UARTDPI_POLL_INTERVAL_", NAME, "=%d"}, poll_interval));
+    if (poll_interval > 0) begin
+      uartdpi_set_poll_interval(ctx, poll_interval);
+    end
+  endfunction
+
+  // Whether ctx was created by another run of the simulator, and so points nowhere
+  function automatic bit ctx_stale();
+`ifdef VERILATOR
+    return ctx != null && ctx_run_id != simctrl_run_id();
+`else
+    return 1'b0;
+`endif
+  endfunction
+
+  // Create the context again if a restored checkpoint made it stale
+  function automatic void renew_ctx();
+    if (ctx_stale()) begin
+      ctx = null;
+      initialize();
+    end
   endfunction
 
   initial begin
@@ -56,7 +96,7 @@ module uartdpi #(
   end
 
   final begin
-    uartdpi_close(ctx);
+    if (!ctx_stale()) uartdpi_close(ctx);
     ctx = null;
   end
 
@@ -77,6 +117,7 @@ module uartdpi #(
     end else begin
       if (!txactive) begin
         tx_o <= 1;
+        renew_ctx();
         if (uartdpi_can_read(ctx)) begin
           automatic int c = uartdpi_read(ctx);
           txsymbol <= {1'b1, c[7:0], 1'b0};
@@ -137,6 +178,7 @@ module uartdpi #(
           if (rxcyccount == CYCLES_PER_SYMBOL - 1) begin
             rxactive <= 0;
             if (rx_i) begin
+              renew_ctx();
               // Write a message through the uart (using the uartdpi DPI library). By default, this
               // always returns 0 but it can be configured to return 1 if it sees a particular
               // string (the "EXIT_STRING"). If that happens, stop the simulation.
@@ -53,12 +53,42 @@ module usbdpi #(
 
   chandle ctx;
 
-  initial begin
+`ifdef VERILATOR
+  // The ID of the simulator run that created ctx (see sim_ctrl_dpi.h)
+  import "DPI-C" pure function longint simctrl_run_id();
+  longint ctx_run_id;
+`endif
+
+  function automatic void initialize();
     ctx = usbdpi_create(NAME, LOG_LEVEL);
+`ifdef VERILATOR
+    ctx_run_id = simctrl_run_id();
+`endif
+  endfunction
+
+  // Whether ctx was created by another run of the simulator, and so points nowhere
+  function automatic bit ctx_stale();
+`ifdef VERILATOR
+    return ctx != null && ctx_run_id != simctrl_run_id();
+`else
+    return 1'b0;
+`endif
+  endfunction
+
+  // Create the context again if a restored checkpoint made it stale
+  function automatic void renew_ctx();
+    if (ctx_stale()) begin
+      ctx = null;
+      initialize();
+    end
+  endfunction
+
+  initial begin
+    initialize();
   end
 
   final begin
-    usbdpi_close(ctx);
+    if (!ctx_stale()) usbdpi_close(ctx);
   end
 
   // USB Packet IDentifier values, for waveform viewing
@@ -206,10 +236,12 @@ module usbdpi #(
   bit [10:0] c_frame;
   usbdpi_host_state_t c_hostSt;
   usbdpi_drv_state_t c_state;
-  always @(posedge clk_48MHz_i)
+  always @(posedge clk_48MHz_i) begin
+    renew_ctx();
     usbdpi_diags(ctx, {c_spare1, c_mon_state, c_mon_bits, c_mon_byte, c_mon_pid,
                        c_step, c_bus_state, c_tickbits, c_frame, c_hostSt,
                        c_state});
+  end
 
   logic [10:0] d2p;
   logic [10:0] d2p_r;
@@ -237,7 +269,9 @@ module usbdpi #(
       dn_int <= 0;
     end else if (enable) begin
       if (!sense_p2d || pullup_detect) begin
-        automatic byte p2d = usbdpi_host_to_device(ctx, d2p);
+        automatic byte p2d;
+        renew_ctx();
+        p2d = usbdpi_host_to_device(ctx, d2p);
         d_last <= d_p2d;
         dp_en_p2d <= p2d[4];
         dn_en_p2d <= p2d[4];
@@ -5,6 +5,7 @@
 #include "dpi_memutil.h"
 
 #include <cassert>
+#include <cerrno>
 #include <cstring>
 #include <fcntl.h>
 #include <filesystem>
@@ -12,6 +13,7 @@
 #include <iostream>
 #include <libelf.h>
 #include <sstream>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <unistd.h>
 #include <vector>
@@ -48,7 +50,10 @@ class ElfFile {
       throw ElfError(path, "could not open file.");
     }
 
-    ptr_ = elf_begin(fd_, ELF_C_READ, NULL);
+    // Have libelf map the file rather than read all of it into the heap. The
+    // data we get with elf_rawfile() is then a view of that mapping, so it
+    // costs nothing for the parts of the file that we never look at.
+    ptr_ = elf_begin(fd_, ELF_C_READ_MMAP, NULL);
     if (!ptr_) {
       close(fd_);
       throw ElfError(path, elf_errmsg(-1));
@@ -87,6 +92,49 @@ class ElfFile {
 };
 }  // namespace
 
+// Map the whole of the file at filepath read-only into memory. The returned
+// pointer unmaps the file when the last reference to it is dropped. Returns a
+// null pointer for an empty file, which can't be mapped.
+static std::shared_ptr<const uint8_t> MapFile(const std::string &filepath,
+                                              size_t *length) {
+  assert(length);
+
+  int fd = open(filepath.c_str(), O_RDONLY, 0);
+  if (fd < 0) {
+    std::ostringstream oss;
+    oss << "Cannot read file: `" << filepath << "'.";
+    throw std::runtime_error(oss.str());
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    std::ostringstream oss;
+    oss << "Cannot stat file: `" << filepath << "'.";
+    throw std::runtime_error(oss.str());
+  }
+
+  *length = st.st_size;
+  if (*length == 0) {
+    close(fd);
+    return nullptr;
+  }
+
+  void *addr = mmap(nullptr, *length, PROT_READ, MAP_PRIVATE, fd, 0);
+  // The mapping stays valid after the file descriptor has been closed.
+  close(fd);
+  if (addr == MAP_FAILED) {
+    std::ostringstream oss;
+    oss << "Cannot map file: `" << filepath << "': " << strerror(errno);
+    throw std::runtime_error(oss.str());
+  }
+
+  size_t map_len = *length;
+  return std::shared_ptr<const uint8_t>(
+      static_cast<const uint8_t *>(addr),
+      [map_len](const uint8_t *p) { munmap((void *)p, map_len); });
+}
+
 // Convert a string to a MemImageType, throwing a std::runtime_error
 // if it's not a known name.
 static MemImageType GetMemImageTypeByName(const std::string &name) {
@@ -143,12 +191,31 @@ static std::vector<uint8_t> LoadBinary(const std::string &filepath) {
   return buf;
 }
 
-// Generate a single array of bytes representing the contents of PT_LOAD
-// segments of the ELF file. Like objcopy, this generates a single "giant
-// segment" whose first byte corresponds to the first byte of the lowest
-// addressed segment and whose last byte corresponds to the last byte of the
-// highest address.
-static std::vector<uint8_t> FlattenElfFile(const std::string &filepath) {
+// Stage a binary image as a single segment at offset 0. If mmap_staging is
+// true, the segment is a view of the mapped file rather than a copy.
+static StagedMem StageBinary(const std::string &filepath, bool mmap_staging) {
+  StagedMem ret;
+  if (!mmap_staging) {
+    ret.AddSegment(0, LoadBinary(filepath));
+    return ret;
+  }
+
+  size_t length;
+  std::shared_ptr<const uint8_t> mapping = MapFile(filepath, &length);
+  if (mapping) {
+    ret.AddSegment(0, StagedSeg(std::move(mapping), 0, length));
+  }
+  return ret;
+}
+
+// Stage the contents of PT_LOAD segments of the ELF file. Like objcopy, this
+// describes a single "giant segment" whose first byte corresponds to the first
+// byte of the lowest addressed segment and whose last byte corresponds to the
+// last byte of the highest address. Gaps between segments are left as holes
+// in the returned StagedMem (use StagedMem::WriteFlat to write them out as
+// zeros). If mmap_staging is true, the segments are views of the mapped file.
+static StagedMem FlattenElfFile(const std::string &filepath,
+                                bool mmap_staging) {
   ElfFile elf(filepath);
 
   size_t phnum = elf.GetPhdrNum();
@@ -196,8 +263,9 @@ static std::vector<uint8_t> FlattenElfFile(const std::string &filepath) {
 
   // If any is false, there were no segments that contributed to the
   // file. Return nothing.
+  StagedMem ret;
   if (!any)
-    return std::vector<uint8_t>();
+    return ret;
 
   // Otherwise, we know every valid byte of data has an address in the
   // range [low, high] (inclusive).
@@ -207,7 +275,12 @@ static std::vector<uint8_t> FlattenElfFile(const std::string &filepath) {
   const char *file_data = elf_rawfile(elf.ptr_, &file_size);
   assert(file_data);
 
-  StagedMem ret;
+  std::shared_ptr<const uint8_t> mapping;
+  if (mmap_staging) {
+    size_t map_size;
+    mapping = MapFile(filepath, &map_size);
+    assert(map_size == file_size);
+  }
 
   for (size_t i = 0; i < phnum; i++) {
     const Elf32_Phdr &phdr = phdrs[i];
@@ -229,12 +302,16 @@ static std::vector<uint8_t> FlattenElfFile(const std::string &filepath) {
       continue;
 
     uint32_t off = phdr.p_paddr - low;
-    std::vector<uint8_t> seg(phdr.p_filesz, 0);
-    memcpy(&seg[0], file_data + phdr.p_offset, phdr.p_filesz);
-    ret.AddSegment(off, std::move(seg));
+    if (mapping) {
+      ret.AddSegment(off, StagedSeg(mapping, phdr.p_offset, phdr.p_filesz));
+    } else {
+      std::vector<uint8_t> seg(phdr.p_filesz, 0);
+      memcpy(&seg[0], file_data + phdr.p_offset, phdr.p_filesz);
+      ret.AddSegment(off, std::move(seg));
+    }
   }
 
-  return ret.GetFlat();
+  return ret;
 }
 
 // Merge seg0 and seg1, overwriting any overlapping data in seg0 with
@@ -299,7 +376,32 @@ static std::vector<uint8_t> MergeSegments(const AddrRange<uint32_t> &rng0,
   return ret;
 }
 
-void StagedMem::AddSegment(uint32_t offset, std::vector<uint8_t> &&seg) {
+// Merge two staged segments. This only needs to copy mapped data if the
+// segments actually have to be combined.
+static StagedSeg MergeStagedSegs(const AddrRange<uint32_t> &rng0,
+                                 StagedSeg &&seg0,
+                                 const AddrRange<uint32_t> &rng1,
+                                 StagedSeg &&seg1) {
+  if (rng1.lo <= rng0.lo && rng0.hi <= rng1.hi) {
+    return std::move(seg1);
+  }
+  return StagedSeg(
+      MergeSegments(rng0, seg0.TakeVector(), rng1, seg1.TakeVector()));
+}
+
+std::vector<uint8_t> StagedSeg::TakeVector() {
+  if (!mapping_) {
+    return std::move(owned_);
+  }
+
+  std::vector<uint8_t> ret(view_, view_ + view_size_);
+  mapping_.reset();
+  view_ = nullptr;
+  view_size_ = 0;
+  return ret;
+}
+
+void StagedMem::AddSegment(uint32_t offset, StagedSeg &&seg) {
   if (seg.empty())
     return;
 
@@ -308,7 +410,7 @@ void StagedMem::AddSegment(uint32_t offset, std::vector<uint8_t> &&seg) {
 
   min_addr_ = std::min(min_addr_, offset);
   max_addr_ = std::max(max_addr_, seg_top);
-  segs_.Emplace(offset, seg_top, std::move(seg), MergeSegments);
+  segs_.Emplace(offset, seg_top, std::move(seg), MergeStagedSegs);
 }
 
 std::vector<uint8_t> StagedMem::GetFlat() const {
@@ -320,18 +422,60 @@ std::vector<uint8_t> StagedMem::GetFlat() const {
 
   for (const auto &pr : segs_) {
     const AddrRange<uint32_t> &rng = pr.first;
-    const std::vector<uint8_t> &seg = pr.second;
+    const StagedSeg &seg = pr.second;
     assert(seg.size() == 1 + (rng.hi - rng.lo));
     assert(min_addr_ <= rng.lo);
 
     uint32_t off = rng.lo - min_addr_;
     assert(off + seg.size() <= ret.size());
 
-    memcpy(&ret[off], &seg[0], seg.size());
+    memcpy(&ret[off], seg.data(), seg.size());
   }
   return ret;
 }
 
+void StagedMem::WriteFlat(const MemArea &mem_area) const {
+  if (segs_.size() == 0)
+    return;
+
+  // Assemble the image one chunk at a time. The chunk is a whole number of
+  // memory words, so every word is written exactly once.
+  const size_t chunk_words = 4096;
+  const size_t width = mem_area.GetWidthByte();
+  const size_t chunk_bytes = chunk_words * width;
+  size_t len = (size_t)1 + (max_addr_ - min_addr_);
+
+  std::vector<uint8_t> chunk;
+  auto seg_it = segs_.begin();
+  for (size_t chunk_lo = 0; chunk_lo < len; chunk_lo += chunk_bytes) {
+    size_t chunk_hi = std::min(len, chunk_lo + chunk_bytes);
+    chunk.assign(chunk_hi - chunk_lo, 0);
+
+    // Skip segments that finish before this chunk. Segments are disjoint and
+    // ordered, so we never need to look back at them.
+    while (seg_it != segs_.end() &&
+           (size_t)(seg_it->first.hi - min_addr_) < chunk_lo) {
+      ++seg_it;
+    }
+
+    // Copy in every segment that overlaps the chunk. The last one may also
+    // overlap the next chunk, so don't advance seg_it past it.
+    for (auto it = seg_it; it != segs_.end(); ++it) {
+      size_t seg_lo = it->first.lo - min_addr_;
+      size_t seg_hi = (size_t)1 + (it->first.hi - min_addr_);
+      if (chunk_hi <= seg_lo)
+        break;
+
+      size_t copy_lo = std::max(seg_lo, chunk_lo);
+      size_t copy_hi = std::min(seg_hi, chunk_hi);
+      memcpy(&chunk[copy_lo - chunk_lo], it->second.data() + (copy_lo - seg_lo),
+             copy_hi - copy_lo);
+    }
+
+    mem_area.Write(chunk_lo / width, chunk);
+  }
+}
+
 void DpiMemUtil::RegisterMemoryArea(const std::string &name, uint32_t base,
                                     const MemArea *mem_area) {
   assert(mem_area);
@@ -423,13 +567,14 @@ void DpiMemUtil::LoadFileToNamedMem(bool verbose, const std::string &name,
   try {
     switch (type) {
       case kMemImageElf:
-        m.Write(0, FlattenElfFile(filepath));
+        FlattenElfFile(filepath, mmap_staging_).WriteFlat(m);
+        elf_paths_.push_back(filepath);
         break;
       case kMemImageVmem:
         m.LoadVmem(filepath);
         break;
       case kMemImageBin:
-        m.Write(0, LoadBinary(filepath));
+        StageBinary(filepath, mmap_staging_).WriteFlat(m);
         break;
       default:
         assert(0);
@@ -457,13 +602,13 @@ void DpiMemUtil::LoadElfToMemories(bool verbose, const std::string &filepath) {
 
     for (const auto &seg_pr : staged_mem.GetSegs()) {
       const AddrRange<uint32_t> &seg_rng = seg_pr.first;
-      const std::vector<uint8_t> &seg_data = seg_pr.second;
+      const StagedSeg &seg_data = seg_pr.second;
 
       assert(seg_rng.lo % mem_area.GetWidthByte() == 0);
       uint32_t lo_word = seg_rng.lo / mem_area.GetWidthByte();
 
       try {
-        mem_area.Write(lo_word, seg_data);
+        mem_area.Write(lo_word, seg_data.data(), seg_data.size());
       } catch (const SVScoped::Error &err) {
         std::ostringstream oss;
         oss << "No memory found at `" << err.scope_name_
@@ -484,6 +629,7 @@ void DpiMemUtil::StageElf(bool verbose, const std::string &path) {
 
   // Allow subclasses to get at the loaded ELF data if they need it
   OnElfLoaded(elf.ptr_);
+  elf_paths_.push_back(path);
 
   size_t file_size;
   const char *file_data = elf_rawfile(elf.ptr_, &file_size);
@@ -492,6 +638,15 @@ void DpiMemUtil::StageElf(bool verbose, const std::string &path) {
   size_t phnum = elf.GetPhdrNum();
   const Elf32_Phdr *phdrs = elf.GetPhdrs();
 
+  // In mmap staging mode, segments are views of this mapping (which is shared
+  // between them) rather than copies of the file data read by libelf.
+  std::shared_ptr<const uint8_t> mapping;
+  if (mmap_staging_) {
+    size_t map_size;
+    mapping = MapFile(path, &map_size);
+    assert(map_size == file_size);
+  }
+
   for (size_t i = 0; i < phnum; ++i) {
     const Elf32_Phdr &phdr = phdrs[i];
     if (phdr.p_type != PT_LOAD)
@@ -541,11 +696,16 @@ void DpiMemUtil::StageElf(bool verbose, const std::string &path) {
     // there isn't one, make a new empty one.
     StagedMem &staged_mem = staging_area_[name];
 
-    const char *seg_data = file_data + phdr.p_offset;
-    std::vector<uint8_t> vec(phdr.p_filesz, 0);
-    memcpy(&vec[0], seg_data, phdr.p_filesz);
+    if (mapping) {
+      staged_mem.AddSegment(local_base,
+                            StagedSeg(mapping, phdr.p_offset, phdr.p_filesz));
+    } else {
+      const char *seg_data = file_data + phdr.p_offset;
+      std::vector<uint8_t> vec(phdr.p_filesz, 0);
+      memcpy(&vec[0], seg_data, phdr.p_filesz);
 
-    staged_mem.AddSegment(local_base, std::move(vec));
+      staged_mem.AddSegment(local_base, std::move(vec));
+    }
   }
 }
 
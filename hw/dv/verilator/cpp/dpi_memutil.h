@@ -23,10 +23,45 @@ enum MemImageType {
   kMemImageBin,
 };
 
+// A contiguous run of bytes staged for a memory area.
+//
+// The bytes are either owned by the segment or are a read-only view into a
+// memory-mapped file. In the latter case, the segment holds a reference to the
+// mapping, which stays valid until the last segment that uses it is destroyed.
+class StagedSeg {
+ public:
+  StagedSeg() : view_(nullptr), view_size_(0) {}
+  StagedSeg(std::vector<uint8_t> &&data)
+      : owned_(std::move(data)), view_(nullptr), view_size_(0) {}
+  StagedSeg(std::shared_ptr<const uint8_t> mapping, size_t offset, size_t size)
+      : mapping_(std::move(mapping)),
+        view_(mapping_.get() + offset),
+        view_size_(size) {}
+
+  const uint8_t *data() const { return mapping_ ? view_ : owned_.data(); }
+  size_t size() const { return mapping_ ? view_size_ : owned_.size(); }
+  bool empty() const { return size() == 0; }
+  const uint8_t &operator[](size_t idx) const { return data()[idx]; }
+
+  // True if the data is a view into a memory-mapped file
+  bool IsMapped() const { return bool(mapping_); }
+
+  // Move the data out of this segment as a vector. This avoids a copy if the
+  // data is owned, and leaves the segment empty.
+  std::vector<uint8_t> TakeVector();
+
+ private:
+  std::vector<uint8_t> owned_;
+  std::shared_ptr<const uint8_t> mapping_;
+  const uint8_t *view_;
+  size_t view_size_;
+};
+
 // Staged data for a given memory area.
 //
 // This is represented as an ordered list of disjoint segments (as loaded from
-// an ELF file).
+// an ELF file). Gaps between the segments are holes: they read as zero, but
+// are never materialised.
 //
 // Once it is nonempty, the class maintains the invariant that min_addr_ /
 // max_addr_ is the smallest / largest byte offset with valid data.
@@ -35,13 +70,21 @@ class StagedMem {
   StagedMem() : min_addr_(~(uint32_t)0), max_addr_(0) {}
 
   // Add a segment to the tracked memory
-  void AddSegment(uint32_t offset, std::vector<uint8_t> &&seg);
+  void AddSegment(uint32_t offset, StagedSeg &&seg);
+  void AddSegment(uint32_t offset, std::vector<uint8_t> &&seg) {
+    AddSegment(offset, StagedSeg(std::move(seg)));
+  }
 
   // Glob together the tracked segments, interspersing them with
   // zeros, and return as a single flat array.
   std::vector<uint8_t> GetFlat() const;
 
-  typedef RangedMap<uint32_t, std::vector<uint8_t>> SegMap;
+  // Write the same data as GetFlat() to mem_area, starting at word 0, but
+  // without building a flat copy of the whole image. The data is assembled
+  // into a bounded buffer and holes are written as zeros.
+  void WriteFlat(const MemArea &mem_area) const;
+
+  typedef RangedMap<uint32_t, StagedSeg> SegMap;
 
   std::pair<uint32_t, uint32_t> GetBounds() const {
     return std::make_pair(min_addr_, max_addr_);
@@ -58,13 +101,25 @@ class StagedMem {
  *
  * These utilities require the corresponding DPI functions:
  * simutil_memload()
- * simutil_set_mem()
+ * simutil_set_mem_bulk()
  * to be defined somewhere as SystemVerilog functions.
  */
 class DpiMemUtil {
  public:
+  DpiMemUtil() : mmap_staging_(false) {}
   virtual ~DpiMemUtil() {}
 
+  /**
+   * Select how ELF and binary files are staged.
+   *
+   * By default, segments are copied out of the file into buffers owned by the
+   * staging area. If |mmap_staging| is true, files are memory-mapped instead
+   * and staged segments reference the mapping without copying it. In that
+   * case, the files must not be modified while their data is staged.
+   */
+  void SetMmapStaging(bool mmap_staging) { mmap_staging_ = mmap_staging; }
+  bool GetMmapStaging() const { return mmap_staging_; }
+
   /**
    * Register a memory as instantiated by generic ram
    *
@@ -134,6 +189,13 @@ class DpiMemUtil {
    */
   const StagedMem &GetMemoryData(const std::string &mem_name) const;
 
+  /**
+   * Get the paths of all the ELF files that have been loaded, whether into a
+   * named memory or by LMA. Tools like profilers can use these to find
+   * symbols.
+   */
+  const std::vector<std::string> &GetElfPaths() const { return elf_paths_; }
+
  protected:
   /**
    * A hook for subclasses to do extra computations with loaded ELF data. This
@@ -160,6 +222,10 @@ class DpiMemUtil {
   std::map<std::string, StagedMem> staging_area_;
   const StagedMem empty_;
 
+  std::vector<std::string> elf_paths_;
+
+  bool mmap_staging_;
+
   /**
    * Find the index of a memory area containing the given segment's addresses.
    * Raises a std::exception if none is found.
@@ -0,0 +1,269 @@
+// Copyright lowRISC contributors (OpenTitan project).
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+
+// Unit test for the staging code in DpiMemUtil. This writes small ELF and
+// binary images to temporary files, stages and loads them with and without
+// mmap staging, and checks that both modes give the same bytes. Memory areas
+// record what would be written over DPI, so no simulator is needed.
+
+#include <cstdlib>
+#include <cstring>
+#include <elf.h>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#include "dpi_memutil.h"
+
+// The staging code never reaches the simulator, but MemArea and SVScoped
+// still need something to link against.
+extern "C" {
+svScope svGetScopeFromName(const char *) { abort(); }
+svScope svSetScope(svScope) { abort(); }
+svScope svGetScope() { abort(); }
+const char *svGetNameFromScope(svScope) { abort(); }
+void simutil_memload(const char *) { abort(); }
+int simutil_set_mem_bulk(int, int, const svBitVecVal *) { abort(); }
+int simutil_get_mem_bulk(int, int, svBitVecVal *) { abort(); }
+int simutil_fill_mem(int, int, const svBitVecVal *) { abort(); }
+}
+
+// A memory area that records writes in a byte image instead of sending them
+// over DPI.
+class RecordingMemArea : public MemArea {
+ public:
+  RecordingMemArea(uint32_t size, uint32_t width_byte)
+      : MemArea("unused", size / width_byte, width_byte) {}
+
+  void Write(uint32_t word_offset,
+             const std::vector<uint8_t> &data) const override {
+    Write(word_offset, data.data(), data.size());
+  }
+
+  void Write(uint32_t word_offset, const uint8_t *data,
+             size_t len) const override {
+    size_t lo = (size_t)word_offset * width_byte_;
+    if (image.size() < lo + len) {
+      image.resize(lo + len);
+    }
+    memcpy(&image[lo], data, len);
+  }
+
+  mutable std::vector<uint8_t> image;
+};
+
+enum {
+  kRamBase = 0x1000,
+  kRamSize = 0x1000,
+  kRomBase = 0x2000,
+  kRomSize = 0x100,
+};
+
+struct TestSeg {
+  uint32_t type;
+  uint32_t lma;
+  std::vector<uint8_t> data;
+};
+
+// Two segments in the RAM with a hole between them (the second one with a
+// length that isn't a whole number of words), one in the ROM, and segments
+// that the loader should skip.
+static const std::vector<TestSeg> kSegs = {
+    {PT_LOAD, kRamBase, {1, 2, 3, 4, 5, 6, 7, 8}},
+    {PT_NOTE, kRamBase + 0x100, {0xee, 0xee, 0xee, 0xee}},
+    {PT_LOAD, kRamBase + 0x10, {9, 10, 11, 12, 13, 14}},
+    {PT_LOAD, kRamBase + 0x20, {}},
+    {PT_LOAD, kRomBase + 4, {0xa0, 0xa1, 0xa2, 0xa3}},
+};
+
+static std::string TempPath(const char *suffix) {
+  const char *dir = getenv("TEST_TMPDIR");
+  std::string path = std::string(dir ? dir : "/tmp") + "/dpi_memutil_test_" +
+                     std::to_string(getpid()) + suffix;
+  return path;
+}
+
+static void WriteFile(const std::string &path,
+                      const std::vector<uint8_t> &bytes) {
+  std::ofstream ofs(path, std::ios::binary);
+  ofs.write(reinterpret_cast<const char *>(bytes.data()), bytes.size());
+}
+
+// Build a 32-bit RISC-V ELF executable with a program header for each entry
+// of segs and no section headers.
+static std::vector<uint8_t> MakeElf(const std::vector<TestSeg> &segs) {
+  Elf32_Ehdr ehdr = {};
+  memcpy(ehdr.e_ident, ELFMAG, SELFMAG);
+  ehdr.e_ident[EI_CLASS] = ELFCLASS32;
+  ehdr.e_ident[EI_DATA] = ELFDATA2LSB;
+  ehdr.e_ident[EI_VERSION] = EV_CURRENT;
+  ehdr.e_type = ET_EXEC;
+  ehdr.e_machine = EM_RISCV;
+  ehdr.e_version = EV_CURRENT;
+  ehdr.e_phoff = sizeof(Elf32_Ehdr);
+  ehdr.e_ehsize = sizeof(Elf32_Ehdr);
+  ehdr.e_phentsize = sizeof(Elf32_Phdr);
+  ehdr.e_phnum = segs.size();
+
+  std::vector<Elf32_Phdr> phdrs;
+  uint32_t offset = sizeof(Elf32_Ehdr) + segs.size() * sizeof(Elf32_Phdr);
+  for (const TestSeg &seg : segs) {
+    Elf32_Phdr phdr = {};
+    phdr.p_type = seg.type;
+    phdr.p_offset = offset;
+    phdr.p_vaddr = phdr.p_paddr = seg.lma;
+    phdr.p_filesz = phdr.p_memsz = seg.data.size();
+    phdrs.push_back(phdr);
+    offset += seg.data.size();
+  }
+
+  std::vector<uint8_t> ret(reinterpret_cast<const uint8_t *>(&ehdr),
+                           reinterpret_cast<const uint8_t *>(&ehdr + 1));
+  ret.insert(ret.end(), reinterpret_cast<const uint8_t *>(phdrs.data()),
+             reinterpret_cast<const uint8_t *>(phdrs.data() + phdrs.size()));
+  for (const TestSeg &seg : segs) {
+    ret.insert(ret.end(), seg.data.begin(), seg.data.end());
+  }
+  return ret;
+}
+
+// Return the contents of the given memory implied by kSegs, with holes as
+// zeros. If lo is nonzero, start at that address rather than at the first
+// segment in the memory.
+static std::vector<uint8_t> ExpectedFlat(uint32_t base, uint32_t size,
+                                         uint32_t lo = 0) {
+  std::vector<uint8_t> ret;
+  for (const TestSeg &seg : kSegs) {
+    if (seg.type != PT_LOAD || seg.data.empty() || seg.lma < base ||
+        seg.lma >= base + size) {
+      continue;
+    }
+    if (!lo) {
+      lo = seg.lma;
+    }
+    size_t hi = seg.lma - lo + seg.data.size();
+    if (ret.size() < hi) {
+      ret.resize(hi);
+    }
+    std::copy(seg.data.begin(), seg.data.end(), &ret[seg.lma - lo]);
+  }
+  return ret;
+}
+
+namespace {
+
+class DpiMemUtilTest : public testing::TestWithParam<bool> {
+ protected:
+  static void SetUpTestSuite() {
+    elf_path_ = TempPath(".elf");
+    bin_path_ = TempPath(".bin");
+    WriteFile(elf_path_, MakeElf(kSegs));
+
+    // Long enough to span more than one WriteFlat chunk, and not a whole
+    // number of words.
+    bin_data_.resize(4 * 4096 + 7);
+    for (size_t i = 0; i < bin_data_.size(); ++i) {
+      bin_data_[i] = i * 13 + 5;
+    }
+    WriteFile(bin_path_, bin_data_);
+  }
+
+  static void TearDownTestSuite() {
+    unlink(elf_path_.c_str());
+    unlink(bin_path_.c_str());
+  }
+
+  // Make a DpiMemUtil that stages in the mode under test, with ram and rom
+  // registered at their base addresses.
+  void Register(DpiMemUtil &util) {
+    util.SetMmapStaging(GetParam());
+    util.RegisterMemoryArea("ram", kRamBase, &ram_);
+    util.RegisterMemoryArea("rom", kRomBase, &rom_);
+  }
+
+  static std::string elf_path_, bin_path_;
+  static std::vector<uint8_t> bin_data_;
+
+  RecordingMemArea ram_{kRamSize, 4}, rom_{kRomSize, 4};
+};
+
+std::string DpiMemUtilTest::elf_path_, DpiMemUtilTest::bin_path_;
+std::vector<uint8_t> DpiMemUtilTest::bin_data_;
+
+TEST_P(DpiMemUtilTest, StageElf) {
+  StagedMem ram_staged;
+  {
+    DpiMemUtil util;
+    Register(util);
+    util.StageElf(false, elf_path_);
+
+    const StagedMem &ram_data = util.GetMemoryData("ram");
+    EXPECT_EQ(ram_data.GetSegs().size(), 2);
+    for (const auto &seg_pr : ram_data.GetSegs()) {
+      EXPECT_EQ(seg_pr.second.IsMapped(), GetParam());
+    }
+    EXPECT_EQ(ram_data.GetBounds(), std::make_pair(0x0u, 0x15u));
+    EXPECT_EQ(ram_data.GetFlat(), ExpectedFlat(kRamBase, kRamSize, kRamBase));
+
+    const StagedMem &rom_data = util.GetMemoryData("rom");
+    EXPECT_EQ(rom_data.GetBounds(), std::make_pair(0x4u, 0x7u));
+    EXPECT_EQ(rom_data.GetSegs().size(), 1);
+
+    // WriteFlat writes the same image as GetFlat, starting at word 0.
+    rom_data.WriteFlat(rom_);
+    EXPECT_EQ(rom_.image, ExpectedFlat(kRomBase, kRomSize));
+
+    // Keep a copy of the staged RAM data after the DpiMemUtil has gone.
+    ram_staged = ram_data;
+  }
+  EXPECT_EQ(ram_staged.GetFlat(), ExpectedFlat(kRamBase, kRamSize, kRamBase));
+}
+
+TEST_P(DpiMemUtilTest, StagedDataOutlivesFile) {
+  // Mapped segments keep the mapping alive, even once the file has been
+  // unlinked.
+  std::string copy_path = elf_path_ + ".copy";
+  {
+    std::ifstream ifs(elf_path_, std::ios::binary);
+    std::ofstream ofs(copy_path, std::ios::binary);
+    ofs << ifs.rdbuf();
+  }
+  StagedMem ram_staged;
+  {
+    DpiMemUtil util;
+    Register(util);
+    util.StageElf(false, copy_path);
+    unlink(copy_path.c_str());
+    ram_staged = util.GetMemoryData("ram");
+  }
+  EXPECT_EQ(ram_staged.GetFlat(), ExpectedFlat(kRamBase, kRamSize, kRamBase));
+}
+
+TEST_P(DpiMemUtilTest, Load) {
+  DpiMemUtil util;
+  Register(util);
+
+  // A flattened ELF starts at its lowest segment and spans all of them.
+  util.LoadFileToNamedMem(false, "rom", elf_path_, kMemImageElf);
+  EXPECT_EQ(rom_.image, ExpectedFlat(0, 0xffffffff));
+
+  util.LoadFileToNamedMem(false, "ram", bin_path_, kMemImageBin);
+  EXPECT_EQ(ram_.image, bin_data_);
+
+  // Loading by LMA writes each segment at its offset in its memory.
+  ram_.image.clear();
+  rom_.image.clear();
+  util.LoadElfToMemories(false, elf_path_);
+  EXPECT_EQ(ram_.image, ExpectedFlat(kRamBase, kRamSize, kRamBase));
+  EXPECT_EQ(rom_.image, ExpectedFlat(kRomBase, kRomSize, kRomBase));
+}
+
+INSTANTIATE_TEST_SUITE_P(MmapStaging, DpiMemUtilTest, testing::Bool(),
+                         [](const testing::TestParamInfo<bool> &info) {
+                           return info.param ? "Mapped" : "Copied";
+                         });
+
+}  // namespace
@@ -34,20 +34,23 @@ Ecc32MemArea::EccWords Ecc32MemArea::ReadWithIntegrity(
     uint32_t word_offset, uint32_t num_words) const {
   assert(word_offset + num_words <= num_words_);
 
+  PrepareTransfer();
+
+  std::vector<uint32_t> phys_addrs(num_words);
+  for (uint32_t i = 0; i < num_words; ++i) {
+    phys_addrs[i] = ToPhysAddr(word_offset + i);
+  }
+
   // See MemArea::Write for an explanation for this buffer.
-  uint8_t minibuf[SV_MEM_WIDTH_BYTES];
-  memset(minibuf, 0, sizeof minibuf);
-  assert(width_byte_ <= sizeof minibuf);
+  std::vector<uint8_t> staged(num_words * SV_MEM_WIDTH_BYTES);
+  ReadPhysWords(phys_addrs, staged);
 
   EccWords ret;
-  ret.reserve(num_words);
+  ret.reserve(num_words * (width_byte_ / 4));
 
   for (uint32_t i = 0; i < num_words; ++i) {
-    uint32_t src_word = word_offset + i;
-    uint32_t phys_addr = ToPhysAddr(src_word);
-
-    ReadToMinibuf(minibuf, phys_addr);
-    ReadBufferWithIntegrity(ret, minibuf, src_word);
+    ReadBufferWithIntegrity(ret, &staged[i * SV_MEM_WIDTH_BYTES],
+                            word_offset + i);
   }
 
   return ret;
@@ -55,24 +58,26 @@ Ecc32MemArea::EccWords Ecc32MemArea::ReadWithIntegrity(
 
 void Ecc32MemArea::WriteWithIntegrity(uint32_t word_offset,
                                       const EccWords &data) const {
-  // See MemArea::Write for an explanation for this buffer.
-  uint8_t minibuf[SV_MEM_WIDTH_BYTES];
-  memset(minibuf, 0, sizeof minibuf);
-  assert(width_byte_ <= sizeof minibuf);
-
   uint32_t width_32 = width_byte_ / 4;
   uint32_t to_write = data.size() / width_32;
 
   assert((data.size() % width_32) == 0);
   assert(word_offset + to_write <= num_words_);
 
+  PrepareTransfer();
+
+  // See MemArea::Write for an explanation for this buffer.
+  std::vector<uint8_t> staged(to_write * SV_MEM_WIDTH_BYTES, 0);
+  std::vector<uint32_t> phys_addrs(to_write);
+
   for (uint32_t i = 0; i < to_write; ++i) {
     uint32_t dst_word = word_offset + i;
-    uint32_t phys_addr = ToPhysAddr(dst_word);
-
-    WriteBufferWithIntegrity(minibuf, data, i * width_32, dst_word);
-    WriteFromMinibuf(phys_addr, minibuf, dst_word);
+    phys_addrs[i] = ToPhysAddr(dst_word);
+    WriteBufferWithIntegrity(&staged[i * SV_MEM_WIDTH_BYTES], data,
+                             i * width_32, dst_word);
   }
+
+  WritePhysWords(phys_addrs, staged);
 }
 
 // Zero enough of the buffer to fill it with a word using insert_bits
@@ -155,11 +160,16 @@ static uint8_t extract_bits(const uint8_t *buf, unsigned bit_idx,
 }
 
 void Ecc32MemArea::WriteBuffer(uint8_t buf[SV_MEM_WIDTH_BYTES],
-                               const std::vector<uint8_t> &data,
+                               const uint8_t *data, size_t data_len,
                                size_t start_idx, uint32_t dst_word) const {
   zero_buffer(buf, width_byte_);
   for (uint32_t i = 0; i < width_byte_ / 4; ++i) {
-    const uint8_t *src_data = &data[start_idx + 4 * i];
+    // Zero-extend a ragged last word
+    uint8_t src_data[4] = {0, 0, 0, 0};
+    size_t word_idx = start_idx + 4 * i;
+    if (word_idx < data_len) {
+      memcpy(src_data, &data[word_idx], std::min(data_len - word_idx, (size_t)4));
+    }
     insert_word(buf, 39 * i, src_data, enc_secded_inv_39_32(src_data));
   }
 }
@@ -0,0 +1,345 @@
+// Copyright lowRISC contributors (OpenTitan project).
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+
+#include "ibex_profiler.h"
+
+#include <algorithm>
+#include <cassert>
+#include <fcntl.h>
+#include <fstream>
+#include <gelf.h>
+#include <getopt.h>
+#include <iomanip>
+#include <iostream>
+#include <libelf.h>
+#include <sstream>
+#include <unistd.h>
+
+#include "sv_scoped.h"
+
+// DPI exports, defined in ibex_profiler_sampler.sv
+extern "C" {
+int ibex_profiler_get_pc();
+void ibex_profiler_set_enabled(svBit enabled);
+}
+
+IbexProfiler *IbexProfiler::active_ = nullptr;
+
+IbexProfiler::IbexProfiler(const DpiMemUtil *mem_util,
+                           const std::string &sampler_scope)
+    : mem_util_(mem_util),
+      sampler_scope_(sampler_scope),
+      period_(1000),
+      cycles_to_sample_(0),
+      overflow_(0),
+      num_samples_(0) {
+  assert(mem_util);
+}
+
+IbexProfiler::~IbexProfiler() {
+  if (active_ == this) {
+    active_ = nullptr;
+  }
+}
+
+static void PrintHelp() {
+  std::cout << "Ibex profiler arguments:\n"
+               "  --profile=FILE\n"
+               "    Sample the Ibex PC and call stack and write a profile in\n"
+               "    folded stacks format to FILE.\n\n"
+               "  --profile-period=N\n"
+               "    Take a sample every N cycles (default: 1000).\n\n";
+}
+
+bool IbexProfiler::ParseCLIArguments(int argc, char **argv, bool &exit_app) {
+  const struct option long_options[] = {
+      {"profile", required_argument, nullptr, 'p'},
+      {"profile-period", required_argument, nullptr, 'P'},
+      {"help", no_argument, nullptr, 'h'},
+      {nullptr, no_argument, nullptr, 0}};
+
+  // Reset the command parsing index in-case other utils have already parsed
+  // some arguments
+  optind = 1;
+  while (1) {
+    int c = getopt_long(argc, argv, "-:h", long_options, nullptr);
+    if (c == -1) {
+      break;
+    }
+
+    // Disable error reporting by getopt
+    opterr = 0;
+
+    switch (c) {
+      case 0:
+      case 1:
+        break;
+      case 'p':
+        out_path_ = optarg;
+        break;
+      case 'P': {
+        char *txt_end;
+        period_ = strtoul(optarg, &txt_end, 0);
+        if (*txt_end || period_ == 0) {
+          std::cerr << "ERROR: Bad profile period: `" << optarg << "'."
+                    << std::endl;
+          return false;
+        }
+        break;
+      }
+      case 'h':
+        PrintHelp();
+        return true;
+      case ':':  // missing argument
+        std::cerr << "ERROR: Missing argument." << std::endl << std::endl;
+        return false;
+      case '?':
+      default:;
+        // Ignore unrecognized options since they might be consumed by
+        // other utils
+    }
+  }
+  return true;
+}
+
+void IbexProfiler::PreExec() {
+  if (out_path_.empty()) {
+    return;
+  }
+
+  for (const std::string &path : mem_util_->GetElfPaths()) {
+    ReadSymbols(path);
+  }
+  std::sort(syms_.begin(), syms_.end(),
+            [](const FuncSym &a, const FuncSym &b) { return a.addr < b.addr; });
+  if (syms_.empty()) {
+    std::cerr << "WARNING: No function symbols found for the profiler. Load "
+                 "an ELF file to get function names."
+              << std::endl;
+  }
+
+  try {
+    SVScoped scoped(sampler_scope_);
+    ibex_profiler_set_enabled(1);
+  } catch (const SVScoped::Error &err) {
+    std::cerr << "ERROR: No profiler sampler found at `" << err.scope_name_
+              << "'. Was the design built with RVFI enabled?" << std::endl;
+    out_path_.clear();
+    return;
+  }
+
+  active_ = this;
+  cycles_to_sample_ = period_;
+}
+
+void IbexProfiler::OnClock(unsigned long sim_time) {
+  if (active_ != this || --cycles_to_sample_) {
+    return;
+  }
+  cycles_to_sample_ = period_;
+
+  uint32_t pc;
+  {
+    SVScoped scoped(sampler_scope_);
+    pc = ibex_profiler_get_pc();
+  }
+
+  std::vector<uint32_t> key(stack_);
+  key.push_back(pc);
+  ++samples_[key];
+  ++num_samples_;
+}
+
+void IbexProfiler::PostExec() {
+  if (active_ != this) {
+    return;
+  }
+  active_ = nullptr;
+
+  PrintFlatProfile();
+  WriteFoldedStacks();
+}
+
+void IbexProfiler::OnCall(uint32_t call_pc) {
+  if (stack_.size() < kMaxDepth) {
+    stack_.push_back(call_pc);
+  } else {
+    ++overflow_;
+  }
+}
+
+void IbexProfiler::OnReturn() {
+  if (overflow_) {
+    --overflow_;
+  } else if (!stack_.empty()) {
+    stack_.pop_back();
+  }
+}
+
+void IbexProfiler::OnReset() {
+  stack_.clear();
+  overflow_ = 0;
+}
+
+void IbexProfiler::ReadSymbols(const std::string &path) {
+  (void)elf_errno();
+  if (elf_version(EV_CURRENT) == EV_NONE) {
+    return;
+  }
+
+  int fd = open(path.c_str(), O_RDONLY, 0);
+  if (fd < 0) {
+    std::cerr << "WARNING: Cannot open `" << path << "' to read symbols."
+              << std::endl;
+    return;
+  }
+
+  Elf *elf_file = elf_begin(fd, ELF_C_READ, nullptr);
+  if (!elf_file || elf_kind(elf_file) != ELF_K_ELF) {
+    std::cerr << "WARNING: Cannot read symbols from `" << path << "'."
+              << std::endl;
+    if (elf_file) {
+      elf_end(elf_file);
+    }
+    close(fd);
+    return;
+  }
+
+  Elf_Scn *scn = nullptr;
+  while ((scn = elf_nextscn(elf_file, scn))) {
+    Elf32_Shdr *shdr = elf32_getshdr(scn);
+    if (!shdr || shdr->sh_type != SHT_SYMTAB)
+      continue;
+
+    Elf_Data *sec_data = elf_getdata(scn, nullptr);
+    if (!sec_data)
+      continue;
+
+    int num_syms = shdr->sh_size / shdr->sh_entsize;
+    for (int i = 0; i < num_syms; ++i) {
+      GElf_Sym sym;
+      if (!gelf_getsym(sec_data, i, &sym) ||
+          ELF32_ST_TYPE(sym.st_info) != STT_FUNC)
+        continue;
+
+      const char *sym_name = elf_strptr(elf_file, shdr->sh_link, sym.st_name);
+      if (!sym_name)
+        continue;
+
+      syms_.push_back({static_cast<uint32_t>(sym.st_value),
+                       static_cast<uint32_t>(sym.st_size), sym_name});
+    }
+  }
+
+  elf_end(elf_file);
+  close(fd);
+}
+
+std::string IbexProfiler::Symbolise(uint32_t addr) const {
+  // Find the last symbol that starts at or below addr
+  auto it = std::upper_bound(
+      syms_.begin(), syms_.end(), addr,
+      [](uint32_t a, const FuncSym &sym) { return a < sym.addr; });
+  if (it != syms_.begin()) {
+    --it;
+    // Symbols with no size (like some assembly functions) extend to the next
+    // symbol.
+    if (it->size == 0 || addr < it->addr + it->size) {
+      return it->name;
+    }
+  }
+
+  std::ostringstream oss;
+  oss << "0x" << std::hex << std::setw(8) << std::setfill('0') << addr;
+  return oss.str();
+}
+
+void IbexProfiler::WriteFoldedStacks() const {
+  // Several stacks may give the same list of names (from different call sites
+  // in a function), so merge them.
+  std::map<std::string, unsigned long> folded;
+  for (const auto &pr : samples_) {
+    std::string line;
+    for (uint32_t addr : pr.first) {
+      if (!line.empty()) {
+        line += ';';
+      }
+      line += Symbolise(addr);
+    }
+    folded[line] += pr.second;
+  }
+
+  std::ofstream out(out_path_);
+  if (!out) {
+    std::cerr << "ERROR: Cannot open `" << out_path_
+              << "' to write the profile." << std::endl;
+    return;
+  }
+  for (const auto &pr : folded) {
+    out << pr.first << ' ' << pr.second << '\n';
+  }
+
+  std::cout << "Wrote call-graph profile to " << out_path_
+            << " (folded stacks format)." << std::endl;
+}
+
+void IbexProfiler::PrintFlatProfile() const {
+  // Self samples count where the PC was; total samples count every function
+  // on the stack (once, even if it appears recursively).
+  std::map<std::string, std::pair<unsigned long, unsigned long>> counts;
+  for (const auto &pr : samples_) {
+    std::vector<std::string> names;
+    for (uint32_t addr : pr.first) {
+      names.push_back(Symbolise(addr));
+    }
+    counts[names.back()].first += pr.second;
+    std::sort(names.begin(), names.end());
+    names.erase(std::unique(names.begin(), names.end()), names.end());
+    for (const std::string &name : names) {
+      counts[name].second += pr.second;
+    }
+  }
+
+  std::vector<std::pair<std::string, std::pair<unsigned long, unsigned long>>>
+      rows(counts.begin(), counts.end());
+  std::sort(rows.begin(), rows.end(), [](const auto &a, const auto &b) {
+    return a.second.first > b.second.first;
+  });
+
+  std::cout << std::endl
+            << "Ibex profile (" << num_samples_ << " samples, one every "
+            << period_ << " cycles)" << std::endl
+            << "=============" << std::endl
+            << "  self%  total%  function" << std::endl;
+  const size_t max_rows = 30;
+  for (size_t i = 0; i < rows.size() && i < max_rows; ++i) {
+    double self_pct = 100.0 * rows[i].second.first / num_samples_;
+    double total_pct = 100.0 * rows[i].second.second / num_samples_;
+    std::cout << std::fixed << std::setprecision(1) << std::setw(7) << self_pct
+              << std::setw(8) << total_pct << "  " << rows[i].first
+              << std::endl;
+  }
+}
+
+// DPI imports, called by ibex_profiler_sampler.sv
+extern "C" void ibex_profiler_call(unsigned int call_pc) {
+  IbexProfiler *profiler = IbexProfiler::GetActive();
+  if (profiler) {
+    profiler->OnCall(call_pc);
+  }
+}
+
+extern "C" void ibex_profiler_return() {
+  IbexProfiler *profiler = IbexProfiler::GetActive();
+  if (profiler) {
+    profiler->OnReturn();
+  }
+}
+
+extern "C" void ibex_profiler_reset() {
+  IbexProfiler *profiler = IbexProfiler::GetActive();
+  if (profiler) {
+    profiler->OnReset();
+  }
+}
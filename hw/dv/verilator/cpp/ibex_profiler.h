@@ -0,0 +1,102 @@
+// Copyright lowRISC contributors (OpenTitan project).
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+#ifndef OPENTITAN_HW_DV_VERILATOR_CPP_IBEX_PROFILER_H_
+#define OPENTITAN_HW_DV_VERILATOR_CPP_IBEX_PROFILER_H_
+
+//
+// A sampling profiler for software running on Ibex in a Verilator simulation
+//
+// The profiler talks to an ibex_profiler_sampler module in the design (see
+// hw/dv/verilator/sv/ibex_profiler_sampler.sv), which tracks the PC of the
+// last retired instruction and tells us about calls and returns. Every N
+// cycles, we take a sample of the PC and the current call stack.
+//
+// At the end of the simulation, the samples are symbolised with the function
+// symbols from the ELF files that were loaded by DpiMemUtil. A flat profile is
+// printed to stdout and a call-graph profile is written in the "folded stacks"
+// format used by flamegraph.pl and speedscope (one line per distinct stack:
+// semicolon-separated function names from the outermost frame, a space and
+// then a sample count).
+//
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "dpi_memutil.h"
+#include "sim_ctrl_extension.h"
+
+class IbexProfiler : public SimCtrlExtension {
+ public:
+  // Create a profiler that talks to the ibex_profiler_sampler instance at
+  // sampler_scope and gets its ELF files from mem_util (which it does not
+  // own).
+  IbexProfiler(const DpiMemUtil *mem_util, const std::string &sampler_scope);
+  ~IbexProfiler();
+
+  // Declared in SimCtrlExtension
+  bool ParseCLIArguments(int argc, char **argv, bool &exit_app) override;
+  void PreExec() override;
+  void OnClock(unsigned long sim_time) override;
+  void PostExec() override;
+
+  // Called through DPI by the sampler: a call or trap from call_pc, a return
+  // and a reset of the core, respectively.
+  void OnCall(uint32_t call_pc);
+  void OnReturn();
+  void OnReset();
+
+  // Get the profiler that the sampler should talk to (or null if profiling is
+  // disabled)
+  static IbexProfiler *GetActive() { return active_; }
+
+ private:
+  // A function symbol from an ELF file
+  struct FuncSym {
+    uint32_t addr;
+    uint32_t size;
+    std::string name;
+  };
+
+  // Read the function symbols from the ELF file at path into syms_
+  void ReadSymbols(const std::string &path);
+
+  // Return the name of the function containing addr, or a hex address if
+  // there isn't one.
+  std::string Symbolise(uint32_t addr) const;
+
+  // Write the call-graph profile to out_path_ and print a flat profile
+  void WriteFoldedStacks() const;
+  void PrintFlatProfile() const;
+
+  const DpiMemUtil *mem_util_;
+  std::string sampler_scope_;
+
+  // Set by command-line arguments. Profiling is disabled if out_path_ is
+  // empty.
+  std::string out_path_;
+  unsigned long period_;
+
+  unsigned long cycles_to_sample_;
+
+  // The call sites of the frames on the shadow call stack, outermost first.
+  // The stack stops growing at kMaxDepth frames and further calls are
+  // counted in overflow_ so that the returns still match up.
+  static const size_t kMaxDepth = 256;
+  std::vector<uint32_t> stack_;
+  size_t overflow_;
+
+  // The number of samples for each stack, where a stack is the call sites
+  // followed by the sampled PC.
+  std::map<std::vector<uint32_t>, unsigned long> samples_;
+  unsigned long num_samples_;
+
+  // Function symbols, sorted by address
+  std::vector<FuncSym> syms_;
+
+  static IbexProfiler *active_;
+};
+
+#endif  // OPENTITAN_HW_DV_VERILATOR_CPP_IBEX_PROFILER_H_
@@ -7,6 +7,7 @@
 #include <algorithm>
 #include <cassert>
 #include <cstring>
+#include <numeric>
 #include <sstream>
 
 #include "sv_scoped.h"
@@ -14,8 +15,36 @@
 // DPI exports, defined in prim_util_memload.svh
 extern "C" {
 void simutil_memload(const char *file);
-int simutil_set_mem(int index, const svBitVecVal *val);
-int simutil_get_mem(int index, svBitVecVal *val);
+int simutil_set_mem_bulk(int index, int count, const svBitVecVal *val);
+int simutil_get_mem_bulk(int index, int count, svBitVecVal *val);
+int simutil_fill_mem(int index, int count, const svBitVecVal *val);
+}
+
+// Return the indices of phys_addrs, ordered by increasing physical address.
+// For memories without address scrambling, this is the identity permutation.
+static std::vector<uint32_t> SortedIndices(
+    const std::vector<uint32_t> &phys_addrs) {
+  std::vector<uint32_t> order(phys_addrs.size());
+  std::iota(order.begin(), order.end(), 0);
+  if (!std::is_sorted(phys_addrs.begin(), phys_addrs.end())) {
+    std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+      return phys_addrs[a] < phys_addrs[b];
+    });
+  }
+  return order;
+}
+
+// Find the length of the run of consecutive physical addresses that starts at
+// position pos of order. This is at most SV_MEM_BULK_WORDS long.
+static uint32_t RunLength(const std::vector<uint32_t> &phys_addrs,
+                          const std::vector<uint32_t> &order, size_t pos) {
+  uint32_t run_start = phys_addrs[order[pos]];
+  uint32_t len = 1;
+  while (len < SV_MEM_BULK_WORDS && pos + len < order.size() &&
+         phys_addrs[order[pos + len]] == run_start + len) {
+    ++len;
+  }
+  return len;
 }
 
 MemArea::MemArea(const std::string &scope, uint32_t num_words,
@@ -27,26 +56,80 @@ MemArea::MemArea(const std::string &scope, uint32_t num_words,
 
 void MemArea::Write(uint32_t word_offset,
                     const std::vector<uint8_t> &data) const {
-  // This "mini buffer" is used to transfer each write to SystemVerilog.
-  // `simutil_set_mem` takes a fixed SV_MEM_WIDTH_BITS-bit vector but it will
-  // only use the bits required for the RAM width. As an example, for a 32-bit
-  // wide RAM only elements 3:0 of `minibuf` will be written to memory. Since
-  // the simulator may still read bits from minibuf it does not use, we must
-  // use a fixed allocation of the full bit vector size to avoid an out of
-  // bounds access.
-  uint8_t minibuf[SV_MEM_WIDTH_BYTES];
-  memset(minibuf, 0, sizeof minibuf);
-  assert(width_byte_ <= sizeof minibuf);
-
-  uint32_t data_words = (data.size() + width_byte_ - 1) / width_byte_;
+  Write(word_offset, data.data(), data.size());
+}
+
+void MemArea::Write(uint32_t word_offset, const uint8_t *data,
+                    size_t len) const {
+  uint32_t data_words = (len + width_byte_ - 1) / width_byte_;
   assert(word_offset + data_words <= num_words_);
 
+  PrepareTransfer();
+
+  // Each memory word gets a full SV_MEM_WIDTH_BYTES slot in the staging
+  // buffer. `simutil_set_mem_bulk` only uses the bits required for the RAM
+  // width, but the slots must be zero-initialised because WriteBuffer needn't
+  // clear the bits above the physical width.
+  std::vector<uint8_t> staged(data_words * SV_MEM_WIDTH_BYTES, 0);
+  std::vector<uint32_t> phys_addrs(data_words);
+
   for (uint32_t i = 0; i < data_words; ++i) {
     uint32_t dst_word = word_offset + i;
-    uint32_t phys_addr = ToPhysAddr(dst_word);
+    phys_addrs[i] = ToPhysAddr(dst_word);
+    WriteBuffer(&staged[i * SV_MEM_WIDTH_BYTES], data, len, i * width_byte_,
+                dst_word);
+  }
+
+  WritePhysWords(phys_addrs, staged);
+}
+
+void MemArea::Fill(const std::vector<uint8_t> &pattern, uint32_t word_offset,
+                   uint32_t num_words) const {
+  assert(!pattern.empty() && width_byte_ % pattern.size() == 0);
+  assert(word_offset + num_words <= num_words_);
+
+  if (num_words == 0) {
+    return;
+  }
+
+  std::vector<uint8_t> word(width_byte_);
+  for (uint32_t i = 0; i < width_byte_; ++i) {
+    word[i] = pattern[i % pattern.size()];
+  }
+
+  if (PhysWordDependsOnAddr()) {
+    // Every physical word is different, so go through Write. Do it in chunks
+    // to avoid building a logical image of the whole range.
+    const uint32_t chunk_words = 1024;
+    std::vector<uint8_t> chunk;
+    chunk.reserve(std::min(num_words, chunk_words) * width_byte_);
+    for (uint32_t i = 0; i < std::min(num_words, chunk_words); ++i) {
+      chunk.insert(chunk.end(), word.begin(), word.end());
+    }
+    for (uint32_t done = 0; done < num_words;) {
+      uint32_t todo = std::min(num_words - done, chunk_words);
+      Write(word_offset + done, chunk.data(), todo * width_byte_);
+      done += todo;
+    }
+    return;
+  }
 
-    WriteBuffer(minibuf, data, i * width_byte_, dst_word);
-    WriteFromMinibuf(phys_addr, minibuf, dst_word);
+  PrepareTransfer();
+
+  // WriteBuffer needn't clear the bits above the physical width (see Write).
+  uint8_t buf[SV_MEM_WIDTH_BYTES];
+  memset(buf, 0, sizeof buf);
+  WriteBuffer(buf, word.data(), word.size(), 0, word_offset);
+
+  uint32_t phys_start = ToPhysAddr(word_offset);
+
+  SVScoped scoped(scope_);
+  if (!simutil_fill_mem(phys_start, num_words, (const svBitVecVal *)buf)) {
+    std::ostringstream oss;
+    oss << "Could not fill " << std::dec << num_words
+        << " memory words at physical index 0x" << std::hex << phys_start
+        << ".";
+    throw std::runtime_error(oss.str());
   }
 }
 
@@ -57,20 +140,22 @@ std::vector<uint8_t> MemArea::Read(uint32_t word_offset,
   uint32_t num_bytes = width_byte_ * num_words;
   assert(num_words <= num_bytes);
 
+  PrepareTransfer();
+
+  std::vector<uint32_t> phys_addrs(num_words);
+  for (uint32_t i = 0; i < num_words; ++i) {
+    phys_addrs[i] = ToPhysAddr(word_offset + i);
+  }
+
   // See Write for an explanation for this buffer.
-  uint8_t minibuf[SV_MEM_WIDTH_BYTES];
-  memset(minibuf, 0, sizeof minibuf);
-  assert(width_byte_ <= sizeof minibuf);
+  std::vector<uint8_t> staged(num_words * SV_MEM_WIDTH_BYTES);
+  ReadPhysWords(phys_addrs, staged);
 
   std::vector<uint8_t> ret;
   ret.reserve(num_bytes);
 
   for (uint32_t i = 0; i < num_words; ++i) {
-    uint32_t src_word = word_offset + i;
-    uint32_t phys_addr = ToPhysAddr(src_word);
-
-    ReadToMinibuf(minibuf, phys_addr);
-    ReadBuffer(ret, minibuf, src_word);
+    ReadBuffer(ret, &staged[i * SV_MEM_WIDTH_BYTES], word_offset + i);
   }
 
   return ret;
@@ -82,10 +167,10 @@ void MemArea::LoadVmem(const std::string &path) const {
   simutil_memload(path.c_str());
 }
 
-void MemArea::WriteBuffer(uint8_t buf[SV_MEM_WIDTH_BYTES],
-                          const std::vector<uint8_t> &data, size_t start_idx,
+void MemArea::WriteBuffer(uint8_t buf[SV_MEM_WIDTH_BYTES], const uint8_t *data,
+                          size_t data_len, size_t start_idx,
                           uint32_t dst_word) const {
-  size_t words_left = data.size() - start_idx;
+  size_t words_left = data_len - start_idx;
   size_t to_copy = std::min(words_left, (size_t)width_byte_);
   if (to_copy < width_byte_) {
     memset(buf, 0, SV_MEM_WIDTH_BYTES);
@@ -101,23 +186,69 @@ void MemArea::ReadBuffer(std::vector<uint8_t> &data,
               std::back_inserter(data));
 }
 
-void MemArea::ReadToMinibuf(uint8_t *minibuf, uint32_t phys_addr) const {
+void MemArea::WritePhysWords(const std::vector<uint32_t> &phys_addrs,
+                             const std::vector<uint8_t> &staged) const {
+  assert(staged.size() == phys_addrs.size() * SV_MEM_WIDTH_BYTES);
+
+  // `simutil_set_mem_bulk` takes a fixed-size bit vector, of which it only
+  // uses the slots for the words being written. Since the simulator may still
+  // read the rest, we must pass a buffer of the full size.
+  uint8_t bulkbuf[SV_MEM_BULK_WORDS * SV_MEM_WIDTH_BYTES];
+  memset(bulkbuf, 0, sizeof bulkbuf);
+
+  std::vector<uint32_t> order = SortedIndices(phys_addrs);
+
   SVScoped scoped(scope_);
-  if (!simutil_get_mem(phys_addr, (svBitVecVal *)minibuf)) {
-    std::ostringstream oss;
-    oss << "Could not read memory word at physical index 0x" << std::hex
-        << phys_addr << ".";
-    throw std::runtime_error(oss.str());
+  for (size_t pos = 0; pos < order.size();) {
+    uint32_t run_start = phys_addrs[order[pos]];
+    uint32_t run_len = RunLength(phys_addrs, order, pos);
+
+    for (uint32_t i = 0; i < run_len; ++i) {
+      memcpy(&bulkbuf[i * SV_MEM_WIDTH_BYTES],
+             &staged[order[pos + i] * SV_MEM_WIDTH_BYTES], SV_MEM_WIDTH_BYTES);
+    }
+
+    if (!simutil_set_mem_bulk(run_start, run_len,
+                              (const svBitVecVal *)bulkbuf)) {
+      std::ostringstream oss;
+      oss << "Could not set " << std::dec << run_len
+          << " memory words at physical index 0x" << std::hex << run_start
+          << ".";
+      throw std::runtime_error(oss.str());
+    }
+
+    pos += run_len;
   }
 }
 
-void MemArea::WriteFromMinibuf(uint32_t phys_addr, const uint8_t *minibuf,
-                               uint32_t dst_word) const {
+void MemArea::ReadPhysWords(const std::vector<uint32_t> &phys_addrs,
+                            std::vector<uint8_t> &staged) const {
+  assert(staged.size() == phys_addrs.size() * SV_MEM_WIDTH_BYTES);
+
+  // See WritePhysWords for an explanation for this buffer.
+  uint8_t bulkbuf[SV_MEM_BULK_WORDS * SV_MEM_WIDTH_BYTES];
+  memset(bulkbuf, 0, sizeof bulkbuf);
+
+  std::vector<uint32_t> order = SortedIndices(phys_addrs);
+
   SVScoped scoped(scope_);
-  if (!simutil_set_mem(phys_addr, (const svBitVecVal *)minibuf)) {
-    std::ostringstream oss;
-    oss << "Could not set memory at byte offset 0x" << std::hex
-        << dst_word * width_byte_ << ".";
-    throw std::runtime_error(oss.str());
+  for (size_t pos = 0; pos < order.size();) {
+    uint32_t run_start = phys_addrs[order[pos]];
+    uint32_t run_len = RunLength(phys_addrs, order, pos);
+
+    if (!simutil_get_mem_bulk(run_start, run_len, (svBitVecVal *)bulkbuf)) {
+      std::ostringstream oss;
+      oss << "Could not read " << std::dec << run_len
+          << " memory words at physical index 0x" << std::hex << run_start
+          << ".";
+      throw std::runtime_error(oss.str());
+    }
+
+    for (uint32_t i = 0; i < run_len; ++i) {
+      memcpy(&staged[order[pos + i] * SV_MEM_WIDTH_BYTES],
+             &bulkbuf[i * SV_MEM_WIDTH_BYTES], SV_MEM_WIDTH_BYTES);
+    }
+
+    pos += run_len;
   }
 }
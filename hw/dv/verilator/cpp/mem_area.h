@@ -18,6 +18,12 @@
 // using the svBitVecVal type, we have to round up to the next 32-bit word.
 #define SV_MEM_WIDTH_BYTES (4 * ((SV_MEM_WIDTH_BITS + 31) / 32))
 
+// This is the maximum number of memory words that can be transferred with a
+// single call to simutil_set_mem_bulk or simutil_get_mem_bulk (defined in
+// prim_util_memload.svh). Each word takes a SV_MEM_WIDTH_BYTES slot in the
+// transfer buffer.
+#define SV_MEM_BULK_WORDS 64
+
 /**
  * A "memory area", representing a memory in the simulated design.
  */
@@ -27,8 +33,8 @@ class MemArea {
    *
    * @param scope  The SystemVerilog scope where the instantiated memory can be
    *               found. This needs to support the DPI-C interfaces \c
-   *               simutil_memload and \c simutil_set_mem (used for vmem and
-   *               ELF files, respectively).
+   *               simutil_memload and \c simutil_set_mem_bulk (used for vmem
+   *               and ELF files, respectively).
    *
    * @param size   The size of the memory in bytes (must be positive and a
    *               multiple of \p width_byte)
@@ -42,8 +48,8 @@ class MemArea {
   /** Write data to this memory area at the given word offset
    *
    * This assumes that the result will fit in the memory. If the scope cannot
-   * be set, this throws an SVScoped::Error. If a call to \c simutil_set_mem
-   * fails, this throws a \c std::runtime_error.
+   * be set, this throws an SVScoped::Error. If a call to \c
+   * simutil_set_mem_bulk fails, this throws a \c std::runtime_error.
    *
    * @param word_offset The offset, in words, of the first word that should be
    *                    written.
@@ -55,13 +61,42 @@ class MemArea {
   virtual void Write(uint32_t word_offset,
                      const std::vector<uint8_t> &data) const;
 
+  /** Write \p len bytes from \p data to this memory area
+   *
+   * This is equivalent to the std::vector version of Write, but allows data
+   * that isn't owned by a vector (such as a memory-mapped file) to be written
+   * without copying it first.
+   */
+  virtual void Write(uint32_t word_offset, const uint8_t *data,
+                     size_t len) const;
+
+  /** Fill part of this memory area with a repeated pattern
+   *
+   * Each of the \p num_words words starting at \p word_offset gets the
+   * logical contents formed by repeating \p pattern, whose length must be
+   * positive and divide the word width. This is much faster than an
+   * equivalent call to Write, because (unless the physical contents depend on
+   * the address, as with scrambling) it computes the physical word once and
+   * then uses a single call to \c simutil_fill_mem.
+   *
+   * If the scope cannot be set, this throws an SVScoped::Error. If a call to
+   * \c simutil_fill_mem fails, this throws a \c std::runtime_error.
+   */
+  void Fill(const std::vector<uint8_t> &pattern, uint32_t word_offset,
+            uint32_t num_words) const;
+
+  /** Fill the whole memory area with a repeated pattern (see above) */
+  void Fill(const std::vector<uint8_t> &pattern) const {
+    Fill(pattern, 0, num_words_);
+  }
+
   /** Read data from this memory area, starting at the given offset.
    *
    * This assumes that there are <tt>word_offset + num_words</tt> words in the
    * memory. Returns a vector with <tt>num_words * width_byte_</tt> elements.
    *
    * If the scope cannot be set, this throws an SVScoped::Error. If a call to
-   * simutil_get_mem fails, this throws a std::runtime_error.
+   * simutil_get_mem_bulk fails, this throws a std::runtime_error.
    *
    * @param word_offset The offset, in words, of the first word that should be
    *                    written.
@@ -95,11 +130,12 @@ class MemArea {
    *
    * @param buf       Destination buffer
    * @param data      A large buffer that contains the data to be written
+   * @param data_len  The length of \p data in bytes
    * @param start_idx An offset into \p data for the start of the memory word
    * @param dst_word  Logical address of the location being written
    */
-  virtual void WriteBuffer(uint8_t buf[SV_MEM_WIDTH_BYTES],
-                           const std::vector<uint8_t> &data, size_t start_idx,
+  virtual void WriteBuffer(uint8_t buf[SV_MEM_WIDTH_BYTES], const uint8_t *data,
+                           size_t data_len, size_t start_idx,
                            uint32_t dst_word) const;
 
   /** Extract the logical memory contents corresponding to the physical
@@ -120,6 +156,16 @@ class MemArea {
                           const uint8_t buf[SV_MEM_WIDTH_BYTES],
                           uint32_t src_word) const;
 
+  /** Prepare for a transfer to or from the memory
+   *
+   * This is called once at the start of each read or write, before any calls
+   * to ToPhysAddr(), WriteBuffer() or ReadBuffer(). Memories that derive state
+   * from the design (such as scrambling keys) can use it to refresh that state
+   * once per transfer instead of once per word. The default implementation
+   * does nothing.
+   */
+  virtual void PrepareTransfer() const {}
+
   /** Convert a logical address to physical address
    *
    * Some memories may have a mapping between the address supplied on the
@@ -131,20 +177,35 @@ class MemArea {
     return logical_addr;
   }
 
-  /** Read the memory word at phys_addr into minibuf
+  /** Whether the physical bits of a word depend on its address
+   *
+   * If this is false (the default), writing the same logical data to a range
+   * of words writes the same physical bits to a range of consecutive physical
+   * addresses, which lets Fill() use \c simutil_fill_mem. Memories that
+   * scramble their contents or addresses must return true.
+   */
+  virtual bool PhysWordDependsOnAddr() const { return false; }
+
+  /** Write staged physical words to the memory
    *
-   * minibuf should be at least SV_MEM_WIDTH_BYTES in size. See the
-   * implementation of MemArea::Write() for the details.
+   * \p staged holds one SV_MEM_WIDTH_BYTES-sized slot for each entry of \p
+   * phys_addrs, containing the bits to be written at that physical address.
+   * The words are sent to SystemVerilog in runs of consecutive physical
+   * addresses using \c simutil_set_mem_bulk, and the scope is only set once
+   * for the whole transfer.
    */
-  void ReadToMinibuf(uint8_t *minibuf, uint32_t phys_addr) const;
+  void WritePhysWords(const std::vector<uint32_t> &phys_addrs,
+                      const std::vector<uint8_t> &staged) const;
 
-  /** Write from minibuf to the memory word at phys_addr
+  /** Read physical words from the memory into a staging buffer
    *
-   * minibuf should be at least SV_MEM_WIDTH_BYTES in size. See the
-   * implementation of MemArea::Write() for the details.
+   * This is the inverse of WritePhysWords(). On return, the
+   * SV_MEM_WIDTH_BYTES-sized slot at index i of \p staged holds the bits
+   * stored at physical address <tt>phys_addrs[i]</tt>. \p staged must already
+   * have the right size.
    */
-  void WriteFromMinibuf(uint32_t phys_addr, const uint8_t *minibuf,
-                        uint32_t dst_word) const;
+  void ReadPhysWords(const std::vector<uint32_t> &phys_addrs,
+                     std::vector<uint8_t> &staged) const;
 };
 
 #endif  // OPENTITAN_HW_DV_VERILATOR_CPP_MEM_AREA_H_
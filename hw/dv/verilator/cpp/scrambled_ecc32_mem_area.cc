@@ -10,6 +10,7 @@
 #include <sstream>
 
 #include "scramble_model.h"
+#include "scramble_model_fast.h"
 #include "sv_scoped.h"
 
 // This is the maximum width of a nonce that's supported by the code in
@@ -17,34 +18,6 @@
 static const uint32_t kScrMaxNonceWidth = 320;
 static const uint32_t kScrMaxNonceWidthByte = (kScrMaxNonceWidth + 7) / 8;
 
-// Functions to convert from integer address to/from a little-endian vector of
-// bytes, addr_width is given in bits
-static std::vector<uint8_t> AddrIntToBytes(uint32_t addr, uint32_t addr_width) {
-  uint32_t addr_width_bytes = (addr_width + 7) / 8;
-  std::vector<uint8_t> addr_bytes(addr_width_bytes);
-
-  for (uint32_t i = 0; i < addr_width_bytes; ++i) {
-    addr_bytes[i] = addr & 0xff;
-    addr >>= 8;
-  }
-
-  return addr_bytes;
-}
-
-static uint32_t AddrBytesToInt(const std::vector<uint8_t> &addr) {
-  assert(addr.size() <= 4);
-
-  uint32_t addr_out = 0;
-  int cur_shift = 0;
-
-  for (uint8_t byte : addr) {
-    addr_out |= ((uint32_t)byte << cur_shift);
-    cur_shift += 8;
-  }
-
-  return addr_out;
-}
-
 // Converts svBitVecVal (bit[m:n] SV type) into a byte vector
 static std::vector<uint8_t> ByteVecFromSV(svBitVecVal sv_val[],
                                           uint32_t bytes) {
@@ -151,21 +124,23 @@ uint32_t ScrambledEcc32MemArea::GetNonceWidthByte() const {
 }
 
 void ScrambledEcc32MemArea::WriteBuffer(uint8_t buf[SV_MEM_WIDTH_BYTES],
-                                        const std::vector<uint8_t> &data,
+                                        const uint8_t *data, size_t data_len,
                                         size_t start_idx,
                                         uint32_t dst_word) const {
   // Compute integrity
-  Ecc32MemArea::WriteBuffer(buf, data, start_idx, dst_word);
+  Ecc32MemArea::WriteBuffer(buf, data, data_len, start_idx, dst_word);
   ScrambleBuffer(buf, dst_word);
 }
 
 std::vector<uint8_t> ScrambledEcc32MemArea::ReadUnscrambled(
     const uint8_t buf[SV_MEM_WIDTH_BYTES], uint32_t src_word) const {
-  std::vector<uint8_t> scrambled_data(buf, buf + GetPhysWidthByte());
-  return scramble_decrypt_data(scrambled_data, GetPhysWidth(), 39,
-                               AddrIntToBytes(src_word, addr_width_),
-                               addr_width_, GetScrambleNonce(),
-                               GetScrambleKey(), repeat_keystream_, false);
+  // With the S&P layer disabled, decryption is an XOR with the keystream.
+  const uint8_t *keystream = GetKeystream(src_word);
+  std::vector<uint8_t> unscrambled_data(GetPhysWidthByte());
+  for (uint32_t i = 0; i < unscrambled_data.size(); ++i) {
+    unscrambled_data[i] = buf[i] ^ keystream[i];
+  }
+  return unscrambled_data;
 }
 
 void ScrambledEcc32MemArea::ReadBuffer(std::vector<uint8_t> &data,
@@ -192,21 +167,60 @@ void ScrambledEcc32MemArea::WriteBufferWithIntegrity(
 
 void ScrambledEcc32MemArea::ScrambleBuffer(uint8_t buf[SV_MEM_WIDTH_BYTES],
                                            uint32_t dst_word) const {
-  std::vector<uint8_t> scramble_buf(buf, buf + GetPhysWidthByte());
-
-  // Scramble data with integrity
-  scramble_buf = scramble_encrypt_data(
-      scramble_buf, GetPhysWidth(), 39, AddrIntToBytes(dst_word, addr_width_),
-      addr_width_, GetScrambleNonce(), GetScrambleKey(), repeat_keystream_,
-      false);
-
-  // Copy scrambled data to write buffer
-  std::copy(scramble_buf.begin(), scramble_buf.end(), &buf[0]);
+  // Scramble data with integrity. With the S&P layer disabled, this is an XOR
+  // with the keystream.
+  const uint8_t *keystream = GetKeystream(dst_word);
+  for (uint32_t i = 0; i < GetPhysWidthByte(); ++i) {
+    buf[i] ^= keystream[i];
+  }
 }
 
 uint32_t ScrambledEcc32MemArea::ToPhysAddr(uint32_t logical_addr) const {
+  GetKeystream(logical_addr);
+  return ctx_.phys_addrs[logical_addr];
+}
+
+void ScrambledEcc32MemArea::PrepareTransfer() const {
+  std::vector<uint8_t> key = GetScrambleKey();
+  std::vector<uint8_t> nonce = GetScrambleNonce();
+
+  if (!ctx_.valid.empty() && key == ctx_.key && nonce == ctx_.nonce) {
+    return;
+  }
+
+  ctx_.key = std::move(key);
+  ctx_.nonce = std::move(nonce);
+  scramble_bytes_to_lanes(ctx_.key_lanes, ctx_.key);
+  scramble_bytes_to_lanes(ctx_.nonce_lanes, ctx_.nonce);
+  ctx_.phys_addrs.assign(num_words_, 0);
+  ctx_.keystreams.assign((size_t)num_words_ * GetPhysWidthByte(), 0);
+  ctx_.valid.assign(num_words_, false);
+}
+
+const uint8_t *ScrambledEcc32MemArea::GetKeystream(
+    uint32_t logical_addr) const {
+  // Accesses always go through MemArea::Read or MemArea::Write, which call
+  // PrepareTransfer first, but be safe if that hasn't happened yet.
+  if (ctx_.valid.empty()) {
+    PrepareTransfer();
+  }
+
+  assert(logical_addr < num_words_);
+  uint8_t *keystream = &ctx_.keystreams[logical_addr * GetPhysWidthByte()];
+  if (ctx_.valid[logical_addr]) {
+    return keystream;
+  }
+
   // Scramble logical address to get physical address
-  return AddrBytesToInt(scramble_addr(AddrIntToBytes(logical_addr, addr_width_),
-                                      addr_width_, GetScrambleNonce(),
-                                      GetNonceWidth()));
+  ctx_.phys_addrs[logical_addr] = scramble_addr_fast(
+      logical_addr, addr_width_, ctx_.nonce_lanes, GetNonceWidth());
+
+  uint64_t keystream_lanes[kScrMaxLanes];
+  scramble_keystream_fast(keystream_lanes, logical_addr, addr_width_,
+                          ctx_.nonce_lanes, ctx_.key_lanes, GetPhysWidth(),
+                          repeat_keystream_);
+  scramble_lanes_to_bytes(keystream, GetPhysWidthByte(), keystream_lanes);
+
+  ctx_.valid[logical_addr] = true;
+  return keystream;
 }
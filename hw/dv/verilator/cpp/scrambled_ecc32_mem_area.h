@@ -8,6 +8,7 @@
 #include <vector>
 
 #include "ecc32_mem_area.h"
+#include "scramble_model_fast.h"
 
 /**
  * A memory that implements scrambling over a 32-bit ECC integrity protection
@@ -33,8 +34,10 @@ class ScrambledEcc32MemArea : public Ecc32MemArea {
                         uint32_t width_32, bool repeat_keystream = true);
 
  private:
-  void WriteBuffer(uint8_t buf[SV_MEM_WIDTH_BYTES],
-                   const std::vector<uint8_t> &data, size_t start_idx,
+  void PrepareTransfer() const override;
+
+  void WriteBuffer(uint8_t buf[SV_MEM_WIDTH_BYTES], const uint8_t *data,
+                   size_t data_len, size_t start_idx,
                    uint32_t dst_word) const override;
 
   std::vector<uint8_t> ReadUnscrambled(const uint8_t buf[SV_MEM_WIDTH_BYTES],
@@ -56,6 +59,8 @@ class ScrambledEcc32MemArea : public Ecc32MemArea {
 
   uint32_t ToPhysAddr(uint32_t logical_addr) const override;
 
+  bool PhysWordDependsOnAddr() const override { return true; }
+
   uint32_t GetPhysWidth() const;
   uint32_t GetPhysWidthByte() const;
   uint32_t GetPrinceReplications() const;
@@ -65,9 +70,29 @@ class ScrambledEcc32MemArea : public Ecc32MemArea {
   std::vector<uint8_t> GetScrambleKey() const;
   std::vector<uint8_t> GetScrambleNonce() const;
 
+  // Compute the physical address and keystream for logical_addr if they
+  // aren't already in the scrambling context, and return the keystream.
+  const uint8_t *GetKeystream(uint32_t logical_addr) const;
+
   std::string scr_scope_;
   uint32_t addr_width_;
   bool repeat_keystream_;
+
+  // Scrambling context for the current key and nonce. PrepareTransfer() reads
+  // the key and nonce from the design and drops the cached tables if either
+  // has changed. The tables are indexed by logical word address and filled in
+  // on first use, so the physical address and keystream for each word are
+  // computed at most once per key and nonce.
+  struct ScrambleCtx {
+    std::vector<uint8_t> key;
+    std::vector<uint8_t> nonce;
+    uint64_t key_lanes[2];
+    uint64_t nonce_lanes[kScrMaxLanes];
+    std::vector<uint32_t> phys_addrs;
+    std::vector<uint8_t> keystreams;  // GetPhysWidthByte() bytes per word
+    std::vector<bool> valid;
+  };
+  mutable ScrambleCtx ctx_;
 };
 
 #endif  // OPENTITAN_HW_DV_VERILATOR_CPP_SCRAMBLED_ECC32_MEM_AREA_H_
@@ -13,16 +13,9 @@
 #include <string>
 #include <vector>
 
-namespace {
-// An instruction to load the file at filepath to the memory called name. If
-// name is the empty string then type must be kMemImageElf and this is an
-// instruction to load an ELF file, picking memories by LMA.
-struct LoadArg {
-  std::string name;
-  std::string filepath;
-  MemImageType type;
-};
-}  // namespace
+#ifdef VM_SAVABLE
+#include "verilated_save.h"
+#endif
 
 // Parse a meminit command-line argument and write the result to the
 // mem_arg output pointer. The command-line argument should be of the
@@ -30,7 +23,8 @@ struct LoadArg {
 //
 // Return true on success. On failure, return false and write an error
 // message to err_msg.
-static bool ParseMemArg(const std::string mem_argument, LoadArg *load_arg,
+static bool ParseMemArg(const std::string mem_argument,
+                        VerilatorMemUtil::LoadArg *load_arg,
                         std::string *err_msg) {
   std::array<std::string, 3> args;
   size_t pos = 0;
@@ -92,15 +86,20 @@ static void PrintHelp() {
                "  Print registered memory regions\n\n"
                "--verbose-mem-load\n"
                "  Print a message for each memory load\n\n"
+               "--mmap-mem-load\n"
+               "  Memory-map ELF and binary files instead of copying their\n"
+               "  contents into the staging area\n\n"
                "-h|--help\n"
                "  Show help\n\n";
 }
 
-VerilatorMemUtil::VerilatorMemUtil() : allocation_(new DpiMemUtil()) {
+VerilatorMemUtil::VerilatorMemUtil()
+    : allocation_(new DpiMemUtil()), verbose_(false) {
   mem_util_ = allocation_.get();
 }
 
-VerilatorMemUtil::VerilatorMemUtil(DpiMemUtil *mem_util) : mem_util_(mem_util) {
+VerilatorMemUtil::VerilatorMemUtil(DpiMemUtil *mem_util)
+    : mem_util_(mem_util), verbose_(false) {
   assert(mem_util);
 }
 
@@ -113,13 +112,11 @@ bool VerilatorMemUtil::ParseCLIArguments(int argc, char **argv,
       {"otpinit", required_argument, nullptr, 'o'},
       {"meminit", required_argument, nullptr, 'l'},
       {"verbose-mem-load", no_argument, nullptr, 'V'},
+      {"mmap-mem-load", no_argument, nullptr, 'M'},
       {"load-elf", required_argument, nullptr, 'E'},
       {"help", no_argument, nullptr, 'h'},
       {nullptr, no_argument, nullptr, 0}};
 
-  std::vector<LoadArg> load_args;
-  bool verbose = false;
-
   // Reset the command parsing index in-case other utils have already parsed
   // some arguments
   optind = 1;
@@ -137,19 +134,19 @@ bool VerilatorMemUtil::ParseCLIArguments(int argc, char **argv,
       case 1:
         break;
       case 'r':
-        load_args.push_back(
+        load_args_.push_back(
             {.name = "rom", .filepath = optarg, .type = kMemImageUnknown});
         break;
       case 'm':
-        load_args.push_back(
+        load_args_.push_back(
             {.name = "ram", .filepath = optarg, .type = kMemImageUnknown});
         break;
       case 'f':
-        load_args.push_back(
+        load_args_.push_back(
             {.name = "flash", .filepath = optarg, .type = kMemImageUnknown});
         break;
       case 'o':
-        load_args.push_back(
+        load_args_.push_back(
             {.name = "otp", .filepath = optarg, .type = kMemImageUnknown});
         break;
       case 'l': {
@@ -166,15 +163,18 @@ bool VerilatorMemUtil::ParseCLIArguments(int argc, char **argv,
           std::cerr << "ERROR: " << load_err_msg << std::endl;
           return false;
         } else {
-          load_args.emplace_back(load_arg);
+          load_args_.emplace_back(load_arg);
         }
         break;
       }
       case 'V':
-        verbose = true;
+        verbose_ = true;
+        break;
+      case 'M':
+        mem_util_->SetMmapStaging(true);
         break;
       case 'E':
-        load_args.push_back(
+        load_args_.push_back(
             {.name = "", .filepath = optarg, .type = kMemImageElf});
         break;
       case 'h':
@@ -190,14 +190,18 @@ bool VerilatorMemUtil::ParseCLIArguments(int argc, char **argv,
     }
   }
 
-  for (const LoadArg &arg : load_args) {
+  return LoadImages();
+}
+
+bool VerilatorMemUtil::LoadImages() {
+  for (const LoadArg &arg : load_args_) {
     try {
       if (!arg.name.empty()) {
-        mem_util_->LoadFileToNamedMem(verbose, arg.name, arg.filepath,
+        mem_util_->LoadFileToNamedMem(verbose_, arg.name, arg.filepath,
                                       arg.type);
       } else {
         assert(arg.type == kMemImageElf);
-        mem_util_->LoadElfToMemories(verbose, arg.filepath);
+        mem_util_->LoadElfToMemories(verbose_, arg.filepath);
       }
     } catch (const std::exception &err) {
       std::cerr << "ERROR: " << err.what() << std::endl;
@@ -207,3 +211,40 @@ bool VerilatorMemUtil::ParseCLIArguments(int argc, char **argv,
 
   return true;
 }
+
+bool VerilatorMemUtil::SaveState(VerilatedSerialize &os) {
+#ifdef VM_SAVABLE
+  uint32_t num_images = load_args_.size();
+  os << num_images;
+  for (const LoadArg &arg : load_args_) {
+    std::string name = arg.name;
+    std::string filepath = arg.filepath;
+    os << name << filepath;
+  }
+  return true;
+#else
+  return false;
+#endif
+}
+
+bool VerilatorMemUtil::RestoreState(VerilatedDeserialize &is) {
+#ifdef VM_SAVABLE
+  uint32_t num_images;
+  is >> num_images;
+  if (verbose_ && num_images) {
+    std::cout << "The restored checkpoint was saved with these images:"
+              << std::endl;
+  }
+  for (uint32_t i = 0; i < num_images; ++i) {
+    std::string name, filepath;
+    is >> name >> filepath;
+    if (verbose_) {
+      std::cout << "  " << (name.empty() ? "(ELF by LMA)" : name) << ": "
+                << filepath << std::endl;
+    }
+  }
+  return LoadImages();
+#else
+  return false;
+#endif
+}
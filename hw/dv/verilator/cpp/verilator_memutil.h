@@ -9,6 +9,8 @@
 //
 
 #include <memory>
+#include <string>
+#include <vector>
 
 #include "dpi_memutil.h"
 #include "sim_ctrl_extension.h"
@@ -20,9 +22,25 @@ class VerilatorMemUtil : public SimCtrlExtension {
   VerilatorMemUtil();
   explicit VerilatorMemUtil(DpiMemUtil *mem_util);
 
+  // An instruction to load the file at filepath to the memory called name. If
+  // name is the empty string then type must be kMemImageElf and this is an
+  // instruction to load an ELF file, picking memories by LMA.
+  struct LoadArg {
+    std::string name;
+    std::string filepath;
+    MemImageType type;
+  };
+
   // Declared in SimCtrlExtension
   bool ParseCLIArguments(int argc, char **argv, bool &exit_app) override;
 
+  // A checkpoint holds the memory contents as part of the model, so only
+  // the list of images that were loaded is saved. Restoring a checkpoint
+  // overwrites the memories, so the images from the command line (if any) are
+  // loaded again on top of the restored contents.
+  bool SaveState(VerilatedSerialize &os) override;
+  bool RestoreState(VerilatedDeserialize &is) override;
+
   // Get underlying DpiMemUtil object
   DpiMemUtil *GetUnderlying() { return mem_util_; }
 
@@ -35,6 +53,13 @@ class VerilatorMemUtil : public SimCtrlExtension {
  private:
   DpiMemUtil *mem_util_;
   std::unique_ptr<DpiMemUtil> allocation_;
+
+  // The images from the command line
+  std::vector<LoadArg> load_args_;
+  bool verbose_;
+
+  // Load the images in load_args_. Returns false on failure.
+  bool LoadImages();
 };
 
 #endif  // OPENTITAN_HW_DV_VERILATOR_CPP_VERILATOR_MEMUTIL_H_
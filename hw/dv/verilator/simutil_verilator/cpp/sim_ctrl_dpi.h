@@ -0,0 +1,58 @@
+// Copyright lowRISC contributors (OpenTitan project).
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef OPENTITAN_HW_DV_VERILATOR_SIMUTIL_VERILATOR_CPP_SIM_CTRL_DPI_H_
+#define OPENTITAN_HW_DV_VERILATOR_SIMUTIL_VERILATOR_CPP_SIM_CTRL_DPI_H_
+
+// Functions of the Verilator simulation controller for DPI modules. Unlike
+// verilator_sim_ctrl.h, this header can be included from C.
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Get an ID for this run of the simulator
+ *
+ * The ID is different for each process. A DPI module keeps it with the handle
+ * of a context that it creates. If a checkpoint is restored, the handle and
+ * the ID come back from the run that saved the checkpoint, which tells the
+ * module that the handle is stale and the context must be created again.
+ *
+ * This is also a DPI import (a `pure` function returning `longint`).
+ */
+long long simctrl_run_id(void);
+
+/**
+ * Keep part of a DPI context in checkpoints
+ *
+ * A DPI module calls this when it creates a context, for the part of the
+ * context that the design depends on and that can be copied as it is (like
+ * the levels that it drives onto pins). This part is saved with the model in
+ * each checkpoint.
+ *
+ * When a checkpoint is restored, the module creates the context again, with
+ * the same kind and name. This call then copies the saved state over the new
+ * one. The module must call simctrl_forget_dpi_state() before it frees the
+ * context.
+ *
+ * @param kind The kind of DPI module, like "gpiodpi"
+ * @param name The name of the context, which is unique for the kind
+ * @param state, size The part of the context to keep
+ */
+void simctrl_keep_dpi_state(const char *kind, const char *name, void *state,
+                            size_t size);
+
+/**
+ * Stop keeping DPI context state that was passed to simctrl_keep_dpi_state()
+ */
+void simctrl_forget_dpi_state(const void *state);
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif
+
+#endif  // OPENTITAN_HW_DV_VERILATOR_SIMUTIL_VERILATOR_CPP_SIM_CTRL_DPI_H_
@@ -5,6 +5,11 @@
 #ifndef OPENTITAN_HW_DV_VERILATOR_SIMUTIL_VERILATOR_CPP_SIM_CTRL_EXTENSION_H_
 #define OPENTITAN_HW_DV_VERILATOR_SIMUTIL_VERILATOR_CPP_SIM_CTRL_EXTENSION_H_
 
+#include <climits>
+
+class VerilatedSerialize;
+class VerilatedDeserialize;
+
 class SimCtrlExtension {
  public:
   virtual ~SimCtrlExtension() = default;
@@ -39,10 +44,47 @@ class SimCtrlExtension {
    */
   virtual void OnClock(unsigned long sim_time) {}
 
+  /**
+   * Limit the number of idle cycles that can be skipped
+   *
+   * If idle skipping is enabled (see VerilatorSimCtrl::SetIdleSignal()) and
+   * the design is idle, the simulation controller may advance time by several
+   * cycles at once, without evaluating the design or calling OnClock(). Before
+   * doing so, it calls this function on each extension to find the largest
+   * number of cycles that may be skipped from sim_time. Return 0 to veto the
+   * skip (for example, because there is pending input for the design).
+   */
+  virtual unsigned long MaxIdleSkip(unsigned long sim_time) {
+    return ULONG_MAX;
+  }
+
   /**
    * Function to be called after executing the simulation
    */
   virtual void PostExec() {}
+
+  /**
+   * Add the extension's state to a checkpoint
+   *
+   * This is called after the model state has been written and should write
+   * anything that isn't stored in the model but is needed to carry on from
+   * this point. RestoreState() must read back exactly what this wrote.
+   *
+   * @return true on success
+   */
+  virtual bool SaveState(VerilatedSerialize &os) { return true; }
+
+  /**
+   * Restore the extension's state from a checkpoint
+   *
+   * This is called before PreExec(), once the model state has been restored.
+   * Anything that the extension wrote into the model before then (for
+   * example, while parsing its arguments) has been overwritten, and should be
+   * written again here.
+   *
+   * @return true on success
+   */
+  virtual bool RestoreState(VerilatedDeserialize &is) { return true; }
 };
 
 #endif  // OPENTITAN_HW_DV_VERILATOR_SIMUTIL_VERILATOR_CPP_SIM_CTRL_EXTENSION_H_
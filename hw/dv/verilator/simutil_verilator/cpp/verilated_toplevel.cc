@@ -4,9 +4,89 @@
 
 #include "verilated_toplevel.h"
 
+#if VM_TRACE == 1 && !defined(VM_TRACE_FMT_FST)
+#include <cerrno>
+#include <cstring>
+#endif
+
 TOPLEVEL_NAME &VerilatedToplevel::dut() {
   // The static_cast below is generally unsafe, but we know the types involved.
   // It's safe for these.
   TOPLEVEL_NAME &dut = static_cast<TOPLEVEL_NAME &>(*this);
   return dut;
 }
+
+#if VM_TRACE == 1 && !defined(VM_TRACE_FMT_FST)
+bool VcdHistoryFile::Commit() {
+  if (!holding_) {
+    return true;
+  }
+  holding_ = false;
+  if (!VerilatedVcdFile::open(name_)) {
+    return false;
+  }
+
+  bool ok = true;
+  for (const std::string *seg : {&header_, &prev_, &cur_}) {
+    const char *bufp = seg->data();
+    ssize_t left = seg->size();
+    while (ok && left > 0) {
+      ssize_t written = VerilatedVcdFile::write(bufp, left);
+      if (written > 0) {
+        bufp += written;
+        left -= written;
+      } else if (written < 0 && errno != EAGAIN && errno != EINTR) {
+        ok = false;
+      }
+    }
+  }
+
+  std::string().swap(header_);
+  std::string().swap(prev_);
+  std::string().swap(cur_);
+  return ok;
+}
+
+bool VcdHistoryFile::open(const std::string &name) {
+  if (!holding_) {
+    return VerilatedVcdFile::open(name);
+  }
+  name_ = name;
+  prev_.swap(cur_);
+  cur_.clear();
+  return true;
+}
+
+void VcdHistoryFile::close() {
+  if (!holding_) {
+    VerilatedVcdFile::close();
+  }
+}
+
+ssize_t VcdHistoryFile::write(const char *bufp, ssize_t len) {
+  if (!holding_) {
+    return VerilatedVcdFile::write(bufp, len);
+  }
+
+  // The header (everything up to the end of the definitions) is only written
+  // by the first open(), so keep it separate from the segments.
+  if (!header_done_) {
+    static const char kEndDefs[] = "$enddefinitions $end\n";
+    size_t search_from = header_.size() < sizeof(kEndDefs)
+                             ? 0
+                             : header_.size() - sizeof(kEndDefs);
+    header_.append(bufp, len);
+    size_t pos = header_.find(kEndDefs, search_from);
+    if (pos != std::string::npos) {
+      size_t end = pos + strlen(kEndDefs);
+      cur_.append(header_, end, std::string::npos);
+      header_.resize(end);
+      header_done_ = true;
+    }
+    return len;
+  }
+
+  cur_.append(bufp, len);
+  return len;
+}
+#endif
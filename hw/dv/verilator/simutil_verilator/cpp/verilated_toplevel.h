@@ -9,6 +9,7 @@
 #error "TOPLEVEL_NAME must be set to the name of the toplevel."
 #endif
 
+#include <string>
 #include <verilated.h>
 
 #define STR(s) #s
@@ -44,6 +45,38 @@
 #endif
 
 #if VM_TRACE == 1
+#ifndef VM_TRACE_FMT_FST
+/**
+ * A VCD output file that can hold back the trace until it is needed
+ *
+ * This is used to keep a history of the trace before a trigger. Once Hold()
+ * has been called, the tracer writes to memory instead of the file. Each time
+ * the tracer opens the file again (with openNext()), it starts a new segment
+ * that starts with a full dump of all signals, and the oldest segment is
+ * dropped, so that we only keep the last two. Commit() writes the header and
+ * the segments to the file and sends everything after that straight to it.
+ */
+class VcdHistoryFile : public VerilatedVcdFile {
+ public:
+  VcdHistoryFile() : holding_(false), header_done_(false) {}
+
+  void Hold() { holding_ = true; }
+  bool Commit();
+
+  bool open(const std::string &name) override;
+  void close() override;
+  ssize_t write(const char *bufp, ssize_t len) override;
+
+ private:
+  bool holding_;
+  bool header_done_;
+  std::string name_;
+  std::string header_;
+  std::string prev_;
+  std::string cur_;
+};
+#endif
+
 /**
  * "Base" for all tracers in Verilator with common functionality
  *
@@ -55,7 +88,13 @@
  */
 class VerilatedTracer {
  public:
+#ifdef VM_TRACE_FMT_FST
   VerilatedTracer() : impl_(nullptr) { impl_ = new VM_TRACE_CLASS_NAME(); };
+#else
+  VerilatedTracer() : impl_(nullptr) {
+    impl_ = new VM_TRACE_CLASS_NAME(&history_file_);
+  };
+#endif
 
   ~VerilatedTracer() { delete impl_; }
 
@@ -67,12 +106,64 @@ class VerilatedTracer {
 
   void dump(vluint64_t timeui) { impl_->dump(timeui); }
 
+  void flush() { impl_->flush(); }
+
+  /**
+   * Only trace levels levels of the hierarchy below hier (all of them if
+   * levels is 0). This must be called before open() and can be called more
+   * than once to trace several scopes.
+   *
+   * @return false if this version of Verilator doesn't support it
+   */
+  bool dumpvars(int levels, const std::string &hier) {
+#if defined(VERILATOR_VERSION_INTEGER) && VERILATOR_VERSION_INTEGER >= 5000000
+    impl_->dumpvars(levels, hier);
+    return true;
+#else
+    return false;
+#endif
+  }
+
+  /**
+   * Can this tracer hold a history of the trace in memory?
+   */
+#ifdef VM_TRACE_FMT_FST
+  bool canHoldHistory() const { return false; }
+  void holdHistory() { assert(0 && "History needs a VCD trace."); }
+  void nextHistorySegment() {}
+  bool commitHistory() { return false; }
+#else
+  bool canHoldHistory() const { return true; }
+
+  /**
+   * Keep the trace in memory instead of writing it (see VcdHistoryFile). This
+   * must be called before open().
+   */
+  void holdHistory() { history_file_.Hold(); }
+
+  /**
+   * Start a new segment of history, dropping the oldest one
+   */
+  void nextHistorySegment() { impl_->openNext(false); }
+
+  /**
+   * Write the history to the file and stop holding it back
+   */
+  bool commitHistory() {
+    impl_->flush();
+    return history_file_.Commit();
+  }
+#endif
+
   operator VM_TRACE_CLASS_NAME *() const {
     assert(impl_);
     return impl_;
   }
 
  private:
+#ifndef VM_TRACE_FMT_FST
+  VcdHistoryFile history_file_;
+#endif
   VM_TRACE_CLASS_NAME *impl_;
 };
 #else
@@ -87,9 +178,24 @@ class VerilatedTracer {
   void open(const char *filename) {};
   void close() {};
   void dump(vluint64_t timeui) {}
+  void flush() {}
+  bool dumpvars(int levels, const std::string &hier) { return false; }
+  bool canHoldHistory() const { return false; }
+  void holdHistory() {}
+  void nextHistorySegment() {}
+  bool commitHistory() { return false; }
 };
 #endif  // VM_TRACE == 1
 
+// VM_SAVABLE must be set by the user when calling Verilator with --savable. It
+// enables checkpointing of the model state.
+#ifdef VM_SAVABLE
+#include "verilated_save.h"
+#else
+class VerilatedSerialize;
+class VerilatedDeserialize;
+#endif
+
 // Forward-declare for use in VerilatedToplevel
 class TOPLEVEL_NAME;
 
@@ -123,6 +229,15 @@ class VerilatedToplevel {
   virtual const char *name() const = 0;
   virtual void trace(VerilatedTracer &tfp, int levels, int options) = 0;
 
+  /**
+   * Write the state of the model to os, or read it back from is
+   *
+   * These only work if the model was verilated with --savable (in which case
+   * VM_SAVABLE should be defined).
+   */
+  virtual void save(VerilatedSerialize &os) = 0;
+  virtual void restore(VerilatedDeserialize &is) = 0;
+
   /**
    * Get the Verilator-generated device under test
    *
@@ -148,6 +263,20 @@ class TOPLEVEL_NAME : public VERILATED_TOPLEVEL_NAME, public VerilatedToplevel {
                                    levels, options);
 #else
     assert(0 && "Tracing not enabled.");
+#endif
+  }
+  void save(VerilatedSerialize &os) {
+#ifdef VM_SAVABLE
+    os << static_cast<VERILATED_TOPLEVEL_NAME &>(*this);
+#else
+    assert(0 && "Checkpointing not enabled.");
+#endif
+  }
+  void restore(VerilatedDeserialize &is) {
+#ifdef VM_SAVABLE
+    is >> static_cast<VERILATED_TOPLEVEL_NAME &>(*this);
+#else
+    assert(0 && "Checkpointing not enabled.");
 #endif
   }
 };
@@ -4,12 +4,18 @@
 
 #include "verilator_sim_ctrl.h"
 
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
 #include <getopt.h>
 #include <iostream>
+#include <random>
 #include <signal.h>
 #include <sys/stat.h>
 #include <verilated.h>
 
+#include "sim_ctrl_dpi.h"
+
 // This is defined by Verilator and passed through the command line
 #ifndef VM_TRACE
 #define VM_TRACE 0
@@ -22,6 +28,55 @@
  */
 double sc_time_stamp() { return VerilatorSimCtrl::GetInstance().GetTime(); }
 
+/**
+ * Fire the trace trigger (see VerilatorSimCtrl::TriggerTrace())
+ *
+ * This is a DPI import, so designs can call it when they see something
+ * interesting.
+ */
+extern "C" void simctrl_trace_trigger() {
+  VerilatorSimCtrl::GetInstance().TriggerTrace();
+}
+
+/**
+ * Stop idle cycles being skipped (see VerilatorSimCtrl::VetoIdleSkip())
+ *
+ * This is a DPI import, so testbenches can call it while a DPI model is busy.
+ */
+extern "C" void simctrl_idle_veto() {
+  VerilatorSimCtrl::GetInstance().VetoIdleSkip();
+}
+
+/**
+ * Get the number of cycles skipped since the last call (see
+ * VerilatorSimCtrl::SetIdleSignal())
+ *
+ * This is a DPI import, so designs that count through idle skips can catch up.
+ */
+extern "C" unsigned long long simctrl_take_skipped_cycles() {
+  return VerilatorSimCtrl::GetInstance().TakeSkippedCycles();
+}
+
+long long simctrl_run_id() {
+  // Unlike a PID, this won't come back in a later run that restores a
+  // checkpoint of this one.
+  static const long long run_id = [] {
+    std::random_device rd;
+    return (long long)(((uint64_t)rd() << 32) | rd());
+  }();
+  return run_id;
+}
+
+void simctrl_keep_dpi_state(const char *kind, const char *name, void *state,
+                            size_t size) {
+  VerilatorSimCtrl::GetInstance().KeepDpiState(
+      std::string(kind) + "." + name, state, size);
+}
+
+void simctrl_forget_dpi_state(const void *state) {
+  VerilatorSimCtrl::GetInstance().ForgetDpiState(state);
+}
+
 #ifdef VL_USER_STOP
 /**
  * A simulation stop was requested, e.g. through $stop() or $error()
@@ -47,6 +102,18 @@ void VerilatorSimCtrl::SetTop(VerilatedToplevel *top, CData *sig_clk,
   flags_ = flags;
 }
 
+void VerilatorSimCtrl::SetIdleSignal(CData *sig_idle,
+                                     IData *sig_idle_max_skip) {
+  sig_idle_ = sig_idle;
+  sig_idle_max_skip_ = sig_idle_max_skip;
+}
+
+unsigned long VerilatorSimCtrl::TakeSkippedCycles() {
+  unsigned long ret = untaken_skipped_cycles_;
+  untaken_skipped_cycles_ = 0;
+  return ret;
+}
+
 std::pair<int, bool> VerilatorSimCtrl::Exec(int argc, char **argv) {
   bool exit_app = false;
   bool good_cmdline = ParseCommandArgs(argc, argv, exit_app);
@@ -107,10 +174,30 @@ static bool read_ul_arg(unsigned long *arg_val, const char *arg_name,
   return true;
 }
 
+// Read an argument of the form FIRST[:SECOND]. If there is no second number,
+// *second is left unchanged.
+static bool read_ul_pair_arg(unsigned long *first, unsigned long *second,
+                             const char *arg_name, const char *arg_text) {
+  const char *colon = strchr(arg_text, ':');
+  if (!colon) {
+    return read_ul_arg(first, arg_name, arg_text);
+  }
+  std::string first_text(arg_text, colon - arg_text);
+  return read_ul_arg(first, arg_name, first_text.c_str()) &&
+         read_ul_arg(second, arg_name, colon + 1);
+}
+
 bool VerilatorSimCtrl::ParseCommandArgs(int argc, char **argv, bool &exit_app) {
   const struct option long_options[] = {
       {"term-after-cycles", required_argument, nullptr, 'c'},
       {"trace", optional_argument, nullptr, 't'},
+      {"trace-depth", required_argument, nullptr, 'd'},
+      {"trace-scope", required_argument, nullptr, 'S'},
+      {"trace-window", required_argument, nullptr, 'w'},
+      {"trace-trigger", required_argument, nullptr, 'T'},
+      {"save-checkpoint", required_argument, nullptr, 's'},
+      {"restore-checkpoint", required_argument, nullptr, 'r'},
+      {"skip-idle", required_argument, nullptr, 'i'},
       {"help", no_argument, nullptr, 'h'},
       {nullptr, no_argument, nullptr, 0}};
 
@@ -139,12 +226,103 @@ bool VerilatorSimCtrl::ParseCommandArgs(int argc, char **argv, bool &exit_app) {
         }
         TraceOn();
         break;
+      case 'd':
+      case 'S':
+      case 'w':
+      case 'T':
+        if (!tracing_possible_) {
+          std::cerr << "ERROR: Tracing has not been enabled at compile time."
+                    << std::endl;
+          exit_app = true;
+          return false;
+        }
+        if (c == 'd') {
+          if (!read_ul_arg(&trace_depth_, "trace-depth", optarg)) {
+            exit_app = true;
+            return false;
+          }
+        } else if (c == 'S') {
+          // The argument has the form SCOPE[:LEVELS]
+          unsigned long levels = 0;
+          std::string scope(optarg);
+          const char *colon = strrchr(optarg, ':');
+          if (colon) {
+            scope.assign(optarg, colon - optarg);
+            if (!read_ul_arg(&levels, "trace-scope", colon + 1)) {
+              exit_app = true;
+              return false;
+            }
+          }
+          if (!tracer_.dumpvars(levels, scope)) {
+            std::cerr << "ERROR: Tracing selected scopes needs Verilator 5."
+                      << std::endl;
+            exit_app = true;
+            return false;
+          }
+        } else if (c == 'w') {
+          trace_window_ = true;
+          if (!read_ul_pair_arg(&trace_start_cycle_, &trace_end_cycle_,
+                                "trace-window", optarg)) {
+            exit_app = true;
+            return false;
+          }
+        } else {
+          trace_trigger_armed_ = true;
+          if (!read_ul_pair_arg(&trace_history_cycles_,
+                                &trace_after_trigger_cycles_, "trace-trigger",
+                                optarg)) {
+            exit_app = true;
+            return false;
+          }
+        }
+        break;
       case 'c':
         if (!read_ul_arg(&term_after_cycles_, "term-after-cycles", optarg)) {
           exit_app = true;
           return false;
         }
         break;
+      case 's':
+      case 'r':
+        if (!checkpoint_possible_) {
+          std::cerr << "ERROR: Checkpointing has not been enabled at compile "
+                       "time."
+                    << std::endl;
+          exit_app = true;
+          return false;
+        }
+        if (c == 'r') {
+          restore_checkpoint_path_.assign(optarg);
+        } else {
+          // The argument has the form CYCLE:FILE
+          const char *colon = strchr(optarg, ':');
+          if (!colon || !colon[1]) {
+            std::cerr << "ERROR: Bad format for save-checkpoint argument: `"
+                      << optarg << "' is not of the form CYCLE:FILE.\n";
+            exit_app = true;
+            return false;
+          }
+          std::string cycle_text(optarg, colon - optarg);
+          if (!read_ul_arg(&save_checkpoint_cycle_, "save-checkpoint",
+                           cycle_text.c_str())) {
+            exit_app = true;
+            return false;
+          }
+          save_checkpoint_path_.assign(colon + 1);
+        }
+        break;
+      case 'i':
+        if (!sig_idle_) {
+          std::cerr << "ERROR: This simulation doesn't support idle skipping."
+                    << std::endl;
+          exit_app = true;
+          return false;
+        }
+        if (!read_ul_arg(&idle_skip_max_cycles_, "skip-idle", optarg)) {
+          exit_app = true;
+          return false;
+        }
+        break;
       case 'h':
         PrintHelp();
         exit_app = true;
@@ -160,6 +338,35 @@ bool VerilatorSimCtrl::ParseCommandArgs(int argc, char **argv, bool &exit_app) {
     }
   }
 
+  if (trace_window_ || trace_trigger_armed_) {
+    if (trace_window_ && trace_trigger_armed_) {
+      std::cerr << "ERROR: --trace-window and --trace-trigger cannot be used "
+                   "together."
+                << std::endl;
+      exit_app = true;
+      return false;
+    }
+    if (trace_window_ && trace_end_cycle_ &&
+        trace_end_cycle_ <= trace_start_cycle_) {
+      std::cerr << "ERROR: The trace window ends before it starts."
+                << std::endl;
+      exit_app = true;
+      return false;
+    }
+    if (trace_history_cycles_ && !tracer_.canHoldHistory()) {
+      std::cerr << "ERROR: Keeping trace history before a trigger needs a VCD "
+                   "trace, but this simulation writes FST."
+                << std::endl;
+      exit_app = true;
+      return false;
+    }
+    // The window or trigger decides when tracing starts, even if --trace was
+    // passed as well (to choose the file name).
+    tracing_enabled_ = false;
+    tracing_enabled_changed_ = false;
+    tracing_ever_enabled_ = false;
+  }
+
   // Pass args to verilator
   Verilated::commandArgs(argc, argv);
 
@@ -185,6 +392,14 @@ void VerilatorSimCtrl::RunSimulation() {
               << std::endl
               << "$ kill -USR1 " << getpid() << std::endl;
   }
+  // Load the checkpoint before the extensions' pre-exec methods so that
+  // anything they set up applies to the restored state. Extensions that did
+  // their setup earlier (like loading memory images while parsing arguments)
+  // do it again in SimCtrlExtension::RestoreState().
+  if (!restore_checkpoint_path_.empty() && !RestoreCheckpoint()) {
+    simulation_success_ = false;
+    return;
+  }
   // Call all extension pre-exec methods
   for (auto it = extension_array_.begin(); it != extension_array_.end(); ++it) {
     (*it)->PreExec();
@@ -198,7 +413,11 @@ void VerilatorSimCtrl::RunSimulation() {
   // Print simulation speed info
   PrintStatistics();
   // Print helper message for tracing
-  if (TracingEverEnabled()) {
+  if (trace_trigger_armed_) {
+    std::cout << std::endl
+              << "The trace trigger never fired, so no trace was written."
+              << std::endl;
+  } else if (TracingEverEnabled()) {
     std::cout << std::endl
               << "You can view the simulation traces by calling" << std::endl
               << "$ gtkwave " << GetTraceFileName() << std::endl;
@@ -229,6 +448,7 @@ void VerilatorSimCtrl::RegisterExtension(SimCtrlExtension *ext) {
 VerilatorSimCtrl::VerilatorSimCtrl()
     : top_(nullptr),
       time_(0),
+      time_at_start_(0),
 #ifdef VM_TRACE_FMT_FST
       trace_file_path_("sim.fst"),
 #else
@@ -243,7 +463,28 @@ VerilatorSimCtrl::VerilatorSimCtrl()
       request_stop_(false),
       simulation_success_(true),
       tracer_(VerilatedTracer()),
-      term_after_cycles_(0) {
+      trace_depth_(99),
+      trace_window_(false),
+      trace_start_cycle_(0),
+      trace_end_cycle_(0),
+      trace_trigger_armed_(false),
+      trace_triggered_(false),
+      trace_history_cycles_(0),
+      trace_after_trigger_cycles_(0),
+      next_history_segment_cycle_(0),
+      term_after_cycles_(0),
+      sig_idle_(nullptr),
+      sig_idle_max_skip_(nullptr),
+      idle_skip_max_cycles_(0),
+      idle_skip_vetoed_(false),
+      skipped_cycles_(0),
+      untaken_skipped_cycles_(0),
+#ifdef VM_SAVABLE
+      checkpoint_possible_(true),
+#else
+      checkpoint_possible_(false),
+#endif
+      save_checkpoint_cycle_(0) {
 }
 
 void VerilatorSimCtrl::RegisterSignalHandler() {
@@ -279,11 +520,37 @@ void VerilatorSimCtrl::PrintHelp() const {
   if (tracing_possible_) {
     std::cout << "-t|--trace\n"
                  "   --trace=FILE\n"
-                 "  Write a trace file from the start\n\n";
+                 "  Write a trace file from the start\n\n"
+                 "--trace-depth=N\n"
+                 "  Only trace N levels of the design hierarchy\n\n"
+                 "--trace-scope=SCOPE[:LEVELS]\n"
+                 "  Only trace the given scope (like TOP.tb.u_dut), to LEVELS\n"
+                 "  levels below it (0 or not given means all levels). Use\n"
+                 "  this more than once to trace several scopes.\n\n"
+                 "--trace-window=START[:END]\n"
+                 "  Trace from cycle START until cycle END (or the end of the\n"
+                 "  simulation)\n\n"
+                 "--trace-trigger=HISTORY[:CYCLES]\n"
+                 "  Trace from a trigger fired by the design for CYCLES\n"
+                 "  cycles (or until the end of the simulation). If HISTORY\n"
+                 "  is not zero, also keep at least HISTORY cycles before\n"
+                 "  the trigger in memory and write them out (VCD only).\n\n";
   }
   std::cout << "-c|--term-after-cycles=N\n"
-               "  Terminate simulation after N cycles. 0 means no timeout.\n\n"
-               "-h|--help\n"
+               "  Terminate simulation after N cycles. 0 means no timeout.\n\n";
+  if (checkpoint_possible_) {
+    std::cout << "--save-checkpoint=CYCLE:FILE\n"
+                 "  Write a checkpoint to FILE at the start of cycle CYCLE\n\n"
+                 "--restore-checkpoint=FILE\n"
+                 "  Start the simulation from the checkpoint in FILE\n\n";
+  }
+  if (sig_idle_) {
+    std::cout << "--skip-idle=N\n"
+                 "  While the design is idle, advance time by up to N cycles\n"
+                 "  at once without evaluating it. 0 (the default) disables\n"
+                 "  skipping.\n\n";
+  }
+  std::cout << "-h|--help\n"
                "  Show help\n\n"
                "All arguments are passed to the design and can be used "
                "in the design, e.g. by DPI modules.\n\n";
@@ -301,6 +568,34 @@ bool VerilatorSimCtrl::TraceOn() {
   return tracing_enabled_;
 }
 
+void VerilatorSimCtrl::TriggerTrace() { trace_triggered_ = true; }
+
+void VerilatorSimCtrl::KeepDpiState(const std::string &key, void *state,
+                                    size_t size) {
+  auto restored = restored_dpi_states_.find(key);
+  if (restored != restored_dpi_states_.end()) {
+    if (restored->second.size() == size) {
+      memcpy(state, restored->second.data(), size);
+      std::cout << "Restored the state of DPI context " << key << std::endl;
+    } else {
+      std::cerr << "WARNING: Not restoring the state of DPI context " << key
+                << ", which has changed size since the checkpoint was saved."
+                << std::endl;
+    }
+    restored_dpi_states_.erase(restored);
+  }
+  dpi_states_[key] = std::make_pair(state, size);
+}
+
+void VerilatorSimCtrl::ForgetDpiState(const void *state) {
+  for (auto it = dpi_states_.begin(); it != dpi_states_.end(); ++it) {
+    if (it->second.first == state) {
+      dpi_states_.erase(it);
+      return;
+    }
+  }
+}
+
 bool VerilatorSimCtrl::TraceOff() {
   if (tracing_enabled_) {
     tracing_enabled_changed_ = true;
@@ -309,15 +604,215 @@ bool VerilatorSimCtrl::TraceOff() {
   return tracing_enabled_;
 }
 
+void VerilatorSimCtrl::UpdateTraceWindow() {
+  unsigned long cycle = time_ / 2;
+
+  if (trace_trigger_armed_) {
+    if (trace_triggered_) {
+      trace_trigger_armed_ = false;
+      std::cout << "Trace trigger fired at cycle " << cycle << "."
+                << std::endl;
+      if (trace_history_cycles_) {
+        trace_history_cycles_ = 0;
+        if (!tracer_.commitHistory()) {
+          std::cerr << "ERROR: Failed to write the trace history to "
+                    << GetTraceFileName() << "." << std::endl;
+        }
+      } else {
+        TraceOn();
+      }
+      if (trace_after_trigger_cycles_) {
+        trace_end_cycle_ = cycle + trace_after_trigger_cycles_;
+      }
+    } else if (trace_history_cycles_ &&
+               cycle >= next_history_segment_cycle_) {
+      tracer_.nextHistorySegment();
+      next_history_segment_cycle_ = cycle + trace_history_cycles_;
+    }
+  }
+
+  if (trace_window_ && cycle == trace_start_cycle_) {
+    TraceOn();
+  }
+  if (trace_end_cycle_ && cycle == trace_end_cycle_) {
+    TraceOff();
+  }
+}
+
+unsigned long VerilatorSimCtrl::IdleCyclesToSkip(
+    unsigned long start_reset_cycle, unsigned long end_reset_cycle) const {
+  // We only skip from the start of a cycle (time_ is incremented twice per
+  // cycle), and only if the design says it is idle.
+  if (!idle_skip_max_cycles_ || (time_ & 1) || !*sig_idle_ ||
+      idle_skip_vetoed_) {
+    return 0;
+  }
+
+  unsigned long cycle = time_ / 2;
+  unsigned long skip = idle_skip_max_cycles_;
+  if (sig_idle_max_skip_) {
+    skip = std::min(skip, (unsigned long)*sig_idle_max_skip_);
+  }
+
+  // Stop at any cycle where we need to do something (and don't skip at all if
+  // that's this cycle)
+  auto stop_at = [&](unsigned long event_cycle) {
+    if (event_cycle >= cycle) {
+      skip = std::min(skip, event_cycle - cycle);
+    }
+  };
+  stop_at(start_reset_cycle);
+  stop_at(end_reset_cycle);
+  if (!save_checkpoint_path_.empty()) {
+    stop_at(save_checkpoint_cycle_);
+  }
+  if (term_after_cycles_) {
+    stop_at(term_after_cycles_);
+  }
+  if (trace_trigger_armed_) {
+    if (trace_triggered_) {
+      return 0;
+    }
+    if (trace_history_cycles_) {
+      stop_at(next_history_segment_cycle_);
+    }
+  }
+  if (trace_window_) {
+    stop_at(trace_start_cycle_);
+  }
+  if (trace_end_cycle_) {
+    stop_at(trace_end_cycle_);
+  }
+
+  for (auto it = extension_array_.begin(); it != extension_array_.end(); ++it) {
+    skip = std::min(skip, (*it)->MaxIdleSkip(time_));
+  }
+  return skip;
+}
+
+bool VerilatorSimCtrl::SaveCheckpoint() {
+#ifdef VM_SAVABLE
+  VerilatedSave os;
+  os.open(save_checkpoint_path_.c_str());
+  if (!os.isOpen()) {
+    std::cerr << "ERROR: Cannot open `" << save_checkpoint_path_
+              << "' to write a checkpoint." << std::endl;
+    return false;
+  }
+
+  uint64_t time = time_;
+  uint32_t num_extensions = extension_array_.size();
+  os << time << num_extensions;
+  top_->save(os);
+  for (auto it = extension_array_.begin(); it != extension_array_.end(); ++it) {
+    if (!(*it)->SaveState(os)) {
+      std::cerr << "ERROR: Failed to save the state of an extension."
+                << std::endl;
+      return false;
+    }
+  }
+
+  // DPI contexts that haven't been created again since a restore still have
+  // their state in restored_dpi_states_. Pass that on too.
+  uint32_t num_dpi_states = dpi_states_.size() + restored_dpi_states_.size();
+  os << num_dpi_states;
+  for (const auto &pr : dpi_states_) {
+    std::string key = pr.first;
+    uint32_t size = pr.second.second;
+    os << key << size;
+    os.write(pr.second.first, size);
+  }
+  for (const auto &pr : restored_dpi_states_) {
+    std::string key = pr.first;
+    uint32_t size = pr.second.size();
+    os << key << size;
+    os.write(pr.second.data(), size);
+  }
+  os.close();
+
+  std::cout << "Wrote checkpoint for cycle " << time_ / 2 << " to "
+            << save_checkpoint_path_ << std::endl;
+  return true;
+#else
+  return false;
+#endif
+}
+
+bool VerilatorSimCtrl::RestoreCheckpoint() {
+#ifdef VM_SAVABLE
+  assert(top_ && "Use SetTop() first.");
+
+  VerilatedRestore is;
+  is.open(restore_checkpoint_path_.c_str());
+  if (!is.isOpen()) {
+    std::cerr << "ERROR: Cannot open checkpoint `" << restore_checkpoint_path_
+              << "'." << std::endl;
+    return false;
+  }
+
+  uint64_t time;
+  uint32_t num_extensions;
+  is >> time >> num_extensions;
+  if (num_extensions != extension_array_.size()) {
+    std::cerr << "ERROR: Checkpoint `" << restore_checkpoint_path_
+              << "' was saved with " << num_extensions
+              << " extensions registered, but there are "
+              << extension_array_.size() << " now." << std::endl;
+    return false;
+  }
+
+  // Verilator checks that the model matches the one that saved the state and
+  // stops the simulation if not.
+  top_->restore(is);
+  for (auto it = extension_array_.begin(); it != extension_array_.end(); ++it) {
+    if (!(*it)->RestoreState(is)) {
+      std::cerr << "ERROR: Failed to restore the state of an extension."
+                << std::endl;
+      return false;
+    }
+  }
+
+  // The DPI modules claim their state when they create their contexts again
+  // (see KeepDpiState()).
+  uint32_t num_dpi_states;
+  is >> num_dpi_states;
+  for (uint32_t i = 0; i < num_dpi_states; ++i) {
+    std::string key;
+    uint32_t size;
+    is >> key >> size;
+    std::vector<uint8_t> &state = restored_dpi_states_[key];
+    state.resize(size);
+    is.read(state.data(), size);
+  }
+  is.close();
+
+  time_ = time;
+  std::cout << "Restored checkpoint for cycle " << time_ / 2 << " from "
+            << restore_checkpoint_path_ << std::endl;
+  return true;
+#else
+  return false;
+#endif
+}
+
 void VerilatorSimCtrl::PrintStatistics() const {
-  double speed_hz = time_ / 2 / (GetExecutionTimeMs() / 1000.0);
+  // The speed only counts the cycles that this run evaluated: not the ones
+  // restored from a checkpoint and not the skipped idle cycles.
+  unsigned long executed_cycles =
+      (time_ - time_at_start_) / 2 - skipped_cycles_;
+  double speed_hz = executed_cycles / (GetExecutionTimeMs() / 1000.0);
   double speed_khz = speed_hz / 1000.0;
 
   std::cout << std::endl
             << "Simulation statistics" << std::endl
             << "=====================" << std::endl
-            << "Executed cycles:  " << std::dec << time_ / 2 << std::endl
-            << "Wallclock time:   " << GetExecutionTimeMs() / 1000.0 << " s"
+            << "Simulated cycles: " << std::dec << time_ / 2 << std::endl
+            << "Executed cycles:  " << executed_cycles << std::endl;
+  if (idle_skip_max_cycles_) {
+    std::cout << "Skipped cycles:   " << skipped_cycles_ << " (idle)"
+              << std::endl;
+  }
+  std::cout << "Wallclock time:   " << GetExecutionTimeMs() / 1000.0 << " s"
             << std::endl
             << "Simulation speed: " << speed_hz << " cycles/s "
             << "(" << speed_khz << " kHz)" << std::endl;
@@ -338,7 +833,7 @@ void VerilatorSimCtrl::Run() {
   // We always need to enable this as tracing can be enabled at runtime
   if (tracing_possible_) {
     Verilated::traceEverOn(true);
-    top_->trace(tracer_, 99, 0);
+    top_->trace(tracer_, trace_depth_, 0);
   }
 
   // Evaluate all initial blocks, including the DPI setup routines
@@ -347,16 +842,63 @@ void VerilatorSimCtrl::Run() {
   std::cout << std::endl
             << "Simulation running, end by pressing CTRL-c." << std::endl;
 
-  time_begin_ = std::chrono::steady_clock::now();
-  UnsetReset();
-  Trace();
-
   unsigned long start_reset_cycle_ = initial_reset_delay_cycles_;
   unsigned long end_reset_cycle_ = start_reset_cycle_ + reset_duration_cycles_;
 
+  // time_ is only nonzero here if we restored a checkpoint, which might have
+  // been saved while the reset was asserted.
+  time_begin_ = std::chrono::steady_clock::now();
+  time_at_start_ = time_;
+  if (start_reset_cycle_ < time_ / 2 && time_ / 2 < end_reset_cycle_) {
+    SetReset();
+  } else {
+    UnsetReset();
+  }
+
+  // Start tracing now if the trace window has already started, or start
+  // keeping history for the trace trigger. The first segment of history ends
+  // after trace_history_cycles_ cycles.
+  unsigned long first_cycle = time_ / 2;
+  if (trace_window_ && trace_start_cycle_ <= first_cycle &&
+      (!trace_end_cycle_ || first_cycle < trace_end_cycle_)) {
+    TraceOn();
+  }
+  if (trace_trigger_armed_ && trace_history_cycles_) {
+    std::cout << "Keeping the last " << trace_history_cycles_
+              << " cycles of trace in memory until the trace trigger."
+              << std::endl;
+    tracer_.holdHistory();
+    next_history_segment_cycle_ = first_cycle + trace_history_cycles_;
+    TraceOn();
+  }
+  Trace();
+
   while (1) {
+    // Fast-forward over idle cycles. The cycle after a skip is evaluated as
+    // normal, which gives DPI modules a chance to pass on any new input.
+    unsigned long skip = IdleCyclesToSkip(start_reset_cycle_, end_reset_cycle_);
+    time_ += 2 * skip;
+    skipped_cycles_ += skip;
+    untaken_skipped_cycles_ += skip;
+    // A veto covers the cycle after the one in which it was made.
+    if (!(time_ & 1)) {
+      idle_skip_vetoed_ = false;
+    }
+
     unsigned long cycle_ = time_ / 2;
 
+    if (!(time_ & 1)) {
+      UpdateTraceWindow();
+    }
+
+    if (!save_checkpoint_path_.empty() &&
+        time_ == 2 * save_checkpoint_cycle_) {
+      if (!SaveCheckpoint()) {
+        RequestStop(false);
+        break;
+      }
+    }
+
     if (cycle_ == start_reset_cycle_) {
       SetReset();
     } else if (cycle_ == end_reset_cycle_) {
@@ -6,6 +6,8 @@
 #define OPENTITAN_HW_DV_VERILATOR_SIMUTIL_VERILATOR_CPP_VERILATOR_SIM_CTRL_H_
 
 #include <chrono>
+#include <cstdint>
+#include <map>
 #include <string>
 #include <vector>
 
@@ -38,6 +40,42 @@ class VerilatorSimCtrl {
   void SetTop(VerilatedToplevel *top, CData *sig_clk, CData *sig_rst,
               VerilatorSimCtrlFlags flags = Defaults);
 
+  /**
+   * Set a signal from the design that shows it is idle
+   *
+   * The design should set sig_idle to 1 only if evaluating it for more clock
+   * cycles wouldn't change its state until some input changes: for example,
+   * if all its clocks are gated and no timer is running. Testbenches can AND
+   * in signals from DPI modules to show that they have no pending input.
+   *
+   * If this signal is set and the user passes --skip-idle, the controller
+   * skips over idle stretches without evaluating the design.
+   *
+   * A design that keeps counting while it is idle (like a timer that will
+   * wake it up) can still be skipped over if it passes sig_idle_max_skip.
+   * This gives the largest number of cycles that may be skipped from the
+   * current one. The design then calls the simctrl_take_skipped_cycles DPI
+   * function in each cycle and adds any skipped cycles to its counters.
+   */
+  void SetIdleSignal(CData *sig_idle, IData *sig_idle_max_skip = nullptr);
+
+  /**
+   * Don't skip idle cycles before the next clock cycle
+   *
+   * DPI modules call this (directly or through the simctrl_idle_veto DPI
+   * function) in each clock cycle in which they have input on the way to the
+   * design that the idle signal can't see.
+   */
+  void VetoIdleSkip() { idle_skip_vetoed_ = true; }
+
+  /**
+   * Get the number of cycles skipped since the last call
+   *
+   * This is the implementation of the simctrl_take_skipped_cycles DPI
+   * function (see SetIdleSignal()).
+   */
+  unsigned long TakeSkippedCycles();
+
   /**
    * Setup and run the simulation (all in one)
    *
@@ -111,6 +149,16 @@ class VerilatorSimCtrl {
    */
   void RequestStop(bool simulation_success);
 
+  /**
+   * Fire the trace trigger
+   *
+   * If the user passed --trace-trigger, tracing starts at the next clock
+   * cycle (writing out any history that was kept). Otherwise, this does
+   * nothing. Designs can call this through the simctrl_trace_trigger DPI
+   * function, for example when the CPU reaches a given PC.
+   */
+  void TriggerTrace();
+
   /**
    * Register an extension to be called automatically
    */
@@ -121,12 +169,27 @@ class VerilatorSimCtrl {
    */
   unsigned long GetTime() const { return time_; }
 
+  /**
+   * Keep size bytes at state in checkpoints, under the given key
+   *
+   * If a restored checkpoint has state for the key that hasn't been claimed
+   * yet, it is copied to state first. DPI modules call this through
+   * simctrl_keep_dpi_state() (see sim_ctrl_dpi.h).
+   */
+  void KeepDpiState(const std::string &key, void *state, size_t size);
+
+  /**
+   * Stop keeping the state passed to KeepDpiState()
+   */
+  void ForgetDpiState(const void *state);
+
  private:
   VerilatedToplevel *top_;
   CData *sig_clk_;
   CData *sig_rst_;
   VerilatorSimCtrlFlags flags_;
   unsigned long time_;
+  unsigned long time_at_start_;
   std::string trace_file_path_;
   bool tracing_enabled_;
   bool tracing_enabled_changed_;
@@ -139,8 +202,31 @@ class VerilatorSimCtrl {
   std::chrono::steady_clock::time_point time_begin_;
   std::chrono::steady_clock::time_point time_end_;
   VerilatedTracer tracer_;
+  unsigned long trace_depth_;
+  bool trace_window_;
+  unsigned long trace_start_cycle_;
+  unsigned long trace_end_cycle_;
+  bool trace_trigger_armed_;
+  volatile bool trace_triggered_;
+  unsigned long trace_history_cycles_;
+  unsigned long trace_after_trigger_cycles_;
+  unsigned long next_history_segment_cycle_;
   unsigned long term_after_cycles_;
+  CData *sig_idle_;
+  IData *sig_idle_max_skip_;
+  unsigned long idle_skip_max_cycles_;
+  bool idle_skip_vetoed_;
+  unsigned long skipped_cycles_;
+  unsigned long untaken_skipped_cycles_;
+  bool checkpoint_possible_;
+  unsigned long save_checkpoint_cycle_;
+  std::string save_checkpoint_path_;
+  std::string restore_checkpoint_path_;
   std::vector<SimCtrlExtension *> extension_array_;
+  // The DPI context state that goes into checkpoints (see KeepDpiState()),
+  // and the state from a restored checkpoint that hasn't been claimed yet
+  std::map<std::string, std::pair<void *, size_t>> dpi_states_;
+  std::map<std::string, std::vector<uint8_t>> restored_dpi_states_;
 
   /**
    * Default constructor
@@ -200,6 +286,51 @@ class VerilatorSimCtrl {
    */
   bool TracingPossible() const { return tracing_possible_; }
 
+  /**
+   * Start or stop tracing for --trace-window and --trace-trigger
+   *
+   * This is called at the start of each clock cycle.
+   */
+  void UpdateTraceWindow();
+
+  /**
+   * Get the number of idle cycles that can be skipped at the current time
+   *
+   * This is zero unless idle skipping is enabled, the design is idle and no
+   * DPI module vetoed the skip in the last cycle (see VetoIdleSkip()). It is
+   * also limited by the design (see SetIdleSignal()) and the extensions (see
+   * SimCtrlExtension::MaxIdleSkip()) and never skips past a cycle at which
+   * the controller has something to do, like changing the reset signal.
+   *
+   * @param start_reset_cycle, end_reset_cycle The cycles where the reset is
+   *                                           asserted and deasserted
+   */
+  unsigned long IdleCyclesToSkip(unsigned long start_reset_cycle,
+                                 unsigned long end_reset_cycle) const;
+
+  /**
+   * Write a checkpoint to save_checkpoint_path_
+   *
+   * A checkpoint holds the state of the model, the simulation time, the
+   * state of all registered extensions (see SimCtrlExtension::SaveState())
+   * and the DPI context state passed to KeepDpiState(). Host resources that
+   * DPI modules hold (like sockets and files) are not saved: the modules
+   * create their contexts again after a restore.
+   *
+   * @return true on success
+   */
+  bool SaveCheckpoint();
+
+  /**
+   * Load the checkpoint at restore_checkpoint_path_
+   *
+   * This must be called before the simulation starts running, and with the
+   * same extensions registered as when the checkpoint was saved.
+   *
+   * @return true on success
+   */
+  bool RestoreCheckpoint();
+
   /**
    * Print statistics about the simulation run
    */
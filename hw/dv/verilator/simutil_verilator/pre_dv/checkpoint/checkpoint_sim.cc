@@ -0,0 +1,58 @@
+// Copyright lowRISC contributors (OpenTitan project).
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+
+#include <cstdint>
+#include <iostream>
+
+#include "sim_ctrl_dpi.h"
+#include "verilated_toplevel.h"
+#include "verilator_sim_ctrl.h"
+
+// A DPI context with a counter, which is kept in checkpoints
+struct CheckpointCounter {
+  uint32_t count;
+};
+
+extern "C" void *checkpoint_counter_create(const char *name) {
+  CheckpointCounter *ctx = new CheckpointCounter();
+  simctrl_keep_dpi_state("checkpoint_counter", name, &ctx->count,
+                         sizeof(ctx->count));
+  return ctx;
+}
+
+extern "C" int checkpoint_counter_tick(void *ctx_void) {
+  CheckpointCounter *ctx = static_cast<CheckpointCounter *>(ctx_void);
+  return ++ctx->count;
+}
+
+extern "C" void checkpoint_counter_close(void *ctx_void) {
+  CheckpointCounter *ctx = static_cast<CheckpointCounter *>(ctx_void);
+  simctrl_forget_dpi_state(&ctx->count);
+  delete ctx;
+}
+
+int main(int argc, char **argv) {
+  checkpoint_sim top;
+  VerilatorSimCtrl &simctrl = VerilatorSimCtrl::GetInstance();
+  simctrl.SetTop(&top, &top.IO_CLK, &top.IO_RST_N,
+                 VerilatorSimCtrlFlags::ResetPolarityNegative);
+
+  bool exit_app = false;
+  int ret_code = simctrl.ParseCommandArgs(argc, argv, exit_app);
+  if (exit_app) {
+    return ret_code;
+  }
+
+  std::cout << "Simulation" << std::endl
+            << "==================" << std::endl
+            << std::endl;
+
+  simctrl.RunSimulation();
+
+  if (!simctrl.WasSimulationSuccessful()) {
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,57 @@
+// Copyright lowRISC contributors (OpenTitan project).
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+
+// Smoke test for checkpoints (see --save-checkpoint and --restore-checkpoint). A counter in a DPI
+// context, which is kept in checkpoints like the context state of the DPI modules in hw/dv/dpi,
+// must agree with a counter in the model, whether or not the simulation started from a checkpoint.
+module checkpoint_sim (
+  input IO_CLK,
+  input IO_RST_N
+);
+  import "DPI-C" function chandle checkpoint_counter_create(input string name);
+  import "DPI-C" function int checkpoint_counter_tick(input chandle ctx);
+  import "DPI-C" function void checkpoint_counter_close(input chandle ctx);
+  import "DPI-C" pure function longint simctrl_run_id();
+
+  localparam int unsigned Cycles = 300;
+
+  chandle ctx;
+  longint ctx_run_id;
+
+  function automatic void initialize();
+    ctx = checkpoint_counter_create("counter0");
+    ctx_run_id = simctrl_run_id();
+  endfunction
+
+  initial begin
+    initialize();
+  end
+
+  final begin
+    if (ctx_run_id == simctrl_run_id()) checkpoint_counter_close(ctx);
+  end
+
+  int unsigned cycle_q;
+
+  always @(posedge IO_CLK or negedge IO_RST_N) begin
+    if (!IO_RST_N) begin
+      cycle_q <= '0;
+    end else begin : count_cycle
+      int unsigned count;
+      // Like the DPI modules, create the context again if it comes from a restored checkpoint.
+      if (ctx_run_id != simctrl_run_id()) begin
+        initialize();
+      end
+      count = checkpoint_counter_tick(ctx);
+      if (count != cycle_q + 1) begin
+        $fatal(1, "Cycle %0d: the DPI counter is at %0d", cycle_q, count);
+      end
+      cycle_q <= cycle_q + 1;
+      if (cycle_q + 1 == Cycles) begin
+        $display("PASS: counted to %0d", count);
+        $finish();
+      end
+    end
+  end
+endmodule
@@ -0,0 +1,59 @@
+#!/bin/bash
+# Copyright lowRISC contributors (OpenTitan project).
+# Licensed under the Apache License, Version 2.0, see LICENSE for details.
+# SPDX-License-Identifier: Apache-2.0
+
+# Runs the checkpoint pre-dv testbench (builds the simulation, runs it once to
+# save a checkpoint and once more from the checkpoint, and checks that both
+# runs passed)
+
+fail() {
+    echo >&2 "PRE-DV FAILURE: $*"
+    exit 1
+}
+
+set -o pipefail
+
+SCRIPT_DIR="$(dirname "$(readlink -e "${BASH_SOURCE[0]}")")"
+UTIL_DIR="$(readlink -e "$SCRIPT_DIR/../../../../../../util")" || \
+  fail "Can't find OpenTitan util dir"
+
+source "$UTIL_DIR/build_consts.sh"
+
+(cd $REPO_TOP || exit;
+ fusesoc --cores-root=. run --target=sim --setup --build \
+         lowrisc:dv_verilator:checkpoint_sim || fail "HW Sim build failed")
+
+SIM=$REPO_TOP/build/lowrisc_dv_verilator_checkpoint_sim_0/sim-verilator/Vcheckpoint_sim
+
+WORK_DIR=`mktemp -d`
+readonly WORK_DIR
+# shellcheck disable=SC2064 # The WORK_DIR tempdir path should not change
+trap "rm -rf $WORK_DIR" EXIT
+
+# run_sim LOG ARGS... runs the simulation and checks that it passed
+run_sim() {
+  local log="$1"
+  shift
+  timeout 5s $SIM "$@" | tee "$log"
+  local status=$?
+  if [ $status -eq 124 ]; then
+    fail "Simulation timeout"
+  fi
+  if [ $status -ne 0 ]; then
+    fail "Simulator run failed"
+  fi
+  grep -q "^PASS:" "$log" || fail "Simulation didn't pass"
+}
+
+run_sim "$WORK_DIR/save.log" --save-checkpoint="150:$WORK_DIR/cp.bin"
+grep -q "Wrote checkpoint for cycle 150" "$WORK_DIR/save.log" || \
+  fail "No checkpoint was saved"
+
+run_sim "$WORK_DIR/restore.log" --restore-checkpoint="$WORK_DIR/cp.bin"
+grep -q "Restored checkpoint for cycle 150" "$WORK_DIR/restore.log" || \
+  fail "The checkpoint wasn't restored"
+grep -q "Restored the state of DPI context checkpoint_counter.counter0" \
+  "$WORK_DIR/restore.log" || fail "The DPI context state wasn't restored"
+
+echo "PRE-DV PASS"
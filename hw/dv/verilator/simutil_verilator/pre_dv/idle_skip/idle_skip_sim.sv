@@ -0,0 +1,90 @@
+// Copyright lowRISC contributors (OpenTitan project).
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+
+// Checks that the simulation controller skips idle cycles (see --skip-idle), and that it doesn't
+// skip after a cycle in which the idle signal was low or a DPI module vetoed the skip. Skips must
+// also be no longer than idle_max_skip_o, and simctrl_take_skipped_cycles must report them.
+module idle_skip_sim (
+  input               IO_CLK,
+  input               IO_RST_N,
+  output logic        idle_o,
+  output logic [31:0] idle_max_skip_o
+);
+  import "DPI-C" function void simctrl_idle_veto();
+  import "DPI-C" function longint unsigned simctrl_take_skipped_cycles();
+
+  // The design is busy for BusyCycles (evaluated) cycles and then idle for IdleCycles, with a veto
+  // in each of the cycles from VetoStart to VetoEnd - 1.
+  localparam int unsigned BusyCycles = 100;
+  localparam int unsigned IdleCycles = 200;
+  localparam int unsigned VetoStart = BusyCycles + 50;
+  localparam int unsigned VetoEnd = VetoStart + 10;
+  // The longest skip that the design allows
+  localparam int unsigned MaxSkip = 30;
+
+  assign idle_max_skip_o = MaxSkip;
+
+  int unsigned     cycle_q;
+  logic            vetoed_q;
+  longint unsigned last_time_q;
+  longint unsigned period_q;
+  longint unsigned skipped_q;
+
+  always @(posedge IO_CLK or negedge IO_RST_N) begin
+    if (!IO_RST_N) begin
+      cycle_q <= '0;
+      vetoed_q <= 1'b0;
+      last_time_q <= '0;
+      period_q <= '0;
+      skipped_q <= '0;
+      idle_o <= 1'b0;
+    end else begin : check_cycle
+      longint unsigned now;
+      longint unsigned gap;
+      longint unsigned reported;
+      now = $time;
+      gap = now - last_time_q;
+      reported = simctrl_take_skipped_cycles();
+      last_time_q <= now;
+      cycle_q <= cycle_q + 1;
+
+      // The gap since the last evaluated cycle is a clock period unless the controller skipped.
+      // It may only skip if the design was idle and nothing vetoed at the last cycle.
+      if (cycle_q == 1) begin
+        period_q <= gap;
+      end else if (cycle_q > 1) begin
+        if (!idle_o || vetoed_q) begin
+          if (gap != period_q) begin
+            $fatal(1, "Cycle %0d: skipped although busy or vetoed (gap %0d, period %0d)",
+                   cycle_q, gap, period_q);
+          end
+        end else begin
+          if (gap <= period_q) begin
+            $fatal(1, "Cycle %0d: didn't skip although idle (gap %0d)", cycle_q, gap);
+          end
+          if (gap / period_q - 1 > MaxSkip) begin
+            $fatal(1, "Cycle %0d: skipped more than %0d cycles (gap %0d)", cycle_q, MaxSkip, gap);
+          end
+          skipped_q <= skipped_q + gap / period_q - 1;
+        end
+        if (period_q != 0 && reported != gap / period_q - 1) begin
+          $fatal(1, "Cycle %0d: %0d skipped cycles reported for a gap of %0d", cycle_q, reported,
+                 gap);
+        end
+      end
+
+      idle_o <= cycle_q + 1 >= BusyCycles;
+      vetoed_q <= 1'b0;
+      if (cycle_q >= VetoStart && cycle_q < VetoEnd) begin
+        simctrl_idle_veto();
+        vetoed_q <= 1'b1;
+      end
+
+      if (cycle_q == BusyCycles + IdleCycles) begin
+        $display("PASS: skipped %0d cycles", skipped_q);
+        $finish();
+      end
+    end
+  end
+endmodule
@@ -0,0 +1,48 @@
+#!/bin/bash
+# Copyright lowRISC contributors (OpenTitan project).
+# Licensed under the Apache License, Version 2.0, see LICENSE for details.
+# SPDX-License-Identifier: Apache-2.0
+
+# Runs the idle skipping pre-dv testbench (builds the simulation, runs it with
+# --skip-idle and checks that it passed)
+
+fail() {
+    echo >&2 "PRE-DV FAILURE: $*"
+    exit 1
+}
+
+set -o pipefail
+
+SCRIPT_DIR="$(dirname "$(readlink -e "${BASH_SOURCE[0]}")")"
+UTIL_DIR="$(readlink -e "$SCRIPT_DIR/../../../../../../util")" || \
+  fail "Can't find OpenTitan util dir"
+
+source "$UTIL_DIR/build_consts.sh"
+
+(cd $REPO_TOP || exit;
+ fusesoc --cores-root=. run --target=sim --setup --build \
+         lowrisc:dv_verilator:idle_skip_sim || fail "HW Sim build failed")
+
+RUN_LOG=`mktemp`
+readonly RUN_LOG
+# shellcheck disable=SC2064 # The RUN_LOG tempfile path should not change
+trap "rm -rf $RUN_LOG" EXIT
+
+timeout 5s \
+  $REPO_TOP/build/lowrisc_dv_verilator_idle_skip_sim_0/sim-verilator/Vidle_skip_sim \
+  --skip-idle=1000 | tee $RUN_LOG
+STATUS=$?
+
+if [ $STATUS -eq 124 ]; then
+  fail "Simulation timeout"
+fi
+
+if [ $STATUS -ne 0 ]; then
+  fail "Simulator run failed"
+fi
+
+if grep -q "^PASS: skipped [1-9]" $RUN_LOG; then
+  echo "PRE-DV PASS"
+else
+  fail "Simulator didn't skip idle cycles"
+fi
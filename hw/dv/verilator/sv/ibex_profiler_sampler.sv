@@ -0,0 +1,93 @@
+// Copyright lowRISC contributors (OpenTitan project).
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+
+// The design side of the IbexProfiler simulation extension
+// (hw/dv/verilator/cpp/ibex_profiler.h)
+//
+// This watches the RVFI retirement port of an Ibex core. It remembers the PC of
+// the last retired instruction, which the profiler reads when it takes a
+// sample, and reports calls and returns so that the profiler can keep a shadow
+// call stack. Nothing is reported until the profiler enables the sampler, so
+// an instance costs almost nothing when profiling is off.
+//
+// A call is a JAL or JALR that writes the link register (x1) or the first
+// instruction of a trap handler. A return is a JALR through x1 that doesn't
+// link, or an MRET.
+module ibex_profiler_sampler (
+  input logic        clk_i,
+  input logic        rst_ni,
+
+  input logic        rvfi_valid,
+  input logic        rvfi_trap,
+  input logic        rvfi_intr,
+  input logic [31:0] rvfi_insn,
+  input logic [31:0] rvfi_pc_rdata,
+  input logic [ 4:0] rvfi_rs1_addr,
+  input logic [ 4:0] rvfi_rd_addr
+);
+
+  import "DPI-C" function void ibex_profiler_call(input int unsigned call_pc);
+  import "DPI-C" function void ibex_profiler_return();
+  import "DPI-C" function void ibex_profiler_reset();
+
+  export "DPI-C" function ibex_profiler_set_enabled;
+  export "DPI-C" function ibex_profiler_get_pc;
+
+  localparam logic [31:0] MRET = 32'h30200073;
+
+  bit          enabled = 1'b0;
+  logic [31:0] last_pc = '0;
+
+  function automatic void ibex_profiler_set_enabled(input bit en);
+    enabled = en;
+  endfunction
+
+  function automatic int ibex_profiler_get_pc();
+    return last_pc;
+  endfunction
+
+  // Is insn a jump (JAL or JALR)? This decodes both the compressed and the
+  // uncompressed encodings, so it doesn't matter which of them RVFI reports.
+  function automatic logic is_jump(logic [31:0] insn);
+    if (insn[1:0] == 2'b11) begin
+      return insn[6:0] inside {7'b1101111, 7'b1100111};
+    end
+    // C.JAL (RV32 only), then C.JR and C.JALR
+    return (insn[1:0] == 2'b01 && insn[15:13] == 3'b001) ||
+           (insn[1:0] == 2'b10 && insn[15:13] == 3'b100 && insn[6:2] == '0 &&
+            insn[11:7] != '0);
+  endfunction
+
+  always_ff @(posedge clk_i) begin
+    if (enabled && rst_ni && rvfi_valid) begin
+      // rvfi_intr marks the first instruction of a trap handler, so the trap
+      // was taken "from" the last instruction that retired before it.
+      if (rvfi_intr) begin
+        ibex_profiler_call(last_pc);
+      end
+
+      if (!rvfi_trap) begin
+        if (rvfi_insn == MRET) begin
+          ibex_profiler_return();
+        end else if (is_jump(rvfi_insn)) begin
+          if (rvfi_rd_addr == 5'd1) begin
+            ibex_profiler_call(rvfi_pc_rdata);
+          end else if (rvfi_rd_addr == '0 && rvfi_rs1_addr == 5'd1) begin
+            ibex_profiler_return();
+          end
+        end
+      end
+
+      last_pc <= rvfi_pc_rdata;
+    end
+  end
+
+  // Forget the call stack when the core is reset.
+  always @(negedge rst_ni) begin
+    if (enabled) begin
+      ibex_profiler_reset();
+    end
+  end
+
+endmodule
@@ -0,0 +1,109 @@
+#!/usr/bin/env python3
+# Copyright lowRISC contributors (OpenTitan project).
+# Licensed under the Apache License, Version 2.0, see LICENSE for details.
+# SPDX-License-Identifier: Apache-2.0
+"""Measure Verilator simulation speed against the number of threads
+
+For each thread count, this builds //hw:verilator with --threads set to that
+count, runs it for a fixed number of cycles and reads the simulation speed
+that VerilatorSimCtrl prints at the end of the run. Arguments after "--" are
+passed to the simulation and should load the images for a fixed test, for
+example:
+
+  ./hw/dv/verilator/thread_bench.py --threads 1,2,4,8 -- \\
+      --meminit=rom,<test_rom>.39.scr.vmem --meminit=otp,<otp>.vmem
+
+This must be run from the top of the repository.
+"""
+
+import argparse
+import os
+import re
+import shutil
+import subprocess
+import sys
+import tempfile
+from typing import List, Optional
+
+_BAZEL = './bazelisk.sh'
+_TARGET = '//hw:verilator_bin'
+_SPEED_RE = re.compile(r'^Simulation speed: *([0-9.e+]+) cycles/s',
+                       re.MULTILINE)
+
+
+def _options_flag(threads: int) -> str:
+    return '--//hw:verilator_options=--threads,{}'.format(threads)
+
+
+def build(threads: int, dest_dir: str) -> str:
+    '''Build the simulation with the given thread count
+
+    Returns the path of a copy of the binary in dest_dir (the Bazel output is
+    overwritten when we build for the next thread count).
+    '''
+    flag = _options_flag(threads)
+    subprocess.run([_BAZEL, 'build', flag, _TARGET], check=True)
+    files = subprocess.run([_BAZEL, 'cquery', flag, '--output=files', _TARGET],
+                           check=True, stdout=subprocess.PIPE,
+                           universal_newlines=True).stdout.split()
+    if len(files) != 1:
+        raise RuntimeError('Expected one output file from {}, got {}.'
+                           .format(_TARGET, files))
+
+    dest = os.path.join(dest_dir, 'sim_threads{}'.format(threads))
+    shutil.copy(files[0], dest)
+    return dest
+
+
+def run(binary: str, cycles: int, sim_args: List[str]) -> float:
+    '''Run a simulation binary and return its speed in cycles/s'''
+    cmd = [binary, '--term-after-cycles={}'.format(cycles)] + sim_args
+    out = subprocess.run(cmd, check=False, stdout=subprocess.PIPE,
+                         stderr=subprocess.STDOUT,
+                         universal_newlines=True).stdout
+    match = _SPEED_RE.search(out)
+    if match is None:
+        raise RuntimeError('No simulation speed in the output of {!r}.'
+                           .format(' '.join(cmd)))
+    return float(match.group(1))
+
+
+def main(argv: Optional[List[str]] = None) -> int:
+    parser = argparse.ArgumentParser(
+        description=__doc__,
+        formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('--threads', default='1,2,4,8',
+                        help='Comma-separated list of thread counts to try')
+    parser.add_argument('--cycles', type=int, default=2000000,
+                        help='Number of cycles to simulate for each run')
+    parser.add_argument('--repeat', type=int, default=1,
+                        help='Number of runs for each thread count (the '
+                        'fastest is reported)')
+    parser.add_argument('sim_args', nargs='*',
+                        help='Arguments for the simulation (after "--")')
+    args = parser.parse_args(argv)
+
+    try:
+        counts = [int(t) for t in args.threads.split(',')]
+    except ValueError:
+        print('Bad thread count list: {!r}'.format(args.threads),
+              file=sys.stderr)
+        return 1
+
+    results = []
+    with tempfile.TemporaryDirectory() as tmpdir:
+        for threads in counts:
+            binary = build(threads, tmpdir)
+            speed = max(run(binary, args.cycles, args.sim_args)
+                        for _ in range(args.repeat))
+            results.append((threads, speed))
+
+    base = results[0][1]
+    print('{:>8} {:>14} {:>8}'.format('threads', 'cycles/s', 'speedup'))
+    for threads, speed in results:
+        print('{:>8} {:>14.1f} {:>7.2f}x'.format(threads, speed, speed / base))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
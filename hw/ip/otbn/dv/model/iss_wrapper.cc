@@ -4,6 +4,7 @@
 
 #include "iss_wrapper.h"
 
+#include <algorithm>
 #include <cassert>
 #include <cstring>
 #include <fcntl.h>
@@ -17,9 +18,11 @@
 #include <regex>
 #include <signal.h>
 #include <sstream>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/wait.h>
 
+#include "otbn_iss.h"
 #include "otbn_trace_checker.h"
 
 // Guard class to safely delete C strings
@@ -105,6 +108,254 @@ struct TmpDir {
   }
 };
 
+// The layout of the header of the shared-memory channel. This must match
+// shm_channel.py in the otbnsim directory, which also documents the format.
+// Everything in the channel is little-endian and we assume that the host is
+// too.
+struct IssChannelHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t cmd_off, cmd_size;
+  uint32_t rsp_off, rsp_size;
+  uint32_t imem_off, imem_words;
+  uint32_t dmem_off, dmem_words;
+  uint32_t cmd_wr, cmd_rd;
+  uint32_t rsp_wr, rsp_rd;
+};
+
+static const uint32_t kChannelMagic = 0x4f54424e;
+static const uint32_t kChannelVersion = 3;
+static const uint32_t kCmdRingSize = 4096;
+static const uint32_t kRspRingSize = 65536;
+
+// Command and response frame kinds
+enum {
+  kCmdText = 1,
+  kCmdStep = 2,
+  kCmdLoadI = 3,
+  kCmdLoadD = 4,
+  kCmdDumpD = 5,
+  kCmdStepBatch = 6,
+  kCmdRewind = 7,
+};
+enum {
+  kRspEnd = 0,
+  kRspLine = 1,
+  kRspExtReg = 2,
+  kRspCycle = 3,
+  kRspTrace = 4,
+};
+
+// Response frame flags
+enum {
+  // The payload carries on in the next frame
+  kRspFlagMore = 1,
+};
+
+// The bytes that the child writes to its pipe after a command: all the
+// response frames are in the ring, or the ring needs emptying first.
+enum {
+  kDoorbellDone = 1,
+  kDoorbellFull = 2,
+};
+
+// IDs of external registers in EXT_REG frames (matching EXT_REG_IDS in
+// shm_channel.py)
+enum {
+  kExtRegStatus = 0,
+  kExtRegInsnCnt = 1,
+  kExtRegErrBits = 2,
+  kExtRegStopPc = 3,
+  kExtRegRndReq = 4,
+  kExtRegWipeStart = 5,
+};
+
+// A mapped file holding the shared-memory channel. The indices in the header
+// are only ever touched between ringing the doorbell on the pipe and getting
+// the reply, so the pipe syscalls order our accesses with the child's.
+struct IssChannel {
+  IssChannel(const std::string &path, uint32_t imem_words,
+             uint32_t dmem_words);
+  ~IssChannel();
+
+  // Append a frame to the command ring
+  void PutCommand(uint16_t kind, const std::string &payload);
+
+  // Take the next frame from the response ring, filling in *kind and *flags
+  // and appending its payload to *payload. Returns false if the ring is
+  // empty.
+  bool GetResponse(uint16_t *kind, uint16_t *flags, std::string *payload);
+
+  // Fill the IMEM or DMEM region
+  void WriteMem(bool is_imem, const Ecc32MemArea::EccWords &words);
+
+  // Read the DMEM region
+  Ecc32MemArea::EccWords ReadDmem() const;
+
+ private:
+  void RingRead(uint32_t off, uint32_t size, uint32_t pos, void *dst,
+                uint32_t len) const;
+  void RingWrite(uint32_t off, uint32_t size, uint32_t pos, const void *src,
+                 uint32_t len);
+
+  uint8_t *base_;
+  size_t len_;
+  IssChannelHeader *hdr_;
+};
+
+static uint32_t round_up_4(uint32_t x) { return (x + 3) & ~3u; }
+
+IssChannel::IssChannel(const std::string &path, uint32_t imem_words,
+                       uint32_t dmem_words) {
+  uint32_t cmd_off = round_up_4(sizeof(IssChannelHeader));
+  uint32_t rsp_off = cmd_off + kCmdRingSize;
+  uint32_t imem_off = rsp_off + kRspRingSize;
+  uint32_t dmem_off = imem_off + round_up_4(5 * imem_words);
+  len_ = dmem_off + round_up_4(5 * dmem_words);
+
+  int fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+  if (fd < 0) {
+    std::ostringstream oss;
+    oss << "Cannot create ISS channel at '" << path << "': " << strerror(errno);
+    throw std::runtime_error(oss.str());
+  }
+  if (ftruncate(fd, len_) != 0) {
+    std::ostringstream oss;
+    oss << "Cannot resize ISS channel at '" << path
+        << "': " << strerror(errno);
+    close(fd);
+    throw std::runtime_error(oss.str());
+  }
+  void *mapping =
+      mmap(nullptr, len_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED) {
+    std::ostringstream oss;
+    oss << "Cannot map ISS channel at '" << path << "': " << strerror(errno);
+    throw std::runtime_error(oss.str());
+  }
+
+  base_ = static_cast<uint8_t *>(mapping);
+  hdr_ = reinterpret_cast<IssChannelHeader *>(base_);
+
+  hdr_->magic = kChannelMagic;
+  hdr_->version = kChannelVersion;
+  hdr_->cmd_off = cmd_off;
+  hdr_->cmd_size = kCmdRingSize;
+  hdr_->rsp_off = rsp_off;
+  hdr_->rsp_size = kRspRingSize;
+  hdr_->imem_off = imem_off;
+  hdr_->imem_words = imem_words;
+  hdr_->dmem_off = dmem_off;
+  hdr_->dmem_words = dmem_words;
+  hdr_->cmd_wr = hdr_->cmd_rd = 0;
+  hdr_->rsp_wr = hdr_->rsp_rd = 0;
+}
+
+IssChannel::~IssChannel() { munmap(base_, len_); }
+
+void IssChannel::RingRead(uint32_t off, uint32_t size, uint32_t pos, void *dst,
+                          uint32_t len) const {
+  uint32_t start = pos & (size - 1);
+  uint32_t first = std::min(len, size - start);
+  memcpy(dst, base_ + off + start, first);
+  memcpy(static_cast<uint8_t *>(dst) + first, base_ + off, len - first);
+}
+
+void IssChannel::RingWrite(uint32_t off, uint32_t size, uint32_t pos,
+                           const void *src, uint32_t len) {
+  uint32_t start = pos & (size - 1);
+  uint32_t first = std::min(len, size - start);
+  memcpy(base_ + off + start, src, first);
+  memcpy(base_ + off, static_cast<const uint8_t *>(src) + first, len - first);
+}
+
+void IssChannel::PutCommand(uint16_t kind, const std::string &payload) {
+  uint32_t len = payload.size();
+  uint32_t padded = round_up_4(len);
+  uint32_t used = hdr_->cmd_wr - hdr_->cmd_rd;
+  if (used + 8 + padded > hdr_->cmd_size) {
+    std::ostringstream oss;
+    oss << "Command of " << len << " bytes does not fit in the ISS channel.";
+    throw std::runtime_error(oss.str());
+  }
+
+  uint8_t frame_hdr[8] = {0};
+  memcpy(frame_hdr, &kind, 2);
+  memcpy(frame_hdr + 4, &len, 4);
+  static const uint8_t zeros[4] = {0};
+
+  uint32_t wr = hdr_->cmd_wr;
+  RingWrite(hdr_->cmd_off, hdr_->cmd_size, wr, frame_hdr, 8);
+  RingWrite(hdr_->cmd_off, hdr_->cmd_size, wr + 8, payload.data(), len);
+  RingWrite(hdr_->cmd_off, hdr_->cmd_size, wr + 8 + len, zeros, padded - len);
+  hdr_->cmd_wr = wr + 8 + padded;
+}
+
+bool IssChannel::GetResponse(uint16_t *kind, uint16_t *flags,
+                             std::string *payload) {
+  uint32_t rd = hdr_->rsp_rd;
+  if (hdr_->rsp_wr - rd < 8)
+    return false;
+
+  uint8_t frame_hdr[8];
+  RingRead(hdr_->rsp_off, hdr_->rsp_size, rd, frame_hdr, 8);
+  uint32_t len;
+  memcpy(kind, frame_hdr, 2);
+  memcpy(flags, frame_hdr + 2, 2);
+  memcpy(&len, frame_hdr + 4, 4);
+  if (len > hdr_->rsp_wr - rd - 8) {
+    throw std::runtime_error("Truncated frame in ISS response ring.");
+  }
+
+  size_t old_size = payload->size();
+  payload->resize(old_size + len);
+  RingRead(hdr_->rsp_off, hdr_->rsp_size, rd + 8, &(*payload)[old_size],
+           len);
+  hdr_->rsp_rd = rd + 8 + round_up_4(len);
+  return true;
+}
+
+void IssChannel::WriteMem(bool is_imem, const Ecc32MemArea::EccWords &words) {
+  uint32_t off = is_imem ? hdr_->imem_off : hdr_->dmem_off;
+  uint32_t num_words = is_imem ? hdr_->imem_words : hdr_->dmem_words;
+  if (words.size() != num_words) {
+    std::ostringstream oss;
+    oss << "Cannot send " << words.size() << " words to a " << num_words
+        << " word " << (is_imem ? "IMEM" : "DMEM") << " region.";
+    throw std::runtime_error(oss.str());
+  }
+
+  uint8_t *dst_words = base_ + off;
+  uint8_t *dst_vld = dst_words + 4 * num_words;
+  for (uint32_t i = 0; i < num_words; ++i) {
+    uint32_t w32 = words[i].second;
+    memcpy(dst_words + 4 * i, &w32, 4);
+    dst_vld[i] = words[i].first ? 1 : 0;
+  }
+}
+
+Ecc32MemArea::EccWords IssChannel::ReadDmem() const {
+  uint32_t num_words = hdr_->dmem_words;
+  const uint8_t *src_words = base_ + hdr_->dmem_off;
+  const uint8_t *src_vld = src_words + 4 * num_words;
+
+  Ecc32MemArea::EccWords ret;
+  ret.reserve(num_words);
+  for (uint32_t i = 0; i < num_words; ++i) {
+    if (src_vld[i] > 1) {
+      std::ostringstream oss;
+      oss << "DMEM word " << i << " from ISS had a validity byte with value "
+          << (int)src_vld[i] << "; not 0 or 1.";
+      throw std::runtime_error(oss.str());
+    }
+    uint32_t w32;
+    memcpy(&w32, src_words + 4 * i, 4);
+    ret.push_back(std::make_pair(src_vld[i] == 1, w32));
+  }
+  return ret;
+}
+
 // Find the top of the OpenTitan repository
 //
 // If REPO_TOP is defined, use that. Otherwise, this will only work if we're
@@ -202,6 +453,31 @@ static std::string find_otbn_model() {
   return std::string(abs_path.get());
 }
 
+// Return true if the OTBN_ISS environment variable asks for the in-process
+// C++ ISS (see otbn_iss.h) instead of a subprocess.
+static bool use_native_iss() {
+  const char *iss = getenv("OTBN_ISS");
+  return iss && !strcmp(iss, "native");
+}
+
+// Get the command line to run the ISS. By default, this runs the Python model
+// with python3. The interpreter can be overridden with the OTBN_ISS_PYTHON
+// environment variable (to use PyPy, for example). Alternatively, OTBN_ISS can
+// name some other ISS executable, which must speak the same protocol as
+// stepped.py and produce the same trace (or be "native": see
+// use_native_iss()).
+static std::vector<std::string> get_iss_command() {
+  const char *iss = getenv("OTBN_ISS");
+  if (iss && *iss)
+    return {iss};
+
+  const char *python = getenv("OTBN_ISS_PYTHON");
+  if (!python || !*python)
+    python = "python3";
+
+  return {"/usr/bin/env", python, "-u", find_otbn_model()};
+}
+
 // Read 8 hex characters from str as a uint32_t.
 static uint32_t read_hex_32(const char *str) {
   char buf[9];
@@ -235,28 +511,127 @@ static void read_ext_reg(const std::string &reg_name,
   }
 }
 
-// A specialized version of read_ext_reg that updates a boolean flag
-// (assuming that the ISS will always signal the register as having
-// value 0 or 1). Prints a message to stderr and returns false on
-// error.
-static bool read_ext_flag(const std::string &reg_name,
-                          const std::vector<std::string> &lines, bool *dest) {
+// Update a boolean flag from an EXT_REG frame (assuming that the ISS will
+// always signal the register as having value 0 or 1). Prints a message to
+// stderr and returns false on error.
+static bool set_ext_flag(const char *reg_name, uint32_t value, bool *dest) {
   assert(dest);
 
-  uint32_t dest32 = *dest ? 1 : 0;
-  read_ext_reg(reg_name, lines, &dest32);
-
-  if (dest32 > 1) {
+  if (value > 1) {
     std::cerr << "ERROR: Unexpected update to " << reg_name << " with value 0x"
-              << std::hex << dest32 << std::dec
+              << std::hex << value << std::dec
               << " when we expected a boolean flag.";
     return false;
   }
 
-  *dest = dest32 != 0;
+  *dest = value != 0;
+  return true;
+}
+
+// Apply the update from an EXT_REG frame to regs. Returns false (having
+// printed a message to stderr) if the value doesn't fit.
+static bool apply_ext_reg(uint32_t id, uint32_t value, MirroredRegs *regs) {
+  assert(regs);
+
+  switch (id) {
+    case kExtRegStatus:
+      regs->status = value;
+      break;
+    case kExtRegInsnCnt:
+      regs->insn_cnt = value;
+      break;
+    case kExtRegErrBits:
+      regs->err_bits = value;
+      break;
+    case kExtRegStopPc:
+      regs->stop_pc = value;
+      break;
+    case kExtRegRndReq:
+      return set_ext_flag("RND_REQ", value, &regs->rnd_req);
+    case kExtRegWipeStart:
+      return set_ext_flag("WIPE_START", value, &regs->wipe_start);
+    default:
+      break;
+  }
   return true;
 }
 
+// Parse the payload of an EXT_REG frame
+static std::pair<uint32_t, uint32_t> parse_ext_reg(const std::string &rsp) {
+  if (rsp.size() != 8) {
+    throw std::runtime_error("Malformed EXT_REG frame from ISS.");
+  }
+  std::pair<uint32_t, uint32_t> ret;
+  memcpy(&ret.first, rsp.data(), 4);
+  memcpy(&ret.second, rsp.data() + 4, 4);
+  return ret;
+}
+
+// Decode the payload of a TRACE frame (see write_trace in shm_channel.py) into
+// *record, which should be empty. Raises a runtime_error if the payload is
+// malformed.
+static void decode_trace_record(const std::string &rsp,
+                                OtbnTraceRecord *record) {
+  const size_t hdr_len = 28;
+  if (rsp.size() < hdr_len) {
+    throw std::runtime_error("Malformed TRACE frame from ISS.");
+  }
+
+  const uint8_t *data = reinterpret_cast<const uint8_t *>(rsp.data());
+  uint16_t num_writes;
+  uint32_t insn_addr, insn_bits;
+  memcpy(&num_writes, data + 2, 2);
+  memcpy(&insn_addr, data + 4, 4);
+  memcpy(&insn_bits, data + 8, 4);
+  uint8_t trace_type = data[0], flags = data[1];
+  if (trace_type < OtbnTraceRecord::Stall ||
+      trace_type > OtbnTraceRecord::WipeComplete) {
+    throw std::runtime_error("Bad record type in TRACE frame from ISS.");
+  }
+  record->set_header((OtbnTraceRecord::trace_type_t)trace_type, flags & 1,
+                     flags & 2, insn_addr, insn_bits);
+  record->set_mnemonic(reinterpret_cast<const char *>(data + 12),
+                       strnlen(reinterpret_cast<const char *>(data + 12),
+                               kOtbnTraceMnemonicLen));
+
+  size_t pos = hdr_len;
+  OtbnTraceValue value;
+  for (unsigned i = 0; i < num_writes; ++i) {
+    if (rsp.size() < pos + 4) {
+      throw std::runtime_error("Truncated TRACE frame from ISS.");
+    }
+    unsigned loc = data[pos];
+    value.num_words = data[pos + 1];
+    bool unknown = data[pos + 2] != 0;
+    pos += 4;
+
+    if (value.num_words > kOtbnTraceMaxWords ||
+        rsp.size() < pos + 4 * value.num_words) {
+      throw std::runtime_error("Truncated TRACE frame from ISS.");
+    }
+    memcpy(value.bits, data + pos, 4 * value.num_words);
+    for (unsigned j = 0; j < value.num_words; ++j) {
+      value.xbits[j] = unknown ? ~0u : 0;
+    }
+    pos += 4 * value.num_words;
+
+    if (!record->add_write(loc, value)) {
+      std::ostringstream oss;
+      oss << "Bad location " << loc << " in TRACE frame from ISS.";
+      throw std::runtime_error(oss.str());
+    }
+  }
+}
+
+// Read the batch size from the OTBN_ISS_BATCH_CYCLES environment variable. A
+// missing or unparseable value disables batching.
+static uint32_t get_batch_cycles() {
+  const char *str = getenv("OTBN_ISS_BATCH_CYCLES");
+  if (!str)
+    return 0;
+  return strtoul(str, nullptr, 0);
+}
+
 void MirroredRegs::reset() {
   status = 0x04;
   insn_cnt = 0;
@@ -266,8 +641,27 @@ void MirroredRegs::reset() {
   wipe_start = false;
 }
 
-ISSWrapper::ISSWrapper() : tmpdir(new TmpDir()) {
-  std::string model_path(find_otbn_model());
+ISSWrapper::ISSWrapper(uint32_t imem_words, uint32_t dmem_words)
+    : tmpdir(new TmpDir()),
+      batch_cycles_(get_batch_cycles()),
+      batch_len_(0),
+      batch_pos_(0),
+      rsp_pending_(false) {
+  if (use_native_iss()) {
+    // There's no child process, so nothing to batch either.
+    native_.reset(new OtbnIss(imem_words, dmem_words));
+    batch_cycles_ = 0;
+    child_pid = -1;
+    child_write_file = child_read_file = nullptr;
+    return;
+  }
+
+  std::vector<std::string> iss_command(get_iss_command());
+  std::vector<char *> iss_argv;
+  for (std::string &arg : iss_command) {
+    iss_argv.push_back(&arg[0]);
+  }
+  iss_argv.push_back(nullptr);
 
   // We want two pipes: one for writing to the child process, and the other for
   // reading from it. We set the O_CLOEXEC flag so that the child process will
@@ -315,8 +709,10 @@ ISSWrapper::ISSWrapper() : tmpdir(new TmpDir()) {
       abort();
     }
     // Finally, exec the ISS
-    execl("/usr/bin/env", "/usr/bin/env", "python3", "-u", model_path.c_str(),
-          NULL);
+    execvp(iss_argv[0], iss_argv.data());
+    std::cerr << "Failed to run ISS (" << iss_argv[0]
+              << "): " << strerror(errno) << "\n";
+    abort();
   }
 
   // We are the parent process and pid is the PID of the child. Close the pipe
@@ -335,9 +731,19 @@ ISSWrapper::ISSWrapper() : tmpdir(new TmpDir()) {
   // valid). Add an assertion to make sure nothing weird happens.
   assert(child_write_file);
   assert(child_read_file);
+
+  // Set up the shared-memory channel and tell the child to switch to it.
+  std::string channel_path = make_tmp_path("channel");
+  std::unique_ptr<IssChannel> channel(
+      new IssChannel(channel_path, imem_words, dmem_words));
+  run_command("attach_shm " + channel_path + "\n", nullptr);
+  channel_ = std::move(channel);
 }
 
 ISSWrapper::~ISSWrapper() {
+  if (native_)
+    return;
+
   // Stop the child process if it's still running. No need to be nice: we'll
   // just send a SIGKILL. Also, no need to check whether it's running first: we
   // can just fire off the signal and ignore whether it worked or not.
@@ -347,20 +753,27 @@ ISSWrapper::~ISSWrapper() {
   waitpid(child_pid, NULL, 0);
 
   // Close the child file handles.
+  channel_.reset();
   fclose(child_write_file);
   fclose(child_read_file);
 }
 
-void ISSWrapper::load_d(const std::string &path) {
-  std::ostringstream oss;
-  oss << "load_d " << path << "\n";
-  run_command(oss.str(), nullptr);
+void ISSWrapper::load_d(const Ecc32MemArea::EccWords &words) {
+  if (native_) {
+    native_->load_d(words);
+    return;
+  }
+  channel_->WriteMem(false, words);
+  run_binary_command(kCmdLoadD, std::string(), nullptr, nullptr, nullptr);
 }
 
-void ISSWrapper::load_i(const std::string &path) {
-  std::ostringstream oss;
-  oss << "load_i " << path << "\n";
-  run_command(oss.str(), nullptr);
+void ISSWrapper::load_i(const Ecc32MemArea::EccWords &words) {
+  if (native_) {
+    native_->load_i(words);
+    return;
+  }
+  channel_->WriteMem(true, words);
+  run_binary_command(kCmdLoadI, std::string(), nullptr, nullptr, nullptr);
 }
 
 void ISSWrapper::add_loop_warp(uint32_t addr, uint32_t from_cnt,
@@ -375,10 +788,11 @@ void ISSWrapper::clear_loop_warps() {
   run_command("clear_loop_warps\n", nullptr);
 }
 
-void ISSWrapper::dump_d(const std::string &path) const {
-  std::ostringstream oss;
-  oss << "dump_d " << path << "\n";
-  run_command(oss.str(), nullptr);
+Ecc32MemArea::EccWords ISSWrapper::dump_d() const {
+  if (native_)
+    return native_->dump_d();
+  run_binary_command(kCmdDumpD, std::string(), nullptr, nullptr, nullptr);
+  return channel_->ReadDmem();
 }
 
 void ISSWrapper::start_operation(command_t command) {
@@ -451,35 +865,53 @@ void ISSWrapper::set_keymgr_value(const std::array<uint32_t, 12> &key0_arr,
 }
 
 int ISSWrapper::step(bool gen_trace) {
-  std::vector<std::string> lines;
+  // Execution has finished if STATUS (which is written when execution ends)
+  // changes to either 0 (IDLE) or 0xff (LOCKED).
+  bool was_stopped = mirrored_.stopped();
+
+  // The ISS sends updates to STATUS, INSN_CNT, ERR_BITS and STOP_PC plus some
+  // associated flags as EXT_REG frames, which we apply to mirrored_. Some of
+  // these flags only get updated around the end of an operation but the
+  // precise timing is slightly fiddly, so it's easiest to just allow updates
+  // whenever they arrive.
+  bool good = true;
+  const OtbnTraceRecord *trace;
+  if (batch_cycles_ > 1) {
+    if (batch_pos_ == batch_len_) {
+      fetch_batch();
+    }
+    const BatchedCycle &cycle = batch_[batch_pos_++];
+    for (const auto &pr : cycle.ext_regs) {
+      good &= apply_ext_reg(pr.first, pr.second, &mirrored_);
+    }
+    trace = &cycle.trace;
+  } else if (native_) {
+    step_trace_.clear();
+    native_ext_regs_.clear();
+    native_->step(&step_trace_, &native_ext_regs_);
+    for (const auto &pr : native_ext_regs_) {
+      good &= apply_ext_reg(pr.first, pr.second, &mirrored_);
+    }
+    trace = &step_trace_;
+  } else {
+    step_trace_.clear();
+    good = run_binary_command(kCmdStep, std::string(), nullptr, &mirrored_,
+                              &step_trace_);
+    trace = &step_trace_;
+  }
 
-  run_command("step\n", &lines);
-  if (gen_trace && lines.size()) {
-    if (!OtbnTraceChecker::get().OnIssTrace(lines)) {
+  if (gen_trace && !trace->empty()) {
+    if (!OtbnTraceChecker::get().OnIssTrace(*trace)) {
       return -1;
     }
   }
 
-  // Try to read STATUS, which is written when execution ends. Execution has
-  // finished if status_ is either 0 (IDLE) or 0xff (LOCKED)
-  bool was_stopped = mirrored_.stopped();
-  read_ext_reg("STATUS", lines, &mirrored_.status);
+  if (!good)
+    return -1;
+
   bool is_stopped = mirrored_.stopped();
   bool done = is_stopped && !was_stopped;
 
-  // Also try to read INSN_CNT, ERR_BITS and STOP_PC plus some associated
-  // flags. Some of these flags only get updated around the end of an operation
-  // but the precise timing is slightly fiddly, so it's easiest to just allow
-  // updates whenever they arrive.
-  read_ext_reg("INSN_CNT", lines, &mirrored_.insn_cnt);
-  read_ext_reg("ERR_BITS", lines, &mirrored_.err_bits);
-  read_ext_reg("STOP_PC", lines, &mirrored_.stop_pc);
-
-  if (!read_ext_flag("RND_REQ", lines, &mirrored_.rnd_req))
-    return -1;
-  if (!read_ext_flag("WIPE_START", lines, &mirrored_.wipe_start))
-    return -1;
-
   return done ? 1 : 0;
 }
 
@@ -533,6 +965,10 @@ void ISSWrapper::reset(bool gen_trace) {
   if (gen_trace)
     OtbnTraceChecker::get().Flush();
 
+  // The reset replaces the ISS state, so there's no need to rewind to the end
+  // of any batch that we haven't finished.
+  batch_len_ = batch_pos_ = 0;
+
   run_command("reset\n", nullptr);
 
   // Reset all mirrored registers.
@@ -734,6 +1170,17 @@ void ISSWrapper::run_command(const std::string &cmd,
   assert(cmd.size() > 0);
   assert(cmd.back() == '\n');
 
+  if (native_) {
+    native_->run_command(cmd.substr(0, cmd.size() - 1), dst);
+    return;
+  }
+
+  if (channel_) {
+    run_binary_command(kCmdText, cmd.substr(0, cmd.size() - 1), dst, nullptr,
+                       nullptr);
+    return;
+  }
+
   fputs(cmd.c_str(), child_write_file);
   fflush(child_write_file);
   if (!read_child_response(dst)) {
@@ -743,3 +1190,147 @@ void ISSWrapper::run_command(const std::string &cmd,
     throw std::runtime_error(oss.str());
   }
 }
+
+void ISSWrapper::transact(uint16_t kind, const std::string &payload) const {
+  assert(channel_);
+
+  channel_->PutCommand(kind, payload);
+  ring_doorbell();
+}
+
+void ISSWrapper::ring_doorbell() const {
+  // Ring the doorbell and wait for the reply. We don't use the FILE streams
+  // here: the child only writes a response byte after we've sent a doorbell,
+  // so there is never anything left in their buffers.
+  char doorbell = 1;
+  if (write(fileno(child_write_file), &doorbell, 1) != 1 ||
+      read(fileno(child_read_file), &doorbell, 1) != 1) {
+    throw std::runtime_error("Failed to run binary command: EOF from ISS.");
+  }
+  rsp_pending_ = (doorbell == kDoorbellFull);
+}
+
+bool ISSWrapper::next_response(uint16_t *kind, std::string *payload) const {
+  payload->clear();
+  for (;;) {
+    uint16_t flags;
+    while (!channel_->GetResponse(kind, &flags, payload)) {
+      // The ring is empty. If the child filled it up before it got to the end
+      // of its response, tell it to carry on. Otherwise, we're done.
+      if (!rsp_pending_) {
+        if (!payload->empty()) {
+          throw std::runtime_error("Truncated frame in ISS response.");
+        }
+        return false;
+      }
+      ring_doorbell();
+    }
+    if (!(flags & kRspFlagMore))
+      return true;
+  }
+}
+
+bool ISSWrapper::run_binary_command(uint16_t kind, const std::string &payload,
+                                    std::vector<std::string> *dst,
+                                    MirroredRegs *regs,
+                                    OtbnTraceRecord *trace) const {
+  // If the RTL hasn't caught up with the ISS, tell the ISS how far it has
+  // really got before sending anything else.
+  if (batch_pos_ < batch_len_) {
+    uint32_t used = batch_pos_;
+    batch_len_ = batch_pos_ = 0;
+    transact(kCmdRewind, std::string(reinterpret_cast<const char *>(&used), 4));
+    read_binary_response(nullptr, nullptr, nullptr);
+  }
+
+  transact(kind, payload);
+  return read_binary_response(dst, regs, trace);
+}
+
+bool ISSWrapper::read_binary_response(std::vector<std::string> *dst,
+                                      MirroredRegs *regs,
+                                      OtbnTraceRecord *trace) const {
+  bool good = true;
+  uint16_t rsp_kind;
+  std::string &rsp = rsp_buf_;
+  while (next_response(&rsp_kind, &rsp)) {
+    switch (rsp_kind) {
+      case kRspEnd:
+        return good;
+
+      case kRspLine:
+        if (dst)
+          dst->push_back(rsp);
+        break;
+
+      case kRspExtReg: {
+        std::pair<uint32_t, uint32_t> ext_reg = parse_ext_reg(rsp);
+        if (regs)
+          good &= apply_ext_reg(ext_reg.first, ext_reg.second, regs);
+      } break;
+
+      case kRspTrace:
+        if (trace)
+          decode_trace_record(rsp, trace);
+        break;
+
+      default: {
+        std::ostringstream oss;
+        oss << "Unexpected response frame kind " << rsp_kind << " from ISS.";
+        throw std::runtime_error(oss.str());
+      }
+    }
+  }
+
+  throw std::runtime_error("ISS response had no END frame.");
+}
+
+void ISSWrapper::fetch_batch() {
+  assert(batch_pos_ == batch_len_);
+  batch_len_ = batch_pos_ = 0;
+
+  transact(kCmdStepBatch,
+           std::string(reinterpret_cast<const char *>(&batch_cycles_), 4));
+
+  if (batch_.empty())
+    batch_.resize(1);
+  batch_[0].trace.clear();
+  batch_[0].ext_regs.clear();
+
+  uint16_t rsp_kind;
+  std::string &rsp = rsp_buf_;
+  while (next_response(&rsp_kind, &rsp)) {
+    BatchedCycle &cycle = batch_[batch_len_];
+    switch (rsp_kind) {
+      case kRspEnd:
+        if (batch_len_ == 0) {
+          throw std::runtime_error("ISS returned an empty batch of steps.");
+        }
+        return;
+
+      case kRspTrace:
+        decode_trace_record(rsp, &cycle.trace);
+        break;
+
+      case kRspExtReg:
+        cycle.ext_regs.push_back(parse_ext_reg(rsp));
+        break;
+
+      case kRspCycle:
+        ++batch_len_;
+        if (batch_.size() == batch_len_)
+          batch_.resize(batch_len_ + 1);
+        batch_[batch_len_].trace.clear();
+        batch_[batch_len_].ext_regs.clear();
+        break;
+
+      default: {
+        std::ostringstream oss;
+        oss << "Unexpected response frame kind " << rsp_kind << " from ISS.";
+        throw std::runtime_error(oss.str());
+      }
+    }
+  }
+
+  throw std::runtime_error("ISS response had no END frame.");
+}
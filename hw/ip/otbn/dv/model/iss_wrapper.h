@@ -12,8 +12,15 @@
 #include <unistd.h>
 #include <vector>
 
-// Forward declaration (the implementation is private in iss_wrapper.cc)
+#include "ecc32_mem_area.h"
+#include "otbn_trace_record.h"
+
+// Forward declarations (the implementations are private in iss_wrapper.cc)
 struct TmpDir;
+struct IssChannel;
+
+// The in-process ISS (see otbn_iss.h)
+class OtbnIss;
 
 // OTBN has some externally visible CSRs that can be updated by hardware
 // (without explicit writes from software). The ISSWrapper mirrors the ISS's
@@ -44,7 +51,26 @@ class MirroredRegs {
   bool stopped() const { return status == 0 || status == 0xff; }
 };
 
-// An object wrapping the ISS subprocess.
+// An object wrapping the ISS subprocess. This is normally the Python model in
+// hw/ip/otbn/dv/otbnsim, but see get_iss_command() in iss_wrapper.cc for how to
+// pick a different interpreter or ISS at runtime.
+//
+// If the OTBN_ISS environment variable is set to "native", there is no
+// subprocess. Instead, commands go to an OtbnIss object: a C++ port of the
+// Python model that runs in-process and produces the same trace.
+//
+// Once the subprocess has started, all commands are sent as binary frames
+// through a shared-memory channel (see otbnsim/shm_channel.py), with just a
+// single byte on each pipe per command. Memory contents are passed through
+// regions of the same shared mapping, rather than through files.
+//
+// If the OTBN_ISS_BATCH_CYCLES environment variable is set to a number N > 1,
+// step() asks the ISS to run ahead by up to N cycles at a time and hands out
+// the buffered results one cycle per call. The ISS stops a batch early at
+// anything that is likely to need an input (a stall, a RND request, the end
+// of an operation and so on). If some other command is sent before the batch
+// has been used up, we first tell the ISS to rewind to the cycle that the RTL
+// has actually reached.
 struct ISSWrapper {
   // A 256-bit unsigned integer value, stored in "LSB order". Thus, words[0]
   // contains the LSB and words[7] contains the MSB.
@@ -54,12 +80,16 @@ struct ISSWrapper {
 
   enum command_t { Execute, DmemWipe, ImemWipe };
 
-  ISSWrapper();
+  // Start the ISS. imem_words and dmem_words give the sizes of the
+  // memories that will be passed with load_i, load_d and dump_d, counted in
+  // 32-bit words (the units of Ecc32MemArea::EccWords).
+  ISSWrapper(uint32_t imem_words, uint32_t dmem_words);
   ~ISSWrapper();
 
-  // Load new contents of DMEM / IMEM
-  void load_d(const std::string &path);
-  void load_i(const std::string &path);
+  // Load new contents of DMEM / IMEM. The number of words must match the
+  // size passed to the constructor.
+  void load_d(const Ecc32MemArea::EccWords &words);
+  void load_i(const Ecc32MemArea::EccWords &words);
 
   // Add a loop warp instruction to the simulation
   void add_loop_warp(uint32_t addr, uint32_t from_cnt, uint32_t to_cnt);
@@ -67,8 +97,8 @@ struct ISSWrapper {
   // Clear any loop warp instructions from the simulation
   void clear_loop_warps();
 
-  // Dump the contents of DMEM to a file
-  void dump_d(const std::string &path) const;
+  // Read the contents of DMEM
+  Ecc32MemArea::EccWords dump_d() const;
 
   // Start an operation (execute, dmem wipe or imem wipe)
   void start_operation(command_t command);
@@ -102,7 +132,8 @@ struct ISSWrapper {
   // Run simulation for a single cycle.
   //
   // If gen_trace is true, pass trace data to the (singleton) OtbnTraceChecker
-  // object.
+  // object. When batching, the trace for each cycle is still passed on when
+  // that cycle is stepped, so the checker sees the same sequence of events.
   //
   // The return code describes the state of the simulation. It is 1 if the
   // simulation just stopped (on ECALL or an architectural error); it is 0 if
@@ -172,9 +203,54 @@ struct ISSWrapper {
   bool read_child_response(std::vector<std::string> *dst) const;
 
   // Send a command to the child and wait for its response. If no
-  // response, raise a runtime_error.
+  // response, raise a runtime_error. Once the channel is attached, cmd is sent
+  // as a text frame.
   void run_command(const std::string &cmd, std::vector<std::string> *dst) const;
 
+  // Send a binary command frame to the child and wait for its response. Any
+  // LINE frames in the response are appended to dst if it is not null. Any
+  // EXT_REG frames update the matching fields of *regs if it is not null. A
+  // TRACE frame is decoded into *trace if it is not null.
+  // Returns false if an EXT_REG frame carried a value that doesn't fit a flag
+  // register (having printed a message to stderr). If the child doesn't
+  // respond, raise a runtime_error.
+  //
+  // If there are unused cycles from a batch of steps, this first rewinds the
+  // ISS to the last cycle that was used.
+  bool run_binary_command(uint16_t kind, const std::string &payload,
+                          std::vector<std::string> *dst, MirroredRegs *regs,
+                          OtbnTraceRecord *trace) const;
+
+  // Read response frames from the channel up to the END frame. The
+  // arguments and return value are as for run_binary_command.
+  bool read_binary_response(std::vector<std::string> *dst,
+                            MirroredRegs *regs, OtbnTraceRecord *trace) const;
+
+  // Put a command frame in the channel, ring the doorbell and wait for the
+  // child to finish writing its response (or to fill the response ring). If
+  // the child doesn't respond, raise a runtime_error.
+  void transact(uint16_t kind, const std::string &payload) const;
+
+  // Write a doorbell byte to the child and wait for its reply, setting
+  // rsp_pending_ if the reply says that the response ring is full.
+  void ring_doorbell() const;
+
+  // Get the next response frame from the channel, joining up frames that
+  // were split to fit in the ring. If the ring is empty and the child has
+  // more to say, tell it to carry on first. Returns false if the response has
+  // no more frames.
+  bool next_response(uint16_t *kind, std::string *payload) const;
+
+  // Ask the ISS for a new batch of steps and fill in batch_ with the results.
+  void fetch_batch();
+
+  // The results of a single cycle in a batch of steps: a trace record and
+  // (id, value) pairs from EXT_REG frames.
+  struct BatchedCycle {
+    OtbnTraceRecord trace;
+    std::vector<std::pair<uint32_t, uint32_t>> ext_regs;
+  };
+
   pid_t child_pid;
   FILE *child_write_file;
   FILE *child_read_file;
@@ -182,8 +258,38 @@ struct ISSWrapper {
   // A temporary directory for communicating with the child process
   std::unique_ptr<TmpDir> tmpdir;
 
+  // The shared-memory channel to the child process
+  std::unique_ptr<IssChannel> channel_;
+
+  // The trace record from the most recent (unbatched) step
+  OtbnTraceRecord step_trace_;
+
+  // A buffer for the payload of response frames (kept to reuse its storage)
+  mutable std::string rsp_buf_;
+
+  // The maximum number of cycles to step in a batch. Batching is disabled if
+  // this is at most 1.
+  uint32_t batch_cycles_;
+
+  // Results from the current batch of steps. Only the first batch_len_
+  // entries are valid (the rest are kept to reuse their storage) and
+  // batch_pos_ is the index of the next one to use.
+  mutable std::vector<BatchedCycle> batch_;
+  mutable size_t batch_len_;
+  mutable size_t batch_pos_;
+
+  // True if the child filled the response ring and is waiting for us to empty
+  // it before it writes the rest of its response
+  mutable bool rsp_pending_;
+
   // Mirrored copies of registers
   MirroredRegs mirrored_;
+
+  // The in-process ISS if OTBN_ISS is "native" (in which case there is no
+  // child process or channel), together with a buffer for the EXT_REG
+  // updates from each of its steps
+  std::unique_ptr<OtbnIss> native_;
+  std::vector<std::pair<uint32_t, uint32_t>> native_ext_regs_;
 };
 
 #endif  // OPENTITAN_HW_IP_OTBN_DV_MODEL_ISS_WRAPPER_H_
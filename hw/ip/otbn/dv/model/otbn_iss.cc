@@ -0,0 +1,5665 @@
+// Copyright lowRISC contributors (OpenTitan project).
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+
+#include "otbn_iss.h"
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstring>
+#include <map>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+
+// This is a port of the Python model in hw/ip/otbn/dv/otbnsim. The structure
+// deliberately follows the Python code (most of the structs below have the
+// same name as a Python class and their methods have the same names as the
+// Python methods), so that a change to one model can be copied across to the
+// other. Anything that doesn't affect the trace that we send to the RTL
+// testbench (such as the "verbose" trace that the standalone simulator can
+// print) has been left out.
+
+namespace {
+
+typedef unsigned __int128 u128;
+
+const uint32_t kMask32 = 0xffffffff;
+
+// Raise an error in the same places where the Python model would fail an
+// assertion
+#define ISS_ASSERT(cond)                                                 \
+  do {                                                                   \
+    if (!(cond)) {                                                       \
+      throw std::runtime_error("OTBN ISS assertion failed: " #cond);     \
+    }                                                                    \
+  } while (0)
+
+// A 512-bit unsigned integer, stored as four 128-bit limbs with the least
+// significant one first. Arithmetic wraps modulo 2^512. This is wide enough
+// for every value in the Python model (the widest being the 512-bit
+// concatenation used by BN.RSHI), and a negative intermediate result (like
+// a - b in BN.SUB) has all its top bits set, so its bit 256 is the borrow.
+struct Wide {
+  u128 w[4];
+
+  Wide() : w{0, 0, 0, 0} {}
+
+  static Wide from_u64(uint64_t val) {
+    Wide ret;
+    ret.w[0] = val;
+    return ret;
+  }
+
+  static Wide from_u128(u128 val) {
+    Wide ret;
+    ret.w[0] = val;
+    return ret;
+  }
+
+  // 2^n - 1 (n should be at most 512)
+  static Wide ones(unsigned n) {
+    Wide ret;
+    for (unsigned i = 0; i < 4; ++i) {
+      if (n >= 128 * (i + 1)) {
+        ret.w[i] = ~(u128)0;
+      } else if (n > 128 * i) {
+        ret.w[i] = ((u128)1 << (n - 128 * i)) - 1;
+      }
+    }
+    return ret;
+  }
+
+  bool is_zero() const { return !(w[0] | w[1] | w[2] | w[3]); }
+
+  bool bit(unsigned idx) const {
+    return idx < 512 && ((w[idx / 128] >> (idx % 128)) & 1);
+  }
+
+  // The n-bit field starting at bit lsb (n should be at most 64)
+  uint64_t bits(unsigned lsb, unsigned n) const {
+    if (lsb >= 512) {
+      return 0;
+    }
+    unsigned limb = lsb / 128, off = lsb % 128;
+    u128 val = w[limb] >> off;
+    if (off && limb < 3) {
+      val |= w[limb + 1] << (128 - off);
+    }
+    uint64_t mask = n >= 64 ? ~(uint64_t)0 : ((uint64_t)1 << n) - 1;
+    return (uint64_t)val & mask;
+  }
+
+  uint32_t word(unsigned idx) const { return (uint32_t)bits(32 * idx, 32); }
+
+  void set_word(unsigned idx, uint32_t val) {
+    unsigned limb = idx / 4, off = 32 * (idx % 4);
+    w[limb] &= ~((u128)kMask32 << off);
+    w[limb] |= (u128)val << off;
+  }
+
+  Wide masked(unsigned n) const { return *this & ones(n); }
+
+  Wide operator<<(unsigned n) const {
+    Wide ret;
+    if (n >= 512) {
+      return ret;
+    }
+    unsigned limbs = n / 128, off = n % 128;
+    for (unsigned i = limbs; i < 4; ++i) {
+      u128 val = w[i - limbs] << off;
+      if (off && i > limbs) {
+        val |= w[i - limbs - 1] >> (128 - off);
+      }
+      ret.w[i] = val;
+    }
+    return ret;
+  }
+
+  Wide operator>>(unsigned n) const {
+    Wide ret;
+    if (n >= 512) {
+      return ret;
+    }
+    unsigned limbs = n / 128, off = n % 128;
+    for (unsigned i = 0; i + limbs < 4; ++i) {
+      u128 val = w[i + limbs] >> off;
+      if (off && i + limbs + 1 < 4) {
+        val |= w[i + limbs + 1] << (128 - off);
+      }
+      ret.w[i] = val;
+    }
+    return ret;
+  }
+
+  Wide operator&(const Wide &o) const {
+    Wide ret;
+    for (unsigned i = 0; i < 4; ++i)
+      ret.w[i] = w[i] & o.w[i];
+    return ret;
+  }
+
+  Wide operator|(const Wide &o) const {
+    Wide ret;
+    for (unsigned i = 0; i < 4; ++i)
+      ret.w[i] = w[i] | o.w[i];
+    return ret;
+  }
+
+  Wide operator^(const Wide &o) const {
+    Wide ret;
+    for (unsigned i = 0; i < 4; ++i)
+      ret.w[i] = w[i] ^ o.w[i];
+    return ret;
+  }
+
+  Wide operator~() const {
+    Wide ret;
+    for (unsigned i = 0; i < 4; ++i)
+      ret.w[i] = ~w[i];
+    return ret;
+  }
+
+  Wide operator+(const Wide &o) const {
+    Wide ret;
+    u128 carry = 0;
+    for (unsigned i = 0; i < 4; ++i) {
+      u128 part = w[i] + carry;
+      u128 c0 = part < carry;
+      ret.w[i] = part + o.w[i];
+      carry = c0 + (ret.w[i] < part);
+    }
+    return ret;
+  }
+
+  Wide operator-(const Wide &o) const { return *this + ~o + from_u64(1); }
+
+  bool operator==(const Wide &o) const {
+    return w[0] == o.w[0] && w[1] == o.w[1] && w[2] == o.w[2] &&
+           w[3] == o.w[3];
+  }
+  bool operator!=(const Wide &o) const { return !(*this == o); }
+
+  bool operator<(const Wide &o) const {
+    for (int i = 3; i >= 0; --i) {
+      if (w[i] != o.w[i])
+        return w[i] < o.w[i];
+    }
+    return false;
+  }
+  bool operator>=(const Wide &o) const { return !(*this < o); }
+};
+
+typedef std::optional<Wide> OptWide;
+
+const unsigned kNoLoc = ~0u;
+
+// The trace location (see otbn_trace_record.h) for a register with the given
+// name, or kNoLoc if there isn't one.
+unsigned trace_loc(const char *name) {
+  for (unsigned loc = 0; loc < kOtbnTraceNumLocs; ++loc) {
+    if (!strcmp(OtbnTraceRecord::loc_name(loc), name))
+      return loc;
+  }
+  return kNoLoc;
+}
+
+// Format a value like Trace.hex_value in the Python model
+std::string hex_value(const OptWide &value, unsigned width) {
+  char buf[16];
+  if (width == 32) {
+    if (!value)
+      return "0xxxxxxxxx";
+    snprintf(buf, sizeof buf, "0x%08x", value->word(0));
+    return buf;
+  }
+  unsigned num_words = (width + 31) / 32;
+  std::string ret = "0x";
+  for (unsigned idx = num_words; idx > 0; --idx) {
+    if (value) {
+      unsigned lsb = 32 * (idx - 1);
+      int digits = std::min(8u, (width - lsb + 3) / 4);
+      snprintf(buf, sizeof buf, "%0*x", digits, value->word(idx - 1));
+      ret += buf;
+    } else {
+      ret += "xxxxxxxx";
+    }
+    if (idx > 1)
+      ret += "_";
+  }
+  return ret;
+}
+
+// Parse a string as an integer in the same way as Python's int(s, 0). Sets
+// *negative if there was a minus sign and *too_big if the magnitude doesn't
+// fit in 512 bits. Returns false if the string is malformed.
+bool parse_int(const std::string &str, Wide *value, bool *negative,
+               bool *too_big) {
+  size_t pos = 0, end = str.size();
+  while (pos < end && isspace((unsigned char)str[pos]))
+    ++pos;
+  while (end > pos && isspace((unsigned char)str[end - 1]))
+    --end;
+
+  *negative = false;
+  *too_big = false;
+  if (pos < end && (str[pos] == '+' || str[pos] == '-')) {
+    *negative = str[pos] == '-';
+    ++pos;
+  }
+
+  unsigned base = 10;
+  if (end - pos >= 2 && str[pos] == '0') {
+    char pfx = tolower((unsigned char)str[pos + 1]);
+    if (pfx == 'x' || pfx == 'o' || pfx == 'b') {
+      base = pfx == 'x' ? 16 : pfx == 'o' ? 8 : 2;
+      pos += 2;
+      // Python allows an underscore straight after the prefix
+      if (pos < end && str[pos] == '_')
+        ++pos;
+    }
+  }
+  if (pos == end)
+    return false;
+
+  // A decimal number with a leading zero must be all zeros
+  bool leading_zero = base == 10 && str[pos] == '0';
+
+  Wide acc;
+  bool last_underscore = false;
+  for (; pos < end; ++pos) {
+    char c = str[pos];
+    if (c == '_') {
+      if (last_underscore)
+        return false;
+      last_underscore = true;
+      continue;
+    }
+    last_underscore = false;
+
+    unsigned digit;
+    if (isdigit((unsigned char)c)) {
+      digit = c - '0';
+    } else if (isalpha((unsigned char)c)) {
+      digit = 10 + tolower((unsigned char)c) - 'a';
+    } else {
+      return false;
+    }
+    if (digit >= base)
+      return false;
+    if (leading_zero && digit != 0)
+      return false;
+
+    if (acc.w[3] >> 120)
+      *too_big = true;
+    Wide shifted;
+    if (base == 10) {
+      shifted = (acc << 3) + (acc << 1);
+    } else {
+      unsigned shift = base == 16 ? 4 : base == 8 ? 3 : 1;
+      shifted = acc << shift;
+    }
+    acc = shifted + Wide::from_u64(digit);
+  }
+  if (last_underscore)
+    return false;
+
+  *value = acc;
+  return true;
+}
+
+// A CRC-32 (as computed by Python's zlib.crc32) of the bytes in data, starting
+// from state.
+uint32_t crc32_update(uint32_t state, const uint8_t *data, size_t len) {
+  uint32_t crc = ~state;
+  for (size_t i = 0; i < len; ++i) {
+    crc ^= data[i];
+    for (int j = 0; j < 8; ++j)
+      crc = (crc >> 1) ^ (0xedb88320 & -(crc & 1));
+  }
+  return ~crc;
+}
+
+// ---------------------------------------------------------------------------
+// Keccak (used by the KMAC model)
+
+// The Keccak-f[1600] permutation on a 25-lane state
+void keccak_f1600(uint64_t st[25]) {
+  static const uint64_t rc[24] = {
+      0x0000000000000001ULL, 0x0000000000008082ULL, 0x800000000000808aULL,
+      0x8000000080008000ULL, 0x000000000000808bULL, 0x0000000080000001ULL,
+      0x8000000080008081ULL, 0x8000000000008009ULL, 0x000000000000008aULL,
+      0x0000000000000088ULL, 0x0000000080008009ULL, 0x000000008000000aULL,
+      0x000000008000808bULL, 0x800000000000008bULL, 0x8000000000008089ULL,
+      0x8000000000008003ULL, 0x8000000000008002ULL, 0x8000000000000080ULL,
+      0x000000000000800aULL, 0x800000008000000aULL, 0x8000000080008081ULL,
+      0x8000000000008080ULL, 0x0000000080000001ULL, 0x8000000080008008ULL};
+  static const unsigned rotc[24] = {1,  3,  6,  10, 15, 21, 28, 36,
+                                    45, 55, 2,  14, 27, 41, 56, 8,
+                                    25, 43, 62, 18, 39, 61, 20, 44};
+  static const unsigned piln[24] = {10, 7,  11, 17, 18, 3,  5,  16,
+                                    8,  21, 24, 4,  15, 23, 19, 13,
+                                    12, 2,  20, 14, 22, 9,  6,  1};
+  auto rotl = [](uint64_t x, unsigned n) { return (x << n) | (x >> (64 - n)); };
+
+  for (unsigned round = 0; round < 24; ++round) {
+    uint64_t bc[5];
+    for (unsigned i = 0; i < 5; ++i)
+      bc[i] = st[i] ^ st[i + 5] ^ st[i + 10] ^ st[i + 15] ^ st[i + 20];
+    for (unsigned i = 0; i < 5; ++i) {
+      uint64_t t = bc[(i + 4) % 5] ^ rotl(bc[(i + 1) % 5], 1);
+      for (unsigned j = 0; j < 25; j += 5)
+        st[j + i] ^= t;
+    }
+
+    uint64_t t = st[1];
+    for (unsigned i = 0; i < 24; ++i) {
+      unsigned j = piln[i];
+      uint64_t tmp = st[j];
+      st[j] = rotl(t, rotc[i]);
+      t = tmp;
+    }
+
+    for (unsigned j = 0; j < 25; j += 5) {
+      for (unsigned i = 0; i < 5; ++i)
+        bc[i] = st[j + i];
+      for (unsigned i = 0; i < 5; ++i)
+        st[j + i] ^= (~bc[(i + 1) % 5]) & bc[(i + 2) % 5];
+    }
+
+    st[0] ^= rc[round];
+  }
+}
+
+// A Keccak sponge with a byte-aligned rate and domain separation byte. This
+// covers SHA3, SHAKE and (with the right prefix) KMAC.
+struct KeccakSponge {
+  uint64_t st[25];
+  unsigned rate;
+  uint8_t pad;
+  unsigned pos;
+  bool squeezing;
+
+  KeccakSponge(unsigned rate_, uint8_t pad_)
+      : st{}, rate(rate_), pad(pad_), pos(0), squeezing(false) {}
+
+  void xor_byte(unsigned idx, uint8_t byte) {
+    st[idx / 8] ^= (uint64_t)byte << (8 * (idx % 8));
+  }
+
+  uint8_t get_byte(unsigned idx) const {
+    return (uint8_t)(st[idx / 8] >> (8 * (idx % 8)));
+  }
+
+  void absorb(const uint8_t *data, size_t len) {
+    for (size_t i = 0; i < len; ++i) {
+      xor_byte(pos++, data[i]);
+      if (pos == rate) {
+        keccak_f1600(st);
+        pos = 0;
+      }
+    }
+  }
+
+  void absorb(const std::vector<uint8_t> &data) {
+    absorb(data.data(), data.size());
+  }
+
+  void squeeze(uint8_t *out, size_t len) {
+    if (!squeezing) {
+      xor_byte(pos, pad);
+      xor_byte(rate - 1, 0x80);
+      keccak_f1600(st);
+      pos = 0;
+      squeezing = true;
+    }
+    for (size_t i = 0; i < len; ++i) {
+      if (pos == rate) {
+        keccak_f1600(st);
+        pos = 0;
+      }
+      out[i] = get_byte(pos++);
+    }
+  }
+};
+
+// The left_encode function from NIST SP 800-185
+std::vector<uint8_t> left_encode(uint64_t x) {
+  std::vector<uint8_t> bytes;
+  do {
+    bytes.insert(bytes.begin(), (uint8_t)x);
+    x >>= 8;
+  } while (x);
+  bytes.insert(bytes.begin(), (uint8_t)bytes.size());
+  return bytes;
+}
+
+// The right_encode function from NIST SP 800-185
+std::vector<uint8_t> right_encode(uint64_t x) {
+  std::vector<uint8_t> bytes;
+  do {
+    bytes.insert(bytes.begin(), (uint8_t)x);
+    x >>= 8;
+  } while (x);
+  bytes.push_back((uint8_t)bytes.size());
+  return bytes;
+}
+
+// The encode_string function from NIST SP 800-185
+std::vector<uint8_t> encode_string(const std::vector<uint8_t> &str) {
+  std::vector<uint8_t> ret = left_encode(8 * str.size());
+  ret.insert(ret.end(), str.begin(), str.end());
+  return ret;
+}
+
+// Absorb bytepad(data, rate) from NIST SP 800-185
+void absorb_bytepad(KeccakSponge *sponge, const std::vector<uint8_t> &data) {
+  std::vector<uint8_t> padded = left_encode(sponge->rate);
+  padded.insert(padded.end(), data.begin(), data.end());
+  padded.resize((padded.size() + sponge->rate - 1) / sponge->rate *
+                sponge->rate);
+  sponge->absorb(padded);
+}
+
+// ---------------------------------------------------------------------------
+// Bivium (the URND generator, from trivium.py)
+
+// The Python Trivium class, specialised to the Bivium cipher with a partial
+// seed, which is the only configuration that OTBN uses.
+struct Bivium {
+  static const unsigned kStateSize = 177;
+  static const unsigned kPartSeedSize = 32;
+  static const unsigned kLastPartSeedSize = 17;
+  static const unsigned kSeedRounds = 6;
+
+  unsigned output_width;
+  u128 state[2];
+  unsigned seed_counter;
+  bool has_next_state;
+  u128 next_state[2];
+  std::optional<uint32_t> next_seed;
+  Wide ks;
+
+  explicit Bivium(unsigned output_width_)
+      : output_width(output_width_),
+        seed_counter(0),
+        has_next_state(false),
+        next_state{0, 0} {
+    // TRIVIUM_INIT_SEED in trivium.py, truncated to the Bivium state size
+    Wide seed;
+    bool negative, too_big;
+    parse_int("0x82a30c132b5723c5a4cf4743b3c7c32d580f74f1713a", &seed,
+              &negative, &too_big);
+    int_to_regs(seed, state);
+  }
+
+  static void int_to_regs(const Wide &val, u128 regs[2]) {
+    regs[0] = 0;
+    regs[1] = 0;
+    for (unsigned j = 0; j < 93; ++j)
+      regs[0] |= (u128)val.bit(j) << (92 - j);
+    for (unsigned j = 0; j < 84; ++j)
+      regs[1] |= (u128)val.bit(93 + j) << (83 - j);
+  }
+
+  bool seed_done() const { return seed_counter == kSeedRounds; }
+
+  void update() {
+    if (has_next_state)
+      throw std::runtime_error("cannot update more than once per cycle");
+    do_update(state, next_state);
+    has_next_state = true;
+  }
+
+  void seed(uint32_t value) {
+    if (next_seed)
+      throw std::runtime_error("cannot seed more than once per cycle");
+    next_seed = value;
+    if (seed_done())
+      seed_counter = 0;
+  }
+
+  void step() {
+    if (!has_next_state && !next_seed)
+      return;
+    if (has_next_state) {
+      state[0] = next_state[0];
+      state[1] = next_state[1];
+    }
+    if (next_seed) {
+      bool last = seed_counter == kSeedRounds - 1;
+      unsigned start =
+          last ? kStateSize - kLastPartSeedSize : kPartSeedSize * seed_counter;
+      unsigned n = last ? kLastPartSeedSize : kPartSeedSize;
+      inject_partial_seed(*next_seed, start, n);
+      ++seed_counter;
+    }
+    has_next_state = false;
+    next_seed.reset();
+  }
+
+  void inject_partial_seed(uint32_t val, unsigned start, unsigned n) {
+    for (unsigned i = 0; i < n; ++i) {
+      u128 b = (val >> i) & 1;
+      unsigned pos = start + i;
+      unsigned reg = pos < 93 ? 0 : 1;
+      unsigned k = pos < 93 ? 92 - pos : 83 - (pos - 93);
+      state[reg] = (state[reg] & ~((u128)1 << k)) | (b << k);
+    }
+  }
+
+  void do_update(const u128 regs[2], u128 new_regs[2]) {
+    const u128 mask93 = ((u128)1 << 93) - 1;
+    const u128 mask84 = ((u128)1 << 84) - 1;
+    u128 reg1 = regs[0], reg2 = regs[1];
+    Wide ks_int;
+    unsigned processed = 0;
+    while (processed < output_width) {
+      unsigned chunk = std::min(output_width - processed, 64u);
+      u128 mask = ((u128)1 << chunk) - 1;
+      u128 v65 = (reg1 >> 27) & mask;
+      u128 v68 = (reg1 >> 24) & mask;
+      u128 v90 = (reg1 >> 2) & mask;
+      u128 v91 = (reg1 >> 1) & mask;
+      u128 v92 = reg1 & mask;
+      u128 v161 = (reg2 >> 15) & mask;
+      u128 v170 = (reg2 >> 6) & mask;
+      u128 v174 = (reg2 >> 2) & mask;
+      u128 v175 = (reg2 >> 1) & mask;
+      u128 v176 = reg2 & mask;
+      u128 t0 = (v68 ^ (v174 & v175) ^ v161 ^ v176) & mask;
+      u128 t1 = (v170 ^ (v65 ^ v92) ^ (v90 & v91)) & mask;
+      ks_int = ks_int |
+               (Wide::from_u128((v65 ^ v92 ^ v161 ^ v176) & mask) << processed);
+      reg1 = ((reg1 >> chunk) | (t0 << (93 - chunk))) & mask93;
+      reg2 = ((reg2 >> chunk) | (t1 << (84 - chunk))) & mask84;
+      processed += chunk;
+    }
+    ks = ks_int;
+    new_regs[0] = reg1;
+    new_regs[1] = reg2;
+  }
+
+  const Wide &keystream() const { return ks; }
+};
+
+// ---------------------------------------------------------------------------
+// Constants (constants.py)
+
+enum ErrBits : uint32_t {
+  kErrBadDataAddr = 1 << 0,
+  kErrBadInsnAddr = 1 << 1,
+  kErrCallStack = 1 << 2,
+  kErrIllegalInsn = 1 << 3,
+  kErrLoop = 1 << 4,
+  kErrKeyInvalid = 1 << 5,
+  kErrRndRepChkFail = 1 << 6,
+  kErrRndFipsChkFail = 1 << 7,
+  kErrMaiSoftwareError = 1 << 8,
+  kErrImemIntgViolation = 1 << 16,
+  kErrDmemIntgViolation = 1 << 17,
+  kErrRegIntgViolation = 1 << 18,
+  kErrBusIntgViolation = 1 << 19,
+  kErrBadInternalState = 1 << 20,
+  kErrIllegalBusAccess = 1 << 21,
+  kErrLifecycleEscalation = 1 << 22,
+  kErrFatalSoftware = 1 << 23,
+  kErrFatalMask = 0xff0000,
+  kErrMask = 0xff01ff
+};
+
+enum Status : uint32_t {
+  kStatusIdle = 0x00,
+  kStatusBusyExecute = 0x01,
+  kStatusBusySecWipeDmem = 0x02,
+  kStatusBusySecWipeImem = 0x03,
+  kStatusBusySecWipeInt = 0x04,
+  kStatusPaused = 0x05,
+  kStatusLocked = 0xff
+};
+
+// ---------------------------------------------------------------------------
+// Trace entries (trace.py)
+
+// A change to the state, as returned by one of the changes() methods in the
+// Python model. We only keep the changes that appear in the RTL trace
+// (register, flag group and external register writes). As in Python, the
+// value is snapshotted when the list of changes is built.
+struct Change {
+  enum Kind { Reg, Flags, Ext };
+
+  Kind kind;
+  // The register name ("x01", "ACC", "FLAGS0" or "STATUS"). This always
+  // points at a string literal or a name from OtbnTraceRecord::loc_name.
+  const char *name;
+  // The trace location (for Reg and Flags changes) or EXT_REG ID (for Ext
+  // changes, kNoLoc for a register that isn't mirrored)
+  unsigned loc;
+  unsigned width;
+  // The new value (unset if it is unknown). For flag groups, this is the four
+  // flags, with C at bit 0.
+  OptWide value;
+
+  std::string rtl_trace() const {
+    char buf[64];
+    switch (kind) {
+      case Reg:
+        return std::string("> ") + name + ": " + hex_value(value, width);
+      case Flags: {
+        unsigned bits = value->word(0);
+        snprintf(buf, sizeof buf, "> %s: {C: %u, M: %u, L: %u, Z: %u}", name,
+                 bits & 1, (bits >> 1) & 1, (bits >> 2) & 1, (bits >> 3) & 1);
+        return buf;
+      }
+      default:
+        snprintf(buf, sizeof buf, "! otbn.%s: 0x%08x", name, value->word(0));
+        return buf;
+    }
+  }
+
+  // Add this change to a trace record (like the rtl_write() method in Python
+  // and write_trace in shm_channel.py)
+  void add_write(OtbnTraceRecord *record) const {
+    if (kind == Ext)
+      return;
+
+    OtbnTraceValue tv;
+    tv.num_words = (width + 31) / 32;
+    for (unsigned i = 0; i < tv.num_words; ++i) {
+      tv.bits[i] = value ? value->word(i) : 0;
+      tv.xbits[i] = value ? 0 : ~0u;
+    }
+    if (!record->add_write(loc, tv)) {
+      throw std::runtime_error(std::string("No trace location for ") + name);
+    }
+  }
+};
+
+typedef std::vector<Change> Changes;
+
+Change reg_change(const char *name, unsigned loc, unsigned width,
+                  const OptWide &value) {
+  return Change{Change::Reg, name, loc, width, value};
+}
+
+// ---------------------------------------------------------------------------
+// Register files (reg.py and gpr.py)
+
+// The GPR register file, including the call stack behind x1
+struct GPRs {
+  static const unsigned kStackDepth = 8;
+
+  uint32_t regs[32];
+  std::optional<uint32_t> next[32];
+  // A bitmask of the registers in _pending_writes
+  uint32_t pending_writes;
+
+  // The state of the CallStackReg for x1
+  std::vector<uint32_t> stack;
+  bool saw_read;
+  std::optional<uint32_t> x1_next;
+
+  bool call_stack_err;
+
+  GPRs() : regs{}, pending_writes(0), saw_read(false), call_stack_err(false) {}
+
+  uint32_t read_unsigned(unsigned idx) {
+    if (idx == 0)
+      return 0;
+    if (idx == 1) {
+      if (stack.empty()) {
+        call_stack_err = true;
+        return 0;
+      }
+      saw_read = true;
+      return stack.back();
+    }
+    return regs[idx];
+  }
+
+  int64_t read_signed(unsigned idx) { return (int32_t)read_unsigned(idx); }
+
+  void write_unsigned(unsigned idx, uint32_t value) {
+    if (idx == 0)
+      return;
+    if (idx == 1)
+      x1_next = value;
+    else
+      next[idx] = value;
+    pending_writes |= 1u << idx;
+  }
+
+  void write_invalid(unsigned idx) {
+    if (idx == 0)
+      return;
+    if (idx == 1)
+      x1_next.reset();
+    else
+      next[idx].reset();
+    pending_writes |= 1u << idx;
+  }
+
+  void post_insn() {
+    if (x1_next && !saw_read && stack.size() == kStackDepth)
+      call_stack_err = true;
+  }
+
+  uint32_t err_bits() const {
+    return call_stack_err ? uint32_t(kErrCallStack) : 0;
+  }
+
+  void changes(Changes *dst) const {
+    for (unsigned idx = 0; idx < 32; ++idx) {
+      if (!(pending_writes >> idx & 1))
+        continue;
+      const std::optional<uint32_t> &nv = idx == 1 ? x1_next : next[idx];
+      OptWide value;
+      if (nv)
+        value = Wide::from_u64(*nv);
+      unsigned loc = kOtbnTraceLocGpr + idx;
+      dst->push_back(
+          reg_change(OtbnTraceRecord::loc_name(loc), loc, 32, value));
+    }
+  }
+
+  void commit() {
+    for (unsigned idx = 2; idx < 32; ++idx) {
+      if (pending_writes >> idx & 1) {
+        if (next[idx])
+          regs[idx] = *next[idx];
+        next[idx].reset();
+      }
+    }
+    pending_writes = 0;
+    ISS_ASSERT(!call_stack_err);
+
+    if (saw_read) {
+      ISS_ASSERT(!stack.empty());
+      stack.pop_back();
+      saw_read = false;
+    }
+    if (x1_next) {
+      ISS_ASSERT(stack.size() <= kStackDepth);
+      stack.push_back(*x1_next);
+    }
+    x1_next.reset();
+  }
+
+  void abort() {
+    for (unsigned idx = 2; idx < 32; ++idx) {
+      if (pending_writes >> idx & 1)
+        next[idx].reset();
+    }
+    pending_writes = 0;
+    saw_read = false;
+    x1_next.reset();
+    call_stack_err = false;
+  }
+
+  void empty_call_stack() {
+    stack.clear();
+    saw_read = false;
+  }
+
+  void wipe() {
+    empty_call_stack();
+    for (unsigned idx = 2; idx < 32; ++idx)
+      write_invalid(idx);
+  }
+};
+
+// The WDR register file
+struct WDRs {
+  Wide regs[32];
+  OptWide next[32];
+  uint32_t pending_writes;
+
+  WDRs() : pending_writes(0) {}
+
+  const Wide &read_unsigned(unsigned idx) const { return regs[idx]; }
+
+  void write_unsigned(unsigned idx, const Wide &value) {
+    next[idx] = value;
+    pending_writes |= 1u << idx;
+  }
+
+  void changes(Changes *dst) const {
+    for (unsigned idx = 0; idx < 32; ++idx) {
+      if (pending_writes >> idx & 1) {
+        unsigned loc = kOtbnTraceLocWdr + idx;
+        dst->push_back(
+            reg_change(OtbnTraceRecord::loc_name(loc), loc, 256, next[idx]));
+      }
+    }
+  }
+
+  void commit() {
+    for (unsigned idx = 0; idx < 32; ++idx) {
+      if (pending_writes >> idx & 1) {
+        if (next[idx])
+          regs[idx] = *next[idx];
+        next[idx].reset();
+      }
+    }
+    pending_writes = 0;
+  }
+
+  void abort() {
+    for (unsigned idx = 0; idx < 32; ++idx) {
+      if (pending_writes >> idx & 1)
+        next[idx].reset();
+    }
+    pending_writes = 0;
+  }
+
+  void wipe() {
+    for (unsigned idx = 0; idx < 32; ++idx) {
+      next[idx].reset();
+      pending_writes |= 1u << idx;
+    }
+  }
+};
+
+// ---------------------------------------------------------------------------
+// Flags (flags.py)
+
+struct FlagReg {
+  bool C, M, L, Z;
+
+  unsigned read_unsigned() const { return Z << 3 | L << 2 | M << 1 | C; }
+
+  bool get_by_idx(unsigned idx) const {
+    ISS_ASSERT(idx <= 3);
+    return (read_unsigned() >> idx) & 1;
+  }
+
+  static FlagReg from_bits(unsigned value) {
+    return FlagReg{(bool)(value & 1), (bool)(value >> 1 & 1),
+                   (bool)(value >> 2 & 1), (bool)(value >> 3 & 1)};
+  }
+
+  static FlagReg mlz_for_result(bool C, const Wide &result) {
+    return FlagReg{C, result.bit(255), result.bit(0), result.is_zero()};
+  }
+};
+
+struct FlagGroups {
+  FlagReg groups[2];
+  std::optional<FlagReg> new_val[2];
+  bool dirty;
+
+  FlagGroups() : groups{{0, 0, 0, 0}, {0, 0, 0, 0}}, dirty(false) {}
+
+  const FlagReg &operator[](unsigned idx) const { return groups[idx]; }
+
+  void set(unsigned idx, const FlagReg &value) {
+    dirty = true;
+    new_val[idx] = value;
+  }
+
+  void changes(Changes *dst) const {
+    static const char *const names[2] = {"FLAGS0", "FLAGS1"};
+    for (unsigned g = 0; g < 2; ++g) {
+      if (new_val[g]) {
+        dst->push_back(Change{Change::Flags, names[g], kOtbnTraceLocFlags + g,
+                              4, Wide::from_u64(new_val[g]->read_unsigned())});
+      }
+    }
+  }
+
+  void commit() {
+    if (dirty) {
+      for (unsigned g = 0; g < 2; ++g) {
+        if (new_val[g])
+          groups[g] = *new_val[g];
+        new_val[g].reset();
+      }
+    }
+    dirty = false;
+  }
+
+  void abort() {
+    if (dirty) {
+      new_val[0].reset();
+      new_val[1].reset();
+    }
+    dirty = false;
+  }
+
+  unsigned read_unsigned() const {
+    return groups[1].read_unsigned() << 4 | groups[0].read_unsigned();
+  }
+
+  void write_unsigned(unsigned value) {
+    dirty = true;
+    new_val[0] = FlagReg::from_bits(value & 15);
+    new_val[1] = FlagReg::from_bits((value >> 4) & 15);
+  }
+};
+
+// ---------------------------------------------------------------------------
+// External registers (ext_regs.py and edn_client.py)
+
+struct EdnClient {
+  static const unsigned kAccLen = 8;
+  static const unsigned kMaxCdcWait = 5;
+
+  std::optional<std::vector<uint32_t>> acc;
+  std::optional<unsigned> cdc_counter;
+  bool poisoned;
+  bool retry;
+  bool fips_err;
+  bool rep_err;
+  std::optional<uint32_t> last_word;
+
+  EdnClient() { edn_reset(); }
+
+  void request() {
+    if (!acc) {
+      ISS_ASSERT(!cdc_counter);
+      acc.emplace();
+    } else if (poisoned) {
+      retry = true;
+    }
+  }
+
+  void poison() {
+    if (acc) {
+      poisoned = true;
+      retry = false;
+      fips_err = false;
+      rep_err = false;
+    }
+  }
+
+  void forget() { retry = false; }
+
+  void take_word(uint32_t word, bool fips) {
+    if (!acc)
+      return;
+    ISS_ASSERT(acc->size() < kAccLen);
+    ISS_ASSERT(!cdc_counter);
+    fips_err = fips || fips_err;
+    rep_err = (last_word && *last_word == word) || rep_err;
+    acc->push_back(word);
+    last_word = word;
+    if (acc->size() == kAccLen)
+      cdc_counter = 0;
+  }
+
+  void edn_reset() {
+    acc.reset();
+    cdc_counter.reset();
+    poisoned = false;
+    retry = false;
+    fips_err = false;
+    rep_err = false;
+    last_word.reset();
+  }
+
+  // Returns (data, retry, fips_err, rep_err) like cdc_complete in Python
+  void cdc_complete(OptWide *data, bool *retry_out, bool *fips_out,
+                    bool *rep_out) {
+    ISS_ASSERT(acc);
+    ISS_ASSERT(acc->size() == kAccLen);
+    ISS_ASSERT(cdc_counter);
+    ISS_ASSERT(*cdc_counter <= kMaxCdcWait);
+    bool was_poisoned = poisoned;
+    bool was_retry = retry;
+    if (was_poisoned) {
+      data->reset();
+      *fips_out = false;
+      *rep_out = false;
+    } else {
+      Wide value;
+      for (unsigned i = 0; i < kAccLen; ++i)
+        value.set_word(i, (*acc)[i]);
+      *data = value;
+      *fips_out = fips_err;
+      *rep_out = rep_err;
+    }
+    acc.reset();
+    cdc_counter.reset();
+    poisoned = false;
+    retry = false;
+    fips_err = false;
+    rep_err = false;
+    if (was_retry) {
+      ISS_ASSERT(was_poisoned);
+      request();
+    }
+    *retry_out = was_retry;
+  }
+
+  void step() {
+    if (cdc_counter) {
+      ISS_ASSERT(acc && acc->size() == kAccLen);
+      ++*cdc_counter;
+      ISS_ASSERT(*cdc_counter <= kMaxCdcWait);
+    }
+  }
+};
+
+// The external registers that the ISS writes. The Python model has a register
+// for everything in otbn.hjson (plus some extra "flag" registers), but the
+// others are never written by the model, so have no effect on the trace.
+enum ExtReg {
+  kIntrState,
+  kStatus,
+  kErrBits,
+  kInsnCnt,
+  kStopPc,
+  kRndReq,
+  kWipeStart,
+  kNumExtRegs
+};
+
+// An RGReg from ext_regs.py. Each register that the ISS writes has a single
+// field (or, for ERR_BITS, fields that behave like one) and is only ever
+// written by hardware, so we can just track a masked value.
+struct RGReg {
+  const char *name;
+  // The EXT_REG ID for the register in shm_channel.py (or kNoLoc)
+  unsigned ext_id;
+  uint32_t mask;
+  bool double_flopped;
+
+  uint32_t value;
+  uint32_t next_value;
+  // The new_value fields of the pending ExtRegChange objects
+  std::vector<uint32_t> changes;
+  std::vector<uint32_t> next_changes;
+
+  RGReg(const char *name_, unsigned ext_id_, uint32_t mask_,
+        bool double_flopped_, uint32_t reset_value)
+      : name(name_),
+        ext_id(ext_id_),
+        mask(mask_),
+        double_flopped(double_flopped_),
+        value(reset_value),
+        next_value(reset_value) {}
+
+  void write(uint32_t v, bool immediately = false) {
+    next_value = v & mask;
+    bool delayed = double_flopped && !immediately;
+    (delayed ? next_changes : changes).push_back(next_value);
+  }
+
+  void set_bits(uint32_t v) {
+    next_value |= v & mask;
+    (double_flopped ? next_changes : changes).push_back(next_value);
+  }
+
+  uint32_t read() const { return value; }
+
+  void commit() {
+    value = next_value;
+    changes.swap(next_changes);
+    next_changes.clear();
+  }
+
+  void abort() {
+    next_value = value;
+    changes.clear();
+    next_changes.clear();
+  }
+
+  void add_changes(Changes *dst) const {
+    for (uint32_t v : changes)
+      dst->push_back(Change{Change::Ext, name, ext_id, 32, Wide::from_u64(v)});
+  }
+};
+
+struct OTBNExtRegs {
+  std::vector<RGReg> regs;
+  int dirty;
+  EdnClient rnd_client;
+
+  OTBNExtRegs() : dirty(0) {
+    regs.emplace_back("INTR_STATE", kNoLoc, 0x1, false, 0);
+    regs.emplace_back("STATUS", 0, 0xff, true, 0x4);
+    regs.emplace_back("ERR_BITS", 2, 0xff01ff, false, 0);
+    regs.emplace_back("INSN_CNT", 1, kMask32, false, 0);
+    regs.emplace_back("STOP_PC", 3, kMask32, true, 0);
+    regs.emplace_back("RND_REQ", 4, kMask32, false, 0);
+    regs.emplace_back("WIPE_START", 5, kMask32, false, 0);
+  }
+
+  void write(ExtReg reg, uint32_t value, bool immediately = false) {
+    regs[reg].write(value, immediately);
+    dirty = 2;
+  }
+
+  void set_bits(ExtReg reg, uint32_t value) {
+    regs[reg].set_bits(value);
+    dirty = 2;
+  }
+
+  uint32_t read(ExtReg reg) const { return regs[reg].read(); }
+
+  void increment_insn_cnt() {
+    uint32_t cnt = regs[kInsnCnt].value;
+    regs[kInsnCnt].write(cnt == kMask32 ? cnt : cnt + 1);
+  }
+
+  void step() { rnd_client.step(); }
+
+  void changes(Changes *dst) const {
+    if (dirty == 0) {
+      regs[kInsnCnt].add_changes(dst);
+      return;
+    }
+    for (const RGReg &reg : regs)
+      reg.add_changes(dst);
+  }
+
+  void commit() {
+    if (dirty > 0) {
+      for (RGReg &reg : regs)
+        reg.commit();
+      dirty = std::max(0, dirty - 1);
+    } else {
+      regs[kInsnCnt].commit();
+    }
+  }
+
+  void abort() {
+    for (RGReg &reg : regs)
+      reg.abort();
+    dirty = 0;
+  }
+
+  void rnd_request() {
+    rnd_client.request();
+    if (regs[kRndReq].read() == 0) {
+      regs[kRndReq].write(1);
+      dirty = 2;
+    }
+  }
+
+  void rnd_take_word(uint32_t word, bool fips_err) {
+    rnd_client.take_word(word, fips_err);
+  }
+
+  void rnd_reset() {
+    rnd_client.edn_reset();
+    dirty = 2;
+  }
+
+  void rnd_cdc_complete(OptWide *data, bool *fips_err, bool *rep_err) {
+    bool retry;
+    rnd_client.cdc_complete(data, &retry, fips_err, rep_err);
+    if (!retry) {
+      regs[kRndReq].write(0);
+      dirty = 2;
+    }
+  }
+
+  void rnd_poison() { rnd_client.poison(); }
+
+  void rnd_forget() {
+    rnd_client.forget();
+    regs[kRndReq].write(0);
+  }
+};
+
+// ---------------------------------------------------------------------------
+// ISPRs (ispr.py, kmac_ispr.py and mai_ispr.py)
+
+// A DumbISPR of up to 256 bits. Some of the special-purpose ISPRs below
+// extend this with extra behaviour.
+struct DumbISPR {
+  const char *name;
+  unsigned loc;
+  unsigned width;
+  Wide value;
+  OptWide next_value;
+  bool pending_write;
+
+  DumbISPR(const char *name_, unsigned width_)
+      : name(name_),
+        loc(trace_loc(name_)),
+        width(width_),
+        pending_write(false) {}
+
+  void on_start() {
+    value = Wide();
+    next_value.reset();
+  }
+
+  const Wide &read_unsigned() const { return value; }
+
+  void write_unsigned(const Wide &v) {
+    ISS_ASSERT(v < Wide::ones(width) || v == Wide::ones(width));
+    next_value = v;
+    pending_write = true;
+  }
+
+  void write_invalid() {
+    next_value.reset();
+    pending_write = true;
+  }
+
+  void commit() {
+    if (next_value)
+      value = *next_value;
+    next_value.reset();
+    pending_write = false;
+  }
+
+  void abort() {
+    next_value.reset();
+    pending_write = false;
+  }
+
+  void changes(Changes *dst) const {
+    if (pending_write)
+      dst->push_back(reg_change(name, loc, width, next_value));
+  }
+};
+
+struct KmacStatusCSR : DumbISPR {
+  static const unsigned kReadyPos = 0;
+  static const unsigned kRspValidPos = 1;
+  static const unsigned kRspErrorPos = 2;
+  static const unsigned kCtrlErrorPos = 3;
+  static const unsigned kMsgWriteErrorPos = 4;
+  static const uint32_t kW1cMask = 0x1c;
+  static const uint32_t kValueMask = 0x1f;
+
+  uint32_t set_mask;
+  uint32_t clr_mask;
+
+  KmacStatusCSR() : DumbISPR("KMAC_STATUS", 32), set_mask(0), clr_mask(0) {}
+
+  void on_start() {
+    DumbISPR::on_start();
+    set_mask = 0;
+    clr_mask = 0;
+  }
+
+  void write_unsigned(uint32_t v) {
+    DumbISPR::write_unsigned(Wide::from_u64(v));
+    clr_mask |= v & kW1cMask;
+  }
+
+  void hw_set_bit(unsigned bit, bool v) {
+    value.set_word(0, v ? value.word(0) | (1u << bit)
+                        : value.word(0) & ~(1u << bit));
+  }
+
+  void hw_set_ready(bool v) { hw_set_bit(kReadyPos, v); }
+  void hw_set_rsp_valid(bool v) { hw_set_bit(kRspValidPos, v); }
+  void hw_set_rsp_error() { set_mask |= 1u << kRspErrorPos; }
+  void hw_set_ctrl_error() { set_mask |= 1u << kCtrlErrorPos; }
+  void hw_set_msg_write_error() { set_mask |= 1u << kMsgWriteErrorPos; }
+
+  void hw_clr_error_bits() { value.set_word(0, value.word(0) & ~kW1cMask); }
+
+  void end(bool commit) {
+    if (!commit)
+      clr_mask = 0;
+    value = Wide::from_u64(((value.word(0) & ~clr_mask) | set_mask) &
+                           kValueMask);
+    set_mask = 0;
+    clr_mask = 0;
+    next_value.reset();
+    pending_write = false;
+  }
+
+  void commit() { end(true); }
+  void abort() { end(false); }
+};
+
+// KmacCtrlCSR and KmacCfgCSR (which behave in the same way apart from their
+// read value)
+struct KmacCmdCSR {
+  const char *name;
+  unsigned loc;
+  uint32_t mask;
+  uint32_t cur;
+  std::optional<uint32_t> next;
+  uint32_t write_value;
+  bool pending_write;
+
+  KmacCmdCSR(const char *name_, uint32_t mask_)
+      : name(name_), loc(trace_loc(name_)), mask(mask_) {
+    on_start();
+  }
+
+  void on_start() {
+    cur = 0;
+    next.reset();
+    write_value = 0;
+    pending_write = false;
+  }
+
+  void write_unsigned(uint32_t v) {
+    write_value = v;
+    next = v & mask;
+    pending_write = true;
+  }
+
+  void commit() {
+    if (next) {
+      cur = *next;
+      next.reset();
+    }
+    pending_write = false;
+  }
+
+  void abort() {
+    next.reset();
+    pending_write = false;
+  }
+
+  void changes(Changes *dst) const {
+    if (pending_write)
+      dst->push_back(reg_change(name, loc, 32, Wide::from_u64(write_value)));
+  }
+};
+
+struct KmacCtrlCSR : KmacCmdCSR {
+  KmacCtrlCSR() : KmacCmdCSR("KMAC_CTRL", 31) {}
+
+  uint32_t read_unsigned() const { return 0; }
+
+  uint32_t take_cmd() {
+    uint32_t cmd = cur;
+    cur = 0;
+    return cmd;
+  }
+
+  uint32_t peek_pending_cmd() const { return next ? *next : 0; }
+};
+
+struct KmacCfgCSR : KmacCmdCSR {
+  KmacCfgCSR() : KmacCmdCSR("KMAC_CFG", 0x3f003f) {}
+
+  uint32_t read_unsigned() const { return cur & mask; }
+
+  bool get_en_xof() const { return cur & 1; }
+  unsigned get_strength() const { return (cur >> 1) & 7; }
+  unsigned get_mode() const { return (cur >> 4) & 3; }
+  unsigned get_en_xof_inv() const { return (cur >> 16) & 1; }
+  unsigned get_strength_inv() const { return (cur >> 17) & 7; }
+  unsigned get_mode_inv() const { return (cur >> 20) & 3; }
+
+  bool redundancy_valid() const {
+    return get_en_xof_inv() == (~(unsigned)get_en_xof() & 1) &&
+           get_strength_inv() == (~get_strength() & 7) &&
+           get_mode_inv() == (~get_mode() & 3);
+  }
+
+  bool is_written() const { return pending_write; }
+};
+
+struct KmacStrbCSR : DumbISPR {
+  bool written_this_cycle;
+
+  KmacStrbCSR() : DumbISPR("KMAC_STRB", 32), written_this_cycle(false) {}
+
+  void on_start() {
+    DumbISPR::on_start();
+    written_this_cycle = false;
+  }
+
+  void write_unsigned(uint32_t v) {
+    DumbISPR::write_unsigned(Wide::from_u64(v));
+    written_this_cycle = true;
+  }
+
+  bool is_written() const { return written_this_cycle; }
+
+  void commit() {
+    DumbISPR::commit();
+    written_this_cycle = false;
+  }
+
+  void abort() {
+    DumbISPR::abort();
+    written_this_cycle = false;
+  }
+};
+
+struct KmacDataWSR : DumbISPR {
+  std::optional<uint64_t> hw_value;
+  bool written_this_cycle;
+  bool read;
+
+  explicit KmacDataWSR(const char *name_)
+      : DumbISPR(name_, 256), written_this_cycle(false), read(false) {}
+
+  void on_start() {
+    DumbISPR::on_start();
+    hw_value.reset();
+    written_this_cycle = false;
+    read = false;
+  }
+
+  void write_unsigned(const Wide &v) {
+    DumbISPR::write_unsigned(v);
+    written_this_cycle = true;
+  }
+
+  const Wide &read_unsigned() {
+    read = true;
+    return value;
+  }
+
+  void hw_write(uint64_t v) { hw_value = v; }
+
+  const Wide &get_unsigned() const { return value; }
+  bool is_written() const { return written_this_cycle; }
+  bool is_hw_written() const { return hw_value.has_value(); }
+  bool was_read() const { return read; }
+  void clr_read() { read = false; }
+
+  void apply_hw_value() {
+    if (hw_value) {
+      value = (value & ~Wide::ones(64)) | Wide::from_u64(*hw_value);
+    }
+  }
+
+  void end() {
+    next_value.reset();
+    pending_write = false;
+    hw_value.reset();
+    written_this_cycle = false;
+  }
+
+  void commit() {
+    if (next_value)
+      value = *next_value;
+    apply_hw_value();
+    end();
+  }
+
+  void abort() {
+    apply_hw_value();
+    end();
+  }
+};
+
+enum MaiOperation : unsigned {
+  kMaiA2B = 11,
+  kMaiB2A = 16,
+  kMaiSecAdd = 23,
+  kMaiSecAddMod = 12
+};
+
+bool is_mai_operation(unsigned raw) {
+  return raw == kMaiA2B || raw == kMaiB2A || raw == kMaiSecAdd ||
+         raw == kMaiSecAddMod;
+}
+
+struct MaiCtrlCSR : DumbISPR {
+  MaiOperation operation;
+  unsigned raw_op;
+  bool start_bit;
+
+  MaiCtrlCSR() : DumbISPR("MAI_CTRL", 32) { on_start(); }
+
+  void on_start() {
+    DumbISPR::on_start();
+    operation = kMaiA2B;
+    raw_op = kMaiA2B;
+    start_bit = false;
+    value = Wide::from_u64(get_value());
+  }
+
+  uint32_t get_value() const { return (raw_op & 31) << 1 | start_bit; }
+
+  static bool extract_start_bit(uint32_t v) { return v & 1; }
+  static unsigned extract_raw_op(uint32_t v) { return (v >> 1) & 31; }
+
+  void update_start_bit(bool start) {
+    start_bit = start;
+    value = Wide::from_u64(get_value());
+    next_value = value;
+    pending_write = false;
+  }
+
+  void commit() {
+    if (next_value) {
+      uint32_t v = next_value->word(0);
+      start_bit = extract_start_bit(v);
+      raw_op = extract_raw_op(v);
+      if (is_mai_operation(raw_op))
+        operation = (MaiOperation)raw_op;
+      value = *next_value;
+    }
+    next_value.reset();
+    pending_write = false;
+  }
+
+  static bool has_reserved_bits(uint32_t v) { return v & ~(uint32_t)0x3f; }
+  static bool is_raw_op_valid(uint32_t v) {
+    return is_mai_operation(extract_raw_op(v));
+  }
+  bool is_start_bit_set() const { return start_bit; }
+  static bool would_set_start_bit(uint32_t v) { return extract_start_bit(v); }
+  MaiOperation current_operation() const { return operation; }
+  bool would_change_raw_op(uint32_t v) const {
+    return extract_raw_op(v) != raw_op;
+  }
+};
+
+struct MaiStatusCSR : DumbISPR {
+  bool busy;
+  bool input_ready;
+
+  MaiStatusCSR() : DumbISPR("MAI_STATUS", 32) { on_start(); }
+
+  void on_start() {
+    DumbISPR::on_start();
+    busy = false;
+    input_ready = true;
+    value = Wide::from_u64(get_value());
+  }
+
+  void write_unsigned(uint32_t) {}
+
+  uint32_t get_value() const { return busy | input_ready << 1; }
+
+  void update_bits() {
+    value = Wide::from_u64(get_value());
+    next_value = value;
+    pending_write = false;
+  }
+
+  bool is_input_ready() const { return input_ready; }
+  bool is_busy() const { return busy; }
+
+  void update_input_ready_bit(bool v) {
+    input_ready = v;
+    update_bits();
+  }
+
+  void update_busy_bit(bool v) {
+    busy = v;
+    update_bits();
+  }
+};
+
+struct MaiOutputWSR : DumbISPR {
+  explicit MaiOutputWSR(const char *name_) : DumbISPR(name_, 256) {}
+
+  void set_unsigned(const Wide &v) {
+    value = v;
+    next_value = v;
+    pending_write = false;
+  }
+
+  void set_32bit_unsigned(uint32_t v, unsigned index) {
+    Wide new_value = value;
+    new_value.set_word(index, v);
+    set_unsigned(new_value);
+  }
+};
+
+struct MaiInputWSR : DumbISPR {
+  explicit MaiInputWSR(const char *name_) : DumbISPR(name_, 256) {}
+
+  uint32_t read_32bit_unsigned(unsigned index) const {
+    return value.word(index);
+  }
+};
+
+// ---------------------------------------------------------------------------
+// WSRs (wsr.py)
+
+struct RandWSR {
+  OptWide random_value;
+  OptWide next_random_value;
+  bool pending_request;
+  bool next_pending_request;
+  bool fips_err;
+  bool fips_err_escalate;
+  bool rep_err;
+  bool rep_err_escalate;
+
+  RandWSR()
+      : pending_request(false),
+        next_pending_request(false),
+        fips_err(false),
+        fips_err_escalate(false),
+        rep_err(false),
+        rep_err_escalate(false) {}
+
+  Wide read_unsigned() {
+    ISS_ASSERT(random_value);
+    next_random_value.reset();
+    rep_err_escalate = rep_err;
+    fips_err_escalate = fips_err;
+    return *random_value;
+  }
+
+  uint32_t read_u32() { return read_unsigned().word(0); }
+
+  void on_start() {
+    next_random_value.reset();
+    next_pending_request = false;
+    fips_err_escalate = false;
+    rep_err_escalate = false;
+  }
+
+  void commit() {
+    random_value = next_random_value;
+    pending_request = next_pending_request;
+  }
+
+  bool request_value(OTBNExtRegs *ext_regs) {
+    if (random_value)
+      return true;
+    if (!pending_request) {
+      next_pending_request = true;
+      ext_regs->rnd_request();
+    }
+    return false;
+  }
+
+  void set_unsigned(const Wide &v, bool fips, bool rep) {
+    fips_err = fips;
+    rep_err = rep;
+    fips_err_escalate = false;
+    rep_err_escalate = false;
+    next_random_value = v;
+    next_pending_request = false;
+  }
+};
+
+struct URNDWSR {
+  static const unsigned kBiviumOutputWidth = 389;
+
+  Bivium trivium;
+  Wide next_value;
+  // The full (unmasked) keystream value. Only the bottom 256 bits are
+  // visible to software, but the MAI uses the rest.
+  Wide value;
+  bool running;
+  bool requesting;
+  bool reseed_done;
+
+  URNDWSR()
+      : trivium(kBiviumOutputWidth),
+        running(false),
+        requesting(false),
+        reseed_done(false) {}
+
+  uint32_t read_u32() const { return value.word(0); }
+
+  void on_start() {
+    running = false;
+    reseed_done = false;
+  }
+
+  Wide read_unsigned() const { return value.masked(256); }
+
+  void set_seed(uint32_t v) {
+    reseed_done = false;
+    trivium.seed(v);
+    running = true;
+  }
+
+  void step() {
+    trivium.update();
+    next_value = trivium.keystream();
+  }
+
+  void commit() {
+    trivium.step();
+    value = next_value;
+    if (trivium.seed_done() && running)
+      requesting = false;
+  }
+};
+
+struct SideloadKey {
+  OptWide value;
+
+  bool has_value() const { return value.has_value(); }
+
+  Wide read_unsigned(unsigned shift) const {
+    ISS_ASSERT(value);
+    return (*value >> shift).masked(256);
+  }
+};
+
+// WSR indices (WsrAddrs in constants.py)
+enum WsrAddr {
+  kWsrMod = 0,
+  kWsrRnd = 1,
+  kWsrUrnd = 2,
+  kWsrAcc = 3,
+  kWsrKeyS0L = 4,
+  kWsrKeyS0H = 5,
+  kWsrKeyS1L = 6,
+  kWsrKeyS1H = 7,
+  kWsrKmacDataS0 = 8,
+  kWsrKmacDataS1 = 9,
+  kWsrMaiResS0 = 10,
+  kWsrMaiResS1 = 11,
+  kWsrMaiIn0S0 = 12,
+  kWsrMaiIn0S1 = 13,
+  kWsrMaiIn1S0 = 14,
+  kWsrMaiIn1S1 = 15,
+  kNumWsrs = 16
+};
+
+struct WSRFile {
+  SideloadKey KeyS0, KeyS1;
+  DumbISPR MOD;
+  RandWSR RND;
+  URNDWSR URND;
+  DumbISPR ACC;
+  KmacDataWSR KMAC_DATA_S0, KMAC_DATA_S1;
+  MaiOutputWSR MAI_RES_S0, MAI_RES_S1;
+  MaiInputWSR MAI_IN0_S0, MAI_IN0_S1, MAI_IN1_S0, MAI_IN1_S1;
+
+  WSRFile()
+      : MOD("MOD", 256),
+        ACC("ACC", 256),
+        KMAC_DATA_S0("KMAC_DATA_S0"),
+        KMAC_DATA_S1("KMAC_DATA_S1"),
+        MAI_RES_S0("MAI_RES_S0"),
+        MAI_RES_S1("MAI_RES_S1"),
+        MAI_IN0_S0("MAI_IN0_S0"),
+        MAI_IN0_S1("MAI_IN0_S1"),
+        MAI_IN1_S0("MAI_IN1_S0"),
+        MAI_IN1_S1("MAI_IN1_S1") {}
+
+  void on_start() {
+    MOD.on_start();
+    RND.on_start();
+    URND.on_start();
+    ACC.on_start();
+    KMAC_DATA_S0.on_start();
+    KMAC_DATA_S1.on_start();
+    MAI_RES_S0.on_start();
+    MAI_RES_S1.on_start();
+    MAI_IN0_S0.on_start();
+    MAI_IN0_S1.on_start();
+    MAI_IN1_S0.on_start();
+    MAI_IN1_S1.on_start();
+  }
+
+  static bool check_idx(uint32_t idx) { return idx < kNumWsrs; }
+
+  bool has_value_at_idx(uint32_t idx) const {
+    switch (idx) {
+      case kWsrKeyS0L:
+      case kWsrKeyS0H:
+        return KeyS0.has_value();
+      case kWsrKeyS1L:
+      case kWsrKeyS1H:
+        return KeyS1.has_value();
+      default:
+        return true;
+    }
+  }
+
+  DumbISPR *mai_in(uint32_t idx) {
+    switch (idx) {
+      case kWsrMaiIn0S0:
+        return &MAI_IN0_S0;
+      case kWsrMaiIn0S1:
+        return &MAI_IN0_S1;
+      case kWsrMaiIn1S0:
+        return &MAI_IN1_S0;
+      default:
+        return &MAI_IN1_S1;
+    }
+  }
+
+  Wide read_at_idx(uint32_t idx) {
+    switch (idx) {
+      case kWsrMod:
+        return MOD.read_unsigned();
+      case kWsrRnd:
+        return RND.read_unsigned();
+      case kWsrUrnd:
+        return URND.read_unsigned();
+      case kWsrAcc:
+        return ACC.read_unsigned();
+      case kWsrKeyS0L:
+        return KeyS0.read_unsigned(0);
+      case kWsrKeyS0H:
+        return KeyS0.read_unsigned(256);
+      case kWsrKeyS1L:
+        return KeyS1.read_unsigned(0);
+      case kWsrKeyS1H:
+        return KeyS1.read_unsigned(256);
+      case kWsrKmacDataS0:
+        return KMAC_DATA_S0.read_unsigned();
+      case kWsrKmacDataS1:
+        return KMAC_DATA_S1.read_unsigned();
+      case kWsrMaiResS0:
+        return MAI_RES_S0.read_unsigned();
+      case kWsrMaiResS1:
+        return MAI_RES_S1.read_unsigned();
+      default:
+        ISS_ASSERT(check_idx(idx));
+        return mai_in(idx)->read_unsigned();
+    }
+  }
+
+  void write_at_idx(uint32_t idx, const Wide &v) {
+    switch (idx) {
+      case kWsrMod:
+        MOD.write_unsigned(v);
+        break;
+      case kWsrAcc:
+        ACC.write_unsigned(v);
+        break;
+      case kWsrKmacDataS0:
+        KMAC_DATA_S0.write_unsigned(v);
+        break;
+      case kWsrKmacDataS1:
+        KMAC_DATA_S1.write_unsigned(v);
+        break;
+      case kWsrMaiResS0:
+        MAI_RES_S0.write_unsigned(v);
+        break;
+      case kWsrMaiResS1:
+        MAI_RES_S1.write_unsigned(v);
+        break;
+      case kWsrMaiIn0S0:
+      case kWsrMaiIn0S1:
+      case kWsrMaiIn1S0:
+      case kWsrMaiIn1S1:
+        mai_in(idx)->write_unsigned(v);
+        break;
+      default:
+        // RND, URND and the sideloaded keys ignore writes
+        ISS_ASSERT(check_idx(idx));
+        break;
+    }
+  }
+
+  void commit() {
+    MOD.commit();
+    RND.commit();
+    URND.commit();
+    ACC.commit();
+    KMAC_DATA_S0.commit();
+    KMAC_DATA_S1.commit();
+    MAI_RES_S0.commit();
+    MAI_RES_S1.commit();
+    MAI_IN0_S0.commit();
+    MAI_IN0_S1.commit();
+    MAI_IN1_S0.commit();
+    MAI_IN1_S1.commit();
+  }
+
+  void abort() {
+    MOD.abort();
+    ACC.abort();
+    KMAC_DATA_S0.abort();
+    KMAC_DATA_S1.abort();
+    MAI_RES_S0.commit();
+    MAI_RES_S1.commit();
+    MAI_IN0_S0.abort();
+    MAI_IN0_S1.abort();
+    MAI_IN1_S0.abort();
+    MAI_IN1_S1.abort();
+  }
+
+  void changes(Changes *dst) const {
+    MOD.changes(dst);
+    ACC.changes(dst);
+    KMAC_DATA_S0.changes(dst);
+    KMAC_DATA_S1.changes(dst);
+    MAI_RES_S0.changes(dst);
+    MAI_RES_S1.changes(dst);
+    MAI_IN0_S0.changes(dst);
+    MAI_IN0_S1.changes(dst);
+    MAI_IN1_S0.changes(dst);
+    MAI_IN1_S1.changes(dst);
+  }
+
+  void set_sideload_keys(const OptWide &key0, const OptWide &key1) {
+    KeyS0.value = key0;
+    KeyS1.value = key1;
+  }
+
+  void wipe() {
+    MOD.write_invalid();
+    ACC.write_invalid();
+    KMAC_DATA_S0.write_invalid();
+    KMAC_DATA_S1.write_invalid();
+    MAI_RES_S0.write_invalid();
+    MAI_RES_S1.write_invalid();
+    MAI_IN0_S0.write_invalid();
+    MAI_IN0_S1.write_invalid();
+    MAI_IN1_S0.write_invalid();
+    MAI_IN1_S1.write_invalid();
+  }
+};
+
+// ---------------------------------------------------------------------------
+// CSRs (csr.py)
+
+enum CsrAddr : uint32_t {
+  kCsrFg0 = 0x7c0,
+  kCsrFg1 = 0x7c1,
+  kCsrFlags = 0x7c8,
+  kCsrMod0 = 0x7d0,
+  kCsrMod7 = 0x7d7,
+  kCsrRndPrefetch = 0x7d8,
+  kCsrKmacStatus = 0x7db,
+  kCsrKmacCtrl = 0x7dc,
+  kCsrKmacCfg = 0x7dd,
+  kCsrKmacStrb = 0x7de,
+  kCsrMaiCtrl = 0x7e0,
+  kCsrRnd = 0xfc0,
+  kCsrUrnd = 0xfc1,
+  kCsrInsnCnt = 0xfc3,
+  kCsrMaiStatus = 0xfca
+};
+
+struct CSRFile {
+  FlagGroups flags;
+  KmacStatusCSR KMAC_STATUS;
+  KmacCtrlCSR KMAC_CTRL;
+  KmacCfgCSR KMAC_CFG;
+  KmacStrbCSR KMAC_STRB;
+  MaiCtrlCSR MAI_CTRL;
+  MaiStatusCSR MAI_STATUS;
+
+  static bool check_idx(uint32_t idx) {
+    switch (idx) {
+      case kCsrFg0:
+      case kCsrFg1:
+      case kCsrFlags:
+      case kCsrRndPrefetch:
+      case kCsrKmacStatus:
+      case kCsrKmacCtrl:
+      case kCsrKmacCfg:
+      case kCsrKmacStrb:
+      case kCsrMaiCtrl:
+      case kCsrRnd:
+      case kCsrUrnd:
+      case kCsrInsnCnt:
+      case kCsrMaiStatus:
+        return true;
+      default:
+        return kCsrMod0 <= idx && idx <= kCsrMod7;
+    }
+  }
+
+  uint32_t read_unsigned(WSRFile *wsrs, const OTBNExtRegs &ext_regs,
+                         uint32_t idx) {
+    if (kCsrFg0 <= idx && idx <= kCsrFg1)
+      return (flags.read_unsigned() >> (4 * (idx - kCsrFg0))) & 15;
+    if (kCsrMod0 <= idx && idx <= kCsrMod7)
+      return wsrs->MOD.read_unsigned().word(idx - kCsrMod0);
+
+    switch (idx) {
+      case kCsrFlags:
+        return flags.read_unsigned();
+      case kCsrRndPrefetch:
+        return 0;
+      case kCsrKmacStatus:
+        return KMAC_STATUS.read_unsigned().word(0);
+      case kCsrKmacCtrl:
+        return KMAC_CTRL.read_unsigned();
+      case kCsrKmacCfg:
+        return KMAC_CFG.read_unsigned();
+      case kCsrKmacStrb:
+        return KMAC_STRB.read_unsigned().word(0);
+      case kCsrMaiCtrl:
+        return MAI_CTRL.read_unsigned().word(0);
+      case kCsrRnd:
+        return wsrs->RND.read_u32();
+      case kCsrUrnd:
+        return wsrs->URND.read_u32();
+      case kCsrInsnCnt:
+        return ext_regs.read(kInsnCnt);
+      case kCsrMaiStatus:
+        return MAI_STATUS.read_unsigned().word(0);
+      default:
+        throw std::runtime_error("Unhandled CSR index");
+    }
+  }
+
+  void write_unsigned(WSRFile *wsrs, OTBNExtRegs *ext_regs, uint32_t idx,
+                      uint32_t value) {
+    if (kCsrFg0 <= idx && idx <= kCsrFg1) {
+      unsigned shift = 4 * (idx - kCsrFg0);
+      unsigned old = flags.read_unsigned();
+      flags.write_unsigned((old & ~(15u << shift)) | (value & 15) << shift);
+      return;
+    }
+    if (kCsrMod0 <= idx && idx <= kCsrMod7) {
+      Wide mod = wsrs->MOD.read_unsigned();
+      mod.set_word(idx - kCsrMod0, value);
+      wsrs->MOD.write_unsigned(mod);
+      return;
+    }
+
+    switch (idx) {
+      case kCsrFlags:
+        flags.write_unsigned(value);
+        break;
+      case kCsrRndPrefetch:
+        wsrs->RND.request_value(ext_regs);
+        break;
+      case kCsrKmacStatus:
+        KMAC_STATUS.write_unsigned(value);
+        break;
+      case kCsrKmacCtrl:
+        KMAC_CTRL.write_unsigned(value);
+        break;
+      case kCsrKmacCfg:
+        KMAC_CFG.write_unsigned(value);
+        break;
+      case kCsrKmacStrb:
+        KMAC_STRB.write_unsigned(value);
+        break;
+      case kCsrMaiCtrl:
+        MAI_CTRL.write_unsigned(Wide::from_u64(value));
+        break;
+      case kCsrMaiStatus:
+        MAI_STATUS.write_unsigned(value);
+        break;
+      case kCsrRnd:
+      case kCsrUrnd:
+      case kCsrInsnCnt:
+        break;
+      default:
+        throw std::runtime_error("Unhandled CSR index");
+    }
+  }
+
+  void commit() {
+    flags.commit();
+    KMAC_STATUS.commit();
+    KMAC_CTRL.commit();
+    KMAC_CFG.commit();
+    KMAC_STRB.commit();
+    MAI_CTRL.commit();
+    MAI_STATUS.commit();
+  }
+
+  void abort() {
+    flags.abort();
+    KMAC_STATUS.abort();
+    KMAC_CTRL.abort();
+    KMAC_CFG.abort();
+    KMAC_STRB.abort();
+    MAI_CTRL.abort();
+    MAI_STATUS.commit();
+  }
+
+  void changes(Changes *dst) const {
+    flags.changes(dst);
+    KMAC_STATUS.changes(dst);
+    KMAC_CTRL.changes(dst);
+    KMAC_CFG.changes(dst);
+    KMAC_STRB.changes(dst);
+    MAI_CTRL.changes(dst);
+    MAI_STATUS.changes(dst);
+  }
+
+  void wipe() { flags.write_unsigned(0); }
+};
+
+// ---------------------------------------------------------------------------
+// DMEM (dmem.py)
+
+struct Dmem {
+  static const unsigned kNumWords = 32768 / 4;
+
+  struct Word {
+    uint32_t value;
+    bool valid;
+  };
+
+  struct Store {
+    uint32_t addr;
+    Wide value;
+    bool is_wide;
+  };
+
+  std::vector<Word> data;
+  std::map<uint32_t, uint32_t> pending;
+  std::vector<Store> trace;
+
+  Dmem() : data(kNumWords, Word{0, false}) {}
+
+  void load_words(const Ecc32MemArea::EccWords &words) {
+    if (words.size() > data.size()) {
+      std::ostringstream oss;
+      oss << "Trying to load " << words.size()
+          << " words of data, but DMEM is only " << data.size()
+          << " words long.";
+      throw std::runtime_error(oss.str());
+    }
+    for (size_t i = 0; i < words.size(); ++i)
+      data[i] = Word{words[i].second, words[i].first};
+  }
+
+  Ecc32MemArea::EccWords dump_words() const {
+    Ecc32MemArea::EccWords ret;
+    ret.reserve(data.size());
+    for (uint32_t idx = 0; idx < data.size(); ++idx) {
+      auto it = pending.find(idx);
+      if (it != pending.end())
+        ret.emplace_back(true, it->second);
+      else if (data[idx].valid)
+        ret.emplace_back(true, data[idx].value);
+      else
+        ret.emplace_back(false, 0);
+    }
+    return ret;
+  }
+
+  bool is_valid_256b_addr(uint32_t addr) const {
+    return !(addr & 31) && addr / 4 < data.size();
+  }
+
+  bool is_valid_32b_addr(uint32_t addr) const {
+    return !(addr & 3) && ((uint64_t)addr + 3) / 4 < data.size();
+  }
+
+  Word load_u32(uint32_t addr) const {
+    ISS_ASSERT(is_valid_32b_addr(addr));
+    auto it = pending.find(addr / 4);
+    if (it != pending.end())
+      return Word{it->second, true};
+    return data[addr / 4];
+  }
+
+  Wide load_u256(uint32_t addr, bool *valid) const {
+    ISS_ASSERT(is_valid_256b_addr(addr));
+    Wide ret;
+    *valid = true;
+    for (unsigned i = 0; i < 8; ++i) {
+      Word w = load_u32(addr + 4 * i);
+      ret.set_word(i, w.value);
+      *valid = *valid && w.valid;
+    }
+    return ret;
+  }
+
+  void store_u256(uint32_t addr, const Wide &value) {
+    ISS_ASSERT(is_valid_256b_addr(addr));
+    trace.push_back(Store{addr, value, true});
+  }
+
+  void store_u32(uint32_t addr, uint32_t value) {
+    ISS_ASSERT(is_valid_32b_addr(addr));
+    trace.push_back(Store{addr, Wide::from_u64(value), false});
+  }
+
+  void commit() {
+    for (const auto &kv : pending)
+      data[kv.first] = Word{kv.second, true};
+    pending.clear();
+    for (const Store &item : trace) {
+      if (item.is_wide) {
+        for (unsigned i = 0; i < 8; ++i)
+          pending[item.addr / 4 + i] = item.value.word(i);
+      } else {
+        pending[item.addr / 4] = item.value.word(0);
+      }
+    }
+    trace.clear();
+  }
+
+  void abort() { trace.clear(); }
+
+  void invalidate_dmem() {
+    for (Word &w : data)
+      w.valid = false;
+  }
+};
+
+// ---------------------------------------------------------------------------
+// Loops (loop.py)
+
+struct LoopLevel {
+  uint32_t loop_count;
+  uint32_t restarts_left;
+  uint32_t start_addr;
+  uint32_t last_addr;
+};
+
+typedef std::map<uint32_t, uint32_t> LoopWarps;
+
+struct LoopStack {
+  static const unsigned kStackDepth = 8;
+
+  std::vector<LoopLevel> stack;
+  bool err_flag;
+  bool pop_stack_on_commit;
+
+  LoopStack() : err_flag(false), pop_stack_on_commit(false) {}
+
+  void start_loop(uint32_t start_addr, uint32_t loop_count,
+                  uint32_t insn_count) {
+    ISS_ASSERT(insn_count > 0 && loop_count > 0);
+    if (stack.size() == kStackDepth)
+      err_flag = true;
+    stack.push_back(LoopLevel{loop_count, loop_count - 1, start_addr,
+                              start_addr + 4 * insn_count - 4});
+  }
+
+  bool is_last_insn_in_loop_body(uint32_t pc) const {
+    return !stack.empty() && pc == stack.back().last_addr;
+  }
+
+  void check_insn(uint32_t pc, bool insn_affects_control) {
+    if (is_last_insn_in_loop_body(pc) && insn_affects_control)
+      err_flag = true;
+  }
+
+  // Returns the new PC if we jump back to the start of a loop
+  std::optional<uint32_t> step(uint32_t pc, const LoopWarps *warps) {
+    pop_stack_on_commit = false;
+    apply_warps(warps);
+    if (!is_last_insn_in_loop_body(pc))
+      return std::nullopt;
+
+    LoopLevel &top = stack.back();
+    if (!top.restarts_left) {
+      pop_stack_on_commit = true;
+      return std::nullopt;
+    }
+    --top.restarts_left;
+    return top.start_addr;
+  }
+
+  uint32_t err_bits() const { return err_flag ? uint32_t(kErrLoop) : 0; }
+
+  void commit() {
+    ISS_ASSERT(!err_flag);
+    if (pop_stack_on_commit) {
+      stack.pop_back();
+      pop_stack_on_commit = false;
+    }
+  }
+
+  void abort() { err_flag = false; }
+
+  void apply_warps(const LoopWarps *warps) {
+    if (stack.empty() || !warps)
+      return;
+    LoopLevel &top = stack.back();
+    uint32_t cur_iter_count = top.loop_count - (1 + top.restarts_left);
+    auto it = warps->find(cur_iter_count);
+    if (it == warps->end())
+      return;
+    uint32_t new_iter_count = it->second;
+    ISS_ASSERT(cur_iter_count <= new_iter_count);
+    ISS_ASSERT((uint64_t)new_iter_count + 1 <= top.loop_count);
+    top.restarts_left = top.loop_count - new_iter_count - 1;
+  }
+};
+
+// ---------------------------------------------------------------------------
+// KMAC interface (kmac.py)
+
+struct Kmac {
+  static const unsigned kPermCycles = 24 * 4;
+  static const unsigned kMsgParts = 4;
+  static const unsigned kRejectCycles = 2;
+  static const unsigned kKmacOutputLength = 384;
+  static const uint64_t kDigestMask = 0xdeadbeefdeadbeefULL;
+  static const unsigned kStrbBeatFull = 0xff;
+
+  enum State {
+    IDLE,
+    STARTING,
+    WAIT_FOR_MSG,
+    SENDING,
+    PROCESSING,
+    RECEIVING,
+    TERMINATING,
+    WAIT_FOR_CLOSE
+  };
+
+  enum Cmd : uint32_t {
+    CMD_START = 1,
+    CMD_SEND = 2,
+    CMD_PROCESS = 4,
+    CMD_DONE = 8,
+    CMD_CLOSE = 16,
+    CMD_ALL = 31
+  };
+
+  enum Mode { SHA3, SHAKE, CSHAKE, KMAC };
+  enum Strength { L128, L224, L256, L384, L512 };
+
+  State state;
+  bool no_more_msg_allowed;
+  unsigned msg_beat_idx;
+  bool ready;
+  bool rsp_valid;
+  bool s0_pending;
+  bool s1_pending;
+  Mode app_mode;
+  Strength app_strength;
+  bool app_en_xof;
+  bool service_rejected;
+  std::vector<uint8_t> app_msg;
+  unsigned latency_timer;
+  unsigned msg_block_words;
+  unsigned beats_pushed;
+  unsigned beat_in_rate;
+  std::optional<KeccakSponge> xof;
+  std::vector<uint8_t> fixed_digest;
+
+  Kmac() { reset(); }
+
+  void on_start() { reset(); }
+
+  void reset() {
+    state = IDLE;
+    no_more_msg_allowed = false;
+    msg_beat_idx = 0;
+    ready = false;
+    rsp_valid = false;
+    s0_pending = false;
+    s1_pending = false;
+    app_mode = SHA3;
+    app_strength = L256;
+    app_en_xof = false;
+    service_rejected = false;
+    app_msg.clear();
+    latency_timer = 0;
+    msg_block_words = 0;
+    beats_pushed = 0;
+    beat_in_rate = 0;
+    xof.reset();
+    fixed_digest.clear();
+  }
+
+  void step(CSRFile *csrs, WSRFile *wsrs) {
+    KmacStatusCSR &status = csrs->KMAC_STATUS;
+    KmacDataWSR &data_s0 = wsrs->KMAC_DATA_S0;
+    KmacDataWSR &data_s1 = wsrs->KMAC_DATA_S1;
+
+    uint32_t cmd = csrs->KMAC_CTRL.take_cmd();
+    if (cmd == 0 && state == IDLE && latency_timer == 0 && ready &&
+        !rsp_valid && !data_s0.was_read() && !data_s1.was_read())
+      return;
+
+    if (data_s0.was_read())
+      s0_pending = false;
+    if (data_s1.was_read())
+      s1_pending = false;
+    data_s0.clr_read();
+    data_s1.clr_read();
+
+    bool kmac_busy = latency_timer != 0;
+    bool kmac_idle = !kmac_busy;
+    if (kmac_busy)
+      --latency_timer;
+
+    switch (state) {
+      case IDLE:
+        if (cmd & CMD_START)
+          state = STARTING;
+        break;
+
+      case STARTING:
+        service_rejected = !decode_config(csrs->KMAC_CFG);
+        latency_timer = 0;
+        state = WAIT_FOR_MSG;
+        app_msg.clear();
+        msg_block_words = 0;
+        no_more_msg_allowed = false;
+        break;
+
+      case WAIT_FOR_MSG:
+        if ((cmd & CMD_SEND) && !no_more_msg_allowed) {
+          state = SENDING;
+          msg_beat_idx = 0;
+        } else if (cmd & CMD_PROCESS) {
+          if (!service_rejected) {
+            start_digest();
+            latency_timer += kPermCycles;
+          } else {
+            latency_timer = kRejectCycles;
+          }
+          state = PROCESSING;
+        }
+        break;
+
+      case SENDING:
+        if (kmac_idle) {
+          bool end_phase, no_more, absorbed_full_word;
+          send_beat(*csrs, *wsrs, msg_beat_idx, &end_phase, &no_more,
+                    &absorbed_full_word);
+          if (no_more)
+            no_more_msg_allowed = true;
+          if (absorbed_full_word) {
+            ++msg_block_words;
+            if (msg_block_words >= rate_beats()) {
+              msg_block_words = 0;
+              latency_timer = kPermCycles;
+            }
+          }
+          if (end_phase)
+            state = WAIT_FOR_MSG;
+          else
+            ++msg_beat_idx;
+        }
+        break;
+
+      case PROCESSING:
+        state = RECEIVING;
+        break;
+
+      case RECEIVING:
+        if (cmd & CMD_DONE) {
+          state = TERMINATING;
+          rsp_valid = false;
+          s0_pending = false;
+          s1_pending = false;
+          if (service_rejected)
+            status.hw_set_rsp_error();
+        } else if (kmac_busy) {
+        } else if (service_rejected) {
+          status.hw_set_rsp_error();
+          rsp_valid = true;
+        } else if (!s0_pending && !s1_pending) {
+          if (rsp_valid && digest_exhausted() && app_en_xof) {
+            ISS_ASSERT(app_mode == SHAKE || app_mode == CSHAKE);
+            beat_in_rate = 0;
+            latency_timer = kPermCycles;
+            rsp_valid = false;
+          } else if (!digest_exhausted()) {
+            emit_beat(wsrs);
+            rsp_valid = true;
+            s0_pending = true;
+            s1_pending = true;
+          } else {
+            rsp_valid = false;
+          }
+        }
+        break;
+
+      case TERMINATING:
+        if (kmac_idle) {
+          rsp_valid = true;
+          state = WAIT_FOR_CLOSE;
+        }
+        break;
+
+      case WAIT_FOR_CLOSE:
+        if (cmd & CMD_CLOSE) {
+          rsp_valid = false;
+          s0_pending = false;
+          s1_pending = false;
+          status.hw_clr_error_bits();
+          state = IDLE;
+        }
+        break;
+    }
+
+    ready = state == IDLE || state == WAIT_FOR_MSG || state == RECEIVING;
+    status.hw_set_ready(ready);
+    status.hw_set_rsp_valid(rsp_valid);
+  }
+
+  void detect_errors(CSRFile *csrs, const WSRFile &wsrs) const {
+    uint32_t cmd = csrs->KMAC_CTRL.peek_pending_cmd();
+    if (cmd != 0) {
+      bool multiple_cmds = (cmd & (cmd - 1)) != 0;
+      if (multiple_cmds || unexpected_cmd(cmd))
+        csrs->KMAC_STATUS.hw_set_ctrl_error();
+    }
+
+    bool data_written =
+        wsrs.KMAC_DATA_S0.is_written() || wsrs.KMAC_DATA_S1.is_written();
+    bool strb_written = csrs->KMAC_STRB.is_written();
+    bool cfg_written = csrs->KMAC_CFG.is_written();
+    bool hw_written =
+        wsrs.KMAC_DATA_S0.is_hw_written() || wsrs.KMAC_DATA_S1.is_hw_written();
+    bool not_ready_write = (data_written || strb_written || cfg_written) &&
+                           !ready;
+    bool collision = data_written && hw_written;
+    if (not_ready_write || collision)
+      csrs->KMAC_STATUS.hw_set_msg_write_error();
+  }
+
+  bool unexpected_cmd(uint32_t cmd) const {
+    static const uint32_t disallowed[] = {
+        CMD_ALL & ~CMD_START, CMD_ALL, CMD_ALL & ~(CMD_PROCESS | CMD_SEND),
+        CMD_ALL,              CMD_ALL, CMD_ALL & ~CMD_DONE,
+        CMD_ALL,              CMD_ALL & ~CMD_CLOSE};
+    if (state == WAIT_FOR_MSG && no_more_msg_allowed)
+      return cmd & (CMD_ALL & ~CMD_PROCESS);
+    return cmd & disallowed[state];
+  }
+
+  void send_beat(const CSRFile &csrs, const WSRFile &wsrs, unsigned idx,
+                 bool *end_phase, bool *no_more, bool *absorbed_full_word) {
+    uint64_t share0 = wsrs.KMAC_DATA_S0.get_unsigned().bits(64 * idx, 64);
+    uint64_t share1 = wsrs.KMAC_DATA_S1.get_unsigned().bits(64 * idx, 64);
+    uint32_t strb_word = csrs.KMAC_STRB.read_unsigned().word(0);
+    unsigned strb = (strb_word >> (8 * idx)) & kStrbBeatFull;
+    if (strb == 0) {
+      *end_phase = true;
+      *no_more = true;
+      *absorbed_full_word = false;
+      return;
+    }
+    uint64_t beat = share0 ^ share1;
+    unsigned valid_bytes = __builtin_popcount(strb);
+    for (unsigned i = 0; i < valid_bytes; ++i)
+      app_msg.push_back((uint8_t)(beat >> (8 * i)));
+    if (strb != kStrbBeatFull) {
+      *end_phase = true;
+      *no_more = true;
+      *absorbed_full_word = false;
+      return;
+    }
+    *end_phase = idx == kMsgParts - 1;
+    *no_more = false;
+    *absorbed_full_word = true;
+  }
+
+  bool decode_config(const KmacCfgCSR &cfg) {
+    if (!cfg.redundancy_valid())
+      return false;
+    unsigned mode_raw = cfg.get_mode();
+    unsigned strength_raw = cfg.get_strength();
+    if (strength_raw > L512)
+      return false;
+    app_en_xof = cfg.get_en_xof();
+    app_mode = (Mode)mode_raw;
+    app_strength = (Strength)strength_raw;
+    return config_valid();
+  }
+
+  bool config_valid() const {
+    if (app_en_xof && (app_mode == SHA3 || app_mode == KMAC))
+      return false;
+    if (app_mode == SHA3)
+      return app_strength != L128;
+    return app_strength == L128 || app_strength == L256;
+  }
+
+  unsigned capacity_bits() const {
+    static const unsigned cap_bits[] = {256, 448, 512, 768, 1024};
+    return cap_bits[app_strength];
+  }
+
+  unsigned rate_beats() const { return (1600 - capacity_bits()) / 64; }
+
+  bool digest_exhausted() const {
+    if (!xof)
+      return beats_pushed * 8 >= fixed_digest.size();
+    return beat_in_rate >= rate_beats();
+  }
+
+  void start_digest() {
+    fixed_digest.clear();
+    xof.reset();
+    beats_pushed = 0;
+    beat_in_rate = 0;
+
+    unsigned rate = (1600 - capacity_bits()) / 8;
+    switch (app_mode) {
+      case SHA3: {
+        KeccakSponge sponge(rate, 0x06);
+        sponge.absorb(app_msg);
+        fixed_digest.resize(capacity_bits() / 16);
+        sponge.squeeze(fixed_digest.data(), fixed_digest.size());
+        break;
+      }
+      case SHAKE:
+      case CSHAKE:
+        // cSHAKE with an empty function name and customisation string is
+        // defined to be SHAKE.
+        xof.emplace(rate, 0x1f);
+        xof->absorb(app_msg);
+        break;
+      case KMAC: {
+        static const uint8_t key[] = {
+            0xb2, 0xa3, 0xda, 0x37, 0x97, 0xda, 0x3c, 0x73, 0x53, 0xf4,
+            0xf6, 0x12, 0xf5, 0xa2, 0x44, 0xe6, 0x6f, 0x4d, 0xcd, 0xd9,
+            0xb3, 0x1b, 0xfe, 0x3a, 0x5e, 0xa8, 0x8c, 0x93, 0xde, 0xa1,
+            0xac, 0xf1, 0x3d, 0xeb, 0x1e, 0x63, 0x59, 0x51, 0x36, 0x5a,
+            0x8b, 0xc5, 0xa7, 0x14, 0x10, 0x66, 0xaa, 0xf9};
+        KeccakSponge sponge(rate, 0x04);
+        std::vector<uint8_t> prefix = encode_string({'K', 'M', 'A', 'C'});
+        std::vector<uint8_t> custom = encode_string({});
+        prefix.insert(prefix.end(), custom.begin(), custom.end());
+        absorb_bytepad(&sponge, prefix);
+        absorb_bytepad(&sponge, encode_string(std::vector<uint8_t>(
+                                    key, key + sizeof key)));
+        sponge.absorb(app_msg);
+        sponge.absorb(right_encode(kKmacOutputLength));
+        fixed_digest.resize(kKmacOutputLength / 8);
+        sponge.squeeze(fixed_digest.data(), fixed_digest.size());
+        break;
+      }
+    }
+  }
+
+  uint64_t digest_value(unsigned idx) {
+    uint8_t chunk[8] = {0};
+    if (xof) {
+      xof->squeeze(chunk, 8);
+    } else {
+      for (unsigned i = 0; i < 8 && idx * 8 + i < fixed_digest.size(); ++i)
+        chunk[i] = fixed_digest[idx * 8 + i];
+    }
+    uint64_t ret = 0;
+    for (int i = 7; i >= 0; --i)
+      ret = ret << 8 | chunk[i];
+    return ret;
+  }
+
+  void emit_beat(WSRFile *wsrs) {
+    uint64_t val = digest_value(beats_pushed);
+    wsrs->KMAC_DATA_S0.hw_write(val ^ kDigestMask);
+    wsrs->KMAC_DATA_S1.hw_write(kDigestMask);
+    ++beats_pushed;
+    ++beat_in_rate;
+  }
+};
+
+// ---------------------------------------------------------------------------
+// Masking accelerator interface (mai.py)
+
+uint32_t mod_smear(uint32_t mod) {
+  uint32_t mask = mod;
+  for (unsigned i = 0; i < 5; ++i)
+    mask |= mask >> (1 << i);
+  return mask;
+}
+
+struct UrndFields {
+  Wide rand;
+  uint32_t mask_0;
+  uint32_t mask_1;
+  uint32_t cnt;
+};
+
+UrndFields urnd_fields(const Wide &urnd_val) {
+  return UrndFields{urnd_val.masked(322), (uint32_t)urnd_val.bits(322, 32),
+                    (uint32_t)urnd_val.bits(354, 32),
+                    (uint32_t)urnd_val.bits(386, 3)};
+}
+
+typedef std::pair<uint64_t, uint64_t> Shares;
+
+Shares hpc3_vec(uint64_t x0, uint64_t x1, uint64_t y0, uint64_t y1,
+                uint64_t r, uint64_t rp, uint64_t w0 = 0, uint64_t w1 = 0) {
+  uint64_t y_masked_0 = y0 ^ r;
+  uint64_t y_masked_1 = y1 ^ r;
+  uint64_t inner_0 = (x0 & y_masked_0) ^ w0 ^ rp;
+  uint64_t inner_1 = (x1 & y_masked_1) ^ w1 ^ rp;
+  return Shares(inner_0 ^ (x0 & y_masked_1), inner_1 ^ (x1 & y_masked_0));
+}
+
+const uint32_t kBcastGs[5] = {0x55555555, 0x11111111, 0x01010101, 0x00010001,
+                              0x00000001};
+const uint32_t kBcastFill[5] = {0x2, 0xc, 0xf0, 0xff00, 0xffff0000};
+
+struct LevelMasks {
+  uint32_t active_mask;
+  uint32_t inv_active;
+  uint32_t p_mask;
+  uint32_t feedthrough_pp_mask;
+};
+
+LevelMasks level_masks(unsigned lv_idx) {
+  unsigned step = 1 << lv_idx;
+  unsigned period = 2 * step;
+  uint64_t ones_step = ((uint64_t)1 << step) - 1;
+  uint64_t active_mask = 0;
+  for (unsigned k = 0; k < 32 / period; ++k)
+    active_mask |= ones_step << (period * k + step);
+  uint32_t inv_active = kMask32 ^ (uint32_t)active_mask;
+  uint64_t g0_active_mask = ones_step << step;
+  uint32_t p_mask = (uint32_t)(active_mask ^ g0_active_mask);
+  uint64_t group0_all_mask = ((uint64_t)1 << period) - 1;
+  uint32_t feedthrough = inv_active & (kMask32 ^ (uint32_t)group0_all_mask);
+  return LevelMasks{(uint32_t)active_mask, inv_active, p_mask, feedthrough};
+}
+
+uint64_t bs_extract(uint64_t x, unsigned step) {
+  if (step == 2) {
+    x &= 0x5555555555555555ULL;
+    x = (x | x >> 1) & 0x3333333333333333ULL;
+    x = (x | x >> 2) & 0x0f0f0f0f0f0f0f0fULL;
+    x = (x | x >> 4) & 0x00ff00ff00ff00ffULL;
+    x = (x | x >> 8) & 0x0000ffff0000ffffULL;
+    x = (x | x >> 16) & 0x00000000ffffffffULL;
+    return x;
+  }
+  x &= 0x1111111111111111ULL;
+  x = (x | x >> 3) & 0x0303030303030303ULL;
+  x = (x | x >> 6) & 0x000f000f000f000fULL;
+  x = (x | x >> 12) & 0x000000ff000000ffULL;
+  x = (x | x >> 24) & 0x000000000000ffffULL;
+  return x;
+}
+
+uint64_t bs_scatter(uint64_t x, unsigned gap) {
+  x = (x ^ x << 16) & 0x0000ffff0000ffffULL;
+  x = (x ^ x << 8) & 0x00ff00ff00ff00ffULL;
+  if (gap == 8)
+    return x;
+  x = (x ^ x << 4) & 0x0f0f0f0f0f0f0f0fULL;
+  if (gap == 4)
+    return x;
+  x = (x ^ x << 2) & 0x3333333333333333ULL;
+  if (gap == 2)
+    return x;
+  x = (x ^ x << 1) & 0x5555555555555555ULL;
+  return x;
+}
+
+struct UnpackedRand {
+  uint64_t r_g, rp_g, r_p, rp_p;
+};
+
+// The _ur0 ... _ur5 functions in mai.py
+UnpackedRand unpack_rand(unsigned level, const Wide &ri) {
+  if (level == 0) {
+    uint64_t n = ri.bits(0, 64);
+    return UnpackedRand{bs_extract(n, 2), bs_extract(n >> 1, 2), 0, 0};
+  }
+  if (level == 5) {
+    uint64_t n = ri.bits(290, 32);
+    return UnpackedRand{bs_extract(n, 2) << 16, bs_extract(n >> 1, 2) << 16, 0,
+                        0};
+  }
+  if (level == 1) {
+    uint64_t n = ri.bits(64, 62);
+    uint64_t lower = n & 3, upper = n >> 2;
+    uint64_t r1 = bs_extract(upper, 4);
+    uint64_t r2 = bs_extract(upper >> 1, 4);
+    uint64_t r3 = bs_extract(upper >> 2, 4);
+    uint64_t r4 = bs_extract(upper >> 3, 4);
+    uint64_t v1 = (lower & 1) | r1 << 1;
+    uint64_t v2 = ((lower >> 1) & 1) | r2 << 1;
+    return UnpackedRand{bs_scatter(v1, 1) << 1, bs_scatter(v2, 1) << 1,
+                        bs_scatter(r3, 1) << 3, bs_scatter(r4, 1) << 3};
+  }
+
+  // Levels 2, 3 and 4 follow the same pattern with a gap of 2, 4 and 8.
+  static const unsigned lsbs[] = {126, 186, 242};
+  static const unsigned widths[] = {60, 56, 48};
+  unsigned gap = 1 << (level - 1);
+  uint64_t n = ri.bits(lsbs[level - 2], widths[level - 2]);
+  unsigned lower_bits = 2 * gap;
+  uint64_t lower = n & (((uint64_t)1 << lower_bits) - 1);
+  uint64_t upper = n >> lower_bits;
+  uint64_t p1 = bs_extract(lower, 2);
+  uint64_t p2 = bs_extract(lower >> 1, 2);
+  uint64_t r1 = bs_extract(upper, 4);
+  uint64_t r2 = bs_extract(upper >> 1, 4);
+  uint64_t r3 = bs_extract(upper >> 2, 4);
+  uint64_t r4 = bs_extract(upper >> 3, 4);
+  uint64_t v1 = p1 | r1 << gap;
+  uint64_t v2 = p2 | r2 << gap;
+  return UnpackedRand{bs_scatter(v1, gap) << gap, bs_scatter(v2, gap) << gap,
+                      bs_scatter(r3, gap) << (3 * gap),
+                      bs_scatter(r4, gap) << (3 * gap)};
+}
+
+struct SecAddStage {
+  Shares pg;
+  Shares pp;
+  Shares pre_p;
+  unsigned level;
+  Wide rand;
+};
+
+struct SecureAdder {
+  static const unsigned kLatency = 6;
+
+  std::optional<SecAddStage> stages[kLatency];
+  unsigned num_in_flight;
+
+  SecureAdder() : num_in_flight(0) {}
+
+  void push(const Shares &inp1, const Shares &inp2, const Wide &rand) {
+    stages[0] = precompute(inp1, inp2, rand);
+    ++num_in_flight;
+  }
+
+  void step(const Wide &rand) {
+    if (num_in_flight == 0)
+      return;
+    bool tail_was_set = stages[kLatency - 1].has_value();
+    for (unsigned si = kLatency - 1; si > 0; --si) {
+      if (stages[si - 1]) {
+        SecAddStage new_stage =
+            advance_level(*stages[si - 1], stages[si - 1]->rand);
+        new_stage.rand = rand;
+        stages[si] = new_stage;
+      } else {
+        stages[si].reset();
+      }
+    }
+    stages[0].reset();
+    if (tail_was_set)
+      --num_in_flight;
+  }
+
+  std::optional<Shares> peek() const {
+    if (!stages[kLatency - 1])
+      return std::nullopt;
+    return final_sum(*stages[kLatency - 1]);
+  }
+
+  static SecAddStage precompute(const Shares &inp1, const Shares &inp2,
+                                const Wide &rand) {
+    UnpackedRand ur = unpack_rand(0, rand);
+    Shares pg = hpc3_vec(inp1.first, inp1.second, inp2.first, inp2.second,
+                         ur.r_g, ur.rp_g);
+    Shares pre_p((inp1.first ^ inp2.first) & kMask32,
+                 (inp1.second ^ inp2.second) & kMask32);
+    return SecAddStage{Shares(pg.first & kMask32, pg.second & kMask32), pre_p,
+                       pre_p, 0, rand};
+  }
+
+  static SecAddStage advance_level(const SecAddStage &stage,
+                                   const Wide &rand) {
+    unsigned level = stage.level + 1;
+    unsigned lv_idx = level - 1;
+    unsigned step = 1 << lv_idx;
+    uint64_t pg_s0 = stage.pg.first, pg_s1 = stage.pg.second;
+    uint64_t pp_s0 = stage.pp.first, pp_s1 = stage.pp.second;
+    uint64_t gs = kBcastGs[lv_idx], fill = kBcastFill[lv_idx];
+    unsigned shift = step - 1;
+    uint64_t rem_pg_s0 = ((pg_s0 >> shift & gs) * fill) & kMask32;
+    uint64_t rem_pg_s1 = ((pg_s1 >> shift & gs) * fill) & kMask32;
+    uint64_t rem_pp_s0 = ((pp_s0 >> shift & gs) * fill) & kMask32;
+    uint64_t rem_pp_s1 = ((pp_s1 >> shift & gs) * fill) & kMask32;
+    UnpackedRand ur = unpack_rand(level, rand);
+    LevelMasks lm = level_masks(lv_idx);
+    Shares g = hpc3_vec(rem_pg_s0, rem_pg_s1, pp_s0, pp_s1, ur.r_g, ur.rp_g,
+                        pg_s0, pg_s1);
+    Shares p = hpc3_vec(rem_pp_s0, rem_pp_s1, pp_s0, pp_s1, ur.r_p, ur.rp_p);
+    uint64_t new_pg_s0 = (pg_s0 & lm.inv_active) | (g.first & lm.active_mask);
+    uint64_t new_pg_s1 = (pg_s1 & lm.inv_active) | (g.second & lm.active_mask);
+    uint64_t new_pp_s0 =
+        (pp_s0 & lm.feedthrough_pp_mask) | (p.first & lm.p_mask);
+    uint64_t new_pp_s1 =
+        (pp_s1 & lm.feedthrough_pp_mask) | (p.second & lm.p_mask);
+    return SecAddStage{Shares(new_pg_s0 & kMask32, new_pg_s1 & kMask32),
+                       Shares(new_pp_s0 & kMask32, new_pp_s1 & kMask32),
+                       stage.pre_p, level, Wide()};
+  }
+
+  static Shares final_sum(const SecAddStage &stage) {
+    uint64_t pg_s0 = stage.pg.first, pg_s1 = stage.pg.second;
+    uint64_t res_s0 = (stage.pre_p.first ^ ((pg_s0 << 1) & kMask32)) |
+                      (pg_s0 >> 31) << 32;
+    uint64_t res_s1 = (stage.pre_p.second ^ ((pg_s1 << 1) & kMask32)) |
+                      (pg_s1 >> 31) << 32;
+    return Shares(res_s0, res_s1);
+  }
+};
+
+struct MaskingAccelerator {
+  static const unsigned kVecSize = 8;
+
+  MaiOperation mode;
+  SecureAdder adder;
+  std::vector<Shares> output_queue;
+
+  std::optional<std::pair<Shares, Shares>> inp_reg;
+  std::vector<Shares> pass1_buf;
+  std::vector<uint32_t> mask_fifo;
+  std::vector<std::optional<uint64_t>> check_fifo;
+  unsigned pass1_adder_count;
+  unsigned pass2_fed;
+  bool in_pass2;
+  unsigned adder_outputs;
+
+  explicit MaskingAccelerator(MaiOperation mode_) : mode(mode_) {
+    reset_batch();
+  }
+
+  void reset_batch() {
+    inp_reg.reset();
+    pass1_buf.clear();
+    mask_fifo.clear();
+    check_fifo.clear();
+    pass1_adder_count = 0;
+    pass2_fed = 0;
+    in_pass2 = false;
+    adder_outputs = 0;
+  }
+
+  bool enable_mod() const { return mode != kMaiSecAdd; }
+
+  void push(uint32_t mod, uint32_t in0_s0, uint32_t in0_s1, uint32_t in1_s0,
+            uint32_t in1_s1, uint32_t mask_0, uint32_t mask_1) {
+    inp_reg = encode(in0_s0, in0_s1, in1_s0, in1_s1, mask_0, mask_1, mod);
+    if (mode == kMaiB2A)
+      mask_fifo.push_back(mask_0 & mod_smear(mod));
+    check_fifo.push_back(
+        calc_expected_unmasked(in0_s0, in0_s1, in1_s0, in1_s1, mod));
+  }
+
+  void step(uint32_t mod, const Wide &rand) {
+    std::optional<Shares> raw = adder.peek();
+    if (raw) {
+      ++adder_outputs;
+      if (enable_mod() && adder_outputs <= kVecSize)
+        pass1_buf.push_back(*raw);
+      else
+        emit_result(mod, *raw);
+      unsigned total_outputs = enable_mod() ? 2 * kVecSize : kVecSize;
+      if (adder_outputs == total_outputs) {
+        if (!mask_fifo.empty())
+          throw std::runtime_error("mask_fifo not empty at batch end");
+        if (!check_fifo.empty())
+          throw std::runtime_error("check_fifo not empty at batch end");
+        reset_batch();
+      }
+    }
+
+    adder.step(rand);
+
+    bool pushed_p1 = false;
+    if (inp_reg) {
+      adder.push(inp_reg->first, inp_reg->second, rand);
+      inp_reg.reset();
+      ++pass1_adder_count;
+      pushed_p1 = true;
+    }
+    if (enable_mod() && pass1_adder_count == kVecSize && !in_pass2 &&
+        !pushed_p1)
+      in_pass2 = true;
+    if (in_pass2 && !pushed_p1 && pass2_fed < kVecSize && !pass1_buf.empty()) {
+      Shares p1 = pass1_buf.front();
+      pass1_buf.erase(pass1_buf.begin());
+      uint64_t carry0 = (p1.first >> 32) & 1;
+      uint64_t carry1 = (p1.second >> 32) & 1;
+      Shares inp1(p1.first & kMask32, p1.second & kMask32);
+      Shares inp2(carry0 ? 0 : mod, carry1 ? mod : 0);
+      adder.push(inp1, inp2, rand);
+      ++pass2_fed;
+    }
+  }
+
+  std::optional<Shares> peek() {
+    if (output_queue.empty())
+      return std::nullopt;
+    Shares ret = output_queue.front();
+    output_queue.erase(output_queue.begin());
+    return ret;
+  }
+
+  bool is_busy() const {
+    return inp_reg || adder.num_in_flight > 0 || !pass1_buf.empty() ||
+           !output_queue.empty();
+  }
+
+  std::pair<Shares, Shares> encode(uint32_t in0_s0, uint32_t in0_s1,
+                                   uint32_t in1_s0, uint32_t in1_s1,
+                                   uint32_t mask_0, uint32_t mask_1,
+                                   uint32_t mod) const {
+    uint32_t mod_neg = -mod;
+    if (mode == kMaiA2B) {
+      return std::make_pair(Shares(in0_s0 ^ mask_0, mask_0),
+                            Shares((uint32_t)(in0_s1 + mod_neg) ^ mask_1,
+                                   mask_1));
+    }
+    if (mode == kMaiB2A) {
+      uint32_t mask_mod = mask_0 & mod_smear(mod);
+      return std::make_pair(Shares(in0_s0, in0_s1),
+                            Shares((uint32_t)-mask_mod ^ mask_1, mask_1));
+    }
+    return std::make_pair(Shares(in0_s0, in0_s1), Shares(in1_s0, in1_s1));
+  }
+
+  std::optional<uint64_t> calc_expected_unmasked(uint32_t in0_s0,
+                                                 uint32_t in0_s1,
+                                                 uint32_t in1_s0,
+                                                 uint32_t in1_s1,
+                                                 uint32_t mod) const {
+    uint64_t a = in0_s0 ^ in0_s1;
+    uint64_t b = in1_s0 ^ in1_s1;
+    if (mode == kMaiSecAdd)
+      return (a + b) & kMask32;
+    if (mod == 0)
+      return std::nullopt;
+    if (mode == kMaiSecAddMod) {
+      uint64_t true_sum = a + b;
+      if (true_sum >> 32)
+        return true_sum & kMask32;
+      return (true_sum + mod) & kMask32;
+    }
+    if (mode == kMaiA2B)
+      return ((uint64_t)in0_s0 + in0_s1) % mod;
+    return a % mod;
+  }
+
+  void check_unmasked_result(uint32_t mod, const Shares &result) {
+    std::optional<uint64_t> expected = check_fifo.front();
+    check_fifo.erase(check_fifo.begin());
+    if (!expected)
+      return;
+    uint64_t actual;
+    if (mode == kMaiB2A) {
+      if (mod == 0)
+        throw std::runtime_error("MAI B2A check with zero modulus");
+      actual = (result.first + result.second) % mod;
+    } else {
+      actual = (result.first & kMask32) ^ (result.second & kMask32);
+    }
+    if (actual != *expected) {
+      std::ostringstream oss;
+      oss << "MAI unmasked output mismatch: got 0x" << std::hex << actual
+          << ", expected 0x" << *expected;
+      throw std::runtime_error(oss.str());
+    }
+  }
+
+  void emit_result(uint32_t mod, const Shares &raw) {
+    Shares result;
+    if (mode == kMaiB2A) {
+      uint32_t mask_mod = mask_fifo.front();
+      mask_fifo.erase(mask_fifo.begin());
+      uint64_t diff = (raw.first & kMask32) ^ (raw.second & kMask32);
+      result = Shares(mask_mod, diff & mod_smear(mod));
+    } else {
+      result = Shares(raw.first & kMask32, raw.second & kMask32);
+    }
+    check_unmasked_result(mod, result);
+    output_queue.push_back(result);
+  }
+};
+
+struct MaskingAcceleratorInterface {
+  // These persist across operations (the Python model only resets them when
+  // the whole simulator is reset)
+  uint32_t cnt;
+  uint32_t wb_cnt;
+
+  MaskingAccelerator accel;
+  unsigned dispatch_idx;
+  bool is_dispatching;
+  unsigned writeback_idx;
+  bool pending_busy_clear;
+
+  MaskingAcceleratorInterface() : cnt(0), wb_cnt(0), accel(kMaiA2B) {
+    on_start();
+  }
+
+  void on_start() {
+    accel = MaskingAccelerator(kMaiA2B);
+    dispatch_idx = 0;
+    is_dispatching = false;
+    writeback_idx = 0;
+    pending_busy_clear = false;
+  }
+
+  void on_sec_wipe_zero_step(const WSRFile &wsrs) {
+    uint32_t new_cnt = urnd_fields(wsrs.URND.next_value).cnt;
+    cnt = new_cnt;
+    wb_cnt = new_cnt;
+  }
+
+  void step(CSRFile *csrs, WSRFile *wsrs) {
+    UrndFields fields = urnd_fields(wsrs->URND.value);
+    MaiStatusCSR &status = csrs->MAI_STATUS;
+    MaiCtrlCSR &ctrl = csrs->MAI_CTRL;
+
+    if (pending_busy_clear) {
+      pending_busy_clear = false;
+      status.update_busy_bit(false);
+    }
+    if (!is_dispatching && !status.is_busy() && !ctrl.is_start_bit_set())
+      return;
+
+    std::optional<Shares> results = accel.peek();
+    if (results) {
+      unsigned wb_idx = (wb_cnt + writeback_idx) % MaskingAccelerator::kVecSize;
+      wsrs->MAI_RES_S0.set_32bit_unsigned(results->first, wb_idx);
+      wsrs->MAI_RES_S1.set_32bit_unsigned(results->second, wb_idx);
+      ++writeback_idx;
+    }
+    if (writeback_idx >= MaskingAccelerator::kVecSize) {
+      writeback_idx = 0;
+      wb_cnt = cnt;
+      pending_busy_clear = true;
+    }
+
+    uint32_t mod = wsrs->MOD.read_unsigned().word(0);
+    accel.step(mod, fields.rand);
+
+    if (ctrl.is_start_bit_set()) {
+      ISS_ASSERT(!status.is_busy());
+      accel.mode = ctrl.current_operation();
+      is_dispatching = true;
+      status.update_busy_bit(true);
+      status.update_input_ready_bit(false);
+      ctrl.update_start_bit(false);
+    }
+
+    if (is_dispatching) {
+      bool b2a_stall = false;
+      if (ctrl.current_operation() == kMaiB2A) {
+        if (mod > 0 && (fields.mask_0 & mod_smear(mod)) >= mod)
+          b2a_stall = true;
+      }
+      if (!b2a_stall) {
+        unsigned idx = (cnt + dispatch_idx) % MaskingAccelerator::kVecSize;
+        accel.push(mod, wsrs->MAI_IN0_S0.read_32bit_unsigned(idx),
+                   wsrs->MAI_IN0_S1.read_32bit_unsigned(idx),
+                   wsrs->MAI_IN1_S0.read_32bit_unsigned(idx),
+                   wsrs->MAI_IN1_S1.read_32bit_unsigned(idx), fields.mask_0,
+                   fields.mask_1);
+        ++dispatch_idx;
+      }
+    }
+
+    if (dispatch_idx >= MaskingAccelerator::kVecSize) {
+      dispatch_idx = 0;
+      is_dispatching = false;
+      cnt = urnd_fields(wsrs->URND.value).cnt;
+      status.update_input_ready_bit(true);
+    }
+  }
+
+  bool is_valid_ctrl_change(const CSRFile &csrs, uint32_t value) const {
+    const MaiCtrlCSR &ctrl = csrs.MAI_CTRL;
+    if (MaiCtrlCSR::has_reserved_bits(value))
+      return false;
+    bool busy = csrs.MAI_STATUS.is_busy();
+    if (busy && ctrl.would_change_raw_op(value))
+      return false;
+    if (MaiCtrlCSR::would_set_start_bit(value)) {
+      if (busy)
+        return false;
+      if (!MaiCtrlCSR::is_raw_op_valid(value))
+        return false;
+    }
+    return true;
+  }
+};
+
+// ---------------------------------------------------------------------------
+// Instruction decoding (decode.py and the encodings in data/insns.yml)
+
+enum InsnKind {
+  kInsnAdd,
+  kInsnAddi,
+  kInsnLui,
+  kInsnSub,
+  kInsnSll,
+  kInsnSlli,
+  kInsnSrl,
+  kInsnSrli,
+  kInsnSra,
+  kInsnSrai,
+  kInsnAnd,
+  kInsnAndi,
+  kInsnOr,
+  kInsnOri,
+  kInsnXor,
+  kInsnXori,
+  kInsnLw,
+  kInsnSw,
+  kInsnBeq,
+  kInsnBne,
+  kInsnJal,
+  kInsnJalr,
+  kInsnCsrrs,
+  kInsnCsrrw,
+  kInsnEcall,
+  kInsnWfi,
+  kInsnLoop,
+  kInsnLoopi,
+  kInsnBnAdd,
+  kInsnBnAddc,
+  kInsnBnAddi,
+  kInsnBnAddm,
+  kInsnBnMulqacc,
+  kInsnBnMulqaccWo,
+  kInsnBnMulqaccSo,
+  kInsnBnSub,
+  kInsnBnSubb,
+  kInsnBnSubi,
+  kInsnBnSubm,
+  kInsnBnAnd,
+  kInsnBnOr,
+  kInsnBnNot,
+  kInsnBnXor,
+  kInsnBnRshi,
+  kInsnBnSel,
+  kInsnBnCmp,
+  kInsnBnCmpb,
+  kInsnBnLid,
+  kInsnBnSid,
+  kInsnBnMov,
+  kInsnBnMovr,
+  kInsnBnWsrr,
+  kInsnBnWsrw,
+  kInsnBnAddv,
+  kInsnBnAddvm,
+  kInsnBnSubv,
+  kInsnBnSubvm,
+  kInsnBnMulv,
+  kInsnBnMulvl,
+  kInsnBnMulvm,
+  kInsnBnMulvml,
+  kInsnBnTrn1,
+  kInsnBnTrn2,
+  kInsnBnShv,
+  kInsnBnUnpk,
+  kInsnBnPack
+};
+
+// The operand values of a decoded instruction. Each field has the name of the
+// operand in insns.yml. Fields that the instruction doesn't use are zero.
+struct Ops {
+  int64_t grd, grs, grs1, grs2, wrd, wrs, wrs1, wrs2;
+  int64_t imm, shamt, offset, csr, wsr;
+  int64_t bodysize, iterations;
+  int64_t shift_type, shift_bits, flag_group, flag;
+  int64_t zero_acc, wrs1_qwsel, wrs2_qwsel, acc_shift_imm, wrd_hwsel;
+  int64_t grd_inc, grs_inc, grs1_inc, grs2_inc;
+  int64_t elen, lane;
+};
+
+// How to extract an operand from an encoded instruction. The bit ranges are
+// concatenated, most significant first, to give the encoded value. This is
+// then converted to an operand value like enc_val_to_op_val in operand.py.
+struct OpField {
+  int64_t Ops::*dst;
+  unsigned num_ranges;
+  unsigned ranges[4][2];
+  bool is_signed;
+  unsigned shift;
+  int enc_offset;
+  bool pc_rel;
+};
+
+struct InsnDesc {
+  const char *mnemonic;
+  InsnKind kind;
+  // A word encodes this instruction if it has no bits from m0 set and all
+  // the bits of m1 set (see InsnsFile.mnem_for_word)
+  uint32_t m0, m1;
+  bool affects_control;
+  bool has_fetch_stall;
+  unsigned num_fields;
+  OpField fields[9];
+};
+
+// This table must be kept in sync with insns.yml. It has the same order as
+// INSN_CLASSES in insn.py.
+const InsnDesc kInsnDescs[] = {
+    {"add", kInsnAdd, 0xfe00704c, 0x00000033, 0, 0, 3, {
+        {&Ops::grd, 1, {{11, 7}}, 0, 0, 0, 0},
+        {&Ops::grs1, 1, {{19, 15}}, 0, 0, 0, 0},
+        {&Ops::grs2, 1, {{24, 20}}, 0, 0, 0, 0}}},
+    {"addi", kInsnAddi, 0x0000706c, 0x00000013, 0, 0, 3, {
+        {&Ops::grd, 1, {{11, 7}}, 0, 0, 0, 0},
+        {&Ops::grs1, 1, {{19, 15}}, 0, 0, 0, 0},
+        {&Ops::imm, 1, {{31, 20}}, 1, 0, 0, 0}}},
+    {"lui", kInsnLui, 0x00000048, 0x00000037, 0, 0, 2, {
+        {&Ops::grd, 1, {{11, 7}}, 0, 0, 0, 0},
+        {&Ops::imm, 1, {{31, 12}}, 0, 0, 0, 0}}},
+    {"sub", kInsnSub, 0xbe00704c, 0x40000033, 0, 0, 3, {
+        {&Ops::grd, 1, {{11, 7}}, 0, 0, 0, 0},
+        {&Ops::grs1, 1, {{19, 15}}, 0, 0, 0, 0},
+        {&Ops::grs2, 1, {{24, 20}}, 0, 0, 0, 0}}},
+    {"sll", kInsnSll, 0xfe00604c, 0x00001033, 0, 0, 3, {
+        {&Ops::grd, 1, {{11, 7}}, 0, 0, 0, 0},
+        {&Ops::grs1, 1, {{19, 15}}, 0, 0, 0, 0},
+        {&Ops::grs2, 1, {{24, 20}}, 0, 0, 0, 0}}},
+    {"slli", kInsnSlli, 0xfe00606c, 0x00001013, 0, 0, 3, {
+        {&Ops::grd, 1, {{11, 7}}, 0, 0, 0, 0},
+        {&Ops::grs1, 1, {{19, 15}}, 0, 0, 0, 0},
+        {&Ops::shamt, 1, {{24, 20}}, 0, 0, 0, 0}}},
+    {"srl", kInsnSrl, 0xfe00204c, 0x00005033, 0, 0, 3, {
+        {&Ops::grd, 1, {{11, 7}}, 0, 0, 0, 0},
+        {&Ops::grs1, 1, {{19, 15}}, 0, 0, 0, 0},
+        {&Ops::grs2, 1, {{24, 20}}, 0, 0, 0, 0}}},
+    {"srli", kInsnSrli, 0xfe00206c, 0x00005013, 0, 0, 3, {
+        {&Ops::grd, 1, {{11, 7}}, 0, 0, 0, 0},
+        {&Ops::grs1, 1, {{19, 15}}, 0, 0, 0, 0},
+        {&Ops::shamt, 1, {{24, 20}}, 0, 0, 0, 0}}},
+    {"sra", kInsnSra, 0xbe00204c, 0x40005033, 0, 0, 3, {
+        {&Ops::grd, 1, {{11, 7}}, 0, 0, 0, 0},
+        {&Ops::grs1, 1, {{19, 15}}, 0, 0, 0, 0},
+        {&Ops::grs2, 1, {{24, 20}}, 0, 0, 0, 0}}},
+    {"srai", kInsnSrai, 0xbe00206c, 0x40005013, 0, 0, 3, {
+        {&Ops::grd, 1, {{11, 7}}, 0, 0, 0, 0},
+        {&Ops::grs1, 1, {{19, 15}}, 0, 0, 0, 0},
+        {&Ops::shamt, 1, {{24, 20}}, 0, 0, 0, 0}}},
+    {"and", kInsnAnd, 0xfe00004c, 0x00007033, 0, 0, 3, {
+        {&Ops::grd, 1, {{11, 7}}, 0, 0, 0, 0},
+        {&Ops::grs1, 1, {{19, 15}}, 0, 0, 0, 0},
+        {&Ops::grs2, 1, {{24, 20}}, 0, 0, 0, 0}}},
+    {"andi", kInsnAndi, 0x0000006c, 0x00007013, 0, 0, 3, {
+        {&Ops::grd, 1, {{11, 7}}, 0, 0, 0, 0},
+        {&Ops::grs1, 1, {{19, 15}}, 0, 0, 0, 0},
+        {&Ops::imm, 1, {{31, 20}}, 1, 0, 0, 0}}},
+    {"or", kInsnOr, 0xfe00104c, 0x00006033, 0, 0, 3, {
+        {&Ops::grd, 1, {{11, 7}}, 0, 0, 0, 0},
+        {&Ops::grs1, 1, {{19, 15}}, 0, 0, 0, 0},
+        {&Ops::grs2, 1, {{24, 20}}, 0, 0, 0, 0}}},
+    {"ori", kInsnOri, 0x0000106c, 0x00006013, 0, 0, 3, {
+        {&Ops::grd, 1, {{11, 7}}, 0, 0, 0, 0},
+        {&Ops::grs1, 1, {{19, 15}}, 0, 0, 0, 0},
+        {&Ops::imm, 1, {{31, 20}}, 1, 0, 0, 0}}},
+    {"xor", kInsnXor, 0xfe00304c, 0x00004033, 0, 0, 3, {
+        {&Ops::grd, 1, {{11, 7}}, 0, 0, 0, 0},
+        {&Ops::grs1, 1, {{19, 15}}, 0, 0, 0, 0},
+        {&Ops::grs2, 1, {{24, 20}}, 0, 0, 0, 0}}},
+    {"xori", kInsnXori, 0x0000306c, 0x00004013, 0, 0, 3, {
+        {&Ops::grd, 1, {{11, 7}}, 0, 0, 0, 0},
+        {&Ops::grs1, 1, {{19, 15}}, 0, 0, 0, 0},
+        {&Ops::imm, 1, {{31, 20}}, 1, 0, 0, 0}}},
+    {"lw", kInsnLw, 0x0000507c, 0x00002003, 0, 0, 3, {
+        {&Ops::grd, 1, {{11, 7}}, 0, 0, 0, 0},
+        {&Ops::offset, 1, {{31, 20}}, 1, 0, 0, 0},
+        {&Ops::grs1, 1, {{19, 15}}, 0, 0, 0, 0}}},
+    {"sw", kInsnSw, 0x0000505c, 0x00002023, 0, 0, 3, {
+        {&Ops::grs2, 1, {{24, 20}}, 0, 0, 0, 0},
+        {&Ops::offset, 2, {{31, 25}, {11, 7}}, 1, 0, 0, 0},
+        {&Ops::grs1, 1, {{19, 15}}, 0, 0, 0, 0}}},
+    {"beq", kInsnBeq, 0x0000701c, 0x00000063, 1, 1, 3, {
+        {&Ops::grs1, 1, {{19, 15}}, 0, 0, 0, 0},
+        {&Ops::grs2, 1, {{24, 20}}, 0, 0, 0, 0},
+        {&Ops::offset, 4, {{31, 31}, {7, 7}, {30, 25}, {11, 8}}, 1, 1, 0, 1}}},
+    {"bne", kInsnBne, 0x0000601c, 0x00001063, 1, 1, 3, {
+        {&Ops::grs1, 1, {{19, 15}}, 0, 0, 0, 0},
+        {&Ops::grs2, 1, {{24, 20}}, 0, 0, 0, 0},
+        {&Ops::offset, 4, {{31, 31}, {7, 7}, {30, 25}, {11, 8}}, 1, 1, 0, 1}}},
+    {"jal", kInsnJal, 0x00000010, 0x0000006f, 1, 1, 2, {
+        {&Ops::grd, 1, {{11, 7}}, 0, 0, 0, 0},
+        {&Ops::offset, 4, {{31, 31}, {19, 12}, {20, 20}, {30, 21}},
+         1, 1, 0, 1}}},
+    {"jalr", kInsnJalr, 0x00007018, 0x00000067, 1, 1, 3, {
+        {&Ops::grd, 1, {{11, 7}}, 0, 0, 0, 0},
+        {&Ops::grs1, 1, {{19, 15}}, 0, 0, 0, 0},
+        {&Ops::offset, 1, {{31, 20}}, 1, 0, 0, 0}}},
+    {"csrrs", kInsnCsrrs, 0x0000500c, 0x00002073, 0, 0, 3, {
+        {&Ops::grd, 1, {{11, 7}}, 0, 0, 0, 0},
+        {&Ops::csr, 1, {{31, 20}}, 0, 0, 0, 0},
+        {&Ops::grs1, 1, {{19, 15}}, 0, 0, 0, 0}}},
+    {"csrrw", kInsnCsrrw, 0x0000600c, 0x00001073, 0, 0, 3, {
+        {&Ops::grd, 1, {{11, 7}}, 0, 0, 0, 0},
+        {&Ops::csr, 1, {{31, 20}}, 0, 0, 0, 0},
+        {&Ops::grs1, 1, {{19, 15}}, 0, 0, 0, 0}}},
+    {"ecall", kInsnEcall, 0xffffff8c, 0x00000073, 0, 0, 0, {
+}},
+    {"wfi", kInsnWfi, 0xefafff8c, 0x10500073, 0, 0, 0, {
+}},
+    {"loop", kInsnLoop, 0x00007004, 0x0000007b, 1, 0, 2, {
+        {&Ops::grs, 1, {{19, 15}}, 0, 0, 0, 0},
+        {&Ops::bodysize, 1, {{31, 20}}, 0, 0, 1, 0}}},
+    {"loopi", kInsnLoopi, 0x00006004, 0x0000107b, 1, 0, 2, {
+        {&Ops::iterations, 2, {{19, 15}, {11, 7}}, 0, 0, 0, 0},
+        {&Ops::bodysize, 1, {{31, 20}}, 0, 0, 1, 0}}},
+    {"bn.add", kInsnBnAdd, 0x00007054, 0x0000002b, 0, 0, 6, {
+        {&Ops::wrd, 1, {{11, 7}}, 0, 0, 0, 0},
+        {&Ops::wrs1, 1, {{19, 15}}, 0, 0, 0, 0},
+        {&Ops::wrs2, 1, {{24, 20}}, 0, 0, 0, 0},
+        {&Ops::shift_type, 1, {{30, 30}}, 0, 0, 0, 0},
+        {&Ops::shift_bits, 1, {{29, 25}}, 0, 3, 0, 0},
+        {&Ops::flag_group, 1, {{31, 31}}, 0, 0, 0, 0}}},
+    {"bn.addc", kInsnBnAddc, 0x00005054, 0x0000202b, 0, 0, 6, {
+        {&Ops::wrd, 1, {{11, 7}}, 0, 0, 0, 0},
+        {&Ops::wrs1, 1, {{19, 15}}, 0, 0, 0, 0},
+        {&Ops::wrs2, 1, {{24, 20}}, 0, 0, 0, 0},
+        {&Ops::shift_type, 1, {{30, 30}}, 0, 0, 0, 0},
+        {&Ops::shift_bits, 1, {{29, 25}}, 0, 3, 0, 0},
+        {&Ops::flag_group, 1, {{31, 31}}, 0, 0, 0, 0}}},
+    {"bn.addi", kInsnBnAddi, 0x40003054, 0x0000402b, 0, 0, 4, {
+        {&Ops::wrd, 1, {{11, 7}}, 0, 0, 0, 0},
+        {&Ops::wrs, 1, {{19, 15}}, 0, 0, 0, 0},
+        {&Ops::imm, 1, {{29, 20}}, 0, 0, 0, 0},
+        {&Ops::flag_group, 1, {{31, 31}}, 0, 0, 0, 0}}},
+    {"bn.addm", kInsnBnAddm, 0x40002054, 0x0000502b, 0, 0, 3, {
+        {&Ops::wrd, 1, {{11, 7}}, 0, 0, 0, 0},
+        {&Ops::wrs1, 1, {{19, 15}}, 0, 0, 0, 0},
+        {&Ops::wrs2, 1, {{24, 20}}, 0, 0, 0, 0}}},
+    {"bn.mulqacc", kInsnBnMulqacc, 0x60000044, 0x0000003b, 0, 0, 6, {
+        {&Ops::zero_acc, 1, {{12, 12}}, 0, 0, 0, 0},
+        {&Ops::wrs1, 1, {{19, 15}}, 0, 0, 0, 0},
+        {&Ops::wrs1_qwsel, 1, {{26, 25}}, 0, 0, 0, 0},
+        {&Ops::wrs2, 1, {{24, 20}}, 0, 0, 0, 0},
+        {&Ops::wrs2_qwsel, 1, {{28, 27}}, 0, 0, 0, 0},
+        {&Ops::acc_shift_imm, 1, {{14, 13}}, 0, 6, 0, 0}}},
+    {"bn.mulqacc.wo", kInsnBnMulqaccWo, 0x40000044, 0x2000003b, 0, 0, 8, {
+        {&Ops::zero_acc, 1, {{12, 12}}, 0, 0, 0, 0},
+        {&Ops::wrd, 1, {{11, 7}}, 0, 0, 0, 0},
+        {&Ops::wrs1, 1, {{19, 15}}, 0, 0, 0, 0},
+        {&Ops::wrs1_qwsel, 1, {{26, 25}}, 0, 0, 0, 0},
+        {&Ops::wrs2, 1, {{24, 20}}, 0, 0, 0, 0},
+        {&Ops::wrs2_qwsel, 1, {{28, 27}}, 0, 0, 0, 0},
+        {&Ops::acc_shift_imm, 1, {{14, 13}}, 0, 6, 0, 0},
+        {&Ops::flag_group, 1, {{31, 31}}, 0, 0, 0, 0}}},
+    {"bn.mulqacc.so", kInsnBnMulqaccSo, 0x00000044, 0x4000003b, 0, 0, 9, {
+        {&Ops::zero_acc, 1, {{12, 12}}, 0, 0, 0, 0},
+        {&Ops::wrd, 1, {{11, 7}}, 0, 0, 0, 0},
+        {&Ops::wrd_hwsel, 1, {{29, 29}}, 0, 0, 0, 0},
+        {&Ops::wrs1, 1, {{19, 15}}, 0, 0, 0, 0},
+        {&Ops::wrs1_qwsel, 1, {{26, 25}}, 0, 0, 0, 0},
+        {&Ops::wrs2, 1, {{24, 20}}, 0, 0, 0, 0},
+        {&Ops::wrs2_qwsel, 1, {{28, 27}}, 0, 0, 0, 0},
+        {&Ops::acc_shift_imm, 1, {{14, 13}}, 0, 6, 0, 0},
+        {&Ops::flag_group, 1, {{31, 31}}, 0, 0, 0, 0}}},
+    {"bn.sub", kInsnBnSub, 0x00006054, 0x0000102b, 0, 0, 6, {
+        {&Ops::wrd, 1, {{11, 7}}, 0, 0, 0, 0},
+        {&Ops::wrs1, 1, {{19, 15}}, 0, 0, 0, 0},
+        {&Ops::wrs2, 1, {{24, 20}}, 0, 0, 0, 0},
+        {&Ops::shift_type, 1, {{30, 30}}, 0, 0, 0, 0},
+        {&Ops::shift_bits, 1, {{29, 25}}, 0, 3, 0, 0},
+        {&Ops::flag_group, 1, {{31, 31}}, 0, 0, 0, 0}}},
+    {"bn.subb", kInsnBnSubb, 0x00004054, 0x0000302b, 0, 0, 6, {
+        {&Ops::wrd, 1, {{11, 7}}, 0, 0, 0, 0},
+        {&Ops::wrs1, 1, {{19, 15}}, 0, 0, 0, 0},
+        {&Ops::wrs2, 1, {{24, 20}}, 0, 0, 0, 0},
+        {&Ops::shift_type, 1, {{30, 30}}, 0, 0, 0, 0},
+        {&Ops::shift_bits, 1, {{29, 25}}, 0, 3, 0, 0},
+        {&Ops::flag_group, 1, {{31, 31}}, 0, 0, 0, 0}}},
+    {"bn.subi", kInsnBnSubi, 0x00003054, 0x4000402b, 0, 0, 4, {
+        {&Ops::wrd, 1, {{11, 7}}, 0, 0, 0, 0},
+        {&Ops::wrs, 1, {{19, 15}}, 0, 0, 0, 0},
+        {&Ops::imm, 1, {{29, 20}}, 0, 0, 0, 0},
+        {&Ops::flag_group, 1, {{31, 31}}, 0, 0, 0, 0}}},
+    {"bn.subm", kInsnBnSubm, 0x00002054, 0x4000502b, 0, 0, 3, {
+        {&Ops::wrd, 1, {{11, 7}}, 0, 0, 0, 0},
+        {&Ops::wrs1, 1, {{19, 15}}, 0, 0, 0, 0},
+        {&Ops::wrs2, 1, {{24, 20}}, 0, 0, 0, 0}}},
+    {"bn.and", kInsnBnAnd, 0x00005004, 0x0000207b, 0, 0, 6, {
+        {&Ops::wrd, 1, {{11, 7}}, 0, 0, 0, 0},
+        {&Ops::wrs1, 1, {{19, 15}}, 0, 0, 0, 0},
+        {&Ops::wrs2, 1, {{24, 20}}, 0, 0, 0, 0},
+        {&Ops::shift_type, 1, {{30, 30}}, 0, 0, 0, 0},
+        {&Ops::shift_bits, 1, {{29, 25}}, 0, 3, 0, 0},
+        {&Ops::flag_group, 1, {{31, 31}}, 0, 0, 0, 0}}},
+    {"bn.or", kInsnBnOr, 0x00003004, 0x0000407b, 0, 0, 6, {
+        {&Ops::wrd, 1, {{11, 7}}, 0, 0, 0, 0},
+        {&Ops::wrs1, 1, {{19, 15}}, 0, 0, 0, 0},
+        {&Ops::wrs2, 1, {{24, 20}}, 0, 0, 0, 0},
+        {&Ops::shift_type, 1, {{30, 30}}, 0, 0, 0, 0},
+        {&Ops::shift_bits, 1, {{29, 25}}, 0, 3, 0, 0},
+        {&Ops::flag_group, 1, {{31, 31}}, 0, 0, 0, 0}}},
+    {"bn.not", kInsnBnNot, 0x00002004, 0x0000507b, 0, 0, 5, {
+        {&Ops::wrd, 1, {{11, 7}}, 0, 0, 0, 0},
+        {&Ops::wrs, 1, {{24, 20}}, 0, 0, 0, 0},
+        {&Ops::shift_type, 1, {{30, 30}}, 0, 0, 0, 0},
+        {&Ops::shift_bits, 1, {{29, 25}}, 0, 3, 0, 0},
+        {&Ops::flag_group, 1, {{31, 31}}, 0, 0, 0, 0}}},
+    {"bn.xor", kInsnBnXor, 0x00001004, 0x0000607b, 0, 0, 6, {
+        {&Ops::wrd, 1, {{11, 7}}, 0, 0, 0, 0},
+        {&Ops::wrs1, 1, {{19, 15}}, 0, 0, 0, 0},
+        {&Ops::wrs2, 1, {{24, 20}}, 0, 0, 0, 0},
+        {&Ops::shift_type, 1, {{30, 30}}, 0, 0, 0, 0},
+        {&Ops::shift_bits, 1, {{29, 25}}, 0, 3, 0, 0},
+        {&Ops::flag_group, 1, {{31, 31}}, 0, 0, 0, 0}}},
+    {"bn.rshi", kInsnBnRshi, 0x00000004, 0x0000307b, 0, 0, 4, {
+        {&Ops::wrd, 1, {{11, 7}}, 0, 0, 0, 0},
+        {&Ops::wrs1, 1, {{19, 15}}, 0, 0, 0, 0},
+        {&Ops::wrs2, 1, {{24, 20}}, 0, 0, 0, 0},
+        {&Ops::imm, 2, {{31, 25}, {14, 14}}, 0, 0, 0, 0}}},
+    {"bn.sel", kInsnBnSel, 0x00007074, 0x0000000b, 0, 0, 5, {
+        {&Ops::wrd, 1, {{11, 7}}, 0, 0, 0, 0},
+        {&Ops::wrs1, 1, {{19, 15}}, 0, 0, 0, 0},
+        {&Ops::wrs2, 1, {{24, 20}}, 0, 0, 0, 0},
+        {&Ops::flag_group, 1, {{31, 31}}, 0, 0, 0, 0},
+        {&Ops::flag, 1, {{26, 25}}, 0, 0, 0, 0}}},
+    {"bn.cmp", kInsnBnCmp, 0x00006074, 0x0000100b, 0, 0, 5, {
+        {&Ops::wrs1, 1, {{19, 15}}, 0, 0, 0, 0},
+        {&Ops::wrs2, 1, {{24, 20}}, 0, 0, 0, 0},
+        {&Ops::shift_type, 1, {{30, 30}}, 0, 0, 0, 0},
+        {&Ops::shift_bits, 1, {{29, 25}}, 0, 3, 0, 0},
+        {&Ops::flag_group, 1, {{31, 31}}, 0, 0, 0, 0}}},
+    {"bn.cmpb", kInsnBnCmpb, 0x00004074, 0x0000300b, 0, 0, 5, {
+        {&Ops::wrs1, 1, {{19, 15}}, 0, 0, 0, 0},
+        {&Ops::wrs2, 1, {{24, 20}}, 0, 0, 0, 0},
+        {&Ops::shift_type, 1, {{30, 30}}, 0, 0, 0, 0},
+        {&Ops::shift_bits, 1, {{29, 25}}, 0, 3, 0, 0},
+        {&Ops::flag_group, 1, {{31, 31}}, 0, 0, 0, 0}}},
+    {"bn.lid", kInsnBnLid, 0x00003074, 0x0000400b, 0, 0, 5, {
+        {&Ops::grd, 1, {{24, 20}}, 0, 0, 0, 0},
+        {&Ops::grs1, 1, {{19, 15}}, 0, 0, 0, 0},
+        {&Ops::offset, 2, {{11, 9}, {31, 25}}, 1, 5, 0, 0},
+        {&Ops::grs1_inc, 1, {{8, 8}}, 0, 0, 0, 0},
+        {&Ops::grd_inc, 1, {{7, 7}}, 0, 0, 0, 0}}},
+    {"bn.sid", kInsnBnSid, 0x00002074, 0x0000500b, 0, 0, 5, {
+        {&Ops::grs1, 1, {{19, 15}}, 0, 0, 0, 0},
+        {&Ops::grs2, 1, {{24, 20}}, 0, 0, 0, 0},
+        {&Ops::offset, 2, {{11, 9}, {31, 25}}, 1, 5, 0, 0},
+        {&Ops::grs1_inc, 1, {{8, 8}}, 0, 0, 0, 0},
+        {&Ops::grs2_inc, 1, {{7, 7}}, 0, 0, 0, 0}}},
+    {"bn.mov", kInsnBnMov, 0x80001074, 0x0000600b, 0, 0, 2, {
+        {&Ops::wrd, 1, {{11, 7}}, 0, 0, 0, 0},
+        {&Ops::wrs, 1, {{19, 15}}, 0, 0, 0, 0}}},
+    {"bn.movr", kInsnBnMovr, 0x00001074, 0x8000600b, 0, 0, 4, {
+        {&Ops::grd, 1, {{24, 20}}, 0, 0, 0, 0},
+        {&Ops::grs, 1, {{19, 15}}, 0, 0, 0, 0},
+        {&Ops::grd_inc, 1, {{7, 7}}, 0, 0, 0, 0},
+        {&Ops::grs_inc, 1, {{9, 9}}, 0, 0, 0, 0}}},
+    {"bn.wsrr", kInsnBnWsrr, 0x80000074, 0x0000700b, 0, 0, 2, {
+        {&Ops::wrd, 1, {{11, 7}}, 0, 0, 0, 0},
+        {&Ops::wsr, 1, {{27, 20}}, 0, 0, 0, 0}}},
+    {"bn.wsrw", kInsnBnWsrw, 0x00000074, 0x8000700b, 0, 0, 2, {
+        {&Ops::wsr, 1, {{27, 20}}, 0, 0, 0, 0},
+        {&Ops::wrs, 1, {{19, 15}}, 0, 0, 0, 0}}},
+    {"bn.addv", kInsnBnAddv, 0x50007024, 0x0000005b, 0, 0, 4, {
+        {&Ops::elen, 1, {{26, 25}}, 0, 0, 0, 0},
+        {&Ops::wrd, 1, {{11, 7}}, 0, 0, 0, 0},
+        {&Ops::wrs1, 1, {{19, 15}}, 0, 0, 0, 0},
+        {&Ops::wrs2, 1, {{24, 20}}, 0, 0, 0, 0}}},
+    {"bn.addvm", kInsnBnAddvm, 0x40007024, 0x1000005b, 0, 0, 4, {
+        {&Ops::elen, 1, {{26, 25}}, 0, 0, 0, 0},
+        {&Ops::wrd, 1, {{11, 7}}, 0, 0, 0, 0},
+        {&Ops::wrs1, 1, {{19, 15}}, 0, 0, 0, 0},
+        {&Ops::wrs2, 1, {{24, 20}}, 0, 0, 0, 0}}},
+    {"bn.subv", kInsnBnSubv, 0x10007024, 0x4000005b, 0, 0, 4, {
+        {&Ops::elen, 1, {{26, 25}}, 0, 0, 0, 0},
+        {&Ops::wrd, 1, {{11, 7}}, 0, 0, 0, 0},
+        {&Ops::wrs1, 1, {{19, 15}}, 0, 0, 0, 0},
+        {&Ops::wrs2, 1, {{24, 20}}, 0, 0, 0, 0}}},
+    {"bn.subvm", kInsnBnSubvm, 0x00007024, 0x5000005b, 0, 0, 4, {
+        {&Ops::elen, 1, {{26, 25}}, 0, 0, 0, 0},
+        {&Ops::wrd, 1, {{11, 7}}, 0, 0, 0, 0},
+        {&Ops::wrs1, 1, {{19, 15}}, 0, 0, 0, 0},
+        {&Ops::wrs2, 1, {{24, 20}}, 0, 0, 0, 0}}},
+    {"bn.mulv", kInsnBnMulv, 0x08004024, 0x0000305b, 0, 0, 4, {
+        {&Ops::elen, 1, {{26, 25}}, 0, 0, 0, 0},
+        {&Ops::wrd, 1, {{11, 7}}, 0, 0, 0, 0},
+        {&Ops::wrs1, 1, {{19, 15}}, 0, 0, 0, 0},
+        {&Ops::wrs2, 1, {{24, 20}}, 0, 0, 0, 0}}},
+    {"bn.mulvl", kInsnBnMulvl, 0x00004024, 0x0800305b, 0, 0, 5, {
+        {&Ops::elen, 1, {{26, 25}}, 0, 0, 0, 0},
+        {&Ops::wrd, 1, {{11, 7}}, 0, 0, 0, 0},
+        {&Ops::wrs1, 1, {{19, 15}}, 0, 0, 0, 0},
+        {&Ops::wrs2, 1, {{24, 20}}, 0, 0, 0, 0},
+        {&Ops::lane, 1, {{30, 28}}, 0, 0, 0, 0}}},
+    {"bn.mulvm", kInsnBnMulvm, 0x08003024, 0x0000405b, 0, 0, 4, {
+        {&Ops::elen, 1, {{26, 25}}, 0, 0, 0, 0},
+        {&Ops::wrd, 1, {{11, 7}}, 0, 0, 0, 0},
+        {&Ops::wrs1, 1, {{19, 15}}, 0, 0, 0, 0},
+        {&Ops::wrs2, 1, {{24, 20}}, 0, 0, 0, 0}}},
+    {"bn.mulvml", kInsnBnMulvml, 0x00003024, 0x0800405b, 0, 0, 5, {
+        {&Ops::elen, 1, {{26, 25}}, 0, 0, 0, 0},
+        {&Ops::wrd, 1, {{11, 7}}, 0, 0, 0, 0},
+        {&Ops::wrs1, 1, {{19, 15}}, 0, 0, 0, 0},
+        {&Ops::wrs2, 1, {{24, 20}}, 0, 0, 0, 0},
+        {&Ops::lane, 1, {{30, 28}}, 0, 0, 0, 0}}},
+    {"bn.trn1", kInsnBnTrn1, 0x40002024, 0x0000505b, 0, 0, 4, {
+        {&Ops::elen, 1, {{26, 25}}, 0, 0, 0, 0},
+        {&Ops::wrd, 1, {{11, 7}}, 0, 0, 0, 0},
+        {&Ops::wrs1, 1, {{19, 15}}, 0, 0, 0, 0},
+        {&Ops::wrs2, 1, {{24, 20}}, 0, 0, 0, 0}}},
+    {"bn.trn2", kInsnBnTrn2, 0x00002024, 0x4000505b, 0, 0, 4, {
+        {&Ops::elen, 1, {{26, 25}}, 0, 0, 0, 0},
+        {&Ops::wrd, 1, {{11, 7}}, 0, 0, 0, 0},
+        {&Ops::wrs1, 1, {{19, 15}}, 0, 0, 0, 0},
+        {&Ops::wrs2, 1, {{24, 20}}, 0, 0, 0, 0}}},
+    {"bn.shv", kInsnBnShv, 0x00000024, 0x0000705b, 0, 0, 5, {
+        {&Ops::elen, 1, {{26, 25}}, 0, 0, 0, 0},
+        {&Ops::wrd, 1, {{11, 7}}, 0, 0, 0, 0},
+        {&Ops::wrs, 1, {{24, 20}}, 0, 0, 0, 0},
+        {&Ops::shift_type, 1, {{30, 30}}, 0, 0, 0, 0},
+        {&Ops::shift_bits, 1, {{19, 15}}, 0, 0, 0, 0}}},
+    {"bn.unpk", kInsnBnUnpk, 0x40001024, 0x0000605b, 0, 0, 4, {
+        {&Ops::wrd, 1, {{11, 7}}, 0, 0, 0, 0},
+        {&Ops::wrs1, 1, {{19, 15}}, 0, 0, 0, 0},
+        {&Ops::wrs2, 1, {{24, 20}}, 0, 0, 0, 0},
+        {&Ops::shift_bits, 1, {{28, 27}}, 0, 6, 0, 0}}},
+    {"bn.pack", kInsnBnPack, 0x00001024, 0x4000605b, 0, 0, 4, {
+        {&Ops::wrd, 1, {{11, 7}}, 0, 0, 0, 0},
+        {&Ops::wrs1, 1, {{19, 15}}, 0, 0, 0, 0},
+        {&Ops::wrs2, 1, {{24, 20}}, 0, 0, 0, 0},
+        {&Ops::shift_bits, 1, {{28, 27}}, 0, 6, 0, 0}}}
+};
+
+// A decoded instruction. Like the Python model, we use a "dummy" instruction
+// (with no descriptor) for words that don't decode (IllegalInsn) and for
+// words that have no valid data (EmptyInsn).
+struct Insn {
+  const InsnDesc *desc;
+  uint32_t raw;
+  bool has_bits;
+  Ops ops;
+
+  const char *mnemonic() const { return desc ? desc->mnemonic : "dummy-insn"; }
+  bool affects_control() const { return desc && desc->affects_control; }
+  bool has_fetch_stall() const { return desc && desc->has_fetch_stall; }
+
+  std::string rtl_trace(uint32_t pc) const {
+    char buf[128];
+    if (has_bits) {
+      snprintf(buf, sizeof buf, "E PC: 0x%08x, insn: 0x%08x\n# @0x%08x: %s",
+               pc, raw, pc, mnemonic());
+    } else {
+      snprintf(buf, sizeof buf, "E PC: 0x%08x, insn: ??\n# @0x%08x: ??", pc,
+               pc);
+    }
+    return buf;
+  }
+};
+
+int64_t extract_operand(const OpField &field, uint32_t pc, uint32_t word) {
+  uint64_t enc_val = 0;
+  unsigned width = 0;
+  for (unsigned i = 0; i < field.num_ranges; ++i) {
+    unsigned msb = field.ranges[i][0], lsb = field.ranges[i][1];
+    unsigned n = msb - lsb + 1;
+    enc_val = enc_val << n | ((word >> lsb) & ((1ull << n) - 1));
+    width += n;
+  }
+  int64_t val = enc_val;
+  if (field.is_signed && (enc_val >> (width - 1)))
+    val -= (int64_t)1 << width;
+  val = (val + field.enc_offset) * ((int64_t)1 << field.shift);
+  if (field.pc_rel)
+    val += pc;
+  return val;
+}
+
+Insn decode_word(uint32_t pc, uint32_t word) {
+  Insn insn{nullptr, word, true, Ops()};
+  for (const InsnDesc &desc : kInsnDescs) {
+    if ((word & desc.m0) || (~word & desc.m1))
+      continue;
+    // The encodings are unambiguous, so there is at most one match
+    ISS_ASSERT(!insn.desc);
+    insn.desc = &desc;
+  }
+  if (insn.desc) {
+    for (unsigned i = 0; i < insn.desc->num_fields; ++i) {
+      const OpField &field = insn.desc->fields[i];
+      insn.ops.*field.dst = extract_operand(field, pc, word);
+    }
+  }
+  return insn;
+}
+
+std::vector<Insn> decode_words(const Ecc32MemArea::EccWords &data) {
+  std::vector<Insn> ret;
+  ret.reserve(data.size());
+  for (size_t idx = 0; idx < data.size(); ++idx) {
+    uint32_t pc = 4 * idx;
+    if (data[idx].first)
+      ret.push_back(decode_word(pc, data[idx].second));
+    else
+      ret.push_back(Insn{nullptr, 0, false, Ops()});
+  }
+  return ret;
+}
+
+// ---------------------------------------------------------------------------
+// Processor state (state.py)
+
+enum FsmState {
+  kFsmPreWipe = 0,
+  kFsmWiping = 1,
+  kFsmIdle = 2,
+  kFsmPreExec = 3,
+  kFsmExec = 4,
+  kFsmMemSecWipe = 10,
+  kFsmLocked = 255
+};
+
+enum InitSecWipeState {
+  kInitSecWipeNotDone,
+  kInitSecWipeInProgress,
+  kInitSecWipeDone
+};
+
+enum LcTx { kLcTxInvalid = 0, kLcTxOn = 5, kLcTxOff = 10 };
+
+LcTx read_lc_tx_t(uint32_t value) {
+  ISS_ASSERT(value <= 15);
+  if (value == kLcTxOn)
+    return kLcTxOn;
+  if (value == kLcTxOff)
+    return kLcTxOff;
+  return kLcTxInvalid;
+}
+
+const int kWipeCycles = 99 + 1;
+const uint32_t kImemSizeBytes = 16384;
+
+struct OTBNState {
+  GPRs gprs;
+  WDRs wdrs;
+  OTBNExtRegs ext_regs;
+  WSRFile wsrs;
+  CSRFile csrs;
+  Kmac kmac;
+  uint32_t pc;
+  std::optional<uint32_t> pc_next_override;
+  Dmem dmem;
+  FsmState fsm_state;
+  FsmState next_fsm_state;
+  InitSecWipeState init_sec_wipe_state;
+  unsigned wipe_rounds_to_do;
+  unsigned wipe_rounds_done;
+  LoopStack loop_stack;
+  uint32_t err_bits;
+  bool pending_halt;
+  uint32_t pending_err_bits;
+  std::optional<int> time_to_imem_invalidation;
+  bool invalidated_imem;
+  int wipe_cycles;
+  FsmState old_state;
+  bool lock_after_wipe;
+  uint32_t injected_err_bits;
+  bool lock_immediately;
+  bool stall_requested_;
+  bool enforce_stall_request;
+  std::optional<int> time_to_insn_cnt_zero;
+  bool software_errs_fatal;
+  unsigned cycles_in_this_state;
+  LcTx rma_req;
+  bool has_state_to_wipe;
+  bool delayed_lock;
+  bool edn_seen_running;
+  MaskingAcceleratorInterface mai;
+  bool wfi_enabled;
+  bool wfi_auto_resume;
+  bool wfi_resume_pending;
+  bool wfi_resume;
+  unsigned mac_rnd_offset;
+  unsigned mac_rnd_offset_predec;
+
+  OTBNState()
+      : pc(0),
+        fsm_state(kFsmPreWipe),
+        next_fsm_state(kFsmPreWipe),
+        init_sec_wipe_state(kInitSecWipeNotDone),
+        wipe_rounds_to_do(2),
+        wipe_rounds_done(0),
+        err_bits(0),
+        pending_halt(false),
+        pending_err_bits(0),
+        invalidated_imem(false),
+        wipe_cycles(-1),
+        old_state(kFsmPreWipe),
+        lock_after_wipe(false),
+        injected_err_bits(0),
+        lock_immediately(false),
+        stall_requested_(false),
+        enforce_stall_request(false),
+        software_errs_fatal(false),
+        cycles_in_this_state(0),
+        rma_req(kLcTxOff),
+        has_state_to_wipe(false),
+        delayed_lock(false),
+        edn_seen_running(false),
+        wfi_enabled(false),
+        wfi_auto_resume(false),
+        wfi_resume_pending(false),
+        wfi_resume(false),
+        mac_rnd_offset(0),
+        mac_rnd_offset_predec(0) {}
+
+  uint32_t get_next_pc() const {
+    return pc_next_override ? *pc_next_override : pc + 4;
+  }
+
+  void set_next_pc(uint32_t next_pc) {
+    ISS_ASSERT(is_pc_valid(next_pc));
+    pc_next_override = next_pc;
+  }
+
+  void edn_urnd_step(uint32_t urnd_data) {
+    wsrs.URND.set_seed(urnd_data);
+    wsrs.URND.commit();
+  }
+
+  void edn_rnd_step(uint32_t rnd_data, bool fips_err) {
+    ext_regs.rnd_take_word(rnd_data, fips_err);
+  }
+
+  void edn_flush() {
+    ext_regs.rnd_reset();
+    if (init_sec_wipe_is_running())
+      wsrs.URND.requesting = true;
+  }
+
+  void rnd_completed() {
+    OptWide rnd_val;
+    bool fips_err, rep_err;
+    ext_regs.rnd_cdc_complete(&rnd_val, &fips_err, &rep_err);
+    if (rnd_val)
+      wsrs.RND.set_unsigned(*rnd_val, fips_err, rep_err);
+  }
+
+  void urnd_completed() {
+    edn_seen_running = true;
+    wsrs.URND.reseed_done = true;
+  }
+
+  void start_init_sec_wipe() {
+    init_sec_wipe_state = kInitSecWipeInProgress;
+    wsrs.URND.requesting = true;
+  }
+
+  bool init_sec_wipe_is_running() const {
+    return init_sec_wipe_state == kInitSecWipeInProgress;
+  }
+
+  bool init_sec_wipe_is_done() const {
+    return init_sec_wipe_state == kInitSecWipeDone;
+  }
+
+  void complete_init_sec_wipe() { init_sec_wipe_state = kInitSecWipeDone; }
+
+  void loop_start(uint32_t iterations, uint32_t bodysize) {
+    loop_stack.start_loop(pc + 4, iterations, bodysize);
+  }
+
+  void loop_step(const LoopWarps *loop_warps) {
+    std::optional<uint32_t> back_pc = loop_stack.step(pc, loop_warps);
+    if (back_pc)
+      set_next_pc(*back_pc);
+  }
+
+  // The changes that appear in the RTL trace. The Python model also returns
+  // changes to the PC, DMEM and loop stack, but they don't have an RTL trace
+  // so step_for_trace drops them.
+  Changes changes() const {
+    Changes c;
+    gprs.changes(&c);
+    ext_regs.changes(&c);
+    wsrs.changes(&c);
+    csrs.changes(&c);
+    wdrs.changes(&c);
+    return c;
+  }
+
+  bool executing() const {
+    return fsm_state != kFsmIdle && fsm_state != kFsmLocked &&
+           fsm_state != kFsmMemSecWipe;
+  }
+
+  bool wiping() const { return fsm_state == kFsmWiping; }
+
+  bool stop_if_pending_halt() {
+    if (pending_halt) {
+      stop();
+      return true;
+    }
+    return false;
+  }
+
+  void step(bool handle_injected_error) {
+    if (handle_injected_error)
+      take_injected_err_bits();
+    ext_regs.step();
+    kmac.step(&csrs, &wsrs);
+    mai.step(&csrs, &wsrs);
+  }
+
+  void commit(bool sim_stalled) {
+    if (time_to_imem_invalidation) {
+      --*time_to_imem_invalidation;
+      if (*time_to_imem_invalidation == 0) {
+        invalidated_imem = true;
+        time_to_imem_invalidation.reset();
+      }
+    }
+
+    old_state = fsm_state;
+    fsm_state = next_fsm_state;
+    if (fsm_state == old_state)
+      ++cycles_in_this_state;
+    else
+      cycles_in_this_state = 0;
+
+    ext_regs.commit();
+    wsrs.URND.commit();
+
+    if (old_state != kFsmExec && old_state != kFsmWiping)
+      return;
+
+    kmac.detect_errors(&csrs, wsrs);
+    gprs.commit();
+    dmem.commit();
+    loop_stack.commit();
+    wsrs.commit();
+    csrs.commit();
+    wdrs.commit();
+
+    if (!sim_stalled) {
+      pc = get_next_pc();
+      pc_next_override.reset();
+    }
+  }
+
+  void abort() {
+    kmac.detect_errors(&csrs, wsrs);
+    gprs.abort();
+    pc_next_override.reset();
+    dmem.abort();
+    loop_stack.abort();
+    ext_regs.abort();
+    wsrs.abort();
+    csrs.abort();
+    wdrs.abort();
+  }
+
+  void start() {
+    ext_regs.write(kStatus, kStatusBusyExecute);
+    pending_halt = false;
+    err_bits = 0;
+    fsm_state = kFsmPreExec;
+    next_fsm_state = kFsmPreExec;
+    has_state_to_wipe = true;
+    pc = 0;
+    wsrs.on_start();
+    csrs = CSRFile();
+    kmac.on_start();
+    mai.on_start();
+    loop_stack = LoopStack();
+    gprs.empty_call_stack();
+    ext_regs.rnd_poison();
+    wsrs.URND.requesting = true;
+  }
+
+  void stop() {
+    bool insn_failed = err_bits && fsm_state == kFsmExec;
+    if (insn_failed)
+      abort();
+
+    ext_regs.set_bits(kIntrState, 1 << 0);
+
+    bool should_lock = (err_bits & kErrFatalMask) ||
+                       (err_bits && software_errs_fatal) ||
+                       rma_req == kLcTxOn;
+
+    ext_regs.write(kErrBits, err_bits);
+    pending_halt = false;
+
+    if (lock_immediately) {
+      ISS_ASSERT(should_lock);
+      set_fsm_state(kFsmLocked);
+      ext_regs.write(kStatus, kStatusLocked);
+    } else if (fsm_state == kFsmExec) {
+      ext_regs.write(kStopPc, pc);
+      ext_regs.write(kWipeStart, 1);
+      ext_regs.regs[kWipeStart].commit();
+      set_fsm_state(kFsmPreWipe);
+      lock_after_wipe = should_lock;
+      wipe_rounds_done = 0;
+    } else if (fsm_state == kFsmPreWipe || fsm_state == kFsmWiping) {
+      ISS_ASSERT(should_lock);
+      lock_after_wipe = true;
+    } else if (init_sec_wipe_state == kInitSecWipeInProgress) {
+      ISS_ASSERT(should_lock);
+      pending_halt = true;
+    } else if (init_sec_wipe_state == kInitSecWipeDone) {
+      ISS_ASSERT(should_lock);
+      next_fsm_state = kFsmLocked;
+      ext_regs.write(kStatus, kStatusLocked);
+    }
+
+    ext_regs.rnd_forget();
+  }
+
+  void enter_wfi_pause() {
+    ext_regs.set_bits(kIntrState, 1 << 0);
+    ext_regs.write(kStatus, kStatusPaused);
+  }
+
+  bool wfi_should_resume() {
+    bool do_resume = wfi_resume || wfi_auto_resume;
+    if (!do_resume) {
+      wfi_resume = wfi_resume_pending;
+      wfi_resume_pending = false;
+    }
+    return do_resume;
+  }
+
+  void exit_wfi_pause() {
+    ext_regs.write(kStatus, kStatusBusyExecute);
+    wfi_resume = false;
+  }
+
+  void request_wfi_resume() { wfi_resume_pending = true; }
+
+  void set_fsm_state(FsmState new_state) {
+    if (new_state == kFsmWiping)
+      wipe_cycles = kWipeCycles;
+    next_fsm_state = new_state;
+  }
+
+  void set_flags(unsigned fg, const FlagReg &flags) {
+    csrs.flags.set(fg, flags);
+  }
+
+  void set_mlz_flags(unsigned fg, const Wide &result) {
+    csrs.flags.set(fg, FlagReg::mlz_for_result(csrs.flags[fg].C, result));
+  }
+
+  void pre_insn(bool insn_affects_control) {
+    loop_stack.check_insn(pc, insn_affects_control);
+  }
+
+  static bool is_pc_valid(uint32_t pc) {
+    return !(pc & 3) && pc < kImemSizeBytes;
+  }
+
+  void post_insn(const LoopWarps *loop_warps) {
+    ext_regs.increment_insn_cnt();
+    loop_step(loop_warps);
+    gprs.post_insn();
+
+    err_bits |= gprs.err_bits() | loop_stack.err_bits();
+    if (err_bits)
+      pending_halt = true;
+
+    if (!is_pc_valid(get_next_pc()) && !pending_halt) {
+      err_bits |= kErrBadInsnAddr;
+      pending_halt = true;
+    }
+  }
+
+  uint32_t read_csr(uint32_t idx) {
+    return csrs.read_unsigned(&wsrs, ext_regs, idx);
+  }
+
+  void write_csr(uint32_t idx, uint32_t value) {
+    csrs.write_unsigned(&wsrs, &ext_regs, idx, value);
+  }
+
+  void stop_at_end_of_cycle(uint32_t bits) {
+    if (bits & kErrDmemIntgViolation) {
+      bits &= ~kErrDmemIntgViolation;
+      pending_err_bits |= kErrDmemIntgViolation;
+      if (bits == 0)
+        return;
+    }
+    err_bits |= bits;
+    pending_halt = true;
+  }
+
+  void take_pending_err_bits() {
+    if (pending_err_bits) {
+      err_bits |= pending_err_bits;
+      pending_err_bits = 0;
+      pending_halt = true;
+    }
+  }
+
+  void invalidate_imem() { time_to_imem_invalidation = 2; }
+
+  void clear_imem_invalidation() {
+    time_to_imem_invalidation.reset();
+    invalidated_imem = false;
+  }
+
+  void wipe() {
+    gprs.wipe();
+    wdrs.wipe();
+    wsrs.wipe();
+    csrs.wipe();
+  }
+
+  void take_injected_err_bits() {
+    if (injected_err_bits != 0) {
+      stop_at_end_of_cycle(injected_err_bits);
+      injected_err_bits = 0;
+    }
+  }
+
+  void request_stall(bool enforce) {
+    stall_requested_ = true;
+    enforce_stall_request = enforce;
+  }
+
+  bool stall_requested() {
+    bool should_stall =
+        stall_requested_ && (enforce_stall_request || !pending_halt);
+    stall_requested_ = false;
+    enforce_stall_request = false;
+    return should_stall;
+  }
+};
+
+// ---------------------------------------------------------------------------
+// Instruction semantics (insn.py)
+
+// The Python model runs instructions that take more than one cycle as
+// generators, which yield once per stall cycle. We emulate that with an
+// explicit state machine: execute() gets called once per cycle with the same
+// ExecCtx and returns true if the instruction yielded (so should be called
+// again on the next cycle). ctx->phase is zero on the first call and anything
+// else that the instruction needs to remember between cycles is stored in
+// the remaining fields.
+struct ExecCtx {
+  unsigned phase;
+  // The result of a vector multiply or the value loaded by BN.LID
+  Wide result;
+  // The address for LW or BN.SID or the register value for a CSR write
+  uint32_t addr;
+  // The value loaded by LW
+  uint32_t val32;
+  // False if a load saw an integrity error
+  bool valid;
+  // The destination and source WDRs for indirect instructions
+  unsigned wrd, wrs;
+  // The value of mac_rnd_offset when a vector multiply started
+  unsigned mac_offset;
+};
+
+// If reading a GPR caused a call stack error, stop at the end of the cycle
+// and return true.
+bool saw_call_stack_err(OTBNState *state) {
+  if (!state->gprs.call_stack_err)
+    return false;
+  state->stop_at_end_of_cycle(kErrCallStack);
+  return true;
+}
+
+Wide logical_byte_shift(const Wide &value, int64_t shift_type,
+                        int64_t shift_bits) {
+  ISS_ASSERT(0 <= shift_type && shift_type <= 1);
+  if (shift_bits >= 256)
+    return Wide();
+  return shift_type == 0 ? (value << shift_bits).masked(256)
+                         : value >> shift_bits;
+}
+
+unsigned element_length_in_bits(int64_t elen) {
+  ISS_ASSERT(0 <= elen && elen <= 2);
+  return 32u << elen;
+}
+
+Wide extract_vec_elem(const Wide &value, unsigned elem, unsigned size) {
+  ISS_ASSERT(elem < 256 / size);
+  return (value >> (elem * size)).masked(size);
+}
+
+// Apply op to each pair of 32-bit elements of vec_a and vec_b (this is
+// map_elems for the only vector element size that the arithmetic
+// instructions support)
+template <typename Op>
+Wide map_elems32(Op op, const Wide &vec_a, const Wide &vec_b) {
+  Wide result;
+  for (unsigned elem = 0; elem < 8; ++elem)
+    result.set_word(elem, op(vec_a.word(elem), vec_b.word(elem)));
+  return result;
+}
+
+// A vector with each 32-bit element equal to element lane of vec
+Wide broadcast_lane32(const Wide &vec, int64_t lane) {
+  ISS_ASSERT(0 <= lane && lane < 8);
+  Wide ret;
+  for (unsigned elem = 0; elem < 8; ++elem)
+    ret.set_word(elem, vec.word(lane));
+  return ret;
+}
+
+uint32_t montgomery_mul_no_cond_subtraction(uint32_t a, uint32_t b,
+                                            uint32_t q, uint32_t mu) {
+  uint64_t reg_c = (uint64_t)a * b;
+  uint64_t reg_tmp = (uint32_t)reg_c;
+  reg_tmp = (uint32_t)(reg_tmp * mu);
+  return (uint32_t)(((u128)reg_c + (u128)reg_tmp * q) >> 32);
+}
+
+// Replace quarter-word chunk of ACC with the matching bits of result (one
+// cycle of the ACC updates done by the vector multiply instructions)
+void write_acc_chunk(OTBNState *state, const Wide &result, unsigned chunk) {
+  Wide mask = Wide::ones(64) << (chunk * 64);
+  Wide acc = state->wsrs.ACC.read_unsigned();
+  acc = (acc & ~mask) | (result & mask);
+  state->wsrs.ACC.write_unsigned(acc.masked(256));
+}
+
+// The result of BN.MULQACC and friends (before the write back)
+Wide mulqacc(OTBNState *state, const Ops &o) {
+  const WDRs &wdrs = state->wdrs;
+  uint64_t a_qw = wdrs.read_unsigned(o.wrs1).bits(64 * o.wrs1_qwsel, 64);
+  uint64_t b_qw = wdrs.read_unsigned(o.wrs2).bits(64 * o.wrs2_qwsel, 64);
+  Wide mul_res = Wide::from_u128((u128)a_qw * b_qw);
+  Wide acc = o.zero_acc ? Wide() : state->wsrs.ACC.read_unsigned();
+  acc = acc + (mul_res << o.acc_shift_imm);
+  return acc.masked(256);
+}
+
+// Run an instruction for one cycle. Returns true if the instruction should
+// run again on the next cycle.
+bool execute(OTBNState *state, const Insn &insn, ExecCtx *ctx) {
+  if (!insn.has_bits) {
+    state->stop_at_end_of_cycle(kErrImemIntgViolation);
+    return false;
+  }
+  if (!insn.desc) {
+    state->stop_at_end_of_cycle(kErrIllegalInsn);
+    return false;
+  }
+
+  const Ops &o = insn.ops;
+  GPRs &gprs = state->gprs;
+  WDRs &wdrs = state->wdrs;
+  WSRFile &wsrs = state->wsrs;
+
+  switch (insn.desc->kind) {
+    case kInsnAdd:
+    case kInsnSub:
+    case kInsnSll:
+    case kInsnSrl:
+    case kInsnSra:
+    case kInsnAnd:
+    case kInsnOr:
+    case kInsnXor: {
+      uint32_t val1 = gprs.read_unsigned(o.grs1);
+      uint32_t val2 = gprs.read_unsigned(o.grs2);
+      if (saw_call_stack_err(state))
+        return false;
+      uint32_t result;
+      switch (insn.desc->kind) {
+        case kInsnAdd:
+          result = val1 + val2;
+          break;
+        case kInsnSub:
+          result = val1 - val2;
+          break;
+        case kInsnSll:
+          result = val1 << (val2 & 0x1f);
+          break;
+        case kInsnSrl:
+          result = val1 >> (val2 & 0x1f);
+          break;
+        case kInsnSra:
+          result = (uint32_t)((int32_t)val1 >> (val2 & 0x1f));
+          break;
+        case kInsnAnd:
+          result = val1 & val2;
+          break;
+        case kInsnOr:
+          result = val1 | val2;
+          break;
+        default:
+          result = val1 ^ val2;
+          break;
+      }
+      gprs.write_unsigned(o.grd, result);
+      return false;
+    }
+
+    case kInsnAddi:
+    case kInsnAndi:
+    case kInsnOri:
+    case kInsnXori:
+    case kInsnSlli:
+    case kInsnSrli:
+    case kInsnSrai: {
+      uint32_t val1 = gprs.read_unsigned(o.grs1);
+      if (saw_call_stack_err(state))
+        return false;
+      uint32_t imm = (uint32_t)o.imm;
+      uint32_t result;
+      switch (insn.desc->kind) {
+        case kInsnAddi:
+          result = val1 + imm;
+          break;
+        case kInsnAndi:
+          result = val1 & imm;
+          break;
+        case kInsnOri:
+          result = val1 | imm;
+          break;
+        case kInsnXori:
+          result = val1 ^ imm;
+          break;
+        case kInsnSlli:
+          result = val1 << o.shamt;
+          break;
+        case kInsnSrli:
+          result = val1 >> o.shamt;
+          break;
+        default:
+          result = (uint32_t)((int32_t)val1 >> o.shamt);
+          break;
+      }
+      gprs.write_unsigned(o.grd, result);
+      return false;
+    }
+
+    case kInsnLui:
+      gprs.write_unsigned(o.grd, (uint32_t)o.imm << 12);
+      return false;
+
+    case kInsnLw: {
+      if (ctx->phase == 0) {
+        uint32_t base = gprs.read_unsigned(o.grs1);
+        if (saw_call_stack_err(state))
+          return false;
+        uint32_t addr = base + (uint32_t)o.offset;
+        if (!state->dmem.is_valid_32b_addr(addr)) {
+          state->stop_at_end_of_cycle(kErrBadDataAddr);
+          return false;
+        }
+        Dmem::Word word = state->dmem.load_u32(addr);
+        ctx->val32 = word.value;
+        ctx->valid = word.valid;
+        ctx->phase = 1;
+        return true;
+      }
+      if (!ctx->valid)
+        state->stop_at_end_of_cycle(kErrDmemIntgViolation);
+      gprs.write_unsigned(o.grd, ctx->val32);
+      return false;
+    }
+
+    case kInsnSw: {
+      uint32_t base = gprs.read_unsigned(o.grs1);
+      uint32_t addr = base + (uint32_t)o.offset;
+      uint32_t value = gprs.read_unsigned(o.grs2);
+      bool bad_grs1 = gprs.call_stack_err && o.grs1 == 1;
+      bool saw_err = false;
+      if (saw_call_stack_err(state))
+        saw_err = true;
+      if (!state->dmem.is_valid_32b_addr(addr) && !bad_grs1) {
+        state->stop_at_end_of_cycle(kErrBadDataAddr);
+        saw_err = true;
+      }
+      if (!saw_err)
+        state->dmem.store_u32(addr, value);
+      return false;
+    }
+
+    case kInsnBeq:
+    case kInsnBne: {
+      uint32_t val1 = gprs.read_unsigned(o.grs1);
+      uint32_t val2 = gprs.read_unsigned(o.grs2);
+      if (saw_call_stack_err(state))
+        return false;
+      uint32_t tgt_pc = (uint32_t)o.offset;
+      if ((val1 == val2) == (insn.desc->kind == kInsnBeq)) {
+        if (!OTBNState::is_pc_valid(tgt_pc))
+          state->stop_at_end_of_cycle(kErrBadInsnAddr);
+        else
+          state->set_next_pc(tgt_pc);
+      }
+      return false;
+    }
+
+    case kInsnJal:
+    case kInsnJalr: {
+      uint32_t next_pc = (uint32_t)o.offset;
+      if (insn.desc->kind == kInsnJalr) {
+        next_pc += gprs.read_unsigned(o.grs1);
+        if (saw_call_stack_err(state))
+          return false;
+      }
+      gprs.write_unsigned(o.grd, state->pc + 4);
+      if (!OTBNState::is_pc_valid(next_pc))
+        state->stop_at_end_of_cycle(kErrBadInsnAddr);
+      else
+        state->set_next_pc(next_pc);
+      return false;
+    }
+
+    case kInsnCsrrs:
+    case kInsnCsrrw: {
+      bool is_csrrs = insn.desc->kind == kInsnCsrrs;
+      if (ctx->phase == 0) {
+        if (!CSRFile::check_idx(o.csr)) {
+          state->stop_at_end_of_cycle(kErrIllegalInsn);
+          return false;
+        }
+        ctx->addr = gprs.read_unsigned(o.grs1);
+        if (saw_call_stack_err(state))
+          return false;
+        ctx->phase = 1;
+      }
+      // Wait for RND (CSRRW only needs to wait if it reads the old value)
+      if (o.csr == kCsrRnd && (is_csrrs || o.grd != 0) &&
+          !wsrs.RND.request_value(&state->ext_regs))
+        return true;
+
+      uint32_t new_val = ctx->addr;
+      if (is_csrrs || o.grd != 0) {
+        uint32_t old_val = state->read_csr(o.csr);
+        gprs.write_unsigned(o.grd, old_val);
+        if (is_csrrs)
+          new_val |= old_val;
+      }
+      if (is_csrrs && o.grs1 == 0)
+        return false;
+      if (o.csr == kCsrMaiCtrl &&
+          !state->mai.is_valid_ctrl_change(state->csrs, new_val)) {
+        state->stop_at_end_of_cycle(kErrMaiSoftwareError);
+        return false;
+      }
+      state->write_csr(o.csr, new_val);
+      return false;
+    }
+
+    case kInsnEcall:
+      state->stop_at_end_of_cycle(0);
+      return false;
+
+    case kInsnWfi:
+      if (ctx->phase == 0) {
+        if (!state->wfi_enabled) {
+          state->stop_at_end_of_cycle(kErrIllegalInsn);
+          return false;
+        }
+        state->enter_wfi_pause();
+        ctx->phase = 1;
+      }
+      if (!state->wfi_should_resume())
+        return true;
+      state->exit_wfi_pause();
+      return false;
+
+    case kInsnLoop: {
+      uint32_t num_iters = gprs.read_unsigned(o.grs);
+      if (saw_call_stack_err(state))
+        return false;
+      if (num_iters == 0)
+        state->stop_at_end_of_cycle(kErrLoop);
+      else
+        state->loop_start(num_iters, o.bodysize);
+      return false;
+    }
+
+    case kInsnLoopi:
+      if (o.iterations == 0)
+        state->stop_at_end_of_cycle(kErrLoop);
+      else
+        state->loop_start(o.iterations, o.bodysize);
+      return false;
+
+    case kInsnBnAdd:
+    case kInsnBnAddc:
+    case kInsnBnSub:
+    case kInsnBnSubb:
+    case kInsnBnCmp:
+    case kInsnBnCmpb:
+    case kInsnBnAddi:
+    case kInsnBnSubi: {
+      InsnKind kind = insn.desc->kind;
+      bool is_imm = kind == kInsnBnAddi || kind == kInsnBnSubi;
+      Wide a = wdrs.read_unsigned(is_imm ? o.wrs : o.wrs1);
+      Wide b = is_imm ? Wide::from_u64(o.imm)
+                      : logical_byte_shift(wdrs.read_unsigned(o.wrs2),
+                                           o.shift_type, o.shift_bits);
+      bool use_carry = kind == kInsnBnAddc || kind == kInsnBnSubb ||
+                       kind == kInsnBnCmpb;
+      Wide carry = Wide::from_u64(
+          use_carry ? state->csrs.flags[o.flag_group].C : 0);
+      bool is_add =
+          kind == kInsnBnAdd || kind == kInsnBnAddc || kind == kInsnBnAddi;
+      Wide full_result = is_add ? a + b + carry : a - b - carry;
+      Wide masked_result = full_result.masked(256);
+      FlagReg flags = FlagReg::mlz_for_result(full_result.bit(256),
+                                              masked_result);
+      if (kind != kInsnBnCmp && kind != kInsnBnCmpb)
+        wdrs.write_unsigned(o.wrd, masked_result);
+      state->set_flags(o.flag_group, flags);
+      return false;
+    }
+
+    case kInsnBnAddm:
+    case kInsnBnSubm: {
+      const Wide &a = wdrs.read_unsigned(o.wrs1);
+      const Wide &b = wdrs.read_unsigned(o.wrs2);
+      const Wide &mod_val = wsrs.MOD.read_unsigned();
+      Wide result;
+      if (insn.desc->kind == kInsnBnAddm) {
+        result = a + b;
+        if (result >= mod_val)
+          result = result - mod_val;
+      } else {
+        result = a - b;
+        if (a < b)
+          result = result + mod_val;
+      }
+      wdrs.write_unsigned(o.wrd, result.masked(256));
+      return false;
+    }
+
+    case kInsnBnMulqacc:
+      wsrs.ACC.write_unsigned(mulqacc(state, o));
+      return false;
+
+    case kInsnBnMulqaccWo: {
+      Wide truncated = mulqacc(state, o);
+      wdrs.write_unsigned(o.wrd, truncated);
+      wsrs.ACC.write_unsigned(truncated);
+      state->set_mlz_flags(o.flag_group, truncated);
+      return false;
+    }
+
+    case kInsnBnMulqaccSo: {
+      Wide truncated = mulqacc(state, o);
+      Wide lo_part = truncated.masked(128);
+      Wide hi_part = truncated >> 128;
+      unsigned hw_shift = 128 * o.wrd_hwsel;
+      Wide hw_mask = Wide::ones(128) << hw_shift;
+      Wide old_wrd = wdrs.read_unsigned(o.wrd);
+      wdrs.write_unsigned(o.wrd, (old_wrd & ~hw_mask) | (lo_part << hw_shift));
+      wsrs.ACC.write_unsigned(hi_part);
+      FlagReg flags = state->csrs.flags[o.flag_group];
+      if (o.wrd_hwsel) {
+        flags.M = lo_part.bit(127);
+        flags.Z = flags.Z && lo_part.is_zero();
+      } else {
+        flags.L = lo_part.bit(0);
+        flags.Z = lo_part.is_zero();
+      }
+      state->set_flags(o.flag_group, flags);
+      return false;
+    }
+
+    case kInsnBnAnd:
+    case kInsnBnOr:
+    case kInsnBnXor:
+    case kInsnBnNot: {
+      InsnKind kind = insn.desc->kind;
+      Wide b = logical_byte_shift(
+          wdrs.read_unsigned(kind == kInsnBnNot ? o.wrs : o.wrs2),
+          o.shift_type, o.shift_bits);
+      Wide result;
+      if (kind == kInsnBnNot) {
+        result = b ^ Wide::ones(256);
+      } else {
+        const Wide &a = wdrs.read_unsigned(o.wrs1);
+        result = kind == kInsnBnAnd ? a & b : kind == kInsnBnOr ? a | b : a ^ b;
+      }
+      wdrs.write_unsigned(o.wrd, result);
+      state->set_mlz_flags(o.flag_group, result);
+      return false;
+    }
+
+    case kInsnBnRshi: {
+      Wide a = wdrs.read_unsigned(o.wrs1);
+      const Wide &b = wdrs.read_unsigned(o.wrs2);
+      wdrs.write_unsigned(o.wrd, (((a << 256) | b) >> o.imm).masked(256));
+      return false;
+    }
+
+    case kInsnBnSel: {
+      bool flag_is_set = state->csrs.flags[o.flag_group].get_by_idx(o.flag);
+      wdrs.write_unsigned(o.wrd,
+                          wdrs.read_unsigned(flag_is_set ? o.wrs1 : o.wrs2));
+      return false;
+    }
+
+    case kInsnBnLid: {
+      if (ctx->phase == 0) {
+        if (o.grs1_inc && o.grd_inc) {
+          state->stop_at_end_of_cycle(kErrIllegalInsn);
+          return false;
+        }
+        uint32_t grs1_val = gprs.read_unsigned(o.grs1);
+        uint32_t addr = grs1_val + (uint32_t)o.offset;
+        uint32_t grd_val = gprs.read_unsigned(o.grd);
+        bool bad_grs1 = gprs.call_stack_err && o.grs1 == 1;
+        bool bad_grd = gprs.call_stack_err && o.grd == 1;
+        bool saw_err = saw_call_stack_err(state);
+        if (grd_val > 31 && !bad_grd) {
+          state->stop_at_end_of_cycle(kErrIllegalInsn);
+          saw_err = true;
+        }
+        if (!state->dmem.is_valid_256b_addr(addr) && !bad_grs1) {
+          state->stop_at_end_of_cycle(kErrBadDataAddr);
+          saw_err = true;
+        }
+        if (saw_err)
+          return false;
+
+        ctx->wrd = grd_val & 0x1f;
+        ctx->result = state->dmem.load_u256(addr, &ctx->valid);
+        if (o.grd_inc)
+          gprs.write_unsigned(o.grd, grd_val + 1);
+        if (o.grs1_inc)
+          gprs.write_unsigned(o.grs1, grs1_val + 32);
+        ctx->phase = 1;
+        return true;
+      }
+      if (!ctx->valid)
+        state->stop_at_end_of_cycle(kErrDmemIntgViolation);
+      wdrs.write_unsigned(ctx->wrd, ctx->result);
+      return false;
+    }
+
+    case kInsnBnSid: {
+      if (ctx->phase == 0) {
+        if (o.grs1_inc && o.grs2_inc) {
+          state->stop_at_end_of_cycle(kErrIllegalInsn);
+          return false;
+        }
+        uint32_t grs1_val = gprs.read_unsigned(o.grs1);
+        uint32_t addr = grs1_val + (uint32_t)o.offset;
+        uint32_t grs2_val = gprs.read_unsigned(o.grs2);
+        bool bad_grs1 = gprs.call_stack_err && o.grs1 == 1;
+        bool bad_grs2 = gprs.call_stack_err && o.grs2 == 1;
+        bool saw_err = saw_call_stack_err(state);
+        if (grs2_val > 31 && !bad_grs2) {
+          state->stop_at_end_of_cycle(kErrIllegalInsn);
+          saw_err = true;
+        }
+        if (!state->dmem.is_valid_256b_addr(addr) && !bad_grs1) {
+          state->stop_at_end_of_cycle(kErrBadDataAddr);
+          saw_err = true;
+        }
+        if (saw_err)
+          return false;
+
+        if (o.grs1_inc)
+          gprs.write_unsigned(o.grs1, grs1_val + 32);
+        if (o.grs2_inc)
+          gprs.write_unsigned(o.grs2, grs2_val + 1);
+        ctx->addr = addr;
+        ctx->wrs = grs2_val & 0x1f;
+        ctx->phase = 1;
+        return true;
+      }
+      state->dmem.store_u256(ctx->addr, wdrs.read_unsigned(ctx->wrs));
+      return false;
+    }
+
+    case kInsnBnMov:
+      wdrs.write_unsigned(o.wrd, wdrs.read_unsigned(o.wrs));
+      return false;
+
+    case kInsnBnMovr: {
+      if (ctx->phase == 0) {
+        if (o.grs_inc && o.grd_inc) {
+          state->stop_at_end_of_cycle(kErrIllegalInsn);
+          return false;
+        }
+        uint32_t grd_val = gprs.read_unsigned(o.grd);
+        uint32_t grs_val = gprs.read_unsigned(o.grs);
+        bool bad_grs = gprs.call_stack_err && o.grs == 1;
+        bool bad_grd = gprs.call_stack_err && o.grd == 1;
+        bool saw_err = saw_call_stack_err(state);
+        if (grd_val > 31 && !bad_grd) {
+          state->stop_at_end_of_cycle(kErrIllegalInsn);
+          saw_err = true;
+        }
+        if (grs_val > 31 && !bad_grs) {
+          state->stop_at_end_of_cycle(kErrIllegalInsn);
+          saw_err = true;
+        }
+        if (saw_err)
+          return false;
+
+        ctx->wrd = grd_val & 0x1f;
+        ctx->wrs = grs_val & 0x1f;
+        if (o.grd_inc)
+          gprs.write_unsigned(o.grd, grd_val + 1);
+        if (o.grs_inc)
+          gprs.write_unsigned(o.grs, grs_val + 1);
+        ctx->phase = 1;
+        return true;
+      }
+      wdrs.write_unsigned(ctx->wrd, wdrs.read_unsigned(ctx->wrs));
+      return false;
+    }
+
+    case kInsnBnWsrr:
+      if (ctx->phase == 0) {
+        if (!WSRFile::check_idx(o.wsr)) {
+          state->stop_at_end_of_cycle(kErrIllegalInsn);
+          return false;
+        }
+        ctx->phase = 1;
+      }
+      if (o.wsr == kWsrRnd && !wsrs.RND.request_value(&state->ext_regs))
+        return true;
+      if (!wsrs.has_value_at_idx(o.wsr)) {
+        state->stop_at_end_of_cycle(kErrKeyInvalid);
+        return false;
+      }
+      wdrs.write_unsigned(o.wrd, wsrs.read_at_idx(o.wsr));
+      return false;
+
+    case kInsnBnWsrw:
+      if (!WSRFile::check_idx(o.wsr)) {
+        state->stop_at_end_of_cycle(kErrIllegalInsn);
+        return false;
+      }
+      if (kWsrMaiIn0S0 <= o.wsr && o.wsr <= kWsrMaiIn1S1 &&
+          !state->csrs.MAI_STATUS.is_input_ready()) {
+        state->stop_at_end_of_cycle(kErrMaiSoftwareError);
+        return false;
+      }
+      wsrs.write_at_idx(o.wsr, wdrs.read_unsigned(o.wrs));
+      return false;
+
+    case kInsnBnAddv:
+    case kInsnBnAddvm:
+    case kInsnBnSubv:
+    case kInsnBnSubvm: {
+      const Wide &vec_a = wdrs.read_unsigned(o.wrs1);
+      const Wide &vec_b = wdrs.read_unsigned(o.wrs2);
+      if (element_length_in_bits(o.elen) != 32) {
+        state->stop_at_end_of_cycle(kErrIllegalInsn);
+        return false;
+      }
+      uint32_t mod_val = wsrs.MOD.read_unsigned().word(0);
+      Wide result;
+      switch (insn.desc->kind) {
+        case kInsnBnAddv:
+          result = map_elems32(
+              [](uint32_t a, uint32_t b) { return a + b; }, vec_a, vec_b);
+          break;
+        case kInsnBnAddvm:
+          result = map_elems32(
+              [mod_val](uint32_t a, uint32_t b) {
+                uint64_t c = (uint64_t)a + b;
+                return (uint32_t)(c >= mod_val ? c - mod_val : c);
+              },
+              vec_a, vec_b);
+          break;
+        case kInsnBnSubv:
+          result = map_elems32(
+              [](uint32_t a, uint32_t b) { return a - b; }, vec_a, vec_b);
+          break;
+        default:
+          result = map_elems32(
+              [mod_val](uint32_t a, uint32_t b) {
+                return a < b ? a - b + mod_val : a - b;
+              },
+              vec_a, vec_b);
+          break;
+      }
+      wdrs.write_unsigned(o.wrd, result);
+      return false;
+    }
+
+    case kInsnBnMulv:
+    case kInsnBnMulvl:
+    case kInsnBnMulvm:
+    case kInsnBnMulvml: {
+      InsnKind kind = insn.desc->kind;
+      bool is_montgomery = kind == kInsnBnMulvm || kind == kInsnBnMulvml;
+      if (ctx->phase == 0) {
+        const Wide &vec_a = wdrs.read_unsigned(o.wrs1);
+        const Wide &vec_b = wdrs.read_unsigned(o.wrs2);
+        if (element_length_in_bits(o.elen) != 32) {
+          state->stop_at_end_of_cycle(kErrIllegalInsn);
+          return false;
+        }
+        bool by_lane = kind == kInsnBnMulvl || kind == kInsnBnMulvml;
+        Wide op_b = by_lane ? broadcast_lane32(vec_b, o.lane) : vec_b;
+        if (is_montgomery) {
+          const Wide &mod_raw = wsrs.MOD.read_unsigned();
+          uint32_t mod_q = mod_raw.word(0), mod_mu = mod_raw.word(1);
+          ctx->result = map_elems32(
+              [mod_q, mod_mu](uint32_t a, uint32_t b) {
+                return montgomery_mul_no_cond_subtraction(a, b, mod_q, mod_mu);
+              },
+              vec_a, op_b);
+        } else {
+          ctx->result = map_elems32(
+              [](uint32_t a, uint32_t b) { return a * b; }, vec_a, op_b);
+        }
+        ctx->mac_offset = state->mac_rnd_offset;
+      }
+
+      // BN.MULV and BN.MULVL update one quarter-word of ACC on each of the
+      // first three cycles and finish on the fourth. The Montgomery versions
+      // take three cycles for each quarter-word (updating ACC in the last of
+      // them for the first three) and finish on the twelfth.
+      unsigned phase = ctx->phase++;
+      unsigned last_phase = is_montgomery ? 11 : 3;
+      if (phase < last_phase) {
+        if (!is_montgomery)
+          write_acc_chunk(state, ctx->result, (phase + ctx->mac_offset) & 3);
+        else if (phase % 3 == 2)
+          write_acc_chunk(state, ctx->result,
+                          (phase / 3 + ctx->mac_offset) & 3);
+        return true;
+      }
+      wsrs.ACC.write_unsigned(wsrs.URND.read_unsigned());
+      wdrs.write_unsigned(o.wrd, ctx->result);
+      return false;
+    }
+
+    case kInsnBnTrn1:
+    case kInsnBnTrn2: {
+      const Wide &vec_a = wdrs.read_unsigned(o.wrs1);
+      const Wide &vec_b = wdrs.read_unsigned(o.wrs2);
+      unsigned size = element_length_in_bits(o.elen);
+      unsigned sel = insn.desc->kind == kInsnBnTrn2 ? 1 : 0;
+      Wide vec_c;
+      for (unsigned elem = 0; elem < 256 / size; elem += 2) {
+        vec_c = vec_c | (extract_vec_elem(vec_a, elem + sel, size)
+                         << (elem * size));
+        vec_c = vec_c | (extract_vec_elem(vec_b, elem + sel, size)
+                         << ((elem + 1) * size));
+      }
+      wdrs.write_unsigned(o.wrd, vec_c);
+      return false;
+    }
+
+    case kInsnBnShv: {
+      const Wide &vec_a = wdrs.read_unsigned(o.wrs);
+      if (element_length_in_bits(o.elen) != 32) {
+        state->stop_at_end_of_cycle(kErrIllegalInsn);
+        return false;
+      }
+      ISS_ASSERT(0 <= o.shift_type && o.shift_type <= 1);
+      Wide vec_c;
+      for (unsigned elem = 0; elem < 8; ++elem) {
+        uint64_t elem_a = vec_a.word(elem);
+        uint64_t shifted = o.shift_type == 0 ? elem_a << o.shift_bits
+                                             : elem_a >> o.shift_bits;
+        vec_c.set_word(elem, (uint32_t)shifted);
+      }
+      wdrs.write_unsigned(o.wrd, vec_c);
+      return false;
+    }
+
+    case kInsnBnUnpk: {
+      Wide a = wdrs.read_unsigned(o.wrs1);
+      const Wide &b = wdrs.read_unsigned(o.wrs2);
+      Wide shifted = ((a << 256) | b) >> o.shift_bits;
+      Wide unpacked;
+      for (unsigned elem = 0; elem < 8; ++elem)
+        unpacked.set_word(elem, (uint32_t)shifted.bits(elem * 24, 24));
+      wdrs.write_unsigned(o.wrd, unpacked);
+      return false;
+    }
+
+    case kInsnBnPack: {
+      Wide dense[2];
+      for (unsigned i = 0; i < 2; ++i) {
+        const Wide &vec = wdrs.read_unsigned(i ? o.wrs2 : o.wrs1);
+        for (unsigned elem = 0; elem < 8; ++elem)
+          dense[i] = dense[i] |
+                     (Wide::from_u64(vec.word(elem) & 0xffffff) << (elem * 24));
+      }
+      Wide combined = (dense[0] << 256) | (dense[1] << 64);
+      wdrs.write_unsigned(o.wrd, (combined >> o.shift_bits).masked(256));
+      return false;
+    }
+  }
+
+  ISS_ASSERT(0);
+  return false;
+}
+
+// ---------------------------------------------------------------------------
+// The simulator (sim.py)
+
+struct OTBNSim {
+  OTBNState state;
+  std::vector<Insn> program;
+  std::map<uint32_t, LoopWarps> loop_warps;
+  // The instruction that will run on the next EXEC cycle (_next_insn)
+  std::optional<Insn> next_insn;
+  // True if next_insn is part way through a multi-cycle execution (the
+  // Python model's _execute_generator is not None)
+  bool executing;
+  ExecCtx exec_ctx;
+
+  OTBNSim() : executing(false), exec_ctx() {}
+
+  void load_program(std::vector<Insn> &&new_program) {
+    program = std::move(new_program);
+    state.clear_imem_invalidation();
+  }
+
+  void add_loop_warp(uint32_t addr, uint32_t from_cnt, uint32_t to_cnt) {
+    loop_warps[addr][from_cnt] = to_cnt;
+  }
+
+  void start() {
+    executing = false;
+    next_insn.reset();
+    state.start();
+  }
+
+  void initial_secure_wipe() { state.start_init_sec_wipe(); }
+
+  void start_mem_wipe(bool is_imem) {
+    if (state.fsm_state != kFsmIdle)
+      return;
+    state.set_fsm_state(kFsmMemSecWipe);
+    state.ext_regs.write(kStatus, is_imem ? kStatusBusySecWipeImem
+                                          : kStatusBusySecWipeDmem);
+  }
+
+  Insn fetch(uint32_t pc) const {
+    uint32_t word_pc = pc >> 2;
+    if (word_pc >= program.size()) {
+      std::ostringstream oss;
+      oss << "Trying to execute instruction at address 0x" << std::hex << pc
+          << ", but the program is only 0x" << 4 * program.size()
+          << " bytes (" << std::dec << program.size()
+          << " instructions) long. Since there are no architectural contents "
+             "of the memory here, we have to stop.";
+      throw std::runtime_error(oss.str());
+    }
+    if (state.invalidated_imem)
+      return Insn{nullptr, 0, false, Ops()};
+    return program[word_pc];
+  }
+
+  void on_stall(bool fetch_next, Changes *changes) {
+    state.stop_if_pending_halt();
+    *changes = state.changes();
+    state.commit(true);
+    if (fetch_next)
+      next_insn = fetch(state.pc);
+  }
+
+  void on_retire(const Insn &insn, Changes *changes) {
+    ISS_ASSERT(!executing);
+    auto warps = loop_warps.find(state.pc);
+    state.post_insn(warps == loop_warps.end() ? nullptr : &warps->second);
+    bool halting = state.stop_if_pending_halt();
+    *changes = state.changes();
+    state.commit(false);
+    if (halting || insn.has_fetch_stall())
+      next_insn.reset();
+    else
+      next_insn = fetch(state.pc);
+  }
+
+  void delayed_insn_cnt_zero(int delay_if_locking) {
+    ISS_ASSERT(state.fsm_state == kFsmPreWipe || state.fsm_state == kFsmWiping);
+    if (!state.lock_after_wipe)
+      return;
+    if (state.ext_regs.read(kInsnCnt) == 0)
+      return;
+    if (!state.time_to_insn_cnt_zero)
+      state.time_to_insn_cnt_zero = delay_if_locking;
+    int count = std::min(*state.time_to_insn_cnt_zero, delay_if_locking);
+    if (count == 0) {
+      state.ext_regs.write(kInsnCnt, 0);
+      state.time_to_insn_cnt_zero.reset();
+    } else {
+      state.time_to_insn_cnt_zero = count - 1;
+    }
+  }
+
+  // Step the simulation by one cycle. If an instruction retired, copy it to
+  // *retired and return true. Either way, the changes from the cycle are
+  // written to *changes.
+  bool step(Insn *retired, Changes *changes) {
+    FsmState fsm_state = state.fsm_state;
+    state.take_pending_err_bits();
+    state.step(fsm_state != kFsmExec);
+    switch (fsm_state) {
+      case kFsmMemSecWipe:
+        step_ext_wipe(changes);
+        return false;
+      case kFsmIdle:
+      case kFsmLocked:
+        step_idle(changes);
+        return false;
+      case kFsmPreExec:
+        step_pre_exec(changes);
+        return false;
+      case kFsmExec:
+        return step_exec(retired, changes);
+      case kFsmPreWipe:
+        step_pre_wipe(changes);
+        return false;
+      case kFsmWiping:
+        step_wiping(changes);
+        return false;
+    }
+    ISS_ASSERT(0);
+    return false;
+  }
+
+  void step_idle(Changes *changes) {
+    state.stop_if_pending_halt();
+    bool is_locked = state.fsm_state == kFsmLocked;
+    bool should_zero = is_locked || state.rma_req == kLcTxOn;
+    bool new_zero = state.cycles_in_this_state == 0 ||
+                    state.ext_regs.read(kInsnCnt) != 0;
+    if (should_zero && new_zero)
+      state.ext_regs.write(kInsnCnt, 0);
+
+    if (state.delayed_lock) {
+      state.set_fsm_state(kFsmLocked);
+      state.ext_regs.write(kStatus, kStatusLocked);
+      is_locked = true;
+    }
+
+    if (state.rma_req == kLcTxOn && !is_locked) {
+      state.ext_regs.write(kStatus, kStatusLocked);
+      state.set_fsm_state(kFsmPreWipe);
+      state.lock_after_wipe = true;
+      state.wipe_rounds_done = 0;
+    }
+
+    if (state.init_sec_wipe_is_running() && !is_locked &&
+        state.wsrs.URND.reseed_done) {
+      bool start_of_time_rma =
+          state.rma_req == kLcTxOn && !state.has_state_to_wipe;
+      if (start_of_time_rma) {
+        state.complete_init_sec_wipe();
+        state.set_fsm_state(kFsmLocked);
+        state.ext_regs.write(kStatus, kStatusLocked);
+      } else {
+        state.set_fsm_state(kFsmWiping);
+        if (is_locked)
+          state.lock_after_wipe = true;
+      }
+    }
+
+    *changes = state.changes();
+    state.commit(true);
+  }
+
+  void step_ext_wipe(Changes *changes) {
+    state.stop_if_pending_halt();
+    *changes = state.changes();
+    state.commit(true);
+  }
+
+  void step_pre_exec(Changes *changes) {
+    if (state.wsrs.URND.reseed_done)
+      state.set_fsm_state(kFsmExec);
+    on_stall(false, changes);
+    if (state.rma_req == kLcTxOn)
+      lock_immediately();
+    if (state.ext_regs.read(kInsnCnt) != 0)
+      state.ext_regs.write(kInsnCnt, 0);
+  }
+
+  bool step_exec(Insn *retired, Changes *changes) {
+    ISS_ASSERT(state.init_sec_wipe_is_done());
+    state.wsrs.URND.step();
+    state.mac_rnd_offset = state.mac_rnd_offset_predec;
+    // permute(BN_MAC_PERMUTATION, URND, 2, 192): bits 192 and 193 of the
+    // permutation are 152 and 121.
+    const Wide urnd = state.wsrs.URND.read_unsigned();
+    state.mac_rnd_offset_predec = urnd.bit(152) | urnd.bit(121) << 1;
+
+    if (!next_insn) {
+      state.take_injected_err_bits();
+      on_stall(true, changes);
+      return false;
+    }
+    const Insn &insn = *next_insn;
+
+    if (state.rma_req == kLcTxOn) {
+      state.stop_at_end_of_cycle(1);
+      state.set_fsm_state(kFsmPreWipe);
+      state.lock_after_wipe = true;
+      executing = false;
+    }
+
+    if (!insn.has_bits)
+      executing = false;
+
+    if (!executing) {
+      state.pre_insn(insn.affects_control());
+      exec_ctx = ExecCtx();
+    }
+    executing = execute(&state, insn, &exec_ctx);
+
+    if (state.wsrs.RND.rep_err_escalate)
+      state.stop_at_end_of_cycle(kErrRndRepChkFail);
+    if (state.wsrs.RND.fips_err_escalate)
+      state.stop_at_end_of_cycle(kErrRndFipsChkFail);
+
+    state.take_injected_err_bits();
+    if (state.pending_halt)
+      executing = false;
+
+    bool sim_stalled = executing || state.stall_requested();
+    if (!sim_stalled) {
+      *retired = insn;
+      on_retire(*retired, changes);
+      return true;
+    }
+    on_stall(false, changes);
+    return false;
+  }
+
+  void step_pre_wipe(Changes *changes) {
+    state.ext_regs.write(kStatus, kStatusBusySecWipeInt);
+
+    if (state.rma_req == kLcTxOn && !state.edn_seen_running) {
+      state.lock_after_wipe = true;
+      state.wipe_rounds_to_do = 1;
+      state.set_fsm_state(kFsmWiping);
+    }
+
+    if (state.ext_regs.read(kWipeStart))
+      state.ext_regs.write(kWipeStart, 0);
+
+    delayed_insn_cnt_zero(0);
+
+    if (state.wsrs.URND.reseed_done) {
+      uint32_t status = state.ext_regs.read(kStatus);
+      if (status != kStatusBusySecWipeInt && status != kStatusLocked)
+        state.ext_regs.write(kStatus, kStatusBusySecWipeInt);
+      state.set_fsm_state(kFsmWiping);
+    }
+
+    on_stall(false, changes);
+  }
+
+  void step_wiping(Changes *changes) {
+    ISS_ASSERT(state.wipe_cycles >= 0);
+    bool was_wiping = state.wipe_cycles > 0;
+    if (was_wiping) {
+      --state.wipe_cycles;
+      state.wsrs.URND.step();
+    }
+
+    bool is_good = !state.lock_after_wipe;
+    bool locking = state.rma_req == kLcTxOn || !is_good;
+    if (state.rma_req == kLcTxOn)
+      state.lock_after_wipe = true;
+    if (state.pending_halt)
+      state.lock_after_wipe = true;
+
+    bool from_wipe = state.old_state == kFsmPreWipe ||
+                     state.old_state == kFsmWiping;
+    delayed_insn_cnt_zero(from_wipe && state.rma_req != kLcTxOn ? 0 : 1);
+
+    if (state.wipe_cycles == 3 &&
+        state.wipe_rounds_done == state.wipe_rounds_to_do - 1)
+      state.mai.on_sec_wipe_zero_step(state.wsrs);
+
+    if (state.wipe_cycles == 1) {
+      if (state.wipe_rounds_done == state.wipe_rounds_to_do - 1) {
+        state.ext_regs.write(kStatus, locking ? kStatusLocked : kStatusIdle);
+        state.wipe();
+      } else {
+        state.wsrs.URND.running = false;
+        state.wsrs.URND.reseed_done = false;
+        state.wsrs.URND.requesting = true;
+      }
+    }
+
+    if (state.wipe_cycles == 0) {
+      if (was_wiping)
+        ++state.wipe_rounds_done;
+      if (state.wipe_rounds_done != state.wipe_rounds_to_do) {
+        state.set_fsm_state(kFsmPreWipe);
+      } else {
+        if (state.rma_req != kLcTxOff)
+          state.delayed_lock = true;
+        FsmState next_state;
+        if (locking) {
+          next_state = kFsmLocked;
+          state.ext_regs.write(kStatus, kStatusLocked);
+        } else {
+          next_state = kFsmIdle;
+          if (state.init_sec_wipe_is_running())
+            state.complete_init_sec_wipe();
+        }
+        state.wipe_cycles = -1;
+        state.set_fsm_state(next_state);
+      }
+    }
+
+    on_stall(false, changes);
+  }
+
+  void on_otp_cdc_done() {
+    FsmState cur_state = state.fsm_state;
+    ISS_ASSERT(cur_state == kFsmMemSecWipe || cur_state == kFsmPreWipe ||
+               cur_state == kFsmWiping || cur_state == kFsmLocked);
+    if (cur_state == kFsmMemSecWipe) {
+      state.ext_regs.write(kStatus, kStatusIdle);
+      state.set_fsm_state(kFsmIdle);
+    }
+  }
+
+  void send_err_escalation(uint32_t err_val, bool lock_immediately) {
+    ISS_ASSERT((err_val & ~kErrMask) == 0);
+    state.injected_err_bits |= err_val;
+    state.lock_immediately = lock_immediately;
+  }
+
+  void lock_immediately() {
+    state.set_fsm_state(kFsmLocked);
+    state.ext_regs.write(kStatus, kStatusLocked, true);
+  }
+
+  void urnd_completed() {
+    state.urnd_completed();
+    if (state.fsm_state != kFsmPreExec && state.fsm_state != kFsmPreWipe)
+      lock_immediately();
+  }
+};
+
+// ---------------------------------------------------------------------------
+// Tracing and text commands (stepped.py)
+
+// The result of step_for_trace: the RTL trace for a single cycle
+struct StepTrace {
+  // The type of the trace entry, or Invalid if there is nothing to report
+  OtbnTraceRecord::trace_type_t type;
+  uint32_t pc;
+  // Valid if type is Exec
+  Insn insn;
+  Changes changes;
+
+  void lines(std::vector<std::string> *dst) const {
+    switch (type) {
+      case OtbnTraceRecord::Invalid:
+        return;
+      case OtbnTraceRecord::Exec: {
+        // The header is two lines (the second is a comment)
+        std::string hdr = insn.rtl_trace(pc);
+        size_t nl = hdr.find('\n');
+        dst->push_back(hdr.substr(0, nl));
+        dst->push_back(hdr.substr(nl + 1));
+      } break;
+      case OtbnTraceRecord::WipeInProgress:
+        dst->push_back("U ");
+        break;
+      case OtbnTraceRecord::WipeComplete:
+        dst->push_back("V ");
+        break;
+      default:
+        dst->push_back("STALL");
+        break;
+    }
+    for (const Change &c : changes)
+      dst->push_back(c.rtl_trace());
+  }
+
+  // Fill in a trace record (which should be empty) and append the updates to
+  // mirrored external registers, like write_to_channel in stepped.py.
+  void write_to_record(
+      OtbnTraceRecord *record,
+      std::vector<std::pair<uint32_t, uint32_t>> *ext_regs) const {
+    if (type == OtbnTraceRecord::Invalid)
+      return;
+
+    if (type == OtbnTraceRecord::Exec) {
+      record->set_header(type, true, !insn.has_bits, pc, insn.raw);
+      const char *mnemonic = insn.has_bits ? insn.mnemonic() : "??";
+      record->set_mnemonic(mnemonic,
+                           strnlen(mnemonic, kOtbnTraceMnemonicLen - 1));
+    } else {
+      record->set_header(type, false, false, 0, 0);
+    }
+
+    for (const Change &c : changes)
+      c.add_write(record);
+    for (const Change &c : changes) {
+      if (c.kind == Change::Ext && c.loc != kNoLoc)
+        ext_regs->emplace_back(c.loc, c.value->word(0));
+    }
+  }
+};
+
+StepTrace step_for_trace(OTBNSim *sim) {
+  StepTrace ret{OtbnTraceRecord::Invalid, sim->state.pc, Insn(), Changes()};
+  ISS_ASSERT((ret.pc & 3) == 0);
+  bool was_wiping = sim->state.wiping();
+
+  Changes changes;
+  OtbnTraceRecord::trace_type_t type;
+  if (sim->step(&ret.insn, &changes))
+    type = OtbnTraceRecord::Exec;
+  else if (was_wiping)
+    type = sim->state.wipe_rounds_done == 2 ? OtbnTraceRecord::WipeComplete
+                                            : OtbnTraceRecord::WipeInProgress;
+  else if (sim->state.executing())
+    type = OtbnTraceRecord::Stall;
+  else
+    type = OtbnTraceRecord::Invalid;
+
+  if (sim->state.lock_immediately && (type == OtbnTraceRecord::WipeComplete ||
+                                      type == OtbnTraceRecord::Stall))
+    type = OtbnTraceRecord::Invalid;
+
+  // Every change that we track appears in the RTL trace
+  if (type == OtbnTraceRecord::Invalid && !changes.empty())
+    type = OtbnTraceRecord::Stall;
+  if (type == OtbnTraceRecord::Invalid)
+    return ret;
+
+  ret.type = type;
+  ret.changes = std::move(changes);
+  return ret;
+}
+
+void check_arg_count(const char *cmd, size_t cnt,
+                     const std::vector<std::string> &args) {
+  if (args.size() == cnt)
+    return;
+  std::ostringstream oss;
+  oss << cmd << " expects ";
+  if (cnt == 0)
+    oss << "no arguments";
+  else if (cnt == 1)
+    oss << "exactly one argument";
+  else
+    oss << "exactly " << cnt << " arguments";
+  oss << " arguments. Got [";
+  for (size_t i = 0; i < args.size(); ++i)
+    oss << (i ? ", '" : "'") << args[i] << "'";
+  oss << "].";
+  throw std::invalid_argument(oss.str());
+}
+
+Wide read_word(const char *arg_name, const std::string &word_data,
+               unsigned bits) {
+  Wide value;
+  bool negative, too_big;
+  if (!parse_int(word_data, &value, &negative, &too_big)) {
+    std::ostringstream oss;
+    oss << "Failed to read '" << word_data << "' as an integer for <"
+        << arg_name << "> argument.";
+    throw std::invalid_argument(oss.str());
+  }
+  if ((negative && !value.is_zero()) || too_big ||
+      !(value >> bits).is_zero()) {
+    std::ostringstream oss;
+    oss << "<" << arg_name << "> argument is '" << word_data
+        << "': not representable in " << bits << " bits.";
+    throw std::invalid_argument(oss.str());
+  }
+  return value;
+}
+
+uint32_t read_u32(const char *arg_name, const std::string &word_data,
+                  unsigned bits) {
+  return read_word(arg_name, word_data, bits).word(0);
+}
+
+std::string format_u32(const char *fmt, uint32_t value) {
+  char buf[64];
+  snprintf(buf, sizeof buf, fmt, value);
+  return buf;
+}
+
+}  // namespace
+
+struct OtbnIss::Impl {
+  uint32_t imem_words;
+  uint32_t dmem_words;
+  std::unique_ptr<OTBNSim> sim;
+
+  Impl(uint32_t imem_words_, uint32_t dmem_words_)
+      : imem_words(imem_words_),
+        dmem_words(dmem_words_),
+        sim(new OTBNSim()) {}
+
+  void run_command(const std::vector<std::string> &words,
+                   std::vector<std::string> *out);
+
+  uint32_t run_standalone();
+};
+
+namespace {
+
+// The fixed RND values and URND seed words that standalonesim.py uses in
+// place of an EDN (_TEST_RND_DATA and _TEST_URND_SEED).
+Wide test_rnd_data(unsigned idx) {
+  static const uint32_t kWords[2][2] = {{0x99999999, 0xAAAAAAAA},
+                                        {0xBBBBBBBB, 0xCCCCCCCC}};
+  Wide ret;
+  for (unsigned i = 0; i < 8; ++i)
+    ret.set_word(i, kWords[idx % 2][i % 2]);
+  return ret;
+}
+
+const uint32_t kTestUrndSeed[] = {0x11111111, 0x22222222, 0x33333333,
+                                  0x44444444, 0x55555555, 0x66666666};
+
+}  // namespace
+
+// Run the loaded program to completion, as in standalone.py's main() and
+// StandaloneSim.run(). Returns the number of cycles taken.
+uint32_t OtbnIss::Impl::run_standalone() {
+  OTBNState &state = sim->state;
+
+  Wide key0, key1;
+  for (unsigned i = 0; i < 12; ++i) {
+    key0.set_word(i, 0xdeadbeef);
+    key1.set_word(i, 0xbaadf00d);
+  }
+  state.wsrs.set_sideload_keys(OptWide(key0), OptWide(key1));
+  state.ext_regs.commit();
+  sim->start();
+
+  state.complete_init_sec_wipe();
+  state.wfi_enabled = true;
+  state.wfi_auto_resume = true;
+
+  uint32_t cycles = 0;
+  unsigned rnd_idx = 0, urnd_idx = 0;
+  const unsigned num_seeds = sizeof kTestUrndSeed / sizeof kTestUrndSeed[0];
+  for (;;) {
+    if (state.ext_regs.read(kRndReq))
+      state.wsrs.RND.set_unsigned(test_rnd_data(rnd_idx++), false, false);
+
+    if (state.wsrs.URND.requesting) {
+      state.wsrs.URND.set_seed(kTestUrndSeed[urnd_idx]);
+      urnd_idx = (urnd_idx + 1) % num_seeds;
+      if (urnd_idx == 0)
+        state.wsrs.URND.reseed_done = true;
+    }
+
+    Insn retired;
+    Changes changes;
+    sim->step(&retired, &changes);
+    ++cycles;
+
+    if (state.fsm_state == kFsmIdle || state.fsm_state == kFsmLocked)
+      return cycles;
+  }
+}
+
+void OtbnIss::Impl::run_command(const std::vector<std::string> &words,
+                                std::vector<std::string> *out) {
+  const std::string &verb = words[0];
+  std::vector<std::string> args(words.begin() + 1, words.end());
+  OTBNState &state = sim->state;
+
+  if (verb == "start_operation") {
+    check_arg_count("start_operation", 1, args);
+    if (args[0] == "Execute") {
+      out->push_back("START");
+      sim->start();
+    } else if (args[0] == "DmemWipe") {
+      sim->start_mem_wipe(false);
+    } else if (args[0] == "ImemWipe") {
+      sim->start_mem_wipe(true);
+    } else {
+      throw std::invalid_argument("Invalid command for start_operation: " +
+                                  args[0] + ".");
+    }
+  } else if (verb == "otp_key_cdc_done") {
+    check_arg_count("otp_key_cdc_done", 0, args);
+    sim->on_otp_cdc_done();
+  } else if (verb == "step") {
+    check_arg_count("step", 0, args);
+    step_for_trace(sim.get()).lines(out);
+  } else if (verb == "add_loop_warp") {
+    check_arg_count("add_loop_warp", 3, args);
+    uint32_t vals[3];
+    const char *names[3] = {"addr", "from_cnt", "to_cnt"};
+    for (int i = 0; i < 3; ++i)
+      vals[i] = read_u32(names[i], args[i], 32);
+    std::ostringstream oss;
+    oss << "ADD_LOOP_WARP 0x" << std::hex << vals[0] << std::dec << " "
+        << vals[1] << " " << vals[2];
+    out->push_back(oss.str());
+    sim->add_loop_warp(vals[0], vals[1], vals[2]);
+  } else if (verb == "clear_loop_warps") {
+    check_arg_count("clear_loop_warps", 0, args);
+    sim->loop_warps.clear();
+  } else if (verb == "print_regs") {
+    check_arg_count("print_regs", 0, args);
+    out->push_back("PRINT_REGS");
+    // As in the Python model, this shows the underlying registers for x0 and
+    // x1 (which are never written) rather than the call stack.
+    for (unsigned idx = 0; idx < 32; ++idx) {
+      char buf[32];
+      snprintf(buf, sizeof buf, " x%-2u = 0x%08x", idx,
+               idx < 2 ? 0 : state.gprs.regs[idx]);
+      out->push_back(buf);
+    }
+    for (unsigned idx = 0; idx < 32; ++idx) {
+      char buf[16];
+      snprintf(buf, sizeof buf, " w%-2u = 0x", idx);
+      std::string line(buf);
+      for (unsigned w = 8; w > 0; --w) {
+        snprintf(buf, sizeof buf, "%08x", state.wdrs.regs[idx].word(w - 1));
+        line += buf;
+      }
+      out->push_back(line);
+    }
+  } else if (verb == "print_call_stack") {
+    check_arg_count("print_call_stack", 0, args);
+    out->push_back("PRINT_CALL_STACK");
+    for (uint32_t value : state.gprs.stack)
+      out->push_back(format_u32("0x%08x", value));
+  } else if (verb == "reset") {
+    check_arg_count("reset", 0, args);
+    sim.reset(new OTBNSim());
+  } else if (verb == "edn_rnd_step") {
+    check_arg_count("edn_rnd_step", 2, args);
+    uint32_t data = read_u32("edn_rnd_step", args[0], 32);
+    bool fips_err = read_u32("fips_err", args[1], 1);
+    state.edn_rnd_step(data, fips_err);
+  } else if (verb == "edn_urnd_step") {
+    check_arg_count("edn_urnd_step", 1, args);
+    state.edn_urnd_step(read_u32("edn_urnd_step", args[0], 32));
+  } else if (verb == "edn_flush") {
+    check_arg_count("edn_flush", 0, args);
+    state.edn_flush();
+  } else if (verb == "edn_urnd_cdc_done") {
+    check_arg_count("urnd_cdc_done", 0, args);
+    sim->urnd_completed();
+  } else if (verb == "edn_rnd_cdc_done") {
+    check_arg_count("edn_rnd_cdc_done", 0, args);
+    state.rnd_completed();
+  } else if (verb == "invalidate_imem") {
+    check_arg_count("invalidate_imem", 0, args);
+    state.invalidate_imem();
+  } else if (verb == "invalidate_dmem") {
+    check_arg_count("invalidate_dmem", 0, args);
+    state.dmem.invalidate_dmem();
+  } else if (verb == "set_software_errs_fatal") {
+    check_arg_count("set_software_errs_fatal", 1, args);
+    state.software_errs_fatal = read_u32("error", args[0], 1);
+  } else if (verb == "set_wfi_enabled") {
+    check_arg_count("set_wfi_enabled", 1, args);
+    state.wfi_enabled = read_u32("enabled", args[0], 1);
+  } else if (verb == "wfi_resume") {
+    check_arg_count("wfi_resume", 0, args);
+    state.request_wfi_resume();
+  } else if (verb == "set_keymgr_value") {
+    check_arg_count("set_keymgr_value", 3, args);
+    Wide key0 = read_word("key0", args[0], 384);
+    Wide key1 = read_word("key1", args[1], 384);
+    bool valid = read_u32("valid", args[2], 1);
+    state.wsrs.set_sideload_keys(valid ? OptWide(key0) : std::nullopt,
+                                 valid ? OptWide(key1) : std::nullopt);
+  } else if (verb == "step_crc") {
+    check_arg_count("step_crc", 2, args);
+    Wide item = read_word("item", args[0], 48);
+    uint32_t crc_state = read_u32("state", args[1], 32);
+    uint8_t bytes[6];
+    for (unsigned i = 0; i < 6; ++i)
+      bytes[i] = item.bits(8 * i, 8);
+    uint32_t new_state = crc32_update(crc_state, bytes, sizeof bytes);
+    out->push_back(format_u32("! otbn.LOAD_CHECKSUM: 0x%08x", new_state));
+  } else if (verb == "send_err_escalation") {
+    check_arg_count("send_err_escalation", 2, args);
+    uint32_t err_val = read_u32("err_val", args[0], 32);
+    bool lock_immediately = read_u32("lock_immediately", args[1], 1);
+    sim->send_err_escalation(err_val, lock_immediately);
+  } else if (verb == "send_stall_request") {
+    check_arg_count("send_stall_request", 1, args);
+    state.request_stall(read_u32("enforced", args[0], 1));
+  } else if (verb == "set_rma_req") {
+    check_arg_count("set_rma_req", 1, args);
+    state.rma_req = read_lc_tx_t(read_u32("rma_req", args[0], 4));
+  } else if (verb == "initial_secure_wipe") {
+    check_arg_count("initial_secure_wipe", 0, args);
+    sim->initial_secure_wipe();
+  } else if (verb == "load_elf" || verb == "load_d" || verb == "load_i" ||
+             verb == "dump_d") {
+    // These take paths to files in formats that only the Python tooling
+    // writes. ISSWrapper passes memory contents with load_d, load_i and
+    // dump_d below instead.
+    throw std::runtime_error("The " + verb +
+                             " command is not supported by the native ISS.");
+  } else {
+    throw std::runtime_error("Unknown command: '" + verb + "'");
+  }
+}
+
+OtbnIss::OtbnIss(uint32_t imem_words, uint32_t dmem_words)
+    : impl_(new Impl(imem_words, dmem_words)) {}
+
+OtbnIss::~OtbnIss() {}
+
+void OtbnIss::load_d(const Ecc32MemArea::EccWords &words) {
+  impl_->sim->state.dmem.load_words(words);
+}
+
+void OtbnIss::load_i(const Ecc32MemArea::EccWords &words) {
+  impl_->sim->load_program(decode_words(words));
+}
+
+Ecc32MemArea::EccWords OtbnIss::dump_d() const {
+  Ecc32MemArea::EccWords ret = impl_->sim->state.dmem.dump_words();
+  if (ret.size() < impl_->dmem_words) {
+    std::ostringstream oss;
+    oss << "Cannot fill a " << impl_->dmem_words << " word DMEM region with "
+        << ret.size() << " words.";
+    throw std::runtime_error(oss.str());
+  }
+  ret.resize(impl_->dmem_words);
+  return ret;
+}
+
+void OtbnIss::step(OtbnTraceRecord *trace,
+                   std::vector<std::pair<uint32_t, uint32_t>> *ext_regs) {
+  assert(trace && trace->empty() && ext_regs);
+  step_for_trace(impl_->sim.get()).write_to_record(trace, ext_regs);
+}
+
+uint32_t OtbnIss::run_standalone() { return impl_->run_standalone(); }
+
+void OtbnIss::dump_regs(std::vector<std::string> *dst) {
+  const OTBNState &state = impl_->sim->state;
+  const ExtReg regs[] = {kErrBits, kInsnCnt, kStopPc};
+  const char *names[] = {"ERR_BITS", "INSN_CNT", "STOP_PC"};
+  for (unsigned i = 0; i < 3; ++i) {
+    char buf[32];
+    snprintf(buf, sizeof buf, " %s = 0x%08x", names[i],
+             state.ext_regs.read(regs[i]));
+    dst->push_back(buf);
+  }
+
+  // The registers are printed as for print_regs, without its header line
+  std::vector<std::string> lines;
+  impl_->run_command({"print_regs"}, &lines);
+  dst->insert(dst->end(), lines.begin() + 1, lines.end());
+}
+
+void OtbnIss::run_command(const std::string &cmd,
+                          std::vector<std::string> *dst) {
+  std::istringstream iss(cmd);
+  std::vector<std::string> words;
+  for (std::string word; iss >> word;)
+    words.push_back(word);
+  if (words.empty())
+    return;
+
+  std::vector<std::string> lines;
+  impl_->run_command(words, &lines);
+  if (dst)
+    dst->insert(dst->end(), lines.begin(), lines.end());
+}
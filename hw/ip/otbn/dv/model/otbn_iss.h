@@ -0,0 +1,67 @@
+// Copyright lowRISC contributors (OpenTitan project).
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+#ifndef OPENTITAN_HW_IP_OTBN_DV_MODEL_OTBN_ISS_H_
+#define OPENTITAN_HW_IP_OTBN_DV_MODEL_OTBN_ISS_H_
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "ecc32_mem_area.h"
+#include "otbn_trace_record.h"
+
+// An in-process C++ port of the Python ISS in hw/ip/otbn/dv/otbnsim.
+//
+// ISSWrapper uses this in place of the Python subprocess if the OTBN_ISS
+// environment variable is set to "native". The interface matches the commands
+// that ISSWrapper sends to stepped.py: memory contents are passed as ECC words
+// (as in the load_d, load_i and dump_d commands), each step fills in a trace
+// record (as with the binary step command) and any other command is passed as
+// a line of text and returns the lines that stepped.py would print.
+//
+// Wide (256-bit) values are stored as __int128 limbs, so this needs a compiler
+// that supports that extension (GCC or Clang on a 64-bit host).
+class OtbnIss {
+ public:
+  // The memory sizes are in 32-bit words, as for ISSWrapper.
+  OtbnIss(uint32_t imem_words, uint32_t dmem_words);
+  ~OtbnIss();
+
+  // Load new contents of DMEM or IMEM
+  void load_d(const Ecc32MemArea::EccWords &words);
+  void load_i(const Ecc32MemArea::EccWords &words);
+
+  // Return the contents of DMEM (dmem_words words)
+  Ecc32MemArea::EccWords dump_d() const;
+
+  // Step the model by a cycle. Fill in trace (which should be empty) with the
+  // RTL trace entry for the cycle (leaving it empty if there is nothing to
+  // report). Append the new values of any mirrored external registers that
+  // changed to ext_regs, as (EXT_REG ID, value) pairs (see EXT_REG_IDS in
+  // otbnsim/shm_channel.py).
+  void step(OtbnTraceRecord *trace,
+            std::vector<std::pair<uint32_t, uint32_t>> *ext_regs);
+
+  // Run the loaded program until it stops, as standalone.py does: skip the
+  // initial secure wipe, let WFI resume immediately and answer each RND or
+  // URND request at once with the fixed values from standalonesim.py.
+  // Returns the number of cycles taken.
+  uint32_t run_standalone();
+
+  // Append the lines that standalone.py writes for --dump-regs to dst
+  void dump_regs(std::vector<std::string> *dst);
+
+  // Run a text command in the syntax of stepped.py. If dst is not null,
+  // append the lines of output (without the final '.') to it. Throws a
+  // std::exception on failure.
+  void run_command(const std::string &cmd, std::vector<std::string> *dst);
+
+ private:
+  struct Impl;
+  std::unique_ptr<Impl> impl_;
+};
+
+#endif  // OPENTITAN_HW_IP_OTBN_DV_MODEL_OTBN_ISS_H_
@@ -0,0 +1,126 @@
+// Copyright lowRISC contributors (OpenTitan project).
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+
+// Run a program on the native ISS in the same way as otbnsim/standalone.py.
+// This is used by otbnsim/test/native_iss_test.py to compare the native ISS
+// with the Python one.
+//
+// Usage:
+//
+//   otbn_iss_standalone [--loop-warp ADDR:FROM:TO]... IMEM DMEM REGS DMEM_OUT
+//
+// IMEM and DMEM hold the initial memory contents in the format of stepped.py's
+// load_i and load_d commands (5 bytes per 32-bit word: a validity byte and
+// then the word, little-endian). The register dump is written to REGS in the
+// format of standalone.py's --dump-regs, and the final contents of DMEM are
+// written to DMEM_OUT in the same format as DMEM.
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "otbn_iss.h"
+
+static Ecc32MemArea::EccWords read_words(const char *path) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file) {
+    throw std::runtime_error(std::string("Cannot open ") + path);
+  }
+  std::vector<uint8_t> bytes((std::istreambuf_iterator<char>(file)),
+                             std::istreambuf_iterator<char>());
+  if (bytes.size() % 5) {
+    throw std::runtime_error(std::string("The size of ") + path +
+                             " is not a multiple of 5.");
+  }
+
+  Ecc32MemArea::EccWords ret;
+  for (size_t i = 0; i < bytes.size(); i += 5) {
+    uint32_t word = 0;
+    for (int j = 0; j < 4; ++j) {
+      word |= (uint32_t)bytes[i + 1 + j] << (8 * j);
+    }
+    ret.emplace_back(bytes[i] != 0, word);
+  }
+  return ret;
+}
+
+static void write_words(const char *path,
+                        const Ecc32MemArea::EccWords &words) {
+  std::ofstream file(path, std::ios::binary);
+  for (const auto &word : words) {
+    char bytes[5] = {word.first ? '\1' : '\0'};
+    for (int j = 0; j < 4; ++j) {
+      bytes[1 + j] = (char)(word.second >> (8 * j));
+    }
+    file.write(bytes, sizeof bytes);
+  }
+  if (!file) {
+    throw std::runtime_error(std::string("Failed to write ") + path);
+  }
+}
+
+static void usage(const char *argv0) {
+  fprintf(stderr,
+          "Usage: %s [--loop-warp ADDR:FROM:TO]... IMEM DMEM REGS DMEM_OUT\n",
+          argv0);
+}
+
+int main(int argc, char **argv) {
+  std::vector<std::string> warp_cmds;
+  std::vector<const char *> paths;
+  for (int i = 1; i < argc; ++i) {
+    if (!strcmp(argv[i], "--loop-warp") && i + 1 < argc) {
+      unsigned addr, from_cnt, to_cnt;
+      if (sscanf(argv[++i], "%i:%u:%u", &addr, &from_cnt, &to_cnt) != 3) {
+        usage(argv[0]);
+        return 1;
+      }
+      warp_cmds.push_back("add_loop_warp " + std::to_string(addr) + " " +
+                          std::to_string(from_cnt) + " " +
+                          std::to_string(to_cnt));
+    } else {
+      paths.push_back(argv[i]);
+    }
+  }
+  if (paths.size() != 4) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  try {
+    Ecc32MemArea::EccWords imem = read_words(paths[0]);
+    Ecc32MemArea::EccWords dmem = read_words(paths[1]);
+
+    OtbnIss iss(imem.size(), dmem.size());
+    iss.load_i(imem);
+    iss.load_d(dmem);
+    for (const std::string &cmd : warp_cmds) {
+      iss.run_command(cmd, nullptr);
+    }
+
+    iss.run_standalone();
+
+    std::vector<std::string> lines;
+    iss.dump_regs(&lines);
+    std::ofstream regs(paths[2]);
+    for (const std::string &line : lines) {
+      regs << line << "\n";
+    }
+    if (!regs) {
+      throw std::runtime_error(std::string("Failed to write ") + paths[2]);
+    }
+
+    write_words(paths[3], iss.dump_d());
+  } catch (const std::exception &err) {
+    std::cerr << "Error: " << err.what() << "\n";
+    return 1;
+  }
+  return 0;
+}
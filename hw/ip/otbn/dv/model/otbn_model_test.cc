@@ -0,0 +1,182 @@
+// Copyright lowRISC contributors (OpenTitan project).
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+
+// Model-level test for moving memory contents between the "RTL" and the ISS.
+// The memories that OtbnModel would reach over DPI are faked in this file, so
+// no simulator is needed. The test runs once with the default ISS (the Python
+// model in a subprocess, unless OTBN_ISS says otherwise) and once with the
+// native ISS.
+
+#include <cstdlib>
+#include <cstring>
+#include <gtest/gtest.h>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "otbn_memutil.h"
+#include "otbn_model.h"
+
+namespace {
+
+// A simulated memory, indexed by physical word. Each word is stored in the
+// SV_MEM_WIDTH_BYTES-sized slot that the simutil DPI functions use.
+struct FakeMem {
+  std::string name;
+  std::map<int, std::vector<uint8_t>> words;
+};
+
+std::map<std::string, FakeMem> fake_mems;
+FakeMem *cur_scope = nullptr;
+
+}  // namespace
+
+// The DPI functions that OtbnModel and its memory areas call. Scopes are the
+// FakeMem objects in fake_mems.
+extern "C" {
+svScope svGetScopeFromName(const char *name) {
+  FakeMem &mem = fake_mems[name];
+  mem.name = name;
+  return &mem;
+}
+
+svScope svSetScope(svScope scope) {
+  svScope prev = cur_scope;
+  cur_scope = static_cast<FakeMem *>(scope);
+  return prev;
+}
+
+svScope svGetScope() { return cur_scope; }
+
+const char *svGetNameFromScope(svScope scope) {
+  return static_cast<FakeMem *>(scope)->name.c_str();
+}
+
+svBit svGetBitselBit(const svBitVecVal *src, int bit) {
+  return (src[bit / 32] >> (bit % 32)) & 1;
+}
+
+void svPutBitselBit(svBitVecVal *dst, int bit, svBit val) {
+  dst[bit / 32] &= ~(1u << (bit % 32));
+  dst[bit / 32] |= (uint32_t)(val & 1) << (bit % 32);
+}
+
+int simutil_set_mem_bulk(int index, int count, const svBitVecVal *val) {
+  const uint8_t *src = reinterpret_cast<const uint8_t *>(val);
+  for (int i = 0; i < count; ++i) {
+    const uint8_t *slot = &src[i * SV_MEM_WIDTH_BYTES];
+    cur_scope->words[index + i].assign(slot, slot + SV_MEM_WIDTH_BYTES);
+  }
+  return 1;
+}
+
+int simutil_get_mem_bulk(int index, int count, svBitVecVal *val) {
+  uint8_t *dst = reinterpret_cast<uint8_t *>(val);
+  for (int i = 0; i < count; ++i) {
+    std::vector<uint8_t> &word = cur_scope->words[index + i];
+    word.resize(SV_MEM_WIDTH_BYTES);
+    memcpy(&dst[i * SV_MEM_WIDTH_BYTES], word.data(), SV_MEM_WIDTH_BYTES);
+  }
+  return 1;
+}
+
+int simutil_get_scramble_key(svBitVecVal *key) {
+  memset(key, 0xa5, 128 / 8);
+  return 1;
+}
+
+int simutil_get_scramble_nonce(svBitVecVal *nonce) {
+  memset(nonce, 0x3c, 320 / 8);
+  return 1;
+}
+
+// Nothing in this test loads files, fills memories or peeks at the design.
+void simutil_memload(const char *) { abort(); }
+int simutil_fill_mem(int, int, const svBitVecVal *) { abort(); }
+int otbn_rf_peek(int, svBitVecVal *) { abort(); }
+int otbn_stack_element_peek(int, svBitVecVal *) { abort(); }
+}
+
+namespace {
+
+const char kMemScope[] = "tb.u_otbn";
+const char kDesignScope[] = "tb.u_otbn.u_otbn_core";
+
+class OtbnModelTest : public testing::TestWithParam<bool> {
+ protected:
+  void SetUp() override {
+    const char *iss = getenv("OTBN_ISS");
+    had_iss_ = iss != nullptr;
+    if (had_iss_) {
+      old_iss_ = iss;
+    }
+    if (GetParam()) {
+      setenv("OTBN_ISS", "native", 1);
+    }
+    fake_mems.clear();
+  }
+
+  void TearDown() override {
+    if (had_iss_) {
+      setenv("OTBN_ISS", old_iss_.c_str(), 1);
+    } else {
+      unsetenv("OTBN_ISS");
+    }
+  }
+
+  bool had_iss_;
+  std::string old_iss_;
+};
+
+// Fill a memory with a pattern, where every 37th word has bad integrity.
+Ecc32MemArea::EccWords Pattern(size_t num_words) {
+  Ecc32MemArea::EccWords ret;
+  for (size_t i = 0; i < num_words; ++i) {
+    ret.emplace_back(i % 37 != 5, 0x9e3779b9u * (i + 1));
+  }
+  return ret;
+}
+
+// The ISS keeps the validity of a word with bad integrity, but not its data.
+// Zero the data of such words so that memory contents can be compared.
+Ecc32MemArea::EccWords ValidData(Ecc32MemArea::EccWords words) {
+  for (auto &word : words) {
+    if (!word.first) {
+      word.second = 0;
+    }
+  }
+  return words;
+}
+
+// Send all of DMEM from the RTL to the ISS (as the model does at the start of
+// an operation) and then back again (as load_dmem does at the end of one).
+// Each direction moves the whole memory through the ISS's channel, so sizes
+// in the wrong units fail here.
+TEST_P(OtbnModelTest, DmemRoundTrip) {
+  OtbnModel model(kMemScope, kDesignScope);
+  OtbnMemUtil mem_util(kMemScope);
+  const ScrambledEcc32MemArea &imem = mem_util.GetMemArea(true);
+  const ScrambledEcc32MemArea &dmem = mem_util.GetMemArea(false);
+  uint32_t dmem_words = dmem.GetSizeBytes() / 4;
+
+  imem.WriteWithIntegrity(
+      0, Ecc32MemArea::EccWords(imem.GetSizeBytes() / 4, {true, 0}));
+  Ecc32MemArea::EccWords expected = Pattern(dmem_words);
+  dmem.WriteWithIntegrity(0, expected);
+  ASSERT_EQ(dmem.ReadWithIntegrity(0, dmem.GetSizeWords()), expected);
+
+  ASSERT_EQ(model.start_operation(OtbnModel::Execute), 0);
+
+  dmem.WriteWithIntegrity(0, Ecc32MemArea::EccWords(dmem_words, {true, 0}));
+  ASSERT_EQ(model.load_dmem(), 0);
+  EXPECT_EQ(ValidData(dmem.ReadWithIntegrity(0, dmem.GetSizeWords())),
+            ValidData(expected));
+}
+
+INSTANTIATE_TEST_SUITE_P(Iss, OtbnModelTest, testing::Bool(),
+                         [](const testing::TestParamInfo<bool> &info) {
+                           return info.param ? "Native" : "Default";
+                         });
+
+}  // namespace
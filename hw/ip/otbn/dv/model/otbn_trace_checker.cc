@@ -42,7 +42,7 @@ OtbnTraceChecker &OtbnTraceChecker::get() {
   return *trace_checker;
 }
 
-void OtbnTraceChecker::AcceptTraceString(const std::string &trace,
+void OtbnTraceChecker::AcceptTraceRecord(const OtbnTraceRecord &record,
                                          unsigned int cycle_count) {
   assert(!(rtl_pending_ && iss_pending_));
 
@@ -50,14 +50,9 @@ void OtbnTraceChecker::AcceptTraceString(const std::string &trace,
     return;
 
   done_ = false;
-  OtbnTraceEntry trace_entry;
-  if (!trace_entry.from_rtl_trace(trace)) {
-    seen_err_ = true;
-    return;
-  }
-  if (trace_entry.trace_type() == OtbnTraceEntry::Invalid) {
+  if (record.trace_type() == OtbnTraceRecord::Invalid) {
     std::cerr << "ERROR: Invalid RTL trace entry with invalid header:\n";
-    trace_entry.print("  ", std::cerr);
+    record.print("  ", std::cerr);
     seen_err_ = true;
     return;
   }
@@ -68,9 +63,9 @@ void OtbnTraceChecker::AcceptTraceString(const std::string &trace,
   //
   // To avoid things being really mysterious, write this to stderr as well. It
   // shouldn't happen very often, so we won't generate much text.
-  if (trace_entry.trace_type() == OtbnTraceEntry::Stray) {
+  if (record.trace_type() == OtbnTraceRecord::Stray) {
     std::cerr << "INFO: RTL trace entry with header 'Z':\n";
-    trace_entry.print("  ", std::cerr);
+    record.print("  ", std::cerr);
     std::cerr << "Discarding the entry: "
               << "we expect to lock shortly afterwards anyway.\n";
     return;
@@ -84,7 +79,7 @@ void OtbnTraceChecker::AcceptTraceString(const std::string &trace,
             "  First RTL entry was:\n");
     rtl_entry_.print("    ", std::cerr);
     std::cerr << "  Second RTL entry was:\n";
-    trace_entry.print("    ", std::cerr);
+    record.print("    ", std::cerr);
     seen_err_ = true;
     return;
   }
@@ -96,79 +91,61 @@ void OtbnTraceChecker::AcceptTraceString(const std::string &trace,
   //
   // We work on the basis that an instruction will appear as zero or more
   // "partial entries" (S or U) followed by an "final" entry (E or V). When we
-  // see a partial entry, we merge it into rtl_partial_entry_, setting
-  // rtl_partial_ to flag that it contains some information.
+  // see a partial entry, we merge it into rtl_entry_, setting rtl_started_ to
+  // flag that it contains some information.
   //
   // When a final entry comes up, we check it matches any pending partial entry
   // and then merge all the fields together, finally setting rtl_pending_.
-  if (trace_entry.is_partial()) {
-    if (rtl_started_) {
-      // We already have a partial entry. Make sure the headers match.
-      if (!trace_entry.is_compatible(rtl_entry_)) {
-        std::cerr
-            << ("ERROR: Partial trace entry followed by "
-                "mis-matching partial entry.\n"
-                "  Existing partial entry was:\n");
-        rtl_entry_.print("    ", std::cerr);
-        std::cerr << "  New partial entry was:\n";
-        trace_entry.print("    ", std::cerr);
-        seen_err_ = true;
-        return;
-      }
-      rtl_entry_.take_writes(trace_entry, false);
+  if (rtl_started_ && !record.is_compatible(rtl_entry_)) {
+    if (record.is_partial()) {
+      std::cerr
+          << ("ERROR: Partial trace entry followed by "
+              "mis-matching partial entry.\n"
+              "  Existing partial entry was:\n");
+      rtl_entry_.print("    ", std::cerr);
+      std::cerr << "  New partial entry was:\n";
     } else {
-      // This is the first partial entry. Set the rtl_started_ flag and save
-      // trace_entry.
-      rtl_started_ = true;
-      rtl_entry_ = trace_entry;
-    }
-    return;
-  }
-
-  // This wasn't a partial entry. At this point, we should know it's a final
-  // one.
-  assert(trace_entry.is_final());
-
-  // If had a partial entry before, merge in any writes from it, making sure
-  // the entries are compatible.
-  if (rtl_started_) {
-    if (!trace_entry.is_compatible(rtl_entry_)) {
       std::cerr
           << ("ERROR: Final trace entry doesn't match partial entry:\n"
               "  Partial entry was:\n");
       rtl_entry_.print("    ", std::cerr);
       std::cerr << "  Final entry was:\n";
-      trace_entry.print("    ", std::cerr);
-      seen_err_ = true;
-      return;
     }
+    record.print("    ", std::cerr);
+    seen_err_ = true;
+    return;
+  }
+
+  if (rtl_started_) {
+    rtl_entry_.take_later(record);
+  } else {
+    rtl_entry_.assign(record);
+  }
 
-    trace_entry.take_writes(rtl_entry_, true);
+  if (record.is_partial()) {
+    rtl_started_ = true;
+    return;
   }
 
+  // This wasn't a partial entry. At this point, we should know it's a final
+  // one.
+  assert(record.is_final());
+
   rtl_pending_ = true;
   rtl_started_ = false;
-  rtl_entry_ = trace_entry;
 
   if (!MatchPair()) {
     seen_err_ = true;
   }
 }
 
-bool OtbnTraceChecker::OnIssTrace(const std::vector<std::string> &lines) {
+bool OtbnTraceChecker::OnIssTrace(const OtbnTraceRecord &record) {
   assert(!(rtl_pending_ && iss_pending_));
 
   if (seen_err_) {
     return false;
   }
 
-  OtbnIssTraceEntry trace_entry;
-  if (!trace_entry.from_iss_trace(lines)) {
-    // Error parsing ISS trace. This has already printed a message to stderr.
-    // Just return false to pass the error code along.
-    return false;
-  }
-
   done_ = false;
 
   if (iss_pending_) {
@@ -181,20 +158,21 @@ bool OtbnTraceChecker::OnIssTrace(const std::vector<std::string> &lines) {
             "  First ISS entry was:\n");
     iss_entry_.print("    ", std::cerr);
     std::cerr << "  Second ISS entry was:\n";
-    trace_entry.print("    ", std::cerr);
+    record.print("    ", std::cerr);
     seen_err_ = true;
     return false;
   }
 
   if (iss_started_) {
     // We have some changes associated with a stall. Merge in the changes that
-    // we've just seen. We do it "backwards" so that if trace_entry is an
-    // final entry then so is the result.
-    trace_entry.take_writes(iss_entry_, true);
+    // we've just seen, taking the new header so that if record is a final
+    // entry then so is the result.
+    iss_entry_.take_later(record);
+  } else {
+    iss_entry_.assign(record);
   }
 
   iss_started_ = true;
-  iss_entry_ = trace_entry;
 
   // Set the pending flag if we've got the end of an event (either E or V).
   if (iss_entry_.is_final()) {
@@ -237,7 +215,7 @@ bool OtbnTraceChecker::Finish() {
   return true;
 }
 
-const OtbnIssTraceEntry::IssData *OtbnTraceChecker::PopIssData() {
+const OtbnTraceChecker::IssData *OtbnTraceChecker::PopIssData() {
   if (!last_data_vld_)
     return nullptr;
 
@@ -284,7 +262,7 @@ bool OtbnTraceChecker::MatchPair() {
       iss_entry_.print("    ", std::cerr);
       seen_err_ = true;
       return false;
-      if (rtl_entry_.trace_type() == OtbnTraceEntry::WipeComplete) {
+      if (rtl_entry_.trace_type() == OtbnTraceRecord::WipeComplete) {
         no_sec_wipe_data_chk_ = false;
       }
     }
@@ -300,10 +278,12 @@ bool OtbnTraceChecker::MatchPair() {
     }
   }
 
-  // We've got a matching pair of entries. Move the ISS data out of the (now
+  // We've got a matching pair of entries. Copy the ISS data out of the (now
   // defunct) iss_entry_ and into last_data_.
-  if (rtl_entry_.trace_type() == OtbnTraceEntry::Exec) {
-    last_data_ = std::move(iss_entry_.data_);
+  if (rtl_entry_.trace_type() == OtbnTraceRecord::Exec) {
+    last_data_.insn_addr = iss_entry_.insn_addr();
+    memcpy(last_data_.mnemonic, iss_entry_.mnemonic(),
+           sizeof last_data_.mnemonic);
     last_data_vld_ = true;
   }
 
@@ -321,16 +301,14 @@ bool OtbnTraceChecker::MatchPair() {
 
 extern "C" unsigned char otbn_trace_checker_pop_iss_insn(
     svBitVecVal *insn_addr, const char **mnemonic) {
-  static char mnemonic_buf[16];
+  static char mnemonic_buf[kOtbnTraceMnemonicLen];
 
-  const OtbnIssTraceEntry::IssData *iss_data =
+  const OtbnTraceChecker::IssData *iss_data =
       OtbnTraceChecker::get().PopIssData();
   if (!iss_data)
     return 0;
 
-  assert(iss_data->mnemonic.size() + 1 <= sizeof mnemonic_buf);
-  memcpy(mnemonic_buf, iss_data->mnemonic.c_str(),
-         iss_data->mnemonic.size() + 1);
+  memcpy(mnemonic_buf, iss_data->mnemonic, sizeof mnemonic_buf);
   *mnemonic = mnemonic_buf;
 
   set_sv_u32(insn_addr, iss_data->insn_addr);
@@ -8,6 +8,11 @@
 // an OtbnTraceListener) and compares them with the trace coming out of the
 // stepped ISS process.
 //
+// Both sides send binary trace records (see otbn_trace_record.h). The checker
+// merges them into a pair of pre-allocated records, one for each side, so
+// checking a trace does no heap allocation. It only renders records as text
+// when it reports a problem.
+//
 // Trace entries from the simulated core appear as a result of DPI callbacks,
 // so there's no way to propagate errors when they appear. ISS trace entries
 // arrive through a synchronous interface, so the checker reports any mismatch
@@ -35,12 +40,10 @@
 // To catch these cases, the ISS simulation must call the Finish() method when
 // it is done (which checks there are no outstanding events missing).
 
-#include <iosfwd>
-#include <string>
-#include <vector>
+#include <cstdint>
 
-#include "otbn_trace_entry.h"
 #include "otbn_trace_listener.h"
+#include "otbn_trace_record.h"
 
 class OtbnTraceChecker : public OtbnTraceListener {
  public:
@@ -50,15 +53,25 @@ class OtbnTraceChecker : public OtbnTraceListener {
   // Get the singleton object
   static OtbnTraceChecker &get();
 
+  // Fields that are taken from the ISS trace for an instruction
+  struct IssData {
+    uint32_t insn_addr;
+    char mnemonic[kOtbnTraceMnemonicLen];
+  };
+
   // Take a trace entry from the wrapped RTL. Any mismatch error is stored
   // until the next call to an API function that can respond with the error.
-  void AcceptTraceString(const std::string &trace,
+  void AcceptTraceRecord(const OtbnTraceRecord &record,
                          unsigned int cycle_count) override;
 
+  // We only look at trace records, so the tracer doesn't need to generate
+  // strings on our behalf.
+  bool WantsTraceStrings() const override { return false; }
+
   // Take a trace entry from the wrapped ISS.
   //
   // Prints an error message to stderr and returns false on mismatch.
-  bool OnIssTrace(const std::vector<std::string> &lines);
+  bool OnIssTrace(const OtbnTraceRecord &record);
 
   // Flush any pending entries. We need to do this on reset, to handle
   // the case where we reset the processor in the middle of a stall.
@@ -73,7 +86,7 @@ class OtbnTraceChecker : public OtbnTraceListener {
 
   // Return and clear the ISS data for the last pair of trace entries that went
   // through MatchPair if there is any.
-  const OtbnIssTraceEntry::IssData *PopIssData();
+  const IssData *PopIssData();
 
   // Tell the model not to execute checks to see if secure wiping has written
   // random data to all registers before wiping them with zeroes on the next
@@ -96,11 +109,11 @@ class OtbnTraceChecker : public OtbnTraceListener {
 
   bool rtl_started_;
   bool rtl_pending_;
-  OtbnTraceEntry rtl_entry_;
+  OtbnTraceRecord rtl_entry_;
 
   bool iss_started_;
   bool iss_pending_;
-  OtbnIssTraceEntry iss_entry_;
+  OtbnTraceRecord iss_entry_;
 
   bool done_;
   bool tolerate_result_mismatch_;
@@ -110,7 +123,7 @@ class OtbnTraceChecker : public OtbnTraceListener {
   // The ISS entry for the last pair of trace entries that went through
   // MatchPair.
   bool last_data_vld_;
-  OtbnIssTraceEntry::IssData last_data_;
+  IssData last_data_;
   bool no_sec_wipe_data_chk_;
 };
 
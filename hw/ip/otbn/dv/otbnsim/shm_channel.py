@@ -0,0 +1,308 @@
+# Copyright lowRISC contributors (OpenTitan project).
+# Licensed under the Apache License, Version 2.0, see LICENSE for details.
+# SPDX-License-Identifier: Apache-2.0
+
+'''A binary, shared-memory channel between stepped.py and the C++ model
+
+The C++ side (ISSWrapper in hw/ip/otbn/dv/model/iss_wrapper.cc) creates a file,
+sizes it and fills in the header below. It then sends "attach_shm <path>" as
+an ordinary text command. From then on, the two sides talk with binary frames
+in two rings in the file. Each side tells the other that it has written a
+frame by writing a single byte to its pipe (stdin for commands, stdout for
+responses). The pipe write/read pair also orders the memory accesses, so the
+ring indices don't need to be atomic.
+
+All values are little-endian. The header is a sequence of 32-bit words:
+
+    MAGIC, VERSION,
+    CMD_OFF, CMD_SIZE, RSP_OFF, RSP_SIZE,
+    IMEM_OFF, IMEM_WORDS, DMEM_OFF, DMEM_WORDS,
+    CMD_WR, CMD_RD, RSP_WR, RSP_RD
+
+The rings are at CMD_OFF and RSP_OFF with power-of-two sizes CMD_SIZE and
+RSP_SIZE. The *_WR and *_RD words are free-running byte counts. A frame is a
+16-bit kind, 16 bits of flags, a 32-bit payload length and then the payload,
+padded with zeros to a multiple of 4 bytes. Command frames have no flags. In a
+response frame, bit 0 of the flags (RSP_FLAG_MORE) means that the payload
+carries on in the next frame, which has the same kind. This lets us send a
+frame that is bigger than the response ring.
+
+A response can also be bigger than the ring in total. If there isn't space for
+the next frame, we write a DOORBELL_FULL byte to our pipe instead of the
+DOORBELL_DONE byte that ends the response. The other side then takes every
+frame from the ring and writes a byte to our stdin, after which we carry on.
+
+The memory regions at IMEM_OFF and DMEM_OFF hold IMEM_WORDS (or DMEM_WORDS)
+32-bit words followed by one validity byte (0 or 1) per word.
+
+'''
+
+import mmap
+import struct
+from typing import Callable, List, Optional, Tuple
+
+MAGIC = 0x4f54424e
+VERSION = 3
+
+_HDR_FMT = '<14I'
+_FRAME_HDR_FMT = '<HHI'
+_FRAME_HDR_LEN = struct.calcsize(_FRAME_HDR_FMT)
+
+_CMD_WR_IDX = 10
+_CMD_RD_IDX = 11
+_RSP_WR_IDX = 12
+_RSP_RD_IDX = 13
+
+# Command frame kinds (sent by the C++ side)
+CMD_TEXT = 1
+CMD_STEP = 2
+CMD_LOAD_I = 3
+CMD_LOAD_D = 4
+CMD_DUMP_D = 5
+CMD_STEP_BATCH = 6  # payload: u32 maximum number of cycles
+CMD_REWIND = 7  # payload: u32 number of cycles of the last batch to keep
+
+# Response frame kinds (sent by us). Each command is answered with zero or
+# more LINE, EXT_REG or TRACE frames, then a single END frame. The response to
+# STEP_BATCH also has a CYCLE frame after the frames for each cycle.
+RSP_END = 0
+RSP_LINE = 1
+RSP_EXT_REG = 2
+RSP_CYCLE = 3
+RSP_TRACE = 4  # payload: a binary trace record (see write_trace)
+
+# Response frame flags
+RSP_FLAG_MORE = 1
+
+# The bytes that we write to our pipe after a command. DONE means that all the
+# response frames are in the ring; FULL means that the ring needs emptying
+# before we can write the rest.
+DOORBELL_DONE = 1
+DOORBELL_FULL = 2
+
+# Trace record types. These match OtbnTraceRecord::trace_type_t in
+# hw/ip/otbn/dv/tracer/cpp/otbn_trace_record.h.
+TRACE_STALL = 1
+TRACE_EXEC = 2
+TRACE_WIPE_IN_PROGRESS = 3
+TRACE_WIPE_COMPLETE = 4
+
+# The names of the locations that a trace record can show a write to, indexed
+# by location number. This must match the numbering in otbn_trace_record.h.
+# The ISPR names are in the order of ispr_e in otbn_pkg.sv (FLAGS is never
+# used: flag groups have their own locations).
+TRACE_LOCS = (['x{:02}'.format(i) for i in range(32)] +
+              ['w{:02}'.format(i) for i in range(32)] +
+              ['FLAGS0', 'FLAGS1'] +
+              ['MOD', 'RND', 'ACC', 'FLAGS', 'URND',
+               'KEYS0L', 'KEYS0H', 'KEYS1L', 'KEYS1H',
+               'MAI_RES_S0', 'MAI_RES_S1', 'MAI_IN0_S0', 'MAI_IN0_S1',
+               'MAI_IN1_S0', 'MAI_IN1_S1', 'MAI_CTRL', 'MAI_STATUS',
+               'KMAC_DATA_S0', 'KMAC_DATA_S1', 'KMAC_STATUS', 'KMAC_CTRL',
+               'KMAC_CFG', 'KMAC_STRB', 'INSN_CNT',
+               'URND_STATE', 'URND_CTRL', 'URND_STATUS'])
+_TRACE_LOC_IDX = {name: idx for idx, name in enumerate(TRACE_LOCS)}
+
+_TRACE_HDR_FMT = '<BBHII16s'
+_TRACE_WRITE_FMT = '<BBBB'
+_TRACE_MNEMONIC_LEN = 15
+
+# External registers that are reported with EXT_REG frames, indexed by the ID
+# that appears in the frame. This must match the order in iss_wrapper.cc.
+EXT_REG_IDS = ['STATUS', 'INSN_CNT', 'ERR_BITS', 'STOP_PC',
+               'RND_REQ', 'WIPE_START']
+
+
+class ShmChannel:
+    '''The ISS side of the channel
+
+    If wait_for_space is not None, it is called when the response ring is too
+    full for the next frame. It should return once the other side has taken
+    frames from the ring. If it is None, running out of space is an error.
+
+    '''
+    def __init__(self, path: str,
+                 wait_for_space: Optional[Callable[[], None]] = None) -> None:
+        self._wait_for_space = wait_for_space
+
+        with open(path, 'r+b') as handle:
+            self._mm = mmap.mmap(handle.fileno(), 0)
+
+        hdr = struct.unpack_from(_HDR_FMT, self._mm, 0)
+        if hdr[0] != MAGIC or hdr[1] != VERSION:
+            raise ValueError('{} is not a version {} OTBN ISS channel '
+                             '(magic {:#x}, version {}).'
+                             .format(path, VERSION, hdr[0], hdr[1]))
+
+        (self._cmd_off, self._cmd_size,
+         self._rsp_off, self._rsp_size,
+         self._imem_off, self.imem_words,
+         self._dmem_off, self.dmem_words) = hdr[2:10]
+
+        for size in [self._cmd_size, self._rsp_size]:
+            if size & (size - 1):
+                raise ValueError('Ring size {} is not a power of two.'
+                                 .format(size))
+
+    def _get_idx(self, idx: int) -> int:
+        return int(struct.unpack_from('<I', self._mm, 4 * idx)[0])
+
+    def _set_idx(self, idx: int, value: int) -> None:
+        struct.pack_into('<I', self._mm, 4 * idx, value & 0xffffffff)
+
+    def _ring_read(self, off: int, size: int, pos: int, length: int) -> bytes:
+        start = pos & (size - 1)
+        first = min(length, size - start)
+        data = self._mm[off + start:off + start + first]
+        if first < length:
+            data += self._mm[off:off + length - first]
+        return data
+
+    def _ring_write(self, off: int, size: int, pos: int, data: bytes) -> None:
+        start = pos & (size - 1)
+        first = min(len(data), size - start)
+        self._mm[off + start:off + start + first] = data[:first]
+        if first < len(data):
+            self._mm[off:off + len(data) - first] = data[first:]
+
+    def read_command(self) -> Tuple[int, bytes]:
+        '''Read the next command frame, returning its kind and payload'''
+        wr = self._get_idx(_CMD_WR_IDX)
+        rd = self._get_idx(_CMD_RD_IDX)
+        if (wr - rd) & 0xffffffff < _FRAME_HDR_LEN:
+            raise RuntimeError('Doorbell rung with no command in the ring.')
+
+        hdr = self._ring_read(self._cmd_off, self._cmd_size, rd,
+                              _FRAME_HDR_LEN)
+        kind, _, length = struct.unpack(_FRAME_HDR_FMT, hdr)
+        payload = self._ring_read(self._cmd_off, self._cmd_size,
+                                  rd + _FRAME_HDR_LEN, length)
+
+        padded = (length + 3) & ~3
+        self._set_idx(_CMD_RD_IDX, rd + _FRAME_HDR_LEN + padded)
+        return (kind, payload)
+
+    def write_response(self, kind: int, payload: bytes = b'') -> None:
+        '''Append a response frame to the ring
+
+        A payload that is too big for a single frame in the ring is split
+        across frames with RSP_FLAG_MORE set on all but the last.
+
+        '''
+        max_chunk = self._rsp_size - _FRAME_HDR_LEN
+        pos = 0
+        while True:
+            chunk = payload[pos:pos + max_chunk]
+            pos += len(chunk)
+            more = pos < len(payload)
+            self._write_frame(kind, RSP_FLAG_MORE if more else 0, chunk)
+            if not more:
+                return
+
+    def _write_frame(self, kind: int, flags: int, payload: bytes) -> None:
+        '''Append a single frame to the response ring, waiting for space'''
+        padded = (len(payload) + 3) & ~3
+        frame = (struct.pack(_FRAME_HDR_FMT, kind, flags, len(payload)) +
+                 payload + bytes(padded - len(payload)))
+
+        while self.response_space() < len(frame):
+            if self._wait_for_space is None:
+                raise RuntimeError('Frame of {} bytes does not fit in the '
+                                   'response ring ({} bytes free).'
+                                   .format(len(frame), self.response_space()))
+            self._wait_for_space()
+
+        wr = self._get_idx(_RSP_WR_IDX)
+        self._ring_write(self._rsp_off, self._rsp_size, wr, frame)
+        self._set_idx(_RSP_WR_IDX, wr + len(frame))
+
+    def response_space(self) -> int:
+        '''Return the number of free bytes in the response ring'''
+        wr = self._get_idx(_RSP_WR_IDX)
+        rd = self._get_idx(_RSP_RD_IDX)
+        return self._rsp_size - ((wr - rd) & 0xffffffff)
+
+    def write_line(self, line: str) -> None:
+        self.write_response(RSP_LINE, line.encode('utf-8'))
+
+    def write_ext_reg(self, reg_id: int, value: int) -> None:
+        self.write_response(RSP_EXT_REG, struct.pack('<II', reg_id, value))
+
+    def write_trace(self,
+                    trace_type: int,
+                    insn_addr: Optional[int],
+                    insn_bits: Optional[int],
+                    mnemonic: str,
+                    writes: List[Tuple[str, int, Optional[int]]]) -> None:
+        '''Send a trace entry as a TRACE frame
+
+        If the entry is for an instruction, insn_addr is its address and
+        insn_bits is its encoding (or None if there was an error fetching it).
+        If not, insn_addr and insn_bits should be None and mnemonic is
+        ignored. Each item in writes is a (name, width, value) tuple for a
+        register write, as returned by Trace.rtl_write().
+
+        The payload starts with a header: the record type (u8), flags (u8; bit
+        0 is set if there is an instruction and bit 1 if it couldn't be
+        fetched), the number of writes (u16), the instruction address and
+        encoding (u32 each) and a 16-byte, null-padded mnemonic. Each write
+        then has its location number (u8), its width in 32-bit words (u8), a
+        byte that is 1 if the value is unknown and a zero byte, followed by
+        the words of the value, least significant first.
+
+        '''
+        has_insn = insn_addr is not None
+        insn_err = has_insn and insn_bits is None
+        flags = (1 if has_insn else 0) | (2 if insn_err else 0)
+        mnem = mnemonic.encode('utf-8')[:_TRACE_MNEMONIC_LEN] \
+            if has_insn else b''
+
+        parts = [struct.pack(_TRACE_HDR_FMT, trace_type, flags, len(writes),
+                             insn_addr or 0, insn_bits or 0, mnem)]
+        for name, width, value in writes:
+            loc = _TRACE_LOC_IDX.get(name)
+            if loc is None:
+                raise ValueError('No trace location for register {!r}.'
+                                 .format(name))
+            num_words = (width + 31) // 32
+            parts.append(struct.pack(_TRACE_WRITE_FMT, loc, num_words,
+                                     1 if value is None else 0, 0))
+            words = value or 0
+            parts.append(struct.pack('<{}I'.format(num_words),
+                                     *[(words >> (32 * i)) & 0xffffffff
+                                       for i in range(num_words)]))
+
+        self.write_response(RSP_TRACE, b''.join(parts))
+
+    def read_mem(self, is_imem: bool) -> List[Tuple[bool, int]]:
+        '''Read a memory region as a list of (validity, word) pairs'''
+        off = self._imem_off if is_imem else self._dmem_off
+        num_words = self.imem_words if is_imem else self.dmem_words
+
+        words = struct.unpack_from('<{}I'.format(num_words), self._mm, off)
+        vld_off = off + 4 * num_words
+        vlds = self._mm[vld_off:vld_off + num_words]
+        for idx, vld in enumerate(vlds):
+            if vld not in [0, 1]:
+                raise ValueError('The validity byte for 32-bit word {} '
+                                 'is {}, not 0 or 1.'.format(idx, vld))
+
+        return [(vld == 1, u32) for vld, u32 in zip(vlds, words)]
+
+    def write_dmem(self, data: List[Tuple[bool, int]]) -> None:
+        '''Write the DMEM region from a list of (validity, word) pairs
+
+        If data is longer than the region, the extra words are dropped.
+
+        '''
+        num_words = self.dmem_words
+        if len(data) < num_words:
+            raise ValueError('Cannot fill a {} word DMEM region with {} words.'
+                             .format(num_words, len(data)))
+
+        data = data[:num_words]
+        struct.pack_into('<{}I'.format(num_words), self._mm, self._dmem_off,
+                         *[u32 for _, u32 in data])
+        vld_off = self._dmem_off + 4 * num_words
+        self._mm[vld_off:vld_off + num_words] = \
+            bytes(1 if vld else 0 for vld, _ in data)
@@ -132,14 +132,23 @@ class Dmem:
         else:
             self._load_4byte_le_words(data, word_offset)
 
-    def dump_le_words(self) -> bytes:
-        '''Return the contents of memory as bytes.
+    def load_words(self, data: List[Tuple[bool, int]]) -> None:
+        '''Replace the start of memory with (validity, word) pairs'''
+        if len(data) > len(self.data):
+            raise ValueError('Trying to load {} words of data, but DMEM '
+                             'is only {} words long.'
+                             .format(len(data), len(self.data)))
 
-        The bytes are formatted as little-endian 32-bit words. These
-        words are themselves packed little-endian into 256-bit words.
+        for idx32, (vld, u32) in enumerate(data):
+            self.data[idx32] = (u32, vld)
+
+    def dump_words(self) -> List[Tuple[bool, int]]:
+        '''Return the contents of memory as (validity, word) pairs.
+
+        Invalid words are reported with a value of zero.
 
         '''
-        ret = b''
+        ret = []
         for idx, (u32, valid) in enumerate(self.data):
             # If there's a pending store, apply it. This matches the RTL, where
             # we only observe the memory after that store has landed.
@@ -148,10 +157,22 @@ class Dmem:
             u32 = self.pending.get(idx, u32)
 
             if valid or has_pending_store:
-                ret += struct.pack('<BI', 1, u32)
+                ret.append((True, u32))
             else:
-                ret += struct.pack('<BI', 0, 0)
+                ret.append((False, 0))
+
+        return ret
 
+    def dump_le_words(self) -> bytes:
+        '''Return the contents of memory as bytes.
+
+        The bytes are formatted as little-endian 32-bit words. These
+        words are themselves packed little-endian into 256-bit words.
+
+        '''
+        ret = b''
+        for valid, u32 in self.dump_words():
+            ret += struct.pack('<BI', 1 if valid else 0, u32)
         return ret
 
     def is_valid_256b_addr(self, addr: int) -> bool:
@@ -2,7 +2,7 @@
 # Licensed under the Apache License, Version 2.0, see LICENSE for details.
 # SPDX-License-Identifier: Apache-2.0
 
-from typing import List, Optional, cast
+from typing import List, Optional, Tuple, cast
 
 from .trace import Trace
 
@@ -28,6 +28,14 @@ class TraceFlags(Trace):
                         int(self.value.L),
                         int(self.value.Z)))
 
+    def rtl_write(self) -> Tuple[str, int, Optional[int]]:
+        # The flags are packed with C in bit 0, matching flags_t in otbn_pkg.
+        value = (int(self.value.C) |
+                 (int(self.value.M) << 1) |
+                 (int(self.value.L) << 2) |
+                 (int(self.value.Z) << 3))
+        return ('FLAGS{}'.format(self.group), 4, value)
+
 
 class FlagReg:
     FLAG_NAMES = ['C', 'M', 'L', 'Z']
@@ -2,7 +2,7 @@
 # Licensed under the Apache License, Version 2.0, see LICENSE for details.
 # SPDX-License-Identifier: Apache-2.0
 
-from typing import List, Optional, Sequence
+from typing import List, Optional, Sequence, Tuple
 from .trace import Trace
 
 
@@ -21,6 +21,9 @@ class ISPRChange(Trace):
         return '> {}: {}'.format(self.ispr_name,
                                  Trace.hex_value(self.new_value, self.width))
 
+    def rtl_write(self) -> Tuple[str, int, Optional[int]]:
+        return (self.ispr_name, self.width, self.new_value)
+
 
 class ISPR:
     '''Models a Internal Special Purpose Register'''
@@ -2,7 +2,7 @@
 # Licensed under the Apache License, Version 2.0, see LICENSE for details.
 # SPDX-License-Identifier: Apache-2.0
 
-from typing import List, Optional, Set
+from typing import List, Optional, Set, Tuple
 
 from .trace import Trace
 
@@ -24,6 +24,9 @@ class TraceRegister(Trace):
         return '> {}: {}'.format(self.name,
                                  Trace.hex_value(self.new_value, self.width))
 
+    def rtl_write(self) -> Tuple[str, int, Optional[int]]:
+        return (self.name, self.width, self.new_value)
+
 
 class Reg:
     def __init__(self,
@@ -2,7 +2,7 @@
 # Licensed under the Apache License, Version 2.0, see LICENSE for details.
 # SPDX-License-Identifier: Apache-2.0
 
-from typing import Optional
+from typing import Optional, Tuple
 
 
 class Trace:
@@ -26,6 +26,18 @@ class Trace:
         '''
         return None
 
+    def rtl_write(self) -> Optional[Tuple[str, int, Optional[int]]]:
+        '''Return the register write that this item shows in the RTL trace
+
+        This is used to build the binary trace records that the stepped
+        interface sends over its shared-memory channel. If the RTL trace shows
+        this item as a register write (a '>' line), return a tuple (name,
+        width, value), where value is None if it is unknown. Otherwise, return
+        None (the default behaviour).
+
+        '''
+        return None
+
     @staticmethod
     def hex_value(value: Optional[int], bit_width: int) -> str:
         '''Render a hex value in the format expected by RTL tracing'''
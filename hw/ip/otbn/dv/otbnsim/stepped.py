@@ -79,15 +79,49 @@ prefixed with "0x" if they are hexadecimal.
 
     wfi_resume              Resume a wfi instruction that is paused (the host
                             has issued the RESUME command).
+
+    attach_shm <path>       Switch to the binary protocol, using the shared
+                            memory channel in the file at <path>. After this
+                            command, stdin and stdout just carry one byte per
+                            command and response (or a few bytes, for a
+                            response that overflows the response ring). See
+                            shm_channel.py for the format. The step, load_i,
+                            load_d and dump_d commands have binary forms
+                            (which use the memory regions in the channel
+                            instead of files); anything else is sent as a line
+                            of text.
+
+                            There are also two binary-only commands. STEP_BATCH
+                            runs ahead for several cycles (stopping early at
+                            anything that might need an external input) and
+                            REWIND goes back to a cycle part way through the
+                            last batch, if the other side needs to send an
+                            input before it has used the whole batch.
 '''
 
 import binascii
+import contextlib
+import copy
+import io
+import os
+import struct
 import sys
-from typing import List, Optional
+from typing import List, NamedTuple, Optional, Tuple
 
-from sim.decode import decode_file
+import shm_channel
+from shm_channel import ShmChannel
+from sim.decode import decode_file, decode_words
+from sim.ext_regs import TraceExtRegChange
+from sim.isa import OTBNInsn
 from sim.load_elf import load_elf
 from sim.sim import OTBNSim
+from sim.state import FsmState
+from sim.trace import Trace
+
+# When running a batch of steps, stop early if there is less than this much
+# space left in the response ring. This is comfortably more than the frames
+# for a single cycle.
+_BATCH_RSP_MARGIN = 4096
 
 
 def read_word(arg_name: str, word_data: str, bits: int) -> int:
@@ -141,10 +175,68 @@ def on_start_operation(sim: OTBNSim, args: List[str]) -> Optional[OTBNSim]:
     return None
 
 
-def on_step(sim: OTBNSim, args: List[str]) -> Optional[OTBNSim]:
-    '''Step one instruction'''
-    check_arg_count('step', 0, args)
-
+class StepTrace(NamedTuple):
+    '''The trace for a single step, as returned by step_for_trace
+
+    hdr is the header for the RTL trace entry (or None if there is no entry).
+    If the step executed an instruction, it is insn, at address pc. changes
+    is the list of changes that appear in the RTL trace and ext_regs is a list
+    of (name, value) pairs for the external registers whose changes appear
+    there.
+
+    '''
+    hdr: Optional[str]
+    pc: int
+    insn: Optional[OTBNInsn]
+    changes: List[Trace]
+    ext_regs: List[Tuple[str, int]]
+
+    def lines(self) -> List[str]:
+        '''Return the trace entry as lines of text'''
+        if self.hdr is None:
+            return []
+        return [self.hdr] + [c.rtl_trace() or '' for c in self.changes]
+
+    def write_to_channel(self, channel: ShmChannel) -> None:
+        '''Send the trace entry as TRACE and EXT_REG frames'''
+        if self.hdr is not None:
+            insn_addr = None
+            insn_bits = None
+            mnemonic = ''
+            if self.hdr.startswith('E '):
+                trace_type = shm_channel.TRACE_EXEC
+                assert self.insn is not None
+                insn_addr = self.pc
+                if self.insn.has_bits:
+                    insn_bits = self.insn.raw
+                    mnemonic = self.insn.insn.mnemonic
+                else:
+                    mnemonic = '??'
+            elif self.hdr == 'U ':
+                trace_type = shm_channel.TRACE_WIPE_IN_PROGRESS
+            elif self.hdr == 'V ':
+                trace_type = shm_channel.TRACE_WIPE_COMPLETE
+            else:
+                assert self.hdr == 'STALL'
+                trace_type = shm_channel.TRACE_STALL
+
+            writes = []
+            for c in self.changes:
+                write = c.rtl_write()
+                if write is not None:
+                    writes.append(write)
+
+            channel.write_trace(trace_type, insn_addr, insn_bits, mnemonic,
+                                writes)
+
+        for name, value in self.ext_regs:
+            if name in shm_channel.EXT_REG_IDS:
+                channel.write_ext_reg(shm_channel.EXT_REG_IDS.index(name),
+                                      value)
+
+
+def step_for_trace(sim: OTBNSim) -> StepTrace:
+    '''Step one instruction, returning its trace'''
     pc = sim.state.pc
     assert 0 == pc & 3
 
@@ -169,10 +261,12 @@ def on_step(sim: OTBNSim, args: List[str]) -> Optional[OTBNSim]:
         hdr = None
 
     rtl_changes = []
+    ext_regs = []
     for c in changes:
-        rt = c.rtl_trace()
-        if rt is not None:
-            rtl_changes.append(rt)
+        if c.rtl_trace() is not None:
+            rtl_changes.append(c)
+            if isinstance(c, TraceExtRegChange):
+                ext_regs.append((c.name, c.erc.new_value))
 
     # This is a bit of a hack. Very occasionally, we'll see traced changes when
     # there's not actually an instruction in flight. For example, this happens
@@ -183,10 +277,18 @@ def on_step(sim: OTBNSim, args: List[str]) -> Optional[OTBNSim]:
     if hdr is None and rtl_changes:
         hdr = 'STALL'
 
-    if hdr is not None:
-        print(hdr)
-        for rt in rtl_changes:
-            print(rt)
+    if hdr is None:
+        return StepTrace(None, pc, None, [], [])
+
+    return StepTrace(hdr, pc, insn, rtl_changes, ext_regs)
+
+
+def on_step(sim: OTBNSim, args: List[str]) -> Optional[OTBNSim]:
+    '''Step one instruction'''
+    check_arg_count('step', 0, args)
+
+    for line in step_for_trace(sim).lines():
+        print(line)
 
     return None
 
@@ -467,8 +569,8 @@ _HANDLERS = {
 }
 
 
-def on_input(sim: OTBNSim, line: str) -> Optional[OTBNSim]:
-    '''Process an input command'''
+def run_text_command(sim: OTBNSim, line: str) -> Optional[OTBNSim]:
+    '''Run a text command, printing its output to stdout'''
     words = line.split()
 
     # Just ignore empty lines
@@ -480,17 +582,169 @@ def on_input(sim: OTBNSim, line: str) -> Optional[OTBNSim]:
     if handler is None:
         raise RuntimeError('Unknown command: {!r}'.format(verb))
 
-    ret = handler(sim, words[1:])
-    print('.')
-    sys.stdout.flush()
+    return handler(sim, words[1:])
 
+
+def on_input(sim: OTBNSim, line: str) -> Optional[OTBNSim]:
+    '''Process an input command'''
+    ret = run_text_command(sim, line)
+    end_command()
     return ret
 
 
+class ChannelServer:
+    '''Serves binary commands from the shared-memory channel'''
+    def __init__(self, sim: OTBNSim, channel: ShmChannel) -> None:
+        self.sim = sim
+        self.channel = channel
+
+        # A copy of the simulation after the first cycle of the last batch of
+        # steps and the number of cycles in that batch. The other side might
+        # only consume some of the batch before it needs to send us an external
+        # input, in which case it tells us how far to rewind. It always
+        # consumes the first cycle straight away, so we never need to go back
+        # further than that.
+        self.batch_start: Optional[OTBNSim] = None
+        self.batch_len = 0
+
+    def _can_run_ahead(self, step: StepTrace) -> bool:
+        '''Return true if we can carry on with a batch after this cycle
+
+        We only run ahead while executing and retiring instructions without
+        touching any externally visible state apart from INSN_CNT. Anything
+        else (stalls, which might be waiting for EDN, an operation finishing,
+        a secure wipe, a RND request or a WFI pause) is likely to be followed
+        by an input from the other side, so we stop there.
+
+        '''
+        if self.sim.state.get_fsm_state() != FsmState.EXEC:
+            return False
+        if step.hdr is None or not step.hdr.startswith('E '):
+            return False
+        return all(name == 'INSN_CNT' for name, _ in step.ext_regs)
+
+    def _step_batch(self, max_cycles: int) -> None:
+        '''Run up to max_cycles cycles, with a CYCLE frame after each'''
+        self.batch_start = None
+        self.batch_len = 0
+
+        while self.batch_len < max_cycles:
+            step = step_for_trace(self.sim)
+            step.write_to_channel(self.channel)
+            self.channel.write_response(shm_channel.RSP_CYCLE)
+            self.batch_len += 1
+
+            if not self._can_run_ahead(step):
+                break
+            if self.channel.response_space() < _BATCH_RSP_MARGIN:
+                break
+
+            # We're going to run ahead, so take a copy of the state after the
+            # first cycle in case we need to rewind. We only do this once we
+            # know the batch is longer than one cycle, since a copy is
+            # expensive. The program is never changed by stepping, so there's
+            # no need to copy that.
+            if self.batch_len == 1 and self.batch_len < max_cycles:
+                memo = {id(self.sim.program): self.sim.program}
+                self.batch_start = copy.deepcopy(self.sim, memo)
+
+    def _rewind(self, cycles_used: int) -> None:
+        '''Go back to the state after cycles_used cycles of the last batch'''
+        if not 1 <= cycles_used <= self.batch_len:
+            raise RuntimeError('Cannot rewind to cycle {} of a batch of {}.'
+                               .format(cycles_used, self.batch_len))
+
+        if cycles_used < self.batch_len:
+            assert self.batch_start is not None
+            self.sim = self.batch_start
+            for _ in range(cycles_used - 1):
+                step_for_trace(self.sim)
+
+        self.batch_start = None
+        self.batch_len = 0
+
+    def on_command(self) -> None:
+        '''Process a binary command from the shared-memory channel'''
+        kind, payload = self.channel.read_command()
+        sim = self.sim
+
+        if kind == shm_channel.CMD_STEP:
+            step_for_trace(sim).write_to_channel(self.channel)
+
+        elif kind == shm_channel.CMD_STEP_BATCH:
+            max_cycles, = struct.unpack('<I', payload)
+            self._step_batch(max_cycles)
+
+        elif kind == shm_channel.CMD_REWIND:
+            cycles_used, = struct.unpack('<I', payload)
+            self._rewind(cycles_used)
+
+        elif kind == shm_channel.CMD_LOAD_I:
+            sim.load_program(decode_words(0, self.channel.read_mem(True)))
+
+        elif kind == shm_channel.CMD_LOAD_D:
+            sim.state.dmem.load_words(self.channel.read_mem(False))
+
+        elif kind == shm_channel.CMD_DUMP_D:
+            self.channel.write_dmem(sim.state.dmem.dump_words())
+
+        elif kind == shm_channel.CMD_TEXT:
+            # Run the command as if it had come in on stdin, but catch anything
+            # it prints and send it back as LINE frames.
+            output = io.StringIO()
+            with contextlib.redirect_stdout(output):
+                ret = run_text_command(sim, payload.decode('utf-8'))
+            for line in output.getvalue().splitlines():
+                self.channel.write_line(line)
+            if ret is not None:
+                self.sim = ret
+                self.batch_start = None
+                self.batch_len = 0
+
+        else:
+            raise RuntimeError('Unknown binary command kind: {}'.format(kind))
+
+        self.channel.write_response(shm_channel.RSP_END)
+
+    def serve(self) -> int:
+        '''Handle binary commands until stdin is closed
+
+        Each command is signalled by a byte on stdin and is acknowledged by a
+        DOORBELL_DONE byte on stdout, once all its response frames are in the
+        ring. If the ring fills up first, wait_for_space sends DOORBELL_FULL.
+
+        '''
+        stdin_fd = sys.stdin.fileno()
+        stdout_fd = sys.stdout.fileno()
+        while os.read(stdin_fd, 1):
+            self.on_command()
+            os.write(stdout_fd, bytes([shm_channel.DOORBELL_DONE]))
+
+        return 0
+
+
+def wait_for_space() -> None:
+    '''Ask the other side to empty the response ring and wait until it has'''
+    os.write(sys.stdout.fileno(), bytes([shm_channel.DOORBELL_FULL]))
+    if not os.read(sys.stdin.fileno(), 1):
+        raise RuntimeError('EOF on stdin while waiting for response space.')
+
+
 def main() -> int:
     sim = OTBNSim()
     try:
         for line in sys.stdin:
+            words = line.split()
+            if words and words[0] == 'attach_shm':
+                # Switch to the binary protocol. The other side waits for the
+                # end of this command before sending anything else, so there
+                # can't be any buffered input that we'd lose by reading the
+                # stdin file descriptor directly from now on.
+                check_arg_count('attach_shm', 1, words[1:])
+                channel = ShmChannel(words[1], wait_for_space)
+                end_command()
+                return ChannelServer(sim, channel).serve()
+
             ret = on_input(sim, line)
             if ret is not None:
                 sim = ret
@@ -0,0 +1,130 @@
+# Copyright lowRISC contributors (OpenTitan project).
+# Licensed under the Apache License, Version 2.0, see LICENSE for details.
+# SPDX-License-Identifier: Apache-2.0
+
+'''Compare the native ISS (../model/otbn_iss.cc) with the Python model
+
+Each of the tests below ./simple and the OTBN smoke tests is run twice: once
+with standalone.py and once with the native ISS, built as the
+otbn_iss_standalone runner (the Makefile's test target builds it and passes
+its path in the OTBN_NATIVE_ISS environment variable). The register dumps and
+the final contents of DMEM must match.
+
+Until this test has been passing for a while, the Python model stays the
+default ISS for the RTL simulations.
+
+'''
+
+import os
+import struct
+import subprocess
+from typing import Any, List
+
+import py
+import pytest
+
+from sim.load_elf import load_elf
+from sim.standalonesim import StandaloneSim
+from simple_test import find_simple_tests, generate_bn_simd_tests
+from testutil import asm_and_link_one_file, OTBN_DIR, SIM_DIR
+
+# Importing sim puts the OTBN util directory on sys.path
+from shared.elf import read_elf
+from shared.reg_dump import parse_reg_dump
+
+
+def find_smoke_tests() -> List[str]:
+    '''Return the paths to the assembly files for the OTBN smoke tests'''
+    smoke_dir = os.path.join(OTBN_DIR, 'dv', 'smoke')
+    return [os.path.join(smoke_dir, name)
+            for name in ['smoke_test.s', 'smoke_test_vectorized.s']]
+
+
+def run_native(elf_file: str, tmpdir: py.path.local) -> bytes:
+    '''Run elf_file on the native ISS
+
+    Writes the register dump to native.regs in tmpdir and returns the final
+    contents of DMEM (as written by stepped.py's dump_d command).
+
+    '''
+    native_iss = os.environ.get('OTBN_NATIVE_ISS')
+    if native_iss is None:
+        pytest.skip('OTBN_NATIVE_ISS is not set. Run "make test" to build '
+                    'the native ISS and run this test.')
+
+    # Get the initial memory contents and loop warps in the same way as
+    # standalone.py.
+    imem_bytes, _, _ = read_elf(elf_file)
+    sim = StandaloneSim()
+    load_elf(sim, elf_file)
+
+    imem_path = str(tmpdir.join('native.imem'))
+    dmem_path = str(tmpdir.join('native.dmem'))
+    with open(imem_path, 'wb') as imem:
+        for (u32,) in struct.iter_unpack('<I', imem_bytes):
+            imem.write(struct.pack('<BI', 1, u32))
+    with open(dmem_path, 'wb') as dmem:
+        dmem.write(sim.dump_data())
+
+    cmd = [os.path.abspath(native_iss)]
+    for addr, warps in sorted(sim.loop_warps.items()):
+        for from_cnt, to_cnt in sorted(warps.items()):
+            warp = '{:#x}:{}:{}'.format(addr, from_cnt, to_cnt)
+            cmd += ['--loop-warp', warp]
+
+    dmem_out_path = str(tmpdir.join('native.dmem_out'))
+    cmd += [imem_path, dmem_path,
+            str(tmpdir.join('native.regs')), dmem_out_path]
+    subprocess.run(cmd, check=True)
+
+    with open(dmem_out_path, 'rb') as dmem_out:
+        return dmem_out.read()
+
+
+def run_python(elf_file: str, tmpdir: py.path.local) -> bytes:
+    '''Run elf_file with standalone.py
+
+    Writes the register dump to python.regs in tmpdir and returns the final
+    contents of DMEM.
+
+    '''
+    dmem_out_path = str(tmpdir.join('python.dmem_out'))
+    cmd = [os.path.join(SIM_DIR, 'standalone.py'),
+           '--dump-regs', str(tmpdir.join('python.regs')),
+           '--dump-dmem', dmem_out_path,
+           elf_file]
+    subprocess.run(cmd, check=True)
+
+    with open(dmem_out_path, 'rb') as dmem_out:
+        return dmem_out.read()
+
+
+def test_native_iss(tmpdir: py.path.local, asm_file: str) -> None:
+    elf_file = asm_and_link_one_file(asm_file, tmpdir)
+
+    native_dmem = run_native(elf_file, tmpdir)
+    python_dmem = run_python(elf_file, tmpdir)
+
+    with open(tmpdir.join('native.regs')) as native_regs:
+        regs_native = parse_reg_dump(native_regs.read())
+    with open(tmpdir.join('python.regs')) as python_regs:
+        regs_python = parse_reg_dump(python_regs.read())
+
+    assert regs_native == regs_python
+
+    # Compare DMEM a word at a time so that a failure says where things went
+    # wrong, rather than printing two huge byte strings.
+    assert len(native_dmem) == len(python_dmem)
+    native_words = list(struct.iter_unpack('<BI', native_dmem))
+    python_words = list(struct.iter_unpack('<BI', python_dmem))
+    for idx, (native, python) in enumerate(zip(native_words, python_words)):
+        assert native == python, \
+            'DMEM word {} (byte address {:#x})'.format(idx, 4 * idx)
+
+
+def pytest_generate_tests(metafunc: Any) -> None:
+    if metafunc.function is test_native_iss:
+        generate_bn_simd_tests()
+        tests = [asm for asm, _ in find_simple_tests()] + find_smoke_tests()
+        test_ids = [os.path.basename(asm) for asm in tests]
+        metafunc.parametrize("asm_file", tests, ids=test_ids)
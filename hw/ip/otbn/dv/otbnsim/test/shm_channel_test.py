@@ -0,0 +1,394 @@
+# Copyright lowRISC contributors (OpenTitan project).
+# Licensed under the Apache License, Version 2.0, see LICENSE for details.
+# SPDX-License-Identifier: Apache-2.0
+
+'''Test the ISS side of the shared-memory channel used by stepped.py.'''
+
+import struct
+from typing import List, Optional, Tuple
+
+import py
+import pytest
+
+import shm_channel
+from shm_channel import ShmChannel
+from sim.constants import ErrBits
+from sim.decode import decode_words
+from sim.sim import OTBNSim
+from stepped import ChannelServer
+
+_CMD_SIZE = 64
+_RSP_SIZE = 64
+_IMEM_WORDS = 4
+_DMEM_WORDS = 3
+
+# A response frame as (kind, flags, payload)
+_Frame = Tuple[int, int, bytes]
+
+
+def _make_channel_file(tmpdir: py.path.local,
+                       rsp_size: int = _RSP_SIZE) -> str:
+    '''Create a channel file, laid out the way ISSWrapper does it'''
+    cmd_off = 56
+    rsp_off = cmd_off + _CMD_SIZE
+    imem_off = rsp_off + rsp_size
+    dmem_off = imem_off + ((5 * _IMEM_WORDS + 3) & ~3)
+    length = dmem_off + ((5 * _DMEM_WORDS + 3) & ~3)
+
+    hdr = struct.pack('<14I', shm_channel.MAGIC, shm_channel.VERSION,
+                      cmd_off, _CMD_SIZE, rsp_off, rsp_size,
+                      imem_off, _IMEM_WORDS, dmem_off, _DMEM_WORDS,
+                      0, 0, 0, 0)
+
+    path = str(tmpdir.join('channel'))
+    with open(path, 'wb') as handle:
+        handle.write(hdr + bytes(length - len(hdr)))
+    return path
+
+
+def _put_command(path: str, kind: int, payload: bytes) -> None:
+    '''Append a command frame, as ISSWrapper would'''
+    with open(path, 'rb') as handle:
+        data = bytearray(handle.read())
+
+    cmd_off, cmd_size = struct.unpack_from('<2I', data, 8)
+    wr = struct.unpack_from('<I', data, 40)[0]
+    padded = (len(payload) + 3) & ~3
+    frame = (struct.pack('<HHI', kind, 0, len(payload)) +
+             payload + bytes(padded - len(payload)))
+    for idx, byte in enumerate(frame):
+        data[cmd_off + ((wr + idx) % cmd_size)] = byte
+    struct.pack_into('<I', data, 40, wr + len(frame))
+
+    with open(path, 'r+b') as handle:
+        handle.write(data)
+
+
+def _take_frames(path: str) -> List[_Frame]:
+    '''Read and consume all the response frames, as ISSWrapper would
+
+    Returns a list of (kind, flags, payload) tuples.
+
+    '''
+    with open(path, 'rb') as handle:
+        data = bytearray(handle.read())
+
+    rsp_off, rsp_size = struct.unpack_from('<2I', data, 16)
+    wr, rd = struct.unpack_from('<2I', data, 48)
+
+    def get(pos: int, length: int) -> bytes:
+        return bytes(data[rsp_off + ((pos + i) % rsp_size)]
+                     for i in range(length))
+
+    frames = []
+    while rd < wr:
+        kind, flags, length = struct.unpack('<HHI', get(rd, 8))
+        frames.append((kind, flags, get(rd + 8, length)))
+        rd += 8 + ((length + 3) & ~3)
+    struct.pack_into('<I', data, 52, rd)
+
+    with open(path, 'r+b') as handle:
+        handle.write(data)
+    return frames
+
+
+def _join_frames(frames: List[_Frame]) -> List[Tuple[int, bytes]]:
+    '''Join frames with RSP_FLAG_MORE set to the ones that follow them'''
+    ret = []  # type: List[Tuple[int, bytes]]
+    continued = False
+    for kind, flags, payload in frames:
+        if continued:
+            assert ret[-1][0] == kind
+            ret[-1] = (kind, ret[-1][1] + payload)
+        else:
+            ret.append((kind, payload))
+        continued = bool(flags & shm_channel.RSP_FLAG_MORE)
+    assert not continued
+    return ret
+
+
+def _take_responses(path: str) -> List[Tuple[int, bytes]]:
+    '''Read, consume and join up all the response frames'''
+    return _join_frames(_take_frames(path))
+
+
+def test_commands_and_responses(tmpdir: py.path.local) -> None:
+    '''Check frames survive a trip through the rings, including wrapping.'''
+    path = _make_channel_file(tmpdir)
+    chan = ShmChannel(path)
+
+    # Each round trip uses more than a quarter of the 64-byte rings, so this
+    # wraps both of them a few times.
+    for i in range(10):
+        text = 'set_wfi_enabled {}'.format(i & 1).encode('utf-8')
+        _put_command(path, shm_channel.CMD_TEXT, text)
+        _put_command(path, shm_channel.CMD_STEP, b'')
+        assert chan.read_command() == (shm_channel.CMD_TEXT, text)
+        assert chan.read_command() == (shm_channel.CMD_STEP, b'')
+
+        chan.write_line('E PC: 0x{:08x}'.format(4 * i))
+        chan.write_ext_reg(1, i)
+        chan.write_response(shm_channel.RSP_END)
+
+        line = 'E PC: 0x{:08x}'.format(4 * i).encode('utf-8')
+        assert _take_responses(path) == [
+            (shm_channel.RSP_LINE, line),
+            (shm_channel.RSP_EXT_REG, struct.pack('<II', 1, i)),
+            (shm_channel.RSP_END, b'')
+        ]
+        assert chan.response_space() == _RSP_SIZE
+
+
+def test_large_responses(tmpdir: py.path.local) -> None:
+    '''Check responses that are bigger than the response ring.'''
+    path = _make_channel_file(tmpdir)
+
+    # Without a way to wait for space, overflowing the ring is an error.
+    chan = ShmChannel(path)
+    chan.write_line('x' * 40)
+    with pytest.raises(RuntimeError):
+        chan.write_line('y' * 40)
+    _take_frames(path)
+
+    # With one, the frames that were in the ring each time it filled up plus
+    # the ones left at the end make up the whole response. The 200 byte line
+    # is split across frames, each of which fits in the 64-byte ring.
+    taken = []  # type: List[_Frame]
+    chan = ShmChannel(path, lambda: taken.extend(_take_frames(path)))
+    line = bytes(range(ord('a'), ord('z'))) * 8
+    chan.write_line('short')
+    chan.write_response(shm_channel.RSP_LINE, line)
+    chan.write_ext_reg(2, 3)
+    chan.write_response(shm_channel.RSP_END)
+    assert len(taken) >= 1
+
+    assert _join_frames(taken + _take_frames(path)) == [
+        (shm_channel.RSP_LINE, b'short'),
+        (shm_channel.RSP_LINE, line),
+        (shm_channel.RSP_EXT_REG, struct.pack('<II', 2, 3)),
+        (shm_channel.RSP_END, b'')
+    ]
+
+
+def test_memory_regions(tmpdir: py.path.local) -> None:
+    '''Check that words and validity bits go through the memory regions.'''
+    path = _make_channel_file(tmpdir)
+    chan = ShmChannel(path)
+
+    dmem = [(True, 0x12345678), (False, 0), (True, 0xffffffff), (True, 1)]
+    chan.write_dmem(dmem)
+
+    # Only the first three words fit in the DMEM region.
+    assert chan.read_mem(False) == dmem[:_DMEM_WORDS]
+    assert chan.read_mem(True) == [(False, 0)] * _IMEM_WORDS
+
+
+def test_trace_frames(tmpdir: py.path.local) -> None:
+    '''Check the layout of TRACE frames.'''
+    path = _make_channel_file(tmpdir, rsp_size=256)
+    chan = ShmChannel(path)
+
+    chan.write_trace(shm_channel.TRACE_EXEC, 0x10, None, 'ignored',
+                     [('x05', 32, 7), ('FLAGS1', 4, None)])
+    assert _take_responses(path) == [
+        (shm_channel.RSP_TRACE,
+         struct.pack('<BBHII16s', shm_channel.TRACE_EXEC, 3, 2,
+                     0x10, 0, b'ignored') +
+         struct.pack('<BBBBI', 5, 1, 0, 0, 7) +
+         struct.pack('<BBBBI', 65, 1, 1, 0, 0))
+    ]
+
+    wide = (0x1234 << 224) | 0x5678
+    chan.write_trace(shm_channel.TRACE_WIPE_COMPLETE, None, None, 'ignored',
+                     [('ACC', 256, wide)])
+    frames = _take_responses(path)
+    assert len(frames) == 1
+    kind, payload = frames[0]
+    assert kind == shm_channel.RSP_TRACE
+    assert payload[:4] == struct.pack('<BBH', 4, 0, 1)
+    assert payload[12:28] == bytes(16)
+    assert payload[28:32] == struct.pack('<BBBB', 68, 8, 0, 0)
+    assert struct.unpack('<8I', payload[32:]) == (0x5678, 0, 0, 0, 0, 0, 0,
+                                                   0x1234)
+
+
+# A response ring that is big enough for a whole batch of steps. The channel
+# server stops a batch early if there is less than _BATCH_RSP_MARGIN bytes of
+# space, so anything much smaller than this would give single-cycle batches.
+_BATCH_RSP_SIZE = 65536
+_BATCH_CYCLES = 8
+
+# URND seed words that the host sends whenever the ISS asks for them (the same
+# as in StandaloneSim)
+_URND_SEED = [0x11111111, 0x22222222, 0x33333333,
+              0x44444444, 0x55555555, 0x66666666]
+
+
+def _batch_test_program() -> List[Tuple[bool, int]]:
+    '''Return IMEM words for a straight-line program that writes DMEM
+
+    The program adds to x2 and stores each new value to DMEM, so that a rewind
+    has to undo register and memory writes. It ends with an ECALL.
+
+    '''
+    words = []
+    for i in range(1, 33):
+        # addi x2, x2, i
+        words.append((i << 20) | (2 << 15) | (2 << 7) | 0x13)
+        # sw x2, 4*i(x0)
+        off = 4 * i
+        words.append(((off >> 5) << 25) | (2 << 20) | (2 << 12) |
+                     ((off & 0x1f) << 7) | 0x23)
+    words.append(0x00000073)
+    return [(True, word) for word in words]
+
+
+class _BatchHost:
+    '''Drive a ChannelServer the way ISSWrapper does
+
+    If batch_cycles is more than one, steps are fetched in batches and handed
+    out one cycle at a time. Any other command first rewinds the ISS to the
+    last cycle that was handed out.
+
+    '''
+    def __init__(self, tmpdir: py.path.local, batch_cycles: int) -> None:
+        self.path = _make_channel_file(tmpdir, rsp_size=_BATCH_RSP_SIZE)
+
+        sim = OTBNSim()
+        sim.state.complete_init_sec_wipe()
+        sim.load_program(decode_words(0, _batch_test_program()))
+        self.server = ChannelServer(sim, ShmChannel(self.path))
+
+        self.batch_cycles = batch_cycles
+        self.pending = []  # type: List[List[Tuple[int, bytes]]]
+        self.used = 0
+        self.rewinds = 0
+        self.urnd_count = 0
+
+    def _transact(self, kind: int, payload: bytes) -> List[Tuple[int, bytes]]:
+        _put_command(self.path, kind, payload)
+        self.server.on_command()
+        rsps = _take_responses(self.path)
+        assert rsps[-1] == (shm_channel.RSP_END, b'')
+        return rsps[:-1]
+
+    def command(self, text: str) -> None:
+        '''Send a text command, rewinding first if there is an unused batch'''
+        if self.pending:
+            self._transact(shm_channel.CMD_REWIND,
+                           struct.pack('<I', self.used))
+            self.pending = []
+            self.rewinds += 1
+        self._transact(shm_channel.CMD_TEXT, text.encode('utf-8'))
+
+    def step(self) -> List[Tuple[int, bytes]]:
+        '''Step a cycle and return the responses for it'''
+        if self.batch_cycles <= 1:
+            return self._transact(shm_channel.CMD_STEP, b'')
+
+        if not self.pending:
+            rsps = self._transact(shm_channel.CMD_STEP_BATCH,
+                                  struct.pack('<I', self.batch_cycles))
+            cycle = []  # type: List[Tuple[int, bytes]]
+            for rsp in rsps:
+                if rsp[0] == shm_channel.RSP_CYCLE:
+                    self.pending.append(cycle)
+                    cycle = []
+                else:
+                    cycle.append(rsp)
+            assert not cycle
+            self.used = 0
+
+        self.used += 1
+        return self.pending.pop(0)
+
+    def serve_urnd(self) -> None:
+        '''Answer a URND request, as StandaloneSim does
+
+        This looks at the ISS's state directly, so only does anything once the
+        host has used all of the last batch (and the ISS is at the same cycle
+        as the host). Batches only run ahead while executing, when there are
+        no URND requests.
+
+        '''
+        urnd = self.server.sim.state.wsrs.URND
+        if self.pending or not urnd.requesting:
+            return
+        urnd.set_seed(_URND_SEED[self.urnd_count])
+        self.urnd_count = (self.urnd_count + 1) % len(_URND_SEED)
+        if self.urnd_count == 0:
+            urnd.reseed_done = True
+
+
+def _run_batch_test(tmpdir: py.path.local, batch_cycles: int,
+                    event: Optional[Tuple[int, str]]
+                    ) -> Tuple[List[List[Tuple[int, bytes]]], object, int]:
+    '''Run the batch test program until the end of its secure wipe
+
+    If event is not None, it is a pair (cycle, command) and the command is
+    sent just before that cycle. Returns the responses for each cycle, the
+    final ISS state and the number of rewinds.
+
+    '''
+    host = _BatchHost(tmpdir, batch_cycles)
+    host.command('start_operation Execute')
+
+    status_id = shm_channel.EXT_REG_IDS.index('STATUS')
+    cycles = []  # type: List[List[Tuple[int, bytes]]]
+    while True:
+        if event is not None and len(cycles) == event[0]:
+            host.command(event[1])
+        host.serve_urnd()
+
+        rsps = host.step()
+        cycles.append(rsps)
+        assert len(cycles) < 1000
+
+        stopped = False
+        for kind, payload in rsps:
+            if kind == shm_channel.RSP_EXT_REG:
+                reg_id, value = struct.unpack('<II', payload)
+                if reg_id == status_id:
+                    stopped = value in [0, 0xff]
+        if stopped:
+            break
+
+    # Any text command syncs the ISS with the host, rewinding if necessary.
+    host.command('print_regs')
+
+    state = host.server.sim.state
+    final = (state.gprs.peek_unsigned_values(),
+             state.wdrs.peek_unsigned_values(),
+             state.dmem.dump_words(),
+             [state.ext_regs.read(name, True)
+              for name in ['STATUS', 'ERR_BITS', 'INSN_CNT', 'STOP_PC']])
+    return (cycles, final, host.rewinds)
+
+
+@pytest.mark.parametrize('event', [
+    None,
+    (20, 'send_stall_request 0'),
+    (30, 'send_err_escalation 0x{:x} 0'.format(ErrBits.FATAL_SOFTWARE)),
+])
+def test_batch_matches_single_steps(tmpdir: py.path.local,
+                                    event: Optional[Tuple[int, str]]) -> None:
+    '''Check that batched steps match single steps, with and without rewinds
+
+    The stall request and error escalation arrive part way through a batch, so
+    the host has to rewind the ISS before sending them. Each cycle's responses
+    (and so the number of cycles) and the final state must be the same as when
+    stepping a cycle at a time.
+
+    '''
+    single_cycles, single_final, _ = \
+        _run_batch_test(tmpdir.mkdir('single'), 1, event)
+    batch_cycles, batch_final, rewinds = \
+        _run_batch_test(tmpdir.mkdir('batch'), _BATCH_CYCLES, event)
+
+    assert len(batch_cycles) == len(single_cycles)
+    assert batch_cycles == single_cycles
+    assert batch_final == single_final
+
+    # Make sure the event really did arrive part way through a batch. A run
+    # always stops at the end of a batch, so nothing else needs a rewind.
+    assert rewinds == (0 if event is None else 1)
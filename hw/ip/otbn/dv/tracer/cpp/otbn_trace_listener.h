@@ -9,6 +9,8 @@
 #include <string>
 #include <vector>
 
+#include "otbn_trace_record.h"
+
 /**
  * Base class for anything that wants to examine trace output from OTBN. The
  * simulation that hosts the tracer is responsible for setting up listeners and
@@ -38,11 +40,31 @@ class OtbnTraceListener {
   /**
    * Called to process an OTBN trace output, called a maximum of once per cycle
    *
+   * This is only called if some listener returns true from
+   * WantsTraceStrings(): otherwise the tracer doesn't generate the string.
+   *
    * @param trace Trace output from OTBN
    * @param cycle_count The cycle count associated with the trace output
    */
   virtual void AcceptTraceString(const std::string &trace,
-                                 unsigned int cycle_count) = 0;
+                                 unsigned int cycle_count) {}
+
+  /**
+   * Called to process the binary form of an OTBN trace output, called a
+   * maximum of once per cycle. The record only contains the header and the
+   * register writes.
+   *
+   * @param record Trace record from OTBN
+   * @param cycle_count The cycle count associated with the trace output
+   */
+  virtual void AcceptTraceRecord(const OtbnTraceRecord &record,
+                                 unsigned int cycle_count) {}
+
+  /**
+   * Return true if this listener needs AcceptTraceString to be called.
+   */
+  virtual bool WantsTraceStrings() const { return true; }
+
   virtual ~OtbnTraceListener() {}
 };
 
@@ -0,0 +1,369 @@
+// Copyright lowRISC contributors (OpenTitan project).
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+
+#include "otbn_trace_record.h"
+
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+// Names for the ISPR locations, indexed by otbn_pkg::ispr_e. These match the
+// names printed by otbn_ispr_name_str in otbn_tracer.sv.
+static const char *const ispr_names[] = {
+    "MOD",          "RND",          "ACC",          "FLAGS",
+    "URND",         "KEYS0L",       "KEYS0H",       "KEYS1L",
+    "KEYS1H",       "MAI_RES_S0",   "MAI_RES_S1",   "MAI_IN0_S0",
+    "MAI_IN0_S1",   "MAI_IN1_S0",   "MAI_IN1_S1",   "MAI_CTRL",
+    "MAI_STATUS",   "KMAC_DATA_S0", "KMAC_DATA_S1", "KMAC_STATUS",
+    "KMAC_CTRL",    "KMAC_CFG",     "KMAC_STRB",    "INSN_CNT",
+    "URND_STATE",   "URND_CTRL",    "URND_STATUS"};
+
+// Widths of the ISPRs in 32-bit words, indexed by otbn_pkg::ispr_e. These
+// match otbn_ispr_size in otbn_tracer.sv.
+static const uint8_t ispr_num_words[] = {8, 8, 8, 1, 8, 8, 8, 8, 8,
+                                         8, 8, 8, 8, 8, 8, 1, 1, 8,
+                                         8, 1, 1, 1, 1, 1, 8, 1, 1};
+
+static_assert(sizeof ispr_names / sizeof ispr_names[0] ==
+                  kOtbnTraceNumLocs - kOtbnTraceLocIspr,
+              "Wrong number of ISPR names");
+static_assert(sizeof ispr_num_words == kOtbnTraceNumLocs - kOtbnTraceLocIspr,
+              "Wrong number of ISPR widths");
+
+bool OtbnTraceValue::operator==(const OtbnTraceValue &other) const {
+  if (num_words != other.num_words) {
+    return false;
+  }
+
+  // Compare the values bit by bit, treating unknown bits on either side as
+  // matching anything.
+  for (unsigned i = 0; i < num_words; ++i) {
+    uint32_t known = ~(xbits[i] | other.xbits[i]);
+    if ((bits[i] ^ other.bits[i]) & known) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Write a value in the format used by the RTL tracer
+static void print_value(unsigned loc, const OtbnTraceValue &value,
+                        std::ostream &os) {
+  auto bit_chr = [&](unsigned bit) -> char {
+    if ((value.xbits[0] >> bit) & 1) {
+      return 'x';
+    }
+    return ((value.bits[0] >> bit) & 1) ? '1' : '0';
+  };
+
+  if (loc >= kOtbnTraceLocFlags && loc < kOtbnTraceLocIspr) {
+    os << "{C: " << bit_chr(0) << ", M: " << bit_chr(1)
+       << ", L: " << bit_chr(2) << ", Z: " << bit_chr(3) << "}";
+    return;
+  }
+
+  std::ios old_state(nullptr);
+  old_state.copyfmt(os);
+  os << "0x";
+  for (unsigned i = value.num_words; i > 0; --i) {
+    uint32_t bits = value.bits[i - 1], xbits = value.xbits[i - 1];
+    for (int nibble = 7; nibble >= 0; --nibble) {
+      unsigned shift = 4 * nibble;
+      if ((xbits >> shift) & 0xf) {
+        os << (((xbits >> shift) & 0xf) == 0xf ? 'x' : 'X');
+      } else {
+        os << std::hex << ((bits >> shift) & 0xf);
+      }
+    }
+    if (i > 1) {
+      os << "_";
+    }
+  }
+  os.copyfmt(old_state);
+}
+
+OtbnTraceRecord::OtbnTraceRecord() : num_locs_(0) {
+  for (OtbnTraceLocWrites &writes : writes_) {
+    writes.count = 0;
+  }
+  clear();
+}
+
+void OtbnTraceRecord::clear() {
+  trace_type_ = Invalid;
+  has_insn_ = false;
+  insn_err_ = false;
+  pc_ = 0;
+  insn_ = 0;
+  mnemonic_[0] = '\0';
+  for (unsigned i = 0; i < num_locs_; ++i) {
+    writes_[locs_[i]].count = 0;
+  }
+  num_locs_ = 0;
+}
+
+void OtbnTraceRecord::set_header(trace_type_t type, bool has_insn,
+                                 bool insn_err, uint32_t pc, uint32_t insn) {
+  trace_type_ = type;
+  has_insn_ = has_insn;
+  insn_err_ = has_insn && insn_err;
+  pc_ = has_insn ? pc : 0;
+  insn_ = (has_insn && !insn_err) ? insn : 0;
+}
+
+void OtbnTraceRecord::set_mnemonic(const char *mnemonic, size_t len) {
+  if (len >= kOtbnTraceMnemonicLen) {
+    len = kOtbnTraceMnemonicLen - 1;
+  }
+  memcpy(mnemonic_, mnemonic, len);
+  mnemonic_[len] = '\0';
+}
+
+bool OtbnTraceRecord::add_write(unsigned loc, const OtbnTraceValue &value) {
+  if (loc >= kOtbnTraceNumLocs || value.num_words > kOtbnTraceMaxWords) {
+    return false;
+  }
+
+  OtbnTraceLocWrites &writes = writes_[loc];
+  if (writes.count == 0) {
+    locs_[num_locs_++] = loc;
+    writes.changed = false;
+    writes.first = value;
+  } else if (value != writes.last) {
+    writes.changed = true;
+  }
+  writes.last = value;
+  ++writes.count;
+  return true;
+}
+
+void OtbnTraceRecord::assign(const OtbnTraceRecord &other) {
+  clear();
+  take_later(other);
+}
+
+void OtbnTraceRecord::take_later(const OtbnTraceRecord &other) {
+  trace_type_ = other.trace_type_;
+  has_insn_ = other.has_insn_;
+  insn_err_ = other.insn_err_;
+  pc_ = other.pc_;
+  insn_ = other.insn_;
+  memcpy(mnemonic_, other.mnemonic_, sizeof mnemonic_);
+
+  for (unsigned i = 0; i < other.num_locs_; ++i) {
+    unsigned loc = other.locs_[i];
+    const OtbnTraceLocWrites &theirs = other.writes_[loc];
+    OtbnTraceLocWrites &ours = writes_[loc];
+    if (ours.count == 0) {
+      locs_[num_locs_++] = loc;
+      ours = theirs;
+      continue;
+    }
+    ours.changed |= theirs.changed || (theirs.first != ours.last);
+    ours.last = theirs.last;
+    ours.count += theirs.count;
+  }
+}
+
+bool OtbnTraceRecord::compare_rtl_iss_entries(const OtbnTraceRecord &other,
+                                              bool no_sec_wipe_data_chk,
+                                              std::string *err_desc) const {
+  assert(err_desc);
+  assert(trace_type_ == WipeComplete || trace_type_ == Exec);
+
+  if (trace_type_ != other.trace_type_ || has_insn_ != other.has_insn_ ||
+      pc_ != other.pc_ || insn_err_ != other.insn_err_ ||
+      insn_ != other.insn_) {
+    *err_desc = "Headers don't match.";
+    return false;
+  }
+
+  for (unsigned i = 0; i < num_locs_; ++i) {
+    unsigned loc = locs_[i];
+    const OtbnTraceLocWrites &rtl = writes_[loc];
+    const OtbnTraceLocWrites &iss = other.writes_[loc];
+
+    if (iss.count == 0) {
+      std::ostringstream oss;
+      oss << "RTL had a write to `" << loc_name(loc)
+          << "', but the ISS doesn't have a write to that location.";
+      *err_desc = oss.str();
+      return false;
+    }
+
+    bool is_flags = loc >= kOtbnTraceLocFlags && loc < kOtbnTraceLocIspr;
+    if (trace_type_ == WipeComplete && !is_flags) {
+      // As a quick check: make sure that there are at least 2 writes to the
+      // location. We will also check that they are different, but debugging
+      // is probably easier if the error message comments that there aren't
+      // two writes *to* be different.
+      if (rtl.count < 2) {
+        std::ostringstream oss;
+        oss << "There are " << rtl.count << " RTL lines for key `"
+            << loc_name(loc) << "'; we expected at least 2.";
+        *err_desc = oss.str();
+        return false;
+      }
+
+      // Make sure that the writes actually contain different values. This
+      // checks that we don't (e.g.) just write zero to the location many
+      // times.
+      if (!rtl.changed && !no_sec_wipe_data_chk) {
+        std::ostringstream oss;
+        oss << "All RTL lines for key `" << loc_name(loc) << "' are identical.";
+        *err_desc = oss.str();
+        return false;
+      }
+    }
+
+    if (rtl.last != iss.last) {
+      std::ostringstream oss;
+      oss << "Final values of ISS and RTL don't match for key `"
+          << loc_name(loc) << "'.";
+      *err_desc = oss.str();
+      return false;
+    }
+  }
+
+  if (num_locs_ != other.num_locs_) {
+    std::ostringstream oss;
+    oss << "RTL wrote to " << num_locs_ << " locations; the ISS wrote to "
+        << other.num_locs_ << ".";
+    *err_desc = oss.str();
+    return false;
+  }
+
+  return true;
+}
+
+bool OtbnTraceRecord::is_compatible(const OtbnTraceRecord &prev) const {
+  // Two entries are compatible if they might both come from the multi-cycle
+  // execution of one instruction: S followed by S or E, or U followed by U or
+  // V. The instruction must match, except that the later entry might have seen
+  // an IMEM fetch error, in which case only the PCs need to match.
+  bool matching_types;
+  switch (prev.trace_type()) {
+    case Stall:
+      matching_types = (trace_type_ == Stall || trace_type_ == Exec);
+      break;
+    case WipeInProgress:
+      matching_types =
+          (trace_type_ == WipeInProgress || trace_type_ == WipeComplete);
+      break;
+    default:
+      matching_types = false;
+  }
+  if (!matching_types)
+    return false;
+
+  if (has_insn_ != prev.has_insn_ || pc_ != prev.pc_)
+    return false;
+
+  if (insn_err_)
+    return true;
+
+  return !prev.insn_err_ && insn_ == prev.insn_;
+}
+
+bool OtbnTraceRecord::is_partial() const {
+  return trace_type_ == Stall || trace_type_ == WipeInProgress;
+}
+
+bool OtbnTraceRecord::is_final() const {
+  return trace_type_ == Exec || trace_type_ == WipeComplete ||
+         trace_type_ == Stray;
+}
+
+void OtbnTraceRecord::print_header(std::ostream &os) const {
+  static const char type_chars[] = {'?', 'S', 'E', 'U', 'V', 'Z'};
+  assert(trace_type_ < sizeof type_chars);
+
+  if (!has_insn_) {
+    // The ISS uses a bare "STALL" header for a stall with no instruction. The
+    // other types have a trailing space, matching the RTL tracer.
+    if (trace_type_ == Stall) {
+      os << "STALL";
+    } else {
+      os << type_chars[trace_type_] << " ";
+    }
+    return;
+  }
+
+  std::ios old_state(nullptr);
+  old_state.copyfmt(os);
+  os << type_chars[trace_type_] << " PC: 0x" << std::hex << std::setw(8)
+     << std::setfill('0') << pc_ << ", insn: ";
+  if (insn_err_) {
+    os << "??";
+  } else {
+    os << "0x" << std::setw(8) << insn_;
+  }
+  os.copyfmt(old_state);
+}
+
+void OtbnTraceRecord::print(const std::string &indent,
+                            std::ostream &os) const {
+  os << indent;
+  print_header(os);
+  os << "\n";
+
+  for (unsigned i = 0; i < num_locs_; ++i) {
+    unsigned loc = locs_[i];
+    const OtbnTraceLocWrites &writes = writes_[loc];
+
+    os << indent << "> " << loc_name(loc) << ": ";
+    if (writes.count > 1) {
+      print_value(loc, writes.first, os);
+      os << " ... ";
+    }
+    print_value(loc, writes.last, os);
+    if (writes.count > 1) {
+      os << " (" << writes.count << " writes"
+         << (writes.changed ? "" : ", all identical") << ")";
+    }
+    os << "\n";
+  }
+}
+
+namespace {
+// Names for the GPR and WDR locations ("x00" to "w31")
+struct RegNames {
+  RegNames() {
+    for (unsigned i = 0; i < kOtbnTraceLocFlags; ++i) {
+      snprintf(names[i], sizeof names[i], "%c%02u",
+               i < kOtbnTraceLocWdr ? 'x' : 'w', i % 32);
+    }
+  }
+  char names[kOtbnTraceLocFlags][4];
+};
+}  // namespace
+
+const char *OtbnTraceRecord::loc_name(unsigned loc) {
+  static const RegNames reg_names;
+
+  if (loc < kOtbnTraceLocFlags)
+    return reg_names.names[loc];
+  if (loc == kOtbnTraceLocFlags)
+    return "FLAGS0";
+  if (loc == kOtbnTraceLocFlags + 1)
+    return "FLAGS1";
+  if (loc < kOtbnTraceNumLocs)
+    return ispr_names[loc - kOtbnTraceLocIspr];
+  return nullptr;
+}
+
+unsigned OtbnTraceRecord::loc_num_words(unsigned loc) {
+  if (loc < kOtbnTraceLocWdr)
+    return 1;
+  if (loc < kOtbnTraceLocFlags)
+    return kOtbnTraceMaxWords;
+  if (loc < kOtbnTraceLocIspr)
+    return 1;
+  if (loc < kOtbnTraceNumLocs)
+    return ispr_num_words[loc - kOtbnTraceLocIspr];
+  return 0;
+}
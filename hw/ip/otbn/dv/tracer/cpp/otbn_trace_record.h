@@ -0,0 +1,169 @@
+// Copyright lowRISC contributors (OpenTitan project).
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+#ifndef OPENTITAN_HW_IP_OTBN_DV_TRACER_CPP_OTBN_TRACE_RECORD_H_
+#define OPENTITAN_HW_IP_OTBN_DV_TRACER_CPP_OTBN_TRACE_RECORD_H_
+
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+
+// A compact, binary form of the register writes in an OTBN trace entry (the
+// '>' lines described in hw/ip/otbn/dv/tracer/README.md), together with its
+// header.
+//
+// Both the RTL tracer (through the otbn_trace_record_* DPI functions) and the
+// ISS (through TRACE frames on its channel) produce these directly, so
+// comparing the two traces needs no string formatting or parsing. A record has
+// a fixed size and filling one in never allocates. The only time we render a
+// record as text is when we report a mismatch.
+//
+// Rather than storing every write, a record stores a summary for each written
+// location: the number of writes, the first and last values and whether any
+// write changed the value. That's everything that the trace checker needs to
+// look at and it means that merging the records for a multi-cycle instruction
+// or secure wipe doesn't need any more space.
+
+// Register locations that can be written. These are numbered as follows:
+//
+//   0 - 31:    GPRs (x00 - x31)
+//   32 - 63:   WDRs (w00 - w31)
+//   64 - 65:   Flag groups (FLAGS0, FLAGS1)
+//   66 - 92:   ISPRs, indexed by otbn_pkg::ispr_e
+//
+// The ISPR that is numbered IsprFlags in otbn_pkg::ispr_e is never used: flag
+// groups have their own locations. The numbering must match otbn_tracer.sv and
+// TRACE_LOCS in hw/ip/otbn/dv/otbnsim/shm_channel.py.
+const unsigned kOtbnTraceLocGpr = 0;
+const unsigned kOtbnTraceLocWdr = 32;
+const unsigned kOtbnTraceLocFlags = 64;
+const unsigned kOtbnTraceLocIspr = 66;
+const unsigned kOtbnTraceNumLocs = 93;
+
+// The number of 32-bit words in the widest value (a WDR or wide ISPR)
+const unsigned kOtbnTraceMaxWords = 8;
+
+// The size of the buffer for an instruction mnemonic (including the
+// terminating null byte)
+const unsigned kOtbnTraceMnemonicLen = 16;
+
+// A value that was written to a location. Flag groups are stored in the bottom
+// four bits of a one-word value (C, M, L and Z from bit 0 upwards), which
+// matches the layout of otbn_pkg::flags_t. Bits that are set in xbits are
+// unknown and match any value.
+struct OtbnTraceValue {
+  uint32_t num_words;
+  uint32_t bits[kOtbnTraceMaxWords];
+  uint32_t xbits[kOtbnTraceMaxWords];
+
+  bool operator==(const OtbnTraceValue &other) const;
+  bool operator!=(const OtbnTraceValue &other) const {
+    return !(*this == other);
+  }
+};
+
+// The writes to a single location
+struct OtbnTraceLocWrites {
+  uint32_t count;
+  // True if some write had a different value from the write before it
+  bool changed;
+  OtbnTraceValue first;
+  OtbnTraceValue last;
+};
+
+class OtbnTraceRecord {
+ public:
+  // The kind of entry. These values match the ones used by otbn_tracer.sv and
+  // shm_channel.py.
+  enum trace_type_t {
+    Invalid = 0,
+    Stall = 1,
+    Exec = 2,
+    WipeInProgress = 3,
+    WipeComplete = 4,
+    Stray = 5,
+  };
+
+  OtbnTraceRecord();
+
+  // Clear the record, leaving an Invalid record with no writes. This only
+  // touches the locations that have been written, so is cheap.
+  void clear();
+
+  // Set the header fields. If has_insn is false, pc and insn are ignored. If
+  // insn_err is true, we saw an integrity error when fetching the instruction
+  // and insn is ignored.
+  void set_header(trace_type_t type, bool has_insn, bool insn_err, uint32_t pc,
+                  uint32_t insn);
+
+  // Set the mnemonic that the ISS reported for the instruction. The string
+  // doesn't need to be null-terminated and is truncated if it is too long.
+  void set_mnemonic(const char *mnemonic, size_t len);
+
+  // Add a write of value to location loc. Returns false if loc is out of range
+  // or the value is too wide.
+  bool add_write(unsigned loc, const OtbnTraceValue &value);
+
+  // Make this record hold the contents of other (without copying any unused
+  // locations)
+  void assign(const OtbnTraceRecord &other);
+
+  // Take the header of other and append its writes to ours. This is how we
+  // merge in a later entry for the same instruction or secure wipe.
+  void take_later(const OtbnTraceRecord &other);
+
+  // Compare the RTL entry in this record with the ISS entry in other. On a
+  // mismatch, write a description to err_desc and return false.
+  bool compare_rtl_iss_entries(const OtbnTraceRecord &other,
+                               bool no_sec_wipe_data_chk,
+                               std::string *err_desc) const;
+
+  // True if this is an acceptable entry to follow prev (assumed to have been
+  // of type Stall or WipeInProgress)
+  bool is_compatible(const OtbnTraceRecord &prev) const;
+
+  // True if this entry is "partial" (Stall or WipeInProgress)
+  bool is_partial() const;
+
+  // True if this entry is "final" (Exec, WipeComplete or Stray)
+  bool is_final() const;
+
+  // True if this record has neither a header nor any writes
+  bool empty() const { return trace_type_ == Invalid && num_locs_ == 0; }
+
+  // Render the record in the text format used by the RTL tracer, one line per
+  // location. A location that was written more than once shows its first and
+  // last values.
+  void print(const std::string &indent, std::ostream &os) const;
+
+  trace_type_t trace_type() const { return trace_type_; }
+  uint32_t insn_addr() const { return pc_; }
+  const char *mnemonic() const { return mnemonic_; }
+
+  // Return the name of a location (like "x01" or "ACC"), or nullptr if loc is
+  // not a valid location.
+  static const char *loc_name(unsigned loc);
+
+  // Return the width of values at a location in 32-bit words, or 0 if loc is
+  // not a valid location.
+  static unsigned loc_num_words(unsigned loc);
+
+ private:
+  void print_header(std::ostream &os) const;
+
+  trace_type_t trace_type_;
+  bool has_insn_;
+  bool insn_err_;
+  uint32_t pc_;
+  uint32_t insn_;
+  char mnemonic_[kOtbnTraceMnemonicLen];
+
+  // The locations that have been written, in the order of their first write,
+  // and the writes to each location. Only the entries of writes_ whose
+  // location appears in locs_ are meaningful.
+  unsigned num_locs_;
+  uint8_t locs_[kOtbnTraceNumLocs];
+  OtbnTraceLocWrites writes_[kOtbnTraceNumLocs];
+};
+
+#endif  // OPENTITAN_HW_IP_OTBN_DV_TRACER_CPP_OTBN_TRACE_RECORD_H_
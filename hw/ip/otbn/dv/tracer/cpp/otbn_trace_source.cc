@@ -7,6 +7,7 @@
 #include <algorithm>
 #include <cassert>
 #include <memory>
+#include <svdpi.h>
 
 static std::unique_ptr<OtbnTraceSource> trace_source;
 
@@ -19,18 +20,34 @@ OtbnTraceSource &OtbnTraceSource::get() {
 
 void OtbnTraceSource::AddListener(OtbnTraceListener *listener) {
   listeners_.push_back(listener);
+  if (listener->WantsTraceStrings()) {
+    ++num_string_listeners_;
+  }
 }
 
 void OtbnTraceSource::RemoveListener(const OtbnTraceListener *listener) {
   auto it = std::find(listeners_.begin(), listeners_.end(), listener);
   assert(it != listeners_.end());
   listeners_.erase(it);
+  if (listener->WantsTraceStrings()) {
+    assert(num_string_listeners_ > 0);
+    --num_string_listeners_;
+  }
 }
 
 void OtbnTraceSource::Broadcast(const std::string &trace,
                                 unsigned cycle_count) {
   for (OtbnTraceListener *listener : listeners_) {
-    listener->AcceptTraceString(trace, cycle_count);
+    if (listener->WantsTraceStrings()) {
+      listener->AcceptTraceString(trace, cycle_count);
+    }
+  }
+}
+
+void OtbnTraceSource::BroadcastRecord(const OtbnTraceRecord &record,
+                                      unsigned cycle_count) {
+  for (OtbnTraceListener *listener : listeners_) {
+    listener->AcceptTraceRecord(record, cycle_count);
   }
 }
 
@@ -39,3 +56,40 @@ extern "C" void accept_otbn_trace_string(const char *trace,
   assert(trace != nullptr);
   OtbnTraceSource::get().Broadcast(trace, cycle_count);
 }
+
+extern "C" unsigned char otbn_trace_want_strings() {
+  return OtbnTraceSource::get().WantsStrings();
+}
+
+extern "C" void otbn_trace_record_write(unsigned int loc,
+                                        const svLogicVecVal *value) {
+  assert(value != nullptr);
+
+  OtbnTraceValue trace_value;
+  trace_value.num_words = OtbnTraceRecord::loc_num_words(loc);
+  assert(trace_value.num_words > 0);
+  for (unsigned i = 0; i < trace_value.num_words; ++i) {
+    // A nonzero bval means X or Z, neither of which we can compare.
+    trace_value.xbits[i] = value[i].bval;
+    trace_value.bits[i] = value[i].aval & ~value[i].bval;
+  }
+
+  bool ok = OtbnTraceSource::get().Building().add_write(loc, trace_value);
+  assert(ok);
+  (void)ok;
+}
+
+extern "C" void otbn_trace_record_done(unsigned char trace_type,
+                                       unsigned char has_insn,
+                                       unsigned char insn_err,
+                                       unsigned int insn_addr,
+                                       unsigned int insn_data,
+                                       unsigned int cycle_count) {
+  OtbnTraceSource &source = OtbnTraceSource::get();
+  OtbnTraceRecord &record = source.Building();
+
+  record.set_header((OtbnTraceRecord::trace_type_t)trace_type, has_insn,
+                    insn_err, insn_addr, insn_data);
+  source.BroadcastRecord(record, cycle_count);
+  record.clear();
+}
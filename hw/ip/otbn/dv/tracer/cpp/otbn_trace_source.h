@@ -7,15 +7,19 @@
 #include <vector>
 
 #include "otbn_trace_listener.h"
+#include "otbn_trace_record.h"
 
 // A source for simulation trace data.
 //
 // This is a singleton class, which will be constructed on the first call to
 // get() or the first trace data that comes back from the simulation.
 //
-// The object is in charge of taking trace data from the simulation (which is
-// sent by calling the accept_otbn_trace_string DPI function) and passing it
-// out to registered listeners.
+// The object is in charge of taking trace data from the simulation and passing
+// it out to registered listeners. The simulation sends the binary form of each
+// trace entry with the otbn_trace_record_write and otbn_trace_record_done DPI
+// functions. It only formats and sends the text form (by calling the
+// accept_otbn_trace_string DPI function) if otbn_trace_want_strings returns
+// true, which is the case if a registered listener asks for it.
 
 class OtbnTraceSource {
  public:
@@ -31,8 +35,19 @@ class OtbnTraceSource {
   // Send a trace string to all listeners
   void Broadcast(const std::string &trace, unsigned cycle_count);
 
+  // Send a trace record to all listeners
+  void BroadcastRecord(const OtbnTraceRecord &record, unsigned cycle_count);
+
+  // True if some listener wants trace strings
+  bool WantsStrings() const { return num_string_listeners_ > 0; }
+
+  // The record that the simulation is filling in for the current cycle
+  OtbnTraceRecord &Building() { return building_; }
+
  private:
   std::vector<OtbnTraceListener *> listeners_;
+  unsigned num_string_listeners_ = 0;
+  OtbnTraceRecord building_;
 };
 
 #endif  // OPENTITAN_HW_IP_OTBN_DV_TRACER_CPP_OTBN_TRACE_SOURCE_H_
@@ -306,9 +306,89 @@ module otbn_tracer (
 
   import "DPI-C" function void accept_otbn_trace_string(string trace, int unsigned cycle_count);
 
+  // Binary trace records. These carry the header and register writes of each trace entry and are
+  // sent every cycle. Formatting the text above is comparatively expensive, so we only do it if
+  // the simulation environment has a listener that wants it. The record types and location numbers
+  // must match hw/ip/otbn/dv/tracer/cpp/otbn_trace_record.h.
+  import "DPI-C" function bit otbn_trace_want_strings();
+  import "DPI-C" function void otbn_trace_record_write(int unsigned loc, logic [WLEN-1:0] value);
+  import "DPI-C" function void otbn_trace_record_done(byte unsigned trace_type,
+                                                      bit has_insn,
+                                                      bit insn_err,
+                                                      int unsigned insn_addr,
+                                                      int unsigned insn_data,
+                                                      int unsigned cycle_count);
+
+  localparam byte unsigned RecordNone           = 8'd0;
+  localparam byte unsigned RecordStall          = 8'd1;
+  localparam byte unsigned RecordExec           = 8'd2;
+  localparam byte unsigned RecordWipeInProgress = 8'd3;
+  localparam byte unsigned RecordWipeComplete   = 8'd4;
+  localparam byte unsigned RecordStray          = 8'd5;
+
+  localparam int unsigned RecordLocGpr   = 0;
+  localparam int unsigned RecordLocWdr   = 32;
+  localparam int unsigned RecordLocFlags = 64;
+  localparam int unsigned RecordLocIspr  = 66;
+
+  function automatic void do_trace_record();
+    bit              any_write = 1'b0;
+    byte unsigned    trace_type;
+
+    if (|otbn_trace.rf_base_wr_en && otbn_trace.rf_base_wr_commit &&
+        otbn_trace.rf_base_wr_addr != '0) begin
+      otbn_trace_record_write(RecordLocGpr + otbn_trace.rf_base_wr_addr,
+                              WLEN'(otbn_trace.rf_base_wr_data));
+      any_write = 1'b1;
+    end
+
+    if (|otbn_trace.rf_bignum_wr_en & otbn_trace.rf_bignum_wr_commit) begin
+      otbn_trace_record_write(RecordLocWdr + otbn_trace.rf_bignum_wr_addr,
+                              otbn_trace.rf_bignum_wr_data);
+      any_write = 1'b1;
+    end
+
+    for (int i_fg = 0; i_fg < NFlagGroups; i_fg++) begin
+      if (otbn_trace.flags_write[i_fg]) begin
+        otbn_trace_record_write(RecordLocFlags + i_fg, WLEN'(otbn_trace.flags_write_data[i_fg]));
+        any_write = 1'b1;
+      end
+    end
+
+    for (int i_ispr = 0; i_ispr < NIspr; i_ispr++) begin
+      if (ispr_e'(i_ispr) != IsprFlags && otbn_trace.ispr_write[i_ispr]) begin
+        otbn_trace_record_write(RecordLocIspr + i_ispr, otbn_trace.ispr_write_data[i_ispr]);
+        any_write = 1'b1;
+      end
+    end
+
+    // This matches the choice of first header line in prepend_trace_header.
+    if (otbn_trace.insn_valid) begin
+      trace_type = (otbn_trace.insn_stall && !otbn_trace.insn_fetch_err) ? RecordStall :
+                                                                            RecordExec;
+    end else if (otbn_trace.secure_wipe_ack_r) begin
+      trace_type = RecordWipeComplete;
+    end else if (otbn_trace.secure_wipe_req || !otbn_trace.initial_secure_wipe_done) begin
+      trace_type = RecordWipeInProgress;
+    end else begin
+      trace_type = any_write ? RecordStray : RecordNone;
+    end
+
+    if (trace_type != RecordNone) begin
+      otbn_trace_record_done(trace_type, otbn_trace.insn_valid, otbn_trace.insn_fetch_err,
+                             otbn_trace.insn_addr, otbn_trace.insn_data, cycle_count);
+    end
+  endfunction
+
   function automatic void do_trace();
     string work;
 
+    do_trace_record();
+
+    if (!otbn_trace_want_strings()) begin
+      return;
+    end
+
     work = trace_bignum_rf(work);
     work = trace_base_rf(work);
     work = trace_bignum_mem(work);
@@ -318,6 +318,18 @@ std::vector<uint8_t> scramble_addr(const std::vector<uint8_t> &addr_in,
                                  kNumAddrSubstPermRounds);
 }
 
+std::vector<uint8_t> scramble_keystream(const std::vector<uint8_t> &addr,
+                                        uint32_t addr_width,
+                                        const std::vector<uint8_t> &nonce,
+                                        const std::vector<uint8_t> &key,
+                                        uint32_t data_width,
+                                        bool repeat_keystream) {
+  assert(addr.size() == ((addr_width + 7) / 8));
+
+  return scramble_gen_keystream(addr, addr_width, nonce, key, data_width,
+                                kNumPrinceHalfRounds, repeat_keystream);
+}
+
 std::vector<uint8_t> scramble_encrypt_data(
     const std::vector<uint8_t> &data_in, uint32_t data_width,
     uint32_t subst_perm_width, const std::vector<uint8_t> &addr,
@@ -329,9 +341,8 @@ std::vector<uint8_t> scramble_encrypt_data(
   // Data is encrypted by XORing with keystream then applying
   // substitution/permutation layer
 
-  auto keystream =
-      scramble_gen_keystream(addr, addr_width, nonce, key, data_width,
-                             kNumPrinceHalfRounds, repeat_keystream);
+  auto keystream = scramble_keystream(addr, addr_width, nonce, key,
+                                      data_width, repeat_keystream);
 
   auto data_enc = xor_vectors(data_in, keystream);
 
@@ -351,9 +362,8 @@ std::vector<uint8_t> scramble_decrypt_data(
   assert(data_in.size() == ((data_width + 7) / 8));
   assert(addr.size() == ((addr_width + 7) / 8));
 
-  auto keystream =
-      scramble_gen_keystream(addr, addr_width, nonce, key, data_width,
-                             kNumPrinceHalfRounds, repeat_keystream);
+  auto keystream = scramble_keystream(addr, addr_width, nonce, key,
+                                      data_width, repeat_keystream);
   if (use_sp_layer) {
     // Data is decrypted by reversing substitution/permutation layer then XORing
     // with keystream
@@ -28,6 +28,29 @@ std::vector<uint8_t> scramble_addr(const std::vector<uint8_t> &addr_in,
                                    const std::vector<uint8_t> &nonce,
                                    uint32_t nonce_width);
 
+/** Generate the keystream that is XORed with the data stored at an address
+ *
+ * When the S&P layer is disabled, encrypting or decrypting data is just an XOR
+ * with this keystream, so callers that access many words under the same key
+ * and nonce can compute it once per address and cache it.
+ *
+ * @param addr             Byte vector of data address
+ * @param addr_width       Width of the address in bits
+ * @param nonce            Byte vector of scrambling nonce
+ * @param key              Byte vector of scrambling key
+ * @param data_width       Width of data in bits
+ * @param repeat_keystream Repeat the keystream of one single PRINCE instance if
+ *                         set to true. Otherwise multiple PRINCE instances are
+ *                         used.
+ * @return Byte vector with (data_width + 7) / 8 bytes of keystream
+ */
+std::vector<uint8_t> scramble_keystream(const std::vector<uint8_t> &addr,
+                                        uint32_t addr_width,
+                                        const std::vector<uint8_t> &nonce,
+                                        const std::vector<uint8_t> &key,
+                                        uint32_t data_width,
+                                        bool repeat_keystream);
+
 /** Decrypt scrambled data
  * @param data_in          Byte vector of data to decrypt
  * @param data_width       Width of data in bits
@@ -0,0 +1,387 @@
+// Copyright lowRISC contributors (OpenTitan project).
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+
+#include "scramble_model_fast.h"
+
+#include <algorithm>
+#include <cassert>
+#include <stdint.h>
+
+// These must match the constants in scramble_model.cc
+static const uint32_t kNumAddrSubstPermRounds = 2;
+static const uint32_t kNumDataSubstPermRounds = 2;
+static const int kNumPrinceHalfRounds = 3;
+
+static const uint64_t kPrinceRoundConstants[] = {
+    0x0000000000000000, 0x13198a2e03707344, 0xa4093822299f31d0,
+    0x082efa98ec4e6c89, 0x452821e638d01377, 0xbe5466cf34e90c6c,
+    0x7ef84f78fd955cb1, 0x85840851f1ac43aa, 0xc882d32f25323c54,
+    0x64a51195e0e3610d, 0xd3b5a399ca0c2399, 0xc0ac29b7c97c50dd};
+
+namespace {
+// Lookup tables for the PRINCE S and M' layers. The S-box tables substitute
+// both nibbles of a byte at once. The M' layer is linear, so it is the XOR of
+// its action on each byte of the input: m_prime[i][b] is the M' layer applied
+// to a value whose only nonzero byte is byte i, with value b.
+struct PrinceTables {
+  uint8_t sbox[256];
+  uint8_t sbox_inv[256];
+  uint64_t m_prime[8][256];
+
+  PrinceTables() {
+    static const uint8_t sbox4[] = {0xb, 0xf, 0x3, 0x2, 0xa, 0xc, 0x9, 0x1,
+                                    0x6, 0x7, 0x8, 0x0, 0xe, 0x5, 0xd, 0x4};
+    static const uint8_t sbox4_inv[] = {0xb, 0x7, 0x3, 0x2, 0xf, 0xd, 0x8, 0x9,
+                                        0xa, 0x6, 0x4, 0x0, 0x5, 0xe, 0xc, 0x1};
+    // The 16 bit matrices M0 and M1 (see prince_m_prime_layer in
+    // prince_ref.h). Chunks 0 and 3 of the state use M0, chunks 1 and 2 use M1.
+    static const uint16_t m16[2][16] = {
+        {0x0111, 0x2220, 0x4404, 0x8088, 0x1011, 0x0222, 0x4440, 0x8808, 0x1101,
+         0x2022, 0x0444, 0x8880, 0x1110, 0x2202, 0x4044, 0x0888},
+        {0x1110, 0x2202, 0x4044, 0x0888, 0x0111, 0x2220, 0x4404, 0x8088, 0x1011,
+         0x0222, 0x4440, 0x8808, 0x1101, 0x2022, 0x0444, 0x8880}};
+
+    for (uint32_t b = 0; b < 256; ++b) {
+      sbox[b] = sbox4[b & 0xf] | (sbox4[b >> 4] << 4);
+      sbox_inv[b] = sbox4_inv[b & 0xf] | (sbox4_inv[b >> 4] << 4);
+    }
+
+    for (uint32_t i = 0; i < 8; ++i) {
+      uint32_t chunk = i / 2;
+      const uint16_t *mat = m16[(chunk == 0 || chunk == 3) ? 0 : 1];
+      for (uint32_t b = 0; b < 256; ++b) {
+        uint32_t in16 = b << (8 * (i % 2));
+        uint64_t out16 = 0;
+        for (uint32_t j = 0; j < 16; ++j) {
+          if ((in16 >> j) & 1)
+            out16 ^= mat[j];
+        }
+        m_prime[i][b] = out16 << (16 * chunk);
+      }
+    }
+  }
+};
+
+const PrinceTables &GetPrinceTables() {
+  static const PrinceTables tables;
+  return tables;
+}
+}  // namespace
+
+static uint64_t width_mask(uint32_t width) {
+  return width >= 64 ? ~(uint64_t)0 : (((uint64_t)1 << width) - 1);
+}
+
+// Extract width bits (at most 64) from lanes, starting at bit lo
+static uint64_t lanes_extract(const uint64_t *lanes, uint32_t lo,
+                              uint32_t width) {
+  if (width == 0)
+    return 0;
+
+  uint32_t idx = lo / 64;
+  uint32_t shift = lo % 64;
+  uint64_t val = lanes[idx] >> shift;
+  if (shift && shift + width > 64) {
+    val |= lanes[idx + 1] << (64 - shift);
+  }
+  return val & width_mask(width);
+}
+
+// Replace width bits (at most 64) of lanes, starting at bit lo, with val
+static void lanes_insert(uint64_t *lanes, uint32_t lo, uint32_t width,
+                         uint64_t val) {
+  if (width == 0)
+    return;
+
+  uint64_t mask = width_mask(width);
+  val &= mask;
+
+  uint32_t idx = lo / 64;
+  uint32_t shift = lo % 64;
+  lanes[idx] = (lanes[idx] & ~(mask << shift)) | (val << shift);
+  if (shift && shift + width > 64) {
+    uint32_t spill = 64 - shift;
+    lanes[idx + 1] = (lanes[idx + 1] & ~(mask >> spill)) | (val >> spill);
+  }
+}
+
+void scramble_bytes_to_lanes(uint64_t *lanes,
+                             const std::vector<uint8_t> &bytes) {
+  uint32_t num_lanes = (bytes.size() + 7) / 8;
+  std::fill(lanes, lanes + num_lanes, 0);
+  for (uint32_t i = 0; i < bytes.size(); ++i) {
+    lanes[i / 8] |= (uint64_t)bytes[i] << (8 * (i % 8));
+  }
+}
+
+void scramble_lanes_to_bytes(uint8_t *bytes, uint32_t num_bytes,
+                             const uint64_t *lanes) {
+  for (uint32_t i = 0; i < num_bytes; ++i) {
+    bytes[i] = lanes[i / 8] >> (8 * (i % 8));
+  }
+}
+
+static uint64_t prince_s_layer_fast(uint64_t x, const uint8_t sbox[256]) {
+  uint64_t out = 0;
+  for (uint32_t i = 0; i < 8; ++i) {
+    out |= (uint64_t)sbox[(x >> (8 * i)) & 0xff] << (8 * i);
+  }
+  return out;
+}
+
+static uint64_t prince_m_prime_layer_fast(uint64_t x) {
+  const PrinceTables &tables = GetPrinceTables();
+  uint64_t out = 0;
+  for (uint32_t i = 0; i < 8; ++i) {
+    out ^= tables.m_prime[i][(x >> (8 * i)) & 0xff];
+  }
+  return out;
+}
+
+static uint64_t prince_shift_rows_fast(uint64_t in, bool inverse) {
+  const uint64_t row_mask = 0xF000F000F000F000;
+  uint64_t out = 0;
+  for (uint32_t i = 0; i < 4; ++i) {
+    uint64_t row = in & (row_mask >> (4 * i));
+    uint32_t shift = inverse ? i * 16 : 64 - i * 16;
+    // A shift of 64 would be undefined, but rotating by 0 or 64 is the same.
+    out |= (shift % 64) ? (row >> shift) | (row << (64 - shift)) : row;
+  }
+  return out;
+}
+
+uint64_t prince_enc_fast(uint64_t in, uint64_t k0, uint64_t k1,
+                         int num_half_rounds) {
+  const PrinceTables &tables = GetPrinceTables();
+  const uint64_t *rc = kPrinceRoundConstants;
+
+  uint64_t k0_prime = ((k0 >> 1) | (k0 << 63)) ^ (k0 >> 63);
+
+  uint64_t state = in ^ k0 ^ k1 ^ rc[0];
+  for (int round = 1; round <= num_half_rounds; ++round) {
+    state = prince_s_layer_fast(state, tables.sbox);
+    state = prince_shift_rows_fast(prince_m_prime_layer_fast(state), false);
+    state ^= ((round % 2 == 1) ? k0 : k1) ^ rc[round];
+  }
+
+  state = prince_s_layer_fast(state, tables.sbox);
+  state = prince_m_prime_layer_fast(state);
+  state = prince_s_layer_fast(state, tables.sbox_inv);
+
+  for (int round = 1; round <= num_half_rounds; ++round) {
+    int constant_idx = 10 - num_half_rounds + round;
+    state ^= (((num_half_rounds + round + 1) % 2 == 1) ? k0 : k1) ^
+             rc[constant_idx];
+    state = prince_m_prime_layer_fast(prince_shift_rows_fast(state, true));
+    state = prince_s_layer_fast(state, tables.sbox_inv);
+  }
+
+  return state ^ k1 ^ rc[11] ^ k0_prime;
+}
+
+// Bit-sliced PRESENT S-box layer over the bottom width bits of x. Each of
+// x0..x3 holds one bit of every nibble, so all 16 S-boxes are evaluated at
+// once with the algebraic normal form of the S-box. As in the byte-vector
+// model, a partial nibble at the top is copied through unchanged.
+static uint64_t sp_sbox_layer(uint64_t x, uint32_t width, bool invert) {
+  uint32_t full_nibbles = width / 4;
+  const uint64_t one = 0x1111111111111111 & width_mask(4 * full_nibbles);
+
+  uint64_t x0 = x & one;
+  uint64_t x1 = (x >> 1) & one;
+  uint64_t x2 = (x >> 2) & one;
+  uint64_t x3 = (x >> 3) & one;
+
+  uint64_t x01 = x0 & x1, x02 = x0 & x2, x03 = x0 & x3;
+  uint64_t x12 = x1 & x2, x13 = x1 & x3, x23 = x2 & x3;
+  uint64_t x012 = x01 & x2, x013 = x01 & x3, x023 = x02 & x3;
+
+  uint64_t y0, y1, y2, y3;
+  if (!invert) {
+    y0 = x0 ^ x2 ^ x12 ^ x3;
+    y1 = x1 ^ x012 ^ x3 ^ x13 ^ x013 ^ x23 ^ x023;
+    y2 = one ^ x01 ^ x2 ^ x3 ^ x03 ^ x13 ^ x013 ^ x023;
+    y3 = one ^ x0 ^ x1 ^ x12 ^ x012 ^ x3 ^ x013 ^ x023;
+  } else {
+    y0 = one ^ x0 ^ x2 ^ x13;
+    y1 = x0 ^ x1 ^ x02 ^ x012 ^ x3 ^ x13 ^ x013 ^ x23 ^ x023;
+    y2 = one ^ x01 ^ x02 ^ x12 ^ x012 ^ x3 ^ x03 ^ x13 ^ x013 ^ x023;
+    y3 = x0 ^ x1 ^ x01 ^ x2 ^ x012 ^ x3 ^ x023;
+  }
+
+  uint64_t rest = width_mask(width) & ~width_mask(4 * full_nibbles);
+  return y0 | (y1 << 1) | (y2 << 2) | (y3 << 3) | (x & rest);
+}
+
+// Reverse the bottom width bits of x
+static uint64_t sp_flip_layer(uint64_t x, uint32_t width) {
+  x = ((x >> 1) & 0x5555555555555555) | ((x & 0x5555555555555555) << 1);
+  x = ((x >> 2) & 0x3333333333333333) | ((x & 0x3333333333333333) << 2);
+  x = ((x >> 4) & 0x0f0f0f0f0f0f0f0f) | ((x & 0x0f0f0f0f0f0f0f0f) << 4);
+  x = ((x >> 8) & 0x00ff00ff00ff00ff) | ((x & 0x00ff00ff00ff00ff) << 8);
+  x = ((x >> 16) & 0x0000ffff0000ffff) | ((x & 0x0000ffff0000ffff) << 16);
+  x = (x >> 32) | (x << 32);
+  return x >> (64 - width);
+}
+
+// Gather the even bits of x into the bottom half
+static uint64_t compress_even_bits(uint64_t x) {
+  x &= 0x5555555555555555;
+  x = (x | (x >> 1)) & 0x3333333333333333;
+  x = (x | (x >> 2)) & 0x0f0f0f0f0f0f0f0f;
+  x = (x | (x >> 4)) & 0x00ff00ff00ff00ff;
+  x = (x | (x >> 8)) & 0x0000ffff0000ffff;
+  x = (x | (x >> 16)) & 0x00000000ffffffff;
+  return x;
+}
+
+// Spread the bottom 32 bits of x into the even bits
+static uint64_t spread_even_bits(uint64_t x) {
+  x &= 0x00000000ffffffff;
+  x = (x | (x << 16)) & 0x0000ffff0000ffff;
+  x = (x | (x << 8)) & 0x00ff00ff00ff00ff;
+  x = (x | (x << 4)) & 0x0f0f0f0f0f0f0f0f;
+  x = (x | (x << 2)) & 0x3333333333333333;
+  x = (x | (x << 1)) & 0x5555555555555555;
+  return x;
+}
+
+// Butterfly permutation of the bottom width bits of x. Even bits go to the
+// lower half and odd bits to the upper half. If width is odd, the top bit
+// stays where it is.
+static uint64_t sp_perm_layer(uint64_t x, uint32_t width, bool invert) {
+  uint32_t half = width / 2;
+  uint64_t odd_top = (width % 2) ? x & ((uint64_t)1 << (width - 1)) : 0;
+
+  if (invert) {
+    uint64_t lo = x & width_mask(half);
+    uint64_t hi = (x >> half) & width_mask(half);
+    return spread_even_bits(lo) | (spread_even_bits(hi) << 1) | odd_top;
+  }
+
+  uint64_t even_part = x & width_mask(2 * half);
+  return compress_even_bits(even_part) |
+         (compress_even_bits(even_part >> 1) << half) | odd_top;
+}
+
+static uint64_t sp_enc(uint64_t x, uint64_t key, uint32_t width,
+                       uint32_t num_rounds) {
+  for (uint32_t i = 0; i < num_rounds; ++i) {
+    x ^= key;
+    x = sp_sbox_layer(x, width, false);
+    x = sp_flip_layer(x, width);
+    x = sp_perm_layer(x, width, false);
+  }
+  return x ^ key;
+}
+
+static uint64_t sp_dec(uint64_t x, uint64_t key, uint32_t width,
+                       uint32_t num_rounds) {
+  for (uint32_t i = 0; i < num_rounds; ++i) {
+    x ^= key;
+    x = sp_perm_layer(x, width, true);
+    x = sp_flip_layer(x, width);
+    x = sp_sbox_layer(x, width, true);
+  }
+  return x ^ key;
+}
+
+// Apply the substitution/permutation network separately to each
+// subst_perm_width chunk of data (in place)
+static void sp_full_width(uint64_t *data, uint32_t data_width,
+                          uint32_t subst_perm_width, bool enc) {
+  assert(0 < subst_perm_width && subst_perm_width <= 64);
+
+  for (uint32_t lo = 0; lo < data_width; lo += subst_perm_width) {
+    uint32_t block_width = std::min(subst_perm_width, data_width - lo);
+    uint64_t block = lanes_extract(data, lo, block_width);
+    block = enc ? sp_enc(block, 0, block_width, kNumDataSubstPermRounds)
+                : sp_dec(block, 0, block_width, kNumDataSubstPermRounds);
+    lanes_insert(data, lo, block_width, block);
+  }
+}
+
+uint32_t scramble_addr_fast(uint32_t addr, uint32_t addr_width,
+                            const uint64_t *nonce, uint32_t nonce_width) {
+  assert(0 < addr_width && addr_width <= 32);
+  assert(addr_width <= nonce_width);
+
+  // The address is scrambled by the substitution/permutation network, using
+  // the top addr_width bits of the nonce as a key.
+  uint64_t key = lanes_extract(nonce, nonce_width - addr_width, addr_width);
+  return sp_enc(addr & width_mask(addr_width), key, addr_width,
+                kNumAddrSubstPermRounds);
+}
+
+void scramble_keystream_fast(uint64_t *keystream, uint32_t addr,
+                             uint32_t addr_width, const uint64_t *nonce,
+                             const uint64_t key[2], uint32_t data_width,
+                             bool repeat_keystream) {
+  assert(addr_width <= 32);
+
+  uint32_t num_lanes = (data_width + 63) / 64;
+  assert(0 < num_lanes && num_lanes <= kScrMaxLanes);
+
+  // The PRINCE reference model takes a big-endian key whose first half is K0,
+  // so K0 is the top lane of our little endian key.
+  uint64_t k0 = key[1];
+  uint64_t k1 = key[0];
+
+  // The IV for each PRINCE instance is the address in its bottom bits and a
+  // different slice of the nonce in the rest.
+  uint32_t nonce_bits = 64 - addr_width;
+  uint64_t addr_bits = addr & width_mask(addr_width);
+
+  for (uint32_t i = 0; i < num_lanes; ++i) {
+    if (repeat_keystream && i > 0) {
+      keystream[i] = keystream[0];
+      continue;
+    }
+    uint64_t iv = addr_bits;
+    if (nonce_bits) {
+      iv |= lanes_extract(nonce, i * nonce_bits, nonce_bits) << addr_width;
+    }
+    keystream[i] = prince_enc_fast(iv, k0, k1, kNumPrinceHalfRounds);
+  }
+
+  if (data_width % 64) {
+    keystream[num_lanes - 1] &= width_mask(data_width % 64);
+  }
+}
+
+void scramble_encrypt_data_fast(uint64_t *data, uint32_t data_width,
+                                uint32_t subst_perm_width, uint32_t addr,
+                                uint32_t addr_width, const uint64_t *nonce,
+                                const uint64_t key[2], bool repeat_keystream,
+                                bool use_sp_layer) {
+  uint64_t keystream[kScrMaxLanes];
+  scramble_keystream_fast(keystream, addr, addr_width, nonce, key, data_width,
+                          repeat_keystream);
+
+  for (uint32_t i = 0; i < (data_width + 63) / 64; ++i) {
+    data[i] ^= keystream[i];
+  }
+
+  if (use_sp_layer) {
+    sp_full_width(data, data_width, subst_perm_width, true);
+  }
+}
+
+void scramble_decrypt_data_fast(uint64_t *data, uint32_t data_width,
+                                uint32_t subst_perm_width, uint32_t addr,
+                                uint32_t addr_width, const uint64_t *nonce,
+                                const uint64_t key[2], bool repeat_keystream,
+                                bool use_sp_layer) {
+  uint64_t keystream[kScrMaxLanes];
+  scramble_keystream_fast(keystream, addr, addr_width, nonce, key, data_width,
+                          repeat_keystream);
+
+  if (use_sp_layer) {
+    sp_full_width(data, data_width, subst_perm_width, false);
+  }
+
+  for (uint32_t i = 0; i < (data_width + 63) / 64; ++i) {
+    data[i] ^= keystream[i];
+  }
+}
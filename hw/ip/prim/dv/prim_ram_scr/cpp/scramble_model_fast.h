@@ -0,0 +1,94 @@
+// Copyright lowRISC contributors (OpenTitan project).
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef OPENTITAN_HW_IP_PRIM_DV_PRIM_RAM_SCR_CPP_SCRAMBLE_MODEL_FAST_H_
+#define OPENTITAN_HW_IP_PRIM_DV_PRIM_RAM_SCR_CPP_SCRAMBLE_MODEL_FAST_H_
+
+#include <stdint.h>
+#include <vector>
+
+// Word-oriented C++ model of memory scrambling. This computes the same results
+// as the byte-vector model in scramble_model.h, but never allocates. Wide
+// values are held in arrays of uint64_t "lanes" in little endian order: bit i
+// of a value is bit (i % 64) of lane (i / 64). Bits above the width of a value
+// must be zero on input and are zero on output.
+//
+// The PRINCE S-box and M-layer are table driven and the
+// substitution/permutation network works on whole 64-bit lanes with bit-sliced
+// S-boxes, so the substitution/permutation width must be at most 64 bits.
+
+// The maximum width of a value (data, keystream or nonce) supported by this
+// model, in lanes.
+const uint32_t kScrMaxLanes = 5;
+
+/** Convert a little endian byte vector to lanes
+ *
+ * @param lanes  Destination; this must have at least (bytes.size() + 7) / 8
+ *               entries, which are all written
+ * @param bytes  Little endian byte vector
+ */
+void scramble_bytes_to_lanes(uint64_t *lanes,
+                             const std::vector<uint8_t> &bytes);
+
+/** Convert lanes to a little endian array of num_bytes bytes */
+void scramble_lanes_to_bytes(uint8_t *bytes, uint32_t num_bytes,
+                             const uint64_t *lanes);
+
+/** Encrypt one 64-bit block with PRINCE, using the new key schedule
+ *
+ * This matches prince_enc_dec_uint64 from prince_ref.h with decrypt and
+ * old_key_schedule both zero.
+ */
+uint64_t prince_enc_fast(uint64_t in, uint64_t k0, uint64_t k1,
+                         int num_half_rounds);
+
+/** Scramble an address. Equivalent to scramble_addr()
+ *
+ * @param addr        Address to scramble (at most 32 bits)
+ * @param addr_width  Width of the address in bits
+ * @param nonce       Scrambling nonce, as lanes
+ * @param nonce_width Width of scramble nonce in bits
+ * @return Scrambled address
+ */
+uint32_t scramble_addr_fast(uint32_t addr, uint32_t addr_width,
+                            const uint64_t *nonce, uint32_t nonce_width);
+
+/** Generate a keystream. Equivalent to scramble_keystream()
+ *
+ * @param keystream        Destination for (data_width + 63) / 64 lanes
+ * @param addr             Data address
+ * @param addr_width       Width of the address in bits
+ * @param nonce            Scrambling nonce, as lanes
+ * @param key              Scrambling key, as two lanes
+ * @param data_width       Width of data in bits (at most 64 * kScrMaxLanes)
+ * @param repeat_keystream Repeat the keystream of one single PRINCE instance
+ */
+void scramble_keystream_fast(uint64_t *keystream, uint32_t addr,
+                             uint32_t addr_width, const uint64_t *nonce,
+                             const uint64_t key[2], uint32_t data_width,
+                             bool repeat_keystream);
+
+/** Encrypt data in place. Equivalent to scramble_encrypt_data()
+ *
+ * See scramble_encrypt_data() for the meaning of the arguments. The data,
+ * nonce and key are given as lanes and subst_perm_width must be at most 64.
+ */
+void scramble_encrypt_data_fast(uint64_t *data, uint32_t data_width,
+                                uint32_t subst_perm_width, uint32_t addr,
+                                uint32_t addr_width, const uint64_t *nonce,
+                                const uint64_t key[2], bool repeat_keystream,
+                                bool use_sp_layer);
+
+/** Decrypt data in place. Equivalent to scramble_decrypt_data()
+ *
+ * See scramble_decrypt_data() for the meaning of the arguments. The data,
+ * nonce and key are given as lanes and subst_perm_width must be at most 64.
+ */
+void scramble_decrypt_data_fast(uint64_t *data, uint32_t data_width,
+                                uint32_t subst_perm_width, uint32_t addr,
+                                uint32_t addr_width, const uint64_t *nonce,
+                                const uint64_t key[2], bool repeat_keystream,
+                                bool use_sp_layer);
+
+#endif  // OPENTITAN_HW_IP_PRIM_DV_PRIM_RAM_SCR_CPP_SCRAMBLE_MODEL_FAST_H_
@@ -0,0 +1,223 @@
+// Copyright lowRISC contributors (OpenTitan project).
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+
+// Differential test and microbenchmark for the word-oriented scrambling model
+// in scramble_model_fast.h. This checks it against the byte-vector model in
+// scramble_model.h on random inputs and then times both. It is a standalone
+// program with no simulator dependencies. It runs as
+//
+//   bazel test //hw/ip/prim:scramble_model_fast_test
+//
+// or can be built and run by hand:
+//
+//   g++ -O2 -std=c++17 -I../../prim_prince/crypto_dpi_prince
+//       scramble_model.cc scramble_model_fast.cc scramble_model_fast_test.cc
+//       -o scramble_model_fast_test
+//   ./scramble_model_fast_test [iterations]
+//
+// The program exits with a nonzero status if any result differs.
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "scramble_model.h"
+#include "scramble_model_fast.h"
+
+static std::mt19937_64 rng(0x5c7a3b1e);
+
+// Return a random byte vector holding a value of the given width in bits
+static std::vector<uint8_t> random_bytes(uint32_t width) {
+  std::vector<uint8_t> ret((width + 7) / 8);
+  for (uint8_t &byte : ret) {
+    byte = rng();
+  }
+  if (width % 8) {
+    ret.back() &= (1 << (width % 8)) - 1;
+  }
+  return ret;
+}
+
+static std::vector<uint8_t> addr_to_bytes(uint32_t addr, uint32_t addr_width) {
+  std::vector<uint8_t> ret((addr_width + 7) / 8);
+  for (uint32_t i = 0; i < ret.size(); ++i) {
+    ret[i] = addr >> (8 * i);
+  }
+  return ret;
+}
+
+static uint32_t bytes_to_addr(const std::vector<uint8_t> &bytes) {
+  uint32_t ret = 0;
+  for (uint32_t i = 0; i < bytes.size(); ++i) {
+    ret |= (uint32_t)bytes[i] << (8 * i);
+  }
+  return ret;
+}
+
+static std::vector<uint8_t> lanes_to_vector(const uint64_t *lanes,
+                                            uint32_t width) {
+  std::vector<uint8_t> ret((width + 7) / 8);
+  scramble_lanes_to_bytes(ret.data(), ret.size(), lanes);
+  return ret;
+}
+
+struct Config {
+  uint32_t data_width;
+  uint32_t subst_perm_width;
+  bool repeat_keystream;
+};
+
+static const Config kConfigs[] = {
+    {32, 32, true},  {39, 39, true},  {39, 39, false}, {64, 8, false},
+    {78, 39, true},  {78, 39, false}, {156, 39, true}, {312, 39, false},
+    {312, 52, true}, {72, 9, false},  {45, 45, true},  {13, 13, false},
+};
+
+static bool check(bool ok, const char *what, const Config &cfg,
+                  uint32_t addr_width) {
+  if (!ok) {
+    std::cerr << "Mismatch in " << what << " (data_width " << cfg.data_width
+              << ", subst_perm_width " << cfg.subst_perm_width
+              << ", repeat_keystream " << cfg.repeat_keystream
+              << ", addr_width " << addr_width << ")\n";
+  }
+  return ok;
+}
+
+static bool differential_test(uint32_t iterations) {
+  bool ok = true;
+
+  for (const Config &cfg : kConfigs) {
+    uint32_t num_princes =
+        cfg.repeat_keystream ? 1 : (cfg.data_width + kPrinceWidth - 1) / 64;
+    uint32_t nonce_width = 64 * num_princes;
+
+    for (uint32_t i = 0; i < iterations; ++i) {
+      uint32_t addr_width = 1 + rng() % 32;
+      uint32_t addr_mask = (addr_width == 32) ? ~0u : (1u << addr_width) - 1;
+      uint32_t addr = rng() & addr_mask;
+      bool use_sp_layer = rng() & 1;
+
+      std::vector<uint8_t> addr_vec = addr_to_bytes(addr, addr_width);
+      std::vector<uint8_t> nonce = random_bytes(nonce_width);
+      std::vector<uint8_t> key = random_bytes(2 * kPrinceWidth);
+      std::vector<uint8_t> data = random_bytes(cfg.data_width);
+
+      uint64_t nonce_lanes[kScrMaxLanes], key_lanes[2];
+      uint64_t data_lanes[kScrMaxLanes];
+      scramble_bytes_to_lanes(nonce_lanes, nonce);
+      scramble_bytes_to_lanes(key_lanes, key);
+      scramble_bytes_to_lanes(data_lanes, data);
+
+      uint32_t ref_addr = bytes_to_addr(
+          scramble_addr(addr_vec, addr_width, nonce, nonce_width));
+      uint32_t fast_addr =
+          scramble_addr_fast(addr, addr_width, nonce_lanes, nonce_width);
+      ok &= check(ref_addr == fast_addr, "scramble_addr", cfg, addr_width);
+
+      std::vector<uint8_t> ref_ks =
+          scramble_keystream(addr_vec, addr_width, nonce, key, cfg.data_width,
+                             cfg.repeat_keystream);
+      uint64_t ks_lanes[kScrMaxLanes];
+      scramble_keystream_fast(ks_lanes, addr, addr_width, nonce_lanes,
+                              key_lanes, cfg.data_width, cfg.repeat_keystream);
+      ok &= check(ref_ks == lanes_to_vector(ks_lanes, cfg.data_width),
+                  "scramble_keystream", cfg, addr_width);
+
+      std::vector<uint8_t> ref_enc = scramble_encrypt_data(
+          data, cfg.data_width, cfg.subst_perm_width, addr_vec, addr_width,
+          nonce, key, cfg.repeat_keystream, use_sp_layer);
+      scramble_encrypt_data_fast(data_lanes, cfg.data_width,
+                                 cfg.subst_perm_width, addr, addr_width,
+                                 nonce_lanes, key_lanes, cfg.repeat_keystream,
+                                 use_sp_layer);
+      ok &= check(ref_enc == lanes_to_vector(data_lanes, cfg.data_width),
+                  "scramble_encrypt_data", cfg, addr_width);
+
+      std::vector<uint8_t> ref_dec = scramble_decrypt_data(
+          ref_enc, cfg.data_width, cfg.subst_perm_width, addr_vec, addr_width,
+          nonce, key, cfg.repeat_keystream, use_sp_layer);
+      scramble_decrypt_data_fast(data_lanes, cfg.data_width,
+                                 cfg.subst_perm_width, addr, addr_width,
+                                 nonce_lanes, key_lanes, cfg.repeat_keystream,
+                                 use_sp_layer);
+      ok &= check(ref_dec == data, "scramble_decrypt_data (reference)", cfg,
+                  addr_width);
+      ok &= check(lanes_to_vector(data_lanes, cfg.data_width) == data,
+                  "scramble_decrypt_data", cfg, addr_width);
+
+      if (!ok)
+        return false;
+    }
+  }
+
+  return ok;
+}
+
+// Time num_words encryptions of 39-bit words (one 32-bit word plus ECC, as in
+// the main SRAM) with each model and print the throughput.
+static void benchmark(uint32_t num_words) {
+  const uint32_t data_width = 39;
+  const uint32_t addr_width = 15;
+
+  std::vector<uint8_t> nonce = random_bytes(64);
+  std::vector<uint8_t> key = random_bytes(128);
+  std::vector<uint8_t> data = random_bytes(data_width);
+
+  uint64_t nonce_lanes[kScrMaxLanes], key_lanes[2], data_lanes[kScrMaxLanes];
+  scramble_bytes_to_lanes(nonce_lanes, nonce);
+  scramble_bytes_to_lanes(key_lanes, key);
+  scramble_bytes_to_lanes(data_lanes, data);
+
+  using clock = std::chrono::steady_clock;
+
+  uint64_t sink = 0;
+  auto t0 = clock::now();
+  for (uint32_t addr = 0; addr < num_words; ++addr) {
+    std::vector<uint8_t> addr_vec =
+        addr_to_bytes(addr % (1u << addr_width), addr_width);
+    std::vector<uint8_t> enc =
+        scramble_encrypt_data(data, data_width, data_width, addr_vec,
+                              addr_width, nonce, key, true, false);
+    sink += enc[0] +
+            bytes_to_addr(scramble_addr(addr_vec, addr_width, nonce, 64));
+  }
+  auto t1 = clock::now();
+  for (uint32_t addr = 0; addr < num_words; ++addr) {
+    uint64_t word[kScrMaxLanes] = {data_lanes[0]};
+    scramble_encrypt_data_fast(word, data_width, data_width,
+                               addr % (1u << addr_width), addr_width,
+                               nonce_lanes, key_lanes, true, false);
+    sink += word[0] + scramble_addr_fast(addr % (1u << addr_width), addr_width,
+                                         nonce_lanes, 64);
+  }
+  auto t2 = clock::now();
+
+  double ref_s = std::chrono::duration<double>(t1 - t0).count();
+  double fast_s = std::chrono::duration<double>(t2 - t1).count();
+
+  std::cout << "Scrambled " << num_words << " words (data + address):\n"
+            << "  byte-vector model: " << ref_s * 1e9 / num_words
+            << " ns/word\n"
+            << "  word model:        " << fast_s * 1e9 / num_words
+            << " ns/word\n"
+            << "  speedup:           " << ref_s / fast_s << "x\n"
+            << "(checksum " << sink << ")\n";
+}
+
+int main(int argc, char **argv) {
+  uint32_t iterations = (argc > 1) ? strtoul(argv[1], nullptr, 0) : 1000;
+
+  if (!differential_test(iterations)) {
+    std::cerr << "FAILED: the word model differs from the byte-vector model.\n";
+    return 1;
+  }
+  std::cout << "PASSED: " << iterations
+            << " random inputs per configuration match.\n";
+
+  benchmark(100000);
+  return 0;
+}
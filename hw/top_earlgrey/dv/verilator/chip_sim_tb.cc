@@ -2,11 +2,11 @@
 // Licensed under the Apache License, Version 2.0, see LICENSE for details.
 // SPDX-License-Identifier: Apache-2.0
 
-#include <algorithm>
 #include <iostream>
 #include <string>
 #include <vector>
 
+#include "ibex_profiler.h"
 #include "verilated_toplevel.h"
 #include "verilator_memutil.h"
 #include "verilator_sim_ctrl.h"
@@ -17,6 +17,7 @@ int main(int argc, char **argv) {
   VerilatorSimCtrl &simctrl = VerilatorSimCtrl::GetInstance();
   simctrl.SetTop(&top, &top.clk_i, &top.rst_ni,
                  VerilatorSimCtrlFlags::ResetPolarityNegative);
+  simctrl.SetIdleSignal(&top.idle_o, &top.idle_max_skip_o);
 
   // Suffix this (_pd_main) once paths to IPs in the Aon power domain are needed
   std::string top_scope("TOP.chip_sim_tb.u_dut.top_earlgrey.earlgrey_pd_main");
@@ -29,9 +30,7 @@ int main(int argc, char **argv) {
               4);
   MemArea rram(top_scope + ".u_rram_macro.u_data_array", 0x200000 / 16, 16);
 
-  std::vector<uint8_t> all_zeros(rram.GetSizeBytes());
-  std::fill(all_zeros.begin(), all_zeros.end(), 0x00u);
-  rram.Write(/*word_offset=*/0, all_zeros);
+  rram.Fill(/*pattern=*/{0x00u});
 
   // OTP occupies the last pages of the RRAM data array.
   // The OTP vmem file's own @addr fields are already absolute RRAM word
@@ -44,6 +43,10 @@ int main(int argc, char **argv) {
   memutil.RegisterMemoryArea("otp", 0x40000000u /* (bogus LMA) */, &otp);
   simctrl.RegisterExtension(&memutil);
 
+  IbexProfiler profiler(memutil.GetUnderlying(),
+                        "TOP.chip_sim_tb.u_ibex_profiler_sampler");
+  simctrl.RegisterExtension(&profiler);
+
   // The initial reset delay must be long enough such that pwr/rst/clkmgr will
   // release clocks to the entire design.  This allows for synchronous resets
   // to appropriately propagate.
@@ -5,7 +5,11 @@
 module chip_sim_tb (
   // Clock and Reset
   input clk_i,
-  input rst_ni
+  input rst_ni,
+  // The design is idle, so the simulation controller may skip cycles (see --skip-idle)
+  output logic        idle_o,
+  // The most cycles that may be skipped before the next timer event
+  output logic [31:0] idle_max_skip_o
 );
 
   logic [31:0]  cio_gpio_p2d, cio_gpio_d2p, cio_gpio_en_d2p;
@@ -13,8 +17,8 @@ module chip_sim_tb (
   logic cio_uart_rx_p2d, cio_uart_tx_d2p, cio_uart_tx_en_d2p;
 
   logic cio_spi_device_sck_p2d, cio_spi_device_csb_p2d;
-  logic cio_spi_device_sdi_p2d;
-  logic cio_spi_device_sdo_d2p, cio_spi_device_sdo_en_d2p;
+  logic [3:0] cio_spi_device_sd_p2d, cio_spi_device_sd_en_p2d;
+  logic [3:0] cio_spi_device_sd_d2p, cio_spi_device_sd_en_d2p;
 
   logic cio_usbdev_sense_p2d;
   logic cio_usbdev_se0_d2p;
@@ -53,9 +57,12 @@ module chip_sim_tb (
   // SPI device
   assign u_dut.u_padring.cio_spi_device_sck_p2d = cio_spi_device_sck_p2d;
   assign u_dut.u_padring.cio_spi_device_csb_p2d = cio_spi_device_csb_p2d;
-  assign u_dut.u_padring.cio_spi_device_sdi_p2d = cio_spi_device_sdi_p2d;
-  assign cio_spi_device_sdo_d2p    = u_dut.u_padring.cio_spi_device_sdo_d2p;
-  assign cio_spi_device_sdo_en_d2p = u_dut.u_padring.cio_spi_device_sdo_en_d2p;
+  // The data lanes read back whatever the device drives on lanes that the host has released.
+  assign u_dut.u_padring.cio_spi_device_sd_p2d =
+      (cio_spi_device_sd_p2d & cio_spi_device_sd_en_p2d) |
+      (cio_spi_device_sd_d2p & ~cio_spi_device_sd_en_p2d);
+  assign cio_spi_device_sd_d2p    = u_dut.u_padring.cio_spi_device_sd_d2p;
+  assign cio_spi_device_sd_en_d2p = u_dut.u_padring.cio_spi_device_sd_en_d2p;
 
   // USB
   assign u_dut.u_padring.cio_usbdev_sense_p2d = cio_usbdev_sense_p2d;
@@ -90,9 +97,13 @@ module chip_sim_tb (
   // The baud rate set to match FPGA implementation; the frequency is "artificial". Both baud rate
   // frequency must match the settings used in the on-chip software at
   // `sw/device/lib/arch/device_sim_verilator.c`.
+  // Polling the pseudo-terminal once every 10k cycles (rather than every cycle) keeps system calls
+  // out of the hot loop and writes output in batches of up to about 14 characters (one character
+  // takes 10 symbols of FREQ / BAUD cycles).
   uartdpi #(
     .BAUD('d7_200),
-    .FREQ('d500_000)
+    .FREQ('d500_000),
+    .POLL_INTERVAL('d10_000)
   ) u_uart (
     .clk_i  (clk_i),
     .rst_ni (rst_ni),
@@ -143,9 +154,10 @@ module chip_sim_tb (
     .rst_ni (rst_ni),
     .spi_device_sck_o     (cio_spi_device_sck_p2d),
     .spi_device_csb_o     (cio_spi_device_csb_p2d),
-    .spi_device_sdi_o     (cio_spi_device_sdi_p2d),
-    .spi_device_sdo_i     (cio_spi_device_sdo_d2p),
-    .spi_device_sdo_en_i  (cio_spi_device_sdo_en_d2p)
+    .spi_device_sd_o      (cio_spi_device_sd_p2d),
+    .spi_device_sd_en_o   (cio_spi_device_sd_en_p2d),
+    .spi_device_sd_i      (cio_spi_device_sd_d2p),
+    .spi_device_sd_en_i   (cio_spi_device_sd_en_d2p)
   );
 
   // USB DPI
@@ -202,6 +214,61 @@ module chip_sim_tb (
     .data     (`SIM_SRAM_IF.tl_h2d.a_data[15:0])
   );
 
+  // Sampler for the Ibex profiler (see --profile). This is always instantiated so that its DPI
+  // exports exist, but only sees retired instructions if the design was built with RVFI.
+  ibex_profiler_sampler u_ibex_profiler_sampler (
+    .clk_i         (`RV_CORE_IBEX.clk_i),
+    .rst_ni        (`RV_CORE_IBEX.rst_ni),
+`ifdef RVFI
+    .rvfi_valid    (`RV_CORE_IBEX.rvfi_valid),
+    .rvfi_trap     (`RV_CORE_IBEX.rvfi_trap),
+    .rvfi_intr     (`RV_CORE_IBEX.rvfi_intr),
+    .rvfi_insn     (`RV_CORE_IBEX.rvfi_insn),
+    .rvfi_pc_rdata (`RV_CORE_IBEX.rvfi_pc_rdata),
+    .rvfi_rs1_addr (`RV_CORE_IBEX.rvfi_rs1_addr),
+    .rvfi_rd_addr  (`RV_CORE_IBEX.rvfi_rd_addr)
+`else
+    .rvfi_valid    (1'b0),
+    .rvfi_trap     (1'b0),
+    .rvfi_intr     (1'b0),
+    .rvfi_insn     ('0),
+    .rvfi_pc_rdata ('0),
+    .rvfi_rs1_addr ('0),
+    .rvfi_rd_addr  ('0)
+`endif
+  );
+
+  // Trace trigger (see --trace-trigger). The trigger fires when Ibex retires the instruction at
+  // +trace_trigger_pc=ADDR (this needs RVFI) or when the GPIO outputs match
+  // +trace_trigger_gpio=VALUE in the bits set in +trace_trigger_gpio_mask=MASK (default: all).
+  import "DPI-C" function void simctrl_trace_trigger();
+
+  bit          trace_trigger_pc_en, trace_trigger_gpio_en;
+  logic [31:0] trace_trigger_pc, trace_trigger_gpio, trace_trigger_gpio_mask = '1;
+  bit          trace_trigger_fired = 1'b0;
+
+  initial begin
+    trace_trigger_pc_en = $value$plusargs("trace_trigger_pc=%h", trace_trigger_pc);
+    trace_trigger_gpio_en = $value$plusargs("trace_trigger_gpio=%h", trace_trigger_gpio);
+    void'($value$plusargs("trace_trigger_gpio_mask=%h", trace_trigger_gpio_mask));
+  end
+
+  always @(posedge clk_i) begin
+    if (!trace_trigger_fired) begin
+      if ((trace_trigger_gpio_en &&
+           ((cio_gpio_d2p & cio_gpio_en_d2p & trace_trigger_gpio_mask) ==
+            (trace_trigger_gpio & trace_trigger_gpio_mask)))
+`ifdef RVFI
+          || (trace_trigger_pc_en && `RV_CORE_IBEX.rvfi_valid &&
+              `RV_CORE_IBEX.rvfi_pc_rdata == trace_trigger_pc)
+`endif
+         ) begin
+        trace_trigger_fired <= 1'b1;
+        simctrl_trace_trigger();
+      end
+    end
+  end
+
   // Set the start address of the simulation SRAM.
   // Use offset 0 within the sim SRAM for SW test status indication.
   initial begin
@@ -218,6 +285,154 @@ module chip_sim_tb (
     end
   end
 
+  // Idle indication for the simulation controller (see VerilatorSimCtrl::SetIdleSignal()): Ibex
+  // sleeps, the UART and SPI models aren't sending to the chip, and the GPIO and SPI models veto
+  // skips while they have socket input queued up.
+  assign idle_o = `RV_CORE_IBEX.core_sleep &&
+                  !u_uart.txactive &&
+                  cio_spi_device_csb_p2d;
+
+  // The AON timer and rv_timer may keep counting while the chip is idle. Each skip stops before the
+  // next timer clock edge at which a timer could fire (an AON wakeup, a watchdog bark or bite or an
+  // rv_timer compare), and the skipped cycles are added to the timers at the next falling edge of
+  // clk_i, where no flop in the timer clock domains is updated. The bus-side copies of the AON
+  // timer counts catch up at the next increment.
+  `define AON_TIMER u_dut.top_earlgrey.earlgrey_pd_aon.u_aon_timer
+  `define RV_TIMER  u_dut.top_earlgrey.earlgrey_pd_main.u_rv_timer
+
+  import "DPI-C" function longint unsigned simctrl_take_skipped_cycles();
+
+  // clk_aon and clk_io_div4 (which runs rv_timer) are both clk_i divided by 4 in
+  // chip_earlgrey_verilator.
+  localparam int unsigned TimerClkDiv = 4;
+  localparam logic [63:0] NoTimerEvent = '1;
+
+  // The number of timer clock edges before the edge that makes the increments'th increment of a
+  // counter (counting from 0), if the first increment is at edge first and the next ones follow
+  // every period edges.
+  function automatic logic [63:0] edges_before_incr(logic [63:0] first, logic [63:0] period,
+                                                    logic [63:0] increments);
+    if (increments != 0 && increments > (NoTimerEvent - first) / period) begin
+      return NoTimerEvent;
+    end
+    return first + increments * period;
+  endfunction
+
+  logic [63:0] aon_wkup_edges, aon_wdog_edges, rv_timer_edges, timer_edges;
+
+  always_comb begin : aon_wkup_next_event
+    logic [63:0] prescaler, prescale_count, count, thold;
+    prescaler = 64'(`AON_TIMER.u_core.reg2hw_i.wkup_ctrl.prescaler.q);
+    prescale_count = 64'(`AON_TIMER.u_core.prescale_count_q);
+    count = `AON_TIMER.u_core.wkup_count;
+    thold = `AON_TIMER.u_core.wkup_thold;
+    if (!`AON_TIMER.u_core.prescale_en) begin
+      aon_wkup_edges = NoTimerEvent;
+    end else if (prescale_count > prescaler) begin
+      aon_wkup_edges = '0;
+    end else begin
+      // The interrupt fires at the first increment that starts from a count of at least thold
+      aon_wkup_edges = edges_before_incr(prescaler - prescale_count, prescaler + 1,
+                                         thold > count ? thold - count : '0);
+    end
+  end
+
+  always_comb begin : aon_wdog_next_event
+    logic [63:0] count, bark, bite;
+    count = 64'(`AON_TIMER.u_core.reg2hw_i.wdog_count.q);
+    bark = 64'(`AON_TIMER.u_core.reg2hw_i.wdog_bark_thold.q);
+    bite = 64'(`AON_TIMER.u_core.reg2hw_i.wdog_bite_thold.q);
+    if (!`AON_TIMER.u_core.wdog_incr) begin
+      aon_wdog_edges = NoTimerEvent;
+    end else begin
+      // The watchdog counts at every edge, and barks or bites at the first one that starts from a
+      // count of at least the threshold.
+      aon_wdog_edges = bark > count ? bark - count : '0;
+      if (bite <= count) begin
+        aon_wdog_edges = '0;
+      end else if (bite - count < aon_wdog_edges) begin
+        aon_wdog_edges = bite - count;
+      end
+    end
+  end
+
+  always_comb begin : rv_timer_next_event
+    logic [63:0] prescaler, tick_count, step, mtime, mtimecmp;
+    prescaler = 64'(`RV_TIMER.prescaler[0]);
+    tick_count = 64'(`RV_TIMER.gen_harts[0].u_core.tick_count);
+    step = 64'(`RV_TIMER.step[0]);
+    mtime = `RV_TIMER.mtime[0];
+    mtimecmp = `RV_TIMER.mtimecmp[0][0];
+    if (!`RV_TIMER.active[0] || (mtime < mtimecmp && step == 0)) begin
+      rv_timer_edges = NoTimerEvent;
+    end else if (mtime >= mtimecmp || tick_count > prescaler) begin
+      rv_timer_edges = '0;
+    end else begin
+      // Stop before the tick that takes mtime up to mtimecmp
+      rv_timer_edges = edges_before_incr(prescaler - tick_count, prescaler + 1,
+                                         (mtimecmp - mtime - 64'd1) / step);
+    end
+  end
+
+  always_comb begin
+    timer_edges = aon_wkup_edges;
+    if (aon_wdog_edges < timer_edges) begin
+      timer_edges = aon_wdog_edges;
+    end
+    if (rv_timer_edges < timer_edges) begin
+      timer_edges = rv_timer_edges;
+    end
+
+    // Up to TimerClkDiv - 1 skipped cycles may be left over from earlier skips, and the first timer
+    // edge after a skip is evaluated before the timers catch up. Leave room for both.
+    if (timer_edges == 0) begin
+      idle_max_skip_o = '0;
+    end else if (timer_edges - 1 > 64'(32'hffffffff / TimerClkDiv)) begin
+      idle_max_skip_o = '1;
+    end else begin
+      idle_max_skip_o = 32'((timer_edges - 1) * TimerClkDiv);
+    end
+  end
+
+  // Skipped clk_i cycles that haven't been added to the timers yet (less than one timer clock
+  // cycle)
+  longint unsigned skip_left_over = 0;
+
+  always @(negedge clk_i) begin : catch_up_timers
+    longint unsigned skipped, edges, count;
+    skipped = skip_left_over + simctrl_take_skipped_cycles();
+    edges = skipped / TimerClkDiv;
+    skip_left_over = skipped % TimerClkDiv;
+
+    if (edges != 0) begin
+      if (`AON_TIMER.u_core.prescale_en &&
+          64'(`AON_TIMER.u_core.prescale_count_q) <=
+          64'(`AON_TIMER.u_core.reg2hw_i.wkup_ctrl.prescaler.q)) begin
+        count = 64'(`AON_TIMER.u_core.prescale_count_q) + edges;
+        `AON_TIMER.u_core.prescale_count_q <=
+            12'(count % (64'(`AON_TIMER.u_core.reg2hw_i.wkup_ctrl.prescaler.q) + 1));
+        count = `AON_TIMER.u_core.wkup_count +
+                count / (64'(`AON_TIMER.u_core.reg2hw_i.wkup_ctrl.prescaler.q) + 1);
+        `AON_TIMER.u_reg.u_wkup_count_lo.q <= count[31:0];
+        `AON_TIMER.u_reg.u_wkup_count_hi.q <= count[63:32];
+      end
+      if (`AON_TIMER.u_core.wdog_incr) begin
+        `AON_TIMER.u_reg.u_wdog_count.q <= `AON_TIMER.u_reg.u_wdog_count.q + 32'(edges);
+      end
+      if (`RV_TIMER.active[0] &&
+          64'(`RV_TIMER.gen_harts[0].u_core.tick_count) <= 64'(`RV_TIMER.prescaler[0])) begin
+        count = 64'(`RV_TIMER.gen_harts[0].u_core.tick_count) + edges;
+        `RV_TIMER.gen_harts[0].u_core.tick_count <= 12'(count % (64'(`RV_TIMER.prescaler[0]) + 1));
+        count = `RV_TIMER.mtime[0] +
+                count / (64'(`RV_TIMER.prescaler[0]) + 1) * 64'(`RV_TIMER.step[0]);
+        `RV_TIMER.u_reg.u_timer_v_lower0.q <= count[31:0];
+        `RV_TIMER.u_reg.u_timer_v_upper0.q <= count[63:32];
+      end
+    end
+  end
+
+  `undef RV_TIMER
+  `undef AON_TIMER
   `undef RV_CORE_IBEX
   `undef SIM_SRAM_IF
 
@@ -60,11 +60,11 @@ module padring_verilator
   logic cio_uart_tx_en_d2p;
 
   // SPI device
-  logic cio_spi_device_sck_p2d;
-  logic cio_spi_device_csb_p2d;
-  logic cio_spi_device_sdi_p2d;
-  logic cio_spi_device_sdo_d2p;
-  logic cio_spi_device_sdo_en_d2p;
+  logic       cio_spi_device_sck_p2d;
+  logic       cio_spi_device_csb_p2d;
+  logic [3:0] cio_spi_device_sd_p2d;
+  logic [3:0] cio_spi_device_sd_d2p;
+  logic [3:0] cio_spi_device_sd_en_d2p;
 
   // USB
   logic cio_usbdev_sense_p2d;
@@ -85,7 +85,10 @@ module padring_verilator
     dio_in_o = '0;
     dio_in_o[DioSpiDeviceSck] = cio_spi_device_sck_p2d;
     dio_in_o[DioSpiDeviceCsb] = cio_spi_device_csb_p2d;
-    dio_in_o[DioSpiDeviceSd0] = cio_spi_device_sdi_p2d;
+    dio_in_o[DioSpiDeviceSd0] = cio_spi_device_sd_p2d[0];
+    dio_in_o[DioSpiDeviceSd1] = cio_spi_device_sd_p2d[1];
+    dio_in_o[DioSpiDeviceSd2] = cio_spi_device_sd_p2d[2];
+    dio_in_o[DioSpiDeviceSd3] = cio_spi_device_sd_p2d[3];
     dio_in_o[DioUsbdevUsbDp]  = cio_usbdev_dp_p2d;
     dio_in_o[DioUsbdevUsbDn]  = cio_usbdev_dn_p2d;
   end
@@ -105,8 +108,11 @@ module padring_verilator
   assign cio_usbdev_dn_d2p    = dio_out_i[DioUsbdevUsbDn];
   assign cio_usbdev_dn_en_d2p = dio_oe_i[DioUsbdevUsbDn];
 
-  assign cio_spi_device_sdo_d2p    = dio_out_i[DioSpiDeviceSd1];
-  assign cio_spi_device_sdo_en_d2p = dio_oe_i[DioSpiDeviceSd1];
+  // SPI device data lanes (SD0 is SDI and SD1 is SDO in single mode)
+  assign cio_spi_device_sd_d2p = {dio_out_i[DioSpiDeviceSd3], dio_out_i[DioSpiDeviceSd2],
+                                  dio_out_i[DioSpiDeviceSd1], dio_out_i[DioSpiDeviceSd0]};
+  assign cio_spi_device_sd_en_d2p = {dio_oe_i[DioSpiDeviceSd3], dio_oe_i[DioSpiDeviceSd2],
+                                     dio_oe_i[DioSpiDeviceSd1], dio_oe_i[DioSpiDeviceSd0]};
 
   //////////////////////////////////////////////////////////////////////////
   // Multiplexed I/O mapping                                              //
@@ -133,15 +133,21 @@ module chip_sim_tb (
   // );
 `endif
 
-  // SPI DPI
+  // SPI DPI (single lane only)
+  logic [3:0] spi_device_sd_p2d;
+  logic [2:0] unused_spi_device_sd_p2d;
+  assign cio_spi_device_sdi_p2d   = spi_device_sd_p2d[0];
+  assign unused_spi_device_sd_p2d = spi_device_sd_p2d[3:1];
+
   spidpi u_spi (
     .clk_i  (clk_i),
     .rst_ni (rst_ni),
     .spi_device_sck_o     (cio_spi_device_sck_p2d),
     .spi_device_csb_o     (cio_spi_device_csb_p2d),
-    .spi_device_sdi_o     (cio_spi_device_sdi_p2d),
-    .spi_device_sdo_i     (cio_spi_device_sdo_d2p),
-    .spi_device_sdo_en_i  (cio_spi_device_sdo_en_d2p)
+    .spi_device_sd_o      (spi_device_sd_p2d),
+    .spi_device_sd_en_o   (),
+    .spi_device_sd_i      ({2'b0, cio_spi_device_sdo_d2p, 1'b0}),
+    .spi_device_sd_en_i   ({2'b0, cio_spi_device_sdo_en_d2p, 1'b0})
   );
 
   // USB DPI
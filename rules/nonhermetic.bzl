@@ -30,6 +30,35 @@ This repository provides 3 variables:
 
 Together, these variables attempt to expose the least amount of environment information
 to Bazel rules as possible, thus improves reproducibility and cacheability.
+
+It also provides an `svdpi` cc_library with the DPI header that comes with Verilator, so
+that the C/C++ halves of DPI models can be unit tested without a simulator. The library is
+incompatible with all platforms if Verilator can't be found.
+"""
+
+def _verilator_vltstd(rctx, verilator):
+    """Find the directory that holds Verilator's svdpi.h, or return None."""
+    candidates = []
+    root = rctx.getenv("VERILATOR_ROOT")
+    if root:
+        candidates.append(rctx.path(root + "/include/vltstd"))
+    if verilator != None:
+        prefix = verilator.dirname.dirname
+        candidates.append(prefix.get_child("share/verilator/include/vltstd"))
+        candidates.append(prefix.get_child("include/vltstd"))
+    for candidate in candidates:
+        if candidate.get_child("svdpi.h").exists:
+            return candidate
+    return None
+
+_SVDPI_BUILD = """
+cc_library(
+    name = "svdpi",
+    hdrs = glob(["vltstd/*.h"], allow_empty = True),
+    includes = ["vltstd"],
+    target_compatible_with = {compatible},
+    visibility = ["//visibility:public"],
+)
 """
 
 def _nonhermetic_repo_impl(rctx):
@@ -42,7 +71,14 @@ def _nonhermetic_repo_impl(rctx):
     bin_paths = "\n".join(["    \"{}\": \"{}\",".format(name, rctx.path(path).dirname if path != None else "/no-such-path") for name, path in bins.items()])
 
     rctx.file("env.bzl", "ENV = {{\n{}\n}}\nHOME = \"{}\"\nBIN_PATHS = {{\n{}\n}}\n".format(env, home, bin_paths))
-    rctx.file("BUILD.bazel", "exports_files(glob([\"**\"]))\n")
+
+    vltstd = _verilator_vltstd(rctx, bins["verilator"])
+    if vltstd != None:
+        rctx.symlink(vltstd, "vltstd")
+        compatible = "[]"
+    else:
+        compatible = "[\"@platforms//:incompatible\"]"
+    rctx.file("BUILD.bazel", "exports_files(glob([\"**\"]))\n" + _SVDPI_BUILD.format(compatible = compatible))
 
 nonhermetic_repo = repository_rule(
     implementation = _nonhermetic_repo_impl,
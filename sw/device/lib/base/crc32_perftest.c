@@ -7,19 +7,52 @@
 
 #include "sw/device/lib/base/crc32.h"
 #include "sw/device/lib/base/macros.h"
+
+#ifdef OT_PLATFORM_RV32
+#include "sw/device/lib/arch/device.h"
 #include "sw/device/lib/runtime/ibex.h"
 #include "sw/device/lib/runtime/log.h"
 #include "sw/device/lib/testing/test_framework/check.h"
 #include "sw/device/lib/testing/test_framework/ottf_main.h"
 #include "sw/device/lib/testing/test_framework/ottf_test_config.h"
+#else
+#include <stdio.h>
+#include <time.h>
+#endif
 
-OTTF_DEFINE_TEST_CONFIG();
+/**
+ * Name of the CRC32 implementation selected at build time.
+ */
+#if defined(OT_PLATFORM_RV32)
+static const char kImplName[] = "zbr";
+#elif defined(CRC32_HOST_BITWISE)
+static const char kImplName[] = "bitwise";
+#elif defined(CRC32_HOST_PCLMUL)
+static const char kImplName[] = "pclmul";
+#else
+static const char kImplName[] = "slice8";
+#endif
 
-bool test_main(void) {
-  uint8_t buf[4096];
+enum {
+  /**
+   * Expected CRC32 of `buf` in `fill_buf()`.
+   */
+  kExpectedChecksum = 0xa2912082,
+};
+
+static uint8_t buf[4096];
+
+static void fill_buf(void) {
   for (size_t i = 0; i < ARRAYSIZE(buf); ++i) {
     buf[i] = i & UINT8_MAX;
   }
+}
+
+#ifdef OT_PLATFORM_RV32
+OTTF_DEFINE_TEST_CONFIG();
+
+bool test_main(void) {
+  fill_buf();
 
   const size_t kNumRepetitions = 10;
   for (size_t i = 0; i < kNumRepetitions; ++i) {
@@ -30,9 +63,13 @@ bool test_main(void) {
 
     CHECK(num_cycles <= UINT32_MAX);
     const uint32_t num_cycles_u32 = (uint32_t)num_cycles;
-    LOG_INFO("CRC32 computed in %d cycles.", num_cycles_u32);
+    // Throughput in KB/s, printed as MB/s.
+    const uint64_t kb_per_s =
+        (uint64_t)sizeof(buf) * kClockFreqCpuHz / num_cycles / 1000;
+    LOG_INFO("CRC32 (%s) computed in %d cycles, %d.%03d MB/s.", kImplName,
+             num_cycles_u32, (uint32_t)(kb_per_s / 1000),
+             (uint32_t)(kb_per_s % 1000));
 
-    const uint32_t kExpectedChecksum = 0xa2912082;
     if (checksum != kExpectedChecksum) {
       LOG_ERROR("Checksum did not match. Expected %x, but got %x.",
                 kExpectedChecksum, checksum);
@@ -41,3 +78,35 @@ bool test_main(void) {
   }
   return true;
 }
+#else
+int main(void) {
+  fill_buf();
+  uint32_t checksum = crc32(buf, sizeof(buf));
+  if (checksum != kExpectedChecksum) {
+    fprintf(stderr, "Checksum did not match. Expected %x, but got %x.\n",
+            kExpectedChecksum, checksum);
+    return 1;
+  }
+
+  // Hash 256 MiB in total, which takes long enough to time with the wall
+  // clock.
+  const size_t kNumRepetitions = (256u << 20) / sizeof(buf);
+  struct timespec start, end;
+  timespec_get(&start, TIME_UTC);
+  uint32_t ctx;
+  crc32_init(&ctx);
+  for (size_t i = 0; i < kNumRepetitions; ++i) {
+    crc32_add(&ctx, buf, sizeof(buf));
+  }
+  timespec_get(&end, TIME_UTC);
+  // Keep the compiler from discarding the computation.
+  volatile uint32_t result = crc32_finish(&ctx);
+  OT_DISCARD(result);
+
+  double seconds = (double)(end.tv_sec - start.tv_sec) +
+                   (double)(end.tv_nsec - start.tv_nsec) / 1e9;
+  double megabytes = (double)kNumRepetitions * sizeof(buf) / 1e6;
+  printf("CRC32 (%s): %.1f MB/s\n", kImplName, megabytes / seconds);
+  return 0;
+}
+#endif
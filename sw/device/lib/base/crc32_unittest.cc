@@ -87,5 +87,25 @@ TEST_F(CrcTest, Crc32Add32) {
   EXPECT_EQ(crc32_finish(&ctx), kExpCrc);
 }
 
+// Long enough to go through the bulk paths of the host implementations.
+TEST_F(CrcTest, LongBuffer) {
+  alignas(uint64_t) uint8_t input[4096];
+  for (size_t i = 0; i < sizeof(input); ++i) {
+    input[i] = i & UINT8_MAX;
+  }
+
+  EXPECT_EQ(crc32(input, sizeof(input)), 0xa2912082);
+  EXPECT_EQ(crc32(&input[3], 3997), 0xdf97f773);
+
+  // Any split into pieces must give the same result.
+  for (size_t split = 0; split < 200; ++split) {
+    uint32_t ctx;
+    crc32_init(&ctx);
+    crc32_add(&ctx, &input[3], split);
+    crc32_add(&ctx, &input[3 + split], 3997 - split);
+    EXPECT_EQ(crc32_finish(&ctx), 0xdf97f773) << "split = " << split;
+  }
+}
+
 }  // namespace
 }  // namespace crc32_unittest
@@ -351,6 +351,44 @@ status_t aes_end(aes_block_t *iv) {
   return spin_until(AES_STATUS_IDLE_BIT);
 }
 
+status_t aes_ctr_check(const aes_key_t key, const aes_block_t *iv,
+                       const aes_block_t *input, const aes_block_t *output,
+                       size_t num_blocks) {
+  if (key.mode != kAesCipherModeCtr) {
+    return OTCRYPTO_BAD_ARGS;
+  }
+
+  HARDENED_TRY(aes_decrypt_begin(key, iv));
+
+  // Put the first two blocks in, so that the hardware can start on the next
+  // block as soon as we read each output.
+  size_t in = 0;
+  for (; in < num_blocks && in < 2; ++in) {
+    HARDENED_TRY(aes_update(/*dest=*/NULL, &output[in]));
+  }
+
+  size_t i = 0;
+  for (; launder32(i) < num_blocks; ++i) {
+    aes_block_t recovered;
+    HARDENED_TRY(aes_update(&recovered, /*src=*/NULL));
+    if (in < num_blocks) {
+      HARDENED_TRY(aes_update(/*dest=*/NULL, &output[in]));
+      ++in;
+    }
+    HARDENED_CHECK_EQ(hardened_memeq(recovered.data, input[i].data,
+                                     kAesBlockNumWords),
+                      kHardenedBoolTrue);
+  }
+  HARDENED_CHECK_EQ(i, num_blocks);
+  HARDENED_CHECK_EQ(in, num_blocks);
+
+  // Verify the CTRL and CTRL_AUX registers of the decryption.
+  HARDENED_TRY(aes_verify_ctrl_reg(key, kHardenedBoolFalse));
+  HARDENED_TRY(aes_verify_ctrl_aux_reg());
+
+  return aes_end(NULL);
+}
+
 status_t aes_clear(void) {
   uint32_t trigger_reg = 0;
   trigger_reg = bitfield_bit32_write(
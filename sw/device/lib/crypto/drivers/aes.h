@@ -161,6 +161,19 @@ status_t aes_decrypt_begin(const aes_key_t key, const aes_block_t *iv);
  * aes_end(...);
  * ```
  *
+ * The hardware can hold the next input block while it works on the current
+ * one. To keep it busy, a caller can put two blocks in before reading the first
+ * output, so that the hardware starts on the next block as soon as each output
+ * is read and the caller can work on that output in the meantime:
+ * ```
+ * aes_update(NULL, input0);
+ * aes_update(NULL, input1);
+ * aes_update(output0, NULL);
+ * aes_update(NULL, input2);
+ * // ...
+ * aes_update(outputN, NULL);
+ * ```
+ *
  * @param dest The output block.
  * @param src The input block.
  * @return The result of the operation.
@@ -168,6 +181,30 @@ status_t aes_decrypt_begin(const aes_key_t key, const aes_block_t *iv);
 OT_WARN_UNUSED_RESULT
 status_t aes_update(aes_block_t *dest, const aes_block_t *src);
 
+/**
+ * Checks a run of CTR-mode blocks by running them back through the hardware.
+ *
+ * Starts a new decryption session with the same key and IV, feeds `output` in
+ * and compares each block that comes out against the corresponding block of
+ * `input` as soon as it is read, keeping two blocks in flight. The session is
+ * ended before returning. This is the streaming form of the decrypt-and-compare
+ * check that protects single-block encryptions against fault injection.
+ *
+ * Must not be called while another AES session is in progress. `key.mode` must
+ * be `kAesCipherModeCtr`.
+ *
+ * @param key AES key used to produce `output`.
+ * @param iv Counter block that was used for the first block.
+ * @param input Blocks that were fed to the hardware.
+ * @param output Blocks that the hardware produced.
+ * @param num_blocks Number of blocks in `input` and `output`.
+ * @return The result of the operation.
+ */
+OT_WARN_UNUSED_RESULT
+status_t aes_ctr_check(const aes_key_t key, const aes_block_t *iv,
+                       const aes_block_t *input, const aes_block_t *output,
+                       size_t num_blocks);
+
 /**
  * Completes an AES session by clearing control settings and key material.
  *
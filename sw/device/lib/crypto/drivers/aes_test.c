@@ -109,6 +109,9 @@ static status_t run_aes_test(void) {
 
   CHECK_ARRAYS_EQ(final_iv.data, kFinalIv.data, kAesBlockNumWords);
 
+  LOG_INFO("Checking the ciphertext by decrypting it again.");
+  TRY(aes_ctr_check(key, &kIv, kPlaintext, ciphertext, ARRAYSIZE(kPlaintext)));
+
   return OTCRYPTO_OK;
 }
 
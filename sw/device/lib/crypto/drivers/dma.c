@@ -0,0 +1,124 @@
+// Copyright lowRISC contributors (OpenTitan project).
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+
+#include "sw/device/lib/crypto/drivers/dma.h"
+
+#include "hw/top/dt/dma.h"
+#include "sw/device/lib/base/abs_mmio.h"
+#include "sw/device/lib/base/bitfield.h"
+#include "sw/device/lib/base/hardened.h"
+#include "sw/device/lib/base/memory.h"
+#include "sw/device/lib/base/multibits.h"
+#include "sw/device/lib/crypto/impl/status.h"
+
+#include "hw/top/dma_regs.h"  // Generated.
+
+// Module ID for status codes.
+#define MODULE_ID MAKE_MODULE_ID('d', 'd', 'm')
+
+static const dt_dma_t kDmaDt = kDtDma;
+
+static inline uint32_t dma_base(void) {
+  return dt_dma_primary_reg_block(kDmaDt);
+}
+
+/**
+ * All the write-one-to-clear bits of the `STATUS` register.
+ */
+static const uint32_t kDmaStatusClearMask =
+    (1u << DMA_STATUS_DONE_BIT) | (1u << DMA_STATUS_ABORTED_BIT) |
+    (1u << DMA_STATUS_ERROR_BIT) | (1u << DMA_STATUS_CHUNK_DONE_BIT);
+
+/**
+ * Whether the system software has allowed the cryptolib to use the DMA.
+ */
+static hardened_bool_t dma_use = kHardenedBoolFalse;
+
+void dma_use_set(hardened_bool_t use) { dma_use = use; }
+
+hardened_bool_t dma_available(void) {
+  if (launder32(dma_use) != kHardenedBoolTrue) {
+    return kHardenedBoolFalse;
+  }
+  const uint32_t kBase = dma_base();
+  uint32_t status = abs_mmio_read32(kBase + DMA_STATUS_REG_OFFSET);
+  if (bitfield_bit32_read(status, DMA_STATUS_BUSY_BIT)) {
+    return kHardenedBoolFalse;
+  }
+  uint32_t cfg_regwen = abs_mmio_read32(kBase + DMA_CFG_REGWEN_REG_OFFSET);
+  if (cfg_regwen != kMultiBitBool4True) {
+    return kHardenedBoolFalse;
+  }
+  uint32_t range_valid = abs_mmio_read32(kBase + DMA_RANGE_VALID_REG_OFFSET);
+  if (!bitfield_bit32_read(range_valid, DMA_RANGE_VALID_RANGE_VALID_BIT)) {
+    return kHardenedBoolFalse;
+  }
+  return kHardenedBoolTrue;
+}
+
+status_t dma_fifo_write(const uint32_t *src, uint32_t fifo_addr, size_t len) {
+  if (len == 0 || misalignment32_of(len) != 0 ||
+      misalignment32_of((uintptr_t)src) != 0 ||
+      misalignment32_of(fifo_addr) != 0) {
+    return OTCRYPTO_BAD_ARGS;
+  }
+  const uint32_t kBase = dma_base();
+  uint32_t src_addr = (uint32_t)(uintptr_t)src;
+
+  // Both ends are on the internal bus, whose addresses are 32 bits wide.
+  abs_mmio_write32(kBase + DMA_SRC_ADDR_LO_REG_OFFSET, src_addr);
+  abs_mmio_write32(kBase + DMA_SRC_ADDR_HI_REG_OFFSET, 0);
+  abs_mmio_write32(kBase + DMA_DST_ADDR_LO_REG_OFFSET, fifo_addr);
+  abs_mmio_write32(kBase + DMA_DST_ADDR_HI_REG_OFFSET, 0);
+  uint32_t reg = 0;
+  reg = bitfield_field32_write(reg, DMA_ADDR_SPACE_ID_SRC_ASID_FIELD,
+                               DMA_ADDR_SPACE_ID_SRC_ASID_VALUE_OT_ADDR);
+  reg = bitfield_field32_write(reg, DMA_ADDR_SPACE_ID_DST_ASID_FIELD,
+                               DMA_ADDR_SPACE_ID_DST_ASID_VALUE_OT_ADDR);
+  abs_mmio_write32(kBase + DMA_ADDR_SPACE_ID_REG_OFFSET, reg);
+
+  // Walk through the source but keep writing the same FIFO address.
+  reg = bitfield_bit32_write(0, DMA_SRC_CONFIG_INCREMENT_BIT, true);
+  abs_mmio_write32(kBase + DMA_SRC_CONFIG_REG_OFFSET, reg);
+  abs_mmio_write32(kBase + DMA_DST_CONFIG_REG_OFFSET, 0);
+
+  // Move the whole buffer as a single chunk of 32-bit transactions.
+  abs_mmio_write32(kBase + DMA_TOTAL_DATA_SIZE_REG_OFFSET, len);
+  abs_mmio_write32(kBase + DMA_CHUNK_DATA_SIZE_REG_OFFSET, len);
+  abs_mmio_write32(kBase + DMA_TRANSFER_WIDTH_REG_OFFSET,
+                   DMA_TRANSFER_WIDTH_TRANSACTION_WIDTH_VALUE_FOUR_BYTE);
+
+  // Check that the transfer is set up as intended before starting it.
+  HARDENED_CHECK_EQ(abs_mmio_read32(kBase + DMA_SRC_ADDR_LO_REG_OFFSET),
+                    src_addr);
+  HARDENED_CHECK_EQ(abs_mmio_read32(kBase + DMA_DST_ADDR_LO_REG_OFFSET),
+                    fifo_addr);
+  HARDENED_CHECK_EQ(abs_mmio_read32(kBase + DMA_TOTAL_DATA_SIZE_REG_OFFSET),
+                    len);
+
+  abs_mmio_write32(kBase + DMA_STATUS_REG_OFFSET, kDmaStatusClearMask);
+  reg = 0;
+  reg = bitfield_field32_write(reg, DMA_CONTROL_OPCODE_FIELD,
+                               DMA_CONTROL_OPCODE_VALUE_COPY);
+  reg = bitfield_bit32_write(reg, DMA_CONTROL_INITIAL_TRANSFER_BIT, true);
+  reg = bitfield_bit32_write(reg, DMA_CONTROL_GO_BIT, true);
+  abs_mmio_write32(kBase + DMA_CONTROL_REG_OFFSET, reg);
+
+  status_t result = OTCRYPTO_OK;
+  while (true) {
+    uint32_t status = abs_mmio_read32(kBase + DMA_STATUS_REG_OFFSET);
+    if (bitfield_bit32_read(status, DMA_STATUS_ERROR_BIT) ||
+        bitfield_bit32_read(status, DMA_STATUS_ABORTED_BIT)) {
+      result = OTCRYPTO_RECOV_ERR;
+      break;
+    }
+    if (bitfield_bit32_read(status, DMA_STATUS_DONE_BIT)) {
+      break;
+    }
+  }
+
+  // Leave the DMA idle and without pending status for the next user.
+  abs_mmio_write32(kBase + DMA_STATUS_REG_OFFSET, kDmaStatusClearMask);
+  return result;
+}
@@ -0,0 +1,76 @@
+// Copyright lowRISC contributors (OpenTitan project).
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef OPENTITAN_SW_DEVICE_LIB_CRYPTO_DRIVERS_DMA_H_
+#define OPENTITAN_SW_DEVICE_LIB_CRYPTO_DRIVERS_DMA_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "sw/device/lib/base/hardened.h"
+#include "sw/device/lib/base/macros.h"
+#include "sw/device/lib/crypto/impl/status.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum {
+  /**
+   * Smallest transfer for which `dma_fifo_write` is worth its setup cost.
+   *
+   * Programming and polling the DMA takes about as many bus accesses as
+   * writing this many bytes with Ibex, so callers should write shorter
+   * messages themselves.
+   */
+  kDmaFifoWriteMinBytes = 64,
+};
+
+/**
+ * Allow or forbid the cryptolib to use the DMA.
+ *
+ * The DMA is shared with the rest of the system, so the cryptolib leaves it
+ * alone until the system software opts in with this call. Use is forbidden
+ * after reset.
+ *
+ * @param use kHardenedBoolTrue to allow use of the DMA.
+ */
+void dma_use_set(hardened_bool_t use);
+
+/**
+ * Check whether the DMA can be used by the cryptolib right now.
+ *
+ * The DMA is only taken if use has been allowed with `dma_use_set`, it is
+ * idle and its configuration is not locked. The DMA also refuses every
+ * transfer until the enabled memory range has been configured and marked
+ * valid, which is up to the system software.
+ *
+ * @return kHardenedBoolTrue if `dma_fifo_write` may be called.
+ */
+OT_WARN_UNUSED_RESULT
+hardened_bool_t dma_available(void);
+
+/**
+ * Copy a buffer into a FIFO window with the DMA and wait until it is done.
+ *
+ * The source address is incremented and the destination address is not, so
+ * every word lands in the register at `fifo_addr`. The DMA issues 32-bit
+ * writes and relies on the FIFO stalling the bus while it is full.
+ *
+ * Both addresses are on the OpenTitan internal bus. The caller must check
+ * `dma_available` first.
+ *
+ * @param src Source buffer, 32-bit aligned.
+ * @param fifo_addr Address of the FIFO window.
+ * @param len Number of bytes to copy, a non-zero multiple of 4.
+ * @return Result of the operation.
+ */
+OT_WARN_UNUSED_RESULT
+status_t dma_fifo_write(const uint32_t *src, uint32_t fifo_addr, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // OPENTITAN_SW_DEVICE_LIB_CRYPTO_DRIVERS_DMA_H_
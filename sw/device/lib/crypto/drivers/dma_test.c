@@ -0,0 +1,129 @@
+// Copyright lowRISC contributors (OpenTitan project).
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+
+#include "sw/device/lib/crypto/drivers/dma.h"
+
+#include "hw/top/dt/dma.h"
+#include "sw/device/lib/base/abs_mmio.h"
+#include "sw/device/lib/crypto/drivers/entropy.h"
+#include "sw/device/lib/crypto/drivers/hmac.h"
+#include "sw/device/lib/crypto/drivers/kmac.h"
+#include "sw/device/lib/crypto/impl/status.h"
+#include "sw/device/lib/dif/dif_dma.h"
+#include "sw/device/lib/runtime/log.h"
+#include "sw/device/lib/testing/test_framework/check.h"
+#include "sw/device/lib/testing/test_framework/ottf_main.h"
+
+#include "hw/top/dma_regs.h"  // Generated.
+
+#define MODULE_ID MAKE_MODULE_ID('t', 's', 't')
+
+OTTF_DEFINE_TEST_CONFIG();
+
+enum {
+  /**
+   * Length of the test message in bytes.
+   *
+   * Long enough for the DMA path, and not a multiple of 4 so that the
+   * drivers also have to write an unaligned tail.
+   */
+  kMessageLen = 1021,
+};
+
+/**
+ * Test message storage.
+ *
+ * The message starts one byte in, so the drivers also have to write an
+ * unaligned head.
+ */
+static uint32_t message_data[(kMessageLen + 1 + 3) / 4];
+
+static dif_dma_t dma;
+
+static otcrypto_const_byte_buf_t message(void) {
+  return OTCRYPTO_MAKE_BUF(otcrypto_const_byte_buf_t,
+                           (const uint8_t *)message_data + 1, kMessageLen);
+}
+
+/**
+ * Clear the DMA source address, so `dma_used` can tell whether the next
+ * operation went through the DMA.
+ */
+static void dma_src_clear(void) {
+  abs_mmio_write32(dt_dma_primary_reg_block(kDtDma) +
+                       DMA_SRC_ADDR_LO_REG_OFFSET,
+                   0);
+}
+
+/**
+ * Check whether the last DMA transfer read from the test message.
+ */
+static bool dma_used(void) {
+  uint32_t src = abs_mmio_read32(dt_dma_primary_reg_block(kDtDma) +
+                                 DMA_SRC_ADDR_LO_REG_OFFSET);
+  uint32_t start = (uint32_t)(uintptr_t)message_data;
+  return src >= start && src < start + sizeof(message_data);
+}
+
+static status_t hmac_dma_test(void) {
+  LOG_INFO("Comparing HMAC-SHA256 digests with and without the DMA.");
+  otcrypto_const_byte_buf_t msg = message();
+
+  uint32_t ibex_digest[8];
+  dma_use_set(kHardenedBoolFalse);
+  dma_src_clear();
+  TRY(hmac_hash_sha256(&msg, ibex_digest));
+  TRY_CHECK(!dma_used());
+
+  uint32_t dma_digest[8];
+  dma_use_set(kHardenedBoolTrue);
+  TRY(hmac_hash_sha256(&msg, dma_digest));
+  dma_use_set(kHardenedBoolFalse);
+  TRY_CHECK(dma_used());
+
+  TRY_CHECK_ARRAYS_EQ(dma_digest, ibex_digest, ARRAYSIZE(ibex_digest));
+  return OTCRYPTO_OK;
+}
+
+static status_t kmac_dma_test(void) {
+  LOG_INFO("Comparing SHA3-256 digests with and without the DMA.");
+  TRY(kmac_hwip_default_configure());
+  otcrypto_const_byte_buf_t msg = message();
+
+  uint32_t ibex_digest[8];
+  dma_use_set(kHardenedBoolFalse);
+  dma_src_clear();
+  TRY(kmac_sha3_256(&msg, ibex_digest));
+  TRY_CHECK(!dma_used());
+
+  uint32_t dma_digest[8];
+  dma_use_set(kHardenedBoolTrue);
+  TRY(kmac_sha3_256(&msg, dma_digest));
+  dma_use_set(kHardenedBoolFalse);
+  TRY_CHECK(dma_used());
+
+  TRY_CHECK_ARRAYS_EQ(dma_digest, ibex_digest, ARRAYSIZE(ibex_digest));
+  return OTCRYPTO_OK;
+}
+
+bool test_main(void) {
+  status_t result = OK_STATUS();
+
+  CHECK_STATUS_OK(entropy_complex_init(kHardenedBoolFalse));
+
+  // The DMA refuses all transfers until its enabled memory range is valid.
+  CHECK_DIF_OK(dif_dma_init_from_dt(kDtDma, &dma));
+  CHECK_DIF_OK(dif_dma_memory_range_set(&dma, (uint32_t)message_data,
+                                        sizeof(message_data)));
+
+  uint8_t *bytes = (uint8_t *)message_data;
+  for (size_t i = 0; i < sizeof(message_data); i++) {
+    bytes[i] = (uint8_t)(i * 7 + 1);
+  }
+
+  EXECUTE_TEST(result, hmac_dma_test);
+  EXECUTE_TEST(result, kmac_dma_test);
+
+  return status_ok(result);
+}
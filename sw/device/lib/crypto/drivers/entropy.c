@@ -26,6 +26,15 @@ static const dt_entropy_src_t kEntropySrcDt = kDtEntropySrc;
 static const dt_edn_t kEdn0Dt = kDtEdn0;
 static const dt_edn_t kEdn1Dt = kDtEdn1;
 
+/**
+ * Number of times the state of the SW CSRNG instance has been replaced.
+ *
+ * Incremented by every command that instantiates, reseeds, updates or
+ * uninstantiates the instance, and whenever the CSRNG is disabled. See
+ * `entropy_csrng_generation()`.
+ */
+static uint32_t csrng_generation = 0;
+
 static inline uint32_t csrng_base(void) {
   return dt_csrng_primary_reg_block(kCsrngDt);
 }
@@ -779,6 +788,7 @@ static void entropy_complex_stop_all(void) {
   edn_stop(edn0_base());
   edn_stop(edn1_base());
   abs_mmio_write32(csrng_base() + CSRNG_CTRL_REG_OFFSET, CSRNG_CTRL_REG_RESVAL);
+  csrng_generation++;
   entropy_src_stop();
 }
 
@@ -1188,6 +1198,7 @@ status_t entropy_complex_health_test_config_check(hardened_bool_t fips) {
 status_t entropy_csrng_instantiate(
     hardened_bool_t disable_trng_input,
     const entropy_seed_material_t *seed_material) {
+  csrng_generation++;
   return csrng_send_app_cmd(csrng_base(),
                             (entropy_csrng_cmd_t){
                                 .id = kEntropyDrbgOpInstantiate,
@@ -1200,6 +1211,7 @@ status_t entropy_csrng_instantiate(
 
 status_t entropy_csrng_reseed(hardened_bool_t disable_trng_input,
                               const entropy_seed_material_t *seed_material) {
+  csrng_generation++;
   return csrng_send_app_cmd(csrng_base(),
                             (entropy_csrng_cmd_t){
                                 .id = kEntropyDrbgOpReseed,
@@ -1211,6 +1223,7 @@ status_t entropy_csrng_reseed(hardened_bool_t disable_trng_input,
 }
 
 status_t entropy_csrng_update(const entropy_seed_material_t *seed_material) {
+  csrng_generation++;
   return csrng_send_app_cmd(csrng_base(),
                             (entropy_csrng_cmd_t){
                                 .id = kEntropyDrbgOpUpdate,
@@ -1290,6 +1303,7 @@ status_t entropy_csrng_generate(const entropy_seed_material_t *seed_material,
 }
 
 status_t entropy_csrng_uninstantiate(void) {
+  csrng_generation++;
   return csrng_send_app_cmd(csrng_base(),
                             (entropy_csrng_cmd_t){
                                 .id = kEntropyDrbgOpUninstantiate,
@@ -1298,3 +1312,5 @@ status_t entropy_csrng_uninstantiate(void) {
                             },
                             kEntropyCsrngSendAppCmdTypeCsrng, true);
 }
+
+uint32_t entropy_csrng_generation(void) { return csrng_generation; }
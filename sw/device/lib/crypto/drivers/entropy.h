@@ -237,6 +237,18 @@ status_t entropy_csrng_generate(const entropy_seed_material_t *seed_material,
 OT_WARN_UNUSED_RESULT
 status_t entropy_csrng_uninstantiate(void);
 
+/**
+ * Get the generation of the SW CSRNG state.
+ *
+ * The value changes every time the SW CSRNG instance is instantiated,
+ * reseeded, updated or uninstantiated, or the CSRNG is disabled. Callers that
+ * buffer CSRNG output can compare it with the value recorded when the buffer
+ * was filled to tell whether the buffered output is from an earlier state.
+ *
+ * @return Current generation of the SW CSRNG state.
+ */
+uint32_t entropy_csrng_generation(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -17,6 +17,10 @@
 
 #include "hw/top/hmac_regs.h"  // Generated.
 
+#ifdef HAS_DMA
+#include "sw/device/lib/crypto/drivers/dma.h"
+#endif
+
 // Module ID for status codes.
 #define MODULE_ID MAKE_MODULE_ID('d', 'h', 'm')
 
@@ -337,6 +341,18 @@ static status_t msg_fifo_write(const uint8_t *message, size_t message_len) {
     abs_mmio_write8(kBase + HMAC_MSG_FIFO_REG_OFFSET, message[i]);
   }
 
+#ifdef HAS_DMA
+  // Hand the aligned middle of long messages to the DMA. The FIFO stalls the
+  // bus while it is full, so the DMA runs at the rate HMAC absorbs words.
+  size_t dma_len = (message_len - i) & ~(sizeof(uint32_t) - 1);
+  if (dma_len >= kDmaFifoWriteMinBytes &&
+      dma_available() == kHardenedBoolTrue) {
+    HARDENED_TRY(dma_fifo_write((const uint32_t *)&message[i],
+                                kBase + HMAC_MSG_FIFO_REG_OFFSET, dma_len));
+    i += dma_len;
+  }
+#endif
+
   // Write one word at a time as long as there is a full word available.
   for (; launder32(i + sizeof(uint32_t)) <= message_len;
        i += sizeof(uint32_t)) {
@@ -843,6 +859,131 @@ status_t hmac_update(hmac_ctx_t *ctx, const otcrypto_const_byte_buf_t *data) {
   return OTCRYPTO_OK;
 }
 
+/**
+ * Feed all queued updates for one stream to the hardware.
+ *
+ * Handles the entries of `updates` from index `first` on that refer to the
+ * same context as `updates[first]`. Full blocks are fed with a single
+ * restore/save of the context and the remaining bytes are kept in its partial
+ * block.
+ *
+ * @param updates Queue of updates.
+ * @param num_updates Number of entries in `updates`.
+ * @param first Index of the first update for the stream.
+ * @return Result of the operation.
+ */
+OT_WARN_UNUSED_RESULT
+static status_t stream_flush(const hmac_stream_update_t *updates,
+                             size_t num_updates, size_t first) {
+  hmac_ctx_t *ctx = updates[first].ctx;
+  size_t block_bytelen = ctx->msg_block_wordlen * sizeof(uint32_t);
+
+  // Count the new bytes and work out how many will be left over once all
+  // complete blocks are fed. As in `hmac_update`, reduce each length modulo
+  // the block length before adding it to the partial length.
+  size_t new_len = 0;
+  size_t leftover_len = ctx->partial_block_bytelen;
+  for (size_t i = first; i < num_updates; i++) {
+    if (updates[i].ctx != ctx) {
+      continue;
+    }
+    size_t len = updates[i].data->len;
+    if (len > SIZE_MAX - new_len) {
+      return OTCRYPTO_BAD_ARGS;
+    }
+    new_len += len;
+    leftover_len = (leftover_len + len % block_bytelen) % block_bytelen;
+  }
+
+  // If the stream still has no complete block, only buffer the new bytes.
+  if (new_len < block_bytelen - ctx->partial_block_bytelen) {
+    for (size_t i = first; i < num_updates; i++) {
+      if (updates[i].ctx != ctx) {
+        continue;
+      }
+      const otcrypto_const_byte_buf_t *data = updates[i].data;
+      memcpy((unsigned char *)(ctx->partial_block) +
+                 ctx->partial_block_bytelen,
+             data->data, data->len);
+      ctx->partial_block_bytelen += data->len;
+      HARDENED_CHECK_EQ(kHardenedBoolTrue, OTCRYPTO_CHECK_BUF(data));
+    }
+    return OTCRYPTO_OK;
+  }
+
+  // Since at least one block is complete, all bytes of the old partial block
+  // are fed and the leftover bytes come from the new data only.
+  HARDENED_CHECK_LE(leftover_len, new_len);
+  HARDENED_TRY(context_restore(ctx));
+  HARDENED_TRY(msg_fifo_write((unsigned char *)ctx->partial_block,
+                              ctx->partial_block_bytelen));
+  size_t feed_len = new_len - leftover_len;
+  for (size_t i = first; i < num_updates; i++) {
+    if (updates[i].ctx != ctx) {
+      continue;
+    }
+    const otcrypto_const_byte_buf_t *data = updates[i].data;
+    size_t len = data->len < feed_len ? data->len : feed_len;
+    HARDENED_TRY(msg_fifo_write(data->data, len));
+    feed_len -= len;
+  }
+  HARDENED_CHECK_EQ(feed_len, 0);
+
+  // Send the STOP command.
+  uint32_t cmd =
+      bitfield_bit32_write(HMAC_CMD_REG_RESVAL, HMAC_CMD_HASH_STOP_BIT, 1);
+  abs_mmio_write32(hmac_base() + HMAC_CMD_REG_OFFSET, cmd);
+
+  // Wait for HMAC to be done, then store the context.
+  HARDENED_TRY(hmac_idle_wait());
+  HARDENED_TRY(context_save(ctx));
+
+  // Collect the bytes that were not fed into the partial block. They are the
+  // tail of the concatenated updates, which may span several entries.
+  feed_len = new_len - leftover_len;
+  ctx->partial_block_bytelen = 0;
+  for (size_t i = first; i < num_updates; i++) {
+    if (updates[i].ctx != ctx) {
+      continue;
+    }
+    const otcrypto_const_byte_buf_t *data = updates[i].data;
+    size_t len = data->len < feed_len ? data->len : feed_len;
+    memcpy((unsigned char *)(ctx->partial_block) + ctx->partial_block_bytelen,
+           data->data + len, data->len - len);
+    ctx->partial_block_bytelen += data->len - len;
+    feed_len -= len;
+    HARDENED_CHECK_EQ(kHardenedBoolTrue, OTCRYPTO_CHECK_BUF(data));
+  }
+  HARDENED_CHECK_EQ(ctx->partial_block_bytelen, leftover_len);
+
+  return OTCRYPTO_OK;
+}
+
+status_t hmac_update_multistream(const hmac_stream_update_t *updates,
+                                 size_t num_updates) {
+  uint32_t hw_cleanup_guard __attribute__((cleanup(hmac_wipe_guard))) = 1;
+  barrier32(hw_cleanup_guard);
+
+  // Handle the streams in the order in which they first appear in the queue.
+  // Each stream is flushed once, together with all of its later updates.
+  size_t i = 0;
+  for (; launder32(i) < num_updates; i++) {
+    bool seen = false;
+    for (size_t j = 0; j < i; j++) {
+      if (updates[j].ctx == updates[i].ctx) {
+        seen = true;
+        break;
+      }
+    }
+    if (!seen) {
+      HARDENED_TRY(stream_flush(updates, num_updates, i));
+    }
+  }
+  HARDENED_CHECK_EQ(i, num_updates);
+
+  return OTCRYPTO_OK;
+}
+
 status_t hmac_final(hmac_ctx_t *ctx, otcrypto_word32_buf_t *digest) {
   uint32_t hw_cleanup_guard __attribute__((cleanup(hmac_wipe_guard))) = 1;
   barrier32(hw_cleanup_guard);
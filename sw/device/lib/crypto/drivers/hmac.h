@@ -427,6 +427,38 @@ hardened_bool_t hmac_key_integrity_checksum_check(const hmac_key_t *key);
 OT_WARN_UNUSED_RESULT
 status_t hmac_update(hmac_ctx_t *ctx, const otcrypto_const_byte_buf_t *data);
 
+/**
+ * A queued message update for one of several concurrent streams.
+ */
+typedef struct hmac_stream_update {
+  // Context of the stream to update.
+  hmac_ctx_t *ctx;
+  // Incoming message bytes for that stream.
+  const otcrypto_const_byte_buf_t *data;
+} hmac_stream_update_t;
+
+/**
+ * Update several SHA-2/HMAC streams with a queue of message data.
+ *
+ * Updates for different contexts may be interleaved in `updates`; the updates
+ * for each context are applied in the order in which they appear. The result
+ * is the same as calling `hmac_update` for every entry in turn, but the
+ * hardware is used far less:
+ *
+ * - All queued bytes for a context are fed in one go, so each context is
+ *   restored and saved at most once per call.
+ * - Bytes that do not complete a message block are only buffered in the
+ *   context, so a context whose queued bytes do not fill its partial block is
+ *   not loaded into the hardware at all.
+ *
+ * @param updates Queue of updates.
+ * @param num_updates Number of entries in `updates`.
+ * @return OK or error.
+ */
+OT_WARN_UNUSED_RESULT
+status_t hmac_update_multistream(const hmac_stream_update_t *updates,
+                                 size_t num_updates);
+
 /**
  * Finalize the SHA-2/HMAC stream and return the digest/tag.
  *
@@ -17,6 +17,10 @@
 
 #include "hw/top/kmac_regs.h"  // Generated.
 
+#ifdef HAS_DMA
+#include "sw/device/lib/crypto/drivers/dma.h"
+#endif
+
 // Module ID for status codes.
 #define MODULE_ID MAKE_MODULE_ID('d', 'k', 'c')
 
@@ -664,6 +668,18 @@ static status_t kmac_msg_fifo_write(const otcrypto_const_byte_buf_t *message) {
     abs_mmio_write8(kBase + KMAC_MSG_FIFO_REG_OFFSET, message->data[i]);
   }
 
+#ifdef HAS_DMA
+  // Hand the aligned middle of long messages to the DMA. The FIFO stalls the
+  // bus while it is full, so there is no need to poll `FIFO_FULL` here.
+  size_t dma_len = (message->len - i) & ~(sizeof(uint32_t) - 1);
+  if (dma_len >= kDmaFifoWriteMinBytes &&
+      dma_available() == kHardenedBoolTrue) {
+    HARDENED_TRY(dma_fifo_write((const uint32_t *)&message->data[i],
+                                kBase + KMAC_MSG_FIFO_REG_OFFSET, dma_len));
+    i += dma_len;
+  }
+#endif
+
   // Write one word at a time as long as there is a full word available.
   for (; i + sizeof(uint32_t) <= message->len; i += sizeof(uint32_t)) {
     HARDENED_TRY(wait_status_bit(KMAC_STATUS_FIFO_FULL_BIT, 0));
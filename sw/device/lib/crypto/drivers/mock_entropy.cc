@@ -61,5 +61,7 @@ status_t entropy_csrng_generate(const entropy_seed_material_t *seed_material,
 }
 
 status_t entropy_csrng_uninstantiate(void) { return OTCRYPTO_OK; }
+
+uint32_t entropy_csrng_generation(void) { return 0; }
 }
 }  // namespace test
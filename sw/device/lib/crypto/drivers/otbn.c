@@ -67,6 +67,112 @@ typedef enum otbn_status {
   kOtbnStatusLocked = 0xFF,
 } otbn_status_t;
 
+/**
+ * The application that is resident in OTBN.
+ *
+ * The LOAD_CHECKSUM register accumulates a CRC32 over every write that Ibex
+ * makes to IMEM or DMEM. When the driver loads an app, it resets the register
+ * and checks that it ends up at the app's checksum. After that, each driver
+ * function that writes to OTBN memory continues the CRC over its own writes
+ * and records the result in `load_checksum`. If the register still matches
+ * that value when the same app is loaded again, nothing but the driver has
+ * written to OTBN memory since the app was loaded, so IMEM still holds the
+ * app and only DMEM needs to be reloaded.
+ *
+ * Code outside this driver must not write to or wipe OTBN memory without
+ * calling `otbn_app_forget()`.
+ */
+static struct {
+  /**
+   * Whether `app_checksum` describes the contents of IMEM.
+   */
+  hardened_bool_t valid;
+  /**
+   * Start of the compressed IMEM payload of the resident app.
+   */
+  const uint8_t *imem_compressed_start;
+  /**
+   * Checksum of the resident app.
+   */
+  uint32_t app_checksum;
+  /**
+   * Expected value of LOAD_CHECKSUM after the driver's last write.
+   */
+  uint32_t load_checksum;
+} otbn_resident = {.valid = kHardenedBoolFalse};
+
+void otbn_app_forget(void) {
+  otbn_resident.valid = kHardenedBoolFalse;
+  otbn_resident.imem_compressed_start = NULL;
+  otbn_resident.app_checksum = 0;
+  otbn_resident.load_checksum = 0;
+}
+
+/**
+ * Starts a CRC over some writes to OTBN memory.
+ *
+ * If LOAD_CHECKSUM still holds the value that the driver expects, the CRC
+ * continues from it so that the resident app stays verifiable. Otherwise,
+ * something else has written to OTBN memory, so we forget the resident app and
+ * restart the register and the CRC from zero.
+ *
+ * @param[out] ctx CRC context.
+ */
+static void load_checksum_begin(uint32_t *ctx) {
+  uint32_t checksum =
+      abs_mmio_read32(otbn_base() + OTBN_LOAD_CHECKSUM_REG_OFFSET);
+  if (launder32(otbn_resident.valid) == kHardenedBoolTrue &&
+      launder32(checksum) == otbn_resident.load_checksum) {
+    HARDENED_CHECK_EQ(checksum, otbn_resident.load_checksum);
+    // `crc32_finish` inverts the state, so inverting the checksum resumes it.
+    *ctx = ~checksum;
+    return;
+  }
+  otbn_app_forget();
+  abs_mmio_write32(otbn_base() + OTBN_LOAD_CHECKSUM_REG_OFFSET, 0);
+  crc32_init(ctx);
+}
+
+/**
+ * Adds a write to OTBN memory to a CRC.
+ *
+ * According to the OTBN documentation, each CRC update consists of 48 bits:
+ * {imem, idx, wdata}
+ *   imem: set to 0 for DMEM writes and 1 for IMEM writes.
+ *   idx: the word index padded to 15 bits.
+ *   wdata: the 32-bit word written.
+ *
+ * @param ctx CRC context.
+ * @param imem Whether the write was to IMEM.
+ * @param addr OTBN address of the write in bytes.
+ * @param wdata Word that was written.
+ */
+static void load_checksum_add(uint32_t *ctx, bool imem, uint32_t addr,
+                              uint32_t wdata) {
+  char crc_data[6];
+  memset(crc_data, 0, sizeof(crc_data));
+  uint32_t offset = ((addr >> 2) & 0x7FFF) | ((uint32_t)imem << 15);
+  memcpy(crc_data, &wdata, sizeof(uint32_t));
+  memcpy(crc_data + sizeof(uint32_t), &offset, 2);
+  crc32_add(ctx, crc_data, sizeof(crc_data));
+}
+
+/**
+ * Finishes a CRC over some writes to OTBN memory.
+ *
+ * Checks the CRC against LOAD_CHECKSUM and records it as the value that the
+ * driver expects the register to hold.
+ *
+ * @param ctx CRC context.
+ */
+static void load_checksum_end(const uint32_t *ctx) {
+  uint32_t checksum_expected = crc32_finish(ctx);
+  uint32_t checksum =
+      abs_mmio_read32(otbn_base() + OTBN_LOAD_CHECKSUM_REG_OFFSET);
+  HARDENED_CHECK_EQ(checksum, checksum_expected);
+  otbn_resident.load_checksum = checksum;
+}
+
 /**
  * Ensures that a memory access fits within the given memory size.
  *
@@ -121,12 +227,9 @@ status_t otbn_dmem_write(size_t num_words, const uint32_t *src,
                          otbn_addr_t dest) {
   HARDENED_TRY(check_offset_len(dest, num_words, kOtbnDMemSizeBytes));
 
-  // Reset the LOAD_CHECKSUM register.
-  abs_mmio_write32(otbn_base() + OTBN_LOAD_CHECKSUM_REG_OFFSET, 0);
-
   // Initialize the CRC.
   uint32_t ctx;
-  crc32_init(&ctx);
+  load_checksum_begin(&ctx);
 
   // Setup the random order construct.
   random_order_t order;
@@ -148,27 +251,15 @@ status_t otbn_dmem_write(size_t num_words, const uint32_t *src,
     abs_mmio_write32(otbn_base() + OTBN_DMEM_REG_OFFSET + dest + idx_word,
                      src[idx]);
 
-    // Update the CRC. According to the OTBN documentation, each CRC update
-    // consists of 48-bit: {imem, idx, wdata}
-    // imem: set to 0 for DMEM writes.
-    // idx: the index padded to 15b.
-    // wdata: the 32b word written into DMEM.
-    char crc_data[6];
-    memset(crc_data, 0, sizeof(crc_data));
-    uint32_t offset = ((dest + idx_word) >> 2) & 0x7FFF;
-    memcpy(crc_data, &src[idx], sizeof(uint32_t));
-    memcpy(crc_data + sizeof(uint32_t), &offset, 2);
-    crc32_add(&ctx, crc_data, sizeof(crc_data));
+    // Update the CRC.
+    load_checksum_add(&ctx, /*imem=*/false, dest + idx_word, src[idx]);
   }
   RANDOM_ORDER_HARDENED_CHECK_DONE(order);
   HARDENED_CHECK_EQ(count, num_words);
 
-  // Get the computed (expected) checksum, fetch the checksum from the OTBN
-  // LOAD_CHECKSUM register, and compare both registers.
-  uint32_t checksum_expected = crc32_finish(&ctx);
-  uint32_t checksum =
-      abs_mmio_read32(otbn_base() + OTBN_LOAD_CHECKSUM_REG_OFFSET);
-  HARDENED_CHECK_EQ(checksum, checksum_expected);
+  // Compare the computed (expected) checksum with the OTBN LOAD_CHECKSUM
+  // register.
+  load_checksum_end(&ctx);
 
   return OTCRYPTO_OK;
 }
@@ -176,15 +267,21 @@ status_t otbn_dmem_write(size_t num_words, const uint32_t *src,
 status_t otbn_dmem_set(size_t num_words, const uint32_t src, otbn_addr_t dest) {
   HARDENED_TRY(check_offset_len(dest, num_words, kOtbnDMemSizeBytes));
 
+  uint32_t ctx;
+  load_checksum_begin(&ctx);
+
   // No need to randomize here, since all the values are the same.
   size_t i = 0;
   const uint32_t kBase = otbn_base();
   for (; launder32(i) < num_words; ++i) {
     abs_mmio_write32(kBase + OTBN_DMEM_REG_OFFSET + dest + i * sizeof(uint32_t),
                      src);
+    load_checksum_add(&ctx, /*imem=*/false, dest + i * sizeof(uint32_t), src);
     HARDENED_CHECK_LT(i, num_words);
   }
   HARDENED_CHECK_EQ(i, num_words);
+
+  load_checksum_end(&ctx);
   return OTCRYPTO_OK;
 }
 
@@ -254,6 +351,7 @@ uint32_t otbn_instruction_count_get(void) {
 
 status_t otbn_imem_sec_wipe(void) {
   HARDENED_TRY(otbn_assert_idle());
+  otbn_app_forget();
   abs_mmio_write32(otbn_base() + OTBN_CMD_REG_OFFSET, kOtbnCmdSecWipeImem);
   HARDENED_TRY(otbn_busy_wait_for_done());
   return OTCRYPTO_OK;
@@ -325,14 +423,21 @@ static status_t check_app_address_ranges(const otbn_app_t *app) {
 /**
  * Decompresses an LZ4-compressed payload and writes it to an OTBN address.
  *
+ * If `crc_ctx` is non-NULL, the writes are added to it (see
+ * `load_checksum_add`), using `otbn_addr` as the OTBN address of the first
+ * word.
+ *
  * @param src Start of the compressed payload.
  * @param src_end End of the compressed payload.
  * @param mmio_addr Destination MMIO address in OTBN memory.
  * @param expected_words Expected uncompressed size in 32-bit words.
+ * @param otbn_addr Destination address in DMEM, as seen by OTBN.
+ * @param crc_ctx CRC context to update (may be NULL).
  * @return `OTCRYPTO_OK` if successful, otherwise `OTCRYPTO_FATAL_ERR`.
  */
 static status_t decompress_load(const uint8_t *src, const uint8_t *src_end,
-                                uint32_t mmio_addr, size_t expected_words) {
+                                uint32_t mmio_addr, size_t expected_words,
+                                otbn_addr_t otbn_addr, uint32_t *crc_ctx) {
   // A 1024-byte stack buffer (256 32-bit words) for chunked
   // decompression.
   uint32_t local_chunk_buf[1024 / sizeof(uint32_t)];
@@ -371,10 +476,15 @@ static status_t decompress_load(const uint8_t *src, const uint8_t *src_end,
 
     for (uint32_t i = 0; launder32(i) < words; i++) {
       abs_mmio_write32(mmio_addr + i * sizeof(uint32_t), local_chunk_buf[i]);
+      if (crc_ctx != NULL) {
+        load_checksum_add(crc_ctx, /*imem=*/false,
+                          otbn_addr + i * sizeof(uint32_t), local_chunk_buf[i]);
+      }
     }
 
     src += comp_len;
     mmio_addr += uncomp_len;
+    otbn_addr += uncomp_len;
     words_written += words;
   }
 
@@ -385,6 +495,52 @@ static status_t decompress_load(const uint8_t *src, const uint8_t *src_end,
   return OTCRYPTO_OK;
 }
 
+/**
+ * Reloads the data of an application whose code is still in IMEM.
+ *
+ * Wipes DMEM and writes the app's initialized data again, skipping the IMEM
+ * wipe and reload. Returns `kHardenedBoolFalse` (without touching OTBN) if the
+ * app is not resident.
+ *
+ * @param app The application to reload.
+ * @param[out] reloaded Whether the app was resident and has been reloaded.
+ * @return The result of the operation.
+ */
+static status_t reload_resident_app(const otbn_app_t *app,
+                                    hardened_bool_t *reloaded) {
+  *reloaded = kHardenedBoolFalse;
+  if (launder32(otbn_resident.valid) != kHardenedBoolTrue ||
+      otbn_resident.imem_compressed_start != app->imem_compressed_start ||
+      otbn_resident.app_checksum != app->checksum) {
+    return OTCRYPTO_OK;
+  }
+  uint32_t checksum =
+      abs_mmio_read32(otbn_base() + OTBN_LOAD_CHECKSUM_REG_OFFSET);
+  if (launder32(checksum) != otbn_resident.load_checksum) {
+    return OTCRYPTO_OK;
+  }
+  HARDENED_CHECK_EQ(otbn_resident.valid, kHardenedBoolTrue);
+  HARDENED_CHECK_EQ(otbn_resident.app_checksum, app->checksum);
+  HARDENED_CHECK_EQ(checksum, otbn_resident.load_checksum);
+
+  HARDENED_TRY(otbn_dmem_sec_wipe());
+
+  // Write the data portion to DMEM, continuing the CRC so that the app stays
+  // resident.
+  uint32_t ctx;
+  load_checksum_begin(&ctx);
+  otbn_addr_t data_offset = app->dmem_data_start_addr;
+  uint32_t data_start_addr = otbn_base() + OTBN_DMEM_REG_OFFSET + data_offset;
+  HARDENED_TRY(decompress_load(app->dmem_compressed_start,
+                               app->dmem_compressed_end, data_start_addr,
+                               app->dmem_uncompressed_words, data_offset,
+                               &ctx));
+  load_checksum_end(&ctx);
+
+  *reloaded = kHardenedBoolTrue;
+  return OTCRYPTO_OK;
+}
+
 status_t otbn_load_app(const otbn_app_t app) {
   HARDENED_TRY(check_app_address_ranges(&app));
 
@@ -394,34 +550,41 @@ status_t otbn_load_app(const otbn_app_t app) {
   const size_t imem_num_words = app.imem_uncompressed_words;
   const size_t data_num_words = app.dmem_uncompressed_words;
 
-  HARDENED_TRY(otbn_imem_sec_wipe());
-  HARDENED_TRY(otbn_dmem_sec_wipe());
-
-  // Reset the LOAD_CHECKSUM register.
-  abs_mmio_write32(otbn_base() + OTBN_LOAD_CHECKSUM_REG_OFFSET, 0);
-
   // Ensure that the IMEM section fits in IMEM and the data section fits in
   // DMEM.
   HARDENED_TRY(check_offset_len(app.dmem_data_start_addr, data_num_words,
                                 kOtbnDMemSizeBytes));
-
-  // Write to IMEM. Always starts at zero on the OTBN side.
   otbn_addr_t imem_offset = 0;
   HARDENED_TRY(
       check_offset_len(imem_offset, imem_num_words, kOtbnIMemSizeBytes));
+
+  // If the app is still in IMEM, only its data needs to be reloaded.
+  hardened_bool_t reloaded;
+  HARDENED_TRY(reload_resident_app(&app, &reloaded));
+  if (launder32(reloaded) == kHardenedBoolTrue) {
+    HARDENED_CHECK_EQ(reloaded, kHardenedBoolTrue);
+    return OTCRYPTO_OK;
+  }
+  HARDENED_CHECK_EQ(reloaded, kHardenedBoolFalse);
+
+  HARDENED_TRY(otbn_imem_sec_wipe());
+  HARDENED_TRY(otbn_dmem_sec_wipe());
+
+  // Reset the LOAD_CHECKSUM register.
+  abs_mmio_write32(otbn_base() + OTBN_LOAD_CHECKSUM_REG_OFFSET, 0);
+
+  // Write to IMEM. Always starts at zero on the OTBN side.
   uint32_t imem_start_addr = otbn_base() + OTBN_IMEM_REG_OFFSET + imem_offset;
   HARDENED_TRY(decompress_load(app.imem_compressed_start,
                                app.imem_compressed_end, imem_start_addr,
-                               imem_num_words));
+                               imem_num_words, imem_offset, /*crc_ctx=*/NULL));
 
   // Write the data portion to DMEM.
   otbn_addr_t data_offset = app.dmem_data_start_addr;
-  HARDENED_TRY(
-      check_offset_len(data_offset, data_num_words, kOtbnDMemSizeBytes));
   uint32_t data_start_addr = otbn_base() + OTBN_DMEM_REG_OFFSET + data_offset;
   HARDENED_TRY(decompress_load(app.dmem_compressed_start,
                                app.dmem_compressed_end, data_start_addr,
-                               data_num_words));
+                               data_num_words, data_offset, /*crc_ctx=*/NULL));
 
   // Ensure that the checksum matches expectations.
   uint32_t checksum =
@@ -431,5 +594,11 @@ status_t otbn_load_app(const otbn_app_t app) {
   }
   HARDENED_CHECK_EQ(checksum, app.checksum);
 
+  // Record the app as resident.
+  otbn_resident.imem_compressed_start = app.imem_compressed_start;
+  otbn_resident.app_checksum = app.checksum;
+  otbn_resident.load_checksum = checksum;
+  otbn_resident.valid = kHardenedBoolTrue;
+
   return OTCRYPTO_OK;
 }
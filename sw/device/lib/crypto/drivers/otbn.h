@@ -413,6 +413,11 @@ status_t otbn_set_ctrl_wfi_enable(bool enable);
  * Load the application image with both instruction and data segments into
  * OTBN.
  *
+ * If `app` is still resident from an earlier call, which the driver checks
+ * using the `LOAD_CHECKSUM` register, then only DMEM is wiped and the app's
+ * data segment reloaded. Otherwise, both memories are wiped and the whole
+ * image is loaded.
+ *
  * This function will return an error if called when OTBN is not idle.
  *
  * Because this function uses the OTBN secure wipe functionality before
@@ -424,6 +429,15 @@ status_t otbn_set_ctrl_wfi_enable(bool enable);
  */
 status_t otbn_load_app(const otbn_app_t app);
 
+/**
+ * Forgets which application is resident in OTBN.
+ *
+ * The next call to `otbn_load_app()` will load the whole application image.
+ * Code that writes to or wipes OTBN memory without going through this driver
+ * must call this function first.
+ */
+void otbn_app_forget(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -24,6 +24,15 @@ enum {
    * Log2 of the number of bytes in an AES block.
    */
   kAesBlockLog2NumBytes = 4,
+  /**
+   * Size of the buffer of input blocks used by a GCTR burst.
+   *
+   * At the hardened security levels, a burst is checked by running all of its
+   * output back through the AES hardware, so it can have at most this many
+   * blocks. At the low security level the buffer is used as a ring and a
+   * burst can be arbitrarily long.
+   */
+  kGctrBurstMaxBlocks = 8,
 };
 static_assert(kAesBlockNumBytes == (1 << kAesBlockLog2NumBytes),
               "kAesBlockLog2NumBytes does not match kAesBlockNumBytes");
@@ -122,6 +131,162 @@ static status_t gctr_process_block(const aes_key_t key, aes_block_t *iv,
   return OTCRYPTO_OK;
 }
 
+/**
+ * Return the number of blocks that can be processed before inc32 wraps.
+ *
+ * The AES hardware increments the whole 128-bit counter block in CTR mode,
+ * whereas GCM's inc32 only increments the last 32 bits. The two agree until
+ * the last word overflows, so a burst must end there.
+ *
+ * @param iv Initialization vector for the first block of the burst.
+ * @param num_blocks Number of blocks that the caller wants to process.
+ * @return Number of blocks to process in this burst.
+ */
+static size_t gctr_burst_len(const aes_block_t *iv, size_t num_blocks) {
+  uint64_t ctr = __builtin_bswap32(iv->data[kAesBlockNumWords - 1]);
+  uint64_t until_wrap = (1ULL << 32) - ctr;
+  if (num_blocks > until_wrap) {
+    return (size_t)until_wrap;
+  }
+  return num_blocks;
+}
+
+/**
+ * Get input block `idx` of a GCTR burst.
+ *
+ * The first block of a burst may be the partial block from an earlier call,
+ * completed with the start of the new input; the rest come from `input`.
+ *
+ * @param first Completed partial block (may be NULL).
+ * @param input Input buffer for the remaining blocks.
+ * @param idx Index of the block in the burst.
+ * @param[out] block Destination block.
+ */
+static void gctr_load_block(const aes_block_t *first, const uint8_t *input,
+                            size_t idx, aes_block_t *block) {
+  if (first != NULL) {
+    if (idx == 0) {
+      randomized_bytecopy(block->data, first->data, kAesBlockNumBytes);
+      return;
+    }
+    idx--;
+  }
+  randomized_bytecopy(block->data, input + idx * kAesBlockNumBytes,
+                      kAesBlockNumBytes);
+}
+
+/**
+ * Run GCTR on a burst of full blocks with a single key and IV load.
+ *
+ * Keeps two blocks in the AES hardware at a time, so that it works on the
+ * next block while the previous one is written out and, if `ghash_ctx` is
+ * non-NULL, absorbed into GHASH. The GHASH input is the ciphertext: the output
+ * if `is_encrypt` is true and the input otherwise.
+ *
+ * At the hardened security levels, the burst must have at most
+ * `kGctrBurstMaxBlocks` blocks. It is checked by decrypting the output again
+ * before anything is written to `output`.
+ *
+ * The burst must not wrap the last word of the counter (see
+ * `gctr_burst_len`). Updates the IV in-place.
+ *
+ * @param key The AES key
+ * @param iv Initialization vector, 128 bits
+ * @param first Completed partial block to use as the first block (may be
+ *              NULL)
+ * @param input Input buffer for the remaining blocks
+ * @param num_blocks Number of blocks in the burst (including `first`)
+ * @param security_level Security level of the key
+ * @param ghash_ctx GHASH context for the ciphertext (may be NULL)
+ * @param is_encrypt Whether the ciphertext is the output
+ * @param[out] output Pointer to output buffer
+ */
+OT_WARN_UNUSED_RESULT
+static status_t gctr_burst(const aes_key_t key, aes_block_t *iv,
+                           const aes_block_t *first, const uint8_t *input,
+                           size_t num_blocks,
+                           otcrypto_key_security_level_t security_level,
+                           ghash_context_t *ghash_ctx,
+                           hardened_bool_t is_encrypt, uint8_t *output) {
+  hardened_bool_t check = kHardenedBoolTrue;
+  if (launder32(security_level) == kOtcryptoKeySecurityLevelLow) {
+    HARDENED_CHECK_EQ(security_level, kOtcryptoKeySecurityLevelLow);
+    check = kHardenedBoolFalse;
+  } else if (num_blocks > kGctrBurstMaxBlocks) {
+    return OTCRYPTO_BAD_ARGS;
+  }
+
+  aes_block_t in[kGctrBurstMaxBlocks];
+  aes_block_t out[kGctrBurstMaxBlocks];
+  HARDENED_TRY(aes_encrypt_begin(key, iv));
+
+  // Put the first two blocks in; from then on, the hardware starts on the next
+  // block as soon as we read each output.
+  size_t num_in = 0;
+  for (; num_in < num_blocks && num_in < 2; ++num_in) {
+    aes_block_t *block_in = &in[num_in % kGctrBurstMaxBlocks];
+    gctr_load_block(first, input, num_in, block_in);
+    HARDENED_TRY(aes_update(/*dest=*/NULL, block_in));
+  }
+
+  size_t i = 0;
+  for (; launder32(i) < num_blocks; ++i) {
+    aes_block_t *block_out = &out[i % kGctrBurstMaxBlocks];
+    HARDENED_TRY(aes_update(block_out, /*src=*/NULL));
+    if (num_in < num_blocks) {
+      aes_block_t *block_in = &in[num_in % kGctrBurstMaxBlocks];
+      gctr_load_block(first, input, num_in, block_in);
+      HARDENED_TRY(aes_update(/*dest=*/NULL, block_in));
+      ++num_in;
+    }
+
+    if (check == kHardenedBoolFalse) {
+      randomized_bytecopy(output + i * kAesBlockNumBytes, block_out->data,
+                          kAesBlockNumBytes);
+    }
+    if (ghash_ctx != NULL) {
+      const aes_block_t *ciphertext = block_out;
+      if (is_encrypt != kHardenedBoolTrue) {
+        ciphertext = &in[i % kGctrBurstMaxBlocks];
+      }
+      otcrypto_const_byte_buf_t ciphertext_buf =
+          OTCRYPTO_MAKE_BUF(otcrypto_const_byte_buf_t,
+                            (const uint8_t *)ciphertext->data,
+                            kAesBlockNumBytes);
+      HARDENED_TRY(ghash_update(ghash_ctx, &ciphertext_buf));
+    }
+  }
+  HARDENED_CHECK_EQ(i, num_blocks);
+
+  if (check != kHardenedBoolFalse) {
+    HARDENED_CHECK_NE(security_level, kOtcryptoKeySecurityLevelLow);
+    // Verify the CTRL and CTRL_AUX registers of the encryption.
+    HARDENED_TRY(aes_verify_ctrl_reg(key, kHardenedBoolTrue));
+    HARDENED_TRY(aes_verify_ctrl_aux_reg());
+    HARDENED_TRY(aes_end(NULL));
+
+    // Decrypt the output and check that the same input is retrieved.
+    HARDENED_TRY(aes_ctr_check(key, iv, in, out, num_blocks));
+    for (i = 0; launder32(i) < num_blocks; ++i) {
+      randomized_bytecopy(output + i * kAesBlockNumBytes, out[i].data,
+                          kAesBlockNumBytes);
+    }
+    HARDENED_CHECK_EQ(i, num_blocks);
+  } else {
+    HARDENED_TRY(aes_end(NULL));
+  }
+
+  // Advance the IV past the burst. The burst does not wrap the last word, so
+  // this matches applying inc32 once per block.
+  uint32_t ctr = __builtin_bswap32(iv->data[kAesBlockNumWords - 1]);
+  iv->data[kAesBlockNumWords - 1] = __builtin_bswap32(ctr + (uint32_t)i);
+
+  hardened_memshred((uint32_t *)in, kGctrBurstMaxBlocks * kAesBlockNumWords);
+  hardened_memshred((uint32_t *)out, kGctrBurstMaxBlocks * kAesBlockNumWords);
+
+  return OTCRYPTO_OK;
+}
+
 /**
  * Implements the GCTR function as specified in SP800-38D, section 6.5.
  *
@@ -133,6 +298,10 @@ static status_t gctr_process_block(const aes_key_t key, aes_block_t *iv,
  * left over. The partial block may be empty, but should never be full;
  * `partial_len` should always be less than `kAesBlockNumBytes`.
  *
+ * Full blocks are processed in bursts, each of which loads the key and IV
+ * only once and keeps the AES hardware busy while the ciphertext of the
+ * previous block is absorbed into GHASH (if `ghash_ctx` is non-NULL).
+ *
  * The output buffer should have enough space to hold all full blocks of
  * partial data + input data. The partial data length after this function will
  * always be `(partial_len + input_len) % kAesBlockNumBytes`.
@@ -149,6 +318,8 @@ static status_t gctr_process_block(const aes_key_t key, aes_block_t *iv,
  * @param input_len Number of bytes for input and output
  * @param input Pointer to input buffer (may be NULL if `len` is 0)
  * @param security_level Security level of the key
+ * @param ghash_ctx GHASH context for the ciphertext (may be NULL)
+ * @param is_encrypt Whether the ciphertext is the output
  * @param[out] output_len Number of output bytes written
  * @param[out] output Pointer to output buffer
  */
@@ -157,49 +328,56 @@ static status_t aes_gcm_gctr(const aes_key_t key, aes_block_t *iv,
                              size_t partial_len, aes_block_t *partial,
                              size_t input_len, const uint8_t *input,
                              otcrypto_key_security_level_t security_level,
-                             size_t *output_len, uint8_t *output) {
+                             ghash_context_t *ghash_ctx,
+                             hardened_bool_t is_encrypt, size_t *output_len,
+                             uint8_t *output) {
   // Key must be intended for CTR mode.
   if (key.mode != kAesCipherModeCtr) {
     return OTCRYPTO_BAD_ARGS;
   }
 
+  *output_len = 0;
   if (input_len < kAesBlockNumBytes - partial_len) {
     // Not enough data for a full block; copy into the partial block.
     unsigned char *partial_bytes = (unsigned char *)partial->data;
     randomized_bytecopy(partial_bytes + partial_len, input, input_len);
-    *output_len = 0;
-  } else {
-    // Construct a block from the partial data and the start of the new data.
-    unsigned char *partial_bytes = (unsigned char *)partial->data;
-    randomized_bytecopy(partial_bytes + partial_len, input,
-                        kAesBlockNumBytes - partial_len);
-    input += kAesBlockNumBytes - partial_len;
-    input_len -= kAesBlockNumBytes - partial_len;
+    return OTCRYPTO_OK;
+  }
 
-    // Process the block.
-    aes_block_t block_out;
-    HARDENED_TRY(
-        gctr_process_block(key, iv, partial, security_level, &block_out));
-    randomized_bytecopy(output, block_out.data, kAesBlockNumBytes);
-    output += kAesBlockNumBytes;
-    *output_len = kAesBlockNumBytes;
-
-    // Process any remaining full blocks of input.
-    while (input_len >= kAesBlockNumBytes) {
-      randomized_bytecopy(partial->data, input, kAesBlockNumBytes);
-      HARDENED_TRY(
-          gctr_process_block(key, iv, partial, security_level, &block_out));
-      randomized_bytecopy(output, block_out.data, kAesBlockNumBytes);
-      output += kAesBlockNumBytes;
-      *output_len += kAesBlockNumBytes;
-      input += kAesBlockNumBytes;
-      input_len -= kAesBlockNumBytes;
+  // Construct a block from the partial data and the start of the new data.
+  // This is the first block of the first burst.
+  unsigned char *partial_bytes = (unsigned char *)partial->data;
+  randomized_bytecopy(partial_bytes + partial_len, input,
+                      kAesBlockNumBytes - partial_len);
+  input += kAesBlockNumBytes - partial_len;
+  input_len -= kAesBlockNumBytes - partial_len;
+  const aes_block_t *first = partial;
+  size_t num_blocks = 1 + input_len / kAesBlockNumBytes;
+
+  while (num_blocks > 0) {
+    size_t burst_len = gctr_burst_len(iv, num_blocks);
+    if (launder32(security_level) != kOtcryptoKeySecurityLevelLow &&
+        burst_len > kGctrBurstMaxBlocks) {
+      burst_len = kGctrBurstMaxBlocks;
     }
+    HARDENED_TRY(gctr_burst(key, iv, first, input, burst_len, security_level,
+                            ghash_ctx, is_encrypt, output));
 
-    // Copy any remaining input into the partial block.
-    randomized_bytecopy(partial->data, input, input_len);
+    size_t input_blocks = burst_len;
+    if (first != NULL) {
+      input_blocks--;
+      first = NULL;
+    }
+    input += input_blocks * kAesBlockNumBytes;
+    input_len -= input_blocks * kAesBlockNumBytes;
+    output += burst_len * kAesBlockNumBytes;
+    *output_len += burst_len * kAesBlockNumBytes;
+    num_blocks -= burst_len;
   }
 
+  // Copy any remaining input into the partial block.
+  randomized_bytecopy(partial->data, input, input_len);
+
   return OTCRYPTO_OK;
 }
 
@@ -538,32 +716,28 @@ status_t aes_gcm_update_encrypted_data(aes_gcm_context_t *ctx,
     }
   }
 
-  // Process any full blocks of input with GCTR to generate more ciphertext.
+  if (ctx->is_encrypt != kHardenedBoolTrue &&
+      ctx->is_encrypt != kHardenedBoolFalse) {
+    return OTCRYPTO_BAD_ARGS;
+  }
+
+  // Process any full blocks of input with GCTR to generate more ciphertext,
+  // accumulating the ciphertext (the output for encryption, and the input for
+  // decryption) in the GHASH context as we go.
   size_t partial_aes_block_len = ctx->input_len % kAesBlockNumBytes;
   HARDENED_TRY(aes_gcm_gctr(ctx->key, &ctx->gctr_iv, partial_aes_block_len,
                             &ctx->partial_aes_block, input->len, input->data,
-                            ctx->security_level, bytes_written, output->data));
-
-  // Accumulate any new ciphertext to the GHASH context. The ciphertext is the
-  // output for encryption, and the input for decryption.
-  if (ctx->is_encrypt == kHardenedBoolTrue) {
-    // Since we only generate ciphertext in full-block increments, no partial
-    // blocks are possible in this case.
-    if (*bytes_written % kGhashBlockNumBytes != 0) {
-      return OTCRYPTO_RECOV_ERR;
-    }
-    otcrypto_const_byte_buf_t written_buf = OTCRYPTO_MAKE_BUF(
-        otcrypto_const_byte_buf_t, output->data, *bytes_written);
-    HARDENED_TRY(ghash_process_full_blocks(&ctx->ghash_ctx, /*partial_len=*/0,
-                                           &ctx->partial_ghash_block,
-                                           &written_buf));
-  } else if (ctx->is_encrypt == kHardenedBoolFalse) {
-    size_t partial_ghash_block_len = ctx->input_len % kGhashBlockNumBytes;
-    HARDENED_TRY(ghash_process_full_blocks(&ctx->ghash_ctx,
-                                           partial_ghash_block_len,
-                                           &ctx->partial_ghash_block, input));
-  } else {
-    return OTCRYPTO_BAD_ARGS;
+                            ctx->security_level, &ctx->ghash_ctx,
+                            ctx->is_encrypt, bytes_written, output->data));
+
+  // For decryption, any leftover ciphertext is in the partial AES block.
+  // Keep a copy in the partial GHASH block for `aes_gcm_final`.
+  if (ctx->is_encrypt == kHardenedBoolFalse) {
+    static_assert(sizeof(ctx->partial_ghash_block) ==
+                      sizeof(ctx->partial_aes_block),
+                  "GHASH and AES block sizes must match");
+    randomized_bytecopy(ctx->partial_ghash_block.data,
+                        ctx->partial_aes_block.data, kAesBlockNumBytes);
   }
 
   ctx->input_len += input->len;
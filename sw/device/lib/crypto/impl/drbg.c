@@ -16,6 +16,136 @@
 // Module ID for status codes.
 #define MODULE_ID MAKE_MODULE_ID('r', 'b', 'g')
 
+enum {
+  /**
+   * Number of words in one CSRNG output block.
+   */
+  kDrbgBlockWords = 128 / 32,
+  /**
+   * Largest pool, in words, that one CSRNG generate command can fill.
+   */
+  kDrbgPoolMaxWords = 0x800 * kDrbgBlockWords,
+};
+
+/**
+ * State of the optional DRBG output pool.
+ */
+typedef struct drbg_pool {
+  /**
+   * Caller-provided pool buffer, or NULL if the pool is disabled.
+   */
+  uint32_t *data;
+  /**
+   * Length of `data` in words.
+   */
+  size_t len;
+  /**
+   * Index of the next unused word in `data`; equal to `len` when empty.
+   */
+  size_t offset;
+  /**
+   * Number of refills allowed between two reseeds.
+   */
+  size_t reseed_interval;
+  /**
+   * Number of refills since the last reseed.
+   */
+  size_t refills;
+  /**
+   * Generation of the CSRNG state that filled `data` (see
+   * `entropy_csrng_generation()`).
+   */
+  uint32_t generation;
+} drbg_pool_t;
+
+static drbg_pool_t pool = {
+    .data = NULL,
+    .len = 0,
+    .offset = 0,
+    .reseed_interval = 0,
+    .refills = 0,
+    .generation = 0,
+};
+
+/**
+ * Wipe and empty the output pool.
+ *
+ * Called whenever the DRBG state changes, so that output from before the
+ * change is never handed out after it. Does nothing if the pool is disabled.
+ *
+ * @return OK or error.
+ */
+static status_t pool_flush(void) {
+  pool.refills = 0;
+  if (pool.data == NULL) {
+    return OTCRYPTO_OK;
+  }
+  pool.offset = pool.len;
+  return hardened_memshred(pool.data, pool.len);
+}
+
+/**
+ * Refill the output pool with a single CSRNG generate command.
+ *
+ * Reseeds the DRBG from the entropy source first if the pool has already been
+ * refilled `reseed_interval` times since the last reseed.
+ *
+ * @return OK or error.
+ */
+static status_t pool_refill(void) {
+  if (pool.refills >= pool.reseed_interval) {
+    HARDENED_TRY(entropy_csrng_reseed(
+        /*disable_trng_input=*/kHardenedBoolFalse, &kEntropyEmptySeed));
+    pool.refills = 0;
+  }
+  status_t result = entropy_csrng_generate(&kEntropyEmptySeed, pool.data,
+                                           pool.len, kHardenedBoolTrue);
+  if (!status_ok(result)) {
+    // Do not hand out a partially-filled pool.
+    HARDENED_TRY(pool_flush());
+    return result;
+  }
+  pool.refills++;
+  pool.offset = 0;
+  pool.generation = entropy_csrng_generation();
+  return OTCRYPTO_OK;
+}
+
+/**
+ * Serve a request from the output pool.
+ *
+ * Every word is wiped from the pool as it is copied out.
+ *
+ * @param[out] drbg_output Buffer for output.
+ * @return OK or error.
+ */
+static status_t pool_generate(otcrypto_word32_buf_t *drbg_output) {
+  // Other cryptolib operations (e.g. RSA-PSS signing and RSA-OAEP encryption)
+  // re-instantiate the CSRNG directly through the entropy driver. Drop any
+  // output left over from before such a change.
+  if (launder32(pool.generation) != entropy_csrng_generation()) {
+    HARDENED_TRY(pool_flush());
+  }
+
+  size_t copied = 0;
+  while (launder32(copied) < drbg_output->len) {
+    if (pool.offset == pool.len) {
+      HARDENED_TRY(pool_refill());
+    }
+    size_t n = drbg_output->len - copied;
+    if (n > pool.len - pool.offset) {
+      n = pool.len - pool.offset;
+    }
+    HARDENED_TRY(hardened_memcpy(&drbg_output->data[copied],
+                                 &pool.data[pool.offset], n));
+    HARDENED_TRY(hardened_memshred(&pool.data[pool.offset], n));
+    pool.offset += n;
+    copied += n;
+  }
+  HARDENED_CHECK_EQ(copied, drbg_output->len);
+  return OTCRYPTO_OK;
+}
+
 /**
  * Construct seed material for the CSRNG.
  *
@@ -120,6 +250,7 @@ otcrypto_status_t otcrypto_drbg_instantiate(
       hardened_memshred(seed_material.data, ARRAYSIZE(seed_material.data)));
   HARDENED_TRY(seed_material_construct(perso_string, &seed_material));
 
+  HARDENED_TRY(pool_flush());
   HARDENED_TRY(entropy_csrng_uninstantiate());
   return otcrypto_eval_exit(entropy_csrng_instantiate(
       /*disable_trng_input=*/kHardenedBoolFalse, &seed_material));
@@ -140,6 +271,7 @@ otcrypto_status_t otcrypto_drbg_reseed(
       hardened_memshred(seed_material.data, ARRAYSIZE(seed_material.data)));
   HARDENED_TRY(seed_material_construct(additional_input, &seed_material));
 
+  HARDENED_TRY(pool_flush());
   return otcrypto_eval_exit(entropy_csrng_reseed(
       /*disable_trng_input=*/kHardenedBoolFalse, &seed_material));
 }
@@ -166,6 +298,7 @@ otcrypto_status_t otcrypto_drbg_manual_instantiate(
 
   HARDENED_CHECK_EQ(seed_material.len, kEntropySeedWords);
 
+  HARDENED_TRY(pool_flush());
   return otcrypto_eval_exit(entropy_csrng_instantiate(
       /*disable_trng_input=*/kHardenedBoolTrue, &seed_material));
 }
@@ -193,6 +326,7 @@ otcrypto_status_t otcrypto_drbg_manual_reseed(
 
   HARDENED_CHECK_EQ(seed_material.len, kEntropySeedWords);
 
+  HARDENED_TRY(pool_flush());
   return otcrypto_eval_exit(entropy_csrng_reseed(
       /*disable_trng_input=*/kHardenedBoolTrue, &seed_material));
 }
@@ -239,6 +373,13 @@ otcrypto_status_t otcrypto_drbg_generate(
   // Randomize destination buffer.
   HARDENED_TRY(hardened_memshred(drbg_output->data, drbg_output->len));
 
+  // Additional input has to reach the CSRNG, so only plain requests that fit
+  // in the pool are served from it.
+  if (pool.data != NULL && additional_input->len == 0 &&
+      drbg_output->len <= pool.len) {
+    return otcrypto_eval_exit(pool_generate(drbg_output));
+  }
+
   return otcrypto_eval_exit(generate(/*fips_check=*/kHardenedBoolTrue,
                                      additional_input, drbg_output));
 }
@@ -263,5 +404,37 @@ otcrypto_status_t otcrypto_drbg_manual_generate(
 }
 
 otcrypto_status_t otcrypto_drbg_uninstantiate(void) {
+  HARDENED_TRY(pool_flush());
   return otcrypto_eval_exit(entropy_csrng_uninstantiate());
 }
+
+otcrypto_status_t otcrypto_drbg_pool_enable(otcrypto_word32_buf_t *pool_buf,
+                                            size_t reseed_interval) {
+#ifndef OTCRYPTO_DISABLE_NULL_CHECKS
+  if (pool_buf == NULL || pool_buf->data == NULL) {
+    return OTCRYPTO_BAD_ARGS;
+  }
+#endif
+  HARDENED_CHECK_EQ(kHardenedBoolTrue, OTCRYPTO_CHECK_BUF(pool_buf));
+  if (pool_buf->len == 0 || pool_buf->len % kDrbgBlockWords != 0 ||
+      pool_buf->len > kDrbgPoolMaxWords || reseed_interval == 0) {
+    return OTCRYPTO_BAD_ARGS;
+  }
+
+  // Wipe the previous pool, if any, before switching buffers.
+  HARDENED_TRY(pool_flush());
+  pool.data = pool_buf->data;
+  pool.len = pool_buf->len;
+  pool.offset = pool.len;
+  pool.reseed_interval = reseed_interval;
+  return otcrypto_eval_exit(hardened_memshred(pool.data, pool.len));
+}
+
+otcrypto_status_t otcrypto_drbg_pool_disable(void) {
+  HARDENED_TRY(pool_flush());
+  pool.data = NULL;
+  pool.len = 0;
+  pool.offset = 0;
+  pool.reseed_interval = 0;
+  return otcrypto_eval_exit(OTCRYPTO_OK);
+}
@@ -273,6 +273,97 @@ otcrypto_status_t otcrypto_ecdsa_p384_sign_verify(
   return OTCRYPTO_OK;
 }
 
+otcrypto_status_t otcrypto_ecdsa_p384_sign_batch(
+    const otcrypto_blinded_key_t *private_key,
+    const otcrypto_const_byte_buf_t *messages, size_t num_messages,
+    otcrypto_word32_buf_t *signatures) {
+#ifndef OTCRYPTO_DISABLE_NULL_CHECKS
+  if (private_key == NULL || private_key->keyblob == NULL || messages == NULL ||
+      signatures == NULL) {
+    return OTCRYPTO_BAD_ARGS;
+  }
+#endif
+  if (num_messages == 0) {
+    return OTCRYPTO_BAD_ARGS;
+  }
+  HARDENED_TRY(p384_private_key_length_check(private_key));
+  for (size_t i = 0; i < num_messages; i++) {
+#ifndef OTCRYPTO_DISABLE_NULL_CHECKS
+    if (signatures[i].data == NULL) {
+      return OTCRYPTO_BAD_ARGS;
+    }
+#endif
+    HARDENED_TRY(p384_signature_length_check(signatures[i].len));
+  }
+
+  // Hash the next message with HMAC while OTBN signs the current one. OTBN
+  // cannot take new inputs before it is done, so the digests alternate
+  // between two buffers.
+  uint32_t digests[2][kP384ScalarWords];
+  HARDENED_TRY(hmac_hash_sha384(&messages[0], digests[0]));
+  size_t i = 0;
+  for (; launder32(i) < num_messages; i++) {
+    otcrypto_hash_digest_t digest = {
+        .mode = kOtcryptoHashModeSha384,
+        .data = digests[i % 2],
+        .len = kP384ScalarWords,
+    };
+    HARDENED_TRY(otcrypto_ecdsa_p384_sign_async_start(private_key, digest));
+    status_t hash_result = OTCRYPTO_OK;
+    if (i + 1 < num_messages) {
+      hash_result = hmac_hash_sha384(&messages[i + 1], digests[(i + 1) % 2]);
+    }
+    // Always collect the signature so that OTBN is idle and DMEM is wiped
+    // even if hashing failed.
+    HARDENED_TRY(otcrypto_ecdsa_p384_sign_async_finalize(&signatures[i]));
+    HARDENED_TRY(hash_result);
+  }
+  HARDENED_CHECK_EQ(i, num_messages);
+
+  return otcrypto_eval_exit(OTCRYPTO_OK);
+}
+
+otcrypto_status_t otcrypto_ecdsa_p384_verify_batch(
+    const otcrypto_unblinded_key_t *public_key,
+    const otcrypto_const_byte_buf_t *messages, size_t num_messages,
+    const otcrypto_const_word32_buf_t *signatures,
+    hardened_bool_t *verification_results) {
+#ifndef OTCRYPTO_DISABLE_NULL_CHECKS
+  if (public_key == NULL || messages == NULL || signatures == NULL ||
+      verification_results == NULL) {
+    return OTCRYPTO_BAD_ARGS;
+  }
+#endif
+  if (num_messages == 0) {
+    return OTCRYPTO_BAD_ARGS;
+  }
+
+  // Same pipeline as `otcrypto_ecdsa_p384_sign_batch`.
+  uint32_t digests[2][kP384ScalarWords];
+  HARDENED_TRY(hmac_hash_sha384(&messages[0], digests[0]));
+  size_t i = 0;
+  for (; launder32(i) < num_messages; i++) {
+    verification_results[i] = kHardenedBoolFalse;
+    otcrypto_hash_digest_t digest = {
+        .mode = kOtcryptoHashModeSha384,
+        .data = digests[i % 2],
+        .len = kP384ScalarWords,
+    };
+    HARDENED_TRY(otcrypto_ecdsa_p384_verify_async_start(public_key, digest,
+                                                        &signatures[i]));
+    status_t hash_result = OTCRYPTO_OK;
+    if (i + 1 < num_messages) {
+      hash_result = hmac_hash_sha384(&messages[i + 1], digests[(i + 1) % 2]);
+    }
+    HARDENED_TRY(otcrypto_ecdsa_p384_verify_async_finalize(
+        &signatures[i], &verification_results[i]));
+    HARDENED_TRY(hash_result);
+  }
+  HARDENED_CHECK_EQ(i, num_messages);
+
+  return otcrypto_eval_exit(OTCRYPTO_OK);
+}
+
 otcrypto_status_t otcrypto_ecdh_p384_keygen(
     otcrypto_blinded_key_t *private_key, otcrypto_unblinded_key_t *public_key) {
   HARDENED_TRY(otcrypto_ecdh_p384_keygen_async_start(private_key));
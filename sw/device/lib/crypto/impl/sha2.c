@@ -166,6 +166,36 @@ otcrypto_status_t otcrypto_sha2_update(
   return otcrypto_eval_exit(hmac_update(hmac_ctx, message));
 }
 
+otcrypto_status_t otcrypto_sha2_update_multistream(
+    const otcrypto_sha2_stream_update_t *updates, size_t num_updates) {
+#ifndef OTCRYPTO_DISABLE_NULL_CHECKS
+  if (updates == NULL && num_updates != 0) {
+    return OTCRYPTO_BAD_ARGS;
+  }
+#endif
+  if (num_updates > kOtcryptoSha2MultistreamMaxUpdates) {
+    return OTCRYPTO_BAD_ARGS;
+  }
+
+  hmac_stream_update_t queue[kOtcryptoSha2MultistreamMaxUpdates];
+  size_t i = 0;
+  for (; launder32(i) < num_updates; i++) {
+#ifndef OTCRYPTO_DISABLE_NULL_CHECKS
+    const otcrypto_const_byte_buf_t *message = updates[i].message;
+    if (updates[i].ctx == NULL || message == NULL ||
+        (message->data == NULL && message->len != 0)) {
+      return OTCRYPTO_BAD_ARGS;
+    }
+#endif
+    queue[i].ctx = (hmac_ctx_t *)updates[i].ctx->data;
+    queue[i].data = updates[i].message;
+    HARDENED_TRY(check_lengths(queue[i].ctx));
+  }
+  HARDENED_CHECK_EQ(i, num_updates);
+
+  return otcrypto_eval_exit(hmac_update_multistream(queue, num_updates));
+}
+
 otcrypto_status_t otcrypto_sha2_final(otcrypto_sha2_context_t *ctx,
                                       otcrypto_hash_digest_t *digest) {
 #ifndef OTCRYPTO_DISABLE_NULL_CHECKS
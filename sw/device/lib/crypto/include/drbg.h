@@ -144,6 +144,44 @@ otcrypto_status_t otcrypto_drbg_manual_generate(
  */
 otcrypto_status_t otcrypto_drbg_uninstantiate(void);
 
+/**
+ * Enables the DRBG output pool.
+ *
+ * While the pool is enabled, `otcrypto_drbg_generate` requests with empty
+ * additional input and no longer than the pool are served from the pool. The
+ * pool is refilled with a single CSRNG generate command when it runs out,
+ * which is much cheaper than one command per request when callers ask for a
+ * few words at a time. Other requests, and `otcrypto_drbg_manual_generate`,
+ * still go directly to the CSRNG.
+ *
+ * Every word is wiped from the pool as soon as it has been handed out. The
+ * DRBG is reseeded from the entropy source before every `reseed_interval`-th
+ * refill, and the pool is emptied whenever the DRBG is instantiated, reseeded
+ * or uninstantiated, including by other cryptolib operations that use the
+ * CSRNG directly (such as RSA-PSS signing).
+ *
+ * The pool buffer must be a non-zero multiple of 4 words long, and at most
+ * 8192 words (the most one generate command can produce). The caller must
+ * keep it allocated until `otcrypto_drbg_pool_disable` is called.
+ *
+ * @param pool Buffer to hold the pool.
+ * @param reseed_interval Number of refills between reseeds; must be non-zero.
+ * @return Result of the operation. Returns `kOtcryptoStatusValueOk` on
+ * success, or `kOtcryptoStatusValueBadArgs` if arguments are invalid.
+ */
+otcrypto_status_t otcrypto_drbg_pool_enable(otcrypto_word32_buf_t *pool,
+                                            size_t reseed_interval);
+
+/**
+ * Wipes and disables the DRBG output pool.
+ *
+ * After this call, the caller may free the pool buffer. Does nothing if the
+ * pool is not enabled.
+ *
+ * @return Result of the operation.
+ */
+otcrypto_status_t otcrypto_drbg_pool_disable(void);
+
 #ifdef __cplusplus
 }  // extern "C"
 #endif  // __cplusplus
@@ -139,6 +139,53 @@ otcrypto_status_t otcrypto_ecdsa_p384_verify(
     const otcrypto_const_word32_buf_t *signature,
     hardened_bool_t *verification_result);
 
+/**
+ * Hashes and signs a batch of messages with ECDSA/P-384.
+ *
+ * Each message is hashed with SHA-384. The hash of the next message is
+ * computed while OTBN signs the current one, so a batch is faster than
+ * hashing and signing each message in turn.
+ *
+ * All signature buffers are checked before anything is signed. If an error
+ * occurs part of the way through, the signatures before it are valid and the
+ * rest must be discarded.
+ *
+ * @param private_key Pointer to the blinded private key (d) struct.
+ * @param messages Messages to be signed (`num_messages` entries).
+ * @param num_messages Number of messages in the batch, at least 1.
+ * @param[out] signatures Signature buffers (`num_messages` entries).
+ * @return Result of the batch signature generation.
+ */
+OT_WARN_UNUSED_RESULT
+otcrypto_status_t otcrypto_ecdsa_p384_sign_batch(
+    const otcrypto_blinded_key_t *private_key,
+    const otcrypto_const_byte_buf_t *messages, size_t num_messages,
+    otcrypto_word32_buf_t *signatures);
+
+/**
+ * Hashes a batch of messages and verifies their ECDSA/P-384 signatures.
+ *
+ * Each message is hashed with SHA-384, overlapping with the verification of
+ * the previous one as in `otcrypto_ecdsa_p384_sign_batch`.
+ *
+ * As for `otcrypto_ecdsa_p384_verify`, the caller must check every entry of
+ * `verification_results`, NOT only the returned status code.
+ *
+ * @param public_key Pointer to the unblinded public key (Q) struct.
+ * @param messages Messages to be verified (`num_messages` entries).
+ * @param num_messages Number of messages in the batch, at least 1.
+ * @param signatures Signatures to be verified (`num_messages` entries).
+ * @param[out] verification_results Whether each signature passed
+ * verification (`num_messages` entries).
+ * @return Result of the batch verification operation.
+ */
+OT_WARN_UNUSED_RESULT
+otcrypto_status_t otcrypto_ecdsa_p384_verify_batch(
+    const otcrypto_unblinded_key_t *public_key,
+    const otcrypto_const_byte_buf_t *messages, size_t num_messages,
+    const otcrypto_const_word32_buf_t *signatures,
+    hardened_bool_t *verification_results);
+
 /**
  * Generates a key pair for ECDH with curve P-384.
  *
@@ -23,6 +23,11 @@ enum {
    * struct.
    */
   kOtcryptoSha2CtxStructWords = 88,
+  /**
+   * The maximum number of updates in one call to
+   * #otcrypto_sha2_update_multistream.
+   */
+  kOtcryptoSha2MultistreamMaxUpdates = 16,
 };
 
 /**
@@ -116,6 +121,36 @@ OT_WARN_UNUSED_RESULT
 otcrypto_status_t otcrypto_sha2_update(
     otcrypto_sha2_context_t *ctx, const otcrypto_const_byte_buf_t *message);
 
+/**
+ * A queued update for #otcrypto_sha2_update_multistream.
+ */
+typedef struct otcrypto_sha2_stream_update {
+  /// Initialized context object of the stream (updated in place).
+  otcrypto_sha2_context_t *ctx;
+  /// Input message data for the stream.
+  const otcrypto_const_byte_buf_t *message;
+} otcrypto_sha2_stream_update_t;
+
+/**
+ * Add more data to several streaming SHA2 operations at once.
+ *
+ * The updates for different streams may be interleaved; the updates for each
+ * stream are applied in the order in which they appear. The result is the
+ * same as calling #otcrypto_sha2_update for every entry in turn, but each
+ * context is loaded into the hardware at most once, and not at all if its
+ * queued data does not complete a message block.
+ *
+ * @param updates Queue of updates.
+ * @param num_updates Number of updates, at most
+ * `kOtcryptoSha2MultistreamMaxUpdates`.
+ * @return Result of the SHA2 update operation. Returns `kOtcryptoStatusValueOk`
+ * on success, `kOtcryptoStatusValueBadArgs` if arguments are invalid, or
+ * `kOtcryptoStatusValueFatalError` if an internal hardware check fails.
+ */
+OT_WARN_UNUSED_RESULT
+otcrypto_status_t otcrypto_sha2_update_multistream(
+    const otcrypto_sha2_stream_update_t *updates, size_t num_updates);
+
 /**
  * Finish a streaming SHA2 operation.
  *
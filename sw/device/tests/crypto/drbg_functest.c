@@ -2,6 +2,7 @@
 // Licensed under the Apache License, Version 2.0, see LICENSE for details.
 // SPDX-License-Identifier: Apache-2.0
 
+#include "sw/device/lib/base/memory.h"
 #include "sw/device/lib/base/status.h"
 #include "sw/device/lib/crypto/impl/status.h"
 #include "sw/device/lib/crypto/include/config.h"
@@ -113,6 +114,60 @@ static status_t reseed_test(void) {
   return OK_STATUS();
 }
 
+static status_t pool_test(void) {
+  LOG_INFO("Running output pool tests...");
+
+  otcrypto_const_byte_buf_t kEmptyBuffer =
+      OTCRYPTO_MAKE_BUF(otcrypto_const_byte_buf_t, NULL, 0);
+  TRY(otcrypto_drbg_instantiate(/*perso_string=*/&kEmptyBuffer));
+
+  // Invalid pool lengths and reseed intervals.
+  uint32_t pool_data[16];
+  otcrypto_word32_buf_t bad_len_pool =
+      OTCRYPTO_MAKE_BUF(otcrypto_word32_buf_t, pool_data, 6);
+  otcrypto_word32_buf_t pool = OTCRYPTO_MAKE_BUF(
+      otcrypto_word32_buf_t, pool_data, ARRAYSIZE(pool_data));
+  TRY_CHECK(otcrypto_drbg_pool_enable(&bad_len_pool, 2).value ==
+            OTCRYPTO_BAD_ARGS.value);
+  TRY_CHECK(otcrypto_drbg_pool_enable(&pool, 0).value ==
+            OTCRYPTO_BAD_ARGS.value);
+
+  // Draw small requests through several refills and one automatic reseed.
+  TRY(otcrypto_drbg_pool_enable(&pool, /*reseed_interval=*/2));
+  uint32_t output_data[3 * 16];
+  for (size_t i = 0; i < ARRAYSIZE(output_data); i += 3) {
+    otcrypto_word32_buf_t output =
+        OTCRYPTO_MAKE_BUF(otcrypto_word32_buf_t, &output_data[i], 3);
+    TRY(otcrypto_drbg_generate(/*additional_input=*/&kEmptyBuffer, &output));
+    if (i == 0) {
+      // The words handed out must have been wiped from the pool.
+      TRY_CHECK(memcmp(pool_data, output_data, 3 * sizeof(uint32_t)) != 0);
+    }
+  }
+  for (size_t i = 3; i < ARRAYSIZE(output_data); i += 3) {
+    TRY_CHECK(memcmp(&output_data[i - 3], &output_data[i],
+                     3 * sizeof(uint32_t)) != 0);
+  }
+
+  // Requests larger than the pool bypass it.
+  uint32_t large_data[32];
+  otcrypto_word32_buf_t large = OTCRYPTO_MAKE_BUF(
+      otcrypto_word32_buf_t, large_data, ARRAYSIZE(large_data));
+  TRY(otcrypto_drbg_generate(/*additional_input=*/&kEmptyBuffer, &large));
+
+  // Reseeding empties the pool, and the next request refills it.
+  TRY(otcrypto_drbg_reseed(/*additional_input=*/&kEmptyBuffer));
+  otcrypto_word32_buf_t output =
+      OTCRYPTO_MAKE_BUF(otcrypto_word32_buf_t, output_data, 4);
+  TRY(otcrypto_drbg_generate(/*additional_input=*/&kEmptyBuffer, &output));
+
+  // Clean up
+  TRY(otcrypto_drbg_pool_disable());
+  TRY(otcrypto_drbg_uninstantiate());
+
+  return OK_STATUS();
+}
+
 static status_t run_negative_tests(void) {
   LOG_INFO("Running negative tests...");
 
@@ -196,6 +251,7 @@ bool test_main(void) {
   EXECUTE_TEST(result, kat_test);
   EXECUTE_TEST(result, random_test);
   EXECUTE_TEST(result, reseed_test);
+  EXECUTE_TEST(result, pool_test);
   EXECUTE_TEST(result, run_negative_tests);
 
   return status_ok(result);
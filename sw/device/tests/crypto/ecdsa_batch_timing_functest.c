@@ -0,0 +1,201 @@
+// Copyright lowRISC contributors (OpenTitan project).
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+
+#include "sw/device/lib/arch/device.h"
+#include "sw/device/lib/base/memory.h"
+#include "sw/device/lib/crypto/impl/keyblob.h"
+#include "sw/device/lib/crypto/include/config.h"
+#include "sw/device/lib/crypto/include/cryptolib_build_info.h"
+#include "sw/device/lib/crypto/include/datatypes.h"
+#include "sw/device/lib/crypto/include/ecc_p256.h"
+#include "sw/device/lib/crypto/include/ecc_p384.h"
+#include "sw/device/lib/crypto/include/entropy_src.h"
+#include "sw/device/lib/crypto/include/integrity.h"
+#include "sw/device/lib/crypto/include/sha2.h"
+#include "sw/device/lib/runtime/log.h"
+#include "sw/device/lib/testing/profile.h"
+#include "sw/device/lib/testing/test_framework/check.h"
+#include "sw/device/lib/testing/test_framework/ottf_main.h"
+
+enum {
+  /* Largest batch to measure; batch sizes are the powers of two up to it. */
+  kMaxBatchSize = 64,
+  /* Length of each message in bytes. */
+  kMessageBytes = 256,
+  /* Number of 32-bit words in the largest (P-384) public key. */
+  kMaxPublicKeyWords = 768 / 32,
+  /* Number of 32-bit words in the largest (P-384) signature. */
+  kMaxSignatureWords = 768 / 32,
+  /* Number of 32-bit words in the largest (P-384) digest. */
+  kMaxDigestWords = 384 / 32,
+};
+
+/**
+ * Operations and sizes of one curve under test.
+ */
+typedef struct ecdsa_curve {
+  const char *name;
+  otcrypto_key_mode_t key_mode;
+  size_t private_key_bytes;
+  size_t public_key_words;
+  size_t signature_words;
+  size_t digest_words;
+  otcrypto_status_t (*keygen)(otcrypto_blinded_key_t *,
+                              otcrypto_unblinded_key_t *);
+  otcrypto_status_t (*hash)(const otcrypto_const_byte_buf_t *,
+                            otcrypto_hash_digest_t *);
+  otcrypto_status_t (*sign)(const otcrypto_blinded_key_t *,
+                            const otcrypto_hash_digest_t,
+                            otcrypto_word32_buf_t *);
+  otcrypto_status_t (*sign_batch)(const otcrypto_blinded_key_t *,
+                                  const otcrypto_const_byte_buf_t *, size_t,
+                                  otcrypto_word32_buf_t *);
+  otcrypto_status_t (*verify_batch)(const otcrypto_unblinded_key_t *,
+                                    const otcrypto_const_byte_buf_t *, size_t,
+                                    const otcrypto_const_word32_buf_t *,
+                                    hardened_bool_t *);
+} ecdsa_curve_t;
+
+static const ecdsa_curve_t kCurves[] = {
+    {
+        .name = "P-256",
+        .key_mode = kOtcryptoKeyModeEcdsaP256,
+        .private_key_bytes = 256 / 8,
+        .public_key_words = 512 / 32,
+        .signature_words = 512 / 32,
+        .digest_words = 256 / 32,
+        .keygen = &otcrypto_ecdsa_p256_keygen,
+        .hash = &otcrypto_sha2_256,
+        .sign = &otcrypto_ecdsa_p256_sign,
+        .sign_batch = &otcrypto_ecdsa_p256_sign_batch,
+        .verify_batch = &otcrypto_ecdsa_p256_verify_batch,
+    },
+    {
+        .name = "P-384",
+        .key_mode = kOtcryptoKeyModeEcdsaP384,
+        .private_key_bytes = 384 / 8,
+        .public_key_words = 768 / 32,
+        .signature_words = 768 / 32,
+        .digest_words = 384 / 32,
+        .keygen = &otcrypto_ecdsa_p384_keygen,
+        .hash = &otcrypto_sha2_384,
+        .sign = &otcrypto_ecdsa_p384_sign,
+        .sign_batch = &otcrypto_ecdsa_p384_sign_batch,
+        .verify_batch = &otcrypto_ecdsa_p384_verify_batch,
+    },
+};
+
+static uint8_t messages[kMaxBatchSize][kMessageBytes];
+static otcrypto_const_byte_buf_t message_bufs[kMaxBatchSize];
+static uint32_t signatures[kMaxBatchSize][kMaxSignatureWords];
+static otcrypto_word32_buf_t signature_bufs[kMaxBatchSize];
+static otcrypto_const_word32_buf_t const_signature_bufs[kMaxBatchSize];
+static hardened_bool_t verification_results[kMaxBatchSize];
+
+/**
+ * Logs the throughput of `count` operations that took `cycles` cycles.
+ */
+static void log_rate(const char *curve, const char *op, size_t count,
+                     uint32_t cycles) {
+  // Signatures per second, in thousandths so that slow targets still show
+  // something useful.
+  uint64_t rate = (uint64_t)count * kClockFreqCpuHz * 1000 / cycles;
+  LOG_INFO("%s %s x%d: %d cycles, %d.%03d sig/s", curve, op, count, cycles,
+           (uint32_t)(rate / 1000), (uint32_t)(rate % 1000));
+}
+
+/**
+ * Measures sequential and batched signing and batched verification on one
+ * curve for every batch size.
+ */
+static status_t run_curve(const ecdsa_curve_t *curve) {
+  otcrypto_key_config_t config = {
+      .version = otcrypto_lib_version(),
+      .key_mode = curve->key_mode,
+      .key_length = curve->private_key_bytes,
+      .hw_backed = kHardenedBoolFalse,
+      .security_level = kOtcryptoKeySecurityLevelLow,
+  };
+  uint32_t keyblob[keyblob_num_words(config)];
+  otcrypto_blinded_key_t private_key = {
+      .config = config,
+      .keyblob_length = sizeof(keyblob),
+      .keyblob = keyblob,
+  };
+  uint32_t pk[kMaxPublicKeyWords];
+  otcrypto_unblinded_key_t public_key = {
+      .key_mode = curve->key_mode,
+      .key_length = curve->public_key_words * sizeof(uint32_t),
+      .key = pk,
+  };
+  TRY(curve->keygen(&private_key, &public_key));
+
+  for (size_t i = 0; i < kMaxBatchSize; i++) {
+    otcrypto_word32_buf_t sig = OTCRYPTO_MAKE_BUF(
+        otcrypto_word32_buf_t, signatures[i], curve->signature_words);
+    otcrypto_const_word32_buf_t const_sig = OTCRYPTO_MAKE_BUF(
+        otcrypto_const_word32_buf_t, signatures[i], curve->signature_words);
+    // The buffer fields are const, so copy the whole structs into place.
+    memcpy(&signature_bufs[i], &sig, sizeof(sig));
+    memcpy(&const_signature_bufs[i], &const_sig, sizeof(const_sig));
+  }
+
+  for (size_t n = 1; n <= kMaxBatchSize; n *= 2) {
+    // Hash and sign each message in turn, as a caller without the batch API
+    // would.
+    uint64_t t_start = profile_start();
+    for (size_t i = 0; i < n; i++) {
+      uint32_t digest_data[kMaxDigestWords];
+      otcrypto_hash_digest_t digest = {
+          .data = digest_data,
+          .len = curve->digest_words,
+      };
+      TRY(curve->hash(&message_bufs[i], &digest));
+      TRY(curve->sign(&private_key, digest, &signature_bufs[i]));
+    }
+    log_rate(curve->name, "sign", n, profile_end(t_start));
+
+    t_start = profile_start();
+    TRY(curve->sign_batch(&private_key, message_bufs, n, signature_bufs));
+    log_rate(curve->name, "sign_batch", n, profile_end(t_start));
+
+    t_start = profile_start();
+    TRY(curve->verify_batch(&public_key, message_bufs, n,
+                            const_signature_bufs, verification_results));
+    log_rate(curve->name, "verify_batch", n, profile_end(t_start));
+
+    for (size_t i = 0; i < n; i++) {
+      TRY_CHECK(verification_results[i] == kHardenedBoolTrue,
+                "Signature %d of the %s batch of %d failed verification.", i,
+                curve->name, n);
+    }
+  }
+  return OK_STATUS();
+}
+
+static status_t batch_timing_test(void) {
+  for (size_t i = 0; i < kMaxBatchSize; i++) {
+    for (size_t j = 0; j < kMessageBytes; j++) {
+      messages[i][j] = (uint8_t)(i * 31 + j);
+    }
+    otcrypto_const_byte_buf_t buf = OTCRYPTO_MAKE_BUF(
+        otcrypto_const_byte_buf_t, messages[i], kMessageBytes);
+    memcpy(&message_bufs[i], &buf, sizeof(buf));
+  }
+  for (size_t i = 0; i < ARRAYSIZE(kCurves); i++) {
+    TRY(run_curve(&kCurves[i]));
+  }
+  return OK_STATUS();
+}
+
+OTTF_DEFINE_TEST_CONFIG();
+
+bool test_main(void) {
+  status_t result = OK_STATUS();
+
+  CHECK_STATUS_OK(otcrypto_init(kOtcryptoKeySecurityLevelLow));
+  EXECUTE_TEST(result, batch_timing_test);
+
+  return status_ok(result);
+}
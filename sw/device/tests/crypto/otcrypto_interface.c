@@ -84,6 +84,8 @@ volatile otcrypto_interface_t otcrypto = {
     .drbg_reseed = &otcrypto_drbg_reseed,
     .drbg_generate = &otcrypto_drbg_generate,
     .drbg_uninstantiate = &otcrypto_drbg_uninstantiate,
+    .drbg_pool_enable = &otcrypto_drbg_pool_enable,
+    .drbg_pool_disable = &otcrypto_drbg_pool_disable,
 
     // Manual DRBG (user-supplied entropy, for example for known-answer
     // testing).
@@ -122,6 +124,7 @@ volatile otcrypto_interface_t otcrypto = {
     .sha2_init = &otcrypto_sha2_init,
     .sha2_update = &otcrypto_sha2_update,
     .sha2_final = &otcrypto_sha2_final,
+    .sha2_update_multistream = &otcrypto_sha2_update_multistream,
 
     // SHA-3
     .sha3_224 = &otcrypto_sha3_224,
@@ -206,6 +209,8 @@ volatile otcrypto_interface_t otcrypto = {
     .ecdsa_p256_sign = &otcrypto_ecdsa_p256_sign,
     .ecdsa_p256_sign_verify = &otcrypto_ecdsa_p256_sign_verify,
     .ecdsa_p256_verify = &otcrypto_ecdsa_p256_verify,
+    .ecdsa_p256_sign_batch = &otcrypto_ecdsa_p256_sign_batch,
+    .ecdsa_p256_verify_batch = &otcrypto_ecdsa_p256_verify_batch,
 
     // ECDH P-256 (blocking).
     .ecdh_p256_keygen = &otcrypto_ecdh_p256_keygen,
@@ -254,6 +259,8 @@ volatile otcrypto_interface_t otcrypto = {
     .ecdsa_p384_sign_config_k = &otcrypto_ecdsa_p384_sign_config_k,
     .ecdsa_p384_sign_verify = &otcrypto_ecdsa_p384_sign_verify,
     .ecdsa_p384_verify = &otcrypto_ecdsa_p384_verify,
+    .ecdsa_p384_sign_batch = &otcrypto_ecdsa_p384_sign_batch,
+    .ecdsa_p384_verify_batch = &otcrypto_ecdsa_p384_verify_batch,
 
     // ECDH P-384 (blocking).
     .ecdh_p384_keygen = &otcrypto_ecdh_p384_keygen,
@@ -141,6 +141,8 @@ typedef struct otcrypto_interface_t {
   otcrypto_status_t (*drbg_manual_generate)(const otcrypto_const_byte_buf_t *,
                                             otcrypto_word32_buf_t *);
   otcrypto_status_t (*drbg_uninstantiate)(void);
+  otcrypto_status_t (*drbg_pool_enable)(otcrypto_word32_buf_t *, size_t);
+  otcrypto_status_t (*drbg_pool_disable)(void);
 
   // HKDF
   otcrypto_status_t (*hkdf)(const otcrypto_blinded_key_t *,
@@ -196,6 +198,8 @@ typedef struct otcrypto_interface_t {
                                    const otcrypto_const_byte_buf_t *);
   otcrypto_status_t (*sha2_final)(otcrypto_sha2_context_t *,
                                   otcrypto_hash_digest_t *);
+  otcrypto_status_t (*sha2_update_multistream)(
+      const otcrypto_sha2_stream_update_t *, size_t);
 
   // SHA-3
   otcrypto_status_t (*sha3_224)(const otcrypto_const_byte_buf_t *,
@@ -355,6 +359,12 @@ typedef struct otcrypto_interface_t {
                                          const otcrypto_hash_digest_t,
                                          const otcrypto_const_word32_buf_t *,
                                          hardened_bool_t *);
+  otcrypto_status_t (*ecdsa_p256_sign_batch)(
+      const otcrypto_blinded_key_t *, const otcrypto_const_byte_buf_t *,
+      size_t, otcrypto_word32_buf_t *);
+  otcrypto_status_t (*ecdsa_p256_verify_batch)(
+      const otcrypto_unblinded_key_t *, const otcrypto_const_byte_buf_t *,
+      size_t, const otcrypto_const_word32_buf_t *, hardened_bool_t *);
   otcrypto_status_t (*ecdh_p256_keygen)(otcrypto_blinded_key_t *,
                                         otcrypto_unblinded_key_t *);
   otcrypto_status_t (*ecdh_p256)(const otcrypto_blinded_key_t *,
@@ -429,6 +439,12 @@ typedef struct otcrypto_interface_t {
                                          const otcrypto_hash_digest_t,
                                          const otcrypto_const_word32_buf_t *,
                                          hardened_bool_t *);
+  otcrypto_status_t (*ecdsa_p384_sign_batch)(
+      const otcrypto_blinded_key_t *, const otcrypto_const_byte_buf_t *,
+      size_t, otcrypto_word32_buf_t *);
+  otcrypto_status_t (*ecdsa_p384_verify_batch)(
+      const otcrypto_unblinded_key_t *, const otcrypto_const_byte_buf_t *,
+      size_t, const otcrypto_const_word32_buf_t *, hardened_bool_t *);
   otcrypto_status_t (*ecdh_p384_keygen)(otcrypto_blinded_key_t *,
                                         otcrypto_unblinded_key_t *);
   otcrypto_status_t (*ecdh_p384)(const otcrypto_blinded_key_t *,
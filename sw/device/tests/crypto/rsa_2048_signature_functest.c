@@ -7,6 +7,7 @@
 #include "sw/device/lib/crypto/impl/status.h"
 #include "sw/device/lib/crypto/include/config.h"
 #include "sw/device/lib/crypto/include/cryptolib_build_info.h"
+#include "sw/device/lib/crypto/include/drbg.h"
 #include "sw/device/lib/crypto/include/entropy_src.h"
 #include "sw/device/lib/crypto/include/integrity.h"
 #include "sw/device/lib/crypto/include/rsa.h"
@@ -525,6 +526,50 @@ status_t all_hashes_sign_verify_test(void) {
   return OK_STATUS();
 }
 
+status_t pss_sign_drbg_pool_test(void) {
+  // Take a few words from the DRBG output pool and keep a copy of the rest.
+  otcrypto_const_byte_buf_t kEmptyBuffer =
+      OTCRYPTO_MAKE_BUF(otcrypto_const_byte_buf_t, NULL, 0);
+  TRY(otcrypto_drbg_instantiate(/*perso_string=*/&kEmptyBuffer));
+  uint32_t pool_data[16];
+  otcrypto_word32_buf_t pool = OTCRYPTO_MAKE_BUF(
+      otcrypto_word32_buf_t, pool_data, ARRAYSIZE(pool_data));
+  TRY(otcrypto_drbg_pool_enable(&pool, /*reseed_interval=*/4));
+  uint32_t output_data[4];
+  otcrypto_word32_buf_t output = OTCRYPTO_MAKE_BUF(
+      otcrypto_word32_buf_t, output_data, ARRAYSIZE(output_data));
+  TRY(otcrypto_drbg_generate(/*additional_input=*/&kEmptyBuffer, &output));
+  uint32_t stale[ARRAYSIZE(pool_data) - ARRAYSIZE(output_data)];
+  memcpy(stale, &pool_data[ARRAYSIZE(output_data)], sizeof(stale));
+
+  // PSS signing re-instantiates the CSRNG to draw the salt.
+  uint32_t sig[kRsa2048NumWords];
+  hardened_bool_t verification_result;
+  TRY(run_rsa_2048_sign(kTestMessage, kTestMessageLen, kOtcryptoRsaPaddingPss,
+                        kOtcryptoHashModeSha256, sig));
+  TRY(run_rsa_2048_verify(kTestMessage, kTestMessageLen, sig,
+                          kOtcryptoRsaPaddingPss, kOtcryptoHashModeSha256,
+                          &verification_result));
+  TRY_CHECK(verification_result == kHardenedBoolTrue);
+
+  // The pool must not hand out words from before the signature. Signing
+  // leaves the CSRNG uninstantiated, so the refill may fail; either way, the
+  // buffered words must be gone.
+  status_t result =
+      otcrypto_drbg_generate(/*additional_input=*/&kEmptyBuffer, &output);
+  if (status_ok(result)) {
+    TRY_CHECK(memcmp(output_data, stale, sizeof(output_data)) != 0);
+  }
+  TRY_CHECK(memcmp(&pool_data[2 * ARRAYSIZE(output_data)],
+                   &stale[ARRAYSIZE(output_data)],
+                   sizeof(stale) - sizeof(output_data)) != 0);
+
+  // Clean up
+  TRY(otcrypto_drbg_pool_disable());
+  TRY(otcrypto_drbg_uninstantiate());
+  return OK_STATUS();
+}
+
 OTTF_DEFINE_TEST_CONFIG();
 
 bool test_main(void) {
@@ -537,5 +582,6 @@ bool test_main(void) {
   EXECUTE_TEST(test_result, pss_verify_invalid_test);
   EXECUTE_TEST(test_result, all_hashes_sign_verify_test);
   EXECUTE_TEST(test_result, run_signature_negative_tests);
+  EXECUTE_TEST(test_result, pss_sign_drbg_pool_test);
   return status_ok(test_result);
 }